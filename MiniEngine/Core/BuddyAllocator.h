@@ -21,10 +21,10 @@
 #pragma once
 
 #include "GpuBuffer.h"
+#include "BuddyRangeAllocator.h"
 #include <vector>
 #include <queue>
 #include <mutex>
-#include <set>
 
 // Unfortunately the api restricts the minimum size of a placed buffer resource to 64k
 #define MIN_PLACED_BUFFER_SIZE (64 * 1024)
@@ -96,12 +96,8 @@ public:
 
 	inline void Reset()
 	{
-		// Clear the free blocks collection  
-		m_freeBlocks.clear();
-
-		// Initialize the pool with a free inner block of max inner block size  
-		m_freeBlocks.resize(m_maxOrder + 1);
-		m_freeBlocks[m_maxOrder].insert((size_t)0);
+		// Return the pool to a single free block of max block size
+		m_Ranges.Reset();
 	}
 
 	void CleanUpAllocations();
@@ -113,11 +109,10 @@ private:
 	const D3D12_HEAP_TYPE m_heapType;
 
 	std::queue<BuddyBlock*> m_deferredDeletionQueue;
-	std::vector<std::set<size_t>> m_freeBlocks;
-	UINT m_maxOrder;
 	const size_t m_baseOffset;
 	const size_t m_maxBlockSize;
 	const size_t m_minBlockSize;
+	BuddyRangeAllocator m_Ranges;
 
 	const kBuddyAllocationStrategy m_allocationStrategy;
 
@@ -128,19 +123,12 @@ private:
 
 	inline UINT UnitSizeToOrder(size_t size) const
 	{
-		return UINT(ceil(log2f(float(size))));
-	}
-
-	inline size_t GetBuddyOffset(const size_t &offset, const size_t &size)
-	{
-		return offset ^ size;
+		return BuddyRangeAllocator::GetOrder(UINT32(size));
 	}
 
 	void DeallocateInternal(BuddyBlock* pBlock);
 
 	size_t OrderToUnitSize(UINT order) const { return ((size_t)1) << order; }
-	size_t AllocateBlock(UINT order);
-	void DeallocateBlock(size_t offset, UINT order);
 
 #if defined(PROFILE) || defined(_DEBUG)
 	size_t m_SpaceUsed;
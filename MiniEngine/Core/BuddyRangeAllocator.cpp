@@ -0,0 +1,328 @@
+#include "pch.h"
+#include "BuddyRangeAllocator.h"
+#include "SystemTime.h"
+#include <set>
+
+BuddyRangeAllocator::BuddyRangeAllocator(UINT32 MaxOrder)
+    : m_MaxOrder(MaxOrder),
+      m_NonEmptyOrders(0),
+      m_FreeUnits(0)
+{
+    assert(MaxOrder < MaxOrders);
+
+    UINT32 WordCount = 0;
+    for (UINT32 Order = 0; Order <= m_MaxOrder; ++Order)
+    {
+        OrderBitmap& Bitmap = m_Orders[Order];
+        Bitmap.LevelCount = 0;
+
+        UINT32 BitCount = 1U << (m_MaxOrder - Order);
+        do
+        {
+            const UINT32 LevelWords = (BitCount + 63) / 64;
+            Bitmap.LevelOffsets[Bitmap.LevelCount++] = WordCount;
+            WordCount += LevelWords;
+            BitCount = LevelWords;
+        }
+        while (BitCount > 1);
+        assert(Bitmap.LevelCount <= MaxLevels);
+    }
+    m_Words.resize(WordCount);
+
+    Reset();
+}
+
+void BuddyRangeAllocator::Reset()
+{
+    std::fill(m_Words.begin(), m_Words.end(), 0);
+    m_NonEmptyOrders = 0;
+    SetFree(m_MaxOrder, 0);
+    m_FreeUnits = 1U << m_MaxOrder;
+}
+
+UINT32 BuddyRangeAllocator::FindFirstFree(UINT32 Order) const
+{
+    // Each summary bit leads to a word below with a bit set
+    const OrderBitmap& Bitmap = m_Orders[Order];
+    UINT32 Index = 0;
+    for (INT32 Level = (INT32)Bitmap.LevelCount - 1; Level >= 0; --Level)
+    {
+        unsigned long Bit;
+        _BitScanForward64(&Bit, m_Words[Bitmap.LevelOffsets[Level] + Index]);
+        Index = Index * 64 + Bit;
+    }
+    return Index;
+}
+
+void BuddyRangeAllocator::SetFree(UINT32 Order, UINT32 Index)
+{
+    const OrderBitmap& Bitmap = m_Orders[Order];
+    for (UINT32 Level = 0; Level < Bitmap.LevelCount; ++Level)
+    {
+        UINT64& Word = m_Words[Bitmap.LevelOffsets[Level] + (Index >> 6)];
+        const bool WasEmpty = (Word == 0);
+        Word |= 1ULL << (Index & 63);
+        if (!WasEmpty)
+        {
+            return;
+        }
+        Index >>= 6;
+    }
+    m_NonEmptyOrders |= 1U << Order;
+}
+
+void BuddyRangeAllocator::ClearFree(UINT32 Order, UINT32 Index)
+{
+    const OrderBitmap& Bitmap = m_Orders[Order];
+    for (UINT32 Level = 0; Level < Bitmap.LevelCount; ++Level)
+    {
+        UINT64& Word = m_Words[Bitmap.LevelOffsets[Level] + (Index >> 6)];
+        Word &= ~(1ULL << (Index & 63));
+        if (Word != 0)
+        {
+            return;
+        }
+        Index >>= 6;
+    }
+    m_NonEmptyOrders &= ~(1U << Order);
+}
+
+bool BuddyRangeAllocator::IsFree(UINT32 Offset, UINT32 Order) const
+{
+    const UINT32 Index = Offset >> Order;
+    return (m_Words[m_Orders[Order].LevelOffsets[0] + (Index >> 6)] >> (Index & 63)) & 1;
+}
+
+INT32 BuddyRangeAllocator::GetLargestFreeOrder() const
+{
+    unsigned long Order;
+    return _BitScanReverse(&Order, m_NonEmptyOrders) ? (INT32)Order : -1;
+}
+
+UINT32 BuddyRangeAllocator::Allocate(UINT32 Order)
+{
+    if (Order > m_MaxOrder)
+    {
+        return InvalidOffset;
+    }
+
+    unsigned long OrderDelta;
+    if (!_BitScanForward(&OrderDelta, m_NonEmptyOrders >> Order))
+    {
+        return InvalidOffset;
+    }
+
+    UINT32 BlockOrder = Order + OrderDelta;
+    const UINT32 Index = FindFirstFree(BlockOrder);
+    ClearFree(BlockOrder, Index);
+    const UINT32 Offset = Index << BlockOrder;
+
+    // Keep the lower half at each split, returning the upper halves
+    while (BlockOrder > Order)
+    {
+        --BlockOrder;
+        SetFree(BlockOrder, (Offset >> BlockOrder) + 1);
+    }
+
+    m_FreeUnits -= 1U << Order;
+    return Offset;
+}
+
+void BuddyRangeAllocator::Free(UINT32 Offset, UINT32 Order)
+{
+    assert(Order <= m_MaxOrder && (Offset & ((1U << Order) - 1)) == 0);
+    assert(!IsFree(Offset, Order));
+
+    m_FreeUnits += 1U << Order;
+    while (Order < m_MaxOrder)
+    {
+        const UINT32 Buddy = Offset ^ (1U << Order);
+        if (!IsFree(Buddy, Order))
+        {
+            break;
+        }
+        ClearFree(Order, Buddy >> Order);
+        Offset &= ~(1U << Order);
+        ++Order;
+    }
+    SetFree(Order, Offset >> Order);
+}
+
+namespace
+{
+    // The free-set bookkeeping BuddyAllocator used before, kept to check against
+    class SetBuddyAllocator
+    {
+    public:
+        explicit SetBuddyAllocator(UINT32 MaxOrder) : m_MaxOrder(MaxOrder), m_FreeBlocks(MaxOrder + 1)
+        {
+            m_FreeBlocks[MaxOrder].insert(0);
+        }
+
+        UINT32 Allocate(UINT32 Order)
+        {
+            if (Order > m_MaxOrder)
+            {
+                return BuddyRangeAllocator::InvalidOffset;
+            }
+
+            auto it = m_FreeBlocks[Order].begin();
+            if (it != m_FreeBlocks[Order].end())
+            {
+                const UINT32 Offset = *it;
+                m_FreeBlocks[Order].erase(it);
+                return Offset;
+            }
+
+            const UINT32 Left = Allocate(Order + 1);
+            if (Left != BuddyRangeAllocator::InvalidOffset)
+            {
+                m_FreeBlocks[Order].insert(Left + (1U << Order));
+            }
+            return Left;
+        }
+
+        void Free(UINT32 Offset, UINT32 Order)
+        {
+            const UINT32 Buddy = Offset ^ (1U << Order);
+            auto it = m_FreeBlocks[Order].find(Buddy);
+            if (Order < m_MaxOrder && it != m_FreeBlocks[Order].end())
+            {
+                m_FreeBlocks[Order].erase(it);
+                Free(std::min(Offset, Buddy), Order + 1);
+            }
+            else
+            {
+                m_FreeBlocks[Order].insert(Offset);
+            }
+        }
+
+    private:
+        UINT32 m_MaxOrder;
+        std::vector<std::set<UINT32>> m_FreeBlocks;
+    };
+
+    struct BuddyOperation
+    {
+        UINT32 Order;       // Allocations only
+        UINT32 LiveIndex;   // Frees only: which live block goes
+        bool IsAllocation;
+    };
+
+    // Replays Ops, recording each allocation's offset, and returns the elapsed milliseconds.
+    // The live list is kept the same way for both allocators so frees pick the same blocks.
+    template <typename Allocator>
+    DOUBLE ReplayBuddyOperations(Allocator& A, const std::vector<BuddyOperation>& Ops, std::vector<UINT32>& Offsets,
+        std::vector<std::pair<UINT32, UINT32>>& Live)
+    {
+        Offsets.resize(Ops.size());
+        Live.clear();
+
+        const INT64 StartTick = SystemTime::GetCurrentTick();
+        for (size_t i = 0; i < Ops.size(); ++i)
+        {
+            const BuddyOperation& Op = Ops[i];
+            if (Op.IsAllocation)
+            {
+                const UINT32 Offset = A.Allocate(Op.Order);
+                Offsets[i] = Offset;
+                if (Offset != BuddyRangeAllocator::InvalidOffset)
+                {
+                    Live.push_back(std::make_pair(Offset, Op.Order));
+                }
+            }
+            else if (!Live.empty())
+            {
+                const UINT32 Victim = Op.LiveIndex % (UINT32)Live.size();
+                A.Free(Live[Victim].first, Live[Victim].second);
+                Live[Victim] = Live.back();
+                Live.pop_back();
+                Offsets[i] = 0;
+            }
+        }
+        return SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - StartTick);
+    }
+}
+
+bool BuddyRangeAllocator::Benchmark(UINT32 OperationCount, UINT32 MaxOrder)
+{
+    MaxOrder = std::min(std::max(MaxOrder, 1U), MaxOrders - 1);
+
+    UINT32 Seed = 1;
+    auto Random = [&Seed]() { Seed = Seed * 1664525 + 1013904223; return Seed >> 8; };
+
+    // Mostly small blocks with occasional large ones; phases of growth and shrinkage keep
+    // the allocator moving between nearly empty and nearly full
+    std::vector<BuddyOperation> Ops(OperationCount);
+    UINT32 LiveEstimate = 0;
+    for (UINT32 i = 0; i < OperationCount; ++i)
+    {
+        BuddyOperation& Op = Ops[i];
+        const bool Growing = ((i / 4096) & 1) == 0;
+        Op.IsAllocation = LiveEstimate == 0 || Random() % 100 < (Growing ? 65U : 35U);
+        const UINT32 Roll = Random() % 100;
+        Op.Order = Roll < 60 ? 0 : (Roll < 90 ? 1 + Random() % 3 : Random() % (MaxOrder + 1));
+        Op.LiveIndex = Random();
+        LiveEstimate = Op.IsAllocation ? LiveEstimate + 1 : LiveEstimate - 1;
+    }
+
+    bool Valid = true;
+
+    // Order computation, including sizes where float log2 rounds down
+    for (UINT32 UnitCount = 1; UnitCount <= (1U << 20) && Valid; ++UnitCount)
+    {
+        const UINT32 Order = GetOrder(UnitCount);
+        Valid = (1ULL << Order) >= UnitCount && (Order == 0 || (1ULL << (Order - 1)) < UnitCount);
+    }
+    Valid = Valid && GetOrder(0x80000000) == 31 && GetOrder(0x80000001) == 32;
+
+    std::vector<UINT32> ReferenceOffsets;
+    std::vector<UINT32> Offsets;
+    std::vector<std::pair<UINT32, UINT32>> Live;
+
+    SetBuddyAllocator Reference(MaxOrder);
+    const DOUBLE ReferenceMsec = ReplayBuddyOperations(Reference, Ops, ReferenceOffsets, Live);
+
+    BuddyRangeAllocator Allocator(MaxOrder);
+    const DOUBLE Msec = ReplayBuddyOperations(Allocator, Ops, Offsets, Live);
+    const UINT32 FinalFreeUnits = Allocator.GetFreeUnits();
+
+    UINT32 AllocationCount = 0;
+    UINT32 FailedCount = 0;
+    for (UINT32 i = 0; i < OperationCount; ++i)
+    {
+        Valid = Valid && Offsets[i] == ReferenceOffsets[i];
+        if (Ops[i].IsAllocation)
+        {
+            ++AllocationCount;
+            FailedCount += Offsets[i] == InvalidOffset ? 1 : 0;
+        }
+    }
+
+    // Live blocks must not overlap, and the free count must account for them
+    std::sort(Live.begin(), Live.end());
+    UINT64 LiveUnits = 0;
+    for (size_t i = 0; i < Live.size(); ++i)
+    {
+        const UINT32 End = Live[i].first + (1U << Live[i].second);
+        Valid = Valid && (i + 1 == Live.size() || End <= Live[i + 1].first);
+        LiveUnits += 1ULL << Live[i].second;
+    }
+    Valid = Valid && LiveUnits + Allocator.GetFreeUnits() == (1ULL << MaxOrder);
+
+    // Everything must merge back into one block once released
+    for (const auto& Block : Live)
+    {
+        Allocator.Free(Block.first, Block.second);
+    }
+    Valid = Valid && Allocator.GetFreeUnits() == (1U << MaxOrder) && Allocator.IsFree(0, MaxOrder) &&
+        Allocator.GetLargestFreeOrder() == (INT32)MaxOrder;
+
+    Utility::PrintfConsole("Buddy allocator benchmark: %u operations (%u allocations, %u failed), 2^%u units\n",
+        OperationCount, AllocationCount, FailedCount, MaxOrder);
+    Utility::PrintfConsole("  Ordered free sets:   %10.0f ops/s\n", OperationCount * 1000.0 / std::max(ReferenceMsec, 1e-3));
+    Utility::PrintfConsole("  Free bitmaps:        %10.0f ops/s\n", OperationCount * 1000.0 / std::max(Msec, 1e-3));
+    Utility::PrintfConsole("  Final live units:    %10llu, %u free\n", LiveUnits, FinalFreeUnits);
+
+    return Valid;
+}
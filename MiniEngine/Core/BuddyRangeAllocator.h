@@ -0,0 +1,68 @@
+#pragma once
+
+#include <vector>
+
+// Offset bookkeeping behind BuddyAllocator, kept free of D3D so it can be exercised on its
+// own.  Manages 2^MaxOrder units as power-of-two blocks.  Each order keeps its free blocks
+// in a bitmap with summary levels above it, one bit per nonzero word below, so the lowest
+// free block of an order takes a few word scans to find and a buddy takes one bit test to
+// check.  Allocation takes the lowest free block of the smallest order that has one and
+// splits it down, the same choice the ordered free sets this replaces made.  Nothing is
+// allocated after construction.
+//
+// Not thread safe.
+class BuddyRangeAllocator
+{
+public:
+    static const UINT32 InvalidOffset = 0xFFFFFFFF;
+    static const UINT32 MaxOrders = 31;
+
+    explicit BuddyRangeAllocator(UINT32 MaxOrder);
+
+    // Smallest order whose blocks hold UnitCount units.
+    static UINT32 GetOrder(UINT32 UnitCount)
+    {
+        unsigned long HighBit;
+        return UnitCount > 1 && _BitScanReverse(&HighBit, UnitCount - 1) ? HighBit + 1 : 0;
+    }
+
+    // Returns the unit offset of a free block of 2^Order units, or InvalidOffset.
+    UINT32 Allocate(UINT32 Order);
+
+    // Returns a block, merging it with its buddy for as long as that is free too.
+    void Free(UINT32 Offset, UINT32 Order);
+
+    // Frees everything at once.
+    void Reset();
+
+    bool IsFree(UINT32 Offset, UINT32 Order) const;
+    UINT32 GetMaxOrder() const { return m_MaxOrder; }
+    UINT32 GetFreeUnits() const { return m_FreeUnits; }
+
+    // Largest order with a free block, or -1 when full.
+    INT32 GetLargestFreeOrder() const;
+
+    // Drives random allocate/free churn through this allocator and through the ordered-set
+    // implementation it replaced, checking every offset matches and that everything merges
+    // back once freed, then reports allocations per second for both.
+    static bool Benchmark(UINT32 OperationCount, UINT32 MaxOrder);
+
+private:
+    static const UINT32 MaxLevels = 6;
+
+    struct OrderBitmap
+    {
+        UINT32 LevelOffsets[MaxLevels];    // Into m_Words, one word at the top level
+        UINT32 LevelCount;
+    };
+
+    UINT32 m_MaxOrder;
+    UINT32 m_NonEmptyOrders;
+    UINT32 m_FreeUnits;
+    OrderBitmap m_Orders[MaxOrders];
+    std::vector<UINT64> m_Words;
+
+    UINT32 FindFirstFree(UINT32 Order) const;
+    void SetFree(UINT32 Order, UINT32 Index);
+    void ClearFree(UINT32 Order, UINT32 Index);
+};
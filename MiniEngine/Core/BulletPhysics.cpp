@@ -1,13 +1,23 @@
 #include "pch.h"
 #include "BulletPhysics.h"
 #include "LineRender.h"
+#include "SystemTime.h"
+#include "LatencyHistogram.h"
+#include <algorithm>
 
 #define BT_NO_SIMD_OPERATOR_OVERLOADS 1
 #include "..\3rdParty\Bullet\src\btBulletCollisionCommon.h"
 #include "..\3rdParty\Bullet\src\btBulletDynamicsCommon.h"
+#if BT_THREADSAFE
+#include "..\3rdParty\Bullet\src\LinearMath\btThreads.h"
+#include "..\3rdParty\Bullet\src\BulletCollision\CollisionDispatch\btCollisionDispatcherMt.h"
+#include "..\3rdParty\Bullet\src\BulletDynamics\Dynamics\btDiscreteDynamicsWorldMt.h"
+#endif
 
 static const USHORT WaterCollisionGroupFlag = 0x8000;
 
+static LatencyHistogram g_PhysicsStepHistogram("PhysicsStep");
+
 STRUCT_TEMPLATE_START_INLINE(AxleConfig, nullptr, nullptr)
 MEMBER_FLOAT(ZPos)
 MEMBER_FLOAT(YPos)
@@ -252,9 +262,6 @@ VOID RigidBody::Initialize( CollisionShape* pShape, FLOAT Mass, CXMMATRIX matTra
         m_pRigidBody->setCcdMotionThreshold( pShape->GetSweptSphereRadius() * 0.5f );
     }
 
-    m_pContactPoints = NULL;
-    m_dwTotalContactPoints = 0;
-    m_dwActiveContactPoints = 0;
     m_CollisionMask = 0;
 
     m_pWorld = NULL;
@@ -532,62 +539,6 @@ VOID RigidBody::ClearAngularVelocity()
     m_pRigidBody->setAngularVelocity( btVector3( 0, 0, 0 ) );
 }
 
-VOID RigidBody::ClearContactPoints()
-{
-    if( IsTrackingContactPoints() )
-    {
-        m_dwActiveContactPoints = 0;
-    }
-}
-
-VOID RigidBody::TrackContactPoints( DWORD dwCount )
-{
-    if( dwCount > m_dwTotalContactPoints )
-    {
-        if( m_pContactPoints != NULL )
-        {
-            delete[] m_pContactPoints;
-        }
-        m_dwTotalContactPoints = dwCount;
-        m_pContactPoints = new ContactPoint[dwCount];
-    }
-    else if( dwCount == 0 )
-    {
-        if( m_pContactPoints != NULL )
-        {
-            delete[] m_pContactPoints;
-            m_pContactPoints = nullptr;
-        }
-        m_dwTotalContactPoints = 0;
-    }
-    m_dwActiveContactPoints = 0;
-}
-
-BOOL RigidBody::AddContactPoint( CXMVECTOR vLocalPos, CXMVECTOR Distance, RigidBody* pOtherRigidBody )
-{
-    if( !IsTrackingContactPoints() )
-    {
-        return FALSE;
-    }
-    if( m_dwActiveContactPoints >= m_dwTotalContactPoints )
-    {
-        return FALSE;
-    }
-    if( pOtherRigidBody != nullptr && !TestCollisionMask( pOtherRigidBody ) )
-    {
-        return FALSE;
-    }
-
-    DWORD i = m_dwActiveContactPoints;
-    ++m_dwActiveContactPoints;
-
-    m_pContactPoints[i].pOtherBody = pOtherRigidBody;
-    XMStoreFloat3( &m_pContactPoints[i].vLocalPosition, vLocalPos );
-    XMStoreFloat3( &m_pContactPoints[i].vWorldDirection, Distance );
-
-    return TRUE;
-}
-
 XMVECTOR RigidBody::ShootRay( CXMVECTOR Direction, BOOL* pHit )
 {
     return GetPhysicsWorld()->ShootRay( this, Direction, pHit );
@@ -613,11 +564,15 @@ VOID RigidBody::PerformCollisionCallback( LuaContext* pContext, ItemInstance* pI
     assert( pContext != nullptr );
     assert( pII == GetUserData() );
 
-    for( UINT i = 0; i < m_dwActiveContactPoints; ++i )
+    const PhysicsWorld* pWorld = GetPhysicsWorld();
+    const std::vector<ContactEvent>& Events = pWorld->GetContactEvents();
+    UINT32 EventCount = 0;
+    const UINT32* pEventIndices = pWorld->GetContactEvents( this, &EventCount );
+    for( UINT32 i = 0; i < EventCount; ++i )
     {
-        const ContactPoint& CP = m_pContactPoints[i];
-        const RigidBody* pOtherRB = CP.pOtherBody;
-        if( pOtherRB == nullptr )
+        const ContactEvent& CE = Events[pEventIndices[i]];
+        const RigidBody* pOtherRB = ( CE.pBodyA == this ) ? CE.pBodyB : CE.pBodyA;
+        if( CE.Type != CET_Begin || pOtherRB == nullptr )
         {
             continue;
         }
@@ -626,7 +581,9 @@ VOID RigidBody::PerformCollisionCallback( LuaContext* pContext, ItemInstance* pI
         if( pOtherII != nullptr && pOtherII->IsAlive() )
         {
             //DebugSpew( "collision between %S and %S\n", pII->GetItem()->GetName().GetSafeString(), pOtherII->GetItem()->GetName().GetSafeString() );
-            const XMFLOAT3& LocalPos = CP.vLocalPosition;
+            // Scripts take the contact position in this body's space, as they did before contact events
+            XMFLOAT3 LocalPos;
+            XMStoreFloat3( &LocalPos, XMVector3TransformCoord( XMLoadFloat3( &CE.WorldPosition ), XMMatrixInverse( nullptr, GetWorldTransform() ) ) );
             pContext->ExecuteFunctionWithUserdata( m_strCollisionCallbackName, pII, pOtherII, LocalPos.x, LocalPos.y, LocalPos.z );
         }
     }
@@ -777,19 +734,120 @@ PhysicsWorld::PhysicsWorld()
       m_pDispatcher(nullptr),
       m_pOverlappingPairCache(nullptr),
       m_pSolver(nullptr),
-      m_pDynamicsWorld(nullptr)
+      m_pDynamicsWorld(nullptr),
+      m_Multithreaded(false),
+      m_ContactStepIndex(0),
+      m_ContactEventsIndexed(false),
+      m_FixedTimeStep(1.0f / 60.0f),
+      m_MaxStepsPerUpdate(6),
+      m_TimeAccumulator(0)
 {
+    ZeroMemory(&m_LastUpdateStats, sizeof(m_LastUpdateStats));
+}
+
+// Applies the buoyancy gathered during collision dispatch before the solver reads
+// the accumulated forces on each body.
+template <class TBaseWorld>
+class BuoyantDynamicsWorld : public TBaseWorld
+{
+public:
+    using TBaseWorld::TBaseWorld;
+
+protected:
+    virtual void solveConstraints(btContactSolverInfo& SolverInfo) override
+    {
+        PhysicsWorld* pPW = (PhysicsWorld*)this->getWorldUserInfo();
+        assert(pPW != nullptr);
+        pPW->ApplyPendingBuoyancy();
+        TBaseWorld::solveConstraints(SolverInfo);
+    }
+};
+
+#if BT_THREADSAFE
+static btITaskScheduler* GetPhysicsTaskScheduler()
+{
+    static btITaskScheduler* s_pScheduler = []()
+    {
+        btITaskScheduler* pScheduler = btGetPPLTaskScheduler();
+        if (pScheduler == nullptr)
+        {
+            pScheduler = btCreateDefaultTaskScheduler();
+        }
+        if (pScheduler != nullptr)
+        {
+            btSetTaskScheduler(pScheduler);
+        }
+        return pScheduler;
+    }();
+    return s_pScheduler;
+}
+#endif
+
+UINT32 PhysicsWorld::GetMaxThreadCount()
+{
+#if BT_THREADSAFE
+    btITaskScheduler* pScheduler = GetPhysicsTaskScheduler();
+    if (pScheduler != nullptr)
+    {
+        return (UINT32)pScheduler->getMaxNumThreads();
+    }
+#endif
+    return 1;
+}
+
+UINT32 PhysicsWorld::GetThreadCount()
+{
+#if BT_THREADSAFE
+    btITaskScheduler* pScheduler = GetPhysicsTaskScheduler();
+    if (pScheduler != nullptr)
+    {
+        return (UINT32)pScheduler->getNumThreads();
+    }
+#endif
+    return 1;
+}
+
+VOID PhysicsWorld::SetThreadCount( UINT32 ThreadCount )
+{
+#if BT_THREADSAFE
+    btITaskScheduler* pScheduler = GetPhysicsTaskScheduler();
+    if (pScheduler != nullptr)
+    {
+        pScheduler->setNumThreads((INT)std::max(1U, std::min(ThreadCount, GetMaxThreadCount())));
+    }
+#endif
 }
 
 void PhysicsWorld::Initialize(DWORD Flags, XMVECTOR vGravity)
 {
     m_Speed = 1.0f;
+    m_Multithreaded = false;
     m_pCollisionConfiguration = new btDefaultCollisionConfiguration();
-    m_pDispatcher = new btCollisionDispatcher(m_pCollisionConfiguration);
-    m_pDispatcher->setNearCallback((btNearCallback)NearCollisionCallback);
     m_pOverlappingPairCache = new btDbvtBroadphase();
-    m_pSolver = new btSequentialImpulseConstraintSolver();
-    m_pDynamicsWorld = new btDiscreteDynamicsWorld(m_pDispatcher, m_pOverlappingPairCache, m_pSolver, m_pCollisionConfiguration);
+
+#if BT_THREADSAFE
+    if ((Flags & PWF_Multithreaded) != 0 && GetPhysicsTaskScheduler() != nullptr)
+    {
+        // Narrowphase pairs are dispatched in batches across the task scheduler, and each
+        // simulation island is handed to one of the pooled solvers.
+        m_pDispatcher = new btCollisionDispatcherMt(m_pCollisionConfiguration, 40);
+        btConstraintSolverPoolMt* pSolverPool = new btConstraintSolverPoolMt(GetMaxThreadCount());
+        m_pSolver = pSolverPool;
+        m_pDynamicsWorld = new BuoyantDynamicsWorld<btDiscreteDynamicsWorldMt>(m_pDispatcher, m_pOverlappingPairCache, pSolverPool, nullptr, m_pCollisionConfiguration);
+        m_Multithreaded = true;
+    }
+    else
+#endif
+    {
+        m_pDispatcher = new btCollisionDispatcher(m_pCollisionConfiguration);
+        m_pSolver = new btSequentialImpulseConstraintSolver();
+        m_pDynamicsWorld = new BuoyantDynamicsWorld<btDiscreteDynamicsWorld>(m_pDispatcher, m_pOverlappingPairCache, m_pSolver, m_pCollisionConfiguration);
+    }
+    if ((Flags & PWF_Multithreaded) != 0 && !m_Multithreaded)
+    {
+        Utility::Print("PhysicsWorld: multithreading requested, but Bullet was built without BT_THREADSAFE or has no task scheduler; stepping on one thread.\n");
+    }
+    m_pDispatcher->setNearCallback((btNearCallback)NearCollisionCallback);
     m_pDynamicsWorld->setWorldUserInfo(this);
 
     m_pDynamicsWorld->setGravity(*(btVector3*)&vGravity);
@@ -849,27 +907,71 @@ PhysicsWorld::~PhysicsWorld()
     delete m_pCollisionConfiguration;
 }
 
+VOID PhysicsWorld::SetFixedTimeStep( FLOAT TimeStep, UINT32 MaxStepsPerUpdate )
+{
+    assert( TimeStep > 0.0f );
+    assert( MaxStepsPerUpdate > 0 );
+    m_FixedTimeStep = TimeStep;
+    m_MaxStepsPerUpdate = MaxStepsPerUpdate;
+    m_TimeAccumulator = std::min( m_TimeAccumulator, m_FixedTimeStep );
+}
+
 VOID PhysicsWorld::Update( FLOAT DeltaTime )
 {
-    ClearContactPoints();
+    const INT64 StartTick = SystemTime::GetCurrentTick();
+
+    m_ContactEvents.clear();
+    m_BodyContactEventRanges.clear();
+    m_BodyContactEventIndices.clear();
+    m_ContactEventsIndexed = false;
+
+    m_pDynamicsWorld->setWorldUserInfo( this );
 
+    UINT32 StepCount = 0;
+    UINT32 DroppedStepCount = 0;
+    if( m_Speed > 0.0f )
     {
-        auto iter = m_FloatingCorners.begin();
-        auto end = m_FloatingCorners.end();
-        while (iter != end)
+        m_TimeAccumulator += DeltaTime * m_Speed;
+        StepCount = (UINT32)( m_TimeAccumulator / m_FixedTimeStep );
+
+        // Never try to catch up more than m_MaxStepsPerUpdate steps at once; if the
+        // server falls behind, simulated time slows down instead of spiraling.
+        if( StepCount > m_MaxStepsPerUpdate )
         {
-            RigidBody* pRB = iter->first;
-            ++iter;
-            pRB->ResetUnderwater();
+            DroppedStepCount = StepCount - m_MaxStepsPerUpdate;
+            m_TimeAccumulator -= (FLOAT)DroppedStepCount * m_FixedTimeStep;
+            StepCount = m_MaxStepsPerUpdate;
+        }
+
+        for( UINT32 i = 0; i < StepCount; ++i )
+        {
+            ScopedLatencyTimer StepTimer( g_PhysicsStepHistogram );
+            ClearFloatingCorners();
+            m_pDynamicsWorld->stepSimulation( m_FixedTimeStep, 0, m_FixedTimeStep );
+            m_TimeAccumulator -= m_FixedTimeStep;
         }
-        m_FloatingCorners.clear();
+        m_TimeAccumulator = std::max( m_TimeAccumulator, 0.0f );
     }
 
-    m_pDynamicsWorld->setWorldUserInfo( this );
-    if( m_Speed > 0.0f )
+    IndexContactEvents();
+
+    m_LastUpdateStats.StepCount = StepCount;
+    m_LastUpdateStats.DroppedStepCount = DroppedStepCount;
+    m_LastUpdateStats.InterpolationAlpha = m_TimeAccumulator / m_FixedTimeStep;
+    m_LastUpdateStats.StepMilliseconds = (FLOAT)SystemTime::TicksToMillisecs( SystemTime::GetCurrentTick() - StartTick );
+}
+
+VOID PhysicsWorld::ClearFloatingCorners()
+{
+    auto iter = m_FloatingCorners.begin();
+    auto end = m_FloatingCorners.end();
+    while (iter != end)
     {
-        m_pDynamicsWorld->stepSimulation( DeltaTime * m_Speed, 6 );
+        RigidBody* pRB = iter->first;
+        ++iter;
+        pRB->ResetUnderwater();
     }
+    m_FloatingCorners.clear();
 }
 
 void PhysicsWorld::NearCollisionCallback(btBroadphasePair& collisionPair, btCollisionDispatcher& dispatcher, btDispatcherInfo& dispatchInfo)
@@ -880,11 +982,13 @@ void PhysicsWorld::NearCollisionCallback(btBroadphasePair& collisionPair, btColl
     const bool p1water = (p1 != nullptr && (p1->m_collisionFilterGroup & WaterCollisionGroupFlag) != 0);
     if (p0water && !p1water)
     {
-        ApplyBuoyancyForce(RigidBody::Promote(p0->m_clientObject), RigidBody::Promote(p1->m_clientObject));
+        RigidBody* pOtherRB = RigidBody::Promote(p1->m_clientObject);
+        pOtherRB->GetPhysicsWorld()->QueueBuoyancyPair(RigidBody::Promote(p0->m_clientObject), pOtherRB);
     }
     else if (p1water && !p0water)
     {
-        ApplyBuoyancyForce(RigidBody::Promote(p1->m_clientObject), RigidBody::Promote(p0->m_clientObject));
+        RigidBody* pOtherRB = RigidBody::Promote(p0->m_clientObject);
+        pOtherRB->GetPhysicsWorld()->QueueBuoyancyPair(RigidBody::Promote(p1->m_clientObject), pOtherRB);
     }
     else if (p0water && p1water)
     {
@@ -896,6 +1000,25 @@ void PhysicsWorld::NearCollisionCallback(btBroadphasePair& collisionPair, btColl
     }
 }
 
+VOID PhysicsWorld::QueueBuoyancyPair( RigidBody* pWaterRB, RigidBody* pOtherRB )
+{
+    BuoyancyPair Pair = { pWaterRB, pOtherRB };
+    std::lock_guard<std::mutex> Lock(m_BuoyancyPairMutex);
+    m_BuoyancyPairs.push_back(Pair);
+}
+
+VOID PhysicsWorld::ApplyPendingBuoyancy()
+{
+    // Dispatch order depends on thread timing; sorting keeps the corner masks, and
+    // therefore the applied forces, independent of it.
+    std::sort(m_BuoyancyPairs.begin(), m_BuoyancyPairs.end());
+    for (const BuoyancyPair& Pair : m_BuoyancyPairs)
+    {
+        ApplyBuoyancyForce(Pair.pWaterRB, Pair.pOtherRB);
+    }
+    m_BuoyancyPairs.clear();
+}
+
 void PhysicsWorld::ApplyBuoyancyForce(RigidBody* pWaterRB, RigidBody* pOtherRB)
 {
     assert((pWaterRB->GetInternalRigidBody()->getBroadphaseHandle()->m_collisionFilterGroup & WaterCollisionGroupFlag) != 0);
@@ -1001,7 +1124,7 @@ VOID PhysicsWorld::SimulationTickCallback( btDynamicsWorld* pDynamicsWorld, FLOA
 {
     PhysicsWorld* pPW = (PhysicsWorld*)pDynamicsWorld->getWorldUserInfo();
     assert( pPW != nullptr );
-    pPW->ReportContactPoints();
+    pPW->ReportContactEvents();
 }
 
 VOID PhysicsWorld::DebugRender()
@@ -1009,24 +1132,13 @@ VOID PhysicsWorld::DebugRender()
     m_pDynamicsWorld->debugDrawWorld();
 }
 
-VOID PhysicsWorld::ClearContactPoints()
+VOID PhysicsWorld::ReportContactEvents()
 {
-    INT RBCount = m_pDynamicsWorld->getNumCollisionObjects();
-    for( INT i = 0; i < RBCount; ++i )
-    {
-        btCollisionObject* pObj = m_pDynamicsWorld->getCollisionObjectArray()[ i ];
-        btRigidBody* pRB = btRigidBody::upcast( pObj );
-        if( pRB != NULL && pRB->getUserPointer() != NULL )
-        {
-            RigidBody* pRigidBody = (RigidBody*)pRB->getUserPointer();
-            pRigidBody->ClearContactPoints();
-        }
-    }
-}
+    ++m_ContactStepIndex;
 
-VOID PhysicsWorld::ReportContactPoints()
-{
-    INT iNumContactManifolds = m_pDispatcher->getNumManifolds();
+    // Only manifolds that involve a body with a collision callback are considered, so
+    // the cost follows the number of touching pairs rather than the number of bodies.
+    const INT iNumContactManifolds = m_pDispatcher->getNumManifolds();
     for( INT i = 0; i < iNumContactManifolds; ++i )
     {
         const btPersistentManifold* pManifold = m_pDispatcher->getManifoldByIndexInternal( i );
@@ -1034,31 +1146,192 @@ VOID PhysicsWorld::ReportContactPoints()
         if( numContacts <= 0 )
             continue;
 
-        const btCollisionObject* pObjA = static_cast<const btCollisionObject*>( pManifold->getBody0() );
-        const btCollisionObject* pObjB = static_cast<const btCollisionObject*>( pManifold->getBody1() );
-
-        RigidBody* pRigidBodyA = (RigidBody*)pObjA->getUserPointer();
-        RigidBody* pRigidBodyB = (RigidBody*)pObjB->getUserPointer();
-
+        RigidBody* pRigidBodyA = (RigidBody*)pManifold->getBody0()->getUserPointer();
+        RigidBody* pRigidBodyB = (RigidBody*)pManifold->getBody1()->getUserPointer();
         if( pRigidBodyA == nullptr || pRigidBodyB == nullptr )
         {
             continue;
         }
+        if( !pRigidBodyA->IsCollisionCallbackEnabled() && !pRigidBodyB->IsCollisionCallbackEnabled() )
+        {
+            continue;
+        }
+        if( !pRigidBodyA->TestCollisionMask( pRigidBodyB ) )
+        {
+            continue;
+        }
 
+        // Keep a stable body order per pair, flipping the normal along with it.
+        FLOAT NormalSign = 1.0f;
+        if( pRigidBodyB < pRigidBodyA )
+        {
+            std::swap( pRigidBodyA, pRigidBodyB );
+            NormalSign = -1.0f;
+        }
+
+        const btManifoldPoint* pDeepest = &pManifold->getContactPoint( 0 );
+        FLOAT Impulse = 0;
         for( INT ContactIndex = 0; ContactIndex < numContacts; ++ContactIndex )
         {
             const btManifoldPoint& ContactPoint = pManifold->getContactPoint( ContactIndex );
-            btVector3 btdistance = ContactPoint.m_normalWorldOnB * ContactPoint.m_distance1;
-            XMVECTOR Distance = *(XMVECTOR*)&btdistance;
-            if( pRigidBodyA != NULL )
-            {
-                pRigidBodyA->AddContactPoint( *(XMVECTOR*)&ContactPoint.m_localPointA, -Distance, pRigidBodyB );
-            }
-            if( pRigidBodyB != NULL )
+            Impulse += ContactPoint.getAppliedImpulse();
+            if( ContactPoint.getDistance() < pDeepest->getDistance() )
             {
-                pRigidBodyB->AddContactPoint( *(XMVECTOR*)&ContactPoint.m_localPointB, Distance, pRigidBodyA );
+                pDeepest = &ContactPoint;
             }
         }
+
+        // A body on the swapped side reports the point on the other body, so the
+        // position always lies on pBodyB.
+        const btVector3& Position = ( NormalSign > 0 ) ? pDeepest->getPositionWorldOnB() : pDeepest->getPositionWorldOnA();
+        const btVector3 Normal = pDeepest->m_normalWorldOnB * NormalSign;
+
+        ContactPairKey Key = { pRigidBodyA, pRigidBodyB };
+        auto iter = m_ContactPairs.find( Key );
+        if( iter == m_ContactPairs.end() )
+        {
+            ContactPairState NewState = {};
+            NewState.IsNew = true;
+            iter = m_ContactPairs.insert( std::make_pair( Key, NewState ) ).first;
+        }
+
+        // Compound shapes can produce several manifolds for one pair in the same step.
+        ContactPairState& State = iter->second;
+        if( State.TouchStepIndex != m_ContactStepIndex )
+        {
+            State.TouchStepIndex = m_ContactStepIndex;
+            State.Impulse = 0;
+            State.Distance = FLT_MAX;
+        }
+        State.Impulse += Impulse;
+        if( pDeepest->getDistance() < State.Distance )
+        {
+            State.Distance = pDeepest->getDistance();
+            State.WorldPosition = XMFLOAT3( Position.x(), Position.y(), Position.z() );
+            State.WorldNormal = XMFLOAT3( Normal.x(), Normal.y(), Normal.z() );
+        }
+    }
+
+    // Every tracked pair was touching at the end of the previous step, so any pair not
+    // touched in this step has separated.
+    auto iter = m_ContactPairs.begin();
+    while( iter != m_ContactPairs.end() )
+    {
+        ContactPairState& State = iter->second;
+        ContactEvent Event;
+        Event.pBodyA = iter->first.pBodyA;
+        Event.pBodyB = iter->first.pBodyB;
+        Event.WorldPosition = State.WorldPosition;
+        Event.WorldNormal = State.WorldNormal;
+        Event.Impulse = State.Impulse;
+
+        if( State.TouchStepIndex == m_ContactStepIndex )
+        {
+            Event.Type = State.IsNew ? CET_Begin : CET_Persist;
+            State.IsNew = false;
+            m_ContactEvents.push_back( Event );
+            ++iter;
+        }
+        else
+        {
+            Event.Type = CET_End;
+            Event.Impulse = 0;
+            m_ContactEvents.push_back( Event );
+            iter = m_ContactPairs.erase( iter );
+        }
+    }
+}
+
+// Counts the events per body, then scatters event indices into one array so each
+// body's events are contiguous.
+VOID PhysicsWorld::IndexContactEvents()
+{
+    const UINT32 EventCount = (UINT32)m_ContactEvents.size();
+    for( UINT32 i = 0; i < EventCount; ++i )
+    {
+        const ContactEvent& CE = m_ContactEvents[i];
+        m_BodyContactEventRanges[CE.pBodyA].Count++;
+        m_BodyContactEventRanges[CE.pBodyB].Count++;
+    }
+    m_BodyContactEventRanges.erase( (const RigidBody*)nullptr );
+
+    UINT32 FirstIndex = 0;
+    for( auto& Entry : m_BodyContactEventRanges )
+    {
+        Entry.second.FirstIndex = FirstIndex;
+        FirstIndex += Entry.second.Count;
+        Entry.second.Count = 0;
+    }
+
+    m_BodyContactEventIndices.resize( FirstIndex );
+    for( UINT32 i = 0; i < EventCount; ++i )
+    {
+        const ContactEvent& CE = m_ContactEvents[i];
+        if( CE.pBodyA != nullptr )
+        {
+            BodyContactEventRange& RangeA = m_BodyContactEventRanges[CE.pBodyA];
+            m_BodyContactEventIndices[RangeA.FirstIndex + RangeA.Count++] = i;
+        }
+        if( CE.pBodyB != nullptr )
+        {
+            BodyContactEventRange& RangeB = m_BodyContactEventRanges[CE.pBodyB];
+            m_BodyContactEventIndices[RangeB.FirstIndex + RangeB.Count++] = i;
+        }
+    }
+
+    m_ContactEventsIndexed = true;
+}
+
+const UINT32* PhysicsWorld::GetContactEvents( const RigidBody* pRigidBody, UINT32* pEventCount ) const
+{
+    auto iter = m_BodyContactEventRanges.find( pRigidBody );
+    if( iter == m_BodyContactEventRanges.end() )
+    {
+        *pEventCount = 0;
+        return nullptr;
+    }
+    *pEventCount = iter->second.Count;
+    return &m_BodyContactEventIndices[iter->second.FirstIndex];
+}
+
+VOID PhysicsWorld::RemoveContactPairs( RigidBody* pRigidBody )
+{
+    auto iter = m_ContactPairs.begin();
+    while( iter != m_ContactPairs.end() )
+    {
+        if( iter->first.pBodyA == pRigidBody || iter->first.pBodyB == pRigidBody )
+        {
+            iter = m_ContactPairs.erase( iter );
+        }
+        else
+        {
+            ++iter;
+        }
+    }
+
+    // Events already reported this update may still be walked by callbacks, so they stay
+    // in place with the body cleared rather than being erased.
+    if( !m_ContactEventsIndexed )
+    {
+        for( ContactEvent& CE : m_ContactEvents )
+        {
+            if( CE.pBodyA == pRigidBody ) { CE.pBodyA = nullptr; }
+            if( CE.pBodyB == pRigidBody ) { CE.pBodyB = nullptr; }
+        }
+        return;
+    }
+
+    auto RangeIter = m_BodyContactEventRanges.find( pRigidBody );
+    if( RangeIter != m_BodyContactEventRanges.end() )
+    {
+        const BodyContactEventRange& Range = RangeIter->second;
+        for( UINT32 i = 0; i < Range.Count; ++i )
+        {
+            ContactEvent& CE = m_ContactEvents[m_BodyContactEventIndices[Range.FirstIndex + i]];
+            if( CE.pBodyA == pRigidBody ) { CE.pBodyA = nullptr; }
+            if( CE.pBodyB == pRigidBody ) { CE.pBodyB = nullptr; }
+        }
+        m_BodyContactEventRanges.erase( RangeIter );
     }
 }
 
@@ -1101,6 +1374,7 @@ VOID PhysicsWorld::RemoveRigidBody( RigidBody* pRigidBody )
     {
         m_FloatingCorners.erase(iter);
     }
+    RemoveContactPairs( pRigidBody );
     m_pDynamicsWorld->removeRigidBody( pRigidBody->GetInternalRigidBody() );
     pRigidBody->SetPhysicsWorld( NULL );
 }
@@ -1199,6 +1473,272 @@ XMVECTOR PhysicsWorld::ShootRay( CXMVECTOR Origin, CXMVECTOR Ray, BOOL* pHit, Ri
     }
 }
 
+// Interleaves the low 10 bits of x with two zero bits between each bit.
+static inline UINT32 SpreadMortonBits(UINT32 x)
+{
+    x &= 0x3FF;
+    x = (x | (x << 16)) & 0x030000FF;
+    x = (x | (x << 8)) & 0x0300F00F;
+    x = (x | (x << 4)) & 0x030C30C3;
+    x = (x | (x << 2)) & 0x09249249;
+    return x;
+}
+
+struct RayBatchJob
+{
+    btDiscreteDynamicsWorld* pWorld;
+    const RayBatch* pBatch;
+    const UINT64* pSortedKeys;
+    mutable volatile LONG HitCount;
+
+    // Casts rays [Begin, End) in sorted order; the low 32 bits of each key are the ray index.
+    void Execute(INT Begin, INT End) const
+    {
+        const RayBatch& B = *pBatch;
+        LONG LocalHitCount = 0;
+        for (INT i = Begin; i < End; ++i)
+        {
+            const UINT32 Index = (UINT32)pSortedKeys[i];
+            const XMVECTOR RayStart = XMVectorSet(B.pOriginX[Index], B.pOriginY[Index], B.pOriginZ[Index], 0);
+            const XMVECTOR RayEnd = RayStart + XMVectorSet(B.pRayX[Index], B.pRayY[Index], B.pRayZ[Index], 0);
+
+            RigidBody* pIgnoreRB = (B.ppIgnoreBodies != nullptr) ? B.ppIgnoreBodies[Index] : nullptr;
+            ClosestWithExclusion Callback( pIgnoreRB != nullptr ? pIgnoreRB->GetInternalRigidBody() : nullptr );
+            Callback.m_closestHitFraction = 1.0f;
+            pWorld->rayTest( *(btVector3*)&RayStart, *(btVector3*)&RayEnd, Callback );
+
+            const BOOL HasHit = Callback.hasHit();
+            XMVECTOR HitPosition = RayEnd;
+            XMVECTOR HitNormal = g_XMZero;
+            RigidBody* pHitRB = nullptr;
+            if (HasHit)
+            {
+                ++LocalHitCount;
+                HitPosition = XMVectorLerp( RayStart, RayEnd, Callback.m_closestHitFraction );
+                HitNormal = XMVector3Normalize( XMVectorSet( Callback.m_hitNormalWorld.x(), Callback.m_hitNormalWorld.y(), Callback.m_hitNormalWorld.z(), 0 ) );
+                if (Callback.m_collisionObject != nullptr)
+                {
+                    pHitRB = (RigidBody*)Callback.m_collisionObject->getUserPointer();
+                }
+            }
+
+            if (B.pHits != nullptr)
+            {
+                B.pHits[Index] = HasHit;
+            }
+            if (B.pHitPositionX != nullptr)
+            {
+                B.pHitPositionX[Index] = XMVectorGetX(HitPosition);
+                B.pHitPositionY[Index] = XMVectorGetY(HitPosition);
+                B.pHitPositionZ[Index] = XMVectorGetZ(HitPosition);
+            }
+            if (B.pHitNormalX != nullptr)
+            {
+                B.pHitNormalX[Index] = XMVectorGetX(HitNormal);
+                B.pHitNormalY[Index] = XMVectorGetY(HitNormal);
+                B.pHitNormalZ[Index] = XMVectorGetZ(HitNormal);
+            }
+            if (B.ppHitBodies != nullptr)
+            {
+                B.ppHitBodies[Index] = pHitRB;
+            }
+        }
+        InterlockedAdd(&HitCount, LocalHitCount);
+    }
+};
+
+#if BT_THREADSAFE
+struct RayBatchParallelBody : public btIParallelForBody
+{
+    const RayBatchJob* pJob;
+    virtual void forLoop(int iBegin, int iEnd) const override { pJob->Execute(iBegin, iEnd); }
+};
+#endif
+
+UINT32 PhysicsWorld::ShootRays( const RayBatch& Batch )
+{
+    const UINT32 RayCount = Batch.RayCount;
+    if (RayCount == 0)
+    {
+        return 0;
+    }
+
+    // Sort rays along a Morton curve through their midpoints, so that consecutive rays
+    // (and therefore each worker's range) walk the same broadphase nodes.
+    XMVECTOR BoundsMin = g_XMFltMax;
+    XMVECTOR BoundsMax = -g_XMFltMax;
+    for (UINT32 i = 0; i < RayCount; ++i)
+    {
+        const XMVECTOR Midpoint = XMVectorSet(Batch.pOriginX[i] + Batch.pRayX[i] * 0.5f, Batch.pOriginY[i] + Batch.pRayY[i] * 0.5f, Batch.pOriginZ[i] + Batch.pRayZ[i] * 0.5f, 0);
+        BoundsMin = XMVectorMin(BoundsMin, Midpoint);
+        BoundsMax = XMVectorMax(BoundsMax, Midpoint);
+    }
+    const XMVECTOR QuantizeScale = XMVectorDivide(XMVectorReplicate(1023.0f), XMVectorMax(BoundsMax - BoundsMin, g_XMEpsilon));
+
+    std::vector<UINT64> SortKeys(RayCount);
+    for (UINT32 i = 0; i < RayCount; ++i)
+    {
+        const XMVECTOR Midpoint = XMVectorSet(Batch.pOriginX[i] + Batch.pRayX[i] * 0.5f, Batch.pOriginY[i] + Batch.pRayY[i] * 0.5f, Batch.pOriginZ[i] + Batch.pRayZ[i] * 0.5f, 0);
+        XMFLOAT3 Cell;
+        XMStoreFloat3(&Cell, (Midpoint - BoundsMin) * QuantizeScale);
+        const UINT32 MortonCode = SpreadMortonBits((UINT32)Cell.x) | (SpreadMortonBits((UINT32)Cell.y) << 1) | (SpreadMortonBits((UINT32)Cell.z) << 2);
+        SortKeys[i] = ((UINT64)MortonCode << 32) | i;
+    }
+    std::sort(SortKeys.begin(), SortKeys.end());
+
+    RayBatchJob Job;
+    Job.pWorld = m_pDynamicsWorld;
+    Job.pBatch = &Batch;
+    Job.pSortedKeys = SortKeys.data();
+    Job.HitCount = 0;
+
+#if BT_THREADSAFE
+    // Broadphase ray tests use per-thread traversal stacks when Bullet is thread safe.
+    // Installing the scheduler here covers worlds that step on one thread.
+    if (GetPhysicsTaskScheduler() != nullptr)
+    {
+        RayBatchParallelBody Body;
+        Body.pJob = &Job;
+        btParallelFor(0, (INT)RayCount, 64, Body);
+        return (UINT32)Job.HitCount;
+    }
+#endif
+    Job.Execute(0, (INT)RayCount);
+
+    return (UINT32)Job.HitCount;
+}
+
+// Casts straight-down and oblique rays into a grid of heightfield blocks, comparing
+// one ShootRay call per ray against ShootRays at each power-of-two thread count.
+bool PhysicsWorld::BenchmarkRayThroughput( UINT32 RayCount, UINT32 IterationCount )
+{
+    const UINT32 BlockCount = 4;
+    const UINT32 BlockSamples = 129;
+    const FLOAT BlockSize = (FLOAT)(BlockSamples - 1);
+    const FLOAT MaxHeight = 40.0f;
+
+    PhysicsWorld* pWorld = new PhysicsWorld();
+    pWorld->Initialize(PWF_Multithreaded, XMVectorSet(0, -9.8f, 0, 0));
+
+    std::vector<FLOAT> Heights(BlockSamples * BlockSamples * BlockCount * BlockCount);
+    for (UINT32 Block = 0; Block < BlockCount * BlockCount; ++Block)
+    {
+        const FLOAT BlockX = (FLOAT)(Block % BlockCount) * BlockSize;
+        const FLOAT BlockZ = (FLOAT)(Block / BlockCount) * BlockSize;
+        FLOAT* pHeights = &Heights[Block * BlockSamples * BlockSamples];
+        for (UINT32 i = 0; i < BlockSamples * BlockSamples; ++i)
+        {
+            const FLOAT X = BlockX + (FLOAT)(i % BlockSamples);
+            const FLOAT Z = BlockZ + (FLOAT)(i / BlockSamples);
+            pHeights[i] = MaxHeight * 0.5f * (1.0f + sinf(X * 0.05f) * cosf(Z * 0.037f));
+        }
+
+        CollisionShape* pShape = CollisionShape::CreateHeightfield(pHeights, BlockSamples, BlockSamples, 0, MaxHeight);
+        pWorld->OwnShape(pShape);
+        const XMMATRIX matTransform = XMMatrixTranslation(BlockX + BlockSize * 0.5f, MaxHeight * 0.5f, BlockZ + BlockSize * 0.5f);
+        pWorld->AddRigidBody(new RigidBody(pShape, 0, matTransform), TRUE);
+    }
+    pWorld->GetInternalWorld()->updateAabbs();
+
+    std::vector<FLOAT> RayData(RayCount * 9);
+    FLOAT* pOrigins[3] = { &RayData[0], &RayData[RayCount], &RayData[RayCount * 2] };
+    FLOAT* pRays[3] = { &RayData[RayCount * 3], &RayData[RayCount * 4], &RayData[RayCount * 5] };
+    FLOAT* pHitPositions[3] = { &RayData[RayCount * 6], &RayData[RayCount * 7], &RayData[RayCount * 8] };
+
+    UINT32 Seed = 12345;
+    auto RandomFloat = [&Seed]() { Seed = Seed * 1664525 + 1013904223; return (FLOAT)(Seed >> 8) * (1.0f / 16777216.0f); };
+    const FLOAT WorldSize = BlockSize * (FLOAT)BlockCount;
+    for (UINT32 i = 0; i < RayCount; ++i)
+    {
+        pOrigins[0][i] = RandomFloat() * WorldSize;
+        pOrigins[1][i] = MaxHeight + 10.0f;
+        pOrigins[2][i] = RandomFloat() * WorldSize;
+        pRays[0][i] = (RandomFloat() - 0.5f) * 40.0f;
+        pRays[1][i] = -(MaxHeight + 20.0f);
+        pRays[2][i] = (RandomFloat() - 0.5f) * 40.0f;
+    }
+
+    RayBatch Batch;
+    ZeroMemory(&Batch, sizeof(Batch));
+    Batch.RayCount = RayCount;
+    Batch.pOriginX = pOrigins[0];
+    Batch.pOriginY = pOrigins[1];
+    Batch.pOriginZ = pOrigins[2];
+    Batch.pRayX = pRays[0];
+    Batch.pRayY = pRays[1];
+    Batch.pRayZ = pRays[2];
+    Batch.pHitPositionX = pHitPositions[0];
+    Batch.pHitPositionY = pHitPositions[1];
+    Batch.pHitPositionZ = pHitPositions[2];
+
+    Utility::PrintfConsole("Ray throughput: %u rays x %u iterations against %u heightfield blocks\n", RayCount, IterationCount, BlockCount * BlockCount);
+
+    if (!pWorld->IsMultithreaded())
+    {
+        Utility::PrintfConsole("  FAILED: the batch cannot run in parallel; Bullet was built without BT_THREADSAFE\n");
+        delete pWorld;
+        return false;
+    }
+
+    UINT32 SerialHitCount = 0;
+    INT64 StartTick = SystemTime::GetCurrentTick();
+    for (UINT32 Iteration = 0; Iteration < IterationCount; ++Iteration)
+    {
+        SerialHitCount = 0;
+        for (UINT32 i = 0; i < RayCount; ++i)
+        {
+            BOOL Hit = FALSE;
+            pWorld->ShootRay(XMVectorSet(pOrigins[0][i], pOrigins[1][i], pOrigins[2][i], 0), XMVectorSet(pRays[0][i], pRays[1][i], pRays[2][i], 0), &Hit, nullptr);
+            SerialHitCount += Hit ? 1 : 0;
+        }
+    }
+    DOUBLE ElapsedMsec = SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - StartTick);
+    const DOUBLE SerialRaysPerMsec = (DOUBLE)RayCount * IterationCount / ElapsedMsec;
+    Utility::PrintfConsole("  ShootRay:            %10.1f rays/ms (%u hits)\n", SerialRaysPerMsec, SerialHitCount);
+
+    bool Success = true;
+    DOUBLE BestRaysPerMsec = 0;
+    const UINT32 OriginalThreadCount = GetThreadCount();
+    const UINT32 MaxThreadCount = GetMaxThreadCount();
+    UINT32 ThreadCount = 1;
+    for (;;)
+    {
+        SetThreadCount(ThreadCount);
+        UINT32 HitCount = 0;
+        StartTick = SystemTime::GetCurrentTick();
+        for (UINT32 Iteration = 0; Iteration < IterationCount; ++Iteration)
+        {
+            HitCount = pWorld->ShootRays(Batch);
+        }
+        ElapsedMsec = SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - StartTick);
+        const DOUBLE RaysPerMsec = (DOUBLE)RayCount * IterationCount / ElapsedMsec;
+        BestRaysPerMsec = std::max(BestRaysPerMsec, RaysPerMsec);
+        Utility::PrintfConsole("  ShootRays %2u threads: %10.1f rays/ms (%u hits), %.2fx\n", ThreadCount, RaysPerMsec, HitCount, RaysPerMsec / SerialRaysPerMsec);
+
+        if (HitCount != SerialHitCount)
+        {
+            Success = false;
+        }
+
+        if (ThreadCount >= MaxThreadCount)
+        {
+            break;
+        }
+        ThreadCount = std::min(ThreadCount * 2, MaxThreadCount);
+    }
+    SetThreadCount(OriginalThreadCount);
+
+    // Timing depends on the machine's load, so only the hit counts decide the result
+    Utility::PrintfConsole("  Best speedup:        %.2fx over ShootRay with %u threads available\n", BestRaysPerMsec / SerialRaysPerMsec, MaxThreadCount);
+    if (!Success)
+    {
+        Utility::PrintfConsole("  FAILED: batched hit counts differ from ShootRay\n");
+    }
+
+    delete pWorld;
+    return Success;
+}
+
 UINT8 PhysicsWorld::GetFloatingCornerMask(RigidBody* pRB) const
 {
     auto iter = m_FloatingCorners.find(pRB);
@@ -1214,6 +1754,90 @@ void PhysicsWorld::SetFloatingCornerMask(RigidBody* pRB, UINT8 Mask)
     m_FloatingCorners[pRB] = Mask;
 }
 
+// Steps a scene of BodyCount dynamic boxes dropped onto a ground plane, half of them
+// into water, at each power-of-two thread count up to the scheduler maximum.
+bool PhysicsWorld::BenchmarkThreadScaling( UINT32 BodyCount, UINT32 StepCount )
+{
+    const UINT32 MaxThreadCount = GetMaxThreadCount();
+    const UINT32 OriginalThreadCount = GetThreadCount();
+    const UINT32 WarmupStepCount = 30;
+
+    Utility::PrintfConsole("Physics thread scaling: %u bodies, %u steps, max %u threads\n", BodyCount, StepCount, MaxThreadCount);
+
+    DOUBLE SingleThreadMsec = 0;
+    UINT32 ThreadCount = 1;
+    for (;;)
+    {
+        SetThreadCount(ThreadCount);
+
+        PhysicsWorld* pWorld = new PhysicsWorld();
+        pWorld->Initialize(PWF_Multithreaded, XMVectorSet(0, -9.8f, 0, 0));
+        if (!pWorld->IsMultithreaded())
+        {
+            Utility::PrintfConsole("  FAILED: the multithreaded world is unavailable; Bullet was built without BT_THREADSAFE\n");
+            delete pWorld;
+            SetThreadCount(OriginalThreadCount);
+            return false;
+        }
+
+        CollisionShape* pGroundShape = CollisionShape::CreatePlane(XMVectorSet(0, 1, 0, -20.0f));
+        pWorld->OwnShape(pGroundShape);
+        pWorld->AddRigidBody(new RigidBody(pGroundShape, 0, XMMatrixIdentity()), TRUE);
+
+        const UINT32 GridSize = (UINT32)ceilf(sqrtf((FLOAT)BodyCount));
+        const FLOAT Spacing = 8.0f;
+        const FLOAT HalfExtent = (FLOAT)GridSize * Spacing * 0.5f;
+
+        CollisionShape* pWaterShape = CollisionShape::CreateBox(XMVectorSet(HalfExtent * 0.5f, 10.0f, HalfExtent, 0));
+        pWorld->OwnShape(pWaterShape);
+        RigidBody* pWaterRB = new RigidBody(pWaterShape, 0, XMMatrixTranslation(-HalfExtent * 0.5f, -10.0f, 0));
+        pWorld->AddRigidBody(pWaterRB, TRUE);
+        pWaterRB->SetWaterRigidBody();
+
+        CollisionShape* pBoxShape = CollisionShape::CreateBox(XMVectorSet(1.0f, 0.75f, 2.0f, 0));
+        pWorld->OwnShape(pBoxShape);
+        for (UINT32 i = 0; i < BodyCount; ++i)
+        {
+            const FLOAT X = (FLOAT)(i % GridSize) * Spacing - HalfExtent;
+            const FLOAT Z = (FLOAT)(i / GridSize) * Spacing - HalfExtent;
+            const FLOAT Y = 2.0f + (FLOAT)(i % 3) * 2.0f;
+            RigidBody* pRB = new RigidBody(pBoxShape, 1000.0f, XMMatrixRotationY((FLOAT)i) * XMMatrixTranslation(X, Y, Z));
+            pRB->DisableDeactivation();
+            pWorld->AddRigidBody(pRB, TRUE);
+        }
+
+        const FLOAT TimeStep = pWorld->GetFixedTimeStep();
+        for (UINT32 i = 0; i < WarmupStepCount; ++i)
+        {
+            pWorld->Update(TimeStep);
+        }
+
+        const INT64 StartTick = SystemTime::GetCurrentTick();
+        for (UINT32 i = 0; i < StepCount; ++i)
+        {
+            pWorld->Update(TimeStep);
+        }
+        const DOUBLE StepMsec = SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - StartTick) / (DOUBLE)std::max(StepCount, 1U);
+        if (ThreadCount == 1)
+        {
+            SingleThreadMsec = StepMsec;
+        }
+
+        Utility::PrintfConsole("  %2u threads: %.3f ms/step, %.2fx\n", ThreadCount, StepMsec, SingleThreadMsec / StepMsec);
+
+        delete pWorld;
+
+        if (ThreadCount >= MaxThreadCount)
+        {
+            break;
+        }
+        ThreadCount = std::min(ThreadCount * 2, MaxThreadCount);
+    }
+
+    SetThreadCount(OriginalThreadCount);
+    return true;
+}
+
 struct ClosestNoWaterRayResultCallback : public btCollisionWorld::RayResultCallback
 {
     ClosestNoWaterRayResultCallback(const btVector3& rayFromWorld, const btVector3& rayToWorld)
@@ -3,6 +3,7 @@
 #include <unordered_set>
 #include <unordered_map>
 #include <vector>
+#include <mutex>
 
 #include <DirectXMath.h>
 using namespace DirectX;
@@ -18,7 +19,7 @@ class btTypedConstraint;
 class btDefaultCollisionConfiguration;
 class btCollisionDispatcher;
 class btBroadphaseInterface;
-class btSequentialImpulseConstraintSolver;
+class btConstraintSolver;
 class btDiscreteDynamicsWorld;
 class btDynamicsWorld;
 class btTriangleIndexVertexArray;
@@ -181,19 +182,9 @@ class RigidBody : public PhysicsObject
 {
     friend class PhysicsWorld;
 
-public:
-    struct ContactPoint
-    {
-        XMFLOAT3 vLocalPosition;
-        XMFLOAT3 vWorldDirection;
-        RigidBody* pOtherBody;
-    };
 protected:
     btRigidBody* m_pRigidBody;
     btMotionState* m_pMotionState;
-    ContactPoint* m_pContactPoints;
-    DWORD m_dwTotalContactPoints;
-    DWORD m_dwActiveContactPoints;
     CHAR m_strCollisionCallbackName[32];
     UINT32 m_CollisionMask;
     FLOAT m_IsUnderwater;
@@ -241,11 +232,9 @@ public:
 
     FLOAT GetInverseMass() const;
 
-    VOID TrackContactPoints( DWORD dwCount );
-    BOOL IsTrackingContactPoints() const { return m_pContactPoints != NULL; }
-    DWORD GetNumContactPoints() const { return m_dwActiveContactPoints; }
-    const ContactPoint& GetContactPoint( DWORD dwIndex ) const { return m_pContactPoints[dwIndex]; }
+    // Bodies with a collision callback name generate contact events in their world.
     VOID SetCollisionCallbackName( const CHAR* strCallback );
+    const CHAR* GetCollisionCallbackName() const { return m_strCollisionCallbackName; }
     BOOL IsCollisionCallbackEnabled() const { return m_strCollisionCallbackName[0] != '\0'; }
 
     VOID SetCollisionMask( UINT32 Mask ) { m_CollisionMask = Mask; }
@@ -277,8 +266,6 @@ public:
 
 protected:
     VOID Initialize( CollisionShape* pShape, FLOAT Mass, CXMMATRIX matTransform, CXMVECTOR vLocalInertia );
-    VOID ClearContactPoints();
-    BOOL AddContactPoint( CXMVECTOR vLocalPos, CXMVECTOR Distance, RigidBody* pOtherRigidBody );
 };
 
 class Constraint : public PhysicsObject
@@ -343,6 +330,69 @@ private:
     void SetAxleSteering( UINT32 Axle, FLOAT Steering );
 };
 
+enum PhysicsWorldFlags
+{
+    // Uses Bullet's multithreaded dispatcher, solver pool and island solving.  Falls
+    // back to the single threaded world, with a warning, if Bullet was not built with
+    // BT_THREADSAFE (see PropertySheets\BulletThreading.props).
+    PWF_Multithreaded = 0x1,
+};
+
+struct PhysicsStepStatistics
+{
+    UINT32 StepCount;
+    UINT32 DroppedStepCount;
+    FLOAT InterpolationAlpha;
+    FLOAT StepMilliseconds;
+};
+
+// Structure-of-arrays ray batch for PhysicsWorld::ShootRays.  Each ray runs from
+// Origin to Origin + Ray.  Output arrays are optional; rays that miss report their
+// end point, a zero normal and a null body.
+struct RayBatch
+{
+    UINT32 RayCount;
+
+    const FLOAT* pOriginX;
+    const FLOAT* pOriginY;
+    const FLOAT* pOriginZ;
+    const FLOAT* pRayX;
+    const FLOAT* pRayY;
+    const FLOAT* pRayZ;
+    RigidBody* const* ppIgnoreBodies;
+
+    BOOL* pHits;
+    FLOAT* pHitPositionX;
+    FLOAT* pHitPositionY;
+    FLOAT* pHitPositionZ;
+    FLOAT* pHitNormalX;
+    FLOAT* pHitNormalY;
+    FLOAT* pHitNormalZ;
+    RigidBody** ppHitBodies;
+};
+
+enum ContactEventType
+{
+    CET_Begin,
+    CET_Persist,
+    CET_End,
+};
+
+// One touching pair of bodies at the end of a physics step.  At least one of the
+// bodies has a collision callback name.  The normal points from body B towards body A,
+// and the position is the deepest contact point on body B, in world space.  End events
+// carry the last position and normal seen, and zero impulse.  A body removed from the
+// world during the update is cleared to null in the events that named it.
+struct ContactEvent
+{
+    ContactEventType Type;
+    RigidBody* pBodyA;
+    RigidBody* pBodyB;
+    XMFLOAT3 WorldPosition;
+    XMFLOAT3 WorldNormal;
+    FLOAT Impulse;
+};
+
 typedef std::unordered_set<PhysicsObject*> PhysicsObjectSet;
 typedef std::unordered_set<CollisionShape*> CollisionShapeSet;
 typedef std::vector<CollisionShape*> CollisionShapeVector;
@@ -353,8 +403,9 @@ protected:
     btDefaultCollisionConfiguration* m_pCollisionConfiguration;
     btCollisionDispatcher* m_pDispatcher;
     btBroadphaseInterface* m_pOverlappingPairCache;
-    btSequentialImpulseConstraintSolver* m_pSolver;
+    btConstraintSolver* m_pSolver;
     btDiscreteDynamicsWorld* m_pDynamicsWorld;
+    bool m_Multithreaded;
 
     PhysicsObjectSet m_OwnedObjects;
 
@@ -362,9 +413,68 @@ protected:
 
     FLOAT m_Speed;
 
+    // Fixed timestep scheduling; the simulation always advances in whole steps of
+    // m_FixedTimeStep, and the remainder is carried over in m_TimeAccumulator.
+    FLOAT m_FixedTimeStep;
+    UINT32 m_MaxStepsPerUpdate;
+    FLOAT m_TimeAccumulator;
+    PhysicsStepStatistics m_LastUpdateStats;
+
     typedef std::unordered_map<RigidBody*, UINT8> FloatingCornerMaskMap;
     FloatingCornerMaskMap m_FloatingCorners;
 
+    // Water overlaps found during collision dispatch, which may run on worker threads.
+    // Buoyancy is applied serially from this list right before the constraint solver runs.
+    struct BuoyancyPair
+    {
+        RigidBody* pWaterRB;
+        RigidBody* pOtherRB;
+
+        bool operator<(const BuoyancyPair& RHS) const
+        {
+            return pOtherRB < RHS.pOtherRB || (pOtherRB == RHS.pOtherRB && pWaterRB < RHS.pWaterRB);
+        }
+    };
+    std::mutex m_BuoyancyPairMutex;
+    std::vector<BuoyancyPair> m_BuoyancyPairs;
+
+    // Contact events from every step taken during the current Update.  Pairs that were
+    // touching at the end of the last step are tracked so persist and end can be told apart.
+    struct ContactPairKey
+    {
+        RigidBody* pBodyA;
+        RigidBody* pBodyB;
+
+        bool operator==(const ContactPairKey& RHS) const { return pBodyA == RHS.pBodyA && pBodyB == RHS.pBodyB; }
+    };
+    struct ContactPairKeyHash
+    {
+        size_t operator()(const ContactPairKey& Key) const { return std::hash<RigidBody*>()(Key.pBodyA) ^ (std::hash<RigidBody*>()(Key.pBodyB) * 31); }
+    };
+    struct ContactPairState
+    {
+        UINT32 TouchStepIndex;
+        bool IsNew;
+        XMFLOAT3 WorldPosition;
+        XMFLOAT3 WorldNormal;
+        FLOAT Distance;
+        FLOAT Impulse;
+    };
+    typedef std::unordered_map<ContactPairKey, ContactPairState, ContactPairKeyHash> ContactPairMap;
+    ContactPairMap m_ContactPairs;
+    UINT32 m_ContactStepIndex;
+    std::vector<ContactEvent> m_ContactEvents;
+
+    // Indices into m_ContactEvents grouped by body, rebuilt once at the end of each Update
+    struct BodyContactEventRange
+    {
+        UINT32 FirstIndex;
+        UINT32 Count;
+    };
+    std::unordered_map<const RigidBody*, BodyContactEventRange> m_BodyContactEventRanges;
+    std::vector<UINT32> m_BodyContactEventIndices;
+    bool m_ContactEventsIndexed;
+
 public:
     PhysicsWorld();
     ~PhysicsWorld();
@@ -372,11 +482,23 @@ public:
     void Initialize(DWORD Flags, XMVECTOR vGravity);
 
     btDiscreteDynamicsWorld* GetInternalWorld() const { return m_pDynamicsWorld; }
+    bool IsMultithreaded() const { return m_Multithreaded; }
+
+    // The task scheduler is shared by every multithreaded world in the process.
+    static UINT32 GetMaxThreadCount();
+    static UINT32 GetThreadCount();
+    static VOID SetThreadCount( UINT32 ThreadCount );
+    static bool BenchmarkThreadScaling( UINT32 BodyCount, UINT32 StepCount );
 
     BOOL IsPaused() const { return m_Speed <= 0.0f; }
     VOID SetSpeed( FLOAT Speed ) { m_Speed = (Speed > 0.0f) ? Speed : 0.0f; }
     FLOAT GetSpeed() const { return m_Speed; }
 
+    VOID SetFixedTimeStep( FLOAT TimeStep, UINT32 MaxStepsPerUpdate );
+    FLOAT GetFixedTimeStep() const { return m_FixedTimeStep; }
+    FLOAT GetInterpolationAlpha() const { return m_LastUpdateStats.InterpolationAlpha; }
+    const PhysicsStepStatistics& GetLastUpdateStatistics() const { return m_LastUpdateStats; }
+
     VOID Update( FLOAT DeltaTime );
     VOID DebugRender();
 
@@ -392,13 +514,27 @@ public:
     XMVECTOR ShootRay( RigidBody* pRigidBody, CXMVECTOR Ray, BOOL* pHit );
     XMVECTOR ShootRay( CXMVECTOR Origin, CXMVECTOR Ray, BOOL* pHit, RigidBody** ppHitRigidBody );
 
+    // Must not be called while the world is stepping.  Returns the number of hits.
+    UINT32 ShootRays( const RayBatch& Batch );
+    static bool BenchmarkRayThroughput( UINT32 RayCount, UINT32 IterationCount );
+
+    const std::vector<ContactEvent>& GetContactEvents() const { return m_ContactEvents; }
+
+    // Returns the indices of the events in GetContactEvents() that name the body
+    const UINT32* GetContactEvents( const RigidBody* pRigidBody, UINT32* pEventCount ) const;
+
     UINT8 GetFloatingCornerMask(RigidBody* pRB) const;
     void SetFloatingCornerMask(RigidBody* pRB, UINT8 Mask);
 
+    VOID ApplyPendingBuoyancy();
+
 protected:
     static VOID SimulationTickCallback( btDynamicsWorld* pDynamicsWorld, FLOAT timeStep );
     static VOID NearCollisionCallback(btBroadphasePair& collisionPair, btCollisionDispatcher& dispatcher, btDispatcherInfo& dispatchInfo);
     static void ApplyBuoyancyForce(RigidBody* pWaterRB, RigidBody* pOtherRB);
-    VOID ClearContactPoints();
-    VOID ReportContactPoints();
+    VOID ClearFloatingCorners();
+    VOID QueueBuoyancyPair( RigidBody* pWaterRB, RigidBody* pOtherRB );
+    VOID ReportContactEvents();
+    VOID IndexContactEvents();
+    VOID RemoveContactPairs( RigidBody* pRigidBody );
 };
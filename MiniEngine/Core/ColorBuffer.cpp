@@ -73,6 +73,11 @@ void ColorBuffer::CreateDerivedViews(ID3D12Device* Device, DXGI_FORMAT Format, u
 		m_RTVHandle = Graphics::AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
 		m_SRVHandle = Graphics::AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 	}
+	else
+	{
+		// Tables already copied from these views must not be reused
+		DescriptorAllocator::InvalidateCopies();
+	}
 
 	ID3D12Resource* Resource = m_pResource.Get();
 
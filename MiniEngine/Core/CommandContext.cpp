@@ -257,6 +257,42 @@ void GraphicsContext::ResolveQueryData(ID3D12QueryHeap* QueryHeap, D3D12_QUERY_T
 	m_CommandList->ResolveQueryData(QueryHeap, Type, StartIndex, NumQueries, DestinationBuffer, DestinationBufferOffset);
 }
 
+void GraphicsContext::RecordParallel( UINT32 ChunkCount, const std::function<void(GraphicsContext&)>& Setup,
+	const std::function<void(GraphicsContext&, UINT32)>& RecordChunk )
+{
+	if (ChunkCount <= 1)
+	{
+		RecordChunk(*this, 0);
+		return;
+	}
+
+	std::vector<GraphicsContext*> ChunkContexts(ChunkCount, nullptr);
+	std::vector<concurrency::task<void>> ChunkTasks;
+	ChunkTasks.reserve(ChunkCount - 1);
+	for (UINT32 ChunkIndex = 1; ChunkIndex < ChunkCount; ++ChunkIndex)
+	{
+		ChunkTasks.push_back(concurrency::create_task([&, ChunkIndex]()
+		{
+			GraphicsContext& Chunk = g_ContextManager.AllocateContext(D3D12_COMMAND_LIST_TYPE_DIRECT)->GetGraphicsContext();
+			Chunk.SetID(m_ID);
+			Chunk.m_EnableProfiling = false;
+			Setup(Chunk);
+			RecordChunk(Chunk, ChunkIndex);
+			ChunkContexts[ChunkIndex] = &Chunk;
+		}));
+	}
+
+	RecordChunk(*this, 0);
+	concurrency::when_all(ChunkTasks.begin(), ChunkTasks.end()).wait();
+
+	// Submitting this context first keeps the GPU order identical to serial recording
+	Flush();
+	for (UINT32 ChunkIndex = 1; ChunkIndex < ChunkCount; ++ChunkIndex)
+		ChunkContexts[ChunkIndex]->Finish();
+
+	Setup(*this);
+}
+
 void GraphicsContext::ClearUAV( GpuBuffer& Target )
 {
 	// After binding a UAV, we can get a GPU handle that is required to clear it as a UAV (because it essentially runs
@@ -491,6 +527,22 @@ void CommandContext::InitializeTexture( GpuResource& Dest, UINT NumSubresources,
 	InitContext.Finish(true);
 }
 
+void CommandContext::InitializeTextureSubresources( GpuResource& Dest, UINT FirstSubresource, UINT NumSubresources, D3D12_SUBRESOURCE_DATA SubData[] )
+{
+	UINT64 uploadBufferSize = GetRequiredIntermediateSize(Dest.GetResource(), FirstSubresource, NumSubresources);
+
+	CommandContext& InitContext = CommandContext::Begin();
+
+	// The graphics queue runs this between frames, so the texture can leave GENERIC_READ
+	DynAlloc mem = InitContext.ReserveUploadMemory(uploadBufferSize);
+	InitContext.TransitionResource(Dest, D3D12_RESOURCE_STATE_COPY_DEST, true);
+	UpdateSubresources(InitContext.m_CommandList, Dest.GetResource(), mem.Buffer.GetResource(), 0, FirstSubresource, NumSubresources, SubData);
+	InitContext.TransitionResource(Dest, D3D12_RESOURCE_STATE_GENERIC_READ);
+
+	// Execute the command list and wait for it to finish so we can release the upload buffer
+	InitContext.Finish(true);
+}
+
 void CommandContext::CopySubresource(GpuResource& Dest, UINT DestSubIndex, GpuResource& Src, UINT SrcSubIndex, const DestinationPoint* pDestPoint, const D3D12_BOX* pSrcBox)
 {
 	FlushResourceBarriers();
@@ -26,6 +26,7 @@
 #include "CommandSignature.h"
 #include "GraphicsCore.h"
 #include <vector>
+#include <functional>
 
 class ColorBuffer;
 class DepthBuffer;
@@ -137,6 +138,10 @@ public:
 	static void InitializeBuffer( GpuResource& Dest, const void* Data, size_t NumBytes, size_t Offset = 0);
 	static void InitializeTextureArraySlice(GpuResource& Dest, UINT SliceIndex, GpuResource& Src);
 
+	// Uploads NumSubresources subresources of Dest starting at FirstSubresource, leaving the
+	// rest untouched.  Used to fill mips of a reserved texture as they are mapped.
+	static void InitializeTextureSubresources( GpuResource& Dest, UINT FirstSubresource, UINT NumSubresources, D3D12_SUBRESOURCE_DATA SubData[] );
+
 	void WriteBuffer( GpuResource& Dest, size_t DestOffset, const void* Data, size_t NumBytes );
 	void FillBuffer( GpuResource& Dest, size_t DestOffset, DWParam Value, size_t NumBytes );
 
@@ -206,6 +211,15 @@ public:
 		return CommandContext::Begin(ID, DisableProfiling).GetGraphicsContext();
 	}
 
+	// Records a pass in ChunkCount pieces.  Chunk 0 is recorded into this context on the
+	// calling thread; the others are recorded concurrently into their own contexts and
+	// submitted, in order, after everything this context has recorded so far.  Setup must
+	// bind the pass's render targets, viewports and root state; it runs on each chunk
+	// context and again on this one afterwards, because the flush drops that state.
+	// Chunks must not transition resources.
+	void RecordParallel( UINT32 ChunkCount, const std::function<void(GraphicsContext&)>& Setup,
+		const std::function<void(GraphicsContext&, UINT32)>& RecordChunk );
+
 	void ClearUAV( GpuBuffer& Target );
 	void ClearUAV( ColorBuffer& Target );
 	void ClearColor( ColorBuffer& Target, const FLOAT* pClearColor = nullptr );
@@ -244,6 +258,7 @@ public:
 	void SetConstantBuffer( UINT RootIndex, D3D12_GPU_VIRTUAL_ADDRESS CBV );
 	void SetDynamicConstantBufferView( UINT RootIndex, size_t BufferSize, const void* BufferData );
 	void SetBufferSRV( UINT RootIndex, const GpuBuffer& SRV, UINT64 Offset = 0);
+	void SetBufferSRV( UINT RootIndex, D3D12_GPU_VIRTUAL_ADDRESS SRV );
 	void SetBufferUAV( UINT RootIndex, const GpuBuffer& UAV, UINT64 Offset = 0);
 	void SetDescriptorTable( UINT RootIndex, D3D12_GPU_DESCRIPTOR_HANDLE FirstHandle );
 
@@ -535,6 +550,11 @@ inline void GraphicsContext::SetBufferSRV( UINT RootIndex, const GpuBuffer& SRV,
 	m_CommandList->SetGraphicsRootShaderResourceView(RootIndex, SRV.GetGpuVirtualAddress() + Offset);
 }
 
+inline void GraphicsContext::SetBufferSRV(UINT RootIndex, D3D12_GPU_VIRTUAL_ADDRESS SRV)
+{
+	m_CommandList->SetGraphicsRootShaderResourceView(RootIndex, SRV);
+}
+
 inline void ComputeContext::SetBufferSRV( UINT RootIndex, const GpuBuffer& SRV, UINT64 Offset)
 {
 	ASSERT((SRV.m_UsageState & D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE) != 0);
@@ -0,0 +1,631 @@
+#include "pch.h"
+#include "CpuProfiler.h"
+#include "SystemTime.h"
+#include <atomic>
+#include <deque>
+#include <thread>
+#include <unordered_map>
+
+namespace
+{
+    const UINT32 EndScopeID = 0xFFFFFFFF;
+    const UINT32 MaxScopes = 4096;
+
+    // Shared by every scope registered after the table is full
+    const UINT32 OverflowScopeID = MaxScopes - 1;
+
+    struct CpuProfileEvent
+    {
+        INT64 Tick;
+        UINT32 ScopeID;
+        UINT32 Reserved;
+    };
+
+    struct CpuProfileThread
+    {
+        std::atomic<UINT64> WriteIndex;
+        std::atomic<UINT32> Generation;
+        std::atomic<bool> Active;
+        UINT32 SlotIndex;
+        DWORD ThreadId;
+        CHAR strName[64];
+        CpuProfileEvent Events[CpuProfiler::EventsPerThread];
+
+        // Owned by the gathering thread
+        UINT32 GatherGeneration;
+        UINT64 GatherIndex;
+        std::vector<std::pair<UINT32, INT64>> OpenScopes;
+        std::vector<CpuProfileNode> Nodes;
+        std::unordered_map<UINT64, UINT32> NodeLUT;
+    };
+
+    // The events an exited thread left behind, kept for the export
+    struct ExitedThread
+    {
+        DWORD ThreadId;
+        CHAR strName[64];
+        std::vector<CpuProfileEvent> Events;
+    };
+
+    UINT64 CopyEvents(const CpuProfileThread* pThread, UINT64 FirstIndex, std::vector<CpuProfileEvent>& Events);
+
+    // Registration is rare and may happen during static initialization, so the registry
+    // is created on first use and takes a lock; recording never does.
+    class CpuProfileRegistry
+    {
+    public:
+        CpuProfileRegistry()
+            : m_ScopeCount(0),
+              m_ThreadCount(0),
+              m_ExitedEventCount(0)
+        {
+            InitializeCriticalSection(&m_CritSec);
+            ZeroMemory(m_strScopeNames, sizeof(m_strScopeNames));
+            ZeroMemory(m_pThreads, sizeof(m_pThreads));
+        }
+
+        UINT32 RegisterScope(const CHAR* strName)
+        {
+            EnterCriticalSection(&m_CritSec);
+            UINT32 ScopeID = OverflowScopeID;
+            auto iter = m_ScopeLUT.find(strName);
+            if (iter != m_ScopeLUT.end())
+            {
+                ScopeID = iter->second;
+            }
+            else if (m_ScopeCount < OverflowScopeID)
+            {
+                ScopeID = m_ScopeCount;
+                m_strScopeNames[ScopeID] = _strdup(strName);
+                m_ScopeLUT[strName] = ScopeID;
+                m_ScopeCount.store(ScopeID + 1, std::memory_order_release);
+            }
+            LeaveCriticalSection(&m_CritSec);
+            return ScopeID;
+        }
+
+        const CHAR* GetScopeName(UINT32 ScopeID) const
+        {
+            if (ScopeID >= m_ScopeCount.load(std::memory_order_acquire))
+            {
+                return "(other)";
+            }
+            return m_strScopeNames[ScopeID];
+        }
+
+        CpuProfileThread* RegisterThread()
+        {
+            EnterCriticalSection(&m_CritSec);
+            CpuProfileThread* pThread = nullptr;
+            const UINT32 ThreadIndex = m_ThreadCount.load(std::memory_order_relaxed);
+            if (!m_FreeSlots.empty())
+            {
+                // The gathering thread sees the new generation and starts the slot's tree over
+                pThread = m_pThreads[m_FreeSlots.back()];
+                m_FreeSlots.pop_back();
+                pThread->Generation.fetch_add(1, std::memory_order_acq_rel);
+                pThread->WriteIndex.store(0, std::memory_order_release);
+            }
+            else if (ThreadIndex < CpuProfiler::MaxThreads)
+            {
+                pThread = new CpuProfileThread();
+                pThread->WriteIndex.store(0, std::memory_order_relaxed);
+                pThread->Generation.store(0, std::memory_order_relaxed);
+                pThread->SlotIndex = ThreadIndex;
+                pThread->GatherGeneration = 0;
+                pThread->GatherIndex = 0;
+                m_pThreads[ThreadIndex] = pThread;
+                m_ThreadCount.store(ThreadIndex + 1, std::memory_order_release);
+            }
+            if (pThread != nullptr)
+            {
+                pThread->ThreadId = GetCurrentThreadId();
+                sprintf_s(pThread->strName, "Thread %u", (UINT32)pThread->ThreadId);
+                pThread->Active.store(true, std::memory_order_release);
+            }
+            LeaveCriticalSection(&m_CritSec);
+            return pThread;
+        }
+
+        // Called on the exiting thread once it can record no more
+        void ReleaseThread(CpuProfileThread* pThread)
+        {
+            ExitedThread Exited;
+            Exited.ThreadId = pThread->ThreadId;
+            strcpy_s(Exited.strName, pThread->strName);
+            CopyEvents(pThread, 0, Exited.Events);
+
+            EnterCriticalSection(&m_CritSec);
+            m_ExitedEventCount += Exited.Events.size();
+            m_ExitedThreads.push_back(std::move(Exited));
+            while (m_ExitedEventCount > CpuProfiler::MaxExitedEvents)
+            {
+                m_ExitedEventCount -= m_ExitedThreads.front().Events.size();
+                m_ExitedThreads.pop_front();
+            }
+            pThread->Active.store(false, std::memory_order_release);
+            m_FreeSlots.push_back(pThread->SlotIndex);
+            LeaveCriticalSection(&m_CritSec);
+        }
+
+        // Calls Write for each exited thread's events while holding the lock
+        template <typename WriteFunc>
+        void ForEachExitedThread(WriteFunc Write)
+        {
+            EnterCriticalSection(&m_CritSec);
+            for (const auto& Exited : m_ExitedThreads)
+            {
+                Write(Exited);
+            }
+            LeaveCriticalSection(&m_CritSec);
+        }
+
+        UINT32 GetThreadCount() const { return m_ThreadCount.load(std::memory_order_acquire); }
+        CpuProfileThread* GetThread(UINT32 ThreadIndex) const { return m_pThreads[ThreadIndex]; }
+
+    private:
+        CRITICAL_SECTION m_CritSec;
+        std::unordered_map<std::string, UINT32> m_ScopeLUT;
+        const CHAR* m_strScopeNames[MaxScopes];
+        std::atomic<UINT32> m_ScopeCount;
+        CpuProfileThread* m_pThreads[CpuProfiler::MaxThreads];
+        std::atomic<UINT32> m_ThreadCount;
+        std::vector<UINT32> m_FreeSlots;
+        std::deque<ExitedThread> m_ExitedThreads;
+        size_t m_ExitedEventCount;
+    };
+
+    CpuProfileRegistry& GetRegistry()
+    {
+        static CpuProfileRegistry s_Registry;
+        return s_Registry;
+    }
+
+    // Threads past MaxThreads are not recorded
+    thread_local CpuProfileThread* t_pThread = nullptr;
+    thread_local bool t_ThreadRegistered = false;
+
+    // Hands the thread's slot back when the thread exits
+    struct ThreadSlotRelease
+    {
+        CpuProfileThread* pThread;
+
+        ~ThreadSlotRelease()
+        {
+            if (pThread != nullptr)
+            {
+                t_pThread = nullptr;
+                GetRegistry().ReleaseThread(pThread);
+            }
+        }
+    };
+    thread_local ThreadSlotRelease t_SlotRelease = { nullptr };
+
+    CpuProfileThread* GetCurrentThreadBuffer()
+    {
+        if (!t_ThreadRegistered)
+        {
+            t_pThread = GetRegistry().RegisterThread();
+            t_SlotRelease.pThread = t_pThread;
+            t_ThreadRegistered = true;
+        }
+        return t_pThread;
+    }
+
+    inline void RecordEvent(UINT32 ScopeID)
+    {
+        CpuProfileThread* pThread = t_pThread;
+        if (pThread == nullptr)
+        {
+            pThread = GetCurrentThreadBuffer();
+            if (pThread == nullptr)
+            {
+                return;
+            }
+        }
+
+        const UINT64 Index = pThread->WriteIndex.load(std::memory_order_relaxed);
+        CpuProfileEvent& Event = pThread->Events[Index & (CpuProfiler::EventsPerThread - 1)];
+        Event.Tick = SystemTime::GetCurrentTick();
+        Event.ScopeID = ScopeID;
+        pThread->WriteIndex.store(Index + 1, std::memory_order_release);
+    }
+
+    // Copies the thread's events from FirstIndex on into Events and returns the index of the
+    // first one copied; earlier events have been overwritten.  The slot about to be written
+    // is never copied, and anything the thread overwrote during the copy is dropped.
+    UINT64 CopyEvents(const CpuProfileThread* pThread, UINT64 FirstIndex, std::vector<CpuProfileEvent>& Events)
+    {
+        const UINT64 Capacity = CpuProfiler::EventsPerThread;
+        const UINT64 EndIndex = pThread->WriteIndex.load(std::memory_order_acquire);
+        UINT64 BeginIndex = EndIndex >= Capacity ? std::max(FirstIndex, EndIndex - Capacity + 1) : FirstIndex;
+
+        Events.clear();
+        for (UINT64 i = BeginIndex; i < EndIndex; ++i)
+        {
+            Events.push_back(pThread->Events[i & (Capacity - 1)]);
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const UINT64 LatestIndex = pThread->WriteIndex.load(std::memory_order_relaxed);
+        if (LatestIndex >= Capacity && LatestIndex - Capacity + 1 > BeginIndex)
+        {
+            const UINT64 DropCount = std::min(LatestIndex - Capacity + 1 - BeginIndex, (UINT64)Events.size());
+            Events.erase(Events.begin(), Events.begin() + (size_t)DropCount);
+            BeginIndex += DropCount;
+        }
+        return BeginIndex;
+    }
+
+    void WriteJsonString(FILE* pFile, const CHAR* strText)
+    {
+        fputc('"', pFile);
+        for (const CHAR* p = strText; *p != '\0'; ++p)
+        {
+            if (*p == '"' || *p == '\\')
+            {
+                fputc('\\', pFile);
+                fputc(*p, pFile);
+            }
+            else if ((UCHAR)*p < 0x20)
+            {
+                fprintf(pFile, "\\u%04x", (UINT32)(UCHAR)*p);
+            }
+            else
+            {
+                fputc(*p, pFile);
+            }
+        }
+        fputc('"', pFile);
+    }
+}
+
+UINT32 CpuProfiler::RegisterScope(const CHAR* strName)
+{
+    return GetRegistry().RegisterScope(strName);
+}
+
+const CHAR* CpuProfiler::GetScopeName(UINT32 ScopeID)
+{
+    return GetRegistry().GetScopeName(ScopeID);
+}
+
+void CpuProfiler::SetThreadName(const CHAR* strName)
+{
+    CpuProfileThread* pThread = GetCurrentThreadBuffer();
+    if (pThread != nullptr)
+    {
+        strcpy_s(pThread->strName, strName);
+    }
+}
+
+void CpuProfiler::BeginScope(UINT32 ScopeID)
+{
+    RecordEvent(ScopeID);
+}
+
+void CpuProfiler::EndScope()
+{
+    RecordEvent(EndScopeID);
+}
+
+UINT32 CpuProfiler::GetThreadCount()
+{
+    return GetRegistry().GetThreadCount();
+}
+
+const CHAR* CpuProfiler::GetThreadName(UINT32 ThreadIndex)
+{
+    return GetRegistry().GetThread(ThreadIndex)->strName;
+}
+
+bool CpuProfiler::IsCurrentThread(UINT32 ThreadIndex)
+{
+    return t_pThread != nullptr && GetRegistry().GetThread(ThreadIndex) == t_pThread;
+}
+
+UINT32 CpuProfiler::GetThreadGeneration(UINT32 ThreadIndex)
+{
+    return GetRegistry().GetThread(ThreadIndex)->Generation.load(std::memory_order_acquire);
+}
+
+const std::vector<CpuProfileNode>& CpuProfiler::GatherThread(UINT32 ThreadIndex)
+{
+    CpuProfileThread* pThread = GetRegistry().GetThread(ThreadIndex);
+    const UINT32 Generation = pThread->Generation.load(std::memory_order_acquire);
+    if (Generation != pThread->GatherGeneration)
+    {
+        pThread->GatherGeneration = Generation;
+        pThread->GatherIndex = 0;
+        pThread->OpenScopes.clear();
+        pThread->Nodes.clear();
+        pThread->NodeLUT.clear();
+    }
+    for (auto& Node : pThread->Nodes)
+    {
+        Node.CallCount = 0;
+        Node.Msec = 0;
+    }
+
+    static std::vector<CpuProfileEvent> s_Events;
+    const UINT64 FirstIndex = CopyEvents(pThread, pThread->GatherIndex, s_Events);
+    if (pThread->Generation.load(std::memory_order_acquire) != Generation)
+    {
+        // Taken over by a new thread during the copy; the next gather starts over
+        return pThread->Nodes;
+    }
+    if (FirstIndex != pThread->GatherIndex)
+    {
+        // Events were lost, so the open scopes cannot be matched with their ends
+        pThread->OpenScopes.clear();
+    }
+    pThread->GatherIndex = FirstIndex + s_Events.size();
+
+    for (const auto& Event : s_Events)
+    {
+        if (Event.ScopeID == EndScopeID)
+        {
+            if (pThread->OpenScopes.empty())
+            {
+                continue;
+            }
+            CpuProfileNode& Node = pThread->Nodes[pThread->OpenScopes.back().first];
+            Node.Msec += SystemTime::TicksToMillisecs(Event.Tick - pThread->OpenScopes.back().second);
+            ++Node.CallCount;
+            pThread->OpenScopes.pop_back();
+            continue;
+        }
+
+        const UINT32 ParentIndex = pThread->OpenScopes.empty() ? InvalidIndex : pThread->OpenScopes.back().first;
+        const UINT64 Key = ((UINT64)ParentIndex << 32) | Event.ScopeID;
+        auto iter = pThread->NodeLUT.find(Key);
+        UINT32 NodeIndex;
+        if (iter != pThread->NodeLUT.end())
+        {
+            NodeIndex = iter->second;
+        }
+        else
+        {
+            NodeIndex = (UINT32)pThread->Nodes.size();
+            CpuProfileNode Node = { Event.ScopeID, ParentIndex, 0, 0 };
+            pThread->Nodes.push_back(Node);
+            pThread->NodeLUT[Key] = NodeIndex;
+        }
+        pThread->OpenScopes.push_back(std::make_pair(NodeIndex, Event.Tick));
+    }
+
+    return pThread->Nodes;
+}
+
+bool CpuProfiler::ExportChromeTrace(const std::wstring& FileName)
+{
+    FILE* pFile = nullptr;
+    if (_wfopen_s(&pFile, FileName.c_str(), L"wb") != 0 || pFile == nullptr)
+    {
+        return false;
+    }
+
+    CpuProfileRegistry& Registry = GetRegistry();
+    const UINT32 ThreadCount = Registry.GetThreadCount();
+    const DWORD ProcessId = GetCurrentProcessId();
+
+    // Slots of exited threads are skipped; their events were copied out when they exited
+    std::vector<std::vector<CpuProfileEvent>> ThreadEvents(ThreadCount);
+    INT64 BaseTick = INT64_MAX;
+    for (UINT32 i = 0; i < ThreadCount; ++i)
+    {
+        if (Registry.GetThread(i)->Active.load(std::memory_order_acquire))
+        {
+            CopyEvents(Registry.GetThread(i), 0, ThreadEvents[i]);
+        }
+        if (!ThreadEvents[i].empty())
+        {
+            BaseTick = std::min(BaseTick, ThreadEvents[i].front().Tick);
+        }
+    }
+    Registry.ForEachExitedThread([&BaseTick](const ExitedThread& Exited)
+    {
+        if (!Exited.Events.empty())
+        {
+            BaseTick = std::min(BaseTick, Exited.Events.front().Tick);
+        }
+    });
+
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", pFile);
+    bool FirstEvent = true;
+    auto WriteThread = [&](DWORD ThreadId, const CHAR* strName, const std::vector<CpuProfileEvent>& Events)
+    {
+        if (Events.empty())
+        {
+            return;
+        }
+
+        fprintf(pFile, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":", FirstEvent ? "" : ",\n", (UINT32)ProcessId, (UINT32)ThreadId);
+        WriteJsonString(pFile, strName);
+        fputs("}}", pFile);
+        FirstEvent = false;
+
+        // Ends whose beginnings were overwritten are skipped
+        UINT32 Depth = 0;
+        for (const auto& Event : Events)
+        {
+            const DOUBLE Usec = SystemTime::TicksToMillisecs(Event.Tick - BaseTick) * 1000.0;
+            if (Event.ScopeID == EndScopeID)
+            {
+                if (Depth == 0)
+                {
+                    continue;
+                }
+                --Depth;
+                fprintf(pFile, ",\n{\"ph\":\"E\",\"ts\":%.3f,\"pid\":%u,\"tid\":%u}", Usec, (UINT32)ProcessId, (UINT32)ThreadId);
+            }
+            else
+            {
+                ++Depth;
+                fputs(",\n{\"name\":", pFile);
+                WriteJsonString(pFile, Registry.GetScopeName(Event.ScopeID));
+                fprintf(pFile, ",\"ph\":\"B\",\"ts\":%.3f,\"pid\":%u,\"tid\":%u}", Usec, (UINT32)ProcessId, (UINT32)ThreadId);
+            }
+        }
+    };
+
+    Registry.ForEachExitedThread([&WriteThread](const ExitedThread& Exited)
+    {
+        WriteThread(Exited.ThreadId, Exited.strName, Exited.Events);
+    });
+    for (UINT32 i = 0; i < ThreadCount; ++i)
+    {
+        const CpuProfileThread* pThread = Registry.GetThread(i);
+        WriteThread(pThread->ThreadId, pThread->strName, ThreadEvents[i]);
+    }
+    fputs("\n]}\n", pFile);
+
+    const bool Success = ferror(pFile) == 0;
+    fclose(pFile);
+    return Success;
+}
+
+bool CpuProfiler::Benchmark(UINT32 ThreadCount, UINT32 ScopesPerThread)
+{
+    // Leave room for the engine's own threads, and keep every benchmark thread's events in
+    // the export once it exits
+    const UINT32 FreeThreadSlots = MaxThreads - std::min(GetThreadCount() + 1, MaxThreads);
+    ThreadCount = std::max(1U, std::min(std::min(ThreadCount, FreeThreadSlots / 2), MaxExitedEvents / EventsPerThread));
+    const UINT32 CheckScopeCount = 1000;
+    const UINT32 OuterScopeID = RegisterScope("Benchmark Outer");
+    const UINT32 InnerScopeID = RegisterScope("Benchmark Inner");
+    const UINT32 CheckScopeID = RegisterScope("Benchmark Check");
+
+    // What EngineProfiling did per scope: build the name, look it up and read the clock twice
+    DOUBLE LookupMsec = 0;
+    {
+        std::unordered_map<std::wstring, UINT32> LUT;
+        LUT[L"Benchmark Outer"] = 0;
+        volatile UINT32 Found = 0;
+        const INT64 StartTick = SystemTime::GetCurrentTick();
+        for (UINT32 i = 0; i < ScopesPerThread; ++i)
+        {
+            const std::wstring Name(L"Benchmark Outer");
+            Found += LUT.find(Name)->second;
+            volatile INT64 BeginTick = SystemTime::GetCurrentTick();
+            volatile INT64 EndTick = SystemTime::GetCurrentTick();
+        }
+        LookupMsec = SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - StartTick);
+    }
+
+    std::vector<DOUBLE> ThreadMsec(ThreadCount);
+    std::vector<UINT32> ThreadIndices(ThreadCount, (UINT32)InvalidIndex);
+    std::atomic<UINT32> FinishedThreads(0);
+    std::vector<std::thread> Threads;
+    for (UINT32 t = 0; t < ThreadCount; ++t)
+    {
+        Threads.push_back(std::thread([&, t]()
+        {
+            CHAR strName[32];
+            sprintf_s(strName, "Benchmark %u", t);
+            SetThreadName(strName);
+
+            const INT64 StartTick = SystemTime::GetCurrentTick();
+            for (UINT32 i = 0; i < ScopesPerThread; ++i)
+            {
+                CpuProfileScope Outer(OuterScopeID);
+                CpuProfileScope Inner(InnerScopeID);
+            }
+            ThreadMsec[t] = SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - StartTick);
+
+            // Fits in the ring after the timed scopes have overrun it
+            for (UINT32 i = 0; i < CheckScopeCount; ++i)
+            {
+                CpuProfileScope Check(CheckScopeID);
+            }
+
+            for (UINT32 i = 0; i < GetThreadCount(); ++i)
+            {
+                if (IsCurrentThread(i))
+                {
+                    ThreadIndices[t] = i;
+                }
+            }
+
+            // No thread exits before all have their slots, so no two share one
+            ++FinishedThreads;
+            while (FinishedThreads.load() < ThreadCount)
+            {
+                std::this_thread::yield();
+            }
+        }));
+    }
+    for (auto& Thread : Threads)
+    {
+        Thread.join();
+    }
+
+    bool Valid = true;
+    for (UINT32 t = 0; t < ThreadCount; ++t)
+    {
+        if (ThreadIndices[t] == InvalidIndex)
+        {
+            Valid = false;
+            continue;
+        }
+        const std::vector<CpuProfileNode>& Nodes = GatherThread(ThreadIndices[t]);
+        UINT32 CheckCount = 0;
+        for (UINT32 i = 0; i < Nodes.size(); ++i)
+        {
+            Valid = Valid && (Nodes[i].ParentIndex == InvalidIndex || Nodes[i].ParentIndex < i);
+            if (Nodes[i].ScopeID == CheckScopeID && Nodes[i].ParentIndex == InvalidIndex)
+            {
+                CheckCount += Nodes[i].CallCount;
+            }
+        }
+        Valid = Valid && CheckCount == CheckScopeCount;
+    }
+
+    // Every thread's check scopes must reach the trace
+    const std::wstring TraceFileName = L"CpuProfilerBenchmark.json";
+    UINT32 TracedCheckCount = 0;
+    DOUBLE ExportMsec = 0;
+    {
+        const INT64 StartTick = SystemTime::GetCurrentTick();
+        Valid = ExportChromeTrace(TraceFileName) && Valid;
+        ExportMsec = SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - StartTick);
+
+        FILE* pFile = nullptr;
+        if (_wfopen_s(&pFile, TraceFileName.c_str(), L"rb") == 0 && pFile != nullptr)
+        {
+            CHAR strLine[512];
+            while (fgets(strLine, sizeof(strLine), pFile) != nullptr)
+            {
+                if (strstr(strLine, "\"name\":\"Benchmark Check\"") != nullptr)
+                {
+                    ++TracedCheckCount;
+                }
+            }
+            fclose(pFile);
+        }
+        _wremove(TraceFileName.c_str());
+    }
+    Valid = Valid && TracedCheckCount == ThreadCount * CheckScopeCount;
+
+    // The benchmark threads' slots were released on exit, so a new thread takes one over
+    const UINT32 SlotCount = GetThreadCount();
+    std::thread([]() { SetThreadName("Benchmark Reuse"); }).join();
+    const bool SlotReused = GetThreadCount() == SlotCount;
+    Valid = Valid && SlotReused;
+
+    DOUBLE MaxThreadMsec = 0;
+    for (DOUBLE Msec : ThreadMsec)
+    {
+        MaxThreadMsec = std::max(MaxThreadMsec, Msec);
+    }
+    const DOUBLE ScopeCount = (DOUBLE)ScopesPerThread * 2;
+
+    Utility::PrintfConsole("CPU profiler benchmark: %u threads x %u nested scope pairs\n", ThreadCount, ScopesPerThread);
+    Utility::PrintfConsole("  Name lookup:         %8.1f ns/scope\n", LookupMsec * 1e6 / std::max((DOUBLE)ScopesPerThread, 1.0));
+    Utility::PrintfConsole("  Ring buffer:         %8.1f ns/scope (slowest thread), %.0f scopes/s total\n",
+        MaxThreadMsec * 1e6 / std::max(ScopeCount, 1.0), ScopeCount * ThreadCount * 1000.0 / std::max(MaxThreadMsec, 1e-3));
+    Utility::PrintfConsole("  Chrome trace export: %8.3f ms, %u check scopes traced\n", ExportMsec, TracedCheckCount);
+    Utility::PrintfConsole("  Thread slots:        %u in use, exited slot %s\n", SlotCount, SlotReused ? "reused" : "NOT reused");
+
+    return Valid;
+}
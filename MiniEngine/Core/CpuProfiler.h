@@ -0,0 +1,79 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Per-thread CPU scope recorder.  Each thread writes begin and end events into its own
+// ring buffer with no locks, so any thread can be profiled, including the server and
+// network threads.  Scope names are interned once per call site by CPU_PROFILE_SCOPE, so
+// entering a scope costs a timestamp and a 16 byte write.
+//
+// The main thread's EngineProfiling scopes are recorded here as well; EngineProfiling
+// gathers the other threads into its tree view each frame, and ExportChromeTrace writes
+// the buffered events of every thread as a Chrome trace (chrome://tracing, Perfetto).
+//
+// A thread's ring buffer goes back to the registry when the thread exits, for the next
+// new thread to take over.  Its events are copied out first, and the most recent
+// MaxExitedEvents of them stay in the export.
+
+// A scope on a gathered thread's call tree, with totals since the previous gather
+struct CpuProfileNode
+{
+    UINT32 ScopeID;
+    UINT32 ParentIndex;
+    UINT32 CallCount;
+    DOUBLE Msec;
+};
+
+namespace CpuProfiler
+{
+    static const UINT32 MaxThreads = 64;
+    static const UINT32 EventsPerThread = 65536;
+    static const UINT32 MaxExitedEvents = EventsPerThread * 16;
+    static const UINT32 InvalidIndex = 0xFFFFFFFF;
+
+    // Returns the same ID for the same name
+    UINT32 RegisterScope(const CHAR* strName);
+    const CHAR* GetScopeName(UINT32 ScopeID);
+
+    void SetThreadName(const CHAR* strName);
+    void BeginScope(UINT32 ScopeID);
+    void EndScope();
+
+    UINT32 GetThreadCount();
+    const CHAR* GetThreadName(UINT32 ThreadIndex);
+    bool IsCurrentThread(UINT32 ThreadIndex);
+
+    // Changes when the thread's slot is taken over by a new thread, whose node indices
+    // start over.
+    UINT32 GetThreadGeneration(UINT32 ThreadIndex);
+
+    // Consumes the thread's events since the last call and returns its call tree with the
+    // time spent in each scope meanwhile.  Nodes keep their index between calls, and a
+    // parent always precedes its children.  Call from one thread only.
+    const std::vector<CpuProfileNode>& GatherThread(UINT32 ThreadIndex);
+
+    bool ExportChromeTrace(const std::wstring& FileName);
+
+    // Times scope recording on ThreadCount threads at once and checks that the gathered
+    // trees and the exported trace account for every scope.
+    bool Benchmark(UINT32 ThreadCount, UINT32 ScopesPerThread);
+}
+
+class CpuProfileScope
+{
+public:
+    CpuProfileScope(UINT32 ScopeID) { CpuProfiler::BeginScope(ScopeID); }
+    ~CpuProfileScope() { CpuProfiler::EndScope(); }
+};
+
+#define CPU_PROFILE_CONCAT_(a, b) a##b
+#define CPU_PROFILE_CONCAT(a, b) CPU_PROFILE_CONCAT_(a, b)
+
+#ifdef RELEASE
+#define CPU_PROFILE_SCOPE(Name)
+#else
+#define CPU_PROFILE_SCOPE(Name) \
+    static const UINT32 CPU_PROFILE_CONCAT(s_CpuProfileScope, __LINE__) = CpuProfiler::RegisterScope(Name); \
+    CpuProfileScope CPU_PROFILE_CONCAT(_CpuProfileScope, __LINE__)(CPU_PROFILE_CONCAT(s_CpuProfileScope, __LINE__))
+#endif
@@ -0,0 +1,95 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//--------------------------------------------------------------------------------------
+//
+// DDS header parsing and subresource layout, kept apart from resource creation so that
+// it can be used to read part of a file and can be checked without a device.
+//
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <dxgiformat.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Magic value, DDS_HEADER and DDS_HEADER_DXT10.  Reading this many bytes from the start
+// of a file is always enough to parse its layout.
+const size_t DDS_MAX_HEADER_SIZE = 148;
+
+// One mip of one array slice.  Offsets are from the start of the file.
+struct DDSSubresourceLayout
+{
+    uint64_t Offset;
+    uint64_t Size;          // Every depth slice
+    uint32_t Width;
+    uint32_t Height;
+    uint32_t Depth;
+    uint32_t RowPitch;
+    uint32_t RowCount;      // Rows of blocks for block compressed formats
+    uint32_t SlicePitch;
+};
+
+struct DDSLayout
+{
+    DXGI_FORMAT Format;
+    uint32_t Dimension;     // D3D12_RESOURCE_DIMENSION
+    uint32_t Width;
+    uint32_t Height;
+    uint32_t Depth;
+    uint32_t MipCount;
+    uint32_t ArraySize;     // Six per cube
+    bool IsCubeMap;
+    uint32_t HeaderSize;    // Where the first subresource starts
+    uint64_t DataSize;      // Headers plus every subresource; files may carry trailing bytes
+
+    // Ordered as in the file and as D3D12 subresource indices: all mips of a slice, most
+    // detailed first, then the next slice.
+    std::vector<DDSSubresourceLayout> Subresources;
+
+    const DDSSubresourceLayout& GetSubresource( uint32_t mip, uint32_t slice = 0 ) const
+    {
+        return Subresources[mip + slice * MipCount];
+    }
+
+    // Whether a texture can be created with this mip as its most detailed level.  Block
+    // compressed textures need that level to be whole 4x4 blocks.
+    bool CanStartAtMip( uint32_t mip ) const;
+
+    // Bytes of one slice from this mip to the end of the chain.  For a texture with one
+    // slice these are contiguous in the file, ending at DataSize.
+    uint64_t GetMipChainSize( uint32_t firstMip ) const;
+};
+
+// Parses the headers at the start of ddsData and lays out every subresource of a file
+// fileSize bytes long.  ddsData needs only DDS_MAX_HEADER_SIZE bytes (or the whole file
+// if shorter).  Fails with the same HRESULTs as CreateDDSTextureFromMemory for files that
+// are malformed, unsupported or truncated.
+HRESULT ParseDDSLayout( _In_reads_bytes_(ddsDataSize) const uint8_t* ddsData,
+                        _In_ size_t ddsDataSize,
+                        _In_ uint64_t fileSize,
+                        _Out_ DDSLayout& layout );
+
+size_t BitsPerPixel( _In_ DXGI_FORMAT fmt );
+
+void GetSurfaceInfo( _In_ size_t width,
+                     _In_ size_t height,
+                     _In_ DXGI_FORMAT fmt,
+                     _Out_opt_ size_t* outNumBytes,
+                     _Out_opt_ size_t* outRowBytes,
+                     _Out_opt_ size_t* outNumRows );
+
+DXGI_FORMAT MakeSRGB( _In_ DXGI_FORMAT format );
+
+// Checks ParseDDSLayout against synthetic headers with hand-computed layouts and
+// malformed headers that must be rejected, then parses every DDS file in sampleDirectory
+// (if not empty) in full and from its headers alone, checking that the subresources tile
+// the file.  Needs no device.
+bool ValidateDDSLayouts( const std::wstring& sampleDirectory );
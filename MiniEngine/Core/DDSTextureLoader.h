@@ -21,6 +21,7 @@
 #pragma once
 
 #include <d3d12.h>
+#include "DDSLayout.h"
 
 #pragma warning(push)
 #pragma warning(disable : 4005)
@@ -54,5 +55,3 @@ HRESULT __cdecl CreateDDSTextureFromFile( _In_ ID3D12Device* d3dDevice,
                                             _In_ D3D12_CPU_DESCRIPTOR_HANDLE textureView,
                                             _Out_opt_ DDS_ALPHA_MODE* alphaMode = nullptr
                                             );
-
-size_t BitsPerPixel(_In_ DXGI_FORMAT fmt);
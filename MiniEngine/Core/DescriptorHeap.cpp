@@ -23,9 +23,41 @@ using namespace Graphics;
 //
 std::mutex DescriptorAllocator::sm_AllocationMutex;
 std::vector<Microsoft::WRL::ComPtr<ID3D12DescriptorHeap>> DescriptorAllocator::sm_DescriptorHeapPool;
+bool DescriptorAllocator::sm_Destroyed = false;
+std::atomic<uint32_t> DescriptorAllocator::sm_ContentsGeneration(0);
+
+namespace
+{
+	const uint32_t kDescriptorThreadCacheSize = 16;
+
+	struct DescriptorThreadCache
+	{
+		uint32_t Count;
+		SIZE_T Handles[kDescriptorThreadCacheSize];
+	};
+
+	// One cache per heap type; the allocators are global singletons indexed by type.  Handles
+	// still cached when the thread exits go back to the allocators.
+	struct DescriptorThreadCaches
+	{
+		DescriptorThreadCache Caches[D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES];
+
+		~DescriptorThreadCaches()
+		{
+			for (uint32_t Type = 0; Type < D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES; ++Type)
+			{
+				if (Caches[Type].Count > 0)
+					g_DescriptorAllocator[Type].ReturnCached(Caches[Type].Handles, Caches[Type].Count);
+			}
+		}
+	};
+	thread_local DescriptorThreadCaches t_DescriptorCaches;
+}
 
 void DescriptorAllocator::DestroyAll(void)
 {
+	// Buffers destroyed during static destruction may still free descriptors
+	sm_Destroyed = true;
 	sm_DescriptorHeapPool.clear();
 }
 
@@ -45,24 +77,112 @@ ID3D12DescriptorHeap* DescriptorAllocator::RequestNewHeap(D3D12_DESCRIPTOR_HEAP_
 	return pHeap.Get();
 }
 
-D3D12_CPU_DESCRIPTOR_HANDLE DescriptorAllocator::Allocate( uint32_t Count )
+D3D12_CPU_DESCRIPTOR_HANDLE DescriptorAllocator::GetHandle( uint32_t Index ) const
+{
+	D3D12_CPU_DESCRIPTOR_HANDLE Handle;
+	Handle.ptr = m_HeapStarts[Index / sm_NumDescriptorsPerHeap] + (Index % sm_NumDescriptorsPerHeap) * m_DescriptorSize;
+	return Handle;
+}
+
+void DescriptorAllocator::ReleaseCompletedFrees(void)
 {
-	if (m_CurrentHeap == nullptr || m_RemainingFreeHandles < Count)
+	if (m_Ranges.HasPendingFrees())
+		m_Ranges.ReleaseCompleted([](uint64_t FenceValue) { return g_CommandManager.IsFenceComplete(FenceValue); });
+}
+
+uint32_t DescriptorAllocator::AllocateIndex( uint32_t Count )
+{
+	uint32_t Index = m_Ranges.Allocate(Count);
+	if (Index == DescriptorRangeAllocator::InvalidIndex)
 	{
-		m_CurrentHeap = RequestNewHeap(m_Type);
-		m_CurrentHandle = m_CurrentHeap->GetCPUDescriptorHandleForHeapStart();
-		m_RemainingFreeHandles = sm_NumDescriptorsPerHeap;
+		ID3D12DescriptorHeap* pHeap = RequestNewHeap(m_Type);
+		const SIZE_T HeapStart = pHeap->GetCPUDescriptorHandleForHeapStart().ptr;
+		m_HeapIndexByStart[HeapStart] = m_Ranges.AddHeap();
+		m_HeapStarts.push_back(HeapStart);
 
 		if (m_DescriptorSize == 0)
 			m_DescriptorSize = Graphics::g_Device->GetDescriptorHandleIncrementSize(m_Type);
+
+		Index = m_Ranges.Allocate(Count);
+		ASSERT(Index != DescriptorRangeAllocator::InvalidIndex);
+	}
+	return Index;
+}
+
+D3D12_CPU_DESCRIPTOR_HANDLE DescriptorAllocator::Allocate( uint32_t Count )
+{
+	ASSERT(Count > 0 && Count <= sm_NumDescriptorsPerHeap);
+
+	DescriptorThreadCache& Cache = t_DescriptorCaches.Caches[m_Type];
+	if (Count == 1 && Cache.Count > 0)
+	{
+		--m_CachedDescriptors;
+		D3D12_CPU_DESCRIPTOR_HANDLE Handle;
+		Handle.ptr = Cache.Handles[--Cache.Count];
+		return Handle;
+	}
+
+	std::lock_guard<std::mutex> LockGuard(m_Mutex);
+
+	ReleaseCompletedFrees();
+
+	D3D12_CPU_DESCRIPTOR_HANDLE ret = GetHandle(AllocateIndex(Count));
+
+	// Refill the cache while the lock is held
+	if (Count == 1)
+	{
+		while (Cache.Count < kDescriptorThreadCacheSize)
+			Cache.Handles[Cache.Count++] = GetHandle(AllocateIndex(1)).ptr;
+		m_CachedDescriptors += kDescriptorThreadCacheSize;
 	}
 
-	D3D12_CPU_DESCRIPTOR_HANDLE ret = m_CurrentHandle;
-	m_CurrentHandle.ptr += Count * m_DescriptorSize;
-	m_RemainingFreeHandles -= Count;
 	return ret;
 }
 
+void DescriptorAllocator::Free( D3D12_CPU_DESCRIPTOR_HANDLE Handle, uint32_t Count, uint64_t FenceValue )
+{
+	if (sm_Destroyed || Handle.ptr == D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN)
+		return;
+
+	if (FenceValue == 0)
+		FenceValue = g_CommandManager.GetGraphicsQueue().GetNextFenceValue();
+
+	// The handle will be handed out again with new contents
+	InvalidateCopies();
+
+	std::lock_guard<std::mutex> LockGuard(m_Mutex);
+	m_Ranges.Free(GetIndex(Handle.ptr, Count), Count, FenceValue);
+}
+
+void DescriptorAllocator::ReturnCached( const SIZE_T* Handles, uint32_t Count )
+{
+	if (sm_Destroyed)
+		return;
+
+	// Cached handles were never handed out, so they are free at once
+	std::lock_guard<std::mutex> LockGuard(m_Mutex);
+	for (uint32_t i = 0; i < Count; ++i)
+		m_Ranges.FreeImmediate(GetIndex(Handles[i], 1), 1);
+	m_CachedDescriptors -= Count;
+}
+
+uint32_t DescriptorAllocator::GetIndex( SIZE_T HandlePtr, uint32_t Count ) const
+{
+	auto iter = m_HeapIndexByStart.upper_bound(HandlePtr);
+	ASSERT(iter != m_HeapIndexByStart.begin(), "Descriptor was not allocated from this allocator");
+	--iter;
+	const uint32_t Offset = (uint32_t)((HandlePtr - iter->first) / m_DescriptorSize);
+	ASSERT(Offset + Count <= sm_NumDescriptorsPerHeap);
+	return iter->second * sm_NumDescriptorsPerHeap + Offset;
+}
+
+DescriptorRangeStats DescriptorAllocator::GetStats(void)
+{
+	std::lock_guard<std::mutex> LockGuard(m_Mutex);
+	ReleaseCompletedFrees();
+	return m_Ranges.GetStats();
+}
+
 //
 // UserDescriptorHeap implementation
 //
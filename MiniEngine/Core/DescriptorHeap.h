@@ -17,18 +17,38 @@
 #include <vector>
 #include <queue>
 #include <string>
+#include <map>
+#include <atomic>
+#include "DescriptorRangeAllocator.h"
 
 
 // This is an unbounded resource descriptor allocator.  It is intended to provide space for CPU-visible resource descriptors
 // as resources are created.  For those that need to be made shader-visible, they will need to be copied to a UserDescriptorHeap
-// or a DynamicDescriptorHeap.
+// or a DynamicDescriptorHeap.  Freed descriptors are recycled once the GPU is past the fence they were freed at; single
+// descriptors are handed out from a small per-thread cache so most allocations do not take the lock.
 class DescriptorAllocator
 {
 public:
-	DescriptorAllocator(D3D12_DESCRIPTOR_HEAP_TYPE Type) : m_Type(Type), m_CurrentHeap(nullptr) {}
+	DescriptorAllocator(D3D12_DESCRIPTOR_HEAP_TYPE Type)
+		: m_Type(Type), m_DescriptorSize(0), m_Ranges(sm_NumDescriptorsPerHeap), m_CachedDescriptors(0) {}
 
 	D3D12_CPU_DESCRIPTOR_HANDLE Allocate( uint32_t Count );
 
+	// Count must match the allocation.  A FenceValue of zero waits for the next graphics queue fence, which
+	// covers descriptors still waiting to be copied by a context that has not been submitted.
+	void Free( D3D12_CPU_DESCRIPTOR_HANDLE Handle, uint32_t Count, uint64_t FenceValue = 0 );
+
+	// Takes back single descriptors a thread cached but never handed out.
+	void ReturnCached( const SIZE_T* Handles, uint32_t Count );
+
+	DescriptorRangeStats GetStats(void);
+
+	// Changes whenever a descriptor is freed or rewritten in place, so shader-visible copies keyed
+	// by CPU handle can tell their source may have changed.
+	static uint32_t GetContentsGeneration(void) { return sm_ContentsGeneration.load(std::memory_order_acquire); }
+	static void InvalidateCopies(void) { sm_ContentsGeneration.fetch_add(1, std::memory_order_release); }
+	uint32_t GetCachedDescriptorCount(void) const { return m_CachedDescriptors; }
+
 	static void DestroyAll(void);
 
 protected:
@@ -36,13 +56,23 @@ protected:
 	static const uint32_t sm_NumDescriptorsPerHeap = 256;
 	static std::mutex sm_AllocationMutex;
 	static std::vector<Microsoft::WRL::ComPtr<ID3D12DescriptorHeap>> sm_DescriptorHeapPool;
+	static bool sm_Destroyed;
+	static std::atomic<uint32_t> sm_ContentsGeneration;
 	static ID3D12DescriptorHeap* RequestNewHeap( D3D12_DESCRIPTOR_HEAP_TYPE Type );
 
+	uint32_t AllocateIndex( uint32_t Count );
+	D3D12_CPU_DESCRIPTOR_HANDLE GetHandle( uint32_t Index ) const;
+	uint32_t GetIndex( SIZE_T HandlePtr, uint32_t Count ) const;
+	void ReleaseCompletedFrees(void);
+
 	D3D12_DESCRIPTOR_HEAP_TYPE m_Type;
-	ID3D12DescriptorHeap* m_CurrentHeap;
-	D3D12_CPU_DESCRIPTOR_HANDLE m_CurrentHandle;
 	uint32_t m_DescriptorSize;
-	uint32_t m_RemainingFreeHandles;
+
+	std::mutex m_Mutex;
+	DescriptorRangeAllocator m_Ranges;
+	std::vector<SIZE_T> m_HeapStarts;
+	std::map<SIZE_T, uint32_t> m_HeapIndexByStart;
+	std::atomic<uint32_t> m_CachedDescriptors;
 };
 
 
@@ -0,0 +1,223 @@
+#include "pch.h"
+#include "DescriptorRangeAllocator.h"
+#include "SystemTime.h"
+#include <vector>
+
+DescriptorRangeAllocator::DescriptorRangeAllocator(UINT32 HeapSize)
+    : m_HeapSize(HeapSize),
+      m_HeapOrder(BuddyRangeAllocator::GetOrder(HeapSize))
+{
+    assert(HeapSize > 0 && (HeapSize & (HeapSize - 1)) == 0);
+    ZeroMemory(&m_Stats, sizeof(m_Stats));
+}
+
+void DescriptorRangeAllocator::ReleaseRange(UINT32 Index, UINT32 Count)
+{
+    m_Heaps[Index / m_HeapSize]->Free(Index % m_HeapSize, BuddyRangeAllocator::GetOrder(Count));
+}
+
+UINT32 DescriptorRangeAllocator::Allocate(UINT32 Count)
+{
+    assert(Count > 0 && Count <= m_HeapSize);
+    const UINT32 Order = BuddyRangeAllocator::GetOrder(Count);
+
+    // First heap with room, which keeps live ranges packed toward the older heaps
+    for (UINT32 HeapIndex = 0; HeapIndex < (UINT32)m_Heaps.size(); ++HeapIndex)
+    {
+        BuddyRangeAllocator& Heap = *m_Heaps[HeapIndex];
+        if (Heap.GetLargestFreeOrder() < (INT32)Order)
+        {
+            continue;
+        }
+
+        const UINT32 Offset = Heap.Allocate(Order);
+        m_Stats.LiveDescriptors += Count;
+        m_Stats.PaddingDescriptors += (1U << Order) - Count;
+        m_Stats.PeakLiveDescriptors = std::max(m_Stats.PeakLiveDescriptors, m_Stats.LiveDescriptors);
+        ++m_Stats.AllocationCount;
+        return HeapIndex * m_HeapSize + Offset;
+    }
+    return InvalidIndex;
+}
+
+UINT32 DescriptorRangeAllocator::AddHeap()
+{
+    m_Heaps.emplace_back(new BuddyRangeAllocator(m_HeapOrder));
+    m_Stats.CapacityDescriptors += m_HeapSize;
+    return (UINT32)m_Heaps.size() - 1;
+}
+
+void DescriptorRangeAllocator::Free(UINT32 Index, UINT32 Count, UINT64 FenceValue)
+{
+    assert(Index / m_HeapSize < m_Heaps.size());
+    const UINT32 Order = BuddyRangeAllocator::GetOrder(Count);
+    assert((Index & ((1U << Order) - 1)) == 0);
+
+    m_Stats.LiveDescriptors -= Count;
+    m_Stats.PaddingDescriptors -= (1U << Order) - Count;
+    m_Stats.PendingDescriptors += 1U << Order;
+    ++m_Stats.FreeCount;
+
+    PendingFree PF;
+    PF.FenceValue = FenceValue;
+    PF.Index = Index;
+    PF.Count = Count;
+    m_PendingFrees.push_back(PF);
+}
+
+void DescriptorRangeAllocator::FreeImmediate(UINT32 Index, UINT32 Count)
+{
+    assert(Index / m_HeapSize < m_Heaps.size());
+    const UINT32 Order = BuddyRangeAllocator::GetOrder(Count);
+    assert((Index & ((1U << Order) - 1)) == 0);
+
+    m_Stats.LiveDescriptors -= Count;
+    m_Stats.PaddingDescriptors -= (1U << Order) - Count;
+    ++m_Stats.FreeCount;
+    ReleaseRange(Index, Count);
+}
+
+UINT32 DescriptorRangeAllocator::ReleaseCompleted(const std::function<bool(UINT64)>& IsFenceComplete)
+{
+    // Fences from different queues interleave, so the whole queue is scanned rather than
+    // stopping at the first incomplete entry.
+    UINT32 ReleasedCount = 0;
+    auto iter = m_PendingFrees.begin();
+    while (iter != m_PendingFrees.end())
+    {
+        if (!IsFenceComplete(iter->FenceValue))
+        {
+            ++iter;
+            continue;
+        }
+
+        m_Stats.PendingDescriptors -= 1U << BuddyRangeAllocator::GetOrder(iter->Count);
+        ReleaseRange(iter->Index, iter->Count);
+        ReleasedCount += iter->Count;
+        iter = m_PendingFrees.erase(iter);
+    }
+    return ReleasedCount;
+}
+
+DescriptorRangeStats DescriptorRangeAllocator::GetStats() const
+{
+    DescriptorRangeStats Stats = m_Stats;
+    Stats.HeapCount = (UINT32)m_Heaps.size();
+    Stats.FreeDescriptors = 0;
+    Stats.LargestFreeBlock = 0;
+    for (const auto& Heap : m_Heaps)
+    {
+        Stats.FreeDescriptors += Heap->GetFreeUnits();
+        const INT32 LargestOrder = Heap->GetLargestFreeOrder();
+        if (LargestOrder >= 0)
+        {
+            Stats.LargestFreeBlock = std::max(Stats.LargestFreeBlock, 1U << LargestOrder);
+        }
+    }
+    return Stats;
+}
+
+void DescriptorRangeAllocator::Reset()
+{
+    m_Heaps.clear();
+    m_PendingFrees.clear();
+    ZeroMemory(&m_Stats, sizeof(m_Stats));
+}
+
+bool DescriptorRangeAllocator::Benchmark(UINT32 OperationCount, UINT32 MaxLiveRanges)
+{
+    const UINT32 HeapSize = 256;
+    MaxLiveRanges = std::max(MaxLiveRanges, 1U);
+
+    UINT32 Seed = 1;
+    auto Random = [&Seed]() { Seed = Seed * 1664525 + 1013904223; return Seed >> 8; };
+
+    DescriptorRangeAllocator Allocator(HeapSize);
+    std::vector<std::pair<UINT32, UINT32>> LiveRanges;
+    std::vector<bool> InUse;
+    UINT64 BumpDescriptors = 0;
+    UINT64 FenceValue = 0;
+    UINT64 CompletedFenceValue = 0;
+    bool Valid = true;
+
+    auto IsFenceComplete = [&CompletedFenceValue](UINT64 Fence) { return Fence <= CompletedFenceValue; };
+
+    const INT64 StartTick = SystemTime::GetCurrentTick();
+    for (UINT32 Op = 0; Op < OperationCount; ++Op)
+    {
+        // The simulated GPU trails submission by a few fences
+        ++FenceValue;
+        if ((Op & 15) == 0)
+        {
+            CompletedFenceValue = FenceValue > 8 ? FenceValue - 8 : 0;
+            Allocator.ReleaseCompleted(IsFenceComplete);
+        }
+
+        if (LiveRanges.empty() || (LiveRanges.size() < MaxLiveRanges && Random() % 100 < 55))
+        {
+            // Mostly single SRVs, some small tables, a few large ones
+            const UINT32 Roll = Random() % 100;
+            const UINT32 Count = Roll < 70 ? 1 : (Roll < 90 ? 2 + Random() % 7 : 9 + Random() % 56);
+
+            UINT32 Index = Allocator.Allocate(Count);
+            if (Index == InvalidIndex)
+            {
+                Allocator.AddHeap();
+                InUse.resize(Allocator.GetHeapCount() * HeapSize, false);
+                Index = Allocator.Allocate(Count);
+            }
+
+            if (Index == InvalidIndex || Index / HeapSize != (Index + Count - 1) / HeapSize)
+            {
+                Valid = false;
+                break;
+            }
+            for (UINT32 i = Index; i < Index + Count; ++i)
+            {
+                Valid = Valid && !InUse[i];
+                InUse[i] = true;
+            }
+            LiveRanges.push_back(std::make_pair(Index, Count));
+            BumpDescriptors += Count;
+        }
+        else
+        {
+            const UINT32 Victim = Random() % (UINT32)LiveRanges.size();
+            const std::pair<UINT32, UINT32> Range = LiveRanges[Victim];
+            LiveRanges[Victim] = LiveRanges.back();
+            LiveRanges.pop_back();
+            for (UINT32 i = Range.first; i < Range.first + Range.second; ++i)
+            {
+                InUse[i] = false;
+            }
+            Allocator.Free(Range.first, Range.second, FenceValue);
+        }
+    }
+    const DOUBLE ElapsedMsec = SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - StartTick);
+    const DescriptorRangeStats ChurnStats = Allocator.GetStats();
+
+    // Everything must merge back into whole heaps once released
+    for (const auto& Range : LiveRanges)
+    {
+        Allocator.Free(Range.first, Range.second, FenceValue);
+    }
+    Allocator.ReleaseCompleted([](UINT64) { return true; });
+    const DescriptorRangeStats FinalStats = Allocator.GetStats();
+    Valid = Valid && FinalStats.LiveDescriptors == 0 && FinalStats.PendingDescriptors == 0 &&
+        FinalStats.FreeDescriptors == FinalStats.CapacityDescriptors;
+    for (const auto& Heap : Allocator.m_Heaps)
+    {
+        Valid = Valid && Heap->IsFree(0, Allocator.m_HeapOrder);
+    }
+
+    Utility::PrintfConsole("Descriptor allocator benchmark: %u operations, up to %u live ranges, %u-descriptor heaps\n",
+        OperationCount, MaxLiveRanges, HeapSize);
+    Utility::PrintfConsole("  Throughput:        %10.1f ops/ms\n", (DOUBLE)OperationCount / std::max(ElapsedMsec, 1e-3));
+    Utility::PrintfConsole("  Heaps:             %10u (bump allocator: %llu)\n", ChurnStats.HeapCount, (BumpDescriptors + HeapSize - 1) / HeapSize);
+    Utility::PrintfConsole("  Live / peak:       %10u / %u descriptors, %u padding, %u pending\n",
+        ChurnStats.LiveDescriptors, ChurnStats.PeakLiveDescriptors, ChurnStats.PaddingDescriptors, ChurnStats.PendingDescriptors);
+    Utility::PrintfConsole("  Free:              %10u descriptors, largest block %u, fragmentation %0.2f\n",
+        ChurnStats.FreeDescriptors, ChurnStats.LargestFreeBlock, ChurnStats.GetFragmentation());
+
+    return Valid;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "BuddyRangeAllocator.h"
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+struct DescriptorRangeStats
+{
+    UINT32 HeapCount;
+    UINT32 CapacityDescriptors;
+    UINT32 LiveDescriptors;
+    UINT32 PaddingDescriptors;
+    UINT32 PendingDescriptors;
+    UINT32 FreeDescriptors;
+    UINT32 LargestFreeBlock;
+    UINT32 PeakLiveDescriptors;
+    UINT64 AllocationCount;
+    UINT64 FreeCount;
+
+    // 0 when all free descriptors form one block, approaching 1 as they scatter
+    FLOAT GetFragmentation() const { return FreeDescriptors > 0 ? 1.0f - (FLOAT)LargestFreeBlock / (FLOAT)FreeDescriptors : 0.0f; }
+};
+
+// Index bookkeeping behind DescriptorAllocator, kept free of D3D so it can be exercised
+// on its own.  Indices are grouped into heaps of HeapSize; a range never crosses a heap.
+// Each heap's ranges are power-of-two blocks of its own BuddyRangeAllocator, so freed
+// neighbors merge back into larger blocks.  Allocation takes the first heap with room,
+// which keeps live ranges packed toward the older heaps.  Frees are deferred until the
+// fence value passed with them is reported complete.
+//
+// Not thread safe; DescriptorAllocator serializes access.
+class DescriptorRangeAllocator
+{
+public:
+    static const UINT32 InvalidIndex = 0xFFFFFFFF;
+
+private:
+    struct PendingFree
+    {
+        UINT64 FenceValue;
+        UINT32 Index;
+        UINT32 Count;
+    };
+
+    UINT32 m_HeapSize;
+    UINT32 m_HeapOrder;
+    std::vector<std::unique_ptr<BuddyRangeAllocator>> m_Heaps;
+    std::deque<PendingFree> m_PendingFrees;
+
+    DescriptorRangeStats m_Stats;
+
+public:
+    explicit DescriptorRangeAllocator(UINT32 HeapSize);
+
+    // Returns the first of Count contiguous indices, or InvalidIndex when no heap has room;
+    // the caller then creates a heap, calls AddHeap and tries again.
+    UINT32 Allocate(UINT32 Count);
+
+    // Adds HeapSize free indices starting at GetHeapCount() * HeapSize.
+    UINT32 AddHeap();
+    UINT32 GetHeapCount() const { return (UINT32)m_Heaps.size(); }
+    UINT32 GetHeapSize() const { return m_HeapSize; }
+
+    // Queues a range allocated with the same Count for release once FenceValue completes.
+    void Free(UINT32 Index, UINT32 Count, UINT64 FenceValue);
+    void FreeImmediate(UINT32 Index, UINT32 Count);
+
+    // Releases every queued range whose fence has completed; returns the descriptors freed.
+    UINT32 ReleaseCompleted(const std::function<bool(UINT64)>& IsFenceComplete);
+    bool HasPendingFrees() const { return !m_PendingFrees.empty(); }
+
+    DescriptorRangeStats GetStats() const;
+    void Reset();
+
+    // Randomized allocate/free churn that checks ranges never overlap and that everything
+    // merges back once freed, then reports heap growth against a bump allocator.
+    static bool Benchmark(UINT32 OperationCount, UINT32 MaxLiveRanges);
+
+private:
+    void ReleaseRange(UINT32 Index, UINT32 Count);
+};
@@ -0,0 +1,279 @@
+#include "pch.h"
+#include "DescriptorTableReuseCache.h"
+#include "Hash.h"
+#include "SystemTime.h"
+
+DescriptorTableReuseCache::DescriptorTableReuseCache(UINT32 MaxTables)
+    : m_MaxTables(MaxTables),
+      m_TableCount(0),
+      m_Generation(1),
+      m_ContentsGeneration(0)
+{
+    ZeroMemory(&m_Stats, sizeof(m_Stats));
+}
+
+UINT64 DescriptorTableReuseCache::HashTable(UINT32 AssignedBitMap, UINT32 TableSize, const D3D12_CPU_DESCRIPTOR_HANDLE* pHandles)
+{
+    size_t Hash = Utility::HashState(&AssignedBitMap);
+    Hash = Utility::HashState(&TableSize, 1, Hash);
+
+    unsigned long Index;
+    UINT32 SetHandles = AssignedBitMap;
+    while (_BitScanForward(&Index, SetHandles))
+    {
+        SetHandles ^= (1 << Index);
+        Hash = Utility::HashState(&pHandles[Index], 1, Hash);
+    }
+    return Hash;
+}
+
+bool DescriptorTableReuseCache::KeyMatches(const Slot& S, UINT32 AssignedBitMap, UINT32 TableSize, const D3D12_CPU_DESCRIPTOR_HANDLE* pHandles) const
+{
+    if (S.AssignedBitMap != AssignedBitMap || S.TableSize != TableSize)
+    {
+        return false;
+    }
+
+    const D3D12_CPU_DESCRIPTOR_HANDLE* pKey = &m_Keys[S.KeyOffset];
+    unsigned long Index;
+    UINT32 SetHandles = AssignedBitMap;
+    while (_BitScanForward(&Index, SetHandles))
+    {
+        SetHandles ^= (1 << Index);
+        if (pKey[Index].ptr != pHandles[Index].ptr)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool DescriptorTableReuseCache::Find(UINT64 Hash, UINT32 AssignedBitMap, UINT32 TableSize, const D3D12_CPU_DESCRIPTOR_HANDLE* pHandles,
+    D3D12_GPU_DESCRIPTOR_HANDLE& GpuHandle)
+{
+    if (m_TableCount == 0)
+    {
+        return false;
+    }
+
+    const UINT32 Mask = (UINT32)m_Slots.size() - 1;
+    for (UINT32 i = (UINT32)Hash & Mask; m_Slots[i].Generation == m_Generation; i = (i + 1) & Mask)
+    {
+        const Slot& S = m_Slots[i];
+        if (S.Hash == Hash && KeyMatches(S, AssignedBitMap, TableSize, pHandles))
+        {
+            GpuHandle.ptr = S.GpuPtr;
+            ++m_Stats.TablesReused;
+            m_Stats.DescriptorsReused += __popcnt(AssignedBitMap);
+            return true;
+        }
+    }
+    return false;
+}
+
+void DescriptorTableReuseCache::Insert(UINT64 Hash, UINT32 AssignedBitMap, UINT32 TableSize, const D3D12_CPU_DESCRIPTOR_HANDLE* pHandles,
+    D3D12_GPU_DESCRIPTOR_HANDLE GpuHandle)
+{
+    ++m_Stats.TablesCopied;
+    m_Stats.DescriptorsCopied += __popcnt(AssignedBitMap);
+
+    // Sized on first use so contexts that never bind tables of this heap type pay nothing
+    if (m_Slots.empty())
+    {
+        UINT32 SlotCount = 16;
+        while (SlotCount < m_MaxTables * 2)
+        {
+            SlotCount <<= 1;
+        }
+        m_Slots.resize(SlotCount);
+        ZeroMemory(m_Slots.data(), SlotCount * sizeof(Slot));
+    }
+
+    // Keep the load factor at or below one half so probes stay short
+    if ((m_TableCount + 1) * 2 > (UINT32)m_Slots.size())
+    {
+        return;
+    }
+
+    const UINT32 Mask = (UINT32)m_Slots.size() - 1;
+    UINT32 i = (UINT32)Hash & Mask;
+    while (m_Slots[i].Generation == m_Generation)
+    {
+        i = (i + 1) & Mask;
+    }
+
+    Slot& S = m_Slots[i];
+    S.Hash = Hash;
+    S.GpuPtr = GpuHandle.ptr;
+    S.Generation = m_Generation;
+    S.KeyOffset = (UINT32)m_Keys.size();
+    S.AssignedBitMap = AssignedBitMap;
+    S.TableSize = TableSize;
+    m_Keys.insert(m_Keys.end(), pHandles, pHandles + TableSize);
+    ++m_TableCount;
+}
+
+void DescriptorTableReuseCache::Reset()
+{
+    if (m_TableCount == 0)
+    {
+        return;
+    }
+
+    ++m_Stats.HeapResets;
+    DropEntries();
+}
+
+void DescriptorTableReuseCache::SetContentsGeneration(UINT32 ContentsGeneration)
+{
+    if (ContentsGeneration == m_ContentsGeneration)
+    {
+        return;
+    }
+
+    m_ContentsGeneration = ContentsGeneration;
+    if (m_TableCount > 0)
+    {
+        DropEntries();
+    }
+}
+
+void DescriptorTableReuseCache::DropEntries()
+{
+    m_TableCount = 0;
+    m_Keys.clear();
+
+    if (++m_Generation == 0)
+    {
+        ZeroMemory(m_Slots.data(), m_Slots.size() * sizeof(Slot));
+        m_Generation = 1;
+    }
+}
+
+bool DescriptorTableReuseCache::Benchmark(UINT32 MaterialCount, UINT32 DrawCount, UINT32 FrameCount)
+{
+    // Matches DynamicDescriptorHeap: 1024-descriptor heaps, six SRVs per model material
+    const UINT32 HeapSize = 1024;
+    const UINT32 TableSize = 6;
+    const UINT32 PassCount = 3;
+    const UINT32 DescriptorSize = 32;
+    MaterialCount = std::max(MaterialCount, 1U);
+    FrameCount = std::max(FrameCount, 1U);
+
+    UINT32 Seed = 1;
+    auto Random = [&Seed]() { Seed = Seed * 1664525 + 1013904223; return Seed >> 8; };
+
+    // Half of the draws use the most common eighth of the materials
+    std::vector<UINT32> DrawMaterials((size_t)DrawCount * FrameCount);
+    const UINT32 HotMaterialCount = std::max(MaterialCount / 8, 1U);
+    for (auto& Material : DrawMaterials)
+    {
+        Material = (Random() & 1) ? Random() % HotMaterialCount : Random() % MaterialCount;
+    }
+
+    struct ModeResult
+    {
+        UINT64 CopyCalls;
+        UINT64 DescriptorsCopied;
+        UINT64 HeapCount;
+        DOUBLE ElapsedMsec;
+    };
+    ModeResult Results[2];
+    DescriptorTableReuseStats ReuseStats = {};
+    bool Valid = true;
+
+    std::vector<UINT64> HeapContents(HeapSize, 0);
+    for (UINT32 Mode = 0; Mode < 2; ++Mode)
+    {
+        const bool UseReuse = (Mode == 1);
+        DescriptorTableReuseCache Cache(HeapSize);
+        ModeResult& Result = Results[Mode];
+        ZeroMemory(&Result, sizeof(Result));
+
+        const INT64 StartTick = SystemTime::GetCurrentTick();
+        for (UINT32 Frame = 0; Frame < FrameCount; ++Frame)
+        {
+            // One command list per frame; its heaps retire when it finishes
+            UINT32 HeapOffset = HeapSize;
+            Cache.Reset();
+
+            for (UINT32 Pass = 0; Pass < PassCount; ++Pass)
+            {
+                for (UINT32 Draw = 0; Draw < DrawCount; ++Draw)
+                {
+                    const UINT32 Material = DrawMaterials[(size_t)Frame * DrawCount + Draw];
+                    D3D12_CPU_DESCRIPTOR_HANDLE Handles[TableSize];
+                    for (UINT32 i = 0; i < TableSize; ++i)
+                    {
+                        Handles[i].ptr = 0x10000 + ((SIZE_T)Material * TableSize + i) * DescriptorSize;
+                    }
+
+                    const UINT32 AssignedBitMap = (1 << TableSize) - 1;
+                    UINT64 Hash = 0;
+                    if (UseReuse)
+                    {
+                        Hash = HashTable(AssignedBitMap, TableSize, Handles);
+                        D3D12_GPU_DESCRIPTOR_HANDLE GpuHandle;
+                        if (Cache.Find(Hash, AssignedBitMap, TableSize, Handles, GpuHandle))
+                        {
+                            const UINT32 Offset = (UINT32)(GpuHandle.ptr / DescriptorSize);
+                            for (UINT32 i = 0; i < TableSize; ++i)
+                            {
+                                Valid = Valid && HeapContents[Offset + i] == Handles[i].ptr;
+                            }
+                            continue;
+                        }
+                    }
+
+                    if (HeapOffset + TableSize > HeapSize)
+                    {
+                        Cache.Reset();
+                        HeapOffset = 0;
+                        ++Result.HeapCount;
+                    }
+
+                    for (UINT32 i = 0; i < TableSize; ++i)
+                    {
+                        HeapContents[HeapOffset + i] = Handles[i].ptr;
+                    }
+                    ++Result.CopyCalls;
+                    Result.DescriptorsCopied += TableSize;
+
+                    if (UseReuse)
+                    {
+                        D3D12_GPU_DESCRIPTOR_HANDLE GpuHandle;
+                        GpuHandle.ptr = (UINT64)HeapOffset * DescriptorSize;
+                        Cache.Insert(Hash, AssignedBitMap, TableSize, Handles, GpuHandle);
+                    }
+                    HeapOffset += TableSize;
+                }
+            }
+        }
+        Result.ElapsedMsec = SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - StartTick);
+
+        if (UseReuse)
+        {
+            ReuseStats = Cache.GetStats();
+        }
+    }
+
+    const UINT64 TableCount = (UINT64)DrawCount * PassCount * FrameCount;
+    Valid = Valid && ReuseStats.TablesCopied + ReuseStats.TablesReused == TableCount &&
+        ReuseStats.TablesCopied == Results[1].CopyCalls;
+
+    Utility::PrintfConsole("Descriptor table reuse benchmark: %u materials, %u draws x %u passes, %u frames\n",
+        MaterialCount, DrawCount, PassCount, FrameCount);
+    static const char* s_ModeNames[2] = { "Copy every table", "Reuse copied tables" };
+    for (UINT32 Mode = 0; Mode < 2; ++Mode)
+    {
+        const ModeResult& Result = Results[Mode];
+        Utility::PrintfConsole("  %-20s %9.1f CopyDescriptors/frame, %9.1f descriptors/frame, %6.1f heaps/frame, %7.3f ms/frame bookkeeping\n",
+            s_ModeNames[Mode], (DOUBLE)Result.CopyCalls / FrameCount, (DOUBLE)Result.DescriptorsCopied / FrameCount,
+            (DOUBLE)Result.HeapCount / FrameCount, Result.ElapsedMsec / FrameCount);
+    }
+    Utility::PrintfConsole("  Tables reused:       %5.1f%% (%llu of %llu), %llu descriptor copies avoided\n",
+        100.0 * (DOUBLE)ReuseStats.TablesReused / (DOUBLE)std::max<UINT64>(TableCount, 1),
+        ReuseStats.TablesReused, TableCount, ReuseStats.DescriptorsReused);
+
+    return Valid;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <vector>
+
+struct DescriptorTableReuseStats
+{
+    UINT64 TablesCopied;
+    UINT64 TablesReused;
+    UINT64 DescriptorsCopied;
+    UINT64 DescriptorsReused;
+    UINT64 CopyCalls;
+    UINT64 HeapResets;
+
+    void Accumulate(const DescriptorTableReuseStats& Other)
+    {
+        TablesCopied += Other.TablesCopied;
+        TablesReused += Other.TablesReused;
+        DescriptorsCopied += Other.DescriptorsCopied;
+        DescriptorsReused += Other.DescriptorsReused;
+        CopyCalls += Other.CopyCalls;
+        HeapResets += Other.HeapResets;
+    }
+};
+
+// Remembers the descriptor tables already copied into one shader-visible heap, keyed by
+// the source CPU handles, so a table bound again with the same contents can point at the
+// earlier copy.  Entries are only valid until the heap is retired; Reset() drops them all
+// in constant time by bumping a generation counter.  A source handle that is freed or
+// rewritten in place keeps its address, so the owner also passes in the allocator's
+// contents generation and entries copied under an older one are dropped the same way.
+//
+// Unassigned slots of a table are ignored, matching what DynamicDescriptorHeap copies.
+// Not thread safe; each DynamicDescriptorHeap owns one.
+class DescriptorTableReuseCache
+{
+private:
+    struct Slot
+    {
+        UINT64 Hash;
+        UINT64 GpuPtr;
+        UINT32 Generation;
+        UINT32 KeyOffset;
+        UINT32 AssignedBitMap;
+        UINT32 TableSize;
+    };
+
+    UINT32 m_MaxTables;
+    UINT32 m_TableCount;
+    UINT32 m_Generation;
+    UINT32 m_ContentsGeneration;
+    std::vector<Slot> m_Slots;
+    std::vector<D3D12_CPU_DESCRIPTOR_HANDLE> m_Keys;
+
+    DescriptorTableReuseStats m_Stats;
+
+public:
+    // MaxTables bounds the entries per heap; one per descriptor is always enough.
+    explicit DescriptorTableReuseCache(UINT32 MaxTables);
+
+    static UINT64 HashTable(UINT32 AssignedBitMap, UINT32 TableSize, const D3D12_CPU_DESCRIPTOR_HANDLE* pHandles);
+
+    // Returns true with the GPU handle of an identical table copied since the last Reset.
+    bool Find(UINT64 Hash, UINT32 AssignedBitMap, UINT32 TableSize, const D3D12_CPU_DESCRIPTOR_HANDLE* pHandles,
+        D3D12_GPU_DESCRIPTOR_HANDLE& GpuHandle);
+
+    // Records a table that was just copied to GpuHandle.
+    void Insert(UINT64 Hash, UINT32 AssignedBitMap, UINT32 TableSize, const D3D12_CPU_DESCRIPTOR_HANDLE* pHandles,
+        D3D12_GPU_DESCRIPTOR_HANDLE GpuHandle);
+
+    void Reset();
+
+    // Drops every entry if source descriptors were freed or rewritten since the last call.
+    void SetContentsGeneration(UINT32 ContentsGeneration);
+
+    bool IsEmpty() const { return m_TableCount == 0; }
+
+    void RecordCopyCalls(UINT32 Count) { m_Stats.CopyCalls += Count; }
+    const DescriptorTableReuseStats& GetStats() const { return m_Stats; }
+    void ResetStats() { ZeroMemory(&m_Stats, sizeof(m_Stats)); }
+
+    // Replays a synthetic material binding stream through a simulated heap with and
+    // without reuse, checking every reused table against the simulated heap contents,
+    // and reports CopyDescriptors calls per frame.  Needs no device.
+    static bool Benchmark(UINT32 MaterialCount, UINT32 DrawCount, UINT32 FrameCount);
+
+private:
+    void DropEntries();
+    bool KeyMatches(const Slot& S, UINT32 AssignedBitMap, UINT32 TableSize, const D3D12_CPU_DESCRIPTOR_HANDLE* pHandles) const;
+};
@@ -20,6 +20,11 @@
 
 using namespace Graphics;
 
+namespace
+{
+	BoolVar s_ReuseDescriptorTables("Graphics/Reuse Descriptor Tables", true);
+}
+
 //
 // DynamicDescriptorHeap Implementation
 //
@@ -28,6 +33,7 @@ std::mutex DynamicDescriptorHeap::sm_Mutex;
 std::vector<Microsoft::WRL::ComPtr<ID3D12DescriptorHeap>> DynamicDescriptorHeap::sm_DescriptorHeapPool[2];
 std::queue<std::pair<uint64_t, ID3D12DescriptorHeap*>> DynamicDescriptorHeap::sm_RetiredDescriptorHeaps[2];
 std::queue<ID3D12DescriptorHeap*> DynamicDescriptorHeap::sm_AvailableDescriptorHeaps[2];
+DescriptorTableReuseStats DynamicDescriptorHeap::sm_ReuseStats = {};
 
 ID3D12DescriptorHeap* DynamicDescriptorHeap::RequestDescriptorHeap(D3D12_DESCRIPTOR_HEAP_TYPE HeapType)
 {
@@ -82,6 +88,9 @@ void DynamicDescriptorHeap::RetireCurrentHeap( void )
 	m_RetiredHeaps.push_back(m_CurrentHeapPtr);
 	m_CurrentHeapPtr = nullptr;
 	m_CurrentOffset = 0;
+
+	// Copied tables live in the retired heap
+	m_TableReuseCache.Reset();
 }
 
 void DynamicDescriptorHeap::RetireUsedHeaps( uint64_t fenceValue )
@@ -91,7 +100,7 @@ void DynamicDescriptorHeap::RetireUsedHeaps( uint64_t fenceValue )
 }
 
 DynamicDescriptorHeap::DynamicDescriptorHeap(CommandContext& OwningContext, D3D12_DESCRIPTOR_HEAP_TYPE HeapType)
-	: m_OwningContext(OwningContext), m_DescriptorType(HeapType)
+	: m_OwningContext(OwningContext), m_DescriptorType(HeapType), m_TableReuseCache(kNumDescriptorsPerHeap)
 {
 	m_CurrentHeapPtr = nullptr;
 	m_CurrentOffset = 0;
@@ -108,6 +117,16 @@ void DynamicDescriptorHeap::CleanupUsedHeaps( uint64_t fenceValue )
 	RetireUsedHeaps(fenceValue);
 	m_GraphicsHandleCache.ClearCache();
 	m_ComputeHandleCache.ClearCache();
+
+	std::lock_guard<std::mutex> LockGuard(sm_Mutex);
+	sm_ReuseStats.Accumulate(m_TableReuseCache.GetStats());
+	m_TableReuseCache.ResetStats();
+}
+
+DescriptorTableReuseStats DynamicDescriptorHeap::GetReuseStatistics( void )
+{
+	std::lock_guard<std::mutex> LockGuard(sm_Mutex);
+	return sm_ReuseStats;
 }
 
 inline ID3D12DescriptorHeap* DynamicDescriptorHeap::GetHeapPointer()
@@ -146,7 +165,8 @@ uint32_t DynamicDescriptorHeap::DescriptorHandleCache::ComputeStagedSize()
 void DynamicDescriptorHeap::DescriptorHandleCache::CopyAndBindStaleTables(
 	D3D12_DESCRIPTOR_HEAP_TYPE Type, uint32_t DescriptorSize,
 	DescriptorHandle DestHandleStart, ID3D12GraphicsCommandList* CmdList,
-	void (STDMETHODCALLTYPE ID3D12GraphicsCommandList::*SetFunc)(UINT, D3D12_GPU_DESCRIPTOR_HANDLE))
+	void (STDMETHODCALLTYPE ID3D12GraphicsCommandList::*SetFunc)(UINT, D3D12_GPU_DESCRIPTOR_HANDLE),
+	DescriptorTableReuseCache& ReuseCache)
 {
 	uint32_t StaleParamCount = 0;
 	uint32_t TableSize[DescriptorHandleCache::kMaxNumDescriptorTables];
@@ -184,6 +204,7 @@ void DynamicDescriptorHeap::DescriptorHandleCache::CopyAndBindStaleTables(
 	UINT NumSrcDescriptorRanges = 0;
 	D3D12_CPU_DESCRIPTOR_HANDLE pSrcDescriptorRangeStarts[kMaxDescriptorsPerCopy];
 	UINT pSrcDescriptorRangeSizes[kMaxDescriptorsPerCopy];
+	uint32_t CopyCalls = 1;
 
 	for (uint32_t i = 0; i < StaleParamCount; ++i)
 	{
@@ -191,6 +212,9 @@ void DynamicDescriptorHeap::DescriptorHandleCache::CopyAndBindStaleTables(
 		(CmdList->*SetFunc)(RootIndex, DestHandleStart.GetGpuHandle());
 
 		DescriptorTableCache& RootDescTable = m_RootDescriptorTable[RootIndex];
+		ReuseCache.Insert(
+			DescriptorTableReuseCache::HashTable(RootDescTable.AssignedHandlesBitMap, TableSize[i], RootDescTable.TableStart),
+			RootDescTable.AssignedHandlesBitMap, TableSize[i], RootDescTable.TableStart, DestHandleStart.GetGpuHandle());
 
 		D3D12_CPU_DESCRIPTOR_HANDLE* SrcHandles = RootDescTable.TableStart;
 		uint64_t SetHandles = (uint64_t)RootDescTable.AssignedHandlesBitMap;
@@ -219,6 +243,7 @@ void DynamicDescriptorHeap::DescriptorHandleCache::CopyAndBindStaleTables(
 
 				NumSrcDescriptorRanges = 0;
 				NumDestDescriptorRanges = 0;
+				++CopyCalls;
 			}
 
 			// Setup destination range
@@ -244,11 +269,49 @@ void DynamicDescriptorHeap::DescriptorHandleCache::CopyAndBindStaleTables(
 		NumDestDescriptorRanges, pDestDescriptorRangeStarts, pDestDescriptorRangeSizes,
 		NumSrcDescriptorRanges, pSrcDescriptorRangeStarts, pSrcDescriptorRangeSizes,
 		Type);
+
+	ReuseCache.RecordCopyCalls(CopyCalls);
 }
-	
+
+void DynamicDescriptorHeap::DescriptorHandleCache::BindReusedTables( DescriptorTableReuseCache& ReuseCache,
+	ID3D12GraphicsCommandList* CmdList, void (STDMETHODCALLTYPE ID3D12GraphicsCommandList::*SetFunc)(UINT, D3D12_GPU_DESCRIPTOR_HANDLE))
+{
+	uint32_t RootIndex;
+	uint32_t StaleParams = m_StaleRootParamsBitMap;
+	while (_BitScanForward((unsigned long*)&RootIndex, StaleParams))
+	{
+		StaleParams ^= (1 << RootIndex);
+
+		DescriptorTableCache& RootDescTable = m_RootDescriptorTable[RootIndex];
+		uint32_t MaxSetHandle;
+		_BitScanReverse((unsigned long*)&MaxSetHandle, RootDescTable.AssignedHandlesBitMap);
+
+		const uint32_t TableSize = MaxSetHandle + 1;
+		const uint64_t Hash = DescriptorTableReuseCache::HashTable(RootDescTable.AssignedHandlesBitMap, TableSize, RootDescTable.TableStart);
+		D3D12_GPU_DESCRIPTOR_HANDLE GpuHandle;
+		if (ReuseCache.Find(Hash, RootDescTable.AssignedHandlesBitMap, TableSize, RootDescTable.TableStart, GpuHandle))
+		{
+			(CmdList->*SetFunc)(RootIndex, GpuHandle);
+			m_StaleRootParamsBitMap ^= (1 << RootIndex);
+		}
+	}
+}
+
 void DynamicDescriptorHeap::CopyAndBindStagedTables( DescriptorHandleCache& HandleCache, ID3D12GraphicsCommandList* CmdList,
 	void (STDMETHODCALLTYPE ID3D12GraphicsCommandList::*SetFunc)(UINT, D3D12_GPU_DESCRIPTOR_HANDLE))
 {
+	// Point tables whose contents are already in the current heap at the earlier copy.  If the
+	// rest do not fit, retiring the heap marks these stale again and they are copied anew.
+	if (s_ReuseDescriptorTables)
+		m_TableReuseCache.SetContentsGeneration(DescriptorAllocator::GetContentsGeneration());
+	if (s_ReuseDescriptorTables && !m_TableReuseCache.IsEmpty())
+	{
+		m_OwningContext.SetDescriptorHeap(m_DescriptorType, m_CurrentHeapPtr);
+		HandleCache.BindReusedTables(m_TableReuseCache, CmdList, SetFunc);
+		if (HandleCache.m_StaleRootParamsBitMap == 0)
+			return;
+	}
+
 	uint32_t NeededSize = HandleCache.ComputeStagedSize();
 	if (!HasSpace(NeededSize))
 	{
@@ -259,7 +322,7 @@ void DynamicDescriptorHeap::CopyAndBindStagedTables( DescriptorHandleCache& Hand
 
 	// This can trigger the creation of a new heap
 	m_OwningContext.SetDescriptorHeap(m_DescriptorType, GetHeapPointer());
-	HandleCache.CopyAndBindStaleTables(m_DescriptorType, m_DescriptorSize, Allocate(NeededSize), CmdList, SetFunc);
+	HandleCache.CopyAndBindStaleTables(m_DescriptorType, m_DescriptorSize, Allocate(NeededSize), CmdList, SetFunc, m_TableReuseCache);
 }
 
 void DynamicDescriptorHeap::UnbindAllValid( void )
@@ -15,6 +15,7 @@
 
 #include "DescriptorHeap.h"
 #include "RootSignature.h"
+#include "DescriptorTableReuseCache.h"
 #include <vector>
 #include <queue>
 
@@ -25,7 +26,9 @@ namespace Graphics
 
 // This class is a linear allocation system for dynamically generated descriptor tables.  It internally caches
 // CPU descriptor handles so that when not enough space is available in the current heap, necessary descriptors
-// can be re-copied to the new heap.
+// can be re-copied to the new heap.  Tables already copied into the current heap are remembered by their
+// source handles, so binding the same set of descriptors again reuses the earlier copy.  A descriptor rewritten
+// in place keeps its earlier copy for the rest of the heap's life, which ends with the command list.
 class DynamicDescriptorHeap
 {
 public:
@@ -40,6 +43,9 @@ public:
 
 	void CleanupUsedHeaps( uint64_t fenceValue );
 
+	// Table copy and reuse counts of all contexts, gathered as each one finishes.
+	static DescriptorTableReuseStats GetReuseStatistics( void );
+
 	// Copy multiple handles into the cache area reserved for the specified root parameter.
 	void SetGraphicsDescriptorHandles( UINT RootIndex, UINT Offset, UINT NumHandles, const D3D12_CPU_DESCRIPTOR_HANDLE Handles[] )
 	{
@@ -86,6 +92,7 @@ private:
 	static std::vector<Microsoft::WRL::ComPtr<ID3D12DescriptorHeap>> sm_DescriptorHeapPool[2];
 	static std::queue<std::pair<uint64_t, ID3D12DescriptorHeap*>> sm_RetiredDescriptorHeaps[2];
 	static std::queue<ID3D12DescriptorHeap*> sm_AvailableDescriptorHeaps[2];
+	static DescriptorTableReuseStats sm_ReuseStats;
 
 	// Static methods
 	static ID3D12DescriptorHeap* RequestDescriptorHeap(D3D12_DESCRIPTOR_HEAP_TYPE HeapType);
@@ -99,6 +106,7 @@ private:
 	uint32_t m_CurrentOffset;
 	DescriptorHandle m_FirstDescriptor;
 	std::vector<ID3D12DescriptorHeap*> m_RetiredHeaps;
+	DescriptorTableReuseCache m_TableReuseCache;
 
 	// Describes a descriptor table entry:  a region of the handle cache and which handles have been set
 	struct DescriptorTableCache
@@ -131,6 +139,8 @@ private:
 
 		uint32_t ComputeStagedSize();
 		void CopyAndBindStaleTables( D3D12_DESCRIPTOR_HEAP_TYPE Type, uint32_t DescriptorSize, DescriptorHandle DestHandleStart, ID3D12GraphicsCommandList* CmdList,
+			void (STDMETHODCALLTYPE ID3D12GraphicsCommandList::*SetFunc)(UINT, D3D12_GPU_DESCRIPTOR_HANDLE), DescriptorTableReuseCache& ReuseCache);
+		void BindReusedTables( DescriptorTableReuseCache& ReuseCache, ID3D12GraphicsCommandList* CmdList,
 			void (STDMETHODCALLTYPE ID3D12GraphicsCommandList::*SetFunc)(UINT, D3D12_GPU_DESCRIPTOR_HANDLE));
 
 		DescriptorTableCache m_RootDescriptorTable[kMaxNumDescriptorTables];
@@ -19,6 +19,8 @@
 #include "GameInput.h"
 #include "GpuTimeManager.h"
 #include "CommandContext.h"
+#include "GpuJobQueue.h"
+#include "CpuProfiler.h"
 #include <vector>
 #include <unordered_map>
 #include <array>
@@ -32,6 +34,9 @@ using namespace std;
 namespace EngineProfiling
 {
 	bool Paused = false;
+
+	// Blocks begun on other threads only go to the CPU profiler; 0 until Initialize()
+	DWORD MainThreadId = 0;
 }
 
 class StatHistory
@@ -195,7 +200,11 @@ class NestedTimingTree
 {
 public:
 	NestedTimingTree( const wstring& name, NestedTimingTree* parent = nullptr )
-		: m_Name(name), m_Parent(parent), m_IsExpanded(false), m_IsGraphed(false), m_GraphHandle(PERF_GRAPH_ERROR) {}
+		: m_Name(name), m_Parent(parent), m_LiteralName(nullptr), m_IsExpanded(false), m_IsGraphed(false), m_GraphHandle(PERF_GRAPH_ERROR),
+		  m_IsThreadScope(false), m_ThreadTime(0.0f)
+	{
+		m_ScopeID = CpuProfiler::RegisterScope(MakeUtf8(name).c_str());
+	}
 
 	NestedTimingTree* GetChild( const wstring& name )
 	{
@@ -209,6 +218,30 @@ public:
 		return node;
 	}
 
+	// Scopes named by string literals are found by address, without building a wstring.  The
+	// name is compared too, since a buffer reused for another name can have the same address.
+	NestedTimingTree* GetChild( const wchar_t* name )
+	{
+		for (auto node : m_Children)
+		{
+			if (node->m_LiteralName == name && node->m_Name.compare(name) == 0)
+				return node;
+		}
+
+		NestedTimingTree* node = GetChild(wstring(name));
+		if (node->m_LiteralName == nullptr)
+			node->m_LiteralName = name;
+		return node;
+	}
+
+	static string MakeUtf8( const wstring& name )
+	{
+		char utf8[256];
+		if (WideCharToMultiByte(CP_UTF8, 0, name.c_str(), -1, utf8, sizeof(utf8), nullptr, nullptr) == 0)
+			return string();
+		return string(utf8);
+	}
+
 	NestedTimingTree* NextScope( void )
 	{
 		if (m_IsExpanded && m_Children.size() > 0)
@@ -283,6 +316,7 @@ public:
 
 	void StartTiming( CommandContext* Context )
 	{
+		CpuProfiler::BeginScope(m_ScopeID);
 		m_StartTick = SystemTime::GetCurrentTick();
 		if (Context == nullptr)
 			return;
@@ -295,6 +329,7 @@ public:
 	void StopTiming( CommandContext* Context )
 	{
 		m_EndTick = SystemTime::GetCurrentTick();
+		CpuProfiler::EndScope();
 		if (Context == nullptr)
 			return;
 
@@ -311,12 +346,22 @@ public:
 		}
 		if (EngineProfiling::Paused)
 		{
+			m_ThreadTime = 0.0f;
 			for (auto node : m_Children)
 				node->GatherTimes(FrameIndex);
 			return;
 		}
-		m_CpuTime.RecordStat(FrameIndex, 1000.0f * (float)SystemTime::TimeBetweenTicks(m_StartTick, m_EndTick));
-		m_GpuTime.RecordStat(FrameIndex, 1000.0f * m_GpuTimer.GetTime());
+		if (m_IsThreadScope)
+		{
+			m_CpuTime.RecordStat(FrameIndex, m_ThreadTime);
+			m_GpuTime.RecordStat(FrameIndex, 0.0f);
+			m_ThreadTime = 0.0f;
+		}
+		else
+		{
+			m_CpuTime.RecordStat(FrameIndex, 1000.0f * (float)SystemTime::TimeBetweenTicks(m_StartTick, m_EndTick));
+			m_GpuTime.RecordStat(FrameIndex, 1000.0f * m_GpuTimer.GetTime());
+		}
 
 		for (auto node : m_Children)
 			node->GatherTimes(FrameIndex);
@@ -331,21 +376,27 @@ public:
 		gpuTime = 0.0f;
 		for (auto iter = m_Children.begin(); iter != m_Children.end(); ++iter)
 		{
+			if ((*iter)->m_IsThreadScope)
+				continue;
 			cpuTime += (*iter)->m_CpuTime.GetLast();
 			gpuTime += (*iter)->m_GpuTime.GetLast();
 		}
 	}
 
 	static void PushProfilingMarker( const wstring& name, CommandContext* Context );
+	static void PushProfilingMarker( const wchar_t* name, CommandContext* Context );
 	static void PopProfilingMarker( CommandContext* Context );
 	static void Update( void );
 	static void UpdateTimes( void )
 	{
 		uint32_t FrameIndex = (uint32_t)Graphics::GetFrameCount();
 
+		GatherThreadTimes();
+
 		GpuTimeManager::BeginReadBack();
 		sm_RootScope.GatherTimes(FrameIndex);
 		s_FrameDelta.RecordStat(FrameIndex, GpuTimeManager::GetTime(0));
+		g_GpuJobQueue.UpdateCostEstimates();
 		GpuTimeManager::EndReadBack();
 
 		float TotalCpuTime, TotalGpuTime;
@@ -382,6 +433,7 @@ private:
 
 	void DisplayNode( TextContext& Text, float x, float indent );
 	void StoreToGraph(void);
+	static void GatherThreadTimes( void );
 	void DeleteChildren( void )
 	{
 		for (auto node : m_Children)
@@ -393,6 +445,8 @@ private:
 	NestedTimingTree* m_Parent;
 	vector<NestedTimingTree*> m_Children;
 	unordered_map<wstring, NestedTimingTree*> m_LUT;
+	const wchar_t* m_LiteralName;
+	uint32_t m_ScopeID;
 	int64_t m_StartTick;
 	int64_t m_EndTick;
 	StatHistory m_CpuTime;
@@ -401,6 +455,13 @@ private:
 	GpuTimer m_GpuTimer;
 	bool m_IsGraphed;
 	GraphHandle m_GraphHandle;
+
+	// Mirrors a scope recorded on another thread; its time comes from the CPU profiler
+	bool m_IsThreadScope;
+	float m_ThreadTime;
+	static vector<vector<NestedTimingTree*>> sm_ThreadScopes;
+	static vector<uint32_t> sm_ThreadGenerations;
+
 	static StatHistory s_TotalCpuTime;
 	static StatHistory s_TotalGpuTime;
 	static StatHistory s_FrameDelta;
@@ -419,6 +480,8 @@ NestedTimingTree NestedTimingTree::sm_RootScope(L"");
 NestedTimingTree* NestedTimingTree::sm_CurrentNode = &NestedTimingTree::sm_RootScope;
 NestedTimingTree* NestedTimingTree::sm_SelectedScope = &NestedTimingTree::sm_RootScope;
 bool NestedTimingTree::sm_CursorOnGraph = false;
+vector<vector<NestedTimingTree*>> NestedTimingTree::sm_ThreadScopes;
+vector<uint32_t> NestedTimingTree::sm_ThreadGenerations;
 namespace EngineProfiling
 {
 	BoolVar DrawFrameRate("Display Frame Rate", true);
@@ -426,6 +489,12 @@ namespace EngineProfiling
 	//BoolVar DrawPerfGraph("Display Performance Graph", false);
 	const bool DrawPerfGraph = false;
 	
+	void Initialize( void )
+	{
+		MainThreadId = GetCurrentThreadId();
+		CpuProfiler::SetThreadName("Main");
+	}
+
 	void Update( void )
 	{
 		if (GameInput::IsFirstPressed( GameInput::kStartButton ) 
@@ -433,17 +502,83 @@ namespace EngineProfiling
 		{
 			Paused = !Paused;
 		}
+		if (GameInput::IsFirstPressed( GameInput::kKey_f11 ))
+		{
+			bool Success = CpuProfiler::ExportChromeTrace(L"CpuTrace.json");
+			Utility::Printf("CPU trace %s CpuTrace.json\n", Success ? "written to" : "could not be written to");
+		}
 		NestedTimingTree::UpdateTimes();
 	}
 
+	static bool IsMainThread()
+	{
+		return MainThreadId == GetCurrentThreadId();
+	}
+
+	// Each thread registers a block name with the CPU profiler the first time it begins it
+	static uint32_t GetThreadScopeID(const wstring& name)
+	{
+		thread_local unordered_map<wstring, uint32_t> t_ScopeIDs;
+		auto iter = t_ScopeIDs.find(name);
+		if (iter != t_ScopeIDs.end())
+			return iter->second;
+
+		const uint32_t ScopeID = CpuProfiler::RegisterScope(NestedTimingTree::MakeUtf8(name).c_str());
+		t_ScopeIDs.emplace(name, ScopeID);
+		return ScopeID;
+	}
+
+	// Literal names are matched by address first, as GetChild does on the main thread
+	static uint32_t GetThreadScopeID(const wchar_t* name)
+	{
+		thread_local unordered_map<const wchar_t*, pair<wstring, uint32_t>> t_LiteralScopeIDs;
+		auto iter = t_LiteralScopeIDs.find(name);
+		if (iter != t_LiteralScopeIDs.end() && iter->second.first.compare(name) == 0)
+			return iter->second.second;
+
+		const wstring NameString(name);
+		const uint32_t ScopeID = GetThreadScopeID(NameString);
+		t_LiteralScopeIDs[name] = make_pair(NameString, ScopeID);
+		return ScopeID;
+	}
+
 	void BeginBlock(const wstring& name, CommandContext* Context)
 	{
-		NestedTimingTree::PushProfilingMarker(name, Context);
+		if (IsMainThread())
+		{
+			NestedTimingTree::PushProfilingMarker(name, Context);
+			return;
+		}
+
+		CpuProfiler::BeginScope(GetThreadScopeID(name));
+		if (Context != nullptr)
+			Context->PIXBeginEvent(name.c_str());
+	}
+
+	void BeginBlock(const wchar_t* name, CommandContext* Context)
+	{
+		if (IsMainThread())
+		{
+			NestedTimingTree::PushProfilingMarker(name, Context);
+			return;
+		}
+
+		CpuProfiler::BeginScope(GetThreadScopeID(name));
+		if (Context != nullptr)
+			Context->PIXBeginEvent(name);
 	}
 
 	void EndBlock(CommandContext* Context)
 	{
-		NestedTimingTree::PopProfilingMarker(Context);
+		if (IsMainThread())
+		{
+			NestedTimingTree::PopProfilingMarker(Context);
+			return;
+		}
+
+		CpuProfiler::EndScope();
+		if (Context != nullptr)
+			Context->PIXEndEvent();
 	}
 
 	bool IsPaused()
@@ -504,6 +639,67 @@ void NestedTimingTree::PushProfilingMarker( const wstring& name, CommandContext*
 	sm_CurrentNode->StartTiming(Context);
 }
 
+void NestedTimingTree::PushProfilingMarker( const wchar_t* name, CommandContext* Context )
+{
+	sm_CurrentNode = sm_CurrentNode->GetChild(name);
+	sm_CurrentNode->StartTiming(Context);
+}
+
+void NestedTimingTree::GatherThreadTimes( void )
+{
+	const uint32_t ThreadCount = CpuProfiler::GetThreadCount();
+	sm_ThreadScopes.resize(ThreadCount);
+	sm_ThreadGenerations.resize(ThreadCount);
+
+	for (uint32_t ThreadIndex = 0; ThreadIndex < ThreadCount; ++ThreadIndex)
+	{
+		if (CpuProfiler::IsCurrentThread(ThreadIndex))
+			continue;
+
+		// A slot taken over by a new thread starts its node indices over; if that happens
+		// during the gather, the slot is picked up again next frame
+		const uint32_t Generation = CpuProfiler::GetThreadGeneration(ThreadIndex);
+		const vector<CpuProfileNode>& Nodes = CpuProfiler::GatherThread(ThreadIndex);
+		if (CpuProfiler::GetThreadGeneration(ThreadIndex) != Generation)
+			continue;
+
+		vector<NestedTimingTree*>& Scopes = sm_ThreadScopes[ThreadIndex];
+		if (Generation != sm_ThreadGenerations[ThreadIndex])
+		{
+			sm_ThreadGenerations[ThreadIndex] = Generation;
+			Scopes.clear();
+		}
+
+		if (Nodes.empty())
+			continue;
+
+		// Each thread shows up as a top level scope holding that thread's scopes
+		if (Scopes.empty())
+		{
+			NestedTimingTree* ThreadNode = sm_RootScope.GetChild(MakeWStr(string("[") + CpuProfiler::GetThreadName(ThreadIndex) + "]"));
+			ThreadNode->m_IsThreadScope = true;
+			Scopes.push_back(ThreadNode);
+		}
+
+		NestedTimingTree* ThreadNode = Scopes[0];
+		for (uint32_t i = 0; i < (uint32_t)Nodes.size(); ++i)
+		{
+			if (i + 1 >= Scopes.size())
+			{
+				NestedTimingTree* Parent = (Nodes[i].ParentIndex == CpuProfiler::InvalidIndex) ? ThreadNode : Scopes[Nodes[i].ParentIndex + 1];
+				NestedTimingTree* Node = Parent->GetChild(MakeWStr(CpuProfiler::GetScopeName(Nodes[i].ScopeID)));
+				Node->m_IsThreadScope = true;
+				Scopes.push_back(Node);
+			}
+
+			const float Msec = (float)Nodes[i].Msec;
+			Scopes[i + 1]->m_ThreadTime += Msec;
+			if (Nodes[i].ParentIndex == CpuProfiler::InvalidIndex)
+				ThreadNode->m_ThreadTime += Msec;
+		}
+	}
+}
+
 void NestedTimingTree::PopProfilingMarker( CommandContext* Context )
 {
 	sm_CurrentNode->StopTiming(Context);
@@ -20,9 +20,12 @@ class CommandContext;
 
 namespace EngineProfiling
 {
+	// Blocks are only added to the timing tree on the thread that called Initialize
+	void Initialize();
 	void Update();
 
 	void BeginBlock(const std::wstring& name, CommandContext* Context = nullptr);
+	void BeginBlock(const wchar_t* name, CommandContext* Context = nullptr);
 	void EndBlock(CommandContext* Context = nullptr);
 
 	void DisplayFrameRate(TextContext& Text);
@@ -37,6 +40,8 @@ class ScopedTimer
 public:
 	ScopedTimer(const std::wstring&) {}
 	ScopedTimer(const std::wstring&, CommandContext&) {}
+	ScopedTimer(const wchar_t*) {}
+	ScopedTimer(const wchar_t*, CommandContext&) {}
 };
 #else
 class ScopedTimer
@@ -50,6 +55,15 @@ public:
 	{
 		EngineProfiling::BeginBlock(name, m_Context);
 	}
+	// Literal names avoid building a wstring per scope
+	ScopedTimer( const wchar_t* name ) : m_Context(nullptr)
+	{
+		EngineProfiling::BeginBlock(name);
+	}
+	ScopedTimer( const wchar_t* name, CommandContext& Context ) : m_Context(&Context)
+	{
+		EngineProfiling::BeginBlock(name, m_Context);
+	}
 	~ScopedTimer()
 	{
 		EngineProfiling::EndBlock(m_Context);
@@ -19,6 +19,8 @@
 #include "GraphicsCore.h"
 #include "CommandContext.h"
 #include "GraphRenderer.h"
+#include "SystemTime.h"
+#include "Network/NetSocket.h"
 
 using namespace std;
 using namespace Math;
@@ -46,6 +48,35 @@ namespace EngineTuning
 
     std::vector<std::string> s_FrameStrings;
     void PrintFrameStrings(TextContext& Text);
+
+	// Changes from outside the menu, applied once per frame by ApplyChanges
+	EngineVar* FindVariable( const string& path );
+	bool SetVariable( const string& path, const string& value );
+	void ReadSettingsFile( FILE* file, vector<pair<string, string>>& settings );
+	bool CheckWatchedFile( vector<pair<string, string>>& settings );
+	void ReceiveRemoteCommands( void );
+	void ProcessRemoteCommands( void );
+	void ProcessRemoteCommand( const string& line, string& reply );
+	void SendRemoteReplies( void );
+
+	bool s_ChangesApplied = false;
+	std::atomic<uint32_t> s_ChangeCount(0);
+
+	wstring s_WatchedFileName;
+	FILETIME s_WatchedFileTime = {};
+	int64_t s_NextWatchTick = 0;
+
+	struct RemoteConnection
+	{
+		NetTcpSocket Socket;
+		string Received;
+		string Unsent;
+		bool IsClosing;
+	};
+	enum { kMaxRemoteConnections = 4, kMaxRemoteLineLength = 1024, kMaxRemoteUnsentBytes = 1 << 20 };
+	NetTcpSocket s_RemoteListenSocket;
+	bool s_RemoteControlStarted = false;
+	vector<RemoteConnection> s_RemoteConnections;
 }
 
 // Not open to the public.  Groups are auto-created when a tweaker's path includes the group name.
@@ -70,6 +101,7 @@ public:
 
 	void SaveToFile( FILE* file, int fileMargin );
 	void LoadSettingsFromFile( FILE* file );
+	void GatherVariables( const string& pathPrefix, vector<pair<string, EngineVar*>>& variables );
 
 	EngineVar* NextVariable( EngineVar* currentVariable );
 	EngineVar* PrevVariable( EngineVar* currentVariable );
@@ -193,6 +225,18 @@ void VariableGroup::LoadSettingsFromFile( FILE* file )
 	}
 }
 
+void VariableGroup::GatherVariables( const string& pathPrefix, vector<pair<string, EngineVar*>>& variables )
+{
+	for (auto iter = m_Children.begin(); iter != m_Children.end(); ++iter)
+	{
+		VariableGroup* subGroup = dynamic_cast<VariableGroup*>(iter->second);
+		if (subGroup != nullptr)
+			subGroup->GatherVariables(pathPrefix + iter->first + "/", variables);
+		else if (dynamic_cast<CallbackTrigger*>(iter->second) == nullptr)
+			variables.push_back(make_pair(pathPrefix + iter->first, iter->second));
+	}
+}
+
 EngineVar* VariableGroup::FirstVariable( void )
 {
 	return m_Children.size() == 0 ? nullptr : m_Children.begin()->second;
@@ -327,6 +371,18 @@ void BoolVar::SetValue(FILE* file, const std::string& setting)
 		0 == _stricmp(valstr, "true") );
 }
 
+bool BoolVar::SetFromString( const std::string& value )
+{
+	const char* valstr = value.c_str();
+	if (0 == _stricmp(valstr, "1") || 0 == _stricmp(valstr, "on") || 0 == _stricmp(valstr, "yes") || 0 == _stricmp(valstr, "true"))
+		m_Flag = true;
+	else if (0 == _stricmp(valstr, "0") || 0 == _stricmp(valstr, "off") || 0 == _stricmp(valstr, "no") || 0 == _stricmp(valstr, "false"))
+		m_Flag = false;
+	else
+		return false;
+	return true;
+}
+
 NumVar::NumVar( const std::string& path, float val, float minVal, float maxVal, float stepSize )
 	: EngineVar(path)
 {
@@ -339,13 +395,13 @@ NumVar::NumVar( const std::string& path, float val, float minVal, float maxVal,
 
 void NumVar::DisplayValue( TextContext& Text ) const
 {
-	Text.DrawFormattedString("%-11f", m_Value);
+	Text.DrawFormattedString("%-11f", (float)m_Value);
 }
 
 std::string NumVar::ToString( void ) const
 {
 	char buf[128];
-	sprintf_s(buf, "%f", m_Value);
+	sprintf_s(buf, "%f", (float)m_Value);
 	return buf;
 } 
 
@@ -359,6 +415,16 @@ void NumVar::SetValue(FILE* file, const std::string& setting)
 		*this = valueRead; 
 }
 
+bool NumVar::SetFromString( const std::string& value )
+{
+	char* end = nullptr;
+	float valueRead = strtof(value.c_str(), &end);
+	if (end == value.c_str() || *end != '\0' || !_finite(valueRead))
+		return false;
+	*this = valueRead;
+	return true;
+}
+
 #if _MSC_VER < 1800
 __forceinline float log2( float x ) { return log(x) / log(2.0f); }
 __forceinline float exp2( float x ) { return pow(2.0f, x); }
@@ -377,7 +443,7 @@ ExpVar& ExpVar::operator=( float val )
 
 ExpVar::operator float() const
 {
-	return exp2(m_Value);
+	return exp2((float)m_Value);
 }
 
 void ExpVar::DisplayValue( TextContext& Text ) const
@@ -402,6 +468,16 @@ void ExpVar::SetValue(FILE* file, const std::string& setting)
 		*this = valueRead;
 }
 
+bool ExpVar::SetFromString( const std::string& value )
+{
+	char* end = nullptr;
+	float valueRead = strtof(value.c_str(), &end);
+	if (end == value.c_str() || *end != '\0' || !_finite(valueRead) || valueRead <= 0.0f)
+		return false;
+	*this = valueRead;
+	return true;
+}
+
 IntVar::IntVar( const std::string& path, int32_t val, int32_t minVal, int32_t maxVal, int32_t stepSize )
 	: EngineVar(path)
 {
@@ -414,13 +490,13 @@ IntVar::IntVar( const std::string& path, int32_t val, int32_t minVal, int32_t ma
 
 void IntVar::DisplayValue( TextContext& Text ) const
 {
-	Text.DrawFormattedString("%-11d", m_Value);
+	Text.DrawFormattedString("%-11d", (int32_t)m_Value);
 }
 
 std::string IntVar::ToString( void ) const
 {
 	char buf[128];
-	sprintf_s(buf, "%d", m_Value);
+	sprintf_s(buf, "%d", (int32_t)m_Value);
 	return buf;
 } 
 
@@ -433,6 +509,16 @@ void IntVar::SetValue(FILE* file, const std::string& setting)
 		*this = valueRead;
 }
 
+bool IntVar::SetFromString( const std::string& value )
+{
+	char* end = nullptr;
+	long valueRead = strtol(value.c_str(), &end, 0);
+	if (end == value.c_str() || *end != '\0')
+		return false;
+	*this = (int32_t)valueRead;
+	return true;
+}
+
 
 EnumVar::EnumVar( const std::string& path, int32_t initialVal, int32_t listLength, const char** listLabels )
 	: EngineVar(path)
@@ -476,6 +562,26 @@ void EnumVar::SetValue(FILE* file, const std::string& setting)
 
 }
 
+bool EnumVar::SetFromString( const std::string& value )
+{
+	for (int32_t i = 0; i < m_EnumLength; ++i)
+	{
+		if (0 == _stricmp(m_EnumLabels[i], value.c_str()))
+		{
+			m_Value = i;
+			return true;
+		}
+	}
+
+	// Also accept the index of the label
+	char* end = nullptr;
+	long valueRead = strtol(value.c_str(), &end, 10);
+	if (end == value.c_str() || *end != '\0' || valueRead < 0 || valueRead >= m_EnumLength)
+		return false;
+	m_Value = (int32_t)valueRead;
+	return true;
+}
+
 CallbackTrigger::CallbackTrigger( const std::string& path, std::function<void (void*)> callback, void* args )
 	: EngineVar(path)
 {
@@ -543,6 +649,8 @@ void HandleDigitalButtonPress( GameInput::DigitalInput button, float timeDelta,
 
 void EngineTuning::Update( float frameTime )
 {
+	ApplyChanges();
+
 	if (GameInput::IsFirstPressed( GameInput::kBackButton )
 		|| GameInput::IsFirstPressed( GameInput::kKey_back ))
 		sm_IsVisible = !sm_IsVisible;
@@ -739,4 +847,306 @@ void EngineTuning::RegisterVariable( const std::string& path, EngineVar& var )
 bool EngineTuning::IsFocused( void )
 {
 	return sm_IsVisible;
-}
\ No newline at end of file
+}
+//=====================================================================================================================
+// Hot reload and remote control
+
+static string TrimWhitespace( const string& text )
+{
+	size_t start = text.find_first_not_of(" \t\r\n");
+	if (start == string::npos)
+		return string();
+	size_t end = text.find_last_not_of(" \t\r\n");
+	return text.substr(start, end - start + 1);
+}
+
+EngineVar* EngineTuning::FindVariable( const string& path )
+{
+	VariableGroup* group = &VariableGroup::sm_RootGroup;
+	size_t start = 0;
+
+	while (1)
+	{
+		size_t end = path.find('/', start);
+		EngineVar* node = group->FindChild(path.substr(start, end == string::npos ? string::npos : end - start));
+		if (node == nullptr || end == string::npos)
+			return node;
+
+		group = dynamic_cast<VariableGroup*>(node);
+		if (group == nullptr)
+			return nullptr;
+		start = end + 1;
+	}
+}
+
+bool EngineTuning::SetVariable( const string& path, const string& value )
+{
+	EngineVar* var = FindVariable(path);
+	if (var == nullptr || !var->SetFromString(value))
+		return false;
+
+	s_ChangesApplied = true;
+	return true;
+}
+
+void EngineTuning::ReadSettingsFile( FILE* file, vector<pair<string, string>>& settings )
+{
+	// Groups written by Save Settings enclose the more indented lines that follow them
+	vector<pair<size_t, string>> groups;
+	char line[512];
+
+	while (fgets(line, _countof(line), file) != nullptr)
+	{
+		string text = line;
+		size_t indent = text.find_first_not_of(" \t");
+		if (indent == string::npos || text[indent] == '#' || text[indent] == '\r' || text[indent] == '\n')
+			continue;
+
+		while (!groups.empty() && groups.back().first >= indent)
+			groups.pop_back();
+
+		text = TrimWhitespace(text);
+		if (text[0] == '+')
+		{
+			string name = TrimWhitespace(text.substr(1));
+			if (name.size() >= 3 && name.compare(name.size() - 3, 3, "...") == 0)
+				name = TrimWhitespace(name.substr(0, name.size() - 3));
+			groups.push_back(make_pair(indent, name));
+			continue;
+		}
+
+		size_t colon = text.find(':');
+		if (colon == string::npos)
+			continue;
+
+		string path;
+		for (auto iter = groups.begin(); iter != groups.end(); ++iter)
+			path += iter->second + "/";
+		path += TrimWhitespace(text.substr(0, colon));
+
+		settings.push_back(make_pair(path, TrimWhitespace(text.substr(colon + 1))));
+	}
+}
+
+bool EngineTuning::CheckWatchedFile( vector<pair<string, string>>& settings )
+{
+	if (s_WatchedFileName.empty())
+		return false;
+
+	// Checking the file's time stamp twice a second is plenty for edits by hand
+	int64_t currentTick = SystemTime::GetCurrentTick();
+	if (currentTick < s_NextWatchTick)
+		return false;
+	s_NextWatchTick = currentTick + (int64_t)(0.5 / SystemTime::TicksToSeconds(1));
+
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if (!GetFileAttributesExW(s_WatchedFileName.c_str(), GetFileExInfoStandard, &attributes))
+		return false;
+	if (CompareFileTime(&attributes.ftLastWriteTime, &s_WatchedFileTime) == 0)
+		return false;
+
+	// The editor may still have the file open; try again next time
+	FILE* settingsFile = nullptr;
+	if (_wfopen_s(&settingsFile, s_WatchedFileName.c_str(), L"rb") != 0 || settingsFile == nullptr)
+		return false;
+
+	s_WatchedFileTime = attributes.ftLastWriteTime;
+	ReadSettingsFile(settingsFile, settings);
+	fclose(settingsFile);
+	return true;
+}
+
+void EngineTuning::WatchSettingsFile( const wstring& fileName )
+{
+	s_WatchedFileName = fileName;
+	ZeroMemory(&s_WatchedFileTime, sizeof(s_WatchedFileTime));
+	s_NextWatchTick = 0;
+}
+
+void EngineTuning::ProcessRemoteCommand( const string& line, string& reply )
+{
+	string command = line;
+	string argument;
+	size_t space = line.find(' ');
+	if (space != string::npos)
+	{
+		command = line.substr(0, space);
+		argument = TrimWhitespace(line.substr(space + 1));
+	}
+
+	if (_stricmp(command.c_str(), "get") == 0)
+	{
+		EngineVar* var = FindVariable(argument);
+		if (var == nullptr)
+			reply += "error: unknown variable " + argument + "\n";
+		else
+			reply += argument + ": " + var->ToString() + "\n";
+	}
+	else if (_stricmp(command.c_str(), "set") == 0)
+	{
+		size_t colon = argument.find(':');
+		string path = TrimWhitespace(argument.substr(0, colon));
+		EngineVar* var = FindVariable(path);
+		if (colon == string::npos)
+			reply += "error: expected set <path>: <value>\n";
+		else if (var == nullptr)
+			reply += "error: unknown variable " + path + "\n";
+		else if (!SetVariable(path, TrimWhitespace(argument.substr(colon + 1))))
+			reply += "error: invalid value for " + path + "\n";
+		else
+			reply += path + ": " + var->ToString() + "\n";
+	}
+	else if (_stricmp(command.c_str(), "list") == 0)
+	{
+		vector<pair<string, EngineVar*>> variables;
+		VariableGroup::sm_RootGroup.GatherVariables("", variables);
+		for (auto iter = variables.begin(); iter != variables.end(); ++iter)
+		{
+			if (iter->first.compare(0, argument.size(), argument) == 0)
+				reply += iter->first + ": " + iter->second->ToString() + "\n";
+		}
+		reply += ".\n";
+	}
+	else
+	{
+		reply += "error: unknown command " + command + " (get, set, list)\n";
+	}
+}
+
+void EngineTuning::ReceiveRemoteCommands( void )
+{
+	if (!s_RemoteControlStarted)
+		return;
+
+	NetTcpSocket clientSocket;
+	while (s_RemoteConnections.size() < kMaxRemoteConnections && s_RemoteListenSocket.AcceptConnection(&clientSocket) == S_OK)
+	{
+		RemoteConnection connection;
+		connection.Socket = clientSocket;
+		connection.IsClosing = false;
+		s_RemoteConnections.push_back(connection);
+	}
+
+	for (auto iter = s_RemoteConnections.begin(); iter != s_RemoteConnections.end(); ++iter)
+	{
+		char buffer[kMaxRemoteLineLength];
+		UINT bytesReceived = 0;
+		HRESULT hr;
+		while ((hr = iter->Socket.Recv(buffer, sizeof(buffer), &bytesReceived)) == S_OK)
+			iter->Received.append(buffer, bytesReceived);
+
+		// A closed connection still gets the replies to the commands it sent before closing
+		if (hr != S_FALSE)
+			iter->IsClosing = true;
+	}
+}
+
+void EngineTuning::ProcessRemoteCommands( void )
+{
+	for (auto iter = s_RemoteConnections.begin(); iter != s_RemoteConnections.end(); ++iter)
+	{
+		size_t lineEnd;
+		while ((lineEnd = iter->Received.find('\n')) != string::npos)
+		{
+			string line = TrimWhitespace(iter->Received.substr(0, lineEnd));
+			iter->Received.erase(0, lineEnd + 1);
+			if (!line.empty())
+				ProcessRemoteCommand(line, iter->Unsent);
+		}
+		if (iter->Received.size() > kMaxRemoteLineLength)
+			iter->IsClosing = true;
+	}
+}
+
+void EngineTuning::SendRemoteReplies( void )
+{
+	for (size_t i = 0; i < s_RemoteConnections.size(); )
+	{
+		RemoteConnection& connection = s_RemoteConnections[i];
+
+		// Whatever the socket does not take now is sent on later frames
+		if (!connection.Unsent.empty())
+		{
+			UINT bytesSent = 0;
+			HRESULT hr = connection.Socket.Send(connection.Unsent.data(), (UINT)connection.Unsent.size(), &bytesSent);
+			if (hr == S_OK)
+				connection.Unsent.erase(0, bytesSent);
+			else if (FAILED(hr))
+				connection.IsClosing = true;
+		}
+
+		// A client that stops reading is dropped rather than buffered for without limit
+		if (connection.Unsent.size() > kMaxRemoteUnsentBytes)
+			connection.IsClosing = true;
+
+		if (connection.IsClosing)
+		{
+			connection.Socket.Disconnect();
+			s_RemoteConnections[i] = s_RemoteConnections.back();
+			s_RemoteConnections.pop_back();
+		}
+		else
+		{
+			++i;
+		}
+	}
+}
+
+bool EngineTuning::StartRemoteControl( uint16_t port )
+{
+	if (s_RemoteControlStarted)
+		return true;
+
+	InitializeWinsock();
+	if (FAILED(s_RemoteListenSocket.Bind(port, true)))
+	{
+		TerminateWinsock();
+		return false;
+	}
+
+	s_RemoteControlStarted = true;
+	return true;
+}
+
+void EngineTuning::StopRemoteControl( void )
+{
+	if (!s_RemoteControlStarted)
+		return;
+
+	for (auto iter = s_RemoteConnections.begin(); iter != s_RemoteConnections.end(); ++iter)
+		iter->Socket.Disconnect();
+	s_RemoteConnections.clear();
+
+	s_RemoteListenSocket.Disconnect();
+	TerminateWinsock();
+	s_RemoteControlStarted = false;
+}
+
+void EngineTuning::ApplyChanges( void )
+{
+	// The file and the sockets are read first and written last, so the changes in between are
+	// applied together without waiting on I/O
+	vector<pair<string, string>> fileSettings;
+	const bool fileRead = CheckWatchedFile(fileSettings);
+	ReceiveRemoteCommands();
+
+	s_ChangesApplied = false;
+	uint32_t appliedCount = 0;
+	for (auto iter = fileSettings.begin(); iter != fileSettings.end(); ++iter)
+	{
+		if (SetVariable(iter->first, iter->second))
+			++appliedCount;
+	}
+	ProcessRemoteCommands();
+	if (s_ChangesApplied)
+		++s_ChangeCount;
+
+	SendRemoteReplies();
+	if (fileRead)
+		Utility::Printf(L"EngineTuning: applied %u settings from %s\n", appliedCount, s_WatchedFileName.c_str());
+}
+
+uint32_t EngineTuning::GetChangeCount( void )
+{
+	return s_ChangeCount;
+}
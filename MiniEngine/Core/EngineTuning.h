@@ -18,10 +18,15 @@
 #include <float.h>
 #include <map>
 #include <set>
+#include <atomic>
 
 class VariableGroup;
 class TextContext;
 
+// Variable values are atomic, so any thread may read them without locks or torn values.  They
+// are only written on the main thread: by the menu, and by EngineTuning::ApplyChanges, which
+// applies everything changed in the watched settings file or by remote control at once per frame.
+// Another thread reading several variables may see some from before a batch and some from after.
 class EngineVar
 {
 public:
@@ -35,6 +40,7 @@ public:
 	virtual void DisplayValue( TextContext& ) const {}
 	virtual std::string ToString( void ) const { return ""; }
 	virtual void SetValue( FILE* file, const std::string& setting) = 0; //set value read from file
+	virtual bool SetFromString( const std::string& ) { return false; } //set value from a watched file or remote control
 
 	EngineVar* NextVar( void );
 	EngineVar* PrevVar( void );
@@ -62,9 +68,10 @@ public:
 	virtual void DisplayValue( TextContext& Text ) const override;
 	virtual std::string ToString( void ) const override;
 	virtual void SetValue( FILE* file, const std::string& setting) override;
+	virtual bool SetFromString( const std::string& value ) override;
 
 private:
-	bool m_Flag;
+	std::atomic<bool> m_Flag;
 };
 
 class NumVar : public EngineVar
@@ -80,11 +87,13 @@ public:
 	virtual void DisplayValue( TextContext& Text ) const override;
 	virtual std::string ToString( void ) const override;
 	virtual void SetValue( FILE* file, const std::string& setting)  override;
+	virtual bool SetFromString( const std::string& value ) override;
 
 protected:
-	float Clamp( float val ) { return val > m_MaxValue ? m_MaxValue : val < m_MinValue ? m_MinValue : val; }
+	// NaN becomes the minimum
+	float Clamp( float val ) { return val > m_MaxValue ? m_MaxValue : val >= m_MinValue ? val : m_MinValue; }
 
-	float m_Value;
+	std::atomic<float> m_Value;
 	float m_MinValue;
 	float m_MaxValue;
 	float m_StepSize;
@@ -100,6 +109,7 @@ public:
 	virtual void DisplayValue( TextContext& Text ) const override;
 	virtual std::string ToString( void ) const override;
 	virtual void SetValue( FILE* file, const std::string& setting ) override;
+	virtual bool SetFromString( const std::string& value ) override;
 
 };
 
@@ -116,11 +126,12 @@ public:
 	virtual void DisplayValue( TextContext& Text ) const override;
 	virtual std::string ToString( void ) const override;
 	virtual void SetValue( FILE* file, const std::string& setting ) override;
+	virtual bool SetFromString( const std::string& value ) override;
 
 protected:
 	int32_t Clamp( int32_t val ) { return val > m_MaxValue ? m_MaxValue : val < m_MinValue ? m_MinValue : val; }
 
-	int32_t m_Value;
+	std::atomic<int32_t> m_Value;
 	int32_t m_MinValue;
 	int32_t m_MaxValue;
 	int32_t m_StepSize;
@@ -139,12 +150,13 @@ public:
 	virtual void DisplayValue( TextContext& Text ) const override;
 	virtual std::string ToString( void ) const override;
 	virtual void SetValue( FILE* file, const std::string& setting ) override;
+	virtual bool SetFromString( const std::string& value ) override;
 
 
 private:
 	int32_t Clamp( int32_t val ) { return val < 0 ? 0 : val >= m_EnumLength ? m_EnumLength - 1 : val; }
 
-	int32_t m_Value;
+	std::atomic<int32_t> m_Value;
 	int32_t m_EnumLength;
 	const char** m_EnumLabels;
 };
@@ -174,6 +186,25 @@ namespace EngineTuning
 	void Display( GraphicsContext& Context, float x, float y, float w, float h );
 	bool IsFocused( void );
 
+	// Reloads the watched file if it was modified and runs the remote control commands received
+	// since the last call.  Update calls this every frame; a loop without Update must call it.
+	void ApplyChanges( void );
+
+	// Incremented each time ApplyChanges modifies a variable, for caches of derived values
+	uint32_t GetChangeCount( void );
+
+	// Accepts the format written by Save Settings as well as lines of the form "Group/Name: value"
+	void WatchSettingsFile( const std::wstring& fileName );
+
+	// Listens on the loopback interface for line-based text commands:
+	//   get <path>            replies "<path>: <value>"
+	//   set <path>: <value>   replies "<path>: <value>" with the value as clamped
+	//   list [prefix]         replies a "<path>: <value>" line per variable, then "."
+	// Errors reply a single line starting with "error:".  Values that are not finite numbers
+	// are rejected.
+	bool StartRemoteControl( uint16_t port );
+	void StopRemoteControl( void );
+
     void PrintLine(const CHAR* strLine);
     void FormatLine(const CHAR* strFormat, ...);
     void PrintVector(const CHAR* strLabel, const DirectX::XMVECTOR& Value);
@@ -13,8 +13,12 @@
 
 #include "pch.h"
 #include "FileUtility.h"
+#include "SystemTime.h"
+#include "Hash.h"
 #include <fstream>
 #include <mutex>
+#include <thread>
+#include <atomic>
 #include "../3rdParty/zlib-win64/zlib.h"
 //#include "miniz.c"
 
@@ -26,7 +30,7 @@ namespace Utility
 	ByteArray NullFile = make_shared<vector<byte> > (vector<byte>() );
 }
 
-ByteArray DecompressZippedFile( wstring& fileName );
+ByteArray DecompressZippedFile( const wstring& fileName );
 
 ByteArray ReadFileHelper(const wstring& fileName)
 {
@@ -58,66 +62,65 @@ ByteArray ReadFileHelperEx( shared_ptr<wstring> fileName)
 	return ReadFileHelper(*fileName);
 }
 
-ByteArray Inflate(ByteArray CompressedSource, int& err, uint32_t ChunkSize = 0x100000 ) 
+// gzip ends with the uncompressed size modulo 2^32, which is exact for any file we load
+static size_t GetInflatedSizeHint(const byte* Source, size_t SourceSize)
 {
-	// Create a dynamic buffer to hold compressed blocks
-	vector<unique_ptr<byte> > blocks;
+	if (SourceSize < 18 || Source[0] != 0x1f || Source[1] != 0x8b)
+		return 0;
 
+	// Deflate cannot expand by more than about 1032:1, so anything larger is corrupt
+	uint32_t InflatedSize;
+	memcpy(&InflatedSize, Source + SourceSize - sizeof(InflatedSize), sizeof(InflatedSize));
+	return InflatedSize <= (uint64_t)SourceSize * 1032 ? InflatedSize : 0;
+}
+
+// Inflates straight into the returned array.  With a gzip size hint that is the only
+// allocation; zlib streams grow it as they go.
+ByteArray Inflate(const byte* Source, size_t SourceSize, int& err)
+{
 	z_stream strm  = {};
 	strm.data_type = Z_BINARY;
-	strm.total_in  = strm.avail_in  = (uInt)CompressedSource->size();
-	strm.next_in   = CompressedSource->data();
+	strm.avail_in  = (uInt)SourceSize;
+	strm.next_in   = (Bytef*)Source;
 
 	err = inflateInit2(&strm, (15 + 32)); //15 window bits, and the +32 tells zlib to to detect if using gzip or zlib
-
-	while (err == Z_OK || err == Z_BUF_ERROR)
-	{
-		strm.avail_out = ChunkSize;
-		strm.next_out = (byte*)malloc(ChunkSize);
-		blocks.emplace_back(strm.next_out);
-		err = inflate(&strm, Z_NO_FLUSH);
-	}
-
-	if (err != Z_STREAM_END) 
-	{
-		inflateEnd(&strm);
+	if (err != Z_OK)
 		return NullFile;
-	}
-
-	ASSERT(strm.total_out > 0, "Nothing to decompress");
 
-	Utility::ByteArray byteArray = make_shared<vector<byte> >( strm.total_out );
+	const size_t SizeHint = GetInflatedSizeHint(Source, SourceSize);
+	Utility::ByteArray byteArray = make_shared<vector<byte> >( SizeHint > 0 ? SizeHint : SourceSize * 4 );
+	size_t InflatedSize = 0;
 
-	// Allocate actual memory for this.
-	// copy the bits into that RAM.
-	// Free everything else up!!
-	void* curDest = byteArray->data();
-	size_t remaining = byteArray->size();
-
-	for (size_t i = 0; i < blocks.size(); ++i)
+	while (err == Z_OK)
 	{
-		ASSERT(remaining > 0);
-
-		size_t CopySize = min(remaining, (size_t)ChunkSize);
+		if (InflatedSize == byteArray->size())
+			byteArray->resize(byteArray->size() * 2);
 
-		memcpy(curDest, blocks[i].get(), CopySize);
-		curDest = (byte*)curDest + CopySize;
-		remaining -= CopySize;
+		strm.next_out = byteArray->data() + InflatedSize;
+		strm.avail_out = (uInt)min(byteArray->size() - InflatedSize, (size_t)UINT_MAX);
+		err = inflate(&strm, Z_NO_FLUSH);
+		InflatedSize = strm.next_out - byteArray->data();
 	}
 
 	inflateEnd(&strm);
 
+	// Z_BUF_ERROR here means the input ran out first
+	if (err != Z_STREAM_END || InflatedSize == 0)
+		return NullFile;
+
+	byteArray->resize(InflatedSize);
 	return byteArray;
 }
 
-ByteArray DecompressZippedFile( wstring& fileName )
+ByteArray DecompressZippedFile( const wstring& fileName )
 {
-	ByteArray CompressedFile = ReadFileHelper(fileName);
-	if (CompressedFile == NullFile)
+	// Inflate from a mapping rather than a copy of the compressed file
+	FileViewPtr CompressedFile = MapFileUncompressed(fileName);
+	if (CompressedFile == nullptr)
 		return NullFile;
 
 	int error;
-	ByteArray DecompressedFile = Inflate(CompressedFile, error);
+	ByteArray DecompressedFile = Inflate(CompressedFile->Data(), CompressedFile->Size(), error);
 	if (DecompressedFile->size() == 0)
 	{
 		Utility::Printf(L"Couldn't unzip file %s:  Error = %d\n", fileName.c_str(), error);
@@ -127,6 +130,180 @@ ByteArray DecompressZippedFile( wstring& fileName )
 	return DecompressedFile;
 }
 
+FileView::~FileView()
+{
+	if (m_Inflated == nullptr && m_Data != nullptr)
+		UnmapViewOfFile(m_Data);
+}
+
+FileViewPtr Utility::MapFileUncompressed( const wstring& fileName )
+{
+	HANDLE hFile = CreateFile2(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return nullptr;
+
+	// The view keeps the mapping and the file open once it exists
+	LARGE_INTEGER FileSize = {};
+	HANDLE hMapping = nullptr;
+	if (GetFileSizeEx(hFile, &FileSize) && FileSize.QuadPart > 0 && (uint64_t)FileSize.QuadPart <= SIZE_MAX)
+		hMapping = CreateFileMapping(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	CloseHandle(hFile);
+	if (hMapping == nullptr)
+		return nullptr;
+
+	const void* pData = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(hMapping);
+	if (pData == nullptr)
+		return nullptr;
+
+	FileViewPtr View(new FileView);
+	View->m_Data = (const byte*)pData;
+	View->m_Size = (size_t)FileSize.QuadPart;
+	return View;
+}
+
+FileViewPtr Utility::MapFile( const wstring& fileName )
+{
+	ByteArray Decompressed = DecompressZippedFile(fileName + L".gz");
+	if (Decompressed != NullFile)
+	{
+		FileViewPtr View(new FileView);
+		View->m_Inflated = Decompressed;
+		View->m_Data = Decompressed->data();
+		View->m_Size = Decompressed->size();
+		return View;
+	}
+
+	return MapFileUncompressed(fileName);
+}
+
+// Completes overlapped reads for ReadFileAsync.  Each file is read in chunks that are all
+// in flight at once; the I/O thread finishes the task when the last one lands.
+class FileReadQueue
+{
+public:
+	FileReadQueue() : m_hPort(nullptr) {}
+
+	~FileReadQueue()
+	{
+		if (m_hPort == nullptr)
+			return;
+
+		PostQueuedCompletionStatus(m_hPort, 0, 0, nullptr);
+		m_Thread.join();
+		CloseHandle(m_hPort);
+	}
+
+	task<ByteArray> Read( const wstring& fileName )
+	{
+		call_once(m_StartFlag, [this]()
+		{
+			m_hPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 1);
+			m_Thread = thread(&FileReadQueue::CompletionThread, this);
+		});
+
+		CREATEFILE2_EXTENDED_PARAMETERS Params = {};
+		Params.dwSize = sizeof(Params);
+		Params.dwFileAttributes = FILE_ATTRIBUTE_NORMAL;
+		Params.dwFileFlags = FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN;
+		HANDLE hFile = CreateFile2(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, &Params);
+		if (hFile == INVALID_HANDLE_VALUE)
+			return task_from_result(NullFile);
+
+		LARGE_INTEGER FileSize = {};
+		if (!GetFileSizeEx(hFile, &FileSize) || FileSize.QuadPart == 0 || (uint64_t)FileSize.QuadPart > SIZE_MAX ||
+			CreateIoCompletionPort(hFile, m_hPort, 0, 0) == nullptr)
+		{
+			CloseHandle(hFile);
+			return task_from_result(NullFile);
+		}
+
+		Request* pRequest = new Request;
+		pRequest->hFile = hFile;
+		pRequest->Data = make_shared<vector<byte> >( (size_t)FileSize.QuadPart );
+		pRequest->Failed = false;
+
+		const size_t ChunkCount = (pRequest->Data->size() + kChunkSize - 1) / kChunkSize;
+		pRequest->Chunks.resize(ChunkCount);
+		pRequest->Outstanding = (uint32_t)ChunkCount;
+		task<ByteArray> Result(pRequest->Completion);
+
+		for (size_t i = 0; i < ChunkCount; ++i)
+		{
+			Chunk& C = pRequest->Chunks[i];
+			ZeroMemory(&C.Overlapped, sizeof(C.Overlapped));
+			const uint64_t Offset = (uint64_t)i * kChunkSize;
+			C.Overlapped.Offset = (DWORD)Offset;
+			C.Overlapped.OffsetHigh = (DWORD)(Offset >> 32);
+			C.pRequest = pRequest;
+			C.Size = (DWORD)min(pRequest->Data->size() - (size_t)Offset, kChunkSize);
+
+			// A chunk that fails to start gets no completion packet, so finish it here
+			if (!ReadFile(hFile, pRequest->Data->data() + Offset, C.Size, nullptr, &C.Overlapped) && GetLastError() != ERROR_IO_PENDING)
+				CompleteChunk(C, false);
+		}
+
+		return Result;
+	}
+
+private:
+	static const size_t kChunkSize = 4 * 1024 * 1024;
+
+	struct Request;
+
+	struct Chunk
+	{
+		OVERLAPPED Overlapped;	// First, so completion packets point at the chunk
+		Request* pRequest;
+		DWORD Size;
+	};
+
+	struct Request
+	{
+		HANDLE hFile;
+		ByteArray Data;
+		vector<Chunk> Chunks;
+		atomic<uint32_t> Outstanding;
+		atomic<bool> Failed;
+		task_completion_event<ByteArray> Completion;
+	};
+
+	static void CompleteChunk( Chunk& C, bool Succeeded )
+	{
+		Request* pRequest = C.pRequest;
+		if (!Succeeded)
+			pRequest->Failed = true;
+		if (--pRequest->Outstanding != 0)
+			return;
+
+		CloseHandle(pRequest->hFile);
+		pRequest->Completion.set(pRequest->Failed ? NullFile : pRequest->Data);
+		delete pRequest;
+	}
+
+	void CompletionThread( void )
+	{
+		for (;;)
+		{
+			DWORD BytesRead = 0;
+			ULONG_PTR Key = 0;
+			OVERLAPPED* pOverlapped = nullptr;
+			const BOOL Succeeded = GetQueuedCompletionStatus(m_hPort, &BytesRead, &Key, &pOverlapped, INFINITE);
+			if (pOverlapped == nullptr)
+				return;
+
+			Chunk& C = *CONTAINING_RECORD(pOverlapped, Chunk, Overlapped);
+			CompleteChunk(C, Succeeded && BytesRead == C.Size);
+		}
+	}
+
+	HANDLE m_hPort;
+	thread m_Thread;
+	once_flag m_StartFlag;
+};
+
+static FileReadQueue s_FileReadQueue;
+
 ByteArray Utility::ReadFileSync( const wstring& fileName)
 {
 	return ReadFileHelperEx(make_shared<wstring>(fileName));
@@ -134,6 +311,117 @@ ByteArray Utility::ReadFileSync( const wstring& fileName)
 
 task<ByteArray> Utility::ReadFileAsync(const wstring& fileName)
 {
+	// The compressed version comes first, as in ReadFileSync; only inflating uses the pool
 	shared_ptr<wstring> SharedPtr = make_shared<wstring>(fileName);
-	return create_task( [=] { return ReadFileHelperEx(SharedPtr); } );
+	return s_FileReadQueue.Read(fileName + L".gz").then( [=]( ByteArray CompressedFile ) -> task<ByteArray>
+	{
+		if (CompressedFile == NullFile)
+			return s_FileReadQueue.Read(*SharedPtr);
+
+		return create_task( [=]
+		{
+			int error;
+			ByteArray DecompressedFile = Inflate(CompressedFile->data(), CompressedFile->size(), error);
+			if (DecompressedFile->size() == 0)
+			{
+				Utility::Printf(L"Couldn't unzip file %s.gz:  Error = %d\n", SharedPtr->c_str(), error);
+				return ReadFileHelper(*SharedPtr);
+			}
+			return DecompressedFile;
+		} );
+	} );
+}
+
+bool Utility::BenchmarkFileReads( const wstring& fileName, uint32_t iterationCount )
+{
+	iterationCount = max(iterationCount, 1u);
+
+	struct MethodResult
+	{
+		const char* Name;
+		DOUBLE Msec;
+		uint64_t Hash;
+		bool Failed;
+	};
+	MethodResult Results[4] =
+	{
+		{ "Blocking read", 0.0, 0, false },
+		{ "Mapped view", 0.0, 0, false },
+		{ "Blocked pool threads", 0.0, 0, false },
+		{ "Overlapped I/O queue", 0.0, 0, false },
+	};
+
+	// Stands in for the upload buffer every load ends in
+	vector<byte> Upload;
+	auto CopyToUpload = [&Upload]( const byte* Data, size_t Size )
+	{
+		Upload.resize(Size);
+		memcpy(Upload.data(), Data, Size);
+	};
+
+	// Warm the file cache so every method reads the same way
+	const size_t FileSize = ReadFileSync(fileName)->size();
+	if (FileSize == 0)
+	{
+		Utility::Printf(L"File read benchmark: could not read %s\n", fileName.c_str());
+		return false;
+	}
+
+	for (uint32_t Method = 0; Method < _countof(Results); ++Method)
+	{
+		MethodResult& Result = Results[Method];
+		Upload.clear();
+
+		const int64_t StartTick = SystemTime::GetCurrentTick();
+		if (Method < 2)
+		{
+			for (uint32_t i = 0; i < iterationCount; ++i)
+			{
+				if (Method == 0)
+				{
+					ByteArray ba = ReadFileSync(fileName);
+					Result.Failed = Result.Failed || ba->size() != FileSize;
+					CopyToUpload(ba->data(), ba->size());
+				}
+				else
+				{
+					FileViewPtr View = MapFile(fileName);
+					Result.Failed = Result.Failed || View == nullptr || View->Size() != FileSize;
+					if (View != nullptr)
+						CopyToUpload(View->Data(), View->Size());
+				}
+			}
+		}
+		else
+		{
+			// Every iteration in flight at once, as a level load would request them
+			vector<task<ByteArray>> Reads;
+			shared_ptr<wstring> SharedPtr = make_shared<wstring>(fileName);
+			for (uint32_t i = 0; i < iterationCount; ++i)
+				Reads.push_back(Method == 2 ? create_task( [=] { return ReadFileHelperEx(SharedPtr); } ) : ReadFileAsync(fileName));
+
+			for (auto& Read : Reads)
+			{
+				ByteArray ba = Read.get();
+				Result.Failed = Result.Failed || ba->size() != FileSize;
+				CopyToUpload(ba->data(), ba->size());
+			}
+		}
+		Result.Msec = SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - StartTick);
+		Result.Hash = Utility::HashBytes64(Upload.data(), Upload.size());
+	}
+
+	bool Valid = true;
+	for (const MethodResult& Result : Results)
+		Valid = Valid && !Result.Failed && Result.Hash == Results[0].Hash;
+
+	const DOUBLE Megabytes = (DOUBLE)FileSize * iterationCount / (1024.0 * 1024.0);
+	Utility::PrintfConsole("File read benchmark: %0.1f MB file, %u reads, each copied once more\n", FileSize / (1024.0 * 1024.0), iterationCount);
+	for (const MethodResult& Result : Results)
+	{
+		Utility::PrintfConsole("  %-22s %9.1f ms, %8.1f MB/s%s\n", Result.Name, Result.Msec,
+			Megabytes * 1000.0 / max(Result.Msec, 1e-3), Result.Failed ? " (failed)" : "");
+	}
+
+	return Valid;
 }
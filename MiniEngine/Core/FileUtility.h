@@ -31,7 +31,47 @@ namespace Utility
 	// This operation blocks until the entire file is read.
 	ByteArray ReadFileSync(const wstring& fileName);
 
-	// Same as previous except that it does not block but instead returns a task.
+	// Same as previous except that it does not block but instead returns a task.  Reads are
+	// issued as overlapped I/O and completed by one I/O thread, so no pool thread waits on the
+	// disk; only decompression runs on the pool.
 	task<ByteArray> ReadFileAsync(const wstring& fileName);
 
+	// Read-only contents of a whole file.  Uncompressed files are mapped rather than read, so
+	// pages load from the file cache on first touch and are copied only when the caller
+	// copies them, e.g. into an upload buffer.  Compressed files are inflated into memory the
+	// view owns.
+	class FileView
+	{
+	public:
+		~FileView();
+
+		const byte* Data( void ) const { return m_Data; }
+		size_t Size( void ) const { return m_Size; }
+		bool IsMapped( void ) const { return m_Inflated == nullptr; }
+
+	private:
+		friend shared_ptr<FileView> MapFile(const wstring& fileName);
+		friend shared_ptr<FileView> MapFileUncompressed(const wstring& fileName);
+
+		FileView() : m_Data(nullptr), m_Size(0) {}
+
+		const byte* m_Data;
+		size_t m_Size;
+		ByteArray m_Inflated;
+	};
+	typedef shared_ptr<FileView> FileViewPtr;
+
+	// Like ReadFileSync, but maps the file instead of reading it.  Returns null if the file
+	// cannot be opened or is empty.
+	FileViewPtr MapFile(const wstring& fileName);
+
+	// Maps fileName itself even if a compressed version exists, for readers that seek within
+	// the file.
+	FileViewPtr MapFileUncompressed(const wstring& fileName);
+
+	// Reads the file through each path above and the previous blocking reader, checks they
+	// agree and reports throughput.  Every iteration copies the bytes once more, as a texture
+	// or buffer upload would.
+	bool BenchmarkFileReads(const wstring& fileName, uint32_t iterationCount);
+
 } // namespace Utility
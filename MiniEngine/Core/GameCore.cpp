@@ -20,6 +20,7 @@
 #include "CommandContext.h"
 #include "PostEffects.h"
 #include "StringID.h"
+#include "LatencyHistogram.h"
 
 #if WINAPI_FAMILY_PARTITION(WINAPI_PARTITION_DESKTOP)
 	#pragma comment(lib, "runtimeobject.lib")
@@ -47,6 +48,7 @@ namespace GameCore
 	void InitializeApplication( IGameApp& game )
 	{
         StringID::Initialize();
+		EngineProfiling::Initialize();
         Graphics::Initialize();
 		SystemTime::Initialize();
 		GameInput::Initialize();
@@ -60,11 +62,14 @@ namespace GameCore
 		game.Cleanup();
 
 		GameInput::Shutdown();
+
+		LatencyHistogram::WriteLog();
 	}
 
 	bool UpdateApplication( IGameApp& game )
 	{
 		EngineProfiling::Update();
+		LatencyHistogram::UpdateLog();
 
 		float DeltaTime = Graphics::GetFrameTime();
 	
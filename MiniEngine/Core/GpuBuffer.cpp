@@ -92,6 +92,17 @@ void GpuBuffer::Create(const std::wstring& name, uint32_t NumElements, uint32_t
 
 void GpuBuffer::Destroy(void)
 {
+	// Views are recreated on the next Create, so their descriptors can be recycled
+	if (m_SRV.ptr != D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN)
+	{
+		FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, m_SRV);
+		m_SRV.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
+	}
+	if (m_UAV.ptr != D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN)
+	{
+		FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, m_UAV);
+		m_UAV.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
+	}
 	GpuResource::Destroy();
 }
 
@@ -140,6 +151,8 @@ void ByteAddressBuffer::CreateDerivedViews(void)
 
 	if (m_SRV.ptr == D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN)
 		m_SRV = AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+	else
+		DescriptorAllocator::InvalidateCopies();
 	g_Device->CreateShaderResourceView(m_pResource.Get(), &SRVDesc, m_SRV);
 
 	D3D12_UNORDERED_ACCESS_VIEW_DESC UAVDesc = {};
@@ -165,6 +178,8 @@ void StructuredBuffer::CreateDerivedViews(void)
 
 	if (m_SRV.ptr == D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN)
 		m_SRV = AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+	else
+		DescriptorAllocator::InvalidateCopies();
 	g_Device->CreateShaderResourceView(m_pResource.Get(), &SRVDesc, m_SRV);
 
 	D3D12_UNORDERED_ACCESS_VIEW_DESC UAVDesc = {};
@@ -193,6 +208,8 @@ void TypedBuffer::CreateDerivedViews(void)
 
 	if (m_SRV.ptr == D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN)
 		m_SRV = AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+	else
+		DescriptorAllocator::InvalidateCopies();
 	g_Device->CreateShaderResourceView(m_pResource.Get(), &SRVDesc, m_SRV);
 
 	D3D12_UNORDERED_ACCESS_VIEW_DESC UAVDesc = {};
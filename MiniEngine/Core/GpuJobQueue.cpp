@@ -3,9 +3,20 @@
 #include "CommandContext.h"
 #include "CommandListManager.h"
 #include "TiledResources.h"
+#include "GpuTimeManager.h"
+#include <algorithm>
 
 GpuJobQueue g_GpuJobQueue;
 
+// A mapped entry must have gone unused for this many frames before it can be evicted for a
+// more important one, so that nothing drawn in the frames still in flight loses its tiles.
+static const UINT32 g_EvictionIdleFrames = 2;
+
+// Compaction only evicts entries that have been out of use for a second or so, and only a
+// few per frame.
+static const UINT32 g_CompactionIdleFrames = 60;
+static const UINT32 g_MaxCompactionEvictionsPerFrame = 4;
+
 bool GraphicsJob::IsComplete() const
 {
     if (CompletionFenceValue == 0)
@@ -17,6 +28,8 @@ bool GraphicsJob::IsComplete() const
 }
 
 GpuJobQueue::GpuJobQueue()
+    : m_TimerCount(0),
+      m_ReadBackCount(0)
 {
     InitializeCriticalSection(&m_JobCritSec);
     for (UINT32 i = 0; i < 10; ++i)
@@ -33,10 +46,9 @@ GpuJobQueue::~GpuJobQueue()
         FreeGraphicsJob(m_CompleteGraphicsJobs.front());
         m_CompleteGraphicsJobs.pop_front();
     }
-    while (!m_GraphicsJobs.empty())
+    while (!m_Scheduler.IsEmpty())
     {
-        FreeGraphicsJob(m_GraphicsJobs.front());
-        m_GraphicsJobs.pop_front();
+        FreeGraphicsJob(static_cast<GraphicsJob*>(m_Scheduler.RemoveNext()));
     }
     LeaveCriticalSection(&m_JobCritSec);
     DeleteCriticalSection(&m_JobCritSec);
@@ -44,27 +56,45 @@ GpuJobQueue::~GpuJobQueue()
 
 void GpuJobQueue::AddPagingMapEntry(PagingQueueEntry* pEntry)
 {
-    m_PagingMapQueue.push_back(pEntry);
+    EnterCriticalSection(&m_JobCritSec);
+    m_PagingMapQueue.Push(pEntry, GetPagingKey(pEntry));
+    LeaveCriticalSection(&m_JobCritSec);
 }
 
 void GpuJobQueue::AddPagingUnmapEntry(PagingQueueEntry* pEntry)
 {
+    EnterCriticalSection(&m_JobCritSec);
     m_PagingUnmapQueue.push_back(pEntry);
+    LeaveCriticalSection(&m_JobCritSec);
+}
+
+void GpuJobQueue::UpdatePagingEntry(PagingQueueEntry* pEntry)
+{
+    EnterCriticalSection(&m_JobCritSec);
+    if (pEntry->IsQueued())
+    {
+        m_PagingMapQueue.Update(pEntry, GetPagingKey(pEntry));
+    }
+    LeaveCriticalSection(&m_JobCritSec);
 }
 
 void GpuJobQueue::RemovePagingEntry(PagingQueueEntry* pEntry)
 {
+    EnterCriticalSection(&m_JobCritSec);
+    if (pEntry->IsQueued())
     {
-        auto iter = m_PagingMapQueue.begin();
-        auto end = m_PagingMapQueue.end();
-        while (iter != end)
+        m_PagingMapQueue.Remove(pEntry);
+    }
+
+    RemoveMappedEntry(pEntry);
+
+    // A job mapped this frame that has not started yet must not run after its entry is gone
+    if (pEntry->pGraphicsJob != nullptr)
+    {
+        auto iter = std::find(m_MappedJobs.begin(), m_MappedJobs.end(), pEntry->pGraphicsJob);
+        if (iter != m_MappedJobs.end())
         {
-            if (*iter == pEntry)
-            {
-                m_PagingMapQueue.erase(iter);
-                break;
-            }
-            ++iter;
+            m_MappedJobs.erase(iter);
         }
     }
 
@@ -81,6 +111,7 @@ void GpuJobQueue::RemovePagingEntry(PagingQueueEntry* pEntry)
             ++iter;
         }
     }
+    LeaveCriticalSection(&m_JobCritSec);
 }
 
 GraphicsJob* GpuJobQueue::AllocGraphicsJob(bool ForceCreate)
@@ -111,25 +142,46 @@ void GpuJobQueue::FreeGraphicsJob(GraphicsJob* pJob)
     delete pJob;
 }
 
-GraphicsJob* GpuJobQueue::CreateGraphicsJob(const std::wstring& ID)
+GraphicsJob* GpuJobQueue::CreateGraphicsJob(const std::wstring& ID, UINT32 JobType)
 {
+    assert(JobType < GpuJobCostModel::MaxJobTypes);
     GraphicsJob* pJob = AllocGraphicsJob(false);
     assert(pJob != nullptr);
 
     ZeroMemory(pJob, sizeof(*pJob));
     pJob->CancelJob = false;
     pJob->HoldJobOpen = false;
+    pJob->JobType = JobType;
     pJob->pContext = &GraphicsContext::Begin(ID, true);
 
+    // Jobs created while every timer is waiting for a readback go untimed
+    EnterCriticalSection(&m_JobCritSec);
+    if (!m_FreeTimers.empty())
+    {
+        pJob->TimerIndex = m_FreeTimers.back();
+        m_FreeTimers.pop_back();
+    }
+    else if (m_TimerCount < MaxJobTimers)
+    {
+        pJob->TimerIndex = GpuTimeManager::NewTimer();
+        ++m_TimerCount;
+    }
+    LeaveCriticalSection(&m_JobCritSec);
+
+    if (pJob->TimerIndex != 0)
+    {
+        GpuTimeManager::StartTimer(*pJob->pContext, pJob->TimerIndex);
+    }
+
     return pJob;
 }
 
-void GpuJobQueue::SubmitGraphicsJob(GraphicsJob* pJob)
+void GpuJobQueue::SubmitGraphicsJob(GraphicsJob* pJob, UINT32 LatencyFrames)
 {
     assert(pJob != nullptr);
 
     EnterCriticalSection(&m_JobCritSec);
-    m_GraphicsJobs.push_back(pJob);
+    m_Scheduler.Submit(pJob, Graphics::GetFrameCount(), LatencyFrames);
     LeaveCriticalSection(&m_JobCritSec);
 }
 
@@ -143,37 +195,66 @@ void GpuJobQueue::CloseGraphicsJob(GraphicsJob* pJob)
 
 void GpuJobQueue::ExecuteGraphicsJobs(UINT32 ExecutionBudgetUsec)
 {
-    PerformPageMapping();
-
-    if (m_GraphicsJobs.empty())
-    {
-        return;
-    }
-
-    while (!m_GraphicsJobs.empty())
+    // Jobs whose tiles were just mapped run first, outside the lock.  Each is taken off the
+    // list under the lock so that RemovePagingEntry can withdraw the ones not yet started.
+    PerformPageMapping(ExecutionBudgetUsec);
+    for (;;)
     {
         GraphicsJob* pJob = nullptr;
-
         EnterCriticalSection(&m_JobCritSec);
-        if (!m_GraphicsJobs.empty())
+        if (!m_MappedJobs.empty())
         {
-            pJob = m_GraphicsJobs.front();
+            pJob = m_MappedJobs.back();
+            m_MappedJobs.pop_back();
         }
-        if (pJob != nullptr && pJob->EstimatedGpuUsec <= ExecutionBudgetUsec)
+        LeaveCriticalSection(&m_JobCritSec);
+
+        if (pJob == nullptr)
         {
-            m_GraphicsJobs.pop_front();
+            break;
         }
-        else
+        ExecuteSingleGraphicsJob(pJob);
+    }
+
+    EnterCriticalSection(&m_JobCritSec);
+    m_SelectedJobs.clear();
+    m_Scheduler.SelectJobs(Graphics::GetFrameCount(), ExecutionBudgetUsec, m_SelectedJobs);
+    LeaveCriticalSection(&m_JobCritSec);
+
+    for (auto pJob : m_SelectedJobs)
+    {
+        ExecuteSingleGraphicsJob(static_cast<GraphicsJob*>(pJob));
+    }
+}
+
+void GpuJobQueue::UpdateCostEstimates()
+{
+    EnterCriticalSection(&m_JobCritSec);
+
+    // A job submitted before the previous readback finished was resolved by it, so its time
+    // is in the buffer now.  Later jobs wait for the next readback.
+    UINT32 Index = 0;
+    while (Index < m_PendingTimers.size())
+    {
+        const PendingTimer& Timer = m_PendingTimers[Index];
+        if (Timer.ReadBackIndex == m_ReadBackCount)
         {
-            pJob = nullptr;
+            ++Index;
+            continue;
         }
-        LeaveCriticalSection(&m_JobCritSec);
 
-        if (pJob != nullptr)
+        const FLOAT Msec = GpuTimeManager::GetTime(Timer.TimerIndex);
+        if (Msec > 0.0f)
         {
-            ExecutionBudgetUsec -= ExecuteSingleGraphicsJob(pJob);
+            m_Scheduler.GetCostModel().RecordMeasurement(Timer.JobType, Msec * 1000.0f);
         }
+        m_FreeTimers.push_back(Timer.TimerIndex);
+        m_PendingTimers[Index] = m_PendingTimers.back();
+        m_PendingTimers.pop_back();
     }
+    ++m_ReadBackCount;
+
+    LeaveCriticalSection(&m_JobCritSec);
 }
 
 UINT32 GpuJobQueue::ExecuteSingleGraphicsJob(GraphicsJob* pJob)
@@ -187,7 +268,10 @@ UINT32 GpuJobQueue::ExecuteSingleGraphicsJob(GraphicsJob* pJob)
     if (!pJob->CancelJob)
     {
         assert(pJob->CompletionFenceValue == 0);
-        UsecElapsed = pJob->EstimatedGpuUsec;
+        if (pJob->TimerIndex != 0)
+        {
+            GpuTimeManager::StopTimer(*pJob->pContext, pJob->TimerIndex);
+        }
         UINT64 CompletionFence = pJob->pContext->Finish(false);
         pJob->CompletionFenceValue = CompletionFence;
         pJob->pContext = nullptr;
@@ -199,6 +283,26 @@ UINT32 GpuJobQueue::ExecuteSingleGraphicsJob(GraphicsJob* pJob)
         pJob->pContext = nullptr;
     }
 
+    EnterCriticalSection(&m_JobCritSec);
+    if (!pJob->CancelJob)
+    {
+        UsecElapsed = m_Scheduler.GetEstimate(pJob);
+    }
+    if (pJob->TimerIndex != 0 && !pJob->CancelJob)
+    {
+        PendingTimer Timer;
+        Timer.TimerIndex = pJob->TimerIndex;
+        Timer.JobType = pJob->JobType;
+        Timer.ReadBackIndex = m_ReadBackCount;
+        m_PendingTimers.push_back(Timer);
+    }
+    else if (pJob->TimerIndex != 0)
+    {
+        m_FreeTimers.push_back(pJob->TimerIndex);
+    }
+    pJob->TimerIndex = 0;
+    LeaveCriticalSection(&m_JobCritSec);
+
     if (!pJob->HoldJobOpen)
     {
         CloseGraphicsJob(pJob);
@@ -207,84 +311,197 @@ UINT32 GpuJobQueue::ExecuteSingleGraphicsJob(GraphicsJob* pJob)
     return UsecElapsed;
 }
 
-void GpuJobQueue::PerformPageMapping()
+void GpuJobQueue::PerformPageMapping(UINT32& ExecutionBudgetUsec)
 {
     ID3D12CommandQueue* pQueue = Graphics::g_CommandManager.GetQueue(D3D12_COMMAND_LIST_TYPE_DIRECT).GetCommandQueue();
 
+    EnterCriticalSection(&m_JobCritSec);
+
+    m_MappedJobs.clear();
     while (!m_PagingUnmapQueue.empty())
     {
         PagingQueueEntry* pEntry = m_PagingUnmapQueue.front();
         m_PagingUnmapQueue.pop_front();
+        UnmapPagingEntry(pQueue, pEntry);
+    }
 
-        for (UINT32 i = 0; i < ARRAYSIZE(pEntry->TiledTexture); ++i)
+    // Entries leave the queue once mapped, so the top is always the most important
+    // entry still waiting for tiles
+    UINT32 MappedCount = 0;
+    while (!m_PagingMapQueue.IsEmpty())
+    {
+        PagingQueueEntry* pEntry = static_cast<PagingQueueEntry*>(m_PagingMapQueue.Top());
+        if (pEntry->SortKey == 0)
         {
-            if (pEntry->TiledTexture[i].IsSubresourceMapped(0))
-            {
-                g_TilePool.UnmapTiledTextureSubresource(pQueue, &pEntry->TiledTexture[i], 0, 0);
-            }
+            // Everything left is out of view
+            break;
         }
-        pEntry->SetUnmapped();
-    }
 
-    PagingQueueEntryComparator Comparator;
-    std::sort(m_PagingMapQueue.begin(), m_PagingMapQueue.end(), Comparator);
+        bool NothingToMap = pEntry->IsUnmapped();
+        UINT32 TileGroupCount = 0;
+        for (UINT32 i = 0; i < ARRAYSIZE(pEntry->TiledTexture) && !NothingToMap; ++i)
+        {
+            NothingToMap = pEntry->TiledTexture[i].IsSubresourceMapped(0);
+            TileGroupCount += g_TilePool.GetTileGroupCount(pEntry->TiledTexture[i].GetTotalTileCount());
+        }
 
-    auto iter = m_PagingMapQueue.begin();
-    auto end = m_PagingMapQueue.end();
-    while (iter != end)
-    {
-        auto nextiter = iter;
-        ++nextiter;
-        PagingQueueEntry* pEntry = *iter;
-        if (pEntry->IsUnmapped())
+        if (NothingToMap)
         {
-            m_PagingMapQueue.erase(iter);
-            iter = nextiter;
+            m_PagingMapQueue.Pop();
             continue;
         }
 
-        if (pEntry->SortKey == 0)
+        if (TileGroupCount > g_TilePool.GetFreeTileGroupCount() && !EvictPagingEntries(pQueue, pEntry, TileGroupCount))
         {
-            iter = nextiter;
-            continue;
+            // Ran out of tiles.
+            break;
         }
 
-        UINT32 TileGroupCount = 0;
-        bool NextEntry = false;
-        for (UINT32 i = 0; i < ARRAYSIZE(pEntry->TiledTexture); ++i)
+        // The first entry of the frame is mapped even if its job is larger than the budget
+        const UINT32 JobUsec = (pEntry->pGraphicsJob != nullptr) ? m_Scheduler.GetEstimate(pEntry->pGraphicsJob) : 0;
+        if (JobUsec > ExecutionBudgetUsec && MappedCount > 0)
         {
-            if (pEntry->TiledTexture[i].IsSubresourceMapped(0))
+            break;
+        }
+
+        bool Success = true;
+        for (UINT32 i = 0; i < ARRAYSIZE(pEntry->TiledTexture) && Success; ++i)
+        {
+            Success = g_TilePool.MapTiledTextureSubresource(pQueue, &pEntry->TiledTexture[i], 0, 0);
+        }
+        if (!Success)
+        {
+            // The pool could not grow; give back what was mapped and leave the entry queued
+            // so that its job runs once tiles are available
+            for (UINT32 i = 0; i < ARRAYSIZE(pEntry->TiledTexture); ++i)
             {
-                NextEntry = true;
-                break;
+                if (pEntry->TiledTexture[i].IsSubresourceMapped(0))
+                {
+                    g_TilePool.UnmapTiledTextureSubresource(pQueue, &pEntry->TiledTexture[i], 0, 0);
+                }
             }
-            TileGroupCount += g_TilePool.GetTileGroupCount(pEntry->TiledTexture[i].GetTotalTileCount());
+            break;
         }
 
-        if (NextEntry)
+        m_PagingMapQueue.Pop();
+        m_MappedEntries.push_back(pEntry);
+        pEntry->MappedIndex = (UINT32)m_MappedEntries.size();
+
+        // Run by the caller once the lock is released; the queue orders them after the mapping
+        if (pEntry->pGraphicsJob != nullptr)
         {
-            iter = nextiter;
-            continue;
+            m_MappedJobs.push_back(pEntry->pGraphicsJob);
         }
 
-        if (TileGroupCount > g_TilePool.GetFreeTileGroupCount())
+        ExecutionBudgetUsec -= std::min(JobUsec, ExecutionBudgetUsec);
+        ++MappedCount;
+    }
+
+    CompactTilePool(pQueue);
+    g_TilePool.ReleaseEmptySlabs();
+
+    // Taken from the back, so this runs them in the order they were mapped
+    std::reverse(m_MappedJobs.begin(), m_MappedJobs.end());
+
+    LeaveCriticalSection(&m_JobCritSec);
+}
+
+bool GpuJobQueue::EvictPagingEntries(ID3D12CommandQueue* pQueue, const PagingQueueEntry* pRequester, UINT32 TileGroupCount)
+{
+    const UINT64 FrameCount = Graphics::GetFrameCount();
+    const UINT32 FreeCount = g_TilePool.GetFreeTileGroupCount();
+
+    // Only entries that matter less than the one being mapped may give up their tiles
+    m_EvictionCandidates.clear();
+    for (auto pEntry : m_MappedEntries)
+    {
+        if (pEntry->MostRecentTimestamp + g_EvictionIdleFrames > FrameCount || pEntry->SortKey >= pRequester->SortKey)
         {
-            // Ran out of tiles.
-            break;
+            continue;
         }
 
+        TileEvictionCandidate Candidate;
+        Candidate.LastUsedFrame = pEntry->MostRecentTimestamp;
+        Candidate.GroupCount = 0;
+        Candidate.pOwner = pEntry;
         for (UINT32 i = 0; i < ARRAYSIZE(pEntry->TiledTexture); ++i)
         {
-            TiledTextureBuffer* pTT = &pEntry->TiledTexture[i];
-            bool Success = g_TilePool.MapTiledTextureSubresource(pQueue, pTT, 0, 0);
-            assert(Success);
+            Candidate.GroupCount += g_TilePool.GetTileGroupCount(pEntry->TiledTexture[i].GetTotalTileCount());
         }
+        m_EvictionCandidates.push_back(Candidate);
+    }
 
-        if (pEntry->pGraphicsJob != nullptr)
+    const UINT32 EvictionCount = SelectTileEvictions(m_EvictionCandidates, TileGroupCount - FreeCount);
+    for (UINT32 i = 0; i < EvictionCount; ++i)
+    {
+        UnmapPagingEntry(pQueue, (PagingQueueEntry*)m_EvictionCandidates[i].pOwner);
+    }
+
+    return EvictionCount > 0;
+}
+
+void GpuJobQueue::CompactTilePool(ID3D12CommandQueue* pQueue)
+{
+    // Drain a sparsely used slab by evicting its long idle entries, so that it can be
+    // released once empty.  Tiles are not copied between heaps.
+    const UINT32 SlabIndex = g_TilePool.FindCompactionSlab();
+    if (SlabIndex == TileGroupAllocator::InvalidIndex)
+    {
+        return;
+    }
+
+    const UINT64 FrameCount = Graphics::GetFrameCount();
+    UINT32 EvictionCount = 0;
+    UINT32 Index = 0;
+    while (Index < m_MappedEntries.size() && EvictionCount < g_MaxCompactionEvictionsPerFrame)
+    {
+        PagingQueueEntry* pEntry = m_MappedEntries[Index];
+        bool OnSlab = false;
+        for (UINT32 i = 0; i < ARRAYSIZE(pEntry->TiledTexture) && !OnSlab; ++i)
+        {
+            OnSlab = g_TilePool.IsTextureOnSlab(&pEntry->TiledTexture[i], SlabIndex);
+        }
+
+        if (OnSlab && pEntry->MostRecentTimestamp + g_CompactionIdleFrames <= FrameCount)
         {
-            ExecuteSingleGraphicsJob(pEntry->pGraphicsJob);
+            // Swaps the last entry into this slot
+            UnmapPagingEntry(pQueue, pEntry);
+            ++EvictionCount;
         }
+        else
+        {
+            ++Index;
+        }
+    }
+}
 
-        iter = nextiter;
+void GpuJobQueue::UnmapPagingEntry(ID3D12CommandQueue* pQueue, PagingQueueEntry* pEntry)
+{
+    for (UINT32 i = 0; i < ARRAYSIZE(pEntry->TiledTexture); ++i)
+    {
+        if (pEntry->TiledTexture[i].IsSubresourceMapped(0))
+        {
+            g_TilePool.UnmapTiledTextureSubresource(pQueue, &pEntry->TiledTexture[i], 0, 0);
+        }
     }
+    pEntry->SetUnmapped();
+    if (pEntry->IsQueued())
+    {
+        m_PagingMapQueue.Remove(pEntry);
+    }
+    RemoveMappedEntry(pEntry);
+}
+
+void GpuJobQueue::RemoveMappedEntry(PagingQueueEntry* pEntry)
+{
+    if (pEntry->MappedIndex == 0)
+    {
+        return;
+    }
+
+    PagingQueueEntry* pLast = m_MappedEntries.back();
+    m_MappedEntries[pEntry->MappedIndex - 1] = pLast;
+    pLast->MappedIndex = pEntry->MappedIndex;
+    m_MappedEntries.pop_back();
+    pEntry->MappedIndex = 0;
 }
@@ -2,15 +2,16 @@
 
 #include <deque>
 #include "TiledResources.h"
+#include "GpuJobScheduler.h"
 
 class CommandContext;
 class ComputeContext;
 
-struct GraphicsJob
+struct GraphicsJob : public GpuScheduledJob
 {
-    UINT32 EstimatedGpuUsec;
     GraphicsContext* pContext;
     UINT64 CompletionFenceValue;
+    UINT32 TimerIndex;      // GpuTimeManager timer of this job, 0 if untimed
     bool HoldJobOpen;
     bool CancelJob;
 
@@ -23,7 +24,9 @@ struct ComputeJob : public GraphicsJob
     ComputeContext* pComputeContext;
 };
 
-struct PagingQueueEntry
+// Queued by priority: the highest SortKey is mapped first.  Once mapped, an entry that
+// has not been used for a while may be evicted to make room for a more important one.
+struct PagingQueueEntry : public GpuJobHeapNode
 {
     TiledTextureBuffer TiledTexture[2];
     UINT64 MostRecentTimestamp;
@@ -34,29 +37,55 @@ struct PagingQueueEntry
     };
     GraphicsJob* pGraphicsJob;
 
-    void SetUnmapped() { SortKey = -1; }
-    bool IsUnmapped() const { return SortKey == -1; }
-};
+    // 1-based position in the mapped entry list, 0 when not mapped
+    UINT32 MappedIndex;
 
-typedef std::deque<PagingQueueEntry*> PagingQueueEntryDeque;
+    // Set once the tiles have been evicted; the job's output is gone for good
+    bool Unmapped;
 
-struct PagingQueueEntryComparator
-{
-public:
-    bool operator() (const PagingQueueEntry* pA, const PagingQueueEntry* pB) const
+    PagingQueueEntry()
     {
-        return pA->SortKey > pB->SortKey;
+        HeapKey = 0;
+        HeapIndex = 0;
+        MostRecentTimestamp = 0;
+        SortKey = 0;
+        pGraphicsJob = nullptr;
+        MappedIndex = 0;
+        Unmapped = false;
     }
+
+    void SetUnmapped() { Unmapped = true; }
+    bool IsUnmapped() const { return Unmapped; }
 };
 
+typedef std::deque<PagingQueueEntry*> PagingQueueEntryDeque;
+
 class GpuJobQueue
 {
 private:
     CRITICAL_SECTION m_JobCritSec;
-    std::deque<GraphicsJob*> m_GraphicsJobs;
+    GpuJobScheduler m_Scheduler;
+    std::vector<GpuScheduledJob*> m_SelectedJobs;
     std::deque<GraphicsJob*> m_CompleteGraphicsJobs;
-    PagingQueueEntryDeque m_PagingMapQueue;
+    GpuJobHeap m_PagingMapQueue;
     PagingQueueEntryDeque m_PagingUnmapQueue;
+    std::vector<PagingQueueEntry*> m_MappedEntries;
+    std::vector<TileEvictionCandidate> m_EvictionCandidates;
+
+    // Each job is timed with its own GpuTimeManager timer, which returns to the free list
+    // once the readback after the job ran has been recorded
+    struct PendingTimer
+    {
+        UINT32 TimerIndex;
+        UINT32 JobType;
+        UINT64 ReadBackIndex;
+    };
+    static const UINT32 MaxJobTimers = 256;
+    std::vector<UINT32> m_FreeTimers;
+    std::vector<PendingTimer> m_PendingTimers;
+    std::vector<GraphicsJob*> m_MappedJobs;
+    UINT32 m_TimerCount;
+    UINT64 m_ReadBackCount;
 
 public:
     GpuJobQueue();
@@ -66,16 +95,31 @@ public:
     void AddPagingUnmapEntry(PagingQueueEntry* pEntry);
     void RemovePagingEntry(PagingQueueEntry* pEntry);
 
-    GraphicsJob* CreateGraphicsJob(const std::wstring& ID = L"");
-    void SubmitGraphicsJob(GraphicsJob* pJob);
+    // Call after changing an entry's SortKey to move it within the queue.
+    void UpdatePagingEntry(PagingQueueEntry* pEntry);
+
+    // Jobs of the same type share a learned GPU cost estimate.
+    GraphicsJob* CreateGraphicsJob(const std::wstring& ID = L"", UINT32 JobType = 0);
+    void SubmitGraphicsJob(GraphicsJob* pJob, UINT32 LatencyFrames = GpuJobScheduler::DefaultLatencyFrames);
     void CloseGraphicsJob(GraphicsJob* pJob);
 
     void ExecuteGraphicsJobs(UINT32 ExecutionBudgetUsec = -1);
 
-    const PagingQueueEntryDeque& GetPagingMapDeque() const { return m_PagingMapQueue; }
+    // Feeds measured job times into the cost estimates.  Must be called while
+    // GpuTimeManager has its readback buffer mapped.
+    void UpdateCostEstimates();
+
+    const GpuJobSchedulerStats& GetSchedulerStats() const { return m_Scheduler.GetStats(); }
 
 private:
-    void PerformPageMapping();
+    static UINT64 GetPagingKey(const PagingQueueEntry* pEntry) { return 0xFFFFFFFFULL - pEntry->SortKey; }
+    // Maps the most important paging entries and leaves their jobs in m_MappedJobs, last
+    // to run first
+    void PerformPageMapping(UINT32& ExecutionBudgetUsec);
+    bool EvictPagingEntries(ID3D12CommandQueue* pQueue, const PagingQueueEntry* pRequester, UINT32 TileGroupCount);
+    void CompactTilePool(ID3D12CommandQueue* pQueue);
+    void UnmapPagingEntry(ID3D12CommandQueue* pQueue, PagingQueueEntry* pEntry);
+    void RemoveMappedEntry(PagingQueueEntry* pEntry);
     GraphicsJob* AllocGraphicsJob(bool ForceCreate = false);
     void FreeGraphicsJob(GraphicsJob* pJob);
     UINT32 ExecuteSingleGraphicsJob(GraphicsJob* pJob);
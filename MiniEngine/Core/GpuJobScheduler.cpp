@@ -0,0 +1,519 @@
+#include "pch.h"
+#include "GpuJobScheduler.h"
+#include "FileUtility.h"
+#include "SystemTime.h"
+#include <deque>
+#include <set>
+
+void GpuJobHeap::Place(UINT32 Position, GpuJobHeapNode* pNode)
+{
+    m_Nodes[Position] = pNode;
+    pNode->HeapIndex = Position + 1;
+}
+
+void GpuJobHeap::SiftUp(UINT32 Position)
+{
+    GpuJobHeapNode* pNode = m_Nodes[Position];
+    while (Position > 0)
+    {
+        const UINT32 Parent = (Position - 1) / 2;
+        if (m_Nodes[Parent]->HeapKey <= pNode->HeapKey)
+        {
+            break;
+        }
+        Place(Position, m_Nodes[Parent]);
+        Position = Parent;
+    }
+    Place(Position, pNode);
+}
+
+void GpuJobHeap::SiftDown(UINT32 Position)
+{
+    GpuJobHeapNode* pNode = m_Nodes[Position];
+    const UINT32 Count = (UINT32)m_Nodes.size();
+    for (;;)
+    {
+        UINT32 Child = Position * 2 + 1;
+        if (Child >= Count)
+        {
+            break;
+        }
+        if (Child + 1 < Count && m_Nodes[Child + 1]->HeapKey < m_Nodes[Child]->HeapKey)
+        {
+            ++Child;
+        }
+        if (pNode->HeapKey <= m_Nodes[Child]->HeapKey)
+        {
+            break;
+        }
+        Place(Position, m_Nodes[Child]);
+        Position = Child;
+    }
+    Place(Position, pNode);
+}
+
+void GpuJobHeap::Push(GpuJobHeapNode* pNode, UINT64 Key)
+{
+    assert(!pNode->IsQueued());
+    pNode->HeapKey = Key;
+    m_Nodes.push_back(pNode);
+    SiftUp((UINT32)m_Nodes.size() - 1);
+}
+
+GpuJobHeapNode* GpuJobHeap::Pop()
+{
+    GpuJobHeapNode* pTop = Top();
+    if (pTop != nullptr)
+    {
+        Remove(pTop);
+    }
+    return pTop;
+}
+
+void GpuJobHeap::Update(GpuJobHeapNode* pNode, UINT64 Key)
+{
+    assert(pNode->IsQueued() && m_Nodes[pNode->HeapIndex - 1] == pNode);
+    const UINT64 OldKey = pNode->HeapKey;
+    pNode->HeapKey = Key;
+    if (Key < OldKey)
+    {
+        SiftUp(pNode->HeapIndex - 1);
+    }
+    else if (Key > OldKey)
+    {
+        SiftDown(pNode->HeapIndex - 1);
+    }
+}
+
+void GpuJobHeap::Remove(GpuJobHeapNode* pNode)
+{
+    assert(pNode->IsQueued() && m_Nodes[pNode->HeapIndex - 1] == pNode);
+    const UINT32 Position = pNode->HeapIndex - 1;
+    pNode->HeapIndex = 0;
+
+    GpuJobHeapNode* pLast = m_Nodes.back();
+    m_Nodes.pop_back();
+    if (pLast == pNode)
+    {
+        return;
+    }
+
+    // The last node fills the hole and moves whichever way its key requires
+    Place(Position, pLast);
+    if (Position > 0 && pLast->HeapKey < m_Nodes[(Position - 1) / 2]->HeapKey)
+    {
+        SiftUp(Position);
+    }
+    else
+    {
+        SiftDown(Position);
+    }
+}
+
+void GpuJobHeap::Clear()
+{
+    for (auto pNode : m_Nodes)
+    {
+        pNode->HeapIndex = 0;
+    }
+    m_Nodes.clear();
+}
+
+UINT32 GpuJobCostModel::GetEstimate(UINT32 JobType, UINT32 FallbackUsec) const
+{
+    assert(JobType < MaxJobTypes);
+    const JobTypeCost& Cost = m_Costs[JobType];
+    if (Cost.SampleCount == 0)
+    {
+        return FallbackUsec != 0 ? FallbackUsec : DefaultEstimateUsec;
+    }
+
+    // Lean toward the peak so that an occasional slow job is not packed into a full frame
+    return (UINT32)(Cost.AverageUsec + 0.25f * (Cost.PeakUsec - Cost.AverageUsec) + 0.5f);
+}
+
+void GpuJobCostModel::RecordMeasurement(UINT32 JobType, FLOAT Usec)
+{
+    assert(JobType < MaxJobTypes);
+    JobTypeCost& Cost = m_Costs[JobType];
+    if (Cost.SampleCount == 0)
+    {
+        Cost.AverageUsec = Usec;
+        Cost.PeakUsec = Usec;
+    }
+    else
+    {
+        // Moving average over roughly the last eight jobs; the peak decays toward it
+        Cost.AverageUsec += (Usec - Cost.AverageUsec) * 0.125f;
+        Cost.PeakUsec = std::max(Usec, Cost.PeakUsec - (Cost.PeakUsec - Cost.AverageUsec) * 0.125f);
+    }
+    ++Cost.SampleCount;
+}
+
+void GpuJobCostModel::Reset()
+{
+    ZeroMemory(m_Costs, sizeof(m_Costs));
+}
+
+GpuJobScheduler::GpuJobScheduler()
+    : m_Sequence(0)
+{
+    ZeroMemory(&m_Stats, sizeof(m_Stats));
+}
+
+void GpuJobScheduler::Submit(GpuScheduledJob* pJob, UINT64 CurrentFrame, UINT32 LatencyFrames)
+{
+    pJob->DeadlineFrame = CurrentFrame + LatencyFrames;
+    m_Jobs.Push(pJob, (pJob->DeadlineFrame << 32) | (m_Sequence++ & 0xFFFFFFFF));
+    ++m_Stats.JobsSubmitted;
+}
+
+UINT32 GpuJobScheduler::SelectJobs(UINT64 CurrentFrame, UINT32 BudgetUsec, std::vector<GpuScheduledJob*>& Selected)
+{
+    UINT32 UsedUsec = 0;
+    UINT32 SelectedCount = 0;
+    m_Deferred.clear();
+
+    while (!m_Jobs.IsEmpty())
+    {
+        GpuScheduledJob* pJob = static_cast<GpuScheduledJob*>(m_Jobs.Top());
+        const UINT32 CostUsec = GetEstimate(pJob);
+        const bool Overdue = pJob->DeadlineFrame <= CurrentFrame;
+
+        if (CostUsec > BudgetUsec - UsedUsec)
+        {
+            if (!Overdue && UsedUsec >= BudgetUsec)
+            {
+                // Nothing behind this job is due sooner, and nothing more fits
+                break;
+            }
+            if (Overdue)
+            {
+                if (SelectedCount == 0)
+                {
+                    // Too large for any frame, so it gets one to itself
+                    m_Jobs.Pop();
+                    Selected.push_back(pJob);
+                    UsedUsec += CostUsec;
+                    ++SelectedCount;
+                    ++m_Stats.JobsForced;
+                    m_Stats.JobsExecutedLate += (pJob->DeadlineFrame < CurrentFrame) ? 1 : 0;
+                }
+                break;
+            }
+            if (m_Deferred.size() == MaxDeferralsPerFrame)
+            {
+                break;
+            }
+            m_Jobs.Pop();
+            m_Deferred.push_back(pJob);
+            ++m_Stats.JobsDeferred;
+            continue;
+        }
+
+        m_Jobs.Pop();
+        Selected.push_back(pJob);
+        UsedUsec += CostUsec;
+        ++SelectedCount;
+        m_Stats.JobsExecutedLate += (pJob->DeadlineFrame < CurrentFrame) ? 1 : 0;
+    }
+
+    // Deferred jobs keep their keys, and with them their place in line
+    for (auto pJob : m_Deferred)
+    {
+        m_Jobs.Push(pJob, pJob->HeapKey);
+    }
+    m_Stats.JobsExecuted += SelectedCount;
+    return UsedUsec;
+}
+
+namespace
+{
+    struct TraceJob : public GpuScheduledJob
+    {
+        UINT32 SubmitFrame;
+        UINT32 ActualUsec;
+        UINT32 LatencyFrames;
+        INT32 CompletionFrame;
+    };
+
+    struct TraceResult
+    {
+        UINT32 CompletedJobs;
+        UINT32 LateJobs;
+        UINT32 OverBudgetFrames;
+        UINT32 FrameCount;
+        UINT32 WorstFrameUsec;
+        UINT32 MaxLatencyFrames;
+        DOUBLE TotalLatencyFrames;
+        DOUBLE ElapsedMsec;
+        bool ExecutedTwice;
+    };
+
+    bool LoadTrace(const std::wstring& TraceFileName, std::vector<TraceJob>& Jobs)
+    {
+        Utility::ByteArray Contents = Utility::ReadFileSync(TraceFileName);
+        if (Contents->empty())
+        {
+            return false;
+        }
+
+        std::string Text(Contents->begin(), Contents->end());
+        size_t LineStart = 0;
+        while (LineStart < Text.size())
+        {
+            size_t LineEnd = Text.find('\n', LineStart);
+            if (LineEnd == std::string::npos)
+            {
+                LineEnd = Text.size();
+            }
+            const std::string Line = Text.substr(LineStart, LineEnd - LineStart);
+            LineStart = LineEnd + 1;
+
+            UINT32 Frame, JobType, ActualUsec, EstimatedUsec = 0, LatencyFrames = GpuJobScheduler::DefaultLatencyFrames;
+            if (Line.empty() || Line[0] == '#' ||
+                sscanf_s(Line.c_str(), "%u %u %u %u %u", &Frame, &JobType, &ActualUsec, &EstimatedUsec, &LatencyFrames) < 3)
+            {
+                continue;
+            }
+
+            TraceJob Job = {};
+            Job.SubmitFrame = Frame;
+            Job.JobType = std::min(JobType, GpuJobCostModel::MaxJobTypes - 1);
+            Job.ActualUsec = ActualUsec;
+            Job.EstimatedGpuUsec = EstimatedUsec;
+            Job.LatencyFrames = LatencyFrames;
+            Jobs.push_back(Job);
+        }
+
+        std::stable_sort(Jobs.begin(), Jobs.end(), [](const TraceJob& A, const TraceJob& B) { return A.SubmitFrame < B.SubmitFrame; });
+        return !Jobs.empty();
+    }
+
+    // Terrain-like load: frequent small heightmap jobs, surface maps, cheap jobs whose
+    // estimate is far too high and an occasional bake larger than the frame budget.
+    void GenerateTrace(UINT32 FrameCount, std::vector<TraceJob>& Jobs)
+    {
+        struct JobTypeDesc { UINT32 Percent; UINT32 ActualUsec; UINT32 EstimatedUsec; UINT32 LatencyFrames; };
+        static const JobTypeDesc s_Types[] =
+        {
+            { 45,  300,  200, 4 },
+            { 25, 1200,  800, 6 },
+            { 28,   60,  500, 8 },
+            {  2, 9000, 6000, 30 },
+        };
+
+        UINT32 Seed = 1;
+        auto Random = [&Seed]() { Seed = Seed * 1664525 + 1013904223; return Seed >> 8; };
+
+        for (UINT32 Frame = 0; Frame < FrameCount; ++Frame)
+        {
+            // Bursts every few seconds, as when the camera crosses into a new terrain block
+            const UINT32 JobCount = (Frame % 120 < 10) ? 6 + Random() % 6 : Random() % 4;
+            for (UINT32 i = 0; i < JobCount; ++i)
+            {
+                UINT32 Roll = Random() % 100;
+                UINT32 JobType = 0;
+                while (Roll >= s_Types[JobType].Percent)
+                {
+                    Roll -= s_Types[JobType].Percent;
+                    ++JobType;
+                }
+
+                TraceJob Job = {};
+                Job.SubmitFrame = Frame;
+                Job.JobType = JobType;
+                Job.ActualUsec = s_Types[JobType].ActualUsec * (80 + Random() % 41) / 100;
+                Job.EstimatedGpuUsec = s_Types[JobType].EstimatedUsec;
+                Job.LatencyFrames = s_Types[JobType].LatencyFrames;
+                Jobs.push_back(Job);
+            }
+        }
+    }
+
+    // Runs the trace until every job completes or the queue stops making progress.  Policy 0
+    // is the old FIFO, which stops at the first job that does not fit its static estimate.
+    TraceResult ReplayTrace(std::vector<TraceJob>& Jobs, UINT32 Policy, UINT32 BudgetUsec)
+    {
+        TraceResult Result = {};
+        GpuJobScheduler Scheduler;
+        std::deque<TraceJob*> FifoQueue;
+        std::vector<GpuScheduledJob*> Selected;
+
+        for (auto& Job : Jobs)
+        {
+            Job.HeapIndex = 0;
+            Job.CompletionFrame = -1;
+        }
+
+        const UINT32 LastSubmitFrame = Jobs.empty() ? 0 : Jobs.back().SubmitFrame;
+        // Enough for the scheduler to drain at one forced job per frame
+        const UINT32 MaxDrainFrames = std::max((UINT32)Jobs.size(), 1000U);
+        size_t NextJob = 0;
+
+        const INT64 StartTick = SystemTime::GetCurrentTick();
+        UINT32 Frame = 0;
+        for (; Frame <= LastSubmitFrame + MaxDrainFrames; ++Frame)
+        {
+            for (; NextJob < Jobs.size() && Jobs[NextJob].SubmitFrame <= Frame; ++NextJob)
+            {
+                if (Policy == 0)
+                {
+                    FifoQueue.push_back(&Jobs[NextJob]);
+                }
+                else
+                {
+                    Scheduler.Submit(&Jobs[NextJob], Frame, Jobs[NextJob].LatencyFrames);
+                }
+            }
+            if (NextJob == Jobs.size() && FifoQueue.empty() && Scheduler.IsEmpty())
+            {
+                break;
+            }
+
+            Selected.clear();
+            if (Policy == 0)
+            {
+                UINT32 RemainingUsec = BudgetUsec;
+                while (!FifoQueue.empty() && FifoQueue.front()->EstimatedGpuUsec <= RemainingUsec)
+                {
+                    RemainingUsec -= FifoQueue.front()->EstimatedGpuUsec;
+                    Selected.push_back(FifoQueue.front());
+                    FifoQueue.pop_front();
+                }
+            }
+            else
+            {
+                Scheduler.SelectJobs(Frame, BudgetUsec, Selected);
+            }
+
+            // The simulated GPU runs each job at its actual cost and reports it back
+            UINT32 FrameUsec = 0;
+            for (auto pSelected : Selected)
+            {
+                TraceJob* pJob = static_cast<TraceJob*>(pSelected);
+                Result.ExecutedTwice = Result.ExecutedTwice || pJob->CompletionFrame >= 0;
+                pJob->CompletionFrame = Frame;
+                FrameUsec += pJob->ActualUsec;
+                Scheduler.GetCostModel().RecordMeasurement(pJob->JobType, (FLOAT)pJob->ActualUsec);
+
+                const UINT32 Latency = Frame - pJob->SubmitFrame;
+                ++Result.CompletedJobs;
+                Result.LateJobs += (Latency > pJob->LatencyFrames) ? 1 : 0;
+                Result.TotalLatencyFrames += Latency;
+                Result.MaxLatencyFrames = std::max(Result.MaxLatencyFrames, Latency);
+            }
+            Result.OverBudgetFrames += (FrameUsec > BudgetUsec) ? 1 : 0;
+            Result.WorstFrameUsec = std::max(Result.WorstFrameUsec, FrameUsec);
+        }
+        Result.ElapsedMsec = SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - StartTick);
+        Result.FrameCount = Frame;
+        return Result;
+    }
+
+    // Random pushes, re-keys and removals checked against a sorted reference
+    bool ValidateHeap(UINT32 OperationCount)
+    {
+        const UINT32 NodeCount = 1024;
+        std::vector<GpuJobHeapNode> Nodes(NodeCount);
+        ZeroMemory(Nodes.data(), NodeCount * sizeof(GpuJobHeapNode));
+        std::set<std::pair<UINT64, GpuJobHeapNode*>> Reference;
+        GpuJobHeap Heap;
+
+        UINT32 Seed = 7;
+        auto Random = [&Seed]() { Seed = Seed * 1664525 + 1013904223; return Seed >> 8; };
+
+        bool Valid = true;
+        for (UINT32 i = 0; i < OperationCount && Valid; ++i)
+        {
+            GpuJobHeapNode* pNode = &Nodes[Random() % NodeCount];
+            const UINT64 Key = Random() % 4096;
+            switch (Random() % 4)
+            {
+            case 0:
+            case 1:
+                if (pNode->IsQueued())
+                {
+                    Reference.erase(std::make_pair(pNode->HeapKey, pNode));
+                    Heap.Update(pNode, Key);
+                }
+                else
+                {
+                    Heap.Push(pNode, Key);
+                }
+                Reference.insert(std::make_pair(Key, pNode));
+                break;
+            case 2:
+                if (pNode->IsQueued())
+                {
+                    Reference.erase(std::make_pair(pNode->HeapKey, pNode));
+                    Heap.Remove(pNode);
+                }
+                break;
+            default:
+                if (!Heap.IsEmpty())
+                {
+                    GpuJobHeapNode* pTop = Heap.Pop();
+                    Valid = pTop->HeapKey == Reference.begin()->first && !pTop->IsQueued();
+                    Reference.erase(std::make_pair(pTop->HeapKey, pTop));
+                }
+                break;
+            }
+            Valid = Valid && Heap.GetSize() == (UINT32)Reference.size() &&
+                (Heap.IsEmpty() || Heap.Top()->HeapKey == Reference.begin()->first);
+        }
+
+        UINT64 PreviousKey = 0;
+        while (Valid && !Heap.IsEmpty())
+        {
+            GpuJobHeapNode* pTop = Heap.Pop();
+            Valid = pTop->HeapKey >= PreviousKey;
+            PreviousKey = pTop->HeapKey;
+        }
+        return Valid;
+    }
+}
+
+bool GpuJobScheduler::Benchmark(const std::wstring& TraceFileName, UINT32 BudgetUsec)
+{
+    std::vector<TraceJob> Jobs;
+    const bool FromFile = !TraceFileName.empty();
+    if (FromFile)
+    {
+        if (!LoadTrace(TraceFileName, Jobs))
+        {
+            Utility::Printf("Could not read a job trace from %ls\n", TraceFileName.c_str());
+            return false;
+        }
+    }
+    else
+    {
+        GenerateTrace(3600, Jobs);
+    }
+
+    TraceResult Results[2];
+    for (UINT32 Policy = 0; Policy < 2; ++Policy)
+    {
+        Results[Policy] = ReplayTrace(Jobs, Policy, BudgetUsec);
+    }
+
+    const UINT32 JobCount = (UINT32)Jobs.size();
+    const bool HeapValid = ValidateHeap(200000);
+    const bool Valid = HeapValid && !Results[1].ExecutedTwice && !Results[0].ExecutedTwice &&
+        Results[1].CompletedJobs == JobCount;
+
+    Utility::PrintfConsole("GPU job scheduler benchmark: %u jobs from %s, %u usec budget per frame\n",
+        JobCount, FromFile ? "trace file" : "synthetic trace", BudgetUsec);
+    static const char* s_PolicyNames[2] = { "FIFO", "Deadline scheduler" };
+    for (UINT32 Policy = 0; Policy < 2; ++Policy)
+    {
+        const TraceResult& Result = Results[Policy];
+        Utility::PrintfConsole("  %-20s %6u/%u jobs in %5u frames, %5u late, latency %5.1f avg %4u max frames, %4u frames over budget (worst %6u usec), %7.3f ms\n",
+            s_PolicyNames[Policy], Result.CompletedJobs, JobCount, Result.FrameCount, Result.LateJobs,
+            Result.TotalLatencyFrames / std::max(Result.CompletedJobs, 1U), Result.MaxLatencyFrames,
+            Result.OverBudgetFrames, Result.WorstFrameUsec, Result.ElapsedMsec);
+    }
+    Utility::PrintfConsole("  Heap check:          %s\n", HeapValid ? "passed" : "FAILED");
+
+    return Valid;
+}
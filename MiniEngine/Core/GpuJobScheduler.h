@@ -0,0 +1,126 @@
+#pragma once
+
+#include <vector>
+
+// Embedded in anything kept in a GpuJobHeap.  HeapIndex is 1-based so that zeroed
+// memory reads as "not queued".
+struct GpuJobHeapNode
+{
+    UINT64 HeapKey;
+    UINT32 HeapIndex;
+
+    bool IsQueued() const { return HeapIndex != 0; }
+};
+
+// Binary min-heap of intrusive nodes.  Each node knows its own position, so a node can
+// be re-keyed or removed in O(log n) instead of searching and re-sorting the queue.
+class GpuJobHeap
+{
+private:
+    std::vector<GpuJobHeapNode*> m_Nodes;
+
+public:
+    bool IsEmpty() const { return m_Nodes.empty(); }
+    UINT32 GetSize() const { return (UINT32)m_Nodes.size(); }
+    GpuJobHeapNode* Top() const { return m_Nodes.empty() ? nullptr : m_Nodes[0]; }
+
+    void Push(GpuJobHeapNode* pNode, UINT64 Key);
+    GpuJobHeapNode* Pop();
+    void Update(GpuJobHeapNode* pNode, UINT64 Key);
+    void Remove(GpuJobHeapNode* pNode);
+    void Clear();
+
+private:
+    void SiftUp(UINT32 Position);
+    void SiftDown(UINT32 Position);
+    void Place(UINT32 Position, GpuJobHeapNode* pNode);
+};
+
+// Per job type GPU cost, learned from measured durations.  Until a type has been measured
+// the estimate given with the job is used.
+class GpuJobCostModel
+{
+public:
+    static const UINT32 MaxJobTypes = 16;
+    static const UINT32 DefaultEstimateUsec = 500;
+
+private:
+    struct JobTypeCost
+    {
+        FLOAT AverageUsec;
+        FLOAT PeakUsec;
+        UINT32 SampleCount;
+    };
+    JobTypeCost m_Costs[MaxJobTypes];
+
+public:
+    GpuJobCostModel() { Reset(); }
+
+    UINT32 GetEstimate(UINT32 JobType, UINT32 FallbackUsec) const;
+    void RecordMeasurement(UINT32 JobType, FLOAT Usec);
+    UINT32 GetSampleCount(UINT32 JobType) const { return m_Costs[JobType].SampleCount; }
+    void Reset();
+};
+
+// The scheduling half of a GPU job; GraphicsJob derives from this.
+struct GpuScheduledJob : public GpuJobHeapNode
+{
+    UINT32 EstimatedGpuUsec;
+    UINT32 JobType;
+    UINT64 DeadlineFrame;
+};
+
+struct GpuJobSchedulerStats
+{
+    UINT64 JobsSubmitted;
+    UINT64 JobsExecuted;
+    UINT64 JobsDeferred;
+    UINT64 JobsForced;
+    UINT64 JobsExecutedLate;
+};
+
+// Orders submitted jobs by deadline, then by submission, and each frame packs as many as
+// the GPU budget allows.  A job that does not fit is passed over for smaller ones behind
+// it until its deadline passes; an overdue job that does not fit stops packing so it
+// leads the next frame, where it runs alone even if it is larger than the whole budget.
+// Overdue jobs run in deadline order at one or more per frame, so none waits forever.
+//
+// Not thread safe; GpuJobQueue serializes access.
+class GpuJobScheduler
+{
+public:
+    static const UINT32 DefaultLatencyFrames = 4;
+
+    // Bounds the work spent looking past jobs that do not fit
+    static const UINT32 MaxDeferralsPerFrame = 64;
+
+private:
+    GpuJobHeap m_Jobs;
+    GpuJobCostModel m_CostModel;
+    std::vector<GpuScheduledJob*> m_Deferred;
+    UINT64 m_Sequence;
+    GpuJobSchedulerStats m_Stats;
+
+public:
+    GpuJobScheduler();
+
+    void Submit(GpuScheduledJob* pJob, UINT64 CurrentFrame, UINT32 LatencyFrames = DefaultLatencyFrames);
+    void Remove(GpuScheduledJob* pJob) { if (pJob->IsQueued()) m_Jobs.Remove(pJob); }
+    GpuScheduledJob* RemoveNext() { return static_cast<GpuScheduledJob*>(m_Jobs.Pop()); }
+    bool IsEmpty() const { return m_Jobs.IsEmpty(); }
+    UINT32 GetQueuedCount() const { return m_Jobs.GetSize(); }
+
+    // Removes the jobs to run this frame from the queue and appends them to Selected in the
+    // order they should run.  Returns the estimated GPU time of the selection.
+    UINT32 SelectJobs(UINT64 CurrentFrame, UINT32 BudgetUsec, std::vector<GpuScheduledJob*>& Selected);
+
+    UINT32 GetEstimate(const GpuScheduledJob* pJob) const { return m_CostModel.GetEstimate(pJob->JobType, pJob->EstimatedGpuUsec); }
+    GpuJobCostModel& GetCostModel() { return m_CostModel; }
+    const GpuJobSchedulerStats& GetStats() const { return m_Stats; }
+
+    // Replays a job trace through the FIFO queue GpuJobQueue used to have and through this
+    // scheduler on a simulated GPU, reporting frame overruns and job latency, and checks the
+    // heap against a sorted reference.  Trace lines are "frame type actualUsec
+    // [estimatedUsec [latencyFrames]]"; without a trace file a synthetic one is generated.
+    static bool Benchmark(const std::wstring& TraceFileName, UINT32 BudgetUsec);
+};
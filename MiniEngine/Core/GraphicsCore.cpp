@@ -21,11 +21,13 @@
 #include "TextRenderer.h"
 #include "ColorBuffer.h"
 #include "SystemTime.h"
+#include "LatencyHistogram.h"
 #include "SamplerManager.h"
 #include "DescriptorHeap.h"
 #include "CommandContext.h"
 #include "CommandListManager.h"
 #include "RootSignature.h"
+#include "PipelineStateCache.h"
 #include "CommandSignature.h"
 #include "ParticleEffectManager.h"
 #include "GraphRenderer.h"
@@ -83,6 +85,7 @@ namespace
 	float s_FrameTime = 0.0f;
 	uint64_t s_FrameIndex = 0;
 	int64_t s_FrameStartTick = 0;
+	LatencyHistogram s_FrameTimeHistogram("FrameTime");
     int64_t s_StartAppTick = 0;
 
 	BoolVar s_EnableVSync("Timing/VSync", true);
@@ -177,10 +180,10 @@ namespace Graphics
 
 	DescriptorAllocator g_DescriptorAllocator[D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES] =
 	{
-		D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV,
-		D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER,
-		D3D12_DESCRIPTOR_HEAP_TYPE_RTV,
-		D3D12_DESCRIPTOR_HEAP_TYPE_DSV,
+		{ D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV },
+		{ D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER },
+		{ D3D12_DESCRIPTOR_HEAP_TYPE_RTV },
+		{ D3D12_DESCRIPTOR_HEAP_TYPE_DSV },
 	};
 
 	SamplerDesc SamplerLinearWrapDesc;
@@ -469,6 +472,26 @@ void Graphics::Initialize(void)
 		}
 	}
 
+	// Cached pipeline blobs are tied to the adapter and driver that produced them
+	{
+		PipelineCacheAdapterIdentity Identity = {};
+		Microsoft::WRL::ComPtr<IDXGIAdapter1> pDeviceAdapter;
+		if (SUCCEEDED(dxgiFactory->EnumAdapterByLuid(g_Device->GetAdapterLuid(), MY_IID_PPV_ARGS(&pDeviceAdapter))))
+		{
+			DXGI_ADAPTER_DESC1 desc;
+			pDeviceAdapter->GetDesc1(&desc);
+			Identity.VendorId = desc.VendorId;
+			Identity.DeviceId = desc.DeviceId;
+			Identity.SubSysId = desc.SubSysId;
+			Identity.Revision = desc.Revision;
+
+			LARGE_INTEGER UMDVersion = {};
+			if (SUCCEEDED(pDeviceAdapter->CheckInterfaceSupport(__uuidof(IDXGIDevice), &UMDVersion)))
+				Identity.DriverVersion = UMDVersion.QuadPart;
+		}
+		g_PipelineStateCache.Initialize(L"PipelineStateCache.bin", Identity);
+	}
+
 	g_CommandManager.Create(g_Device);
 
 	DXGI_SWAP_CHAIN_DESC1 swapChainDesc = {};
@@ -699,6 +722,8 @@ void Graphics::Initialize(void)
 	ParticleEffects::Initialize(kMaxNativeWidth, kMaxNativeHeight);
     LineRender::Initialize();
 	g_LODModelManager.Initialize();
+
+	g_PipelineStateCache.PrintStats("startup");
 }
 
 void Graphics::Terminate( void )
@@ -711,25 +736,42 @@ void Graphics::Terminate( void )
 
 void Graphics::Shutdown( void )
 {
+	// Texture readers upload through command contexts, so they stop first
+	TextureManager::Shutdown();
 	CommandContext::DestroyAllContexts();
 	g_CommandManager.Shutdown();
 	GpuTimeManager::Shutdown();
 	s_SwapChain1->Release();
+	PSO::PrintCompileStatistics();
 	PSO::DestroyAll();
+	g_PipelineStateCache.PrintStats("shutdown");
+	g_PipelineStateCache.Terminate();
 	RootSignature::DestroyAll();
 
 	DispatchIndirectCommandSignature.Destroy();
 	DrawIndirectCommandSignature.Destroy();
     DrawIndexedIndirectCommandSignature.Destroy();
+
+	static const char* s_DescriptorTypeNames[D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES] = { "CBV/SRV/UAV", "Sampler", "RTV", "DSV" };
+	for (uint32_t i = 0; i < D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES; ++i)
+	{
+		const DescriptorRangeStats Stats = g_DescriptorAllocator[i].GetStats();
+		Utility::Printf("Descriptors (%s): %u live (peak %u), %u pending, %u free in %u heaps, fragmentation %0.2f\n",
+			s_DescriptorTypeNames[i], Stats.LiveDescriptors - g_DescriptorAllocator[i].GetCachedDescriptorCount(), Stats.PeakLiveDescriptors,
+			Stats.PendingDescriptors, Stats.FreeDescriptors, Stats.HeapCount, Stats.GetFragmentation());
+	}
 	DescriptorAllocator::DestroyAll();
 
+	const DescriptorTableReuseStats ReuseStats = DynamicDescriptorHeap::GetReuseStatistics();
+	Utility::Printf("Descriptor tables: %llu copied, %llu reused (%llu descriptor copies avoided) in %llu CopyDescriptors calls\n",
+		ReuseStats.TablesCopied, ReuseStats.TablesReused, ReuseStats.DescriptorsReused, ReuseStats.CopyCalls);
+
 	DestroyRenderingBuffers();
 	PostEffects::Shutdown();
 	SSAO::Shutdown();
 	TextRenderer::Shutdown();
 	GraphRenderer::Shutdown();
 	ParticleEffects::Shutdown();
-	TextureManager::Shutdown();
     LineRender::Terminate();
 	g_LODModelManager.Terminate();
 
@@ -898,6 +940,10 @@ void Graphics::Present(void)
 
 	int64_t CurrentTick = SystemTime::GetCurrentTick();
 
+	// The measured frame time, whatever time step VSync gives the simulation
+	if (s_FrameStartTick != 0)
+		s_FrameTimeHistogram.RecordTicks(CurrentTick - s_FrameStartTick);
+
 	if (s_EnableVSync)
 	{
 		// With VSync enabled, the time step between frames becomes a multiple of 16.666 ms.  We need
@@ -922,6 +968,9 @@ void Graphics::Present(void)
 
 	++s_FrameIndex;
 
+	// Every context of this frame has been recorded, so streamed texture views can be written
+	TextureManager::Update();
+
 	SetNativeResolution();
 }
 
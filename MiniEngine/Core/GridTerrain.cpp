@@ -91,55 +91,7 @@ void GridBlock::BuildGeometry(const GridTerrainConfig* pConfig)
     //assert(m_pFeaturesBlock->CanMakeTerrain());
     //assert(m_pFeaturesBlock->GetConfig() == pConfig);
 
-    const bool PhysicsOnly = (pConfig->pPhysicsWorld != nullptr);
-
-    if (m_pHeightmapJob == nullptr)
-    {
-        GridBlockCoord HeightmapCoord;
-        if (m_Coord.SizeShift < pConfig->SmallHeightmapShift)
-        {
-            HeightmapCoord.InitializeWithShift(m_Coord, pConfig->SmallHeightmapShift);
-        }
-        else if (m_Coord.SizeShift < pConfig->MedHeightmapShift)
-        {
-            HeightmapCoord.InitializeWithShift(m_Coord, pConfig->MedHeightmapShift);
-        }
-        else
-        {
-            assert(m_Coord.SizeShift <= pConfig->LargeHeightmapShift);
-            HeightmapCoord.InitializeWithShift(m_Coord, pConfig->LargeHeightmapShift);
-        }
-        TerrainGraphicsHeightmapParams Params = {};
-        Params.ViewCoord = HeightmapCoord;
-        Params.pConfig = pConfig;
-        Params.GenerateMaterialMap = !PhysicsOnly;
-        m_pHeightmapJob = g_GridTerrainJobs.CreateTextureHeightmapJob(Params);
-    }
-    if (PhysicsOnly && m_pPhysicsHeightmapJob == nullptr)
-    {
-        TerrainPhysicsHeightmapParams Params = {};
-        assert(pConfig->SmallestBlockShift == pConfig->LargestBlockShift);
-        Params.ViewCoord.InitializeWithShift(m_Coord, pConfig->SmallestBlockShift);
-        Params.pConfig = pConfig;
-        Params.pGraphicsHeightmapJob = m_pHeightmapJob;
-        m_pPhysicsHeightmapJob = g_GridTerrainJobs.CreatePhysicsHeightmapJob(Params);
-    }
-    if (!PhysicsOnly && m_pSurfacemapJob == nullptr)
-    {
-        TerrainSurfacemapParams Params = {};
-        if (m_Coord.SizeShift <= pConfig->SmallSurfacemapShift)
-        {
-            Params.ViewCoord.InitializeWithShift(m_Coord, pConfig->SmallSurfacemapShift);
-        }
-        else
-        {
-            assert(m_Coord.SizeShift <= pConfig->LargeSurfacemapShift);
-            Params.ViewCoord.InitializeWithShift(m_Coord, pConfig->LargeSurfacemapShift);
-        }
-        Params.pConfig = pConfig;
-        Params.pGraphicsHeightmapJob = m_pHeightmapJob;
-        m_pSurfacemapJob = g_GridTerrainJobs.CreateTextureSurfacemapJob(Params);
-    }
+    CreateGpuJobs(pConfig);
 
     /*
     const INT32 GridVertexEdgeCount = pConfig->GetBlockVertexCount();
@@ -377,6 +329,82 @@ void GridBlock::BuildGeometry(const GridTerrainConfig* pConfig)
     */
 }    
 
+void GridBlock::CreateGpuJobs(const GridTerrainConfig* pConfig)
+{
+    const bool PhysicsOnly = (pConfig->pPhysicsWorld != nullptr);
+
+    if (m_pHeightmapJob == nullptr)
+    {
+        GridBlockCoord HeightmapCoord;
+        if (m_Coord.SizeShift < pConfig->SmallHeightmapShift)
+        {
+            HeightmapCoord.InitializeWithShift(m_Coord, pConfig->SmallHeightmapShift);
+        }
+        else if (m_Coord.SizeShift < pConfig->MedHeightmapShift)
+        {
+            HeightmapCoord.InitializeWithShift(m_Coord, pConfig->MedHeightmapShift);
+        }
+        else
+        {
+            assert(m_Coord.SizeShift <= pConfig->LargeHeightmapShift);
+            HeightmapCoord.InitializeWithShift(m_Coord, pConfig->LargeHeightmapShift);
+        }
+        TerrainGraphicsHeightmapParams Params = {};
+        Params.ViewCoord = HeightmapCoord;
+        Params.pConfig = pConfig;
+        Params.GenerateMaterialMap = !PhysicsOnly;
+        m_pHeightmapJob = g_GridTerrainJobs.CreateTextureHeightmapJob(Params);
+    }
+    if (PhysicsOnly && m_pPhysicsHeightmapJob == nullptr)
+    {
+        TerrainPhysicsHeightmapParams Params = {};
+        assert(pConfig->SmallestBlockShift == pConfig->LargestBlockShift);
+        Params.ViewCoord.InitializeWithShift(m_Coord, pConfig->SmallestBlockShift);
+        Params.pConfig = pConfig;
+        Params.pGraphicsHeightmapJob = m_pHeightmapJob;
+        m_pPhysicsHeightmapJob = g_GridTerrainJobs.CreatePhysicsHeightmapJob(Params);
+    }
+    if (!PhysicsOnly && m_pSurfacemapJob == nullptr)
+    {
+        TerrainSurfacemapParams Params = {};
+        if (m_Coord.SizeShift <= pConfig->SmallSurfacemapShift)
+        {
+            Params.ViewCoord.InitializeWithShift(m_Coord, pConfig->SmallSurfacemapShift);
+        }
+        else
+        {
+            assert(m_Coord.SizeShift <= pConfig->LargeSurfacemapShift);
+            Params.ViewCoord.InitializeWithShift(m_Coord, pConfig->LargeSurfacemapShift);
+        }
+        Params.pConfig = pConfig;
+        Params.pGraphicsHeightmapJob = m_pHeightmapJob;
+        m_pSurfacemapJob = g_GridTerrainJobs.CreateTextureSurfacemapJob(Params);
+    }
+}
+
+void GridBlock::ReplaceEvictedGpuJobs()
+{
+    // The command list of a finished job is gone, so evicted output cannot be paged back in;
+    // drop the job and create a new one for the same coordinates
+    bool Evicted = false;
+    if (m_pHeightmapJob != nullptr && m_pHeightmapJob->OutputResources.IsUnmapped())
+    {
+        m_pHeightmapJob->Release();
+        m_pHeightmapJob = nullptr;
+        Evicted = true;
+    }
+    if (m_pSurfacemapJob != nullptr && m_pSurfacemapJob->OutputResources.IsUnmapped())
+    {
+        m_pSurfacemapJob->Release();
+        m_pSurfacemapJob = nullptr;
+        Evicted = true;
+    }
+    if (Evicted)
+    {
+        CreateGpuJobs(m_pConfig);
+    }
+}
+
 void GridBlock::CheckGpuJobs()
 {
     assert(m_State == Initializing);
@@ -1868,6 +1896,7 @@ UINT32 GridTerrain::TestGridBlock(const GridBlockCoord& Coord,
     XMVECTOR ViewBlockPos = XMVector3TransformCoord(SyntheticBlockPos, GTU.matVP);
     const FLOAT Width = XMVectorGetX(ViewBlockPos);
 
+    pBlock->ReplaceEvictedGpuJobs();
     if (pBlock->m_pHeightmapJob != nullptr)
     {
         pBlock->m_pHeightmapJob->MostRecentViewWidth = Width;
@@ -439,6 +439,8 @@ private:
         return 0;
     }
     void BuildGeometry(const GridTerrainConfig* pConfig);
+    void CreateGpuJobs(const GridTerrainConfig* pConfig);
+    void ReplaceEvictedGpuJobs();
     void AddDecorationSet(const DecorationSet& DSet);
     void BuildDetailGeometry(const GridTerrainConfig* pConfig);
     void SetDecorationLOD(FLOAT MinDistance, FLOAT MaxDistance, FLOAT Blend = 0.25f);
@@ -72,6 +72,7 @@ void TerrainGpuJob::UpdateSortKey()
         SortKey *= std::max(0.0f, MostRecentViewWidth);
     }
     OutputResources.PositiveWeight = SortKey;
+    g_GpuJobQueue.UpdatePagingEntry(&OutputResources);
 }
 
 GridTerrainJobs::GridTerrainJobs()
@@ -151,7 +152,9 @@ TerrainGpuJob* GridTerrainJobs::FindJob(UINT64 Key, TerrainGpuJobMap& JobMap)
     TerrainGpuJob* pResult = nullptr;
     EnterCriticalSection(&m_JobCritSec);
     auto iter = JobMap.find(Key);
-    if (iter != JobMap.end())
+    // A job whose tiles were evicted is replaced by a new one; it stays alive for whoever
+    // still references it
+    if (iter != JobMap.end() && !iter->second->OutputResources.IsUnmapped())
     {
         pResult = iter->second;
     }
@@ -179,8 +182,10 @@ void GridTerrainJobs::DeleteJob(TerrainGpuJob* pJob)
     assert(pMap == &m_TextureHeightmaps || pMap == &m_PhysicsHeightmaps || pMap == &m_TextureSurfacemaps);
     EnterCriticalSection(&m_JobCritSec);
     auto iter = pMap->find(pJob->ViewCoord.Value);
-    assert(iter != pMap->end() && iter->second == pJob);
-    pMap->erase(iter);
+    if (iter != pMap->end() && iter->second == pJob)
+    {
+        pMap->erase(iter);
+    }
     LeaveCriticalSection(&m_JobCritSec);
 }
 
@@ -243,7 +248,7 @@ TerrainGpuJob* GridTerrainJobs::CreateTextureHeightmapJob(const TerrainGraphicsH
         pJob->OutputResources.TiledTexture[1].Create(strID, WidthHeight, WidthHeight, 1, 1, DXGI_FORMAT_R8G8_UNORM);
     }
 
-    pJob->OutputResources.pGraphicsJob = g_GpuJobQueue.CreateGraphicsJob(strID);
+    pJob->OutputResources.pGraphicsJob = g_GpuJobQueue.CreateGraphicsJob(strID, TerrainJob_Heightmap);
     GraphicsContext* pContext = pJob->OutputResources.pGraphicsJob->pContext;
 
     pContext->ExplicitTransitionResource(m_HeightmapRT, D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_RENDER_TARGET, true);
@@ -300,7 +305,7 @@ TerrainGpuJob* GridTerrainJobs::CreateTextureSurfacemapJob(const TerrainSurfacem
     pJob->OutputResources.TiledTexture[0].Create(L"Terrain Diffuse Map", WidthHeight, WidthHeight, 1, 1, DXGI_FORMAT_R10G10B10A2_UNORM);
     pJob->OutputResources.TiledTexture[1].Create(L"Terrain Normal Map", WidthHeight, WidthHeight, 1, 1, DXGI_FORMAT_R10G10B10A2_UNORM);
 
-    pJob->OutputResources.pGraphicsJob = g_GpuJobQueue.CreateGraphicsJob(strID);
+    pJob->OutputResources.pGraphicsJob = g_GpuJobQueue.CreateGraphicsJob(strID, TerrainJob_Surfacemap);
     GraphicsContext* pContext = pJob->OutputResources.pGraphicsJob->pContext;
 
     pContext->TransitionResource(m_SurfaceDiffuseRT, D3D12_RESOURCE_STATE_RENDER_TARGET);
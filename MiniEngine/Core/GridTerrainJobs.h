@@ -6,6 +6,13 @@
 #include "ColorBuffer.h"
 #include "TiledResources.h"
 
+// GpuJobQueue job types, each with its own learned GPU cost
+enum TerrainGpuJobType
+{
+    TerrainJob_Heightmap = 1,
+    TerrainJob_Surfacemap = 2,
+};
+
 struct TerrainGpuJob;
 typedef std::unordered_map<UINT64, TerrainGpuJob*> TerrainGpuJobMap;
 
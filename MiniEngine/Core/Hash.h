@@ -63,4 +63,17 @@ namespace Utility
 		return HashRange((uint32_t*)StateDesc, (uint32_t*)(StateDesc + Count), Hash);
 	}
 
+	// 64-bit FNV-1a over arbitrary bytes.  Slower than HashState, but stable across
+	// processes and wide enough to key persistent caches.
+	inline uint64_t HashBytes64( const void* Data, size_t SizeBytes, uint64_t Hash = 0xcbf29ce484222325ULL )
+	{
+		const uint8_t* Bytes = (const uint8_t*)Data;
+		for (size_t i = 0; i < SizeBytes; ++i)
+		{
+			Hash ^= Bytes[i];
+			Hash *= 0x100000001b3ULL;
+		}
+		return Hash;
+	}
+
 } // namespace Utility
\ No newline at end of file
@@ -0,0 +1,343 @@
+#include "pch.h"
+#include "LatencyHistogram.h"
+#include <algorithm>
+#include <random>
+#include <thread>
+
+namespace
+{
+    class LatencyHistogramRegistry
+    {
+    public:
+        LatencyHistogramRegistry()
+            : m_LogFileName(L"LatencyLog.jsonl"),
+              m_LogIntervalSeconds(LatencyHistogram::DefaultLogIntervalSeconds),
+              m_StartTick(0),
+              m_NextLogTick(0)
+        {
+            InitializeCriticalSection(&m_CritSec);
+        }
+
+        void Register(LatencyHistogram* pHistogram)
+        {
+            EnterCriticalSection(&m_CritSec);
+            m_Histograms.push_back(pHistogram);
+            LeaveCriticalSection(&m_CritSec);
+        }
+
+        void Lock() { EnterCriticalSection(&m_CritSec); }
+        void Unlock() { LeaveCriticalSection(&m_CritSec); }
+
+        std::vector<LatencyHistogram*> m_Histograms;
+        std::wstring m_LogFileName;
+        UINT32 m_LogIntervalSeconds;
+        INT64 m_StartTick;
+        INT64 m_NextLogTick;
+
+    private:
+        CRITICAL_SECTION m_CritSec;
+    };
+
+    // Histograms are globals, so the registry must exist before any of them is constructed
+    LatencyHistogramRegistry& GetRegistry()
+    {
+        static LatencyHistogramRegistry s_Registry;
+        return s_Registry;
+    }
+
+    INT64 GetLogIntervalTicks(UINT32 Seconds)
+    {
+        return (INT64)(Seconds / SystemTime::TicksToSeconds(1));
+    }
+
+    void WriteSnapshot(FILE* pFile, const CHAR* strBuild, DOUBLE UptimeSeconds, const CHAR* strName, const CHAR* strWindow, const LatencyHistogramSnapshot& Snapshot)
+    {
+        fprintf(pFile, "{\"build\":\"%s\",\"uptime_s\":%.1f,\"histogram\":\"%s\",\"window\":\"%s\",\"count\":%llu,\"mean_us\":%.1f,"
+            "\"p50_us\":%llu,\"p90_us\":%llu,\"p99_us\":%llu,\"p999_us\":%llu,\"max_us\":%llu}\n",
+            strBuild, UptimeSeconds, strName, strWindow, Snapshot.TotalCount, Snapshot.GetMeanUsec(),
+            Snapshot.GetPercentileUsec(50.0), Snapshot.GetPercentileUsec(90.0), Snapshot.GetPercentileUsec(99.0),
+            Snapshot.GetPercentileUsec(99.9), Snapshot.MaxUsec);
+    }
+}
+
+LatencyHistogramSnapshot::LatencyHistogramSnapshot()
+    : Counts(LatencyHistogram::BucketCount, 0),
+      TotalCount(0),
+      SumUsec(0),
+      MaxUsec(0)
+{
+}
+
+void LatencyHistogramSnapshot::Clear()
+{
+    std::fill(Counts.begin(), Counts.end(), 0);
+    TotalCount = 0;
+    SumUsec = 0;
+    MaxUsec = 0;
+}
+
+void LatencyHistogramSnapshot::Add(const LatencyHistogramSnapshot& Other)
+{
+    for (UINT32 i = 0; i < LatencyHistogram::BucketCount; ++i)
+    {
+        Counts[i] += Other.Counts[i];
+    }
+    TotalCount += Other.TotalCount;
+    SumUsec += Other.SumUsec;
+    MaxUsec = std::max(MaxUsec, Other.MaxUsec);
+}
+
+UINT64 LatencyHistogramSnapshot::GetPercentileUsec(DOUBLE Percentile) const
+{
+    if (TotalCount == 0)
+    {
+        return 0;
+    }
+
+    const DOUBLE Fraction = std::min(std::max(Percentile, 0.0), 100.0) / 100.0;
+    const UINT64 Rank = std::max((UINT64)1, (UINT64)ceil(Fraction * (DOUBLE)TotalCount));
+    UINT64 Seen = 0;
+    for (UINT32 i = 0; i < LatencyHistogram::BucketCount; ++i)
+    {
+        Seen += Counts[i];
+        if (Seen >= Rank)
+        {
+            return std::min(LatencyHistogram::GetBucketLimit(i), MaxUsec);
+        }
+    }
+    return MaxUsec;
+}
+
+LatencyHistogram::LatencyHistogram(const CHAR* strName)
+    : m_strName(strName),
+      m_SumUsec(0),
+      m_MaxUsec(0)
+{
+    for (UINT32 i = 0; i < BucketCount; ++i)
+    {
+        m_Counts[i].store(0, std::memory_order_relaxed);
+    }
+    GetRegistry().Register(this);
+}
+
+UINT32 LatencyHistogram::GetBucketIndex(UINT64 Usec)
+{
+    const UINT32 SubBucketCount = 1 << SubBucketBits;
+    if (Usec < SubBucketCount)
+    {
+        return (UINT32)Usec;
+    }
+
+    Usec = std::min(Usec, ((UINT64)1 << MaxValueBits) - 1);
+    unsigned long HighBit;
+    _BitScanReverse64(&HighBit, Usec);
+
+    // Values from 2^HighBit up to the next power of two share SubBucketCount / 2 buckets
+    const UINT32 Shift = HighBit - (SubBucketBits - 1);
+    const UINT32 SubBucket = (UINT32)(Usec >> Shift) - SubBucketCount / 2;
+    return SubBucketCount + (Shift - 1) * (SubBucketCount / 2) + SubBucket;
+}
+
+UINT64 LatencyHistogram::GetBucketLimit(UINT32 BucketIndex)
+{
+    const UINT32 SubBucketCount = 1 << SubBucketBits;
+    if (BucketIndex < SubBucketCount)
+    {
+        return BucketIndex;
+    }
+
+    const UINT32 Offset = BucketIndex - SubBucketCount;
+    const UINT32 Shift = Offset / (SubBucketCount / 2) + 1;
+    const UINT64 SubBucket = Offset % (SubBucketCount / 2) + SubBucketCount / 2;
+    return ((SubBucket + 1) << Shift) - 1;
+}
+
+void LatencyHistogram::Record(UINT64 Usec)
+{
+    m_Counts[GetBucketIndex(Usec)].fetch_add(1, std::memory_order_relaxed);
+    m_SumUsec.fetch_add(Usec, std::memory_order_relaxed);
+
+    UINT64 MaxUsec = m_MaxUsec.load(std::memory_order_relaxed);
+    while (Usec > MaxUsec && !m_MaxUsec.compare_exchange_weak(MaxUsec, Usec, std::memory_order_relaxed))
+    {
+    }
+}
+
+void LatencyHistogram::RecordTicks(INT64 Ticks)
+{
+    Record(Ticks > 0 ? (UINT64)(SystemTime::TicksToMillisecs(Ticks) * 1000.0 + 0.5) : 0);
+}
+
+void LatencyHistogram::TakeSnapshot(LatencyHistogramSnapshot& Snapshot)
+{
+    // A sample recorded meanwhile lands in this snapshot or the next, never in neither
+    Snapshot.TotalCount = 0;
+    for (UINT32 i = 0; i < BucketCount; ++i)
+    {
+        const UINT32 Count = m_Counts[i].exchange(0, std::memory_order_relaxed);
+        Snapshot.Counts[i] = Count;
+        Snapshot.TotalCount += Count;
+    }
+    Snapshot.SumUsec = m_SumUsec.exchange(0, std::memory_order_relaxed);
+    Snapshot.MaxUsec = m_MaxUsec.exchange(0, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::UpdateLog()
+{
+    LatencyHistogramRegistry& Registry = GetRegistry();
+    const INT64 CurrentTick = SystemTime::GetCurrentTick();
+    if (Registry.m_StartTick == 0)
+    {
+        Registry.m_StartTick = CurrentTick;
+        Registry.m_NextLogTick = CurrentTick + GetLogIntervalTicks(Registry.m_LogIntervalSeconds);
+        return;
+    }
+
+    if (CurrentTick >= Registry.m_NextLogTick)
+    {
+        Registry.m_NextLogTick = CurrentTick + GetLogIntervalTicks(Registry.m_LogIntervalSeconds);
+        WriteLog();
+    }
+}
+
+void LatencyHistogram::WriteLog()
+{
+    LatencyHistogramRegistry& Registry = GetRegistry();
+    const DOUBLE UptimeSeconds = Registry.m_StartTick != 0 ? SystemTime::TicksToSeconds(SystemTime::GetCurrentTick() - Registry.m_StartTick) : 0.0;
+    const CHAR* strBuild = __DATE__ " " __TIME__;
+
+    FILE* pFile = nullptr;
+    _wfopen_s(&pFile, Registry.m_LogFileName.c_str(), L"ab");
+
+    Registry.Lock();
+    for (LatencyHistogram* pHistogram : Registry.m_Histograms)
+    {
+        pHistogram->TakeSnapshot(pHistogram->m_Interval);
+        pHistogram->m_Total.Add(pHistogram->m_Interval);
+        if (pFile == nullptr || pHistogram->m_Total.TotalCount == 0)
+        {
+            continue;
+        }
+        WriteSnapshot(pFile, strBuild, UptimeSeconds, pHistogram->m_strName, "interval", pHistogram->m_Interval);
+        WriteSnapshot(pFile, strBuild, UptimeSeconds, pHistogram->m_strName, "total", pHistogram->m_Total);
+    }
+    Registry.Unlock();
+
+    if (pFile != nullptr)
+    {
+        fclose(pFile);
+    }
+}
+
+void LatencyHistogram::SetLogFile(const std::wstring& FileName, UINT32 IntervalSeconds)
+{
+    LatencyHistogramRegistry& Registry = GetRegistry();
+    Registry.m_LogFileName = FileName;
+    Registry.m_LogIntervalSeconds = std::max(IntervalSeconds, 1U);
+    if (Registry.m_StartTick != 0)
+    {
+        Registry.m_NextLogTick = SystemTime::GetCurrentTick() + GetLogIntervalTicks(Registry.m_LogIntervalSeconds);
+    }
+}
+
+bool LatencyHistogram::Benchmark(UINT32 ThreadCount, UINT32 SamplesPerThread)
+{
+    ThreadCount = std::max(ThreadCount, 1U);
+
+    // Log-normal around 2 ms with a long tail, like frame and tick times
+    std::vector<std::vector<UINT64>> Samples(ThreadCount);
+    for (UINT32 t = 0; t < ThreadCount; ++t)
+    {
+        std::mt19937 Random(t + 1);
+        std::lognormal_distribution<DOUBLE> Distribution(log(2000.0), 0.75);
+        Samples[t].resize(SamplesPerThread);
+        for (auto& Usec : Samples[t])
+        {
+            Usec = (UINT64)Distribution(Random);
+        }
+    }
+
+    // Unregistered, so the log never drains it
+    std::unique_ptr<LatencyHistogram> pHistogram(new LatencyHistogram("Benchmark"));
+    {
+        LatencyHistogramRegistry& Registry = GetRegistry();
+        Registry.Lock();
+        Registry.m_Histograms.erase(std::find(Registry.m_Histograms.begin(), Registry.m_Histograms.end(), pHistogram.get()));
+        Registry.Unlock();
+    }
+
+    std::atomic<UINT32> RunningCount(ThreadCount);
+    std::vector<DOUBLE> ThreadMsec(ThreadCount);
+    std::vector<std::thread> Threads;
+    for (UINT32 t = 0; t < ThreadCount; ++t)
+    {
+        Threads.push_back(std::thread([&, t]()
+        {
+            const INT64 StartTick = SystemTime::GetCurrentTick();
+            for (UINT64 Usec : Samples[t])
+            {
+                pHistogram->Record(Usec);
+            }
+            ThreadMsec[t] = SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - StartTick);
+            --RunningCount;
+        }));
+    }
+
+    // Drain while the threads record, as the log does
+    LatencyHistogramSnapshot Total;
+    LatencyHistogramSnapshot Interval;
+    UINT32 SnapshotCount = 0;
+    while (RunningCount > 0)
+    {
+        pHistogram->TakeSnapshot(Interval);
+        Total.Add(Interval);
+        ++SnapshotCount;
+        std::this_thread::yield();
+    }
+    for (auto& Thread : Threads)
+    {
+        Thread.join();
+    }
+    pHistogram->TakeSnapshot(Interval);
+    Total.Add(Interval);
+
+    std::vector<UINT64> Sorted;
+    UINT64 SumUsec = 0;
+    for (const auto& ThreadSamples : Samples)
+    {
+        Sorted.insert(Sorted.end(), ThreadSamples.begin(), ThreadSamples.end());
+    }
+    std::sort(Sorted.begin(), Sorted.end());
+    for (UINT64 Usec : Sorted)
+    {
+        SumUsec += Usec;
+    }
+
+    bool Valid = Total.TotalCount == Sorted.size() && Total.SumUsec == SumUsec && (Sorted.empty() || Total.MaxUsec == Sorted.back());
+
+    Utility::PrintfConsole("Latency histogram benchmark: %u threads x %u samples, %u snapshots while recording\n", ThreadCount, SamplesPerThread, SnapshotCount);
+
+    const DOUBLE Percentiles[] = { 50.0, 90.0, 99.0, 99.9 };
+    for (DOUBLE Percentile : Percentiles)
+    {
+        if (Sorted.empty())
+        {
+            break;
+        }
+        const size_t Rank = std::max((size_t)1, (size_t)ceil(Percentile / 100.0 * (DOUBLE)Sorted.size()));
+        const UINT64 Exact = Sorted[Rank - 1];
+        const UINT64 Estimate = Total.GetPercentileUsec(Percentile);
+        const DOUBLE Error = (DOUBLE)(Estimate - std::min(Estimate, Exact)) / (DOUBLE)std::max(Exact, (UINT64)1);
+        Valid = Valid && Estimate >= Exact && Error <= 0.01;
+        Utility::PrintfConsole("  p%-5g               %8llu usec, exact %8llu usec (+%.2f%%)\n", Percentile, Estimate, Exact, Error * 100.0);
+    }
+
+    DOUBLE MaxThreadMsec = 0;
+    for (DOUBLE Msec : ThreadMsec)
+    {
+        MaxThreadMsec = std::max(MaxThreadMsec, Msec);
+    }
+    Utility::PrintfConsole("  Record:              %8.1f ns/sample (slowest thread)\n", MaxThreadMsec * 1e6 / std::max((DOUBLE)SamplesPerThread, 1.0));
+
+    return Valid;
+}
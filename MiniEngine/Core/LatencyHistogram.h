@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include "SystemTime.h"
+
+// Counts of a LatencyHistogram's samples, in the same buckets.  Not thread safe.
+struct LatencyHistogramSnapshot
+{
+    std::vector<UINT64> Counts;
+    UINT64 TotalCount;
+    UINT64 SumUsec;
+    UINT64 MaxUsec;
+
+    LatencyHistogramSnapshot();
+
+    void Clear();
+    void Add(const LatencyHistogramSnapshot& Other);
+
+    // A value no sample below the given percentile (0-100) exceeds, to within the bucket
+    // precision, and never more than the largest sample
+    UINT64 GetPercentileUsec(DOUBLE Percentile) const;
+    DOUBLE GetMeanUsec() const { return TotalCount > 0 ? (DOUBLE)SumUsec / (DOUBLE)TotalCount : 0.0; }
+};
+
+// Log-linear histogram of durations in microseconds, in the style of HdrHistogram: each
+// power of two range is split into equal buckets, so every recorded value is kept to within
+// 1% from 1 usec to several days with a fixed 17 KB of counters.  Any thread may record
+// without locks; the log collects and resets the counts periodically.
+//
+// Histograms are meant to be globals.  Each registers itself by name, and UpdateLog appends
+// the percentiles of every histogram, both for the last interval and since startup, to a
+// JSON lines log so that tail latency can be compared across builds.
+class LatencyHistogram
+{
+public:
+    static const UINT32 SubBucketBits = 8;
+    static const UINT32 MaxValueBits = 40;
+    static const UINT32 BucketCount = (1 << SubBucketBits) + (MaxValueBits - SubBucketBits) * (1 << (SubBucketBits - 1));
+    static const UINT32 DefaultLogIntervalSeconds = 60;
+
+private:
+    const CHAR* m_strName;
+    std::atomic<UINT32> m_Counts[BucketCount];
+    std::atomic<UINT64> m_SumUsec;
+    std::atomic<UINT64> m_MaxUsec;
+
+    // Owned by the log
+    LatencyHistogramSnapshot m_Interval;
+    LatencyHistogramSnapshot m_Total;
+
+public:
+    LatencyHistogram(const CHAR* strName);
+
+    const CHAR* GetName() const { return m_strName; }
+
+    void Record(UINT64 Usec);
+    void RecordTicks(INT64 Ticks);
+    void RecordMsec(DOUBLE Msec) { Record(Msec > 0 ? (UINT64)(Msec * 1000.0 + 0.5) : 0); }
+
+    // Moves the counts recorded since the last call into Snapshot, which is cleared first
+    void TakeSnapshot(LatencyHistogramSnapshot& Snapshot);
+
+    static UINT32 GetBucketIndex(UINT64 Usec);
+    static UINT64 GetBucketLimit(UINT32 BucketIndex);
+
+    // Call once per frame or tick from one thread; writes the log every interval.  The log
+    // is LatencyLog.jsonl in the working directory unless set otherwise.
+    static void UpdateLog();
+    static void WriteLog();
+    static void SetLogFile(const std::wstring& FileName, UINT32 IntervalSeconds = DefaultLogIntervalSeconds);
+
+    // Records a synthetic distribution from several threads while another drains it,
+    // compares the percentiles with exact ones and checks that no sample is lost.
+    static bool Benchmark(UINT32 ThreadCount, UINT32 SamplesPerThread);
+};
+
+class ScopedLatencyTimer
+{
+public:
+    ScopedLatencyTimer(LatencyHistogram& Histogram)
+        : m_Histogram(Histogram),
+          m_StartTick(SystemTime::GetCurrentTick())
+    { }
+    ~ScopedLatencyTimer()
+    {
+        m_Histogram.RecordTicks(SystemTime::GetCurrentTick() - m_StartTick);
+    }
+
+private:
+    LatencyHistogram& m_Histogram;
+    INT64 m_StartTick;
+};
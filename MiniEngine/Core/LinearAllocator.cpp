@@ -23,46 +23,91 @@ using namespace std;
 
 LinearAllocatorType LinearAllocatorPageManager::sm_AutoType = kGpuExclusive;
 
-LinearAllocatorPageManager::LinearAllocatorPageManager()
+LinearAllocatorPageManager::LinearAllocatorPageManager() : m_OneOffPageCount(0)
 {
 	m_AllocationType = sm_AutoType;
 	sm_AutoType = (LinearAllocatorType)(sm_AutoType + 1);
 	ASSERT(sm_AutoType <= kNumAllocatorTypes);
+	m_PageSize = (m_AllocationType == kGpuExclusive ? kGpuAllocatorPageSize : kCpuAllocatorPageSize);
 }
 
 LinearAllocatorPageManager LinearAllocator::sm_PageManager[2];
 
-LinearAllocationPage* LinearAllocatorPageManager::RequestPage()
+static bool IsFenceComplete( uint64_t FenceValue )
+{
+	return g_CommandManager.IsFenceComplete(FenceValue);
+}
+
+LinearAllocationPage* LinearAllocatorPageManager::AddPage( uint32_t SizeClass )
 {
+	LinearAllocationPage* PagePtr = CreateNewPage(m_PageSize << SizeClass);
+
+	// Once the pool or the size class is full, new pages are used once and destroyed when discarded
 	lock_guard<mutex> LockGuard(m_Mutex);
+	PagePtr->m_PoolIndex = m_Pages.AddPage(SizeClass, PagePtr);
+	if (PagePtr->m_PoolIndex == LinearPagePool::InvalidPage)
+		++m_OneOffPageCount;
+	else
+		m_PagePool.emplace_back(PagePtr);
 
-	while (!m_RetiredPages.empty() && g_CommandManager.IsFenceComplete(m_RetiredPages.front().first))
-	{
-		m_AvailablePages.push(m_RetiredPages.front().second);
-		m_RetiredPages.pop();
-	}
+	return PagePtr;
+}
 
-	LinearAllocationPage* PagePtr = nullptr;
+LinearAllocationPage* LinearAllocatorPageManager::RequestPage()
+{
+	const uint32_t PageIndex = m_Pages.Acquire(0, IsFenceComplete);
+	if (PageIndex != LinearPagePool::InvalidPage)
+		return (LinearAllocationPage*)m_Pages.GetPage(PageIndex);
 
-	if (!m_AvailablePages.empty())
-	{
-		PagePtr = m_AvailablePages.front();
-		m_AvailablePages.pop();
-	}
-	else
+	return AddPage(0);
+}
+
+LinearAllocationPage* LinearAllocatorPageManager::RequestLargePage( size_t SizeInBytes )
+{
+	const uint32_t SizeClass = LinearPagePool::GetSizeClass(m_PageSize, SizeInBytes);
+	if (LinearPagePool::GetSizeClassCapacity(SizeClass) == 0)
 	{
-		PagePtr = CreateNewPage();
-		m_PagePool.emplace_back(PagePtr);
+		lock_guard<mutex> LockGuard(m_Mutex);
+		++m_OneOffPageCount;
+		return CreateNewPage(SizeInBytes);
 	}
 
-	return PagePtr;
+	const uint32_t PageIndex = m_Pages.Acquire(SizeClass, IsFenceComplete);
+	if (PageIndex != LinearPagePool::InvalidPage)
+		return (LinearAllocationPage*)m_Pages.GetPage(PageIndex);
+
+	return AddPage(SizeClass);
 }
 
 void LinearAllocatorPageManager::DiscardPages( uint64_t FenceValue, const vector<LinearAllocationPage*>& UsedPages )
 {
-	lock_guard<mutex> LockGuard(m_Mutex);
+	vector<LinearAllocationPage*> OneOffPages;
 	for (auto iter = UsedPages.begin(); iter != UsedPages.end(); ++iter)
-		m_RetiredPages.push(make_pair(FenceValue, *iter));
+	{
+		if ((*iter)->m_PoolIndex == LinearPagePool::InvalidPage)
+			OneOffPages.push_back(*iter);
+		else
+			m_Pages.Retire((*iter)->m_PoolIndex, FenceValue);
+	}
+
+	if (!OneOffPages.empty())
+		FreeLargePages(FenceValue, OneOffPages);
+}
+
+void LinearAllocatorPageManager::PrintStatistics( const char* Label ) const
+{
+	const LinearPagePoolStats Stats = m_Pages.GetStats();
+	if (Stats.PagesRetired == 0)
+		return;
+
+	uint64_t LargePageBytes = 0;
+	for (uint32_t i = 1; i < LinearPagePool::MaxSizeClasses; ++i)
+		LargePageBytes += (uint64_t)Stats.PagesBySizeClass[i] * (m_PageSize << i);
+
+	Utility::Printf("Linear allocator pages (%s): %u pages (%u standard, %0.1f MB in large size classes), %llu one-off\n",
+		Label, Stats.PageCount, Stats.PagesBySizeClass[0], LargePageBytes / (1024.0 * 1024.0), m_OneOffPageCount);
+	Utility::Printf("  %llu retired, %llu recycled (%llu from thread caches), %u pending, %llu ring overflows\n",
+		Stats.PagesRetired, Stats.PagesRecycled, Stats.ThreadCacheHits, Stats.PendingPages, Stats.RingOverflows);
 }
 
 void LinearAllocatorPageManager::FreeLargePages( uint64_t FenceValue, const vector<LinearAllocationPage*>& LargePages )
@@ -129,12 +174,12 @@ LinearAllocationPage* LinearAllocatorPageManager::CreateNewPage( size_t PageSize
 
 void LinearAllocator::CleanupUsedPages( uint64_t FenceID )
 {
-	if (m_CurPage == nullptr)
-		return;
-
-	m_RetiredPages.push_back(m_CurPage);
-	m_CurPage = nullptr;
-	m_CurOffset = 0;
+	if (m_CurPage != nullptr)
+	{
+		m_RetiredPages.push_back(m_CurPage);
+		m_CurPage = nullptr;
+		m_CurOffset = 0;
+	}
 
 	sm_PageManager[m_AllocationType].DiscardPages(FenceID, m_RetiredPages);
 	m_RetiredPages.clear();
@@ -145,12 +190,16 @@ void LinearAllocator::CleanupUsedPages( uint64_t FenceID )
 
 DynAlloc LinearAllocator::AllocateLargePage(size_t SizeInBytes)
 {
-	LinearAllocationPage* OneOff = sm_PageManager[m_AllocationType].CreateNewPage(SizeInBytes);
-	m_LargePageList.push_back(OneOff);
+	// Pages from a size class are recycled like standard pages; one-off pages are destroyed
+	LinearAllocationPage* LargePage = sm_PageManager[m_AllocationType].RequestLargePage(SizeInBytes);
+	if (LargePage->m_PoolIndex != LinearPagePool::InvalidPage)
+		m_RetiredPages.push_back(LargePage);
+	else
+		m_LargePageList.push_back(LargePage);
 
-	DynAlloc ret(*OneOff, 0, SizeInBytes);
-	ret.DataPtr = OneOff->m_CpuVirtualAddress;
-	ret.GpuAddress = OneOff->m_GpuVirtualAddress;
+	DynAlloc ret(*LargePage, 0, SizeInBytes);
+	ret.DataPtr = LargePage->m_CpuVirtualAddress;
+	ret.GpuAddress = LargePage->m_GpuVirtualAddress;
 
 	return ret;
 }
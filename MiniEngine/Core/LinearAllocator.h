@@ -13,8 +13,8 @@
 // Description:  This is a dynamic graphics memory allocator for DX12.  It's designed to work in concert
 // with the CommandContext class and to do so in a thread-safe manner.  There may be many command contexts,
 // each with its own linear allocators.  They act as windows into a global memory pool by reserving a
-// context-local memory page.  Requesting a new page is done in a thread-safe manner by guarding accesses
-// with a mutex lock.
+// context-local memory page.  Pages are recycled through a LinearPagePool, so requesting and discarding
+// them takes no lock except when a new page has to be created.
 //
 // When a command context is finished, it will receive a fence ID that indicates when it's safe to reclaim
 // used resources.  The CleanupUsedPages() method must be invoked at this time so that the used pages can be
@@ -23,6 +23,7 @@
 #pragma once
 
 #include "GpuResource.h"
+#include "LinearPagePool.h"
 #include <vector>
 #include <queue>
 #include <mutex>
@@ -46,7 +47,7 @@ struct DynAlloc
 class LinearAllocationPage : public GpuResource
 {
 public:
-	LinearAllocationPage(ID3D12Resource* pResource, D3D12_RESOURCE_STATES Usage) : GpuResource()
+	LinearAllocationPage(ID3D12Resource* pResource, D3D12_RESOURCE_STATES Usage) : GpuResource(), m_PoolIndex(LinearPagePool::InvalidPage)
 	{
 		m_pResource.Attach(pResource);
 		m_UsageState = Usage;
@@ -78,6 +79,7 @@ public:
 
 	void* m_CpuVirtualAddress;
 	D3D12_GPU_VIRTUAL_ADDRESS m_GpuVirtualAddress;
+	uint32_t m_PoolIndex;	// InvalidPage for one-off pages, which are destroyed rather than recycled
 };
 
 enum LinearAllocatorType
@@ -104,25 +106,35 @@ public:
 	LinearAllocationPage* RequestPage( void );
 	LinearAllocationPage* CreateNewPage( size_t PageSize = 0 );
 
-	// Discarded pages will get recycled.  This is for fixed size pages.
+	// Returns a recycled page of the smallest size class that fits, or a one-off page when
+	// SizeInBytes is beyond every size class or its size class is at capacity.
+	LinearAllocationPage* RequestLargePage( size_t SizeInBytes );
+
+	// Discarded pages will get recycled, or destroyed if they are one-off pages.  This is for
+	// every page RequestPage or RequestLargePage returned.
 	void DiscardPages( uint64_t FenceID, const std::vector<LinearAllocationPage*>& Pages );
 
 	// Freed pages will be destroyed once their fence has passed.  This is for single-use,
 	// "large" pages.
 	void FreeLargePages( uint64_t FenceID, const std::vector<LinearAllocationPage*>& Pages );
 
-	void Destroy( void ) { m_PagePool.clear(); }
+	void PrintStatistics( const char* Label ) const;
+
+	void Destroy( void ) { m_PagePool.clear(); m_Pages.Reset(); }
 
 private:
 
+	LinearAllocationPage* AddPage( uint32_t SizeClass );
+
 	static LinearAllocatorType sm_AutoType;
 
 	LinearAllocatorType m_AllocationType;
+	size_t m_PageSize;
+	LinearPagePool m_Pages;
 	std::vector<std::unique_ptr<LinearAllocationPage> > m_PagePool;
-	std::queue<std::pair<uint64_t, LinearAllocationPage*> > m_RetiredPages;
 	std::queue<std::pair<uint64_t, LinearAllocationPage*> > m_DeletionQueue;
-	std::queue<LinearAllocationPage*> m_AvailablePages;
 	std::mutex m_Mutex;
+	uint64_t m_OneOffPageCount;
 };
 
 class LinearAllocator
@@ -141,6 +153,8 @@ public:
 
 	static void DestroyAll( void )
 	{
+		sm_PageManager[0].PrintStatistics("GPU");
+		sm_PageManager[1].PrintStatistics("CPU");
 		sm_PageManager[0].Destroy();
 		sm_PageManager[1].Destroy();
 	}
@@ -0,0 +1,492 @@
+#include "pch.h"
+#include "LinearPagePool.h"
+#include "SystemTime.h"
+#include <queue>
+#include <thread>
+
+namespace
+{
+    std::atomic<UINT64> s_NextPoolId(1);
+
+    const UINT32 ThreadCacheSlots = 4;
+}
+
+// Pages a thread reclaimed for one pool, keyed by pool ID so a reset pool's pages are ignored
+struct LinearPagePool::ThreadCache
+{
+    UINT64 PoolId;
+    UINT32 Count;
+    UINT32 Pages[ThreadCacheSize];
+};
+
+LinearPagePool::LinearPagePool()
+    : m_Pages(new PageEntry[MaxPages]),
+      m_RetiredRing(new RetiredSlot[RetiredRingSize])
+{
+    Reset();
+}
+
+UINT32 LinearPagePool::GetSizeClass(size_t PageSize, size_t SizeInBytes)
+{
+    UINT32 SizeClass = 0;
+    while (SizeClass < MaxSizeClasses && (PageSize << SizeClass) < SizeInBytes)
+    {
+        ++SizeClass;
+    }
+    return SizeClass;
+}
+
+UINT32 LinearPagePool::GetSizeClassCapacity(UINT32 SizeClass)
+{
+    if (SizeClass == 0)
+    {
+        return MaxPages;
+    }
+    return SizeClass < MaxSizeClasses ? LargeClassBudget >> SizeClass : 0;
+}
+
+void LinearPagePool::Reset()
+{
+    m_PoolId = s_NextPoolId++;
+    m_PageCount = 0;
+    for (UINT32 i = 0; i < MaxSizeClasses; ++i)
+    {
+        m_FreeHeads[i] = InvalidPage;
+        m_SizeClassCounts[i] = 0;
+    }
+    for (UINT32 i = 0; i < RetiredRingSize; ++i)
+    {
+        m_RetiredRing[i].Sequence = i;
+    }
+    m_RetireHead = 0;
+    m_ReclaimHead = 0;
+    m_Overflow.clear();
+    m_OverflowCount = 0;
+
+    m_PagesRecycled = 0;
+    m_ThreadCacheHits = 0;
+    m_PagesRetired = 0;
+    m_RingOverflows = 0;
+    m_PendingPages = 0;
+    m_CachedPages = 0;
+}
+
+LinearPagePool::ThreadCache* LinearPagePool::GetThreadCache()
+{
+    // A thread that has seen more pools than this simply goes without a cache for the rest
+    static thread_local ThreadCache s_Caches[ThreadCacheSlots] = {};
+
+    ThreadCache* pUnused = nullptr;
+    for (UINT32 i = 0; i < ThreadCacheSlots; ++i)
+    {
+        if (s_Caches[i].PoolId == m_PoolId)
+        {
+            return &s_Caches[i];
+        }
+        if (s_Caches[i].PoolId == 0 && pUnused == nullptr)
+        {
+            pUnused = &s_Caches[i];
+        }
+    }
+
+    if (pUnused != nullptr)
+    {
+        pUnused->PoolId = m_PoolId;
+    }
+    return pUnused;
+}
+
+void LinearPagePool::PushFree(UINT32 Page)
+{
+    std::atomic<UINT64>& Head = m_FreeHeads[m_Pages[Page].SizeClass];
+    UINT64 OldHead = Head.load(std::memory_order_relaxed);
+    UINT64 NewHead;
+    do
+    {
+        m_Pages[Page].Next.store((UINT32)OldHead, std::memory_order_relaxed);
+        NewHead = ((OldHead >> 32) + 1) << 32 | Page;
+    }
+    while (!Head.compare_exchange_weak(OldHead, NewHead, std::memory_order_release, std::memory_order_relaxed));
+}
+
+UINT32 LinearPagePool::PopFree(UINT32 SizeClass)
+{
+    std::atomic<UINT64>& Head = m_FreeHeads[SizeClass];
+    UINT64 OldHead = Head.load(std::memory_order_acquire);
+    for (;;)
+    {
+        const UINT32 Page = (UINT32)OldHead;
+        if (Page == InvalidPage)
+        {
+            return InvalidPage;
+        }
+
+        // Next may be stale if another thread popped first; the tag then fails the exchange
+        const UINT64 NewHead = ((OldHead >> 32) + 1) << 32 | m_Pages[Page].Next.load(std::memory_order_relaxed);
+        if (Head.compare_exchange_weak(OldHead, NewHead, std::memory_order_acquire, std::memory_order_acquire))
+        {
+            return Page;
+        }
+    }
+}
+
+void LinearPagePool::Release(UINT32 Page, ThreadCache* pCache)
+{
+    // Larger pages and pages past the cache's limit go where any thread can reuse them
+    if (pCache != nullptr && m_Pages[Page].SizeClass == 0 && pCache->Count < ThreadCacheSize)
+    {
+        pCache->Pages[pCache->Count++] = Page;
+        ++m_CachedPages;
+    }
+    else
+    {
+        PushFree(Page);
+    }
+}
+
+UINT32 LinearPagePool::Acquire(UINT32 SizeClass, const std::function<bool(UINT64)>& IsFenceComplete)
+{
+    assert(SizeClass < MaxSizeClasses);
+
+    ThreadCache* pCache = SizeClass == 0 ? GetThreadCache() : nullptr;
+    if (pCache == nullptr || pCache->Count == 0)
+    {
+        ReclaimCompleted(IsFenceComplete);
+    }
+
+    UINT32 Page = InvalidPage;
+    if (pCache != nullptr && pCache->Count > 0)
+    {
+        Page = pCache->Pages[--pCache->Count];
+        --m_CachedPages;
+        ++m_ThreadCacheHits;
+    }
+    else
+    {
+        Page = PopFree(SizeClass);
+    }
+
+    if (Page != InvalidPage)
+    {
+        ++m_PagesRecycled;
+    }
+    return Page;
+}
+
+UINT32 LinearPagePool::AddPage(UINT32 SizeClass, void* pPage)
+{
+    assert(SizeClass < MaxSizeClasses);
+
+    std::lock_guard<std::mutex> Lock(m_AddMutex);
+    const UINT32 Page = m_PageCount.load(std::memory_order_relaxed);
+    if (Page == MaxPages || m_SizeClassCounts[SizeClass] == GetSizeClassCapacity(SizeClass))
+    {
+        return InvalidPage;
+    }
+
+    ++m_SizeClassCounts[SizeClass];
+    m_Pages[Page].pPage = pPage;
+    m_Pages[Page].SizeClass = SizeClass;
+    m_Pages[Page].Next.store(InvalidPage, std::memory_order_relaxed);
+    m_PageCount.store(Page + 1, std::memory_order_release);
+    return Page;
+}
+
+void LinearPagePool::Retire(UINT32 Page, UINT64 FenceValue)
+{
+    ++m_PagesRetired;
+    ++m_PendingPages;
+
+    UINT64 Position = m_RetireHead.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        RetiredSlot& Slot = m_RetiredRing[Position & (RetiredRingSize - 1)];
+        const INT64 Lag = (INT64)(Slot.Sequence.load(std::memory_order_acquire) - Position);
+        if (Lag == 0)
+        {
+            if (m_RetireHead.compare_exchange_weak(Position, Position + 1, std::memory_order_relaxed))
+            {
+                Slot.FenceValue.store(FenceValue, std::memory_order_relaxed);
+                Slot.Page.store(Page, std::memory_order_relaxed);
+                Slot.Sequence.store(Position + 1, std::memory_order_release);
+                return;
+            }
+        }
+        else if (Lag < 0)
+        {
+            break;
+        }
+        else
+        {
+            Position = m_RetireHead.load(std::memory_order_relaxed);
+        }
+    }
+
+    // Full: more pages in flight than the ring holds
+    std::lock_guard<std::mutex> Lock(m_OverflowMutex);
+    m_Overflow.push_back(std::make_pair(FenceValue, Page));
+    ++m_OverflowCount;
+    ++m_RingOverflows;
+}
+
+UINT32 LinearPagePool::ReclaimCompleted(const std::function<bool(UINT64)>& IsFenceComplete)
+{
+    ThreadCache* pCache = GetThreadCache();
+    UINT32 ReclaimedCount = 0;
+
+    // Stops at the first incomplete fence, as the queue this replaces did
+    UINT64 Position = m_ReclaimHead.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        RetiredSlot& Slot = m_RetiredRing[Position & (RetiredRingSize - 1)];
+        const INT64 Lag = (INT64)(Slot.Sequence.load(std::memory_order_acquire) - (Position + 1));
+        if (Lag < 0)
+        {
+            break;
+        }
+        if (Lag > 0)
+        {
+            Position = m_ReclaimHead.load(std::memory_order_relaxed);
+            continue;
+        }
+
+        const UINT64 FenceValue = Slot.FenceValue.load(std::memory_order_relaxed);
+        const UINT32 Page = Slot.Page.load(std::memory_order_relaxed);
+        if (!IsFenceComplete(FenceValue))
+        {
+            break;
+        }
+
+        if (m_ReclaimHead.compare_exchange_weak(Position, Position + 1, std::memory_order_relaxed))
+        {
+            Slot.Sequence.store(Position + RetiredRingSize, std::memory_order_release);
+            Release(Page, pCache);
+            ++ReclaimedCount;
+            Position = Position + 1;
+        }
+    }
+
+    if (m_OverflowCount.load(std::memory_order_relaxed) > 0)
+    {
+        std::lock_guard<std::mutex> Lock(m_OverflowMutex);
+        while (!m_Overflow.empty() && IsFenceComplete(m_Overflow.front().first))
+        {
+            Release(m_Overflow.front().second, pCache);
+            m_Overflow.pop_front();
+            --m_OverflowCount;
+            ++ReclaimedCount;
+        }
+    }
+
+    m_PendingPages -= ReclaimedCount;
+    return ReclaimedCount;
+}
+
+LinearPagePoolStats LinearPagePool::GetStats() const
+{
+    LinearPagePoolStats Stats = {};
+    Stats.PageCount = m_PageCount.load(std::memory_order_acquire);
+    Stats.PagesCreated = Stats.PageCount;
+    Stats.PagesRecycled = m_PagesRecycled;
+    Stats.ThreadCacheHits = m_ThreadCacheHits;
+    Stats.PagesRetired = m_PagesRetired;
+    Stats.RingOverflows = m_RingOverflows;
+    Stats.PendingPages = m_PendingPages;
+    Stats.CachedPages = m_CachedPages;
+    for (UINT32 i = 0; i < Stats.PageCount; ++i)
+    {
+        ++Stats.PagesBySizeClass[m_Pages[i].SizeClass];
+    }
+    return Stats;
+}
+
+namespace
+{
+    // The mutex-guarded queues LinearAllocatorPageManager used before, kept to compare against
+    class LockedPagePool
+    {
+    public:
+        LockedPagePool() : m_PageCount(0), m_SizeClassCounts() {}
+
+        UINT32 Acquire(UINT32 SizeClass, const std::function<bool(UINT64)>& IsFenceComplete)
+        {
+            std::lock_guard<std::mutex> Lock(m_Mutex);
+            while (!m_RetiredPages.empty() && IsFenceComplete(m_RetiredPages.front().first))
+            {
+                m_AvailablePages[m_SizeClasses[m_RetiredPages.front().second]].push(m_RetiredPages.front().second);
+                m_RetiredPages.pop();
+            }
+
+            if (m_AvailablePages[SizeClass].empty())
+            {
+                return LinearPagePool::InvalidPage;
+            }
+            const UINT32 Page = m_AvailablePages[SizeClass].front();
+            m_AvailablePages[SizeClass].pop();
+            return Page;
+        }
+
+        UINT32 AddPage(UINT32 SizeClass, void*)
+        {
+            std::lock_guard<std::mutex> Lock(m_Mutex);
+            if (m_PageCount == LinearPagePool::MaxPages ||
+                m_SizeClassCounts[SizeClass] == LinearPagePool::GetSizeClassCapacity(SizeClass))
+            {
+                return LinearPagePool::InvalidPage;
+            }
+            ++m_SizeClassCounts[SizeClass];
+            m_SizeClasses[m_PageCount] = SizeClass;
+            return m_PageCount++;
+        }
+
+        void Retire(UINT32 Page, UINT64 FenceValue)
+        {
+            std::lock_guard<std::mutex> Lock(m_Mutex);
+            m_RetiredPages.push(std::make_pair(FenceValue, Page));
+        }
+
+    private:
+        std::mutex m_Mutex;
+        UINT32 m_PageCount;
+        UINT32 m_SizeClasses[LinearPagePool::MaxPages];
+        UINT32 m_SizeClassCounts[LinearPagePool::MaxSizeClasses];
+        std::queue<std::pair<UINT64, UINT32>> m_RetiredPages;
+        std::queue<UINT32> m_AvailablePages[LinearPagePool::MaxSizeClasses];
+    };
+
+    struct PagePoolRun
+    {
+        DOUBLE ElapsedMsec;
+        UINT64 PagesAdded;
+        bool Valid;
+    };
+
+    // Each thread records "contexts" of a few pages, mostly standard with some larger, and
+    // retires them against a shared fake fence that completes 16 submissions behind.
+    template <typename Pool>
+    PagePoolRun RunPagePool(Pool& P, UINT32 ThreadCount, UINT32 OperationsPerThread, std::atomic<UINT64>& CompletedFence)
+    {
+        std::unique_ptr<std::atomic<bool>[]> InUse(new std::atomic<bool>[LinearPagePool::MaxPages]);
+        for (UINT32 i = 0; i < LinearPagePool::MaxPages; ++i)
+        {
+            InUse[i] = false;
+        }
+
+        std::atomic<UINT64> SubmittedFence(0);
+        std::atomic<UINT64> PagesAdded(0);
+        std::atomic<bool> Valid(true);
+        CompletedFence = 0;
+        auto IsFenceComplete = [&CompletedFence](UINT64 Fence) { return Fence <= CompletedFence.load(std::memory_order_acquire); };
+
+        auto Worker = [&](UINT32 ThreadIndex)
+        {
+            UINT32 Seed = ThreadIndex * 7919 + 1;
+            auto Random = [&Seed]() { Seed = Seed * 1664525 + 1013904223; return Seed >> 8; };
+
+            UINT32 Held[8];
+            UINT32 HeldCount = 0;
+            for (UINT32 Op = 0; Op < OperationsPerThread; ++Op)
+            {
+                const UINT32 Roll = Random() % 100;
+                const UINT32 SizeClass = Roll < 90 ? 0 : 1 + Roll % 3;
+                UINT32 Page = P.Acquire(SizeClass, IsFenceComplete);
+                if (Page == LinearPagePool::InvalidPage)
+                {
+                    Page = P.AddPage(SizeClass, nullptr);
+                    if (Page == LinearPagePool::InvalidPage && SizeClass != 0)
+                    {
+                        // The size class is at capacity; the allocator would use a one-off page
+                        continue;
+                    }
+                    ++PagesAdded;
+                }
+                if (Page == LinearPagePool::InvalidPage || InUse[Page].exchange(true))
+                {
+                    Valid = false;
+                    return;
+                }
+                Held[HeldCount++] = Page;
+
+                if (HeldCount == 8 || Random() % 4 == 0)
+                {
+                    const UINT64 Fence = ++SubmittedFence;
+                    for (UINT32 i = 0; i < HeldCount; ++i)
+                    {
+                        InUse[Held[i]] = false;
+                        P.Retire(Held[i], Fence);
+                    }
+                    HeldCount = 0;
+
+                    UINT64 Completed = CompletedFence.load();
+                    while (Fence > Completed + 16 && !CompletedFence.compare_exchange_weak(Completed, Fence - 16))
+                    {
+                    }
+                }
+            }
+
+            const UINT64 Fence = ++SubmittedFence;
+            for (UINT32 i = 0; i < HeldCount; ++i)
+            {
+                InUse[Held[i]] = false;
+                P.Retire(Held[i], Fence);
+            }
+        };
+
+        const INT64 StartTick = SystemTime::GetCurrentTick();
+        std::vector<std::thread> Threads;
+        for (UINT32 i = 0; i < ThreadCount; ++i)
+        {
+            Threads.emplace_back(Worker, i);
+        }
+        for (auto& T : Threads)
+        {
+            T.join();
+        }
+
+        PagePoolRun Run;
+        Run.ElapsedMsec = SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - StartTick);
+        Run.PagesAdded = PagesAdded;
+        Run.Valid = Valid;
+        CompletedFence = SubmittedFence.load();
+        return Run;
+    }
+}
+
+bool LinearPagePool::Benchmark(UINT32 ThreadCount, UINT32 OperationsPerThread)
+{
+    ThreadCount = std::max(ThreadCount, 1U);
+
+    std::atomic<UINT64> CompletedFence(0);
+    auto IsFenceComplete = [&CompletedFence](UINT64 Fence) { return Fence <= CompletedFence.load(); };
+
+    std::unique_ptr<LockedPagePool> Locked(new LockedPagePool);
+    const PagePoolRun LockedRun = RunPagePool(*Locked, ThreadCount, OperationsPerThread, CompletedFence);
+
+    std::unique_ptr<LinearPagePool> Pool(new LinearPagePool);
+    const PagePoolRun Run = RunPagePool(*Pool, ThreadCount, OperationsPerThread, CompletedFence);
+
+    // Once every fence has passed, each page is either free or in an exited thread's cache
+    Pool->ReclaimCompleted(IsFenceComplete);
+    const LinearPagePoolStats Stats = Pool->GetStats();
+    UINT32 FreeCount = 0;
+    for (UINT32 SizeClass = 0; SizeClass < MaxSizeClasses; ++SizeClass)
+    {
+        while (Pool->PopFree(SizeClass) != InvalidPage)
+        {
+            ++FreeCount;
+        }
+    }
+    const bool Valid = LockedRun.Valid && Run.Valid && Stats.PendingPages == 0 && Stats.PagesCreated == Run.PagesAdded &&
+        FreeCount + Stats.CachedPages == Stats.PageCount;
+
+    const UINT64 OperationCount = (UINT64)ThreadCount * OperationsPerThread;
+    Utility::PrintfConsole("Linear page pool benchmark: %u threads x %u page requests\n", ThreadCount, OperationsPerThread);
+    Utility::PrintfConsole("  Mutex and queues:    %10.0f requests/s, %llu pages created\n",
+        OperationCount * 1000.0 / std::max(LockedRun.ElapsedMsec, 1e-3), LockedRun.PagesAdded);
+    Utility::PrintfConsole("  Lock-free pool:      %10.0f requests/s, %llu pages created\n",
+        OperationCount * 1000.0 / std::max(Run.ElapsedMsec, 1e-3), Run.PagesAdded);
+    Utility::PrintfConsole("  Recycled:            %10llu (%llu from thread caches), %llu ring overflows\n",
+        Stats.PagesRecycled, Stats.ThreadCacheHits, Stats.RingOverflows);
+
+    return Valid;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+struct LinearPagePoolStats
+{
+    UINT64 PagesCreated;
+    UINT64 PagesRecycled;
+    UINT64 ThreadCacheHits;
+    UINT64 PagesRetired;
+    UINT64 RingOverflows;
+    UINT32 PageCount;
+    UINT32 PendingPages;
+    UINT32 CachedPages;
+    UINT32 PagesBySizeClass[8];
+};
+
+// Page recycling behind LinearAllocatorPageManager, kept free of D3D so it can be exercised
+// with a fake fence.  Pages are numbered as they are added; the caller keeps the pointer
+// each number stands for.
+//
+// Retired pages enter a bounded lock-free ring in retirement order, like the fence-ordered
+// queue it replaces, and move to a lock-free free stack for their size class once the
+// fence passes.  The thread that reclaims them keeps up to ThreadCacheSize standard pages
+// in a thread-local cache that it draws on before touching the shared stacks; the rest,
+// and every larger page, go to the shared stacks.  Size class 0 holds standard pages;
+// class N holds pages 2^N times larger.  Larger classes are capped so that each holds at
+// most LargeClassBudget standard pages' worth of memory; pages past the cap are refused
+// by AddPage and the caller uses them once.  Only adding a page and ring overflow take a
+// lock.
+class LinearPagePool
+{
+public:
+    static const UINT32 InvalidPage = 0xFFFFFFFF;
+    static const UINT32 MaxSizeClasses = 8;
+    static const UINT32 MaxPages = 16384;
+    static const UINT32 RetiredRingSize = 4096;
+    static const UINT32 ThreadCacheSize = 2;
+    static const UINT32 LargeClassBudget = 16;
+
+    LinearPagePool();
+
+    // The size class of pages that hold SizeInBytes, or MaxSizeClasses when too large to recycle.
+    static UINT32 GetSizeClass(size_t PageSize, size_t SizeInBytes);
+
+    // How many pages the size class may hold; zero for classes whose pages are never kept.
+    static UINT32 GetSizeClassCapacity(UINT32 SizeClass);
+
+    // Returns a page of the size class whose fence has passed, or InvalidPage; the caller
+    // then creates one and calls AddPage.
+    UINT32 Acquire(UINT32 SizeClass, const std::function<bool(UINT64)>& IsFenceComplete);
+
+    // Numbers a newly created page, which the caller now holds.  Returns InvalidPage when the
+    // pool or the page's size class is full.
+    UINT32 AddPage(UINT32 SizeClass, void* pPage);
+
+    void* GetPage(UINT32 Page) const { return m_Pages[Page].pPage; }
+    UINT32 GetPageSizeClass(UINT32 Page) const { return m_Pages[Page].SizeClass; }
+
+    // Queues a held page for reuse once FenceValue completes.
+    void Retire(UINT32 Page, UINT64 FenceValue);
+
+    // Moves retired pages whose fences have completed to the free stacks; returns how many.
+    UINT32 ReclaimCompleted(const std::function<bool(UINT64)>& IsFenceComplete);
+
+    LinearPagePoolStats GetStats() const;
+
+    // Forgets every page.  Pages left in thread caches are ignored from then on.
+    void Reset();
+
+    // Threads acquire, hold and retire pages against a fake fence that trails them, checking
+    // that no page is ever held twice and that every page is accounted for at the end, then
+    // report throughput against a mutex-guarded queue.
+    static bool Benchmark(UINT32 ThreadCount, UINT32 OperationsPerThread);
+
+private:
+    struct PageEntry
+    {
+        void* pPage;
+        UINT32 SizeClass;
+        std::atomic<UINT32> Next;
+    };
+
+    struct RetiredSlot
+    {
+        std::atomic<UINT64> Sequence;
+        std::atomic<UINT64> FenceValue;
+        std::atomic<UINT32> Page;
+    };
+
+    struct ThreadCache;
+    ThreadCache* GetThreadCache();
+
+    void PushFree(UINT32 Page);
+    UINT32 PopFree(UINT32 SizeClass);
+    void Release(UINT32 Page, ThreadCache* pCache);
+
+    UINT64 m_PoolId;
+    std::unique_ptr<PageEntry[]> m_Pages;
+    std::atomic<UINT32> m_PageCount;
+
+    // Tagged with a pop count in the upper half to rule out ABA
+    std::atomic<UINT64> m_FreeHeads[MaxSizeClasses];
+
+    std::unique_ptr<RetiredSlot[]> m_RetiredRing;
+    std::atomic<UINT64> m_RetireHead;
+    std::atomic<UINT64> m_ReclaimHead;
+
+    // Retirements that found the ring full; drained after the ring
+    std::mutex m_OverflowMutex;
+    std::deque<std::pair<UINT64, UINT32>> m_Overflow;
+    std::atomic<UINT32> m_OverflowCount;
+
+    std::mutex m_AddMutex;
+    UINT32 m_SizeClassCounts[MaxSizeClasses];
+
+    std::atomic<UINT64> m_PagesRecycled;
+    std::atomic<UINT64> m_ThreadCacheHits;
+    std::atomic<UINT64> m_PagesRetired;
+    std::atomic<UINT64> m_RingOverflows;
+    std::atomic<UINT32> m_PendingPages;
+    std::atomic<UINT32> m_CachedPages;
+};
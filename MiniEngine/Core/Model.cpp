@@ -16,10 +16,13 @@
 #include <string.h>
 #include <float.h>
 #include "TessTerrain.h"
+#include <atomic>
 
 namespace Graphics
 {
 
+static std::atomic<UINT32> s_NextRenderSortIndex(0);
+
 // must match the format enum in model.h
 const char* Model::s_FormatString[] =
 {
@@ -50,9 +53,11 @@ Model::Model()
 	, m_pMaterial(nullptr)
 	, m_pVertexData(nullptr)
 	, m_pIndexData(nullptr)
+	, m_RenderSortIndex(s_NextRenderSortIndex++)
 	, m_pVertexDataDepth(nullptr)
 	, m_pIndexDataDepth(nullptr)
 	, m_SRVs(nullptr)
+	, m_pMaterialTextures(nullptr)
 {
 	Clear();
 }
@@ -203,6 +203,9 @@ public:
 
     UINT32 m_InputLayoutIndex;
 
+    // Unique per model; used by the render queue to group instances of the same model
+    UINT32 m_RenderSortIndex;
+
 	// optimized for depth-only rendering
 	unsigned char *m_pVertexDataDepth;
 	unsigned char *m_pIndexDataDepth;
@@ -215,6 +218,24 @@ public:
 		return m_SRVs + materialIdx * 6;
 	}
 
+	// Moves any of the material's textures that are still streaming in ahead in the load queue
+	void MarkTexturesVisible( uint32_t materialIdx ) const
+	{
+		if (m_pMaterialTextures == nullptr)
+			return;
+		for (uint32_t i = 0; i < kTexturesPerMaterial; ++i)
+			m_pMaterialTextures[materialIdx * kTexturesPerMaterial + i]->MarkVisible();
+	}
+
+	// Asks for enough mip detail in every texture to cover ScreenPixels across the model
+	void RequestTextureResolution( uint32_t ScreenPixels ) const
+	{
+		if (m_pMaterialTextures == nullptr)
+			return;
+		for (uint32_t i = 0; i < m_Header.materialCount * kTexturesPerMaterial; ++i)
+			m_pMaterialTextures[i]->RequestResolution(ScreenPixels);
+	}
+
 private:
 
 	bool LoadH3D(const char *filename);
@@ -243,6 +264,10 @@ private:
 	void LoadTextures();
 	D3D12_CPU_DESCRIPTOR_HANDLE* m_SRVs;
 
+	// Diffuse, specular and normal map of each material
+	static const uint32_t kTexturesPerMaterial = 3;
+	const ManagedTexture** m_pMaterialTextures;
+
     void CreateCommon(uint32_t VertexCount, uint32_t IndexCount);
     void CompleteCommon(const WCHAR* strName, const CHAR* strDiffuseTexName);
 };
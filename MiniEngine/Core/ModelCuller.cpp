@@ -0,0 +1,423 @@
+#include "pch.h"
+#include "ModelCuller.h"
+#include "SystemTime.h"
+#include <algorithm>
+
+using namespace Math;
+
+// Spheres closer than this (in clip w) are treated as crossing the near plane.
+static const FLOAT NearClipW = 1e-3f;
+
+ModelCuller::ModelCuller()
+    : m_SphereCount(0),
+      m_PlaneCount(0),
+      m_DepthEmpty(true)
+{
+    ZeroMemory(m_Planes, sizeof(m_Planes));
+    ZeroMemory(m_ClipRows, sizeof(m_ClipRows));
+    ZeroMemory(m_ClipRowLengths, sizeof(m_ClipRowLengths));
+    ZeroMemory(&m_Stats, sizeof(m_Stats));
+    m_InvDepth.resize(DepthBufferWidth * DepthBufferHeight, 0.0f);
+}
+
+void ModelCuller::ResetSpheres(UINT32 Count)
+{
+    const UINT32 PaddedCount = (Count + 3) & ~3U;
+    m_CenterX.assign(PaddedCount, 0.0f);
+    m_CenterY.assign(PaddedCount, 0.0f);
+    m_CenterZ.assign(PaddedCount, 0.0f);
+    m_Radius.assign(PaddedCount, 0.0f);
+    m_SphereCount = Count;
+}
+
+void ModelCuller::SetSphere(UINT32 Index, const Vector3& Center, FLOAT Radius)
+{
+    assert(Index < m_SphereCount);
+    m_CenterX[Index] = Center.GetX();
+    m_CenterY[Index] = Center.GetY();
+    m_CenterZ[Index] = Center.GetZ();
+    m_Radius[Index] = Radius;
+}
+
+void ModelCuller::BeginView(const Matrix4& ViewProjection, const Vector3& ViewOrigin, bool TestDepthPlanes)
+{
+    m_ViewProjection = ViewProjection;
+    m_ViewOrigin = ViewOrigin;
+
+    const XMMATRIX ClipRows = XMMatrixTranspose(ViewProjection);
+    for (UINT32 i = 0; i < 4; ++i)
+    {
+        XMStoreFloat4(&m_ClipRows[i], ClipRows.r[i]);
+        m_ClipRowLengths[i] = XMVectorGetX(XMVector3Length(ClipRows.r[i]));
+    }
+
+    // Gribb/Hartmann plane extraction; D3D clip space has 0 <= z <= w.
+    XMVECTOR Planes[6];
+    Planes[0] = XMVectorAdd(ClipRows.r[3], ClipRows.r[0]);
+    Planes[1] = XMVectorSubtract(ClipRows.r[3], ClipRows.r[0]);
+    Planes[2] = XMVectorAdd(ClipRows.r[3], ClipRows.r[1]);
+    Planes[3] = XMVectorSubtract(ClipRows.r[3], ClipRows.r[1]);
+    Planes[4] = ClipRows.r[2];
+    Planes[5] = XMVectorSubtract(ClipRows.r[3], ClipRows.r[2]);
+    m_PlaneCount = TestDepthPlanes ? 6 : 4;
+
+    for (UINT32 i = 0; i < m_PlaneCount; ++i)
+    {
+        // Normalize so that plane distances compare against radii, then move the plane
+        // from view-origin-relative space into world space.
+        const FLOAT Length = XMVectorGetX(XMVector3Length(Planes[i]));
+        XMVECTOR Plane = XMVectorScale(Planes[i], Length > 0.0f ? 1.0f / Length : 0.0f);
+        const FLOAT D = XMVectorGetW(Plane) - XMVectorGetX(XMVector3Dot(Plane, ViewOrigin));
+        XMStoreFloat4(&m_Planes[i], XMVectorSetW(Plane, D));
+    }
+
+    ClearDepth();
+    ZeroMemory(&m_Stats, sizeof(m_Stats));
+    m_Stats.SphereCount = m_SphereCount;
+}
+
+UINT32 ModelCuller::CullFrustum(std::vector<UINT32>& VisibleIndices)
+{
+    const INT64 StartTick = SystemTime::GetCurrentTick();
+
+    XMVECTOR PlaneX[6], PlaneY[6], PlaneZ[6], PlaneW[6];
+    for (UINT32 p = 0; p < m_PlaneCount; ++p)
+    {
+        PlaneX[p] = XMVectorReplicate(m_Planes[p].x);
+        PlaneY[p] = XMVectorReplicate(m_Planes[p].y);
+        PlaneZ[p] = XMVectorReplicate(m_Planes[p].z);
+        PlaneW[p] = XMVectorReplicate(m_Planes[p].w);
+    }
+
+    VisibleIndices.clear();
+    const XMVECTOR Zero = XMVectorZero();
+    for (UINT32 i = 0; i < m_SphereCount; i += 4)
+    {
+        const XMVECTOR X = XMLoadFloat4((const XMFLOAT4*)&m_CenterX[i]);
+        const XMVECTOR Y = XMLoadFloat4((const XMFLOAT4*)&m_CenterY[i]);
+        const XMVECTOR Z = XMLoadFloat4((const XMFLOAT4*)&m_CenterZ[i]);
+        const XMVECTOR R = XMLoadFloat4((const XMFLOAT4*)&m_Radius[i]);
+
+        XMVECTOR Outside = XMVectorFalseInt();
+        for (UINT32 p = 0; p < m_PlaneCount; ++p)
+        {
+            XMVECTOR Distance = XMVectorMultiplyAdd(X, PlaneX[p], XMVectorAdd(PlaneW[p], R));
+            Distance = XMVectorMultiplyAdd(Y, PlaneY[p], Distance);
+            Distance = XMVectorMultiplyAdd(Z, PlaneZ[p], Distance);
+            Outside = XMVectorOrInt(Outside, XMVectorLess(Distance, Zero));
+        }
+
+        UINT32 VisibleMask = ~(UINT32)_mm_movemask_ps(Outside) & 0xF;
+        while (VisibleMask != 0)
+        {
+            DWORD Bit;
+            _BitScanForward(&Bit, VisibleMask);
+            VisibleMask &= VisibleMask - 1;
+            if (i + Bit < m_SphereCount)
+            {
+                VisibleIndices.push_back(i + Bit);
+            }
+        }
+    }
+
+    m_Stats.FrustumVisibleCount = (UINT32)VisibleIndices.size();
+    m_Stats.FrustumMsec += SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - StartTick);
+    return m_Stats.FrustumVisibleCount;
+}
+
+XMVECTOR ModelCuller::TransformToClip(FXMVECTOR Position) const
+{
+    const XMVECTOR Relative = XMVectorSetW(XMVectorSubtract(Position, m_ViewOrigin), 1.0f);
+    return XMVector4Transform(Relative, m_ViewProjection);
+}
+
+FLOAT ModelCuller::GetProjectedSize(UINT32 Index) const
+{
+    assert(Index < m_SphereCount);
+    const XMVECTOR Clip = TransformToClip(XMVectorSet(m_CenterX[Index], m_CenterY[Index], m_CenterZ[Index], 1.0f));
+    const FLOAT W = XMVectorGetW(Clip);
+    const FLOAT Radius = m_Radius[Index];
+    if (W - Radius * m_ClipRowLengths[3] <= NearClipW)
+    {
+        return 0.0f;
+    }
+    return Radius * m_ClipRowLengths[0] / W;
+}
+
+void ModelCuller::ClearDepth()
+{
+    if (!m_DepthEmpty)
+    {
+        std::fill(m_InvDepth.begin(), m_InvDepth.end(), 0.0f);
+        m_DepthEmpty = true;
+    }
+}
+
+UINT32 ModelCuller::RasterizeOccluder(const Matrix4& ModelToWorld, const BYTE* pVertexData, UINT32 VertexStride,
+    UINT32 VertexCount, const UINT16* pIndices, UINT32 IndexCount)
+{
+    const INT64 StartTick = SystemTime::GetCurrentTick();
+
+    Matrix4 ModelToView(ModelToWorld);
+    ModelToView.SetW(ModelToWorld.GetW() - Vector4(m_ViewOrigin, 0.0f));
+    const Matrix4 ModelToClip = m_ViewProjection * ModelToView;
+
+    // x, y in pixels, z = 1 / w; w < 0 marks vertices behind the near plane
+    std::vector<XMFLOAT4> ScreenVerts(VertexCount);
+    const FLOAT HalfWidth = 0.5f * DepthBufferWidth;
+    const FLOAT HalfHeight = 0.5f * DepthBufferHeight;
+    for (UINT32 i = 0; i < VertexCount; ++i)
+    {
+        const XMVECTOR Position = XMLoadFloat3((const XMFLOAT3*)(pVertexData + i * VertexStride));
+        const XMVECTOR Clip = XMVector3Transform(Position, ModelToClip);
+        const FLOAT W = XMVectorGetW(Clip);
+        XMFLOAT4& SV = ScreenVerts[i];
+        if (W <= NearClipW)
+        {
+            SV = XMFLOAT4(0, 0, 0, -1.0f);
+            continue;
+        }
+        const FLOAT InvW = 1.0f / W;
+        SV.x = (XMVectorGetX(Clip) * InvW + 1.0f) * HalfWidth;
+        SV.y = (1.0f - XMVectorGetY(Clip) * InvW) * HalfHeight;
+        SV.z = InvW;
+        SV.w = 1.0f;
+    }
+
+    UINT32 TriangleCount = 0;
+    for (UINT32 i = 0; i + 2 < IndexCount; i += 3)
+    {
+        const XMFLOAT4& V0 = ScreenVerts[pIndices[i]];
+        const XMFLOAT4& V1 = ScreenVerts[pIndices[i + 1]];
+        const XMFLOAT4& V2 = ScreenVerts[pIndices[i + 2]];
+        if (V0.w < 0.0f || V1.w < 0.0f || V2.w < 0.0f)
+        {
+            continue;
+        }
+
+        // Both windings occlude; dividing by the signed area handles either.
+        const FLOAT Area = (V1.x - V0.x) * (V2.y - V0.y) - (V1.y - V0.y) * (V2.x - V0.x);
+        if (fabsf(Area) < 1e-6f)
+        {
+            continue;
+        }
+        const FLOAT InvArea = 1.0f / Area;
+
+        // Sample at pixel centers
+        const INT32 MinX = std::max((INT32)ceilf(std::min(std::min(V0.x, V1.x), V2.x) - 0.5f), 0);
+        const INT32 MaxX = std::min((INT32)floorf(std::max(std::max(V0.x, V1.x), V2.x) - 0.5f), (INT32)DepthBufferWidth - 1);
+        const INT32 MinY = std::max((INT32)ceilf(std::min(std::min(V0.y, V1.y), V2.y) - 0.5f), 0);
+        const INT32 MaxY = std::min((INT32)floorf(std::max(std::max(V0.y, V1.y), V2.y) - 0.5f), (INT32)DepthBufferHeight - 1);
+        if (MinX > MaxX || MinY > MaxY)
+        {
+            continue;
+        }
+
+        for (INT32 y = MinY; y <= MaxY; ++y)
+        {
+            const FLOAT py = (FLOAT)y + 0.5f;
+            FLOAT* pRow = &m_InvDepth[y * DepthBufferWidth];
+            for (INT32 x = MinX; x <= MaxX; ++x)
+            {
+                const FLOAT px = (FLOAT)x + 0.5f;
+                const FLOAT B0 = ((V1.x - px) * (V2.y - py) - (V1.y - py) * (V2.x - px)) * InvArea;
+                const FLOAT B1 = ((V2.x - px) * (V0.y - py) - (V2.y - py) * (V0.x - px)) * InvArea;
+                const FLOAT B2 = 1.0f - B0 - B1;
+                if (B0 < 0.0f || B1 < 0.0f || B2 < 0.0f)
+                {
+                    continue;
+                }
+                const FLOAT InvDepth = B0 * V0.z + B1 * V1.z + B2 * V2.z;
+                pRow[x] = std::max(pRow[x], InvDepth);
+            }
+        }
+        ++TriangleCount;
+    }
+
+    if (TriangleCount > 0)
+    {
+        m_DepthEmpty = false;
+    }
+    ++m_Stats.OccluderCount;
+    m_Stats.OccluderTriangleCount += TriangleCount;
+    m_Stats.RasterizeMsec += SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - StartTick);
+    return TriangleCount;
+}
+
+bool ModelCuller::IsSphereOccluded(UINT32 Index) const
+{
+    assert(Index < m_SphereCount);
+    if (m_DepthEmpty)
+    {
+        return false;
+    }
+
+    const XMVECTOR Relative = XMVectorSet(m_CenterX[Index] - m_ViewOrigin.GetX(), m_CenterY[Index] - m_ViewOrigin.GetY(), m_CenterZ[Index] - m_ViewOrigin.GetZ(), 1.0f);
+    const FLOAT Radius = m_Radius[Index];
+    const FLOAT CX = XMVectorGetX(XMVector4Dot(Relative, XMLoadFloat4(&m_ClipRows[0])));
+    const FLOAT CY = XMVectorGetX(XMVector4Dot(Relative, XMLoadFloat4(&m_ClipRows[1])));
+    const FLOAT CW = XMVectorGetX(XMVector4Dot(Relative, XMLoadFloat4(&m_ClipRows[3])));
+
+    const FLOAT NearW = CW - Radius * m_ClipRowLengths[3];
+    if (NearW <= NearClipW)
+    {
+        return false;
+    }
+    const FLOAT FarW = CW + Radius * m_ClipRowLengths[3];
+
+    // Every point of the sphere has clip x within CX +/- Radius * |row x| and clip w within
+    // [NearW, FarW], so dividing the interval ends bounds its projection.
+    const FLOAT MinCX = CX - Radius * m_ClipRowLengths[0];
+    const FLOAT MaxCX = CX + Radius * m_ClipRowLengths[0];
+    const FLOAT MinCY = CY - Radius * m_ClipRowLengths[1];
+    const FLOAT MaxCY = CY + Radius * m_ClipRowLengths[1];
+    const FLOAT MinX = std::min(MinCX / NearW, MinCX / FarW);
+    const FLOAT MaxX = std::max(MaxCX / NearW, MaxCX / FarW);
+    const FLOAT MinY = std::min(MinCY / NearW, MinCY / FarW);
+    const FLOAT MaxY = std::max(MaxCY / NearW, MaxCY / FarW);
+
+    const INT32 X0 = std::max((INT32)floorf((MinX + 1.0f) * 0.5f * DepthBufferWidth), 0);
+    const INT32 X1 = std::min((INT32)floorf((MaxX + 1.0f) * 0.5f * DepthBufferWidth), (INT32)DepthBufferWidth - 1);
+    const INT32 Y0 = std::max((INT32)floorf((1.0f - MaxY) * 0.5f * DepthBufferHeight), 0);
+    const INT32 Y1 = std::min((INT32)floorf((1.0f - MinY) * 0.5f * DepthBufferHeight), (INT32)DepthBufferHeight - 1);
+    if (X0 > X1 || Y0 > Y1)
+    {
+        return false;
+    }
+
+    // Hidden only if every covered pixel holds an occluder nearer than the sphere's nearest point
+    const FLOAT SphereInvDepth = 1.0f / NearW;
+    for (INT32 y = Y0; y <= Y1; ++y)
+    {
+        const FLOAT* pRow = &m_InvDepth[y * DepthBufferWidth];
+        for (INT32 x = X0; x <= X1; ++x)
+        {
+            if (pRow[x] <= SphereInvDepth)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+UINT32 ModelCuller::CullOccluded(std::vector<UINT32>& Indices)
+{
+    const INT64 StartTick = SystemTime::GetCurrentTick();
+
+    const size_t StartCount = Indices.size();
+    if (!m_DepthEmpty)
+    {
+        Indices.erase(std::remove_if(Indices.begin(), Indices.end(), [this](UINT32 Index) { return IsSphereOccluded(Index); }), Indices.end());
+    }
+
+    m_Stats.OccludedCount += (UINT32)(StartCount - Indices.size());
+    m_Stats.OcclusionMsec += SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - StartTick);
+    return (UINT32)Indices.size();
+}
+
+bool ModelCuller::Benchmark(UINT32 SphereCount, UINT32 IterationCount)
+{
+    SphereCount = std::max(SphereCount, 1U);
+    IterationCount = std::max(IterationCount, 1U);
+
+    UINT32 Seed = 1;
+    auto Random = [&Seed]() { Seed = Seed * 1664525 + 1013904223; return (FLOAT)(Seed >> 8) / (FLOAT)(1 << 24); };
+
+    // Objects scattered over a 2 km square around a camera at the origin looking down -Z
+    ModelCuller Culler;
+    Culler.ResetSpheres(SphereCount);
+    for (UINT32 i = 0; i < SphereCount; ++i)
+    {
+        const Vector3 Center((Random() - 0.5f) * 2000.0f, Random() * 20.0f, (Random() - 0.5f) * 2000.0f);
+        Culler.SetSphere(i, Center, 1.0f + Random() * 4.0f);
+    }
+
+    const Vector3 ViewOrigin(0.0f, 2.0f, 0.0f);
+    const Matrix4 ViewProjection(XMMatrixPerspectiveFovRH(XM_PIDIV4, 16.0f / 9.0f, 0.5f, 1000.0f));
+
+    Utility::PrintfConsole("Model culling benchmark: %u spheres, %u iterations, %ux%u depth buffer\n",
+        SphereCount, IterationCount, DepthBufferWidth, DepthBufferHeight);
+
+    // One sphere at a time, as Frustum::IntersectSphere does it, summed in the SIMD order
+    Culler.BeginView(ViewProjection, ViewOrigin, true);
+    std::vector<UINT32> Visible;
+    Visible.reserve(SphereCount);
+    INT64 StartTick = SystemTime::GetCurrentTick();
+    for (UINT32 Iteration = 0; Iteration < IterationCount; ++Iteration)
+    {
+        Visible.clear();
+        for (UINT32 i = 0; i < SphereCount; ++i)
+        {
+            bool Inside = true;
+            for (UINT32 p = 0; p < Culler.m_PlaneCount && Inside; ++p)
+            {
+                const XMFLOAT4& Plane = Culler.m_Planes[p];
+                Inside = Culler.m_CenterZ[i] * Plane.z + (Culler.m_CenterY[i] * Plane.y + (Culler.m_CenterX[i] * Plane.x + (Plane.w + Culler.m_Radius[i]))) >= 0.0f;
+            }
+            if (Inside)
+            {
+                Visible.push_back(i);
+            }
+        }
+    }
+    DOUBLE ElapsedMsec = SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - StartTick);
+    const std::vector<UINT32> ScalarVisible(Visible);
+    Utility::PrintfConsole("  Scalar frustum:   %10.1f spheres/ms (%u visible)\n", (DOUBLE)SphereCount * IterationCount / ElapsedMsec, (UINT32)ScalarVisible.size());
+
+    StartTick = SystemTime::GetCurrentTick();
+    for (UINT32 Iteration = 0; Iteration < IterationCount; ++Iteration)
+    {
+        Culler.CullFrustum(Visible);
+    }
+    ElapsedMsec = SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - StartTick);
+    Utility::PrintfConsole("  SIMD frustum:     %10.1f spheres/ms (%u visible)\n", (DOUBLE)SphereCount * IterationCount / ElapsedMsec, (UINT32)Visible.size());
+    bool Valid = (Visible == ScalarVisible);
+
+    // A row of building-sized boxes across the view as occluders
+    const UINT32 OccluderCount = 8;
+    const UINT16 BoxIndices[36] = { 0,1,2, 2,1,3, 4,6,5, 5,6,7, 0,2,4, 4,2,6, 1,5,3, 3,5,7, 0,4,1, 1,4,5, 2,3,6, 6,3,7 };
+    XMFLOAT3 BoxVertices[8];
+    for (UINT32 i = 0; i < 8; ++i)
+    {
+        BoxVertices[i] = XMFLOAT3((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 4) ? 1.0f : -1.0f);
+    }
+
+    const std::vector<UINT32> FrustumVisible(Visible);
+    DOUBLE RasterizeMsec = 0;
+    StartTick = SystemTime::GetCurrentTick();
+    for (UINT32 Iteration = 0; Iteration < IterationCount; ++Iteration)
+    {
+        Culler.BeginView(ViewProjection, ViewOrigin, true);
+        for (UINT32 i = 0; i < OccluderCount; ++i)
+        {
+            const FLOAT X = ((FLOAT)i - (OccluderCount - 1) * 0.5f) * 30.0f;
+            const Matrix4 BoxToWorld(XMMatrixScaling(14.0f, 25.0f, 5.0f) * XMMatrixTranslation(X, 25.0f, -60.0f));
+            Culler.RasterizeOccluder(BoxToWorld, (const BYTE*)BoxVertices, sizeof(XMFLOAT3), 8, BoxIndices, 36);
+        }
+        RasterizeMsec += Culler.GetStats().RasterizeMsec;
+        Visible = FrustumVisible;
+        Culler.CullOccluded(Visible);
+    }
+    ElapsedMsec = SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - StartTick);
+    Utility::PrintfConsole("  Occluders:        %10.3f ms per view (%u boxes, %u triangles)\n", RasterizeMsec / IterationCount,
+        OccluderCount, Culler.GetStats().OccluderTriangleCount);
+    Utility::PrintfConsole("  Occlusion test:   %10.1f spheres/ms (%u of %u hidden)\n", (DOUBLE)FrustumVisible.size() * IterationCount / std::max(ElapsedMsec - RasterizeMsec, 1e-3),
+        Culler.GetStats().OccludedCount, (UINT32)FrustumVisible.size());
+
+    // The survivors keep their order, and every sphere culled lies wholly behind the
+    // occluders' near faces at z = -55
+    Valid = Valid && std::includes(FrustumVisible.begin(), FrustumVisible.end(), Visible.begin(), Visible.end());
+    for (size_t i = 0, j = 0; Valid && i < FrustumVisible.size(); ++i)
+    {
+        const UINT32 Index = FrustumVisible[i];
+        if (j < Visible.size() && Visible[j] == Index)
+        {
+            ++j;
+            continue;
+        }
+        Valid = Culler.m_CenterZ[Index] + Culler.m_Radius[Index] <= -54.9f;
+    }
+
+    return Valid;
+}
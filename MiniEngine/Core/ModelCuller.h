@@ -0,0 +1,92 @@
+#pragma once
+
+#include "VectorMath.h"
+#include <vector>
+
+struct ModelCullStats
+{
+    UINT32 SphereCount;
+    UINT32 FrustumVisibleCount;
+    UINT32 OccluderCount;
+    UINT32 OccluderTriangleCount;
+    UINT32 OccludedCount;
+    DOUBLE FrustumMsec;
+    DOUBLE RasterizeMsec;
+    DOUBLE OcclusionMsec;
+};
+
+// Visibility tests for a set of bounding spheres against one view at a time.  Spheres
+// are stored as separate X/Y/Z/radius arrays and tested against the frustum planes four
+// at a time.  An optional low resolution software depth buffer, filled with the
+// triangles of a few large occluders, then rejects spheres that are hidden behind them.
+//
+// Positions are world space; the view-projection matrix is relative to a view origin,
+// matching the camera-relative transforms used by the model render path.
+class ModelCuller
+{
+public:
+    static const UINT32 DepthBufferWidth = 256;
+    static const UINT32 DepthBufferHeight = 128;
+
+private:
+    std::vector<FLOAT> m_CenterX;
+    std::vector<FLOAT> m_CenterY;
+    std::vector<FLOAT> m_CenterZ;
+    std::vector<FLOAT> m_Radius;
+    UINT32 m_SphereCount;
+
+    Math::Matrix4 m_ViewProjection;
+    Math::Vector3 m_ViewOrigin;
+    XMFLOAT4 m_Planes[6];
+    UINT32 m_PlaneCount;
+
+    // Rows of the transposed view-projection; dotting one with (P - ViewOrigin, 1)
+    // gives that clip space component.
+    XMFLOAT4 m_ClipRows[4];
+    FLOAT m_ClipRowLengths[4];
+
+    // Nearest occluder per pixel, stored as 1 / clip w; zero means empty.
+    std::vector<FLOAT> m_InvDepth;
+    bool m_DepthEmpty;
+
+    ModelCullStats m_Stats;
+
+public:
+    ModelCuller();
+
+    // Sets the number of spheres; the arrays are padded so the SIMD loop can read whole groups.
+    void ResetSpheres(UINT32 Count);
+    void SetSphere(UINT32 Index, const Math::Vector3& Center, FLOAT Radius);
+    UINT32 GetSphereCount() const { return m_SphereCount; }
+
+    // Extracts the frustum planes for the next tests and clears the depth buffer.  Shadow
+    // views pass TestDepthPlanes = false so casters in front of the near plane are kept.
+    void BeginView(const Math::Matrix4& ViewProjection, const Math::Vector3& ViewOrigin, bool TestDepthPlanes);
+
+    // Fills VisibleIndices with the spheres that touch the frustum.
+    UINT32 CullFrustum(std::vector<UINT32>& VisibleIndices);
+
+    // Projected radius over view depth, for ranking occluder candidates.  Zero for spheres
+    // that cross the near plane.
+    FLOAT GetProjectedSize(UINT32 Index) const;
+
+    // Rasterizes an indexed triangle list (16-bit indices, float3 positions) into the
+    // depth buffer.  Triangles crossing the near plane are skipped.
+    UINT32 RasterizeOccluder(const Math::Matrix4& ModelToWorld, const BYTE* pVertexData, UINT32 VertexStride,
+        UINT32 VertexCount, const UINT16* pIndices, UINT32 IndexCount);
+
+    // Removes the indices of spheres hidden behind the rasterized occluders.
+    UINT32 CullOccluded(std::vector<UINT32>& Indices);
+    bool IsSphereOccluded(UINT32 Index) const;
+
+    const ModelCullStats& GetStats() const { return m_Stats; }
+
+    // Times the SIMD frustum test against a scalar loop and the occlusion pass on a
+    // synthetic scene, and checks that both tests agree and only hidden spheres are
+    // culled.  Needs no device.
+    static bool Benchmark(UINT32 SphereCount, UINT32 IterationCount);
+
+private:
+    void ClearDepth();
+    XMVECTOR TransformToClip(FXMVECTOR Position) const;
+};
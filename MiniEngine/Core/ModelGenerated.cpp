@@ -87,6 +87,12 @@ void Model::CompleteCommon(const WCHAR* strName, const CHAR* strDiffuseTexName)
     m_SRVs[3] = MatTextures[0]->GetSRV();
     m_SRVs[4] = MatTextures[0]->GetSRV();
     m_SRVs[5] = MatTextures[0]->GetSRV();
+
+    m_pMaterialTextures = new const ManagedTexture*[kTexturesPerMaterial];
+    for (uint32_t i = 0; i < kTexturesPerMaterial; ++i)
+    {
+        m_pMaterialTextures[i] = MatTextures[i];
+    }
 }
 
 inline void FillVector3(XMFLOAT3* pDest, size_t StrideBytes, uint32_t Count, const XMFLOAT3& Value)
@@ -146,6 +146,9 @@ h3d_save_fail:
 
 void Model::ReleaseTextures()
 {
+	delete [] m_pMaterialTextures;
+	m_pMaterialTextures = nullptr;
+
 	/*
 	if (m_Textures != nullptr)
 	{
@@ -168,6 +171,7 @@ void Model::LoadTextures(void)
 	ReleaseTextures();
 
 	m_SRVs = new D3D12_CPU_DESCRIPTOR_HANDLE[m_Header.materialCount * 6];
+	m_pMaterialTextures = new const ManagedTexture*[m_Header.materialCount * kTexturesPerMaterial];
 
 	const ManagedTexture* MatTextures[6] = {};
 
@@ -213,5 +217,8 @@ void Model::LoadTextures(void)
 		m_SRVs[materialIdx * 6 + 3] = MatTextures[0]->GetSRV();
 		m_SRVs[materialIdx * 6 + 4] = MatTextures[0]->GetSRV();
 		m_SRVs[materialIdx * 6 + 5] = MatTextures[0]->GetSRV();
+
+		for (uint32_t i = 0; i < kTexturesPerMaterial; ++i)
+			m_pMaterialTextures[materialIdx * kTexturesPerMaterial + i] = MatTextures[i];
 	}
 }
@@ -3,10 +3,19 @@
 #include "Model.h"
 #include "LineRender.h"
 #include "TessTerrain.h"
+#include "SystemTime.h"
+#include "EngineTuning.h"
+#include "GraphicsCore.h"
 
 using namespace Math;
 using namespace Graphics;
 
+BoolVar g_ModelFrustumCulling("Graphics/Model Culling/Frustum", true);
+BoolVar g_ModelOcclusionCulling("Graphics/Model Culling/Occlusion", true);
+NumVar g_OccluderMinSize("Graphics/Model Culling/Occluder Min Size", 0.1f, 0.01f, 1.0f, 0.01f);
+IntVar g_MaxOccluders("Graphics/Model Culling/Max Occluders", 8, 0, 64);
+IntVar g_MaxOccluderTriangles("Graphics/Model Culling/Max Occluder Triangles", 4096, 12, 65536, 256);
+
 ModelInstance::~ModelInstance()
 {
     if (m_pVehicle != nullptr)
@@ -183,6 +192,7 @@ bool ModelInstance::IsRemoteNetworkObject() const
 void ModelInstance::SetWorldTransform(const Math::Matrix4& Transform)
 {
     XMStoreFloat4x4(&m_WorldTransform, Transform);
+    m_PhysicsHistoryValid = false;
     if (IsLocalNetworkObject())
     {
         SetNetworkMatrix(Transform, true);
@@ -271,15 +281,33 @@ bool ModelInstance::PrePhysicsUpdate(float deltaT, INT64 ClientTicks)
     return StillAlive;
 }
 
-void ModelInstance::PostPhysicsUpdate(float deltaT)
+void ModelInstance::PostPhysicsUpdate(float deltaT, UINT32 PhysicsSteps, FLOAT InterpolationAlpha)
 {
-    // Copy world transform from rigid body if the rigid body is dynamic
+    // Interpolate world transform between the last two rigid body states if the rigid body is dynamic
     if (m_pRigidBody != nullptr && m_pRigidBody->IsDynamic())
     {
-        const Matrix4 matWorld(m_pRigidBody->GetWorldTransform());
+        if (PhysicsSteps > 0 || !m_PhysicsHistoryValid)
+        {
+            const XMMATRIX matRigidBody = m_pRigidBody->GetWorldTransform();
+            if (m_PhysicsHistoryValid)
+            {
+                m_PrevPhysicsTransform = m_CurrPhysicsTransform;
+            }
+            else
+            {
+                XMStoreFloat4x4(&m_PrevPhysicsTransform, matRigidBody);
+            }
+            XMStoreFloat4x4(&m_CurrPhysicsTransform, matRigidBody);
+            m_PhysicsHistoryValid = true;
+        }
+
+        const Matrix4 matWorld = NetworkTransform::InterpolateTransform(
+            Matrix4(XMLoadFloat4x4(&m_PrevPhysicsTransform)),
+            Matrix4(XMLoadFloat4x4(&m_CurrPhysicsTransform)),
+            InterpolationAlpha);
         XMStoreFloat4x4(&m_WorldTransform, matWorld);
 
-        if (m_pVehicle != nullptr && m_WheelCount > 0)
+        if (m_pVehicle != nullptr && m_WheelCount > 0 && PhysicsSteps > 0)
         {
             assert(m_pWheelData != nullptr);
             for (UINT32 i = 0; i < m_WheelCount; ++i)
@@ -300,82 +328,69 @@ void ModelInstance::PostPhysicsUpdate(float deltaT)
     }
 }
 
-void RenderModel(ModelRenderContext &MRC, Graphics::Model* pModel, const Matrix4& WorldTransform)
+void ModelInstance::QueueRender(ModelRenderQueue& Queue, const ModelRenderContext& MRC) const
 {
-    GraphicsContext* pContext = MRC.pContext;
-
-    assert(pModel->m_InputLayoutIndex != -1);
-    if (MRC.LastInputLayoutIndex != pModel->m_InputLayoutIndex)
+    if (m_pModel == nullptr)
     {
-        GraphicsPSO* pPso = MRC.pPsoCache->SpecializePso(pModel->m_InputLayoutIndex);
-        pContext->SetPipelineState(*pPso);
-        MRC.LastInputLayoutIndex = pModel->m_InputLayoutIndex;
+        LineRender::DrawAxis(GetWorldTransform());
+        return;
     }
 
-    VSModelConstants vsConstants;
-
-    XMVECTOR NewRow3 = XMVectorSelect(g_XMOne, WorldTransform.GetW() - Vector4(MRC.CameraPosition), g_XMSelect1110);
-    Matrix4 WT(WorldTransform);
-    WT.SetW(Vector4(NewRow3));
-
-    vsConstants.modelToProjection = MRC.ViewProjection * WT;
-    vsConstants.modelToShadow = MRC.ModelToShadow * WT;
-    vsConstants.modelToShadowOuter = MRC.ModelToShadowOuter * WT;
-    vsConstants.modelToWorld = WT;
-    XMStoreFloat3(&vsConstants.viewerPos, g_XMZero);
-
-    pContext->SetDynamicConstantBufferView(0, sizeof(vsConstants), &vsConstants);
-
-    uint32_t materialIdx = 0xFFFFFFFFul;
-
-    uint32_t VertexStride = pModel->m_VertexStride;
-
-    pContext->SetIndexBuffer(pModel->m_IndexBuffer.IndexBufferView());
-    pContext->SetVertexBuffer(0, pModel->m_VertexBuffer.VertexBufferView());
-
-    for (unsigned int meshIndex = 0; meshIndex < pModel->m_Header.meshCount; meshIndex++)
+    if (MRC.CurrentPassType == RenderPass_Shadow && !m_RenderInShadowPass)
     {
-        const Model::Mesh& mesh = pModel->m_pMesh[meshIndex];
+        return;
+    }
 
-        uint32_t indexCount = mesh.indexCount;
-        uint32_t startIndex = mesh.indexDataByteOffset / sizeof(uint16_t);
-        uint32_t baseVertex = mesh.vertexDataByteOffset / VertexStride;
+    Queue.AddModel(m_pModel, GetRenderTransform());
 
-        if (mesh.materialIndex != materialIdx)
+    if (m_WheelCount > 0 && m_pTemplate->GetWheelModel() != nullptr)
+    {
+        Model* pWM = m_pTemplate->GetWheelModel();
+        for (UINT32 i = 0; i < m_WheelCount; ++i)
         {
-            materialIdx = mesh.materialIndex;
-            pContext->SetDynamicDescriptors(3, 0, 6, pModel->GetSRVs(materialIdx));
+            Matrix4 WheelTransform = GetWheelTransform(i);
+            Queue.AddModel(pWM, WheelTransform);
         }
-
-        pContext->DrawIndexed(indexCount, startIndex, baseVertex);
     }
 }
 
-void ModelInstance::Render(ModelRenderContext& MRC) const
+Matrix4 ModelInstance::GetRenderTransform() const
 {
-    if (m_pModel == nullptr)
-    {
-        LineRender::DrawAxis(GetWorldTransform());
-        return;
-    }
+    Matrix4 RenderOffset(AffineTransform(m_pTemplate->GetRenderOffset()));
+    return GetScaledWorldTransform() * RenderOffset;
+}
 
-    if (MRC.CurrentPassType == RenderPass_Shadow && !m_RenderInShadowPass)
+static void GetModelBoundingSphere(const Model* pModel, const Matrix4& Transform, Vector3& Center, FLOAT& Radius)
+{
+    const Model::BoundingBox& Box = pModel->GetBoundingBox();
+    Center = Vector3(Transform * ((Box.min + Box.max) * 0.5f));
+
+    const FLOAT MaxScale = std::max(std::max((FLOAT)Length(Vector3(Transform.GetX())), (FLOAT)Length(Vector3(Transform.GetY()))), (FLOAT)Length(Vector3(Transform.GetZ())));
+    Radius = (FLOAT)Length(Box.max - Box.min) * 0.5f * MaxScale;
+}
+
+void ModelInstance::GetRenderBounds(Vector3& Center, FLOAT& Radius) const
+{
+    if (m_pModel == nullptr)
     {
+        // Drawn as an axis marker; never culled
+        Center = GetWorldPosition();
+        Radius = FLT_MAX;
         return;
     }
 
-    Matrix4 WorldTransform = GetScaledWorldTransform();
-    Matrix4 RenderOffset(AffineTransform(m_pTemplate->GetRenderOffset()));
-    Matrix4 RenderTransform = WorldTransform * RenderOffset;
-    RenderModel(MRC, m_pModel, RenderTransform);
+    GetModelBoundingSphere(m_pModel, GetRenderTransform(), Center, Radius);
 
-    if (m_WheelCount > 0 && m_pTemplate->GetWheelModel() != nullptr)
+    Model* pWM = m_pTemplate->GetWheelModel();
+    if (pWM != nullptr)
     {
-        Model* pWM = m_pTemplate->GetWheelModel();
+        // Grow the body sphere to enclose each wheel sphere, keeping its center
         for (UINT32 i = 0; i < m_WheelCount; ++i)
         {
-            Matrix4 WheelTransform = GetWheelTransform(i);
-            RenderModel(MRC, pWM, WheelTransform);
+            Vector3 WheelCenter;
+            FLOAT WheelRadius;
+            GetModelBoundingSphere(pWM, GetWheelTransform(i), WheelCenter, WheelRadius);
+            Radius = std::max(Radius, (FLOAT)Length(WheelCenter - Center) + WheelRadius);
         }
     }
 }
@@ -423,56 +438,120 @@ void World::LoadTerrainConstructionDesc(const CHAR* strFileName)
     m_pTerrainConstructionDesc = (TerrainConstructionDesc*)DataFile::LoadStructFromFile(STRUCT_TEMPLATE_REFERENCE(TerrainConstructionDesc), strFileName);
 }
 
-void World::Initialize(bool GraphicsEnabled, IWorldNotifications* pNotify)
+TerrainBlockCache World::s_TerrainBlockCache;
+
+void World::InitializeTerrainBlockCache(const WCHAR* strFileName, SIZE_T MemoryBudgetBytes, UINT64 MaxDiskBytes)
+{
+    s_TerrainBlockCache.Initialize(strFileName, MemoryBudgetBytes, MaxDiskBytes);
+}
+
+void World::TerminateTerrainBlockCache()
+{
+    if (s_TerrainBlockCache.IsInitialized())
+    {
+        s_TerrainBlockCache.PrintStats();
+        s_TerrainBlockCache.Terminate();
+    }
+}
+
+void World::Initialize(bool GraphicsEnabled, IWorldNotifications* pNotify, DWORD PhysicsFlags)
 {
     m_GraphicsEnabled = GraphicsEnabled;
     m_pNotify = pNotify;
-    m_PhysicsWorld.Initialize(0, XMVectorSet(0, -9.8f, 0, 0));
+    ZeroMemory(&m_LastTickStats, sizeof(m_LastTickStats));
+    m_CullBoundsFrame = UINT64_MAX;
+    m_PhysicsWorld.Initialize(PhysicsFlags, XMVectorSet(0, -9.8f, 0, 0));
     m_TessTerrain.Initialize(GraphicsEnabled, m_pTerrainConstructionDesc);
     m_TerrainPhysicsMap.Initialize(&m_PhysicsWorld, &m_TessTerrain, m_TessTerrain.GetWorldScale() * 0.25f);
     m_TerrainObjectMap.Initialize(&m_TessTerrain, m_TessTerrain.GetWorldScale() * 4.0f);
+
+    if (s_TerrainBlockCache.IsInitialized())
+    {
+        m_TerrainPhysicsMap.SetBlockCache(&s_TerrainBlockCache);
+        m_TerrainObjectMap.SetBlockCache(&s_TerrainBlockCache);
+    }
 }
 
 void World::Tick(float deltaT, INT64 Ticks)
 {
-    auto iter = m_ModelInstances.begin();
-    auto end = m_ModelInstances.end();
-    while (iter != end)
+    INT64 PhaseStartTick = SystemTime::GetCurrentTick();
+    auto EndPhase = [&PhaseStartTick]() -> FLOAT
+    {
+        const INT64 CurrentTick = SystemTime::GetCurrentTick();
+        const FLOAT Msec = (FLOAT)SystemTime::TicksToMillisecs(CurrentTick - PhaseStartTick);
+        PhaseStartTick = CurrentTick;
+        return Msec;
+    };
+
+    // On the client, predict every remote transform and wheel in one pass; the
+    // instances below pick up the results as they lerp.
+    if (Ticks != 0)
+    {
+        g_ClientPredictStore.Evaluate(Ticks);
+    }
+
+    // Pre physics: instances that expire are swapped out of the dense array, so the
+    // slot at index i is revisited without advancing.
+    UINT32 i = 0;
+    while (i < (UINT32)m_ModelInstances.size())
     {
-        ModelInstance* pMI = *iter;
-        auto nextiter = iter;
-        ++nextiter;
+        ModelInstance* pMI = m_ModelInstances[i];
         bool StillAlive = pMI->PrePhysicsUpdate(deltaT, Ticks);
         if (!StillAlive)
         {
-            m_ModelInstances.erase(iter);
+            RemoveModelInstance(pMI);
             if (m_pNotify != nullptr)
             {
                 m_pNotify->ModelInstanceDeleted(pMI);
             }
             delete pMI;
+            continue;
         }
-        iter = nextiter;
+        ++i;
     }
+    m_LastTickStats.PrePhysicsMsec = EndPhase();
 
     m_PhysicsWorld.Update(deltaT);
+    const PhysicsStepStatistics& StepStats = m_PhysicsWorld.GetLastUpdateStatistics();
+    m_LastTickStats.PhysicsSteps = StepStats.StepCount;
+    m_LastTickStats.DroppedPhysicsSteps = StepStats.DroppedStepCount;
+    m_LastTickStats.InterpolationAlpha = StepStats.InterpolationAlpha;
+    m_LastTickStats.PhysicsMsec = EndPhase();
 
-    m_TerrainObjectMap.Update();
+    // Post physics: each instance only touches its own state, so this pass is kept
+    // separate from the terrain tracking pass below.
+    const UINT32 InstanceCount = (UINT32)m_ModelInstances.size();
+    for (i = 0; i < InstanceCount; ++i)
+    {
+        m_ModelInstances[i]->PostPhysicsUpdate(deltaT, StepStats.StepCount, StepStats.InterpolationAlpha);
+    }
+    m_LastTickStats.PostPhysicsMsec = EndPhase();
 
-    iter = m_ModelInstances.begin();
-    end = m_ModelInstances.end();
-    while (iter != end)
+    m_TerrainObjectMap.Update();
+    for (i = 0; i < InstanceCount; ++i)
     {
-        ModelInstance* pMI = *iter++;
-        pMI->PostPhysicsUpdate(deltaT);
+        ModelInstance* pMI = m_ModelInstances[i];
         if (pMI->IsDynamic())
         {
             m_TerrainObjectMap.TrackObject(pMI->GetWorldPosition(), pMI->GetWorldVelocity(), pMI->GetRadius());
             m_TerrainPhysicsMap.TrackObject(pMI->GetWorldPosition(), pMI->GetWorldVelocity(), pMI->GetRadius());
         }
     }
-
     m_TerrainPhysicsMap.Update();
+    m_LastTickStats.TerrainUpdateMsec = EndPhase();
+
+    m_LastTickStats.ModelInstanceCount = InstanceCount;
+}
+
+void World::RemoveModelInstance(ModelInstance* pMI)
+{
+    const UINT32 Index = pMI->m_WorldIndex;
+    assert(Index < m_ModelInstances.size() && m_ModelInstances[Index] == pMI);
+    ModelInstance* pLast = m_ModelInstances.back();
+    m_ModelInstances[Index] = pLast;
+    pLast->m_WorldIndex = Index;
+    m_ModelInstances.pop_back();
+    pMI->m_WorldIndex = UINT32_MAX;
 }
 
 void World::TrackCameraPos(const XMVECTOR& CameraPos)
@@ -485,12 +564,115 @@ void World::Render(ModelRenderContext& MRC)
 {
     assert(m_GraphicsEnabled);
 
-    auto iter = m_ModelInstances.begin();
-    auto end = m_ModelInstances.end();
-    while (iter != end)
+    const UINT32 InstanceCount = (UINT32)m_ModelInstances.size();
+
+    // Instances only move between frames, so the later passes reuse the first pass's bounds
+    const UINT64 FrameIndex = Graphics::GetFrameCount();
+    if (m_CullBoundsFrame != FrameIndex || m_Culler.GetSphereCount() != InstanceCount)
+    {
+        m_Culler.ResetSpheres(InstanceCount);
+        for (UINT32 i = 0; i < InstanceCount; ++i)
+        {
+            Vector3 Center;
+            FLOAT Radius;
+            m_ModelInstances[i]->GetRenderBounds(Center, Radius);
+            m_Culler.SetSphere(i, Center, Radius);
+        }
+        m_CullBoundsFrame = FrameIndex;
+    }
+
+    // Shadow views keep casters outside their depth range; occlusion only applies to the camera
+    const bool IsShadowPass = (MRC.CurrentPassType == RenderPass_Shadow);
+    m_Culler.BeginView(MRC.ViewProjection, MRC.CameraPosition, !IsShadowPass);
+    if (g_ModelFrustumCulling)
+    {
+        m_Culler.CullFrustum(m_VisibleInstances);
+        if (g_ModelOcclusionCulling && !IsShadowPass)
+        {
+            RasterizeOccluders();
+            m_Culler.CullOccluded(m_VisibleInstances);
+        }
+    }
+    else
     {
-        ModelInstance* pMI = *iter++;
-        pMI->Render(MRC);
+        m_VisibleInstances.resize(InstanceCount);
+        for (UINT32 i = 0; i < InstanceCount; ++i)
+        {
+            m_VisibleInstances[i] = i;
+        }
+    }
+
+    // The camera's view of each instance decides how much of its textures' mip chains stay resident
+    if (!IsShadowPass)
+    {
+        const UINT32 VisibleCount = (UINT32)m_VisibleInstances.size();
+        for (UINT32 i = 0; i < VisibleCount; ++i)
+        {
+            const UINT32 InstanceIndex = m_VisibleInstances[i];
+            const Model* pModel = m_ModelInstances[InstanceIndex]->m_pModel;
+            if (pModel != nullptr)
+            {
+                // Zero when the camera is inside the bounds
+                const FLOAT Size = m_Culler.GetProjectedSize(InstanceIndex);
+                pModel->RequestTextureResolution(Size > 0.0f ? (UINT32)(Size * Graphics::g_DisplayWidth) + 1 : Graphics::g_DisplayWidth);
+            }
+        }
+    }
+
+    m_RenderQueue.Begin(MRC.CurrentPassType, MRC.CameraPosition);
+
+    const UINT32 VisibleCount = (UINT32)m_VisibleInstances.size();
+    for (UINT32 i = 0; i < VisibleCount; ++i)
+    {
+        m_ModelInstances[m_VisibleInstances[i]]->QueueRender(m_RenderQueue, MRC);
+    }
+
+    m_RenderQueue.Sort();
+    m_RenderQueue.Submit(MRC);
+}
+
+void World::RasterizeOccluders()
+{
+    // Only a few of the largest visible models are worth rasterizing
+    m_OccluderCandidates.clear();
+    const UINT32 VisibleCount = (UINT32)m_VisibleInstances.size();
+    for (UINT32 i = 0; i < VisibleCount; ++i)
+    {
+        const UINT32 InstanceIndex = m_VisibleInstances[i];
+        const Model* pModel = m_ModelInstances[InstanceIndex]->m_pModel;
+        if (pModel == nullptr || pModel->m_pVertexData == nullptr || pModel->m_pIndexData == nullptr ||
+            pModel->m_Header.indexDataByteSize / (3 * sizeof(UINT16)) > (UINT32)g_MaxOccluderTriangles)
+        {
+            continue;
+        }
+
+        const FLOAT Size = m_Culler.GetProjectedSize(InstanceIndex);
+        if (Size >= g_OccluderMinSize)
+        {
+            m_OccluderCandidates.push_back(std::make_pair(Size, InstanceIndex));
+        }
+    }
+
+    const UINT32 OccluderCount = std::min((UINT32)m_OccluderCandidates.size(), (UINT32)g_MaxOccluders);
+    std::partial_sort(m_OccluderCandidates.begin(), m_OccluderCandidates.begin() + OccluderCount, m_OccluderCandidates.end(),
+        [](const std::pair<FLOAT, UINT32>& A, const std::pair<FLOAT, UINT32>& B) { return A.first > B.first; });
+
+    for (UINT32 i = 0; i < OccluderCount; ++i)
+    {
+        const ModelInstance* pMI = m_ModelInstances[m_OccluderCandidates[i].second];
+        const Model* pModel = pMI->m_pModel;
+        const Matrix4 RenderTransform = pMI->GetRenderTransform();
+        for (UINT32 MeshIndex = 0; MeshIndex < pModel->m_Header.meshCount; ++MeshIndex)
+        {
+            const Model::Mesh& mesh = pModel->m_pMesh[MeshIndex];
+            const Model::Attrib& Position = mesh.attrib[Model::attrib_position];
+            if (Position.format != Model::attrib_format_float || Position.components < 3)
+            {
+                continue;
+            }
+            m_Culler.RasterizeOccluder(RenderTransform, pModel->m_pVertexData + mesh.vertexDataByteOffset + Position.offset, mesh.vertexStride,
+                mesh.vertexCount, (const UINT16*)(pModel->m_pIndexData + mesh.indexDataByteOffset), mesh.indexCount);
+        }
     }
 }
 
@@ -543,7 +725,8 @@ ModelInstance* World::SpawnModelInstance(ModelTemplate* pTemplate, const CHAR* s
 
     if (Success)
     {
-        m_ModelInstances.insert(pMI);
+        pMI->m_WorldIndex = (UINT32)m_ModelInstances.size();
+        m_ModelInstances.push_back(pMI);
     }
     else
     {
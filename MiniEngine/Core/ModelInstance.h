@@ -8,6 +8,8 @@
 #include "ModelTemplate.h"
 #include "TessTerrain.h"
 #include "WorldGridBuilder.h"
+#include "ModelRenderQueue.h"
+#include "ModelCuller.h"
 
 namespace Graphics
 {
@@ -36,6 +38,10 @@ struct ModelRenderContext
     UINT32 LastInputLayoutIndex;
 
     RenderPass CurrentPassType;
+
+    // When set, large passes are recorded on worker threads; this must bind the pass's
+    // targets and root state on a fresh context (see GraphicsContext::RecordParallel).
+    std::function<void(GraphicsContext&)> SetupParallelChunk;
 };
 
 __declspec(align(16))
@@ -127,7 +133,15 @@ private:
     DirectX::XMFLOAT4X4 m_WorldTransform;
     DirectX::XMFLOAT4X4 m_ScaledWorldTransform;
 
+    // The two most recent fixed-step physics states; the world transform of a dynamic
+    // instance is interpolated between them.
+    DirectX::XMFLOAT4X4 m_PrevPhysicsTransform;
+    DirectX::XMFLOAT4X4 m_CurrPhysicsTransform;
+
     bool m_RenderInShadowPass : 1;
+    bool m_PhysicsHistoryValid : 1;
+
+    UINT32 m_WorldIndex;
 
     FLOAT m_LifetimeRemaining;
 
@@ -148,10 +162,12 @@ public:
           m_pVehicle(nullptr),
           m_WheelCount(0),
           m_pWheelData(nullptr),
-          m_LifetimeRemaining(-1)
+          m_LifetimeRemaining(-1),
+          m_WorldIndex(UINT32_MAX)
     { 
         XMStoreFloat4x4(&m_WorldTransform, XMMatrixIdentity());
         m_RenderInShadowPass = true;
+        m_PhysicsHistoryValid = false;
     }
 
     ~ModelInstance();
@@ -176,11 +192,15 @@ public:
     bool IsDynamic() const;
 
     bool PrePhysicsUpdate(float deltaT, INT64 ClientTicks);
-    void PostPhysicsUpdate(float deltaT);
+    void PostPhysicsUpdate(float deltaT, UINT32 PhysicsSteps, FLOAT InterpolationAlpha);
 
     void ServerProcessInput(const NetworkInputState& InputState, FLOAT DeltaTime, DOUBLE AbsoluteTime);
 
-    void Render(ModelRenderContext& MRC) const;
+    void QueueRender(ModelRenderQueue& Queue, const ModelRenderContext& MRC) const;
+
+    // World space bounding sphere of everything QueueRender draws, wheels included
+    void GetRenderBounds(Math::Vector3& Center, FLOAT& Radius) const;
+    Math::Matrix4 GetRenderTransform() const;
 
 private:
     Math::Matrix4 GetWheelTransform(UINT32 WheelIndex) const;
@@ -189,7 +209,7 @@ private:
 };
 
 typedef std::unordered_map<UINT32, ModelInstance*> ModelInstanceMap;
-typedef std::unordered_set<ModelInstance*> ModelInstanceSet;
+typedef std::vector<ModelInstance*> ModelInstanceArray;
 
 interface IWorldNotifications
 {
@@ -197,6 +217,18 @@ public:
     virtual void ModelInstanceDeleted(ModelInstance* pMI) = 0;
 };
 
+struct WorldTickStatistics
+{
+    FLOAT PrePhysicsMsec;
+    FLOAT PhysicsMsec;
+    FLOAT PostPhysicsMsec;
+    FLOAT TerrainUpdateMsec;
+    UINT32 PhysicsSteps;
+    UINT32 DroppedPhysicsSteps;
+    FLOAT InterpolationAlpha;
+    UINT32 ModelInstanceCount;
+};
+
 class World
 {
 private:
@@ -204,21 +236,34 @@ private:
     TessellatedTerrain m_TessTerrain;
     TerrainObjectMap m_TerrainObjectMap;
     TerrainPhysicsMap m_TerrainPhysicsMap;
-    ModelInstanceSet m_ModelInstances;
+    ModelInstanceArray m_ModelInstances;
     bool m_GraphicsEnabled;
 
+    WorldTickStatistics m_LastTickStats;
+    ModelRenderQueue m_RenderQueue;
+
+    // Instance bounds are gathered once per frame and culled per pass
+    ModelCuller m_Culler;
+    UINT64 m_CullBoundsFrame;
+    std::vector<UINT32> m_VisibleInstances;
+    std::vector<std::pair<FLOAT, UINT32>> m_OccluderCandidates;
+
     ModelTemplateMap m_ModelTemplates;
 
     IWorldNotifications* m_pNotify;
 
     static TerrainConstructionDesc* m_pTerrainConstructionDesc;
+    static TerrainBlockCache s_TerrainBlockCache;
 
 public:
     virtual ~World();
 
     static void LoadTerrainConstructionDesc(const CHAR* strFileName);
+    static void InitializeTerrainBlockCache(const WCHAR* strFileName, SIZE_T MemoryBudgetBytes = 64 * 1024 * 1024, UINT64 MaxDiskBytes = 1024 * 1024 * 1024);
+    static void TerminateTerrainBlockCache();
+    static TerrainBlockCache* GetTerrainBlockCache() { return &s_TerrainBlockCache; }
 
-    void Initialize(bool GraphicsEnabled, IWorldNotifications* pNotify);
+    void Initialize(bool GraphicsEnabled, IWorldNotifications* pNotify, DWORD PhysicsFlags = 0);
     void Terminate();
     void Tick(float deltaT, INT64 Ticks);
     void Render(ModelRenderContext& MRC);
@@ -234,5 +279,13 @@ public:
     TerrainObjectMap* GetTerrainObjectMap() { return &m_TerrainObjectMap; }
 
     ModelTemplate* FindOrCreateModelTemplate(const CHAR* strTemplateName);
+
+    const WorldTickStatistics& GetLastTickStatistics() const { return m_LastTickStats; }
+    const ModelRenderQueueStats& GetLastRenderStatistics() const { return m_RenderQueue.GetStats(); }
+    const ModelCullStats& GetLastCullStatistics() const { return m_Culler.GetStats(); }
+
+private:
+    void RemoveModelInstance(ModelInstance* pMI);
+    void RasterizeOccluders();
 };
 
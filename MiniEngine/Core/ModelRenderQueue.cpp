@@ -0,0 +1,384 @@
+#include "pch.h"
+#include "ModelRenderQueue.h"
+#include "ModelInstance.h"
+#include "Model.h"
+#include "SystemTime.h"
+#include <algorithm>
+#include <thread>
+
+using namespace Math;
+using namespace Graphics;
+
+static const UINT32 SortKeyPassShift = 62;
+static const UINT32 SortKeyLayoutShift = 52;
+static const UINT32 SortKeyModelShift = 32;
+static const UINT32 SortKeyDistanceShift = 16;
+
+// Everything above the distance bits; items whose keys match here share a batch.
+static const UINT32 SortKeyBatchShift = SortKeyModelShift;
+
+ModelRenderQueue::ModelRenderQueue()
+    : m_Pass(0),
+      m_BeginTick(0)
+{
+    ZeroMemory(&m_Stats, sizeof(m_Stats));
+}
+
+UINT64 ModelRenderQueue::MakeSortKey(UINT32 Pass, UINT32 InputLayoutIndex, UINT32 ModelSortIndex, FLOAT ViewDistance)
+{
+    // The bit pattern of a non-negative float increases with its value; the top 16
+    // bits below the sign are a logarithmic distance bucket.
+    UINT32 DistanceBits = 0;
+    ViewDistance = std::max(ViewDistance, 0.0f);
+    memcpy(&DistanceBits, &ViewDistance, sizeof(DistanceBits));
+    const UINT64 DistanceBucket = (DistanceBits >> 15) & 0xFFFF;
+
+    return ((UINT64)(Pass & 0x3) << SortKeyPassShift) |
+           ((UINT64)(InputLayoutIndex & 0x3FF) << SortKeyLayoutShift) |
+           ((UINT64)(ModelSortIndex & 0xFFFFF) << SortKeyModelShift) |
+           (DistanceBucket << SortKeyDistanceShift);
+}
+
+void ModelRenderQueue::Begin(UINT32 Pass, const Vector3& CameraPosition)
+{
+    m_Items.clear();
+    m_SortEntries.clear();
+    m_Pass = Pass;
+    m_CameraPosition = CameraPosition;
+    m_BeginTick = SystemTime::GetCurrentTick();
+}
+
+void ModelRenderQueue::AddModel(Model* pModel, const Matrix4& WorldTransform)
+{
+    assert(pModel->m_InputLayoutIndex != -1);
+
+    const FLOAT Distance = Length(Vector3(WorldTransform.GetW()) - m_CameraPosition);
+
+    SortEntry SE;
+    SE.Key = MakeSortKey(m_Pass, pModel->m_InputLayoutIndex, pModel->m_RenderSortIndex, Distance);
+    SE.ItemIndex = (UINT32)m_Items.size();
+    m_SortEntries.push_back(SE);
+
+    Item I;
+    I.WorldTransform = WorldTransform;
+    I.pModel = pModel;
+    m_Items.push_back(I);
+}
+
+UINT32 ModelRenderQueue::RadixSort(std::vector<SortEntry>& Entries, std::vector<SortEntry>& Scratch)
+{
+    const size_t Count = Entries.size();
+    if (Count < 2)
+    {
+        return 0;
+    }
+    Scratch.resize(Count);
+
+    // A digit that is the same in every key cannot change the order, so its pass is
+    // skipped.  Within a single pass the pass and unused bits are always skipped.
+    const UINT64 FirstKey = Entries[0].Key;
+    UINT64 DifferingBits = 0;
+    for (size_t i = 1; i < Count; ++i)
+    {
+        DifferingBits |= Entries[i].Key ^ FirstKey;
+    }
+
+    SortEntry* pSrc = Entries.data();
+    SortEntry* pDest = Scratch.data();
+    UINT32 PassCount = 0;
+
+    for (UINT32 Shift = 0; Shift < 64; Shift += 8)
+    {
+        if (((DifferingBits >> Shift) & 0xFF) == 0)
+        {
+            continue;
+        }
+
+        UINT32 Offsets[256] = {};
+        for (size_t i = 0; i < Count; ++i)
+        {
+            ++Offsets[(pSrc[i].Key >> Shift) & 0xFF];
+        }
+        UINT32 Total = 0;
+        for (UINT32 Digit = 0; Digit < 256; ++Digit)
+        {
+            const UINT32 DigitCount = Offsets[Digit];
+            Offsets[Digit] = Total;
+            Total += DigitCount;
+        }
+        for (size_t i = 0; i < Count; ++i)
+        {
+            pDest[Offsets[(pSrc[i].Key >> Shift) & 0xFF]++] = pSrc[i];
+        }
+
+        std::swap(pSrc, pDest);
+        ++PassCount;
+    }
+
+    if (pSrc != Entries.data())
+    {
+        Entries.swap(Scratch);
+    }
+    return PassCount;
+}
+
+void ModelRenderQueue::Sort()
+{
+    const INT64 SortTick = SystemTime::GetCurrentTick();
+    m_Stats.BuildMsec = SystemTime::TicksToMillisecs(SortTick - m_BeginTick);
+    m_Stats.RadixPasses = RadixSort(m_SortEntries, m_SortScratch);
+    m_Stats.SortMsec = SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - SortTick);
+}
+
+void ModelRenderQueue::Submit(ModelRenderContext& MRC)
+{
+    const INT64 StartTick = SystemTime::GetCurrentTick();
+
+    const UINT32 Count = (UINT32)m_SortEntries.size();
+    m_Stats.ItemCount = Count;
+    m_Stats.BatchCount = 0;
+    m_Stats.DrawCount = 0;
+    m_Stats.PsoChanges = 0;
+    m_Stats.BufferChanges = 0;
+    m_Stats.MaterialChanges = 0;
+    m_Stats.RecordingChunks = 0;
+
+    if (Count == 0)
+    {
+        m_Stats.SubmitMsec = 0;
+        return;
+    }
+
+    // Batch boundaries are found up front so that batches can be dealt out to threads
+    m_BatchStarts.clear();
+    Model* pLastModel = nullptr;
+    for (UINT32 i = 0; i < Count; ++i)
+    {
+        Model* pModel = m_Items[m_SortEntries[i].ItemIndex].pModel;
+        if (pModel != pLastModel)
+        {
+            m_BatchStarts.push_back(i);
+            pLastModel = pModel;
+        }
+    }
+    const UINT32 BatchCount = (UINT32)m_BatchStarts.size();
+    m_BatchStarts.push_back(Count);
+
+    // Each chunk writes the instance constants for its own batches
+    DynAlloc InstanceData = MRC.pContext->ReserveUploadMemory(Count * sizeof(VSModelConstants));
+    VSModelConstants* pInstanceConstants = (VSModelConstants*)InstanceData.DataPtr;
+
+    UINT32 ChunkCount = 1;
+    if (MRC.SetupParallelChunk)
+    {
+        const UINT32 MinItemsPerChunk = 256;
+        const UINT32 MaxChunkCount = std::min(std::max(std::thread::hardware_concurrency(), 1U), 8U);
+        ChunkCount = std::min(std::min(std::max(Count / MinItemsPerChunk, 1U), MaxChunkCount), BatchCount);
+    }
+
+    std::vector<ModelRenderQueueStats> ChunkStats(ChunkCount);
+    ZeroMemory(ChunkStats.data(), ChunkCount * sizeof(ModelRenderQueueStats));
+    UINT32 LastInputLayoutIndex = MRC.LastInputLayoutIndex;
+
+    auto RecordChunk = [&](GraphicsContext& Context, UINT32 ChunkIndex)
+    {
+        const UINT32 FirstBatch = (UINT32)((UINT64)BatchCount * ChunkIndex / ChunkCount);
+        const UINT32 EndBatch = (UINT32)((UINT64)BatchCount * (ChunkIndex + 1) / ChunkCount);
+
+        // Chunk 0 continues the caller's context; the others start with no PSO bound
+        UINT32 ChunkLayoutIndex = (ChunkIndex == 0) ? LastInputLayoutIndex : (UINT32)-1;
+        RecordBatches(Context, MRC, pInstanceConstants, InstanceData.GpuAddress, FirstBatch, EndBatch, &ChunkLayoutIndex, ChunkStats[ChunkIndex]);
+        if (ChunkIndex == 0)
+        {
+            LastInputLayoutIndex = ChunkLayoutIndex;
+        }
+    };
+
+    if (ChunkCount > 1)
+    {
+        MRC.pContext->RecordParallel(ChunkCount, MRC.SetupParallelChunk, RecordChunk);
+    }
+    else
+    {
+        RecordChunk(*MRC.pContext, 0);
+    }
+    MRC.LastInputLayoutIndex = LastInputLayoutIndex;
+
+    for (UINT32 i = 0; i < ChunkCount; ++i)
+    {
+        m_Stats.BatchCount += ChunkStats[i].BatchCount;
+        m_Stats.DrawCount += ChunkStats[i].DrawCount;
+        m_Stats.PsoChanges += ChunkStats[i].PsoChanges;
+        m_Stats.BufferChanges += ChunkStats[i].BufferChanges;
+        m_Stats.MaterialChanges += ChunkStats[i].MaterialChanges;
+    }
+    m_Stats.RecordingChunks = ChunkCount;
+    m_Stats.SubmitMsec = SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - StartTick);
+}
+
+void ModelRenderQueue::RecordBatches(GraphicsContext& Context, const ModelRenderContext& MRC, VSModelConstants* pInstanceConstants,
+    D3D12_GPU_VIRTUAL_ADDRESS InstanceGpuAddress, UINT32 FirstBatch, UINT32 EndBatch, UINT32* pLastInputLayoutIndex,
+    ModelRenderQueueStats& Stats) const
+{
+    if (FirstBatch >= EndBatch)
+    {
+        return;
+    }
+
+    const UINT32 FirstItem = m_BatchStarts[FirstBatch];
+    const UINT32 EndItem = m_BatchStarts[EndBatch];
+    for (UINT32 i = FirstItem; i < EndItem; ++i)
+    {
+        const Item& I = m_Items[m_SortEntries[i].ItemIndex];
+
+        XMVECTOR NewRow3 = XMVectorSelect(g_XMOne, I.WorldTransform.GetW() - Vector4(MRC.CameraPosition), g_XMSelect1110);
+        Matrix4 WT(I.WorldTransform);
+        WT.SetW(Vector4(NewRow3));
+
+        VSModelConstants& vsConstants = pInstanceConstants[i];
+        vsConstants.modelToProjection = MRC.ViewProjection * WT;
+        vsConstants.modelToShadow = MRC.ModelToShadow * WT;
+        vsConstants.modelToShadowOuter = MRC.ModelToShadowOuter * WT;
+        vsConstants.modelToWorld = WT;
+        XMStoreFloat3(&vsConstants.viewerPos, g_XMZero);
+    }
+    Context.SetBufferSRV(2, InstanceGpuAddress);
+
+    for (UINT32 BatchIndex = FirstBatch; BatchIndex < EndBatch; ++BatchIndex)
+    {
+        const UINT32 BatchStart = m_BatchStarts[BatchIndex];
+        const UINT32 InstanceCount = m_BatchStarts[BatchIndex + 1] - BatchStart;
+        Model* pModel = m_Items[m_SortEntries[BatchStart].ItemIndex].pModel;
+
+        if (*pLastInputLayoutIndex != pModel->m_InputLayoutIndex)
+        {
+            GraphicsPSO* pPso = MRC.pPsoCache->SpecializePso(pModel->m_InputLayoutIndex);
+            Context.SetPipelineState(*pPso);
+            *pLastInputLayoutIndex = pModel->m_InputLayoutIndex;
+            ++Stats.PsoChanges;
+        }
+
+        Context.SetConstants(5, BatchStart);
+        Context.SetIndexBuffer(pModel->m_IndexBuffer.IndexBufferView());
+        Context.SetVertexBuffer(0, pModel->m_VertexBuffer.VertexBufferView());
+        ++Stats.BufferChanges;
+
+        const UINT32 VertexStride = pModel->m_VertexStride;
+        UINT32 MaterialIndex = 0xFFFFFFFF;
+        for (UINT32 MeshIndex = 0; MeshIndex < pModel->m_Header.meshCount; ++MeshIndex)
+        {
+            const Model::Mesh& mesh = pModel->m_pMesh[MeshIndex];
+
+            if (mesh.materialIndex != MaterialIndex)
+            {
+                MaterialIndex = mesh.materialIndex;
+                Context.SetDynamicDescriptors(3, 0, 6, pModel->GetSRVs(MaterialIndex));
+                pModel->MarkTexturesVisible(MaterialIndex);
+                ++Stats.MaterialChanges;
+            }
+
+            const UINT32 StartIndex = mesh.indexDataByteOffset / sizeof(uint16_t);
+            const UINT32 BaseVertex = mesh.vertexDataByteOffset / VertexStride;
+            Context.DrawIndexedInstanced(mesh.indexCount, InstanceCount, StartIndex, BaseVertex, 0);
+            ++Stats.DrawCount;
+        }
+
+        ++Stats.BatchCount;
+    }
+}
+
+bool ModelRenderQueue::Benchmark(UINT32 ItemCount, UINT32 ModelCount, UINT32 IterationCount)
+{
+    const UINT32 LayoutCount = 4;
+    const UINT32 MeshesPerModel = 4;
+    ModelCount = std::max(ModelCount, 1U);
+    IterationCount = std::max(IterationCount, 1U);
+
+    struct SyntheticItem
+    {
+        UINT32 ModelIndex;
+        FLOAT Distance;
+    };
+    std::vector<SyntheticItem> Items(ItemCount);
+    UINT32 Seed = 1;
+    auto Random = [&Seed]() { Seed = Seed * 1664525 + 1013904223; return Seed >> 8; };
+    for (UINT32 i = 0; i < ItemCount; ++i)
+    {
+        Items[i].ModelIndex = Random() % ModelCount;
+        Items[i].Distance = (FLOAT)(Random() % 100000) * 0.01f;
+    }
+
+    Utility::PrintfConsole("Render queue benchmark: %u items, %u models, %u layouts, %u meshes per model, %u iterations\n",
+        ItemCount, ModelCount, LayoutCount, MeshesPerModel, IterationCount);
+
+    // State changes when drawing in submission order, one instance at a time
+    UINT32 UnsortedPsoChanges = 0;
+    UINT32 LastLayout = UINT32_MAX;
+    for (UINT32 i = 0; i < ItemCount; ++i)
+    {
+        const UINT32 Layout = Items[i].ModelIndex % LayoutCount;
+        UnsortedPsoChanges += (Layout != LastLayout) ? 1 : 0;
+        LastLayout = Layout;
+    }
+
+    std::vector<SortEntry> Entries(ItemCount);
+    std::vector<SortEntry> Scratch;
+    UINT32 RadixPasses = 0;
+
+    INT64 StartTick = SystemTime::GetCurrentTick();
+    for (UINT32 Iteration = 0; Iteration < IterationCount; ++Iteration)
+    {
+        for (UINT32 i = 0; i < ItemCount; ++i)
+        {
+            const SyntheticItem& SI = Items[i];
+            Entries[i].Key = MakeSortKey(0, SI.ModelIndex % LayoutCount, SI.ModelIndex, SI.Distance);
+            Entries[i].ItemIndex = i;
+        }
+        RadixPasses = RadixSort(Entries, Scratch);
+    }
+    DOUBLE ElapsedMsec = SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - StartTick);
+    Utility::PrintfConsole("  Build + radix sort:     %10.1f keys/ms (%u passes)\n", (DOUBLE)ItemCount * IterationCount / ElapsedMsec, RadixPasses);
+    const std::vector<SortEntry> RadixEntries(Entries);
+
+    StartTick = SystemTime::GetCurrentTick();
+    for (UINT32 Iteration = 0; Iteration < IterationCount; ++Iteration)
+    {
+        for (UINT32 i = 0; i < ItemCount; ++i)
+        {
+            const SyntheticItem& SI = Items[i];
+            Entries[i].Key = MakeSortKey(0, SI.ModelIndex % LayoutCount, SI.ModelIndex, SI.Distance);
+            Entries[i].ItemIndex = i;
+        }
+        std::sort(Entries.begin(), Entries.end(), [](const SortEntry& A, const SortEntry& B) { return A.Key < B.Key; });
+    }
+    ElapsedMsec = SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - StartTick);
+    Utility::PrintfConsole("  Build + std::sort:      %10.1f keys/ms\n", (DOUBLE)ItemCount * IterationCount / ElapsedMsec);
+
+    // std::sort is not stable, so only the keys must come out in the same order
+    bool Valid = true;
+    for (UINT32 i = 0; i < ItemCount && Valid; ++i)
+    {
+        Valid = (RadixEntries[i].Key == Entries[i].Key);
+    }
+
+    // State changes in sorted order with instances of the same model merged
+    UINT32 SortedPsoChanges = 0;
+    UINT32 BatchCount = 0;
+    UINT64 LastBatchKey = UINT64_MAX;
+    UINT64 LastLayoutKey = UINT64_MAX;
+    for (UINT32 i = 0; i < ItemCount; ++i)
+    {
+        const UINT64 BatchKey = Entries[i].Key >> SortKeyBatchShift;
+        const UINT64 LayoutKey = Entries[i].Key >> SortKeyLayoutShift;
+        BatchCount += (BatchKey != LastBatchKey) ? 1 : 0;
+        SortedPsoChanges += (LayoutKey != LastLayoutKey) ? 1 : 0;
+        LastBatchKey = BatchKey;
+        LastLayoutKey = LayoutKey;
+    }
+
+    Utility::PrintfConsole("  PSO changes:      %8u -> %8u\n", UnsortedPsoChanges, SortedPsoChanges);
+    Utility::PrintfConsole("  IB/VB changes:    %8u -> %8u\n", ItemCount, BatchCount);
+    Utility::PrintfConsole("  Material changes: %8u -> %8u\n", ItemCount * MeshesPerModel, BatchCount * MeshesPerModel);
+    Utility::PrintfConsole("  Draw calls:       %8u -> %8u\n", ItemCount * MeshesPerModel, BatchCount * MeshesPerModel);
+    return Valid;
+}
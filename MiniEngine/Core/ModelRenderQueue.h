@@ -0,0 +1,89 @@
+#pragma once
+
+#include "VectorMath.h"
+#include <vector>
+
+namespace Graphics
+{
+    class Model;
+}
+struct ModelRenderContext;
+struct VSModelConstants;
+class GraphicsContext;
+
+struct ModelRenderQueueStats
+{
+    UINT32 ItemCount;
+    UINT32 BatchCount;
+    UINT32 DrawCount;
+    UINT32 PsoChanges;
+    UINT32 BufferChanges;
+    UINT32 MaterialChanges;
+    UINT32 RadixPasses;
+    UINT32 RecordingChunks;
+    DOUBLE BuildMsec;
+    DOUBLE SortMsec;
+    DOUBLE SubmitMsec;
+};
+
+// Collects the models drawn in one pass, sorts them by a 64-bit state key and submits
+// them with redundant state changes removed.  Consecutive instances of the same model
+// become a single instanced draw per mesh; per-instance constants are read by the
+// vertex shader from a structured buffer at root parameter 2, offset by the first
+// instance index in root constant 5.  Large passes are split into chunks of batches
+// recorded on worker threads when the render context allows it.
+class ModelRenderQueue
+{
+private:
+    struct Item
+    {
+        Math::Matrix4 WorldTransform;
+        Graphics::Model* pModel;
+    };
+
+    struct SortEntry
+    {
+        UINT64 Key;
+        UINT32 ItemIndex;
+    };
+
+    std::vector<Item> m_Items;
+    std::vector<SortEntry> m_SortEntries;
+    std::vector<SortEntry> m_SortScratch;
+    std::vector<UINT32> m_BatchStarts;
+
+    UINT32 m_Pass;
+    Math::Vector3 m_CameraPosition;
+    INT64 m_BeginTick;
+
+    ModelRenderQueueStats m_Stats;
+
+public:
+    ModelRenderQueue();
+
+    // Key layout, most significant bits first: pass (2), input layout (10), model (20),
+    // view distance (16), unused (16).  Materials belong to a model, so grouping by
+    // model also groups material changes; distance orders each model's instances front
+    // to back without splitting the batch.
+    static UINT64 MakeSortKey(UINT32 Pass, UINT32 InputLayoutIndex, UINT32 ModelSortIndex, FLOAT ViewDistance);
+
+    void Begin(UINT32 Pass, const Math::Vector3& CameraPosition);
+    void AddModel(Graphics::Model* pModel, const Math::Matrix4& WorldTransform);
+    void Sort();
+    void Submit(ModelRenderContext& MRC);
+
+    UINT32 GetItemCount() const { return (UINT32)m_Items.size(); }
+    const ModelRenderQueueStats& GetStats() const { return m_Stats; }
+
+    // Times key building and sorting on synthetic data, checks the radix sort against
+    // std::sort and reports the state changes saved against drawing in submission order.
+    // Needs no device.
+    static bool Benchmark(UINT32 ItemCount, UINT32 ModelCount, UINT32 IterationCount);
+
+private:
+    static UINT32 RadixSort(std::vector<SortEntry>& Entries, std::vector<SortEntry>& Scratch);
+
+    void RecordBatches(GraphicsContext& Context, const ModelRenderContext& MRC, VSModelConstants* pInstanceConstants,
+        D3D12_GPU_VIRTUAL_ADDRESS InstanceGpuAddress, UINT32 FirstBatch, UINT32 EndBatch, UINT32* pLastInputLayoutIndex,
+        ModelRenderQueueStats& Stats) const;
+};
@@ -1,9 +1,12 @@
 #include "pch.h"
 #include "ClientPredict.h"
+#include "SystemTime.h"
+#include <random>
 
 using namespace DirectX;
 
 ClientPredictionConstants g_ClientPredictConstants = {};
+ClientPredictStore g_ClientPredictStore;
 LARGE_INTEGER g_LerpThresholdTicks = { UINT_MAX, 0 };
 
 XMVECTOR ClientPredictVector<XMFLOAT3>::GetZeroValue() const
@@ -139,3 +142,382 @@ XMVECTOR ClientPredictVector<T>::GetPredictedValue(INT64 Timestamp)
 
 template XMVECTOR ClientPredictVector<XMFLOAT3>::GetPredictedValue(INT64 Timestamp);
 template XMVECTOR ClientPredictVector<XMFLOAT4>::GetPredictedValue(INT64 Timestamp);
+
+// Evaluated ticks of a slot whose result is out of date
+static const INT64 NotEvaluated = INT64_MIN;
+
+void ClientPredictStore::ComponentArrays::Store(UINT32 Slot, FXMVECTOR Value)
+{
+    XMFLOAT4 Components;
+    XMStoreFloat4(&Components, Value);
+    X[Slot] = Components.x;
+    Y[Slot] = Components.y;
+    Z[Slot] = Components.z;
+    W[Slot] = Components.w;
+}
+
+ClientPredictStore::ClientPredictStore()
+    : m_Enabled(true)
+{
+    // Slot zero is never handed out, so zeroed objects have no slot
+    m_PositionSlots.SlotCount = 1;
+    m_OrientationSlots.SlotCount = 1;
+}
+
+UINT32 ClientPredictStore::AllocateSlot(SlotAllocator& Allocator)
+{
+    if (!Allocator.FreeSlots.empty())
+    {
+        const UINT32 Slot = Allocator.FreeSlots.back();
+        Allocator.FreeSlots.pop_back();
+        return Slot;
+    }
+    return Allocator.SlotCount++;
+}
+
+void ClientPredictStore::GrowPositionSlots(UINT32 Count)
+{
+    // Padded to whole groups of four so that Evaluate never reads past the end
+    const UINT32 PaddedCount = (Count + 63) & ~63U;
+    if (PaddedCount <= (UINT32)m_ExtrapolatedTicks.size())
+    {
+        return;
+    }
+    m_Extrapolated.Resize(PaddedCount);
+    m_Trend.Resize(PaddedCount);
+    m_ExtrapolatedTicks.resize(PaddedCount, 0);
+    m_PredictedPosition.Resize(PaddedCount);
+    m_PositionLerp.resize(PaddedCount, 0.0f);
+    m_PositionEvaluatedTicks.resize(PaddedCount, NotEvaluated);
+}
+
+void ClientPredictStore::GrowOrientationSlots(UINT32 Count)
+{
+    const UINT32 PaddedCount = (Count + 63) & ~63U;
+    if (PaddedCount <= (UINT32)m_CurrentRecvTicks.size())
+    {
+        return;
+    }
+    m_PrevOrientation.Resize(PaddedCount);
+    m_CurrentOrientation.Resize(PaddedCount);
+    m_PrevRecvTicks.resize(PaddedCount, 0);
+    m_CurrentRecvTicks.resize(PaddedCount, 0);
+    m_PredictedOrientation.Resize(PaddedCount);
+    m_OrientationLerp.resize(PaddedCount, 0.0f);
+    m_OrientationEvaluatedTicks.resize(PaddedCount, NotEvaluated);
+}
+
+UINT32 ClientPredictStore::AllocatePositionSlot()
+{
+    if (!m_Enabled)
+    {
+        return InvalidSlot;
+    }
+    const UINT32 Slot = AllocateSlot(m_PositionSlots);
+    GrowPositionSlots(m_PositionSlots.SlotCount);
+    return Slot;
+}
+
+void ClientPredictStore::FreePositionSlot(UINT32 Slot)
+{
+    assert(Slot != InvalidSlot && Slot < m_PositionSlots.SlotCount);
+
+    // A free slot is never extrapolated
+    m_ExtrapolatedTicks[Slot] = 0;
+    m_PositionEvaluatedTicks[Slot] = NotEvaluated;
+    m_PositionSlots.FreeSlots.push_back(Slot);
+}
+
+void ClientPredictStore::SetPosition(UINT32 Slot, FXMVECTOR Extrapolated, FXMVECTOR Trend, INT64 ExtrapolatedTicks)
+{
+    m_Extrapolated.Store(Slot, Extrapolated);
+    m_Trend.Store(Slot, Trend);
+    m_ExtrapolatedTicks[Slot] = ExtrapolatedTicks;
+    m_PositionEvaluatedTicks[Slot] = NotEvaluated;
+}
+
+bool ClientPredictStore::ConsumePosition(UINT32 Slot, INT64 CurrentTime, XMFLOAT3* pExtrapolated, FLOAT* pLerpValue)
+{
+    if (m_PositionEvaluatedTicks[Slot] != CurrentTime)
+    {
+        return false;
+    }
+
+    // The extrapolation advances to the evaluated time, exactly as the scalar Lerp would
+    pExtrapolated->x = m_Extrapolated.X[Slot] = m_PredictedPosition.X[Slot];
+    pExtrapolated->y = m_Extrapolated.Y[Slot] = m_PredictedPosition.Y[Slot];
+    pExtrapolated->z = m_Extrapolated.Z[Slot] = m_PredictedPosition.Z[Slot];
+    *pLerpValue = m_PositionLerp[Slot];
+    m_ExtrapolatedTicks[Slot] = CurrentTime;
+    m_PositionEvaluatedTicks[Slot] = NotEvaluated;
+    return true;
+}
+
+UINT32 ClientPredictStore::AllocateOrientationSlot()
+{
+    if (!m_Enabled)
+    {
+        return InvalidSlot;
+    }
+    const UINT32 Slot = AllocateSlot(m_OrientationSlots);
+    GrowOrientationSlots(m_OrientationSlots.SlotCount);
+    return Slot;
+}
+
+void ClientPredictStore::FreeOrientationSlot(UINT32 Slot)
+{
+    assert(Slot != InvalidSlot && Slot < m_OrientationSlots.SlotCount);
+
+    m_PrevRecvTicks[Slot] = 0;
+    m_CurrentRecvTicks[Slot] = 0;
+    m_OrientationEvaluatedTicks[Slot] = NotEvaluated;
+    m_OrientationSlots.FreeSlots.push_back(Slot);
+}
+
+void ClientPredictStore::SetOrientation(UINT32 Slot, FXMVECTOR Prev, FXMVECTOR Current, INT64 PrevRecvTicks, INT64 CurrentRecvTicks)
+{
+    m_PrevOrientation.Store(Slot, Prev);
+    m_CurrentOrientation.Store(Slot, Current);
+    m_PrevRecvTicks[Slot] = PrevRecvTicks;
+    m_CurrentRecvTicks[Slot] = CurrentRecvTicks;
+    m_OrientationEvaluatedTicks[Slot] = NotEvaluated;
+}
+
+bool ClientPredictStore::GetPredictedOrientation(UINT32 Slot, INT64 CurrentTime, XMVECTOR* pResult, FLOAT* pLerpValue) const
+{
+    if (m_OrientationEvaluatedTicks[Slot] != CurrentTime)
+    {
+        return false;
+    }
+
+    *pResult = m_PredictedOrientation.Load(Slot);
+    *pLerpValue = m_OrientationLerp[Slot];
+    return true;
+}
+
+void ClientPredictStore::Evaluate(INT64 CurrentTime)
+{
+    if (!m_Enabled)
+    {
+        return;
+    }
+
+    const DOUBLE FrameTickLength = (DOUBLE)g_ClientPredictConstants.FrameTickLength;
+
+    // Positions: ExpFilteredVector3::Lerp, four slots at a time.  Slots that have not started
+    // extrapolating keep their value and are left for the scalar path, which returns it as is.
+    for (UINT32 i = 0; i < m_PositionSlots.SlotCount; i += 4)
+    {
+        XMVECTORF32 LerpValue;
+        XMVECTORU32 Moving;
+        for (UINT32 j = 0; j < 4; ++j)
+        {
+            const INT64 LastTicks = m_ExtrapolatedTicks[i + j];
+            LerpValue.f[j] = (FLOAT)((DOUBLE)(CurrentTime - LastTicks) / FrameTickLength);
+            Moving.u[j] = LastTicks > 0 ? 0xFFFFFFFF : 0;
+            m_PositionEvaluatedTicks[i + j] = LastTicks > 0 ? CurrentTime : NotEvaluated;
+        }
+
+        const XMVECTOR X = XMLoadFloat4((const XMFLOAT4*)&m_Extrapolated.X[i]);
+        const XMVECTOR Y = XMLoadFloat4((const XMFLOAT4*)&m_Extrapolated.Y[i]);
+        const XMVECTOR Z = XMLoadFloat4((const XMFLOAT4*)&m_Extrapolated.Z[i]);
+        const XMVECTOR TrendX = XMLoadFloat4((const XMFLOAT4*)&m_Trend.X[i]);
+        const XMVECTOR TrendY = XMLoadFloat4((const XMFLOAT4*)&m_Trend.Y[i]);
+        const XMVECTOR TrendZ = XMLoadFloat4((const XMFLOAT4*)&m_Trend.Z[i]);
+
+        XMStoreFloat4((XMFLOAT4*)&m_PredictedPosition.X[i], XMVectorSelect(X, XMVectorAdd(X, XMVectorMultiply(TrendX, LerpValue)), Moving));
+        XMStoreFloat4((XMFLOAT4*)&m_PredictedPosition.Y[i], XMVectorSelect(Y, XMVectorAdd(Y, XMVectorMultiply(TrendY, LerpValue)), Moving));
+        XMStoreFloat4((XMFLOAT4*)&m_PredictedPosition.Z[i], XMVectorSelect(Z, XMVectorAdd(Z, XMVectorMultiply(TrendZ, LerpValue)), Moving));
+        XMStoreFloat4((XMFLOAT4*)&m_PositionLerp[i], LerpValue);
+    }
+
+    // Orientations: StateDelta::LerpQuaternion, with XMQuaternionSlerp written out across
+    // four slots in the same order of operations.  Slots without two samples return the
+    // previous sample and are left for the scalar path.
+    static const XMVECTORF32 OneMinusEpsilon = { 1.0f - 0.00001f, 1.0f - 0.00001f, 1.0f - 0.00001f, 1.0f - 0.00001f };
+    for (UINT32 i = 0; i < m_OrientationSlots.SlotCount; i += 4)
+    {
+        XMVECTORF32 LerpValue;
+        for (UINT32 j = 0; j < 4; ++j)
+        {
+            const bool Moving = m_CurrentRecvTicks[i + j] > m_PrevRecvTicks[i + j];
+            LerpValue.f[j] = (FLOAT)((DOUBLE)(CurrentTime - m_CurrentRecvTicks[i + j]) / FrameTickLength);
+            m_OrientationEvaluatedTicks[i + j] = Moving ? CurrentTime : NotEvaluated;
+        }
+
+        const XMVECTOR X0 = XMLoadFloat4((const XMFLOAT4*)&m_PrevOrientation.X[i]);
+        const XMVECTOR Y0 = XMLoadFloat4((const XMFLOAT4*)&m_PrevOrientation.Y[i]);
+        const XMVECTOR Z0 = XMLoadFloat4((const XMFLOAT4*)&m_PrevOrientation.Z[i]);
+        const XMVECTOR W0 = XMLoadFloat4((const XMFLOAT4*)&m_PrevOrientation.W[i]);
+        const XMVECTOR X1 = XMLoadFloat4((const XMFLOAT4*)&m_CurrentOrientation.X[i]);
+        const XMVECTOR Y1 = XMLoadFloat4((const XMFLOAT4*)&m_CurrentOrientation.Y[i]);
+        const XMVECTOR Z1 = XMLoadFloat4((const XMFLOAT4*)&m_CurrentOrientation.Z[i]);
+        const XMVECTOR W1 = XMLoadFloat4((const XMFLOAT4*)&m_CurrentOrientation.W[i]);
+
+        // XMVector4Dot sums (x + z) and (y + w) pairs
+        XMVECTOR CosOmega = XMVectorAdd(
+            XMVectorAdd(XMVectorMultiply(Y0, Y1), XMVectorMultiply(W0, W1)),
+            XMVectorAdd(XMVectorMultiply(X0, X1), XMVectorMultiply(Z0, Z1)));
+
+        const XMVECTOR Sign = XMVectorSelect(g_XMOne, g_XMNegativeOne, XMVectorLess(CosOmega, XMVectorZero()));
+        CosOmega = XMVectorMultiply(CosOmega, Sign);
+        const XMVECTOR UseSin = XMVectorLess(CosOmega, OneMinusEpsilon);
+
+        const XMVECTOR SinOmega = XMVectorSqrt(XMVectorSubtract(g_XMOne, XMVectorMultiply(CosOmega, CosOmega)));
+        const XMVECTOR Omega = XMVectorATan2(SinOmega, CosOmega);
+
+        const XMVECTOR T0 = XMVectorAdd(g_XMOne, XMVectorNegate(LerpValue));
+        const XMVECTOR T1 = LerpValue;
+        const XMVECTOR S0 = XMVectorSelect(T0, XMVectorDivide(XMVectorSin(XMVectorMultiply(T0, Omega)), SinOmega), UseSin);
+        const XMVECTOR S1 = XMVectorMultiply(XMVectorSelect(T1, XMVectorDivide(XMVectorSin(XMVectorMultiply(T1, Omega)), SinOmega), UseSin), Sign);
+
+        XMStoreFloat4((XMFLOAT4*)&m_PredictedOrientation.X[i], XMVectorAdd(XMVectorMultiply(X0, S0), XMVectorMultiply(S1, X1)));
+        XMStoreFloat4((XMFLOAT4*)&m_PredictedOrientation.Y[i], XMVectorAdd(XMVectorMultiply(Y0, S0), XMVectorMultiply(S1, Y1)));
+        XMStoreFloat4((XMFLOAT4*)&m_PredictedOrientation.Z[i], XMVectorAdd(XMVectorMultiply(Z0, S0), XMVectorMultiply(S1, Z1)));
+        XMStoreFloat4((XMFLOAT4*)&m_PredictedOrientation.W[i], XMVectorAdd(XMVectorMultiply(W0, S0), XMVectorMultiply(S1, W1)));
+        XMStoreFloat4((XMFLOAT4*)&m_OrientationLerp[i], LerpValue);
+    }
+}
+
+bool ClientPredictStore::Benchmark(UINT32 ObjectCount, UINT32 FrameCount)
+{
+    const ClientPredictionConstants SavedConstants = g_ClientPredictConstants;
+    const bool WasEnabled = g_ClientPredictStore.IsEnabled();
+
+    // Microsecond ticks, 15 Hz snapshots and client frames between 50 and 70 Hz
+    const INT64 ServerTickLength = 1000000 / 15;
+    g_ClientPredictConstants.FrameTickLength = ServerTickLength;
+
+    std::mt19937 Random(1234);
+    std::uniform_real_distribution<FLOAT> Unit(-1.0f, 1.0f);
+    std::uniform_int_distribution<INT32> FrameLength(1000000 / 70, 1000000 / 50);
+
+    // The batched objects take slots when they receive their first value; the scalar
+    // objects receive theirs while the store is disabled, so they never do
+    ExpFilteredVector3* pBatchPositions = new ExpFilteredVector3[ObjectCount];
+    StateFloat4Delta* pBatchOrientations = new StateFloat4Delta[ObjectCount];
+    ExpFilteredVector3* pScalarPositions = new ExpFilteredVector3[ObjectCount];
+    StateFloat4Delta* pScalarOrientations = new StateFloat4Delta[ObjectCount];
+    std::vector<XMFLOAT4> BatchResults(ObjectCount * 2);
+    std::vector<XMFLOAT4> ScalarResults(ObjectCount * 2);
+
+    INT64 CurrentTime = ServerTickLength;
+    INT64 NextSnapshotTime = CurrentTime;
+    INT64 BatchTicks = 0;
+    INT64 ScalarTicks = 0;
+    UINT32 MismatchCount = 0;
+    FLOAT MaxDifference = 0.0f;
+
+    // The batch repeats the scalar order of operations, so the bits must match; the largest
+    // difference only shows how far off a mismatch is
+    auto Compare = [&](FXMVECTOR Batched, FXMVECTOR Scalar, FLOAT BatchedLerp, FLOAT ScalarLerp)
+    {
+        const FLOAT Difference = XMVectorGetX(XMVector4Length(XMVectorSubtract(Batched, Scalar)));
+        MaxDifference = std::max(MaxDifference, Difference);
+        if (!XMVector4EqualInt(Batched, Scalar) || !XMVector4EqualInt(XMVectorReplicate(BatchedLerp), XMVectorReplicate(ScalarLerp)))
+        {
+            ++MismatchCount;
+        }
+    };
+
+    for (UINT32 Frame = 0; Frame < FrameCount; ++Frame)
+    {
+        CurrentTime += FrameLength(Random);
+
+        // Snapshots that arrived since the last frame, each missing a few objects
+        while (NextSnapshotTime <= CurrentTime)
+        {
+            LARGE_INTEGER Timestamp;
+            Timestamp.QuadPart = NextSnapshotTime;
+            for (UINT32 i = 0; i < ObjectCount; ++i)
+            {
+                if ((Random() & 7) == 0)
+                {
+                    continue;
+                }
+
+                const XMVECTOR Position = XMVectorSet(Unit(Random) * 1000.0f, Unit(Random) * 10.0f, Unit(Random) * 1000.0f, 0.0f);
+
+                // Some orientations repeat, which takes the linear blend in the slerp
+                XMVECTOR Orientation = pScalarOrientations[i].GetRawValue();
+                if ((Random() & 3) != 0 || XMVector4Equal(Orientation, XMVectorZero()))
+                {
+                    Orientation = XMQuaternionNormalize(XMVectorSet(Unit(Random), Unit(Random), Unit(Random), Unit(Random) + 1.5f));
+                }
+
+                g_ClientPredictStore.SetEnabled(true);
+                pBatchPositions[i].ReceiveNewValue(Position, Timestamp);
+                pBatchOrientations[i].ReceiveNewValue(Orientation, Timestamp);
+                g_ClientPredictStore.SetEnabled(false);
+                pScalarPositions[i].ReceiveNewValue(Position, Timestamp);
+                pScalarOrientations[i].ReceiveNewValue(Orientation, Timestamp);
+            }
+            NextSnapshotTime += ServerTickLength;
+        }
+
+        // The occasional discontinuity
+        for (UINT32 i = 0; i < ObjectCount; ++i)
+        {
+            if (Random() % 128 == 0)
+            {
+                pBatchPositions[i].ResetPrediction();
+                pBatchOrientations[i].ResetPrediction();
+                pScalarPositions[i].ResetPrediction();
+                pScalarOrientations[i].ResetPrediction();
+            }
+        }
+
+        g_ClientPredictStore.SetEnabled(true);
+        INT64 StartTick = SystemTime::GetCurrentTick();
+        g_ClientPredictStore.Evaluate(CurrentTime);
+        for (UINT32 i = 0; i < ObjectCount; ++i)
+        {
+            XMStoreFloat4(&BatchResults[i * 2], pBatchPositions[i].Lerp(CurrentTime));
+            XMStoreFloat4(&BatchResults[i * 2 + 1], pBatchOrientations[i].LerpQuaternion(CurrentTime));
+        }
+        BatchTicks += SystemTime::GetCurrentTick() - StartTick;
+
+        StartTick = SystemTime::GetCurrentTick();
+        for (UINT32 i = 0; i < ObjectCount; ++i)
+        {
+            XMStoreFloat4(&ScalarResults[i * 2], pScalarPositions[i].Lerp(CurrentTime));
+            XMStoreFloat4(&ScalarResults[i * 2 + 1], pScalarOrientations[i].LerpQuaternion(CurrentTime));
+        }
+        ScalarTicks += SystemTime::GetCurrentTick() - StartTick;
+
+        for (UINT32 i = 0; i < ObjectCount; ++i)
+        {
+            Compare(XMLoadFloat4(&BatchResults[i * 2]), XMLoadFloat4(&ScalarResults[i * 2]),
+                pBatchPositions[i].GetLerpValue(), pScalarPositions[i].GetLerpValue());
+            Compare(XMLoadFloat4(&BatchResults[i * 2 + 1]), XMLoadFloat4(&ScalarResults[i * 2 + 1]),
+                pBatchOrientations[i].GetLerpValue(), pScalarOrientations[i].GetLerpValue());
+        }
+
+        // NetworkTransform asks twice per frame, and the second answer must agree too
+        for (UINT32 i = 0; i < ObjectCount; ++i)
+        {
+            Compare(pBatchPositions[i].Lerp(CurrentTime), pScalarPositions[i].Lerp(CurrentTime),
+                pBatchPositions[i].GetLerpValue(), pScalarPositions[i].GetLerpValue());
+            Compare(pBatchOrientations[i].LerpQuaternion(CurrentTime), pScalarOrientations[i].LerpQuaternion(CurrentTime),
+                pBatchOrientations[i].GetLerpValue(), pScalarOrientations[i].GetLerpValue());
+        }
+    }
+
+    delete[] pBatchPositions;
+    delete[] pBatchOrientations;
+    delete[] pScalarPositions;
+    delete[] pScalarOrientations;
+    g_ClientPredictConstants = SavedConstants;
+    g_ClientPredictStore.SetEnabled(WasEnabled);
+
+    const DOUBLE ScalarMsec = SystemTime::TicksToMillisecs(ScalarTicks) / std::max(FrameCount, 1U);
+    const DOUBLE BatchMsec = SystemTime::TicksToMillisecs(BatchTicks) / std::max(FrameCount, 1U);
+    const bool Passed = (MismatchCount == 0);
+
+    Utility::PrintfConsole("Client prediction benchmark: %u objects x %u frames\n", ObjectCount, FrameCount);
+    Utility::PrintfConsole("  Scalar:              %8.4f ms/frame\n", ScalarMsec);
+    Utility::PrintfConsole("  Batched:             %8.4f ms/frame (%.2fx)\n", BatchMsec, BatchMsec > 0.0 ? ScalarMsec / BatchMsec : 0.0);
+    Utility::PrintfConsole("  Bitwise mismatches:  %u (max difference %g)\n", MismatchCount, MaxDifference);
+
+    return Passed;
+}
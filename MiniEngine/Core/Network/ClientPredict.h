@@ -66,6 +66,89 @@ private:
 typedef ClientPredictVector<XMFLOAT3> PredictionFloat3;
 typedef ClientPredictVector<XMFLOAT4> PredictionQuaternion;
 
+// Prediction state of every remote position (ExpFilteredVector3) and orientation
+// (StateDelta), kept as separate arrays per component so that Evaluate can advance all of
+// them to the frame's time four at a time, with lane masks in place of the per-object
+// state branches.  The objects stay authoritative: they take a slot when the decoder first
+// gives them a value, mirror their state into it whenever it changes, and their Lerp
+// calls pick up the evaluated result when it was computed for the same time and nothing
+// changed since.  Otherwise they fall back to the scalar path, which gives the same values.
+//
+// Slots are taken and evaluated on the thread that decodes client snapshots.
+class ClientPredictStore
+{
+public:
+    static const UINT32 InvalidSlot = 0;
+
+private:
+    struct ComponentArrays
+    {
+        std::vector<FLOAT> X, Y, Z, W;
+
+        void Resize(UINT32 Count) { X.resize(Count, 0.0f); Y.resize(Count, 0.0f); Z.resize(Count, 0.0f); W.resize(Count, 0.0f); }
+        XMVECTOR Load(UINT32 Slot) const { return XMVectorSet(X[Slot], Y[Slot], Z[Slot], W[Slot]); }
+        void Store(UINT32 Slot, FXMVECTOR Value);
+    };
+
+    struct SlotAllocator
+    {
+        UINT32 SlotCount;
+        std::vector<UINT32> FreeSlots;
+    };
+
+    bool m_Enabled;
+
+    // Positions: the ExpFilteredVector3 extrapolation, then the results of Evaluate
+    SlotAllocator m_PositionSlots;
+    ComponentArrays m_Extrapolated;
+    ComponentArrays m_Trend;
+    std::vector<INT64> m_ExtrapolatedTicks;
+    ComponentArrays m_PredictedPosition;
+    std::vector<FLOAT> m_PositionLerp;
+    std::vector<INT64> m_PositionEvaluatedTicks;
+
+    // Orientations: the two StateDelta samples, then the results of Evaluate
+    SlotAllocator m_OrientationSlots;
+    ComponentArrays m_PrevOrientation;
+    ComponentArrays m_CurrentOrientation;
+    std::vector<INT64> m_PrevRecvTicks;
+    std::vector<INT64> m_CurrentRecvTicks;
+    ComponentArrays m_PredictedOrientation;
+    std::vector<FLOAT> m_OrientationLerp;
+    std::vector<INT64> m_OrientationEvaluatedTicks;
+
+public:
+    ClientPredictStore();
+
+    // While disabled, no slots are handed out and Evaluate does nothing
+    void SetEnabled(bool Enabled) { m_Enabled = Enabled; }
+    bool IsEnabled() const { return m_Enabled; }
+
+    UINT32 AllocatePositionSlot();
+    void FreePositionSlot(UINT32 Slot);
+    void SetPosition(UINT32 Slot, FXMVECTOR Extrapolated, FXMVECTOR Trend, INT64 ExtrapolatedTicks);
+    bool ConsumePosition(UINT32 Slot, INT64 CurrentTime, XMFLOAT3* pExtrapolated, FLOAT* pLerpValue);
+
+    UINT32 AllocateOrientationSlot();
+    void FreeOrientationSlot(UINT32 Slot);
+    void SetOrientation(UINT32 Slot, FXMVECTOR Prev, FXMVECTOR Current, INT64 PrevRecvTicks, INT64 CurrentRecvTicks);
+    bool GetPredictedOrientation(UINT32 Slot, INT64 CurrentTime, XMVECTOR* pResult, FLOAT* pLerpValue) const;
+
+    // Predicts every slot for the given time; call once per frame before the objects' Lerps
+    void Evaluate(INT64 CurrentTime);
+
+    // Feeds the same random network samples to batched and scalar objects over many frames,
+    // checks that their predictions agree and compares the time spent predicting.
+    static bool Benchmark(UINT32 ObjectCount, UINT32 FrameCount);
+
+private:
+    UINT32 AllocateSlot(SlotAllocator& Allocator);
+    void GrowPositionSlots(UINT32 Count);
+    void GrowOrientationSlots(UINT32 Count);
+};
+
+extern ClientPredictStore g_ClientPredictStore;
+
 template <typename T>
 struct StateDelta
 {
@@ -75,6 +158,7 @@ private:
     LARGE_INTEGER CurrentRecvTimestamp;
     LARGE_INTEGER PreviousRecvTimestamp;
     FLOAT PrevLerpValue;
+    UINT32 PredictSlot;
 
 private:
     static inline void StateStore(XMFLOAT3* pValue, CXMVECTOR v) { XMStoreFloat3(pValue, v); }
@@ -82,6 +166,17 @@ private:
     static inline XMVECTOR StateLoad(const XMFLOAT3* pValue) { return XMLoadFloat3(pValue); }
     static inline XMVECTOR StateLoad(const XMFLOAT4* pValue) { return XMLoadFloat4(pValue); }
 
+    void MirrorState()
+    {
+        if (PredictSlot != ClientPredictStore::InvalidSlot)
+        {
+            g_ClientPredictStore.SetOrientation(PredictSlot, StateLoad(&PrevValue), StateLoad(&CurrentValue), PreviousRecvTimestamp.QuadPart, CurrentRecvTimestamp.QuadPart);
+        }
+    }
+
+    StateDelta(const StateDelta&) = delete;
+    StateDelta& operator=(const StateDelta&) = delete;
+
 public:
     StateDelta()
     {
@@ -90,11 +185,20 @@ public:
         CurrentRecvTimestamp.QuadPart = 0;
         PreviousRecvTimestamp.QuadPart = 0;
         PrevLerpValue = 0;
+        PredictSlot = ClientPredictStore::InvalidSlot;
+    }
+
+    ~StateDelta()
+    {
+        if (PredictSlot != ClientPredictStore::InvalidSlot)
+        {
+            g_ClientPredictStore.FreeOrientationSlot(PredictSlot);
+        }
     }
 
     const T* GetRawData() const { return &CurrentValue; }
     XMVECTOR GetRawValue() const { return StateLoad(&CurrentValue); }
-    void SetRawValue(CXMVECTOR Value) { StateStore(&CurrentValue, Value); }
+    void SetRawValue(CXMVECTOR Value) { StateStore(&CurrentValue, Value); MirrorState(); }
     INT64 GetSampleTime() const { return CurrentRecvTimestamp.QuadPart; }
     XMVECTOR GetCurrentValue() { return Lerp(GetSampleTime()); }
     XMVECTOR GetCurrentValueQuaternion() { return LerpQuaternion(GetSampleTime()); }
@@ -107,6 +211,7 @@ public:
         CurrentRecvTimestamp.QuadPart = 0;
         PreviousRecvTimestamp.QuadPart = 0;
         PrevLerpValue = 0;
+        MirrorState();
     }
 
     VOID ReceiveNewValue(const XMVECTOR Value, LARGE_INTEGER CurrentTimestamp)
@@ -116,6 +221,13 @@ public:
         StateStore(&CurrentValue, Value);
         CurrentRecvTimestamp = CurrentTimestamp;
         PrevLerpValue = 0;
+
+        // Only decoded values are predicted, so only remote objects take a slot
+        if (PredictSlot == ClientPredictStore::InvalidSlot)
+        {
+            PredictSlot = g_ClientPredictStore.AllocateOrientationSlot();
+        }
+        MirrorState();
     }
 
     void ResetPrediction()
@@ -123,6 +235,7 @@ public:
         PrevValue = CurrentValue;
         PreviousRecvTimestamp = CurrentRecvTimestamp;
         PrevLerpValue = 0;
+        MirrorState();
     }
 
     inline XMVECTOR Lerp(INT64 CurrentTime)
@@ -157,6 +270,13 @@ public:
 
     inline XMVECTOR LerpQuaternion(INT64 CurrentTime)
     {
+        XMVECTOR Evaluated;
+        if (PredictSlot != ClientPredictStore::InvalidSlot &&
+            g_ClientPredictStore.GetPredictedOrientation(PredictSlot, CurrentTime, &Evaluated, &PrevLerpValue))
+        {
+            return Evaluated;
+        }
+
         const XMVECTOR Prev = StateLoad(&PrevValue);
         if (CurrentRecvTimestamp.QuadPart <= PreviousRecvTimestamp.QuadPart)
         {
@@ -197,19 +317,40 @@ private:
     INT64 m_LastReceivedTicks;
     INT64 m_LastExtrapolatedTicks;
     FLOAT m_PrevLerpValue;
+    UINT32 m_PredictSlot;
 
 private:
     static inline void StateStore(XMFLOAT3* pValue, CXMVECTOR v) { XMStoreFloat3(pValue, v); }
     static inline XMVECTOR StateLoad(const XMFLOAT3* pValue) { return XMLoadFloat3(pValue); }
 
+    void MirrorState()
+    {
+        if (m_PredictSlot != ClientPredictStore::InvalidSlot)
+        {
+            g_ClientPredictStore.SetPosition(m_PredictSlot, StateLoad(&m_CurrentExtrapolatedValue), StateLoad(&m_CurrentTrend), m_LastExtrapolatedTicks);
+        }
+    }
+
+    ExpFilteredVector3(const ExpFilteredVector3&) = delete;
+    ExpFilteredVector3& operator=(const ExpFilteredVector3&) = delete;
+
 public:
     ExpFilteredVector3()
     {
+        m_PredictSlot = ClientPredictStore::InvalidSlot;
         XMFLOAT3 ZeroValue;
         StateStore(&ZeroValue, g_XMIdentityR3);
         Reset(ZeroValue);
     }
 
+    ~ExpFilteredVector3()
+    {
+        if (m_PredictSlot != ClientPredictStore::InvalidSlot)
+        {
+            g_ClientPredictStore.FreePositionSlot(m_PredictSlot);
+        }
+    }
+
     const XMFLOAT3* GetRawData() const { return &m_LastReceivedValue; }
     XMVECTOR GetRawValue() const { return StateLoad(&m_LastReceivedValue); }
     void SetRawValue(CXMVECTOR Value) { StateStore(&m_LastReceivedValue, Value); }
@@ -224,10 +365,18 @@ public:
         m_LastExtrapolatedTicks = 0;
         m_LastReceivedTicks = 0;
         m_PrevLerpValue = 0;
+        MirrorState();
     }
 
     void ReceiveNewValue(const XMVECTOR Value, LARGE_INTEGER CurrentTimestamp)
     {
+        // Only decoded values are predicted, so only remote objects take a slot
+        if (m_PredictSlot == ClientPredictStore::InvalidSlot)
+        {
+            m_PredictSlot = g_ClientPredictStore.AllocatePositionSlot();
+            MirrorState();
+        }
+
         if (m_LastExtrapolatedTicks != 0 && CurrentTimestamp.QuadPart > m_LastExtrapolatedTicks)
         {
             Lerp(CurrentTimestamp.QuadPart);
@@ -245,6 +394,7 @@ public:
         static const FLOAT TrendSmoothingFactor = 0.9f;
         XMVECTOR SmoothedTrend = XMVectorLerp(LastTrend, NewTrend, TrendSmoothingFactor) + Error;
         StateStore(&m_CurrentTrend, SmoothedTrend);
+        MirrorState();
     }
 
     void ResetPrediction()
@@ -253,10 +403,18 @@ public:
         Reset(m_CurrentExtrapolatedValue);
         m_LastReceivedTicks = Ticks;
         m_LastExtrapolatedTicks = Ticks;
+        MirrorState();
     }
 
     inline XMVECTOR Lerp(INT64 CurrentTime)
     {
+        if (m_PredictSlot != ClientPredictStore::InvalidSlot &&
+            g_ClientPredictStore.ConsumePosition(m_PredictSlot, CurrentTime, &m_CurrentExtrapolatedValue, &m_PrevLerpValue))
+        {
+            m_LastExtrapolatedTicks = CurrentTime;
+            return StateLoad(&m_CurrentExtrapolatedValue);
+        }
+
         XMVECTOR ExtrapolatedValue = StateLoad(&m_CurrentExtrapolatedValue);
         if (m_LastExtrapolatedTicks > 0)
         {
@@ -265,6 +423,7 @@ public:
             StateStore(&m_CurrentExtrapolatedValue, ExtrapolatedValue);
             m_LastExtrapolatedTicks = CurrentTime;
             m_PrevLerpValue = LerpValue;
+            MirrorState();
         }
         return ExtrapolatedValue;
     }
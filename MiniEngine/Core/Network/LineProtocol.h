@@ -14,6 +14,8 @@ enum class NetPacketType
     NodeCreateComplex = 7,
     NodeDelete = 8,
     UnreliableMessage = 9,
+    ReliableFragment = 10,
+    ReliableAck = 11,
 };
 
 static const CHAR* g_strPacketTypes[] =
@@ -28,6 +30,8 @@ static const CHAR* g_strPacketTypes[] =
     "NodeCreateComplex",
     "NodeDelete",
     "UnreliableMessage",
+    "ReliableFragment",
+    "ReliableAck",
 };
 
 struct NetPacketHeader
@@ -66,6 +70,7 @@ public:
         case NetPacketType::Acknowledge:
         case NetPacketType::BeginSnapshot:
         case NetPacketType::EndSnapshot:
+        case NetPacketType::ReliableAck:
             return TRUE;
         default:
             return FALSE;
@@ -122,6 +127,34 @@ struct NetPacketReliableMessage : public NetPacketHeader
     UINT32 GetOpcode() const { return PayloadID; }
 };
 
+// One piece of a reliable payload too large for a single message.  Fragments take
+// consecutive unique indices and are reassembled in order before delivery.
+struct NetPacketReliableFragment : public NetPacketHeader
+{
+    UINT32 UniqueIndex;
+    USHORT FragmentIndex;
+    USHORT FragmentCount;
+
+    NetPacketReliableFragment() : NetPacketHeader( NetPacketType::ReliableFragment, sizeof(*this) ) {}
+
+    VOID SetOpcode( UINT32 Opcode ) { PayloadID = Opcode; }
+    UINT32 GetOpcode() const { return PayloadID; }
+};
+
+// Selective acknowledgement of reliable messages: every index up to and including the
+// base has arrived, and bit N of the mask is set if index base + 2 + offset + N has
+// arrived.  Receivers send one per run of 32 indices that holds any buffered messages.
+struct NetPacketReliableAck : public NetPacketHeader
+{
+    UINT32 MaskOffset;
+    UINT32 ReceivedMask;
+
+    NetPacketReliableAck() : NetPacketHeader( NetPacketType::ReliableAck, sizeof(*this) ) {}
+
+    VOID SetBaseIndex( UINT32 Index ) { Sequence = Index; }
+    UINT32 GetBaseIndex() const { return Sequence; }
+};
+
 struct NetPacketUnreliableMessage : public NetPacketHeader
 {
     NetPacketUnreliableMessage() : NetPacketHeader( NetPacketType::UnreliableMessage, sizeof(*this) ) {}
@@ -208,6 +241,8 @@ inline SIZE_T NetPacketHeader::GetFixedPacketSizeBytes() const
         return sizeof(NetPacketBeginSnapshot);
     case NetPacketType::EndSnapshot:
         return sizeof(NetPacketEndSnapshot);
+    case NetPacketType::ReliableAck:
+        return sizeof(NetPacketReliableAck);
     default:
         assert(FALSE);
         return 0;
@@ -2,6 +2,7 @@
 #include "NetClientBase.h"
 #include "StateObjects.h"
 #include "LineProtocol.h"
+#include "CpuProfiler.h"
 
 NetClientBase::NetClientBase()
     : m_hThread( INVALID_HANDLE_VALUE ),
@@ -9,7 +10,6 @@ NetClientBase::NetClientBase()
       m_ConnectionState( ConnectionState::Disconnected ),
       m_Disconnect( FALSE ),
       m_DataReceivedRecently( TRUE ),
-      m_LastReliableMessageIndex( 0 ),
       m_PacketDiscardFraction( 0 )
 {
     m_pNullSnapshot = new StateSnapshot( 0 );
@@ -199,7 +199,7 @@ HRESULT NetClientBase::ReceiveFromServer()
         //     DbgPrint( "Received %u bytes from %s port %u\n", BytesReceived, strAddress, Addr.sin_port );
         AllocatePacketQueue();
         assert(m_pCurrentPacketQueue != nullptr);
-        hr = NetDecoder::DecodePacket( nullptr, &m_LastReliableMessageIndex, &m_DecodeHandlers, nullptr, ReceiveBuffer, BytesReceived, m_pCurrentStats, m_pCurrentPacketQueue, &m_DecoderLog );
+        hr = NetDecoder::DecodePacket( nullptr, &m_SendQueue.GetReliableChannel(), &m_DecodeHandlers, nullptr, ReceiveBuffer, BytesReceived, m_pCurrentStats, m_pCurrentPacketQueue, &m_DecoderLog );
         if( FAILED(hr) )
         {
             return hr;
@@ -559,6 +559,8 @@ void NetClientBase::SingleThreadedConnectedTick(LARGE_INTEGER &CurrentTime)
 {
     m_CurrentTime = CurrentTime.QuadPart;
 
+    CPU_PROFILE_SCOPE("Client Net Tick");
+
     g_CurrentRecvTimestamp = CurrentTime;
     HRESULT hr = ReceiveFromServer();
     if (FAILED(hr))
@@ -583,7 +585,10 @@ void NetClientBase::SingleThreadedConnectedTick(LARGE_INTEGER &CurrentTime)
         m_ClientLastTime = CurrentTime.QuadPart;
 
         // Add locally generated state to snapshot and queue any reliable messages:
-        TickClient(DeltaTime, AbsoluteTime, pCurrentSnapshot, &m_SendQueue);
+        {
+            CPU_PROFILE_SCOPE("Tick Client");
+            TickClient(DeltaTime, AbsoluteTime, pCurrentSnapshot, &m_SendQueue);
+        }
 
         m_SendQueue.QueueSnapshot(pCurrentSnapshot);
 
@@ -62,8 +62,6 @@ private:
     typedef std::unordered_map<UINT, INetworkObject*> RemoteProxyObjectMap;
     RemoteProxyObjectMap m_RemoteProxies;
 
-    UINT32 m_LastReliableMessageIndex;
-
     NetworkClientMap m_NetworkClients;
 
     NetFrameStatistics m_Statistics[10];
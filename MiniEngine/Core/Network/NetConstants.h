@@ -10,7 +10,17 @@
 
 #define NET_MAX_RELIABLE_MESSAGE_SIZE_BYTES 512
 
-#define NET_PROTOCOL_VERSION 5
+// Larger reliable payloads are split into fragments of one message each
+#define NET_MAX_RELIABLE_PAYLOAD_SIZE_BYTES ( 1024 * 1024 )
+
+// Reliable messages in flight per connection; the receiver buffers as many out of order
+#define NET_RELIABLE_WINDOW_SIZE 256
+
+// Default reliable send rate per connection
+#define NET_RELIABLE_RATE_LIMIT_BYTES_PER_SECOND ( 256 * 1024 )
+#define NET_RELIABLE_RATE_BURST_BYTES ( 16 * 1024 )
+
+#define NET_PROTOCOL_VERSION 6
 
 #define NET_STRING_SIZEBYTES 64
 
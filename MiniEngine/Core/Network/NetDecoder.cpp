@@ -6,13 +6,18 @@
 #include "NetShared.h"
 
 #include "PacketQueue.h"
+#include "ReliableChannel.h"
+#include "LatencyHistogram.h"
+
+static LatencyHistogram g_NetDecodeHistogram("NetDecode");
 
 VOID DebugSpew( const CHAR* strFormat, ... );
 
-HRESULT NetDecoder::DecodePacket( VOID* pSenderContext, UINT32* pLastReliableMessageIndex, IDecodeHandler* pDecodeHandler, StateInputOutput* pStateIO, const BYTE* pPacket, UINT32 PacketSizeBytes, NetFrameStatistics* pStats, PacketQueue* pQueue, NetDecoderLog* pLog )
+HRESULT NetDecoder::DecodePacket( VOID* pSenderContext, ReliableChannel* pReliableChannel, IDecodeHandler* pDecodeHandler, StateInputOutput* pStateIO, const BYTE* pPacket, UINT32 PacketSizeBytes, NetFrameStatistics* pStats, PacketQueue* pQueue, NetDecoderLog* pLog )
 {
     assert( pPacket != nullptr );
     assert( PacketSizeBytes > 0 );
+    ScopedLatencyTimer DecodeTimer( g_NetDecodeHistogram );
     if (pStateIO == nullptr)
     {
         assert(pPacket != nullptr);
@@ -33,7 +38,7 @@ HRESULT NetDecoder::DecodePacket( VOID* pSenderContext, UINT32* pLastReliableMes
         {
         case NetPacketType::ReliableMessage:
             {
-                assert(pLastReliableMessageIndex != nullptr);
+                assert(pReliableChannel != nullptr);
                 auto* pPacket = (const NetPacketReliableMessage*)p;
 
                 assert( pPacket->GetByteCount() >= sizeof(NetPacketReliableMessage) );
@@ -42,19 +47,49 @@ HRESULT NetDecoder::DecodePacket( VOID* pSenderContext, UINT32* pLastReliableMes
 
                 if( pLog != nullptr ) { pLog->LogMessage( (UINT32)NetPacketType::ReliableMessage, 0, 0, (UINT32)pPacket->GetByteCount() ); }
 
-                if( pPacket->UniqueIndex > *pLastReliableMessageIndex )
+                if( pStats != nullptr ) { pStats->ReliableMessageBytesReceived += (UINT32)pPacket->GetByteCount(); }
+                BOOL MessageHandled = pReliableChannel->Receive( pSenderContext, pDecodeHandler, pPacket->UniqueIndex, pPacket->GetOpcode(), 0, 1, pPayload, (UINT32)PayloadSizeBytes, pStats );
+                if( !MessageHandled )
                 {
-                    if( pStats != nullptr ) { pStats->ReliableMessagesReceived++; pStats->ReliableMessageBytesReceived += (UINT32)pPacket->GetByteCount(); }
-                    BOOL MessageHandled = pDecodeHandler->HandleReliableMessage( pSenderContext, pPacket->GetOpcode(), pPacket->UniqueIndex, pPayload, (UINT32)PayloadSizeBytes );
-                    *pLastReliableMessageIndex = pPacket->UniqueIndex;
+                    // Outside the window, or a payload larger than any sender may queue
+                    return E_FAIL;
                 }
-                else
+
+                break;
+            }
+        case NetPacketType::ReliableFragment:
+            {
+                assert(pReliableChannel != nullptr);
+                auto* pPacket = (const NetPacketReliableFragment*)p;
+
+                assert( pPacket->GetByteCount() >= sizeof(NetPacketReliableFragment) );
+                SIZE_T PayloadSizeBytes = pPacket->GetByteCount() - sizeof(NetPacketReliableFragment);
+                const BYTE* pPayload = PayloadSizeBytes == 0 ? nullptr : p + sizeof(NetPacketReliableFragment);
+
+                if( pLog != nullptr ) { pLog->LogMessage( (UINT32)NetPacketType::ReliableFragment, pPacket->FragmentIndex, 0, (UINT32)pPacket->GetByteCount() ); }
+
+                if( pStats != nullptr ) { pStats->ReliableMessageBytesReceived += (UINT32)pPacket->GetByteCount(); }
+                BOOL MessageHandled = pReliableChannel->Receive( pSenderContext, pDecodeHandler, pPacket->UniqueIndex, pPacket->GetOpcode(), pPacket->FragmentIndex, pPacket->FragmentCount, pPayload, (UINT32)PayloadSizeBytes, pStats );
+                if( !MessageHandled )
                 {
-                    // duplicate message; skip
-                    //DebugSpew( "Skipped duplicate reliable message %u\n", pPacket->UniqueIndex );
-                    if( pStats != nullptr ) { pStats->DuplicateReliableMessagesSkipped++; }
+                    // Outside the window, or part of a payload larger than any sender may queue
+                    return E_FAIL;
                 }
 
+                break;
+            }
+        case NetPacketType::ReliableAck:
+            {
+                assert(pReliableChannel != nullptr);
+                auto* pPacket = (const NetPacketReliableAck*)p;
+
+                if( pLog != nullptr ) { pLog->LogMessage( (UINT32)NetPacketType::ReliableAck, pPacket->GetBaseIndex(), 0, (UINT32)pPacket->GetByteCount() ); }
+
+                if( pStats != nullptr ) { pStats->ReliableAcksReceived++; }
+
+                LARGE_INTEGER CurrentTime;
+                QueryPerformanceCounter( &CurrentTime );
+                pReliableChannel->Acknowledge( pPacket->GetBaseIndex(), pPacket->MaskOffset, pPacket->ReceivedMask, CurrentTime.QuadPart );
                 break;
             }
         case NetPacketType::UnreliableMessage:
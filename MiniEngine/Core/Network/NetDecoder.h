@@ -8,6 +8,7 @@
 
 struct NetFrameStatistics;
 struct PacketQueue;
+class ReliableChannel;
 
 interface IDecodeHandler
 {
@@ -135,7 +136,7 @@ class NetDecoder
 public:
     static HRESULT DecodePacket( 
         VOID* pSenderContext, 
-        UINT32* pLastReliableMessageIndex,
+        ReliableChannel* pReliableChannel,
         IDecodeHandler* pDecodeHandler,
         StateInputOutput* pStateIO, 
         const BYTE* pPacket, 
@@ -137,6 +137,18 @@ VOID NetEncoder::EndSnapshot( UINT32 Index )
 VOID NetEncoder::SendReliableMessage( const ReliableMessage& msg )
 {
     BYTE* pPayload = nullptr;
+    if( msg.FragmentCount > 1 )
+    {
+        auto* pMsg = AllocateMessageWithPayload<NetPacketReliableFragment>( msg.BufferSizeBytes, &pPayload );
+        pMsg->SetOpcode( msg.Opcode );
+        pMsg->UniqueIndex = msg.UniqueIndex;
+        pMsg->FragmentIndex = msg.FragmentIndex;
+        pMsg->FragmentCount = msg.FragmentCount;
+        memcpy( pPayload, msg.Buffer, msg.BufferSizeBytes );
+        LogMessage( (UINT32)NetPacketType::ReliableFragment, msg.FragmentIndex, 0, (UINT32)pMsg->GetByteCount() );
+        return;
+    }
+
     auto* pMsg = AllocateMessageWithPayload<NetPacketReliableMessage>( msg.BufferSizeBytes, &pPayload );
     pMsg->SetOpcode( msg.Opcode );
     pMsg->UniqueIndex = msg.UniqueIndex;
@@ -153,6 +165,15 @@ VOID NetEncoder::SendUnreliableMessage( const ReliableMessage& msg )
     LogMessage( (UINT32)NetPacketType::UnreliableMessage, 0, 0, (UINT32)pMsg->GetByteCount() );
 }
 
+VOID NetEncoder::SendReliableAck( UINT32 BaseIndex, UINT32 MaskOffset, UINT32 ReceivedMask )
+{
+    auto* pMsg = AllocateMessage<NetPacketReliableAck>();
+    pMsg->SetBaseIndex( BaseIndex );
+    pMsg->MaskOffset = MaskOffset;
+    pMsg->ReceivedMask = ReceivedMask;
+    LogMessage( (UINT32)NetPacketType::ReliableAck, BaseIndex, 0, sizeof(NetPacketReliableAck) );
+}
+
 VOID NetEncoder::SendAcknowledge( const UINT SnapshotIndex )
 {
     auto* pMsg = AllocateMessage<NetPacketAck>();
@@ -44,6 +44,7 @@ public:
     virtual VOID NodeSame( StateNode* pPrev, StateNode* pCurrent );
     virtual VOID SendReliableMessage( const ReliableMessage& msg );
     virtual VOID SendUnreliableMessage( const ReliableMessage& msg );
+    virtual VOID SendReliableAck( UINT32 BaseIndex, UINT32 MaskOffset, UINT32 ReceivedMask );
     virtual VOID SendAcknowledge( const UINT SnapshotIndex );
     virtual VOID EndSnapshot( UINT32 Index );
 
@@ -2,6 +2,10 @@
 #include "NetServerBase.h"
 #include <assert.h>
 #include "NetConstants.h"
+#include "CpuProfiler.h"
+#include "LatencyHistogram.h"
+
+static LatencyHistogram g_ServerTickHistogram("ServerTick");
 
 VOID ConnectedClient::Send( NetFrameStatistics* pStats )
 {
@@ -110,6 +114,8 @@ DWORD NetServerBase::Loop()
 {
     assert( !m_Started );
 
+    CpuProfiler::SetThreadName("Server");
+
     InitializeServer();
 
     QueryPerformanceCounter( &m_StartTime );
@@ -160,6 +166,9 @@ bool NetServerBase::SingleThreadedTick()
     m_NextFrameTime = CurrentTime.QuadPart + m_FrameTicks;
     m_CurrentTime = CurrentTime.QuadPart;
 
+    CPU_PROFILE_SCOPE("Server Tick");
+    ScopedLatencyTimer TickTimer( g_ServerTickHistogram );
+
     INT64 DeltaTicks = CurrentTime.QuadPart - m_LastFrameTime;
     DeltaTicks = std::min(DeltaTicks, m_FrameTicks);
     const DOUBLE SecondsPerTick = 1.0 / (DOUBLE)m_PerfFreq.QuadPart;
@@ -171,7 +180,11 @@ bool NetServerBase::SingleThreadedTick()
     m_pCurrentStats->Timestamp.QuadPart = CurrentTime.QuadPart;
 
     // Process all incoming packets from all clients:
-    BOOL IncomingResult = ProcessIncomingPackets();
+    BOOL IncomingResult = FALSE;
+    {
+        CPU_PROFILE_SCOPE("Receive Packets");
+        IncomingResult = ProcessIncomingPackets();
+    }
 
     // Scan for dead clients:
     {
@@ -211,13 +224,22 @@ bool NetServerBase::SingleThreadedTick()
         m_NextClientReport = m_CurrentTime + ClientReportInterval;
     }
 
-    TickServer(DeltaTime, AbsoluteTime);
+    {
+        CPU_PROFILE_SCOPE("Tick Server");
+        LARGE_INTEGER TickStartTime;
+        QueryPerformanceCounter(&TickStartTime);
+        TickServer(DeltaTime, AbsoluteTime);
+        LARGE_INTEGER TickEndTime;
+        QueryPerformanceCounter(&TickEndTime);
+        m_pCurrentStats->ServerTickMsec = (FLOAT)((DOUBLE)(TickEndTime.QuadPart - TickStartTime.QuadPart) * 1000.0 * SecondsPerTick);
+    }
 
     StateSnapshot* pCurrentSnapshot = m_StateIO.CreateSnapshot();
     m_CurrentSnapshotIndex = pCurrentSnapshot->GetIndex();
 
     // Distribute snapshot to client send queues
     {
+        CPU_PROFILE_SCOPE("Send Snapshots");
         EnterLock();
         auto iter = m_Clients.begin();
         auto end = m_Clients.end();
@@ -273,7 +295,11 @@ VOID NetServerBase::ProcessClientDisconnected( ConnectedClient* pClient )
     pClient->m_Encoder.CloseLogFile();
 
     const CHAR* strDisconnectReason = "timeout";
-    if( pClient->m_LastRecvTime == 0 )
+    if( pClient->m_DecodeFailed )
+    {
+        strDisconnectReason = "malformed packet";
+    }
+    else if( pClient->m_LastRecvTime == 0 )
     {
         strDisconnectReason = "clean disconnect";
     }
@@ -324,9 +350,22 @@ BOOL NetServerBase::ProcessPacket( const BYTE* pPacket, UINT32 SizeBytes, const
 {
     ConnectedClient* pClient = FindOrAddClient( SenderAddress );
 
+    // Anything else it sends before the dead client scan removes it is ignored
+    if( pClient->m_DecodeFailed )
+    {
+        return FALSE;
+    }
+
     pClient->m_LastRecvTime = m_CurrentTime;
 
-    NetDecoder::DecodePacket( pClient, &pClient->m_LastReliableMessageIndex, &m_DecodeHandlers, &m_StateIO, pPacket, SizeBytes, m_pCurrentStats, nullptr, nullptr );
+    HRESULT hr = NetDecoder::DecodePacket( pClient, &pClient->m_SendQueue.GetReliableChannel(), &m_DecodeHandlers, &m_StateIO, pPacket, SizeBytes, m_pCurrentStats, nullptr, nullptr );
+    if( FAILED(hr) )
+    {
+        DbgPrint( "Client CID %u sent a packet that could not be decoded; disconnecting.\n", pClient->m_ID );
+        pClient->m_DecodeFailed = TRUE;
+        pClient->m_LastRecvTime = 0;
+        return FALSE;
+    }
 
     return TRUE;
 }
@@ -699,6 +738,18 @@ VOID NetServerBase::GenerateClientReport()
         INT SnapshotDelta = (INT)ServerSnapshotIndex - (INT)ClientAckSnapshotIndex;
 
         m_LogFile.WriteLine( m_CurrentTime, "Client \"%S\" [CID %u]: Last ack snapshot %u (delta %d)\n", pCC->m_strUserName, pCC->m_ID, ClientAckSnapshotIndex, SnapshotDelta );
+
+        ReliableChannel& Channel = pCC->m_SendQueue.GetReliableChannel();
+        const ReliableChannelStatistics& Reliable = Channel.GetStatistics();
+        const DOUBLE RetransmitPercent = Reliable.BytesSent > 0 ? 100.0 * (DOUBLE)Reliable.BytesRetransmitted / (DOUBLE)Reliable.BytesSent : 0.0;
+        m_LogFile.WriteLine( m_CurrentTime, "Client \"%S\" [CID %u]: Reliable %I64u messages, %I64u KB sent, %.1f%% retransmitted, %u in flight, timeout %.0f ms\n",
+            pCC->m_strUserName, pCC->m_ID, Reliable.MessagesSent, Reliable.BytesSent / 1024, RetransmitPercent, Channel.GetInFlightCount(), Channel.GetRetransmitMsec() );
+        if( Reliable.FirstDrainTick != 0 )
+        {
+            const DOUBLE JoinMsec = (DOUBLE)( Reliable.FirstDrainTick - Reliable.FirstSendTick ) * 1000.0 / (DOUBLE)Channel.GetTickFrequency();
+            m_LogFile.WriteLine( m_CurrentTime, "Client \"%S\" [CID %u]: Join transfer %I64u KB in %.1f ms (%.1f KB/s)\n",
+                pCC->m_strUserName, pCC->m_ID, Reliable.FirstDrainBytes / 1024, JoinMsec, JoinMsec > 0.0 ? (DOUBLE)Reliable.FirstDrainBytes / 1024.0 / ( JoinMsec / 1000.0 ) : 0.0 );
+        }
     }
 }
 
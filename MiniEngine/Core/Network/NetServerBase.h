@@ -26,8 +26,7 @@ struct ConnectedClient : public NetConnectionBase
     SnapshotAckTracker m_AckTracker;
 
     INT64 m_LastRecvTime;
-
-    UINT32 m_LastReliableMessageIndex;
+    BOOL m_DecodeFailed;
 
     UINT m_ConnectionBaseObjectID;
 
@@ -37,7 +36,7 @@ struct ConnectedClient : public NetConnectionBase
 
     ConnectedClient()
         : NetConnectionBase( 0, L"" ),
-          m_LastReliableMessageIndex( 0 ),
+          m_DecodeFailed( FALSE ),
           m_ConnectionBaseObjectID( 0 )
     {
         m_ClientTicksAtConnect.QuadPart = 0;
@@ -151,6 +150,8 @@ protected:
     virtual INetworkObject* CreateRemoteObject( VOID* pSenderContext, INetworkObject* pParentObject, UINT ID, const VOID* pCreationData, SIZE_T CreationDataSizeBytes ) = 0;
     virtual VOID DeleteRemoteObject( INetworkObject* pObject ) = 0;
 
+    NetFrameStatistics* GetCurrentStatistics() { return m_pCurrentStats; }
+
     INetworkObject* CreateRemoteProxyObject( VOID* pSenderContext, INetworkObject* pParentObject, UINT ID, const VOID* pCreationData, SIZE_T CreationDataSizeBytes );
     INetworkObject* FindRemoteProxyObject( UINT ID );
     VOID DeleteRemoteProxyObject( UINT ID );
@@ -40,6 +40,21 @@ struct NetFrameStatistics
     UINT32 BeginSnapshotsSent;
     UINT32 EndSnapshotsReceived;
     UINT32 EndSnapshotsSent;
+    UINT32 ReliableMessagesRetransmitted;
+    UINT32 ReliableMessageBytesRetransmitted;
+    UINT32 ReliableAcksSent;
+    UINT32 ReliableAcksReceived;
+
+    // Server tick timings, filled in by the server tick and the world it drives:
+    FLOAT ServerTickMsec;
+    FLOAT PrePhysicsMsec;
+    FLOAT PhysicsMsec;
+    FLOAT PostPhysicsMsec;
+    FLOAT TerrainUpdateMsec;
+    UINT32 PhysicsSubsteps;
+    UINT32 PhysicsSubstepsDropped;
+    UINT32 ModelInstanceCount;
+
     BOOL Finished;
 
 public:
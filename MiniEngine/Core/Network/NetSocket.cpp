@@ -147,7 +147,7 @@ VOID NetUdpSocket::CommonSocketSetup()
     assert( iResult == 0 );
 }
 
-HRESULT NetTcpSocket::Bind( USHORT Port )
+HRESULT NetTcpSocket::Bind( USHORT Port, bool LoopbackOnly )
 {
     struct addrinfo hints;
     ZeroMemory(&hints, sizeof(hints));
@@ -160,7 +160,7 @@ HRESULT NetTcpSocket::Bind( USHORT Port )
     struct addrinfo *result = NULL;
     CHAR strPort[7];
     sprintf_s(strPort, "%u", Port);
-    INT iResult = getaddrinfo(NULL, strPort, &hints, &result);
+    INT iResult = getaddrinfo(LoopbackOnly ? "127.0.0.1" : NULL, strPort, &hints, &result);
     if ( iResult != 0 ) 
     {
         return E_FAIL;
@@ -223,6 +223,22 @@ HRESULT NetTcpSocket::Send( const void* pBuffer, UINT SizeBytes )
     return E_FAIL;
 }
 
+HRESULT NetTcpSocket::Send( const void* pBuffer, UINT SizeBytes, UINT* pBytesSent )
+{
+    *pBytesSent = 0;
+    INT iResult = send( m_Socket, (const char*)pBuffer, SizeBytes, 0 );
+    if (iResult == SOCKET_ERROR)
+    {
+        if( WSAGetLastError() != WSAEWOULDBLOCK )
+        {
+            return E_FAIL;
+        }
+        return S_FALSE;
+    }
+    *pBytesSent = iResult;
+    return S_OK;
+}
+
 HRESULT NetTcpSocket::Recv( void* pBuffer, UINT SizeBytes, UINT* pBytesReceived )
 {
     INT iResult = recv( m_Socket, (char*)pBuffer, SizeBytes, 0 );
@@ -75,9 +75,12 @@ struct NetTcpSocket : public NetSocket
 
     HRESULT Initialize( const SOCKADDR_IN& RemoteAddress );
 
-    HRESULT Bind( USHORT Port );
+    HRESULT Bind( USHORT Port, bool LoopbackOnly = false );
     HRESULT AcceptConnection( NetTcpSocket* pClientSocket );
 
     HRESULT Send( const void* pBuffer, UINT SizeBytes );
     HRESULT Recv( void* pBuffer, UINT SizeBytes, UINT* pBytesReceived );
+
+    // Sends as much as a non-blocking socket takes now.  Returns S_FALSE when it takes nothing.
+    HRESULT Send( const void* pBuffer, UINT SizeBytes, UINT* pBytesSent );
 };
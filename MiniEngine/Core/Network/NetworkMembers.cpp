@@ -0,0 +1,274 @@
+#include "pch.h"
+#include "NetworkMembers.h"
+#include "NetworkTransform.h"
+#include "SystemTime.h"
+#include <algorithm>
+#include <random>
+
+namespace
+{
+    class BenchmarkTransform : public NetworkTransform
+    {
+    public:
+        void SetState( FXMVECTOR Position, FXMVECTOR Orientation, FLOAT Scale, UINT32 Flags )
+        {
+            m_NetPosition.SetRawValue( Position );
+            m_NetOrientation.SetRawValue( Orientation );
+            m_NetScale = Scale;
+            m_NetFlags = Flags;
+        }
+        void Discontinuity() { m_ContinuityEpoch.SourceUpdate(); }
+        XMVECTOR GetRawOrientation() const { return m_NetOrientation.GetRawValue(); }
+
+        bool HasSameState( const BenchmarkTransform& Other ) const
+        {
+            return XMVector3Equal( m_NetPosition.GetRawValue(), Other.m_NetPosition.GetRawValue() ) &&
+                   m_NetPosition.GetSampleTime() == Other.m_NetPosition.GetSampleTime() &&
+                   XMVector4Equal( m_NetOrientation.GetRawValue(), Other.m_NetOrientation.GetRawValue() ) &&
+                   m_NetOrientation.GetSampleTime() == Other.m_NetOrientation.GetSampleTime() &&
+                   m_NetScale == Other.m_NetScale &&
+                   m_NetFlags == Other.m_NetFlags &&
+                   m_ContinuityEpoch.GetCurrentValue() == Other.m_ContinuityEpoch.GetCurrentValue();
+        }
+    };
+
+    // What StateInputOutput links for each member, with a remote copy for each path
+    struct BenchmarkNode
+    {
+        UINT32 ID;
+        StateNodeType Type;
+        const StateNodeCodec* pCodec;
+        VOID* pSourceData;
+        VOID* pSwitchData;
+        VOID* pTableData;
+    };
+
+    // Applies changed and created nodes to the remote copies, as the decoder would
+    class BenchmarkDiff : public IStateSnapshotDiff
+    {
+    public:
+        const std::vector<BenchmarkNode>* pNodes;
+        bool UseTables;
+        std::vector<UINT32> UpdatedIDs;
+        UINT32 SameCount;
+
+        BenchmarkDiff( const std::vector<BenchmarkNode>* pNodeTable, bool UseNodeTables )
+            : pNodes( pNodeTable ),
+              UseTables( UseNodeTables ),
+              SameCount( 0 )
+        { }
+
+        VOID Apply( StateNode* pNode )
+        {
+            if( pNode->IsComplex() )
+            {
+                return;
+            }
+            const BenchmarkNode& Node = ( *pNodes )[pNode->GetID()];
+            UpdatedIDs.push_back( Node.ID );
+            if( UseTables )
+            {
+                Node.pCodec->pDecode( Node.pTableData, pNode->GetRawData() );
+            }
+            else
+            {
+                StateNodeTypeCodec::Decode( Node.Type, Node.pSwitchData, pNode->GetRawData() );
+            }
+        }
+
+        VOID NodeCreated( StateNode* pNode, StateNode* pParentNode ) { Apply( pNode ); }
+        VOID NodeDeleted( StateNode* pNode ) {}
+        VOID NodeChanged( StateNode* pPrev, StateNode* pCurrent ) { Apply( pCurrent ); }
+        VOID NodeSame( StateNode* pPrev, StateNode* pCurrent ) { ++SameCount; }
+    };
+
+    BOOL SameSnapshotData( StateNodeChildSet* pA, StateNodeChildSet* pB )
+    {
+        auto iterA = pA->Begin();
+        auto iterB = pB->Begin();
+        while( iterA != pA->End() && iterB != pB->End() )
+        {
+            StateNode* pNodeA = *iterA++;
+            StateNode* pNodeB = *iterB++;
+            if( pNodeA->GetID() != pNodeB->GetID() || pNodeA->GetType() != pNodeB->GetType() ||
+                pNodeA->GetCreationData().CreationCode != pNodeB->GetCreationData().CreationCode )
+            {
+                return FALSE;
+            }
+            if( pNodeA->IsComplex() )
+            {
+                if( !SameSnapshotData( pNodeA->GetChildSet(), pNodeB->GetChildSet() ) )
+                {
+                    return FALSE;
+                }
+            }
+            else if( pNodeA->GetStorageDataSize() != pNodeB->GetStorageDataSize() ||
+                     memcmp( pNodeA->GetRawData(), pNodeB->GetRawData(), pNodeA->GetStorageDataSize() ) != 0 )
+            {
+                return FALSE;
+            }
+        }
+        return iterA == pA->End() && iterB == pB->End();
+    }
+}
+
+bool NetworkMembers::Benchmark( UINT32 ObjectCount, UINT32 SnapshotCount )
+{
+    const LARGE_INTEGER SavedRecvTimestamp = g_CurrentRecvTimestamp;
+    ObjectCount = std::max( ObjectCount, 1U );
+
+    BenchmarkTransform* pSources = new BenchmarkTransform[ObjectCount];
+    BenchmarkTransform* pSwitchRemotes = new BenchmarkTransform[ObjectCount];
+    BenchmarkTransform* pTableRemotes = new BenchmarkTransform[ObjectCount];
+
+    // Node IDs as CreateNodeGroup assigns them: the object, then each member
+    const INetworkObject::MemberDataPosition* pMemberDatas = nullptr;
+    UINT MemberDataCount = 0;
+    pSources[0].GetMemberDatas( &pMemberDatas, &MemberDataCount );
+    const UINT32 NodesPerObject = MemberDataCount + 1;
+
+    std::vector<BenchmarkNode> Nodes( 1 + ObjectCount * NodesPerObject );
+    for( UINT32 i = 0; i < ObjectCount; ++i )
+    {
+        const UINT32 ObjectID = 1 + i * NodesPerObject;
+        Nodes[ObjectID].ID = ObjectID;
+        Nodes[ObjectID].Type = StateNodeType::Complex;
+        Nodes[ObjectID].pCodec = nullptr;
+        for( UINT32 j = 0; j < MemberDataCount; ++j )
+        {
+            BenchmarkNode& Node = Nodes[ObjectID + 1 + j];
+            Node.ID = ObjectID + 1 + j;
+            Node.Type = pMemberDatas[j].Type;
+            Node.pCodec = pMemberDatas[j].pCodec;
+            Node.pSourceData = (BYTE*)&pSources[i] + pMemberDatas[j].OffsetBytes;
+            Node.pSwitchData = (BYTE*)&pSwitchRemotes[i] + pMemberDatas[j].OffsetBytes;
+            Node.pTableData = (BYTE*)&pTableRemotes[i] + pMemberDatas[j].OffsetBytes;
+        }
+    }
+
+    // As CreateSnapshotHelper walks the linked nodes, which are prepended and so in
+    // descending ID order: node by node through the type switch, or by member table
+    const INetworkObject::SnapshotMembersFunction pSnapshotMembers = pSources[0].GetSnapshotMembersFunction();
+    auto BuildSnapshot = [&]( UINT32 Index, bool UseTables ) -> StateSnapshot*
+    {
+        StateSnapshot* pSS = new StateSnapshot( Index );
+        for( UINT32 i = ObjectCount; i > 0; --i )
+        {
+            const UINT32 ObjectID = 1 + ( i - 1 ) * NodesPerObject;
+            StateNode* pObjectNode = pSS->AddComplex( nullptr, ObjectID );
+            if( UseTables )
+            {
+                pSnapshotMembers( pSS, pObjectNode, ObjectID + 1, &pSources[i - 1] );
+                continue;
+            }
+            for( UINT32 j = MemberDataCount; j > 0; --j )
+            {
+                const BenchmarkNode& Node = Nodes[ObjectID + j];
+                StateNode* pNode = pSS->AddDataType( pObjectNode, Node.ID, Node.Type, Node.pSourceData );
+                pNode->GetCreationData().CreationCode = j - 1;
+            }
+        }
+        return pSS;
+    };
+
+    std::mt19937 Random( 1234 );
+    std::uniform_real_distribution<FLOAT> Unit( -1.0f, 1.0f );
+    for( UINT32 i = 0; i < ObjectCount; ++i )
+    {
+        pSources[i].SetState( XMVectorZero(), XMQuaternionIdentity(), 1.0f, 0 );
+    }
+
+    StateSnapshot* pSwitchPrev = new StateSnapshot( 0 );
+    StateSnapshot* pTablePrev = new StateSnapshot( 0 );
+    INT64 SwitchTicks = 0;
+    INT64 TableTicks = 0;
+    UINT32 MismatchCount = 0;
+    UINT64 UpdateCount = 0;
+
+    for( UINT32 Snapshot = 1; Snapshot <= SnapshotCount; ++Snapshot )
+    {
+        // Most objects are at rest; a few move, turn or change flags each tick
+        for( UINT32 i = 0; i < ObjectCount; ++i )
+        {
+            BenchmarkTransform& Source = pSources[i];
+            const UINT32 Roll = Random() & 63;
+            if( Roll >= 16 )
+            {
+                continue;
+            }
+            const XMVECTOR Position = XMVectorSet( Unit( Random ) * 1000.0f, Unit( Random ) * 10.0f, Unit( Random ) * 1000.0f, 0.0f );
+            const XMVECTOR Orientation = ( Roll < 8 ) ?
+                XMQuaternionNormalize( XMVectorSet( Unit( Random ), Unit( Random ), Unit( Random ), Unit( Random ) + 1.5f ) ) :
+                Source.GetRawOrientation();
+            Source.SetState( Position, Orientation, ( Roll == 0 ) ? 2.0f : 1.0f, Roll & 3 );
+            if( Roll == 1 )
+            {
+                Source.Discontinuity();
+            }
+        }
+        g_CurrentRecvTimestamp.QuadPart = (INT64)Snapshot * 1000000 / 15;
+
+        // Alternate which path runs first, so that neither always finds the caches warm
+        StateSnapshot* pSwitch = nullptr;
+        StateSnapshot* pTable = nullptr;
+        BenchmarkDiff SwitchDiff( &Nodes, false );
+        BenchmarkDiff TableDiff( &Nodes, true );
+        for( UINT32 Pass = 0; Pass < 2; ++Pass )
+        {
+            const bool UseTables = ( ( Snapshot + Pass ) & 1 ) != 0;
+            const INT64 StartTick = SystemTime::GetCurrentTick();
+            if( UseTables )
+            {
+                pTable = BuildSnapshot( Snapshot, true );
+                pTablePrev->Diff( pTable, &TableDiff );
+                TableTicks += SystemTime::GetCurrentTick() - StartTick;
+            }
+            else
+            {
+                pSwitch = BuildSnapshot( Snapshot, false );
+                pSwitchPrev->Diff( pSwitch, &SwitchDiff );
+                SwitchTicks += SystemTime::GetCurrentTick() - StartTick;
+            }
+        }
+
+        if( !SameSnapshotData( pSwitch, pTable ) ||
+            SwitchDiff.UpdatedIDs != TableDiff.UpdatedIDs ||
+            SwitchDiff.SameCount != TableDiff.SameCount )
+        {
+            ++MismatchCount;
+        }
+        UpdateCount += TableDiff.UpdatedIDs.size();
+
+        pSwitchPrev->Release();
+        pTablePrev->Release();
+        pSwitchPrev = pSwitch;
+        pTablePrev = pTable;
+    }
+
+    for( UINT32 i = 0; i < ObjectCount; ++i )
+    {
+        if( !pSwitchRemotes[i].HasSameState( pTableRemotes[i] ) )
+        {
+            ++MismatchCount;
+        }
+    }
+
+    pSwitchPrev->Release();
+    pTablePrev->Release();
+    delete[] pSources;
+    delete[] pSwitchRemotes;
+    delete[] pTableRemotes;
+    g_CurrentRecvTimestamp = SavedRecvTimestamp;
+
+    const DOUBLE SwitchMsec = SystemTime::TicksToMillisecs( SwitchTicks ) / std::max( SnapshotCount, 1U );
+    const DOUBLE TableMsec = SystemTime::TicksToMillisecs( TableTicks ) / std::max( SnapshotCount, 1U );
+    const bool Passed = ( MismatchCount == 0 );
+
+    Utility::PrintfConsole( "Network member benchmark: %u objects x %u snapshots, %u nodes each\n", ObjectCount, SnapshotCount, NodesPerObject );
+    Utility::PrintfConsole( "  Type switch:         %8.4f ms/snapshot\n", SwitchMsec );
+    Utility::PrintfConsole( "  Member tables:       %8.4f ms/snapshot (%.2fx)\n", TableMsec, TableMsec > 0.0 ? SwitchMsec / TableMsec : 0.0 );
+    Utility::PrintfConsole( "  Updates:             %.1f per snapshot\n", SnapshotCount > 0 ? (DOUBLE)UpdateCount / SnapshotCount : 0.0 );
+    Utility::PrintfConsole( "  Mismatches:          %u\n", MismatchCount );
+
+    return Passed;
+}
@@ -0,0 +1,325 @@
+#pragma once
+
+#include <type_traits>
+#include <DirectXPackedVector.h>
+
+#include "StateLinking.h"
+#include "ClientPredict.h"
+
+// Compile-time member tables for INetworkObject.  A replicated class lists its members once:
+//
+//     class Foo : public INetworkObject
+//     {
+//         DECLARE_NETWORK_MEMBERS()
+//         ...
+//     };
+//     DEFINE_NETWORK_MEMBERS( Foo,
+//         NETWORK_MEMBER( Foo, Float3Delta, m_Position ),
+//         NETWORK_MEMBER( Foo, Integer, m_Flags ) )
+//
+// which generates GetMemberDatas, checks each member's C++ type against its node type, and
+// binds each member to the codec for its node type, so that the linked nodes decode and
+// compare without switching on the type.  Snapshots of the object are built by a generated
+// function that encodes every member into one block, rather than node by node.
+
+// Encode, decode and sizes of one node type.  Node types without traits (complex, strings
+// and blobs) cannot be members.
+template<StateNodeType Type>
+struct StateNodeTraits;
+
+// Node types whose storage is a copy of the member
+template<typename T>
+struct StateNodeCopyTraits
+{
+    typedef void ObjectType;
+    static const SIZE_T ExpandedSize = sizeof(T);
+    static const SIZE_T StorageSize = sizeof(T);
+
+    static VOID Encode( VOID* pStorageData, const VOID* pExpandedData ) { memcpy( pStorageData, pExpandedData, sizeof(T) ); }
+    static VOID Decode( VOID* pExpandedData, const VOID* pStorageData ) { memcpy( pExpandedData, pStorageData, sizeof(T) ); }
+};
+
+template<> struct StateNodeTraits<StateNodeType::Integer> : public StateNodeCopyTraits<INT32> {};
+template<> struct StateNodeTraits<StateNodeType::Integer4> : public StateNodeCopyTraits<XMINT4> {};
+template<> struct StateNodeTraits<StateNodeType::Float> : public StateNodeCopyTraits<FLOAT> {};
+template<> struct StateNodeTraits<StateNodeType::Float2> : public StateNodeCopyTraits<XMFLOAT2> {};
+template<> struct StateNodeTraits<StateNodeType::Float3> : public StateNodeCopyTraits<XMFLOAT3> {};
+template<> struct StateNodeTraits<StateNodeType::Float4> : public StateNodeCopyTraits<XMFLOAT4> {};
+template<> struct StateNodeTraits<StateNodeType::Matrix43> : public StateNodeCopyTraits<XMFLOAT4X3> {};
+template<> struct StateNodeTraits<StateNodeType::Matrix44> : public StateNodeCopyTraits<XMFLOAT4X4> {};
+
+template<>
+struct StateNodeTraits<StateNodeType::Float4AsByteN4>
+{
+    typedef void ObjectType;
+    static const SIZE_T ExpandedSize = sizeof(XMFLOAT4);
+    static const SIZE_T StorageSize = sizeof(PackedVector::XMBYTEN4);
+
+    static VOID Encode( VOID* pStorageData, const VOID* pExpandedData )
+    {
+        PackedVector::XMStoreByteN4( (PackedVector::XMBYTEN4*)pStorageData, XMLoadFloat4( (const XMFLOAT4*)pExpandedData ) );
+    }
+    static VOID Decode( VOID* pExpandedData, const VOID* pStorageData )
+    {
+        XMStoreFloat4( (XMFLOAT4*)pExpandedData, PackedVector::XMLoadByteN4( (const PackedVector::XMBYTEN4*)pStorageData ) );
+    }
+};
+
+template<>
+struct StateNodeTraits<StateNodeType::Float2AsHalf2>
+{
+    typedef void ObjectType;
+    static const SIZE_T ExpandedSize = sizeof(XMFLOAT2);
+    static const SIZE_T StorageSize = sizeof(PackedVector::XMHALF2);
+
+    static VOID Encode( VOID* pStorageData, const VOID* pExpandedData )
+    {
+        PackedVector::XMStoreHalf2( (PackedVector::XMHALF2*)pStorageData, XMLoadFloat2( (const XMFLOAT2*)pExpandedData ) );
+    }
+    static VOID Decode( VOID* pExpandedData, const VOID* pStorageData )
+    {
+        XMStoreFloat2( (XMFLOAT2*)pExpandedData, PackedVector::XMLoadHalf2( (const PackedVector::XMHALF2*)pStorageData ) );
+    }
+};
+
+template<>
+struct StateNodeTraits<StateNodeType::Float4AsHalf4>
+{
+    typedef void ObjectType;
+    static const SIZE_T ExpandedSize = sizeof(XMFLOAT4);
+    static const SIZE_T StorageSize = sizeof(PackedVector::XMHALF4);
+
+    static VOID Encode( VOID* pStorageData, const VOID* pExpandedData )
+    {
+        PackedVector::XMStoreHalf4( (PackedVector::XMHALF4*)pStorageData, XMLoadFloat4( (const XMFLOAT4*)pExpandedData ) );
+    }
+    static VOID Decode( VOID* pExpandedData, const VOID* pStorageData )
+    {
+        XMStoreFloat4( (XMFLOAT4*)pExpandedData, PackedVector::XMLoadHalf4( (const PackedVector::XMHALF4*)pStorageData ) );
+    }
+};
+
+// Delta and prediction types send their raw value and feed received values to the filter
+template<>
+struct StateNodeTraits<StateNodeType::Float3Delta>
+{
+    typedef StateFloat3Delta ObjectType;
+    static const SIZE_T ExpandedSize = sizeof(FLOAT) * 3;
+    static const SIZE_T StorageSize = sizeof(XMFLOAT3);
+
+    static VOID Encode( VOID* pStorageData, const VOID* pExpandedData )
+    {
+        XMStoreFloat3( (XMFLOAT3*)pStorageData, ( (const ObjectType*)pExpandedData )->GetRawValue() );
+    }
+    static VOID Decode( VOID* pExpandedData, const VOID* pStorageData )
+    {
+        ( (ObjectType*)pExpandedData )->ReceiveNewValue( XMLoadFloat3( (const XMFLOAT3*)pStorageData ), g_CurrentRecvTimestamp );
+    }
+};
+
+template<>
+struct StateNodeTraits<StateNodeType::Float3AsHalf4Delta>
+{
+    typedef StateFloat3Delta ObjectType;
+    static const SIZE_T ExpandedSize = sizeof(FLOAT) * 3;
+    static const SIZE_T StorageSize = sizeof(PackedVector::XMHALF4);
+
+    static VOID Encode( VOID* pStorageData, const VOID* pExpandedData )
+    {
+        PackedVector::XMStoreHalf4( (PackedVector::XMHALF4*)pStorageData, ( (const ObjectType*)pExpandedData )->GetRawValue() );
+    }
+    static VOID Decode( VOID* pExpandedData, const VOID* pStorageData )
+    {
+        ( (ObjectType*)pExpandedData )->ReceiveNewValue( PackedVector::XMLoadHalf4( (const PackedVector::XMHALF4*)pStorageData ), g_CurrentRecvTimestamp );
+    }
+};
+
+template<>
+struct StateNodeTraits<StateNodeType::Float3AsQwordDelta>
+{
+    typedef StateFloat3Delta ObjectType;
+    static const SIZE_T ExpandedSize = sizeof(FLOAT) * 3;
+    static const SIZE_T StorageSize = sizeof(Float3Qword);
+
+    static VOID Encode( VOID* pStorageData, const VOID* pExpandedData )
+    {
+        ( (Float3Qword*)pStorageData )->SetFloat3( ( (const ObjectType*)pExpandedData )->GetRawValue() );
+    }
+    static VOID Decode( VOID* pExpandedData, const VOID* pStorageData )
+    {
+        ( (ObjectType*)pExpandedData )->ReceiveNewValue( ( (const Float3Qword*)pStorageData )->GetFloat3(), g_CurrentRecvTimestamp );
+    }
+};
+
+template<>
+struct StateNodeTraits<StateNodeType::Float4AsHalf4Delta>
+{
+    typedef StateFloat4Delta ObjectType;
+    static const SIZE_T ExpandedSize = sizeof(FLOAT) * 4;
+    static const SIZE_T StorageSize = sizeof(PackedVector::XMHALF4);
+
+    static VOID Encode( VOID* pStorageData, const VOID* pExpandedData )
+    {
+        PackedVector::XMStoreHalf4( (PackedVector::XMHALF4*)pStorageData, ( (const ObjectType*)pExpandedData )->GetRawValue() );
+    }
+    static VOID Decode( VOID* pExpandedData, const VOID* pStorageData )
+    {
+        ( (ObjectType*)pExpandedData )->ReceiveNewValue( PackedVector::XMLoadHalf4( (const PackedVector::XMHALF4*)pStorageData ), g_CurrentRecvTimestamp );
+    }
+};
+
+template<>
+struct StateNodeTraits<StateNodeType::PredictFloat3>
+{
+    typedef PredictionFloat3 ObjectType;
+    static const SIZE_T ExpandedSize = sizeof(FLOAT) * 3;
+    static const SIZE_T StorageSize = sizeof(XMFLOAT3);
+
+    static VOID Encode( VOID* pStorageData, const VOID* pExpandedData )
+    {
+        XMStoreFloat3( (XMFLOAT3*)pStorageData, ( (const ObjectType*)pExpandedData )->GetStaticValue() );
+    }
+    static VOID Decode( VOID* pExpandedData, const VOID* pStorageData )
+    {
+        ( (ObjectType*)pExpandedData )->UpdateFromNetwork( XMLoadFloat3( (const XMFLOAT3*)pStorageData ), g_CurrentRecvTimestamp.QuadPart );
+    }
+};
+
+template<>
+struct StateNodeTraits<StateNodeType::PredictQuaternion>
+{
+    typedef PredictionQuaternion ObjectType;
+    static const SIZE_T ExpandedSize = sizeof(FLOAT) * 4;
+    static const SIZE_T StorageSize = sizeof(PackedVector::XMHALF4);
+
+    static VOID Encode( VOID* pStorageData, const VOID* pExpandedData )
+    {
+        PackedVector::XMStoreHalf4( (PackedVector::XMHALF4*)pStorageData, ( (const ObjectType*)pExpandedData )->GetStaticValue() );
+    }
+    static VOID Decode( VOID* pExpandedData, const VOID* pStorageData )
+    {
+        ( (ObjectType*)pExpandedData )->UpdateFromNetwork( PackedVector::XMLoadHalf4( (const PackedVector::XMHALF4*)pStorageData ), g_CurrentRecvTimestamp.QuadPart );
+    }
+};
+
+template<StateNodeType Type>
+inline BOOL StateNodeEqual( const VOID* pStorageDataA, const VOID* pStorageDataB )
+{
+    return memcmp( pStorageDataA, pStorageDataB, StateNodeTraits<Type>::StorageSize ) == 0;
+}
+
+template<StateNodeType Type>
+struct StateNodeCodecInstance
+{
+    static const StateNodeCodec Codec;
+};
+
+template<StateNodeType Type>
+const StateNodeCodec StateNodeCodecInstance<Type>::Codec =
+{
+    Type,
+    StateNodeTraits<Type>::ExpandedSize,
+    StateNodeTraits<Type>::StorageSize,
+    &StateNodeTraits<Type>::Encode,
+    &StateNodeTraits<Type>::Decode,
+    &StateNodeEqual<Type>,
+};
+
+// One replicated member: its node type, declared type and offset within the class
+template<StateNodeType Type, typename DeclaredType, SIZE_T Offset>
+struct NetworkMember
+{
+    typedef StateNodeTraits<Type> Traits;
+    typedef typename std::remove_reference<DeclaredType>::type MemberType;
+
+    // Filters and predictors must be the type the codec drives; plain values only need room
+    // for the expanded data, so that e.g. a NetworkSequence can replicate as an Integer.
+    static_assert( std::is_same<typename Traits::ObjectType, void>::value ?
+                       ( sizeof(MemberType) >= Traits::ExpandedSize ) :
+                       std::is_same<typename Traits::ObjectType, MemberType>::value,
+                   "Replicated member does not match its StateNodeType" );
+
+    static const StateNodeType NodeType = Type;
+    static const SIZE_T OffsetBytes = Offset;
+    static const SIZE_T SizeBytes = sizeof(MemberType);
+};
+
+// Encodes members straight into one block of snapshot storage
+template<UINT32 Index, typename... Members>
+struct NetworkMemberSnapshot;
+
+template<UINT32 Index>
+struct NetworkMemberSnapshot<Index>
+{
+    static const SIZE_T StorageSize = 0;
+
+    static VOID Add( StateSnapshot* pSnapshot, StateNode* pParent, UINT32 FirstID, const BYTE* pObject, BYTE* pStorageData ) {}
+};
+
+template<UINT32 Index, typename First, typename... Rest>
+struct NetworkMemberSnapshot<Index, First, Rest...>
+{
+    typedef NetworkMemberSnapshot<Index + 1, Rest...> Next;
+    static const SIZE_T StorageSize = First::Traits::StorageSize + Next::StorageSize;
+
+    // Later members go first, since child sets insert descending IDs in constant time
+    static VOID Add( StateSnapshot* pSnapshot, StateNode* pParent, UINT32 FirstID, const BYTE* pObject, BYTE* pStorageData )
+    {
+        Next::Add( pSnapshot, pParent, FirstID, pObject, pStorageData + First::Traits::StorageSize );
+        First::Traits::Encode( pStorageData, pObject + First::OffsetBytes );
+        pSnapshot->AddEncodedData( pParent, FirstID + Index, &StateNodeCodecInstance<First::NodeType>::Codec, pStorageData, Index );
+    }
+};
+
+template<typename... Members>
+struct NetworkMemberList
+{
+    static const UINT Count = sizeof...(Members);
+
+    static VOID AddToSnapshot( StateSnapshot* pSnapshot, StateNode* pParent, UINT32 FirstID, const VOID* pObject )
+    {
+        typedef NetworkMemberSnapshot<0, Members...> Snapshot;
+        BYTE* pStorageData = (BYTE*)pSnapshot->GetAllocator()->AllocateBytes( Snapshot::StorageSize );
+        Snapshot::Add( pSnapshot, pParent, FirstID, (const BYTE*)pObject, pStorageData );
+    }
+
+    static VOID GetTable( const INetworkObject::MemberDataPosition** ppMemberDatas, UINT* pMemberDataCount )
+    {
+        static const INetworkObject::MemberDataPosition Table[] =
+        {
+            { Members::NodeType, Members::OffsetBytes, Members::SizeBytes, &StateNodeCodecInstance<Members::NodeType>::Codec }...
+        };
+
+        *ppMemberDatas = Table;
+        *pMemberDataCount = Count;
+    }
+};
+
+#define NETWORK_MEMBER( Class, Type, Member ) \
+    NetworkMember<StateNodeType::Type, decltype(Class::Member), offsetof(Class, Member)>
+
+// In the class body; members may be private or protected
+#define DECLARE_NETWORK_MEMBERS() \
+    struct NetworkMemberTable; \
+    virtual VOID GetMemberDatas( const MemberDataPosition** ppMemberDatas, UINT* pMemberDataCount ) const; \
+    virtual SnapshotMembersFunction GetSnapshotMembersFunction() const;
+
+// After the class, in its header
+#define DEFINE_NETWORK_MEMBERS( Class, ... ) \
+    struct Class::NetworkMemberTable : public NetworkMemberList<__VA_ARGS__> {}; \
+    inline VOID Class::GetMemberDatas( const MemberDataPosition** ppMemberDatas, UINT* pMemberDataCount ) const \
+    { \
+        NetworkMemberTable::GetTable( ppMemberDatas, pMemberDataCount ); \
+    } \
+    inline INetworkObject::SnapshotMembersFunction Class::GetSnapshotMembersFunction() const \
+    { \
+        return &NetworkMemberTable::AddToSnapshot; \
+    }
+
+namespace NetworkMembers
+{
+    // Builds and diffs snapshots of NetworkTransforms through the per-node type switch
+    // and through the generated member snapshot functions, decodes the changes into
+    // remote copies, and checks that both give the same snapshots, updates and state.
+    bool Benchmark( UINT32 ObjectCount, UINT32 SnapshotCount );
+}
@@ -1,6 +1,6 @@
 #pragma once
 
-#include "StateLinking.h"
+#include "NetworkMembers.h"
 #include "VectorMath.h"
 #include "ClientPredict.h"
 
@@ -62,20 +62,7 @@ public:
         m_NetScale = 1;
     }
 
-    virtual void GetMemberDatas(const MemberDataPosition** ppMemberDatas, UINT* pMemberDataCount) const
-    {
-        static const MemberDataPosition Members[] =
-        {
-            { StateNodeType::Float3Delta,       offsetof(NetworkTransform, m_NetPosition),       sizeof(m_NetPosition) },
-            { StateNodeType::Float,             offsetof(NetworkTransform, m_NetScale),          sizeof(m_NetScale) },
-            { StateNodeType::Float4AsHalf4Delta,offsetof(NetworkTransform, m_NetOrientation),    sizeof(m_NetOrientation) },
-            { StateNodeType::Integer,           offsetof(NetworkTransform, m_NetFlags),          sizeof(m_NetFlags) },
-            { StateNodeType::Integer,           offsetof(NetworkTransform, m_ContinuityEpoch),   sizeof(UINT32) },
-        };
-
-        *ppMemberDatas = Members;
-        *pMemberDataCount = ARRAYSIZE(Members);
-    }
+    DECLARE_NETWORK_MEMBERS()
 
     virtual void SetRemote(BOOL Remote) 
     { 
@@ -119,7 +106,30 @@ public:
         }
     }
 
+    // Blends between two consecutive physics states; Alpha runs from 0 at Previous to 1 at Current.
+    static Math::Matrix4 InterpolateTransform(const Math::Matrix4& Previous, const Math::Matrix4& Current, FLOAT Alpha)
+    {
+        Math::Vector3 vPrevPosition, vCurrPosition;
+        Math::Vector4 vPrevOrientation, vCurrOrientation;
+        FLOAT PrevScale, CurrScale;
+        Previous.Decompose(vPrevPosition, PrevScale, vPrevOrientation);
+        Current.Decompose(vCurrPosition, CurrScale, vCurrOrientation);
+
+        Math::Matrix4 m;
+        m.Compose(Math::Vector3(XMVectorLerp(vPrevPosition, vCurrPosition, Alpha)),
+                  PrevScale + (CurrScale - PrevScale) * Alpha,
+                  Math::Vector4(XMQuaternionSlerp(vPrevOrientation, vCurrOrientation, Alpha)));
+        return m;
+    }
+
     Math::Vector3 GetRawPosition() const { return Math::Vector3(m_NetPosition.GetRawValue()); }
     INT64 GetRawPositionTimestamp() const { return m_NetPosition.GetSampleTime(); }
     FLOAT GetRawPositionLerpValue() const { return m_NetPosition.GetLerpValue(); }
 };
+
+DEFINE_NETWORK_MEMBERS(NetworkTransform,
+    NETWORK_MEMBER(NetworkTransform, Float3Delta,        m_NetPosition),
+    NETWORK_MEMBER(NetworkTransform, Float,              m_NetScale),
+    NETWORK_MEMBER(NetworkTransform, Float4AsHalf4Delta, m_NetOrientation),
+    NETWORK_MEMBER(NetworkTransform, Integer,            m_NetFlags),
+    NETWORK_MEMBER(NetworkTransform, Integer,            m_ContinuityEpoch))
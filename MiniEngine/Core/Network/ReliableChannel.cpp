@@ -0,0 +1,891 @@
+#include "pch.h"
+#include "ReliableChannel.h"
+#include "SnapshotSendQueue.h"
+#include "NetDecoder.h"
+#include "LineProtocol.h"
+#include "NetShared.h"
+#include <algorithm>
+#include <random>
+
+ReliableMessagePool::ReliableMessagePool()
+    : m_pFreeList( nullptr ),
+      m_AllocatedCount( 0 )
+{
+    InitializeCriticalSection( &m_CritSec );
+}
+
+ReliableMessagePool::~ReliableMessagePool()
+{
+    for( ReliableMessage* pChunk : m_Chunks )
+    {
+        delete[] pChunk;
+    }
+    DeleteCriticalSection( &m_CritSec );
+}
+
+ReliableMessagePool& ReliableMessagePool::Get()
+{
+    static ReliableMessagePool s_Pool;
+    return s_Pool;
+}
+
+ReliableMessage* ReliableMessagePool::Allocate()
+{
+    EnterCriticalSection( &m_CritSec );
+
+    if( m_pFreeList == nullptr )
+    {
+        ReliableMessage* pChunk = new ReliableMessage[MessagesPerChunk];
+        m_Chunks.push_back( pChunk );
+        for( UINT32 i = MessagesPerChunk; i > 0; --i )
+        {
+            auto* pFree = (FreeMessage*)&pChunk[i - 1];
+            pFree->pNext = m_pFreeList;
+            m_pFreeList = pFree;
+        }
+    }
+
+    FreeMessage* pFree = m_pFreeList;
+    m_pFreeList = pFree->pNext;
+    ++m_AllocatedCount;
+
+    LeaveCriticalSection( &m_CritSec );
+
+    return new (pFree) ReliableMessage();
+}
+
+ReliableMessage* ReliableMessagePool::Allocate( const ReliableMessage& Source )
+{
+    assert( Source.BufferSizeBytes <= sizeof(Source.Buffer) );
+    ReliableMessage* pMessage = Allocate();
+    memcpy( pMessage, &Source, Source.GetSizeBytes() );
+    return pMessage;
+}
+
+VOID ReliableMessagePool::Free( ReliableMessage* pMessage )
+{
+    assert( pMessage != nullptr );
+
+    EnterCriticalSection( &m_CritSec );
+
+    auto* pFree = (FreeMessage*)pMessage;
+    pFree->pNext = m_pFreeList;
+    m_pFreeList = pFree;
+    assert( m_AllocatedCount > 0 );
+    --m_AllocatedCount;
+
+    LeaveCriticalSection( &m_CritSec );
+}
+
+ReliableChannel::ReliableChannel()
+    : m_NextSendIndex( 1 ),
+      m_Tokens( 0 ),
+      m_LastRefillTick( 0 ),
+      m_NextRecvIndex( 1 ),
+      m_AckPending( FALSE ),
+      m_ReassemblyIndex( 0 ),
+      m_ReassemblyOpcode( 0 )
+{
+    InitializeCriticalSection( &m_PendingCritSec );
+
+    LARGE_INTEGER Frequency;
+    QueryPerformanceFrequency( &Frequency );
+    m_TickFrequency = Frequency.QuadPart;
+    m_SmoothedRttTicks = m_TickFrequency / 10;
+    m_RetransmitTicks = m_TickFrequency / 4;
+
+    m_RecvWindow.resize( NET_RELIABLE_WINDOW_SIZE, nullptr );
+    ZeroMemory( &m_Stats, sizeof(m_Stats) );
+
+    SetRateLimit( NET_RELIABLE_RATE_LIMIT_BYTES_PER_SECOND, NET_RELIABLE_RATE_BURST_BYTES );
+    m_Tokens = m_BurstBytes;
+}
+
+ReliableChannel::~ReliableChannel()
+{
+    ReliableMessagePool& Pool = ReliableMessagePool::Get();
+    for( ReliableMessage* pMessage : m_PendingQueue )
+    {
+        Pool.Free( pMessage );
+    }
+    for( SendEntry& Entry : m_SendWindow )
+    {
+        if( Entry.pMessage != nullptr )
+        {
+            Pool.Free( Entry.pMessage );
+        }
+    }
+    for( ReliableMessage* pMessage : m_RecvWindow )
+    {
+        if( pMessage != nullptr )
+        {
+            Pool.Free( pMessage );
+        }
+    }
+    DeleteCriticalSection( &m_PendingCritSec );
+}
+
+VOID ReliableChannel::SetRateLimit( UINT32 BytesPerSecond, UINT32 BurstBytes )
+{
+    m_RateBytesPerTick = (DOUBLE)BytesPerSecond / (DOUBLE)m_TickFrequency;
+    m_BurstBytes = (DOUBLE)std::max( BurstBytes, (UINT32)NET_MAX_RELIABLE_MESSAGE_SIZE_BYTES );
+    m_Tokens = std::min( m_Tokens, m_BurstBytes );
+}
+
+VOID ReliableChannel::QueueMessage( const ReliableMessage& msg )
+{
+    ReliableMessage* pMessage = ReliableMessagePool::Get().Allocate( msg );
+    pMessage->FragmentIndex = 0;
+    pMessage->FragmentCount = 1;
+
+    EnterCriticalSection( &m_PendingCritSec );
+
+    m_PendingQueue.push_back( pMessage );
+    ++m_Stats.MessagesQueued;
+    m_Stats.PayloadBytesQueued += msg.BufferSizeBytes;
+
+    LeaveCriticalSection( &m_PendingCritSec );
+}
+
+BOOL ReliableChannel::QueueMessage( UINT Opcode, const VOID* pPayload, UINT PayloadSizeBytes )
+{
+    if( PayloadSizeBytes > NET_MAX_RELIABLE_PAYLOAD_SIZE_BYTES )
+    {
+        return FALSE;
+    }
+
+    const UINT FragmentSizeBytes = sizeof(ReliableMessage::Buffer);
+    const UINT FragmentCount = std::max( 1U, ( PayloadSizeBytes + FragmentSizeBytes - 1 ) / FragmentSizeBytes );
+
+    // Fragments must take consecutive indices, so they are queued together
+    std::vector<ReliableMessage*> Fragments( FragmentCount );
+    const BYTE* pSrc = (const BYTE*)pPayload;
+    UINT BytesRemaining = PayloadSizeBytes;
+    for( UINT i = 0; i < FragmentCount; ++i )
+    {
+        ReliableMessage* pMessage = ReliableMessagePool::Get().Allocate();
+        pMessage->Opcode = Opcode;
+        pMessage->FragmentIndex = (USHORT)i;
+        pMessage->FragmentCount = (USHORT)FragmentCount;
+        pMessage->BufferSizeBytes = std::min( BytesRemaining, FragmentSizeBytes );
+        memcpy( pMessage->Buffer, pSrc, pMessage->BufferSizeBytes );
+        pSrc += pMessage->BufferSizeBytes;
+        BytesRemaining -= pMessage->BufferSizeBytes;
+        Fragments[i] = pMessage;
+    }
+
+    EnterCriticalSection( &m_PendingCritSec );
+
+    m_PendingQueue.insert( m_PendingQueue.end(), Fragments.begin(), Fragments.end() );
+    m_Stats.MessagesQueued += FragmentCount;
+    m_Stats.PayloadBytesQueued += PayloadSizeBytes;
+
+    LeaveCriticalSection( &m_PendingCritSec );
+
+    return TRUE;
+}
+
+BOOL ReliableChannel::IsIdle()
+{
+    EnterCriticalSection( &m_PendingCritSec );
+    const BOOL Idle = m_SendWindow.empty() && m_PendingQueue.empty();
+    LeaveCriticalSection( &m_PendingCritSec );
+    return Idle;
+}
+
+VOID ReliableChannel::Send( ISendState* pISS, INT64 CurrentTick, NetFrameStatistics* pStats )
+{
+    if( m_AckPending )
+    {
+        // The first acknowledgement always goes; the rest only cover buffered messages
+        for( UINT32 MaskOffset = 0; MaskOffset + 1 < NET_RELIABLE_WINDOW_SIZE; MaskOffset += 32 )
+        {
+            UINT32 ReceivedMask = 0;
+            for( UINT32 i = 0; i < 32 && MaskOffset + i + 1 < NET_RELIABLE_WINDOW_SIZE; ++i )
+            {
+                const UINT32 Index = m_NextRecvIndex + 1 + MaskOffset + i;
+                const ReliableMessage* pMessage = m_RecvWindow[Index % NET_RELIABLE_WINDOW_SIZE];
+                if( pMessage != nullptr && pMessage->UniqueIndex == Index )
+                {
+                    ReceivedMask |= ( 1U << i );
+                }
+            }
+            if( MaskOffset == 0 || ReceivedMask != 0 )
+            {
+                if( pStats != nullptr ) { pStats->ReliableAcksSent++; }
+                pISS->SendReliableAck( m_NextRecvIndex - 1, MaskOffset, ReceivedMask );
+            }
+        }
+        m_AckPending = FALSE;
+    }
+
+    if( m_LastRefillTick != 0 )
+    {
+        m_Tokens = std::min( m_BurstBytes, m_Tokens + (DOUBLE)( CurrentTick - m_LastRefillTick ) * m_RateBytesPerTick );
+    }
+    m_LastRefillTick = CurrentTick;
+
+    EnterCriticalSection( &m_PendingCritSec );
+
+    while( !m_PendingQueue.empty() && m_SendWindow.size() < NET_RELIABLE_WINDOW_SIZE )
+    {
+        SendEntry Entry = {};
+        Entry.pMessage = m_PendingQueue.front();
+        Entry.pMessage->UniqueIndex = m_NextSendIndex++;
+        m_SendWindow.push_back( Entry );
+        m_PendingQueue.pop_front();
+    }
+
+    LeaveCriticalSection( &m_PendingCritSec );
+
+    const BOOL RateLimited = ( m_RateBytesPerTick > 0.0 );
+    for( SendEntry& Entry : m_SendWindow )
+    {
+        if( Entry.pMessage == nullptr )
+        {
+            continue;
+        }
+
+        // Back off on every resend, up to eight times the timeout
+        if( Entry.SendCount > 0 && !Entry.Missing && CurrentTick - Entry.LastSendTick < ( m_RetransmitTicks << std::min( Entry.SendCount - 1, 3U ) ) )
+        {
+            continue;
+        }
+
+        const UINT32 SizeBytes = (UINT32)Entry.pMessage->GetSizeBytes();
+        if( RateLimited )
+        {
+            if( m_Tokens < (DOUBLE)SizeBytes )
+            {
+                break;
+            }
+            m_Tokens -= (DOUBLE)SizeBytes;
+        }
+
+        pISS->SendReliableMessage( *Entry.pMessage );
+
+        if( Entry.SendCount == 0 )
+        {
+            if( pStats != nullptr ) { pStats->ReliableMessagesSent++; pStats->ReliableMessageBytesSent += SizeBytes; }
+            if( m_Stats.FirstSendTick == 0 )
+            {
+                m_Stats.FirstSendTick = CurrentTick;
+            }
+        }
+        else
+        {
+            if( pStats != nullptr ) { pStats->ReliableMessagesRetransmitted++; pStats->ReliableMessageBytesRetransmitted += SizeBytes; }
+            ++m_Stats.MessagesRetransmitted;
+            m_Stats.BytesRetransmitted += SizeBytes;
+        }
+        ++m_Stats.MessagesSent;
+        m_Stats.BytesSent += SizeBytes;
+
+        ++Entry.SendCount;
+        Entry.LastSendTick = CurrentTick;
+        Entry.Missing = FALSE;
+    }
+}
+
+VOID ReliableChannel::ReleaseEntry( SendEntry& Entry, INT64 CurrentTick )
+{
+    if( Entry.pMessage == nullptr )
+    {
+        return;
+    }
+
+    // Only messages sent once give an unambiguous round trip
+    if( Entry.SendCount == 1 )
+    {
+        const INT64 RttTicks = CurrentTick - Entry.LastSendTick;
+        m_SmoothedRttTicks += ( RttTicks - m_SmoothedRttTicks ) / 8;
+        m_RetransmitTicks = std::min( std::max( m_SmoothedRttTicks * 2, m_TickFrequency / 20 ), m_TickFrequency );
+    }
+
+    ReliableMessagePool::Get().Free( Entry.pMessage );
+    Entry.pMessage = nullptr;
+    ++m_Stats.MessagesAcknowledged;
+}
+
+VOID ReliableChannel::Acknowledge( UINT32 BaseIndex, UINT32 MaskOffset, UINT32 ReceivedMask, INT64 CurrentTick )
+{
+    if( m_SendWindow.empty() )
+    {
+        return;
+    }
+
+    UINT32 FrontIndex = m_NextSendIndex - (UINT32)m_SendWindow.size();
+    while( !m_SendWindow.empty() && FrontIndex <= BaseIndex )
+    {
+        ReleaseEntry( m_SendWindow.front(), CurrentTick );
+        m_SendWindow.pop_front();
+        ++FrontIndex;
+    }
+
+    UINT32 AckedEnd = 0;
+    for( UINT32 i = 0; i < 32 && ReceivedMask != 0; ++i )
+    {
+        const UINT32 Index = BaseIndex + 2 + MaskOffset + i;
+        if( ( ReceivedMask & ( 1U << i ) ) == 0 || Index < FrontIndex )
+        {
+            continue;
+        }
+        const UINT32 Offset = Index - FrontIndex;
+        if( Offset >= m_SendWindow.size() )
+        {
+            break;
+        }
+        ReleaseEntry( m_SendWindow[Offset], CurrentTick );
+        AckedEnd = Offset + 1;
+    }
+
+    // Anything sent a round trip before a message that has now arrived was lost
+    for( UINT32 Offset = 0; Offset < AckedEnd; ++Offset )
+    {
+        SendEntry& Entry = m_SendWindow[Offset];
+        if( Entry.pMessage != nullptr && CurrentTick - Entry.LastSendTick >= m_SmoothedRttTicks )
+        {
+            Entry.Missing = TRUE;
+        }
+    }
+
+    while( !m_SendWindow.empty() && m_SendWindow.front().pMessage == nullptr )
+    {
+        m_SendWindow.pop_front();
+    }
+
+    if( m_Stats.FirstDrainTick == 0 && m_Stats.FirstSendTick != 0 && IsIdle() )
+    {
+        m_Stats.FirstDrainTick = CurrentTick;
+        m_Stats.FirstDrainBytes = m_Stats.BytesSent;
+    }
+}
+
+BOOL ReliableChannel::Receive( VOID* pSenderContext, IDecodeHandler* pHandler, UINT32 UniqueIndex, UINT Opcode, UINT FragmentIndex, UINT FragmentCount, const BYTE* pPayload, UINT PayloadSizeBytes, NetFrameStatistics* pStats )
+{
+    if( (INT32)( UniqueIndex - m_NextRecvIndex ) < 0 )
+    {
+        // Already delivered; the sender missed our acknowledgement
+        if( pStats != nullptr ) { pStats->DuplicateReliableMessagesSkipped++; }
+        ++m_Stats.DuplicatesReceived;
+        m_AckPending = TRUE;
+        return TRUE;
+    }
+
+    const UINT32 Offset = UniqueIndex - m_NextRecvIndex;
+    if( Offset >= NET_RELIABLE_WINDOW_SIZE || PayloadSizeBytes > sizeof(ReliableMessage::Buffer) )
+    {
+        return FALSE;
+    }
+
+    m_AckPending = TRUE;
+
+    ReliableMessage*& pSlot = m_RecvWindow[UniqueIndex % NET_RELIABLE_WINDOW_SIZE];
+    if( pSlot != nullptr )
+    {
+        if( pStats != nullptr ) { pStats->DuplicateReliableMessagesSkipped++; }
+        ++m_Stats.DuplicatesReceived;
+        return TRUE;
+    }
+
+    if( pStats != nullptr ) { pStats->ReliableMessagesReceived++; }
+
+    if( Offset > 0 )
+    {
+        // Hold it until the gap in front of it is filled
+        ReliableMessage* pMessage = ReliableMessagePool::Get().Allocate();
+        pMessage->UniqueIndex = UniqueIndex;
+        pMessage->Opcode = Opcode;
+        pMessage->FragmentIndex = (USHORT)FragmentIndex;
+        pMessage->FragmentCount = (USHORT)FragmentCount;
+        pMessage->BufferSizeBytes = PayloadSizeBytes;
+        if( PayloadSizeBytes > 0 )
+        {
+            memcpy( pMessage->Buffer, pPayload, PayloadSizeBytes );
+        }
+        pSlot = pMessage;
+        return TRUE;
+    }
+
+    BOOL Success = Deliver( pSenderContext, pHandler, UniqueIndex, Opcode, FragmentIndex, FragmentCount, pPayload, PayloadSizeBytes );
+    ++m_NextRecvIndex;
+
+    for( ;; )
+    {
+        ReliableMessage*& pNext = m_RecvWindow[m_NextRecvIndex % NET_RELIABLE_WINDOW_SIZE];
+        if( pNext == nullptr )
+        {
+            break;
+        }
+        ReliableMessage* pMessage = pNext;
+        pNext = nullptr;
+        assert( pMessage->UniqueIndex == m_NextRecvIndex );
+        if( !Deliver( pSenderContext, pHandler, pMessage->UniqueIndex, pMessage->Opcode, pMessage->FragmentIndex, pMessage->FragmentCount, pMessage->BufferSizeBytes > 0 ? pMessage->Buffer : nullptr, pMessage->BufferSizeBytes ) )
+        {
+            Success = FALSE;
+        }
+        ReliableMessagePool::Get().Free( pMessage );
+        ++m_NextRecvIndex;
+    }
+
+    return Success;
+}
+
+BOOL ReliableChannel::Deliver( VOID* pSenderContext, IDecodeHandler* pHandler, UINT32 UniqueIndex, UINT Opcode, UINT FragmentIndex, UINT FragmentCount, const BYTE* pPayload, UINT PayloadSizeBytes )
+{
+    if( FragmentCount <= 1 )
+    {
+        ++m_Stats.MessagesDelivered;
+        pHandler->HandleReliableMessage( pSenderContext, Opcode, UniqueIndex, pPayload, PayloadSizeBytes );
+        return TRUE;
+    }
+
+    if( FragmentIndex == 0 )
+    {
+        m_Reassembly.clear();
+        m_ReassemblyIndex = UniqueIndex;
+        m_ReassemblyOpcode = Opcode;
+    }
+    else if( UniqueIndex - FragmentIndex != m_ReassemblyIndex || Opcode != m_ReassemblyOpcode )
+    {
+        // The start of this payload was never seen, or it was dropped; drop the rest of it
+        return TRUE;
+    }
+
+    // The sender pads each fragment, so the whole payload may exceed the limit by the padding
+    if( m_Reassembly.size() + PayloadSizeBytes > NET_MAX_RELIABLE_PAYLOAD_SIZE_BYTES + sizeof(UINT32) )
+    {
+        // No valid sender produces this; drop the payload rather than deliver part of it.  The
+        // index of the message before its first fragment makes the rest fail the check above.
+        ++m_Stats.ProtocolErrors;
+        m_Reassembly.clear();
+        m_ReassemblyIndex = UniqueIndex - FragmentIndex - 1;
+        return FALSE;
+    }
+    m_Reassembly.insert( m_Reassembly.end(), pPayload, pPayload + PayloadSizeBytes );
+
+    if( FragmentIndex + 1 == FragmentCount )
+    {
+        ++m_Stats.MessagesDelivered;
+        pHandler->HandleReliableMessage( pSenderContext, Opcode, m_ReassemblyIndex, m_Reassembly.data(), (UINT)m_Reassembly.size() );
+        m_Reassembly.clear();
+        m_ReassemblyIndex = 0;
+    }
+    return TRUE;
+}
+
+namespace
+{
+    const UINT32 BenchmarkStepsPerSecond = 60;
+    const UINT32 BenchmarkLatencySteps = 3;
+    const UINT32 BenchmarkMaxSteps = BenchmarkStepsPerSecond * 30;
+    const UINT32 BenchmarkBlobSizeBytes = 64 * 1024;
+    const UINT32 BenchmarkPacketHeaderBytes = 28;
+
+    inline UINT32 PaddedSize( UINT32 SizeBytes ) { return ( SizeBytes + 3 ) & ~3U; }
+
+    inline BYTE PayloadByte( UINT32 Seed, UINT32 Offset ) { return (BYTE)( Seed * 131 + Offset * 7 + ( Offset >> 8 ) ); }
+
+    struct BenchmarkPayload
+    {
+        UINT32 Opcode;
+        UINT32 SizeBytes;
+        UINT32 Seed;
+    };
+
+    // Checks each delivered payload against the list it was queued from, in order
+    class BenchmarkReceiver : public IDecodeHandler
+    {
+    public:
+        const std::vector<BenchmarkPayload>* pExpected;
+        UINT32 DeliveredCount;
+        UINT32 ErrorCount;
+
+        BenchmarkReceiver( const std::vector<BenchmarkPayload>* pPayloads )
+            : pExpected( pPayloads ),
+              DeliveredCount( 0 ),
+              ErrorCount( 0 )
+        { }
+
+        virtual BOOL HandleReliableMessage( VOID* pSenderContext, const UINT Opcode, const UINT UniqueIndex, const BYTE* pPayload, const UINT PayloadSizeBytes )
+        {
+            if( DeliveredCount >= pExpected->size() )
+            {
+                ++ErrorCount;
+                return TRUE;
+            }
+            const BenchmarkPayload& Expected = ( *pExpected )[DeliveredCount++];
+            if( Opcode != Expected.Opcode || PayloadSizeBytes != PaddedSize( Expected.SizeBytes ) )
+            {
+                ++ErrorCount;
+                return TRUE;
+            }
+            for( UINT32 i = 0; i < Expected.SizeBytes; ++i )
+            {
+                if( pPayload[i] != PayloadByte( Expected.Seed, i ) )
+                {
+                    ++ErrorCount;
+                    break;
+                }
+            }
+            return TRUE;
+        }
+    };
+
+    struct WireMessage
+    {
+        BOOL IsAck;
+        UINT32 BaseIndex;
+        UINT32 MaskOffset;
+        UINT32 ReceivedMask;
+        ReliableMessage Message;
+    };
+
+    struct WirePacket
+    {
+        UINT32 ArrivalStep;
+        std::vector<WireMessage> Messages;
+    };
+
+    // Packs what a channel sends into datagrams the size the encoder uses, and drops,
+    // delays and delivers them
+    class BenchmarkLink : public ISendState
+    {
+    public:
+        std::mt19937* pRandom;
+        UINT32 LossPercent;
+        UINT32 CurrentStep;
+        WirePacket Current;
+        UINT32 CurrentBytes;
+        std::deque<WirePacket> InFlight;
+        UINT64 BytesSent;
+
+        BenchmarkLink( std::mt19937* pRandomSource, UINT32 Loss )
+            : pRandom( pRandomSource ),
+              LossPercent( Loss ),
+              CurrentStep( 0 ),
+              CurrentBytes( 0 ),
+              BytesSent( 0 )
+        { }
+
+        VOID Add( const WireMessage& Message, UINT32 SizeBytes )
+        {
+            if( CurrentBytes + SizeBytes > NET_SEND_RECV_BUFFER_SIZE_BYTES )
+            {
+                Flush();
+            }
+            Current.Messages.push_back( Message );
+            CurrentBytes += SizeBytes;
+        }
+
+        VOID Flush()
+        {
+            if( Current.Messages.empty() )
+            {
+                return;
+            }
+            BytesSent += CurrentBytes + BenchmarkPacketHeaderBytes;
+            if( (UINT32)( ( *pRandom )() % 100 ) >= LossPercent )
+            {
+                Current.ArrivalStep = CurrentStep + BenchmarkLatencySteps;
+                InFlight.push_back( std::move( Current ) );
+            }
+            Current = WirePacket();
+            CurrentBytes = 0;
+        }
+
+        virtual VOID SendReliableMessage( const ReliableMessage& msg )
+        {
+            WireMessage Message = {};
+            Message.Message = msg;
+            const UINT32 HeaderBytes = msg.FragmentCount > 1 ? sizeof(NetPacketReliableFragment) : sizeof(NetPacketReliableMessage);
+            Add( Message, HeaderBytes + PaddedSize( msg.BufferSizeBytes ) );
+        }
+
+        virtual VOID SendReliableAck( UINT32 BaseIndex, UINT32 MaskOffset, UINT32 ReceivedMask )
+        {
+            WireMessage Message = {};
+            Message.IsAck = TRUE;
+            Message.BaseIndex = BaseIndex;
+            Message.MaskOffset = MaskOffset;
+            Message.ReceivedMask = ReceivedMask;
+            Add( Message, sizeof(NetPacketReliableAck) );
+        }
+
+        virtual VOID BeginSnapshot( UINT32 Index ) {}
+        virtual VOID SendUnreliableMessage( const ReliableMessage& msg ) {}
+        virtual VOID SendAcknowledge( const UINT SnapshotIndex ) {}
+        virtual VOID EndSnapshot( UINT32 Index ) {}
+        virtual VOID NodeCreated( StateNode* pNode, StateNode* pParentNode ) {}
+        virtual VOID NodeDeleted( StateNode* pNode ) {}
+        virtual VOID NodeChanged( StateNode* pPrev, StateNode* pCurrent ) {}
+    };
+
+    struct BenchmarkResult
+    {
+        UINT32 Steps;
+        BOOL Finished;
+        UINT64 BytesSent;
+        UINT64 BytesRetransmitted;
+        UINT32 LostCount;
+    };
+
+    // The scheme this channel replaces: every unacknowledged message goes out with every
+    // snapshot, a message is dropped once a snapshot sent after it is acknowledged, and the
+    // receiver skips any index at or below the last one it delivered.  Only payloads that
+    // fit one message can be sent, so the blob goes as separate pieces.
+    BenchmarkResult RunResendPerSnapshot( const std::vector<UINT32>& MessageSizes, UINT32 LossPercent, std::mt19937& Random )
+    {
+        struct Packet
+        {
+            UINT32 ArrivalStep;
+            UINT32 Snapshot;
+            UINT32 PacketCount;
+            std::vector<UINT32> Indices;
+        };
+
+        BenchmarkResult Result = {};
+        std::vector<UINT32> FirstSnapshot( MessageSizes.size(), 0 );
+        std::vector<bool> Delivered( MessageSizes.size(), false );
+        std::deque<Packet> ToReceiver;
+        std::deque<std::pair<UINT32, UINT32>> ToSender;
+        UINT32 QueueFront = 0;
+        UINT32 LastDelivered = 0;
+        UINT32 SnapshotPackets = 0;
+        UINT32 SnapshotPacketsReceived = 0;
+        UINT32 ReceivingSnapshot = 0;
+        UINT32 QueuedAck = 0;
+
+        UINT32 Step = 0;
+        for( ; Step < BenchmarkMaxSteps; ++Step )
+        {
+            while( !ToReceiver.empty() && ToReceiver.front().ArrivalStep <= Step )
+            {
+                const Packet& Arrived = ToReceiver.front();
+                if( Arrived.Snapshot != ReceivingSnapshot )
+                {
+                    ReceivingSnapshot = Arrived.Snapshot;
+                    SnapshotPacketsReceived = 0;
+                }
+                for( UINT32 Index : Arrived.Indices )
+                {
+                    if( Index + 1 > LastDelivered )
+                    {
+                        Delivered[Index] = true;
+                        LastDelivered = Index + 1;
+                    }
+                }
+                if( ++SnapshotPacketsReceived == Arrived.PacketCount )
+                {
+                    QueuedAck = Arrived.Snapshot;
+                }
+                ToReceiver.pop_front();
+            }
+            while( !ToSender.empty() && ToSender.front().first <= Step )
+            {
+                const UINT32 AckedSnapshot = ToSender.front().second;
+                while( QueueFront < MessageSizes.size() && FirstSnapshot[QueueFront] != 0 && FirstSnapshot[QueueFront] <= AckedSnapshot )
+                {
+                    ++QueueFront;
+                }
+                ToSender.pop_front();
+            }
+            if( QueueFront == MessageSizes.size() )
+            {
+                Result.Finished = TRUE;
+                break;
+            }
+
+            const UINT32 Snapshot = Step + 1;
+            std::vector<Packet> Packets( 1 );
+            UINT32 PacketBytes = 0;
+            for( UINT32 i = QueueFront; i < MessageSizes.size(); ++i )
+            {
+                const UINT32 SizeBytes = sizeof(NetPacketReliableMessage) + PaddedSize( MessageSizes[i] );
+                if( PacketBytes + SizeBytes > NET_SEND_RECV_BUFFER_SIZE_BYTES )
+                {
+                    Result.BytesSent += PacketBytes + BenchmarkPacketHeaderBytes;
+                    Packets.emplace_back();
+                    PacketBytes = 0;
+                }
+                if( FirstSnapshot[i] == 0 )
+                {
+                    FirstSnapshot[i] = Snapshot;
+                }
+                else
+                {
+                    Result.BytesRetransmitted += SizeBytes;
+                }
+                Packets.back().Indices.push_back( i );
+                PacketBytes += SizeBytes;
+            }
+            Result.BytesSent += PacketBytes + BenchmarkPacketHeaderBytes;
+            for( Packet& Sent : Packets )
+            {
+                Sent.ArrivalStep = Step + BenchmarkLatencySteps;
+                Sent.Snapshot = Snapshot;
+                Sent.PacketCount = (UINT32)Packets.size();
+                if( Random() % 100 >= LossPercent )
+                {
+                    ToReceiver.push_back( std::move( Sent ) );
+                }
+            }
+
+            if( QueuedAck != 0 )
+            {
+                if( Random() % 100 >= LossPercent )
+                {
+                    ToSender.push_back( std::make_pair( Step + BenchmarkLatencySteps, QueuedAck ) );
+                }
+                QueuedAck = 0;
+            }
+        }
+
+        Result.Steps = Step;
+        Result.LostCount = (UINT32)std::count( Delivered.begin(), Delivered.end(), false );
+        return Result;
+    }
+}
+
+bool ReliableChannel::Benchmark( UINT32 MessageCount, UINT32 LossPercent )
+{
+    MessageCount = std::max( MessageCount, 1U );
+    LossPercent = std::min( LossPercent, 90U );
+    std::mt19937 Random( 1234 );
+
+    // A join burst of small messages with a blob of level state in the middle
+    std::vector<BenchmarkPayload> Payloads;
+    UINT64 PayloadBytes = 0;
+    for( UINT32 i = 0; i < MessageCount; ++i )
+    {
+        if( i == MessageCount / 2 )
+        {
+            BenchmarkPayload Blob = { 100, BenchmarkBlobSizeBytes, 0xB10B };
+            Payloads.push_back( Blob );
+            PayloadBytes += Blob.SizeBytes;
+        }
+        BenchmarkPayload Payload = { (UINT32)ReliableMessageType::FirstUserReliableMessage + ( i & 7 ), 16 + (UINT32)( Random() % 81 ), i };
+        Payloads.push_back( Payload );
+        PayloadBytes += Payload.SizeBytes;
+    }
+
+    // The old scheme's messages, with the blob cut into pieces
+    std::vector<UINT32> MessageSizes;
+    for( const BenchmarkPayload& Payload : Payloads )
+    {
+        for( UINT32 Offset = 0; Offset < Payload.SizeBytes; Offset += sizeof(ReliableMessage::Buffer) )
+        {
+            MessageSizes.push_back( std::min( Payload.SizeBytes - Offset, (UINT32)sizeof(ReliableMessage::Buffer) ) );
+        }
+    }
+
+    std::mt19937 OldRandom( 5678 );
+    const BenchmarkResult Old = RunResendPerSnapshot( MessageSizes, LossPercent, OldRandom );
+
+    std::mt19937 LinkRandom( 5678 );
+    ReliableChannel Server;
+    ReliableChannel Client;
+    BenchmarkLink ToClient( &LinkRandom, LossPercent );
+    BenchmarkLink ToServer( &LinkRandom, LossPercent );
+    BenchmarkReceiver Receiver( &Payloads );
+
+    std::vector<BYTE> Buffer;
+    UINT32 ErrorCount = 0;
+    for( const BenchmarkPayload& Payload : Payloads )
+    {
+        Buffer.resize( Payload.SizeBytes );
+        for( UINT32 i = 0; i < Payload.SizeBytes; ++i )
+        {
+            Buffer[i] = PayloadByte( Payload.Seed, i );
+        }
+        if( !Server.QueueMessage( Payload.Opcode, Buffer.data(), Payload.SizeBytes ) )
+        {
+            ++ErrorCount;
+        }
+    }
+
+    const UINT32 PeakPoolMessages = ReliableMessagePool::Get().GetAllocatedCount();
+    const INT64 TicksPerStep = Server.GetTickFrequency() / BenchmarkStepsPerSecond;
+    BenchmarkResult New = {};
+    UINT32 Step = 0;
+    for( ; Step < BenchmarkMaxSteps; ++Step )
+    {
+        const INT64 CurrentTick = ( Step + 1 ) * TicksPerStep;
+
+        while( !ToClient.InFlight.empty() && ToClient.InFlight.front().ArrivalStep <= Step )
+        {
+            for( const WireMessage& Message : ToClient.InFlight.front().Messages )
+            {
+                const ReliableMessage& msg = Message.Message;
+
+                // Payloads arrive padded to whole words, as they do off the wire
+                BYTE Padded[sizeof(msg.Buffer)] = {};
+                memcpy( Padded, msg.Buffer, msg.BufferSizeBytes );
+                if( !Client.Receive( nullptr, &Receiver, msg.UniqueIndex, msg.Opcode, msg.FragmentIndex, msg.FragmentCount, Padded, PaddedSize( msg.BufferSizeBytes ), nullptr ) )
+                {
+                    ++ErrorCount;
+                }
+            }
+            ToClient.InFlight.pop_front();
+        }
+        while( !ToServer.InFlight.empty() && ToServer.InFlight.front().ArrivalStep <= Step )
+        {
+            for( const WireMessage& Message : ToServer.InFlight.front().Messages )
+            {
+                Server.Acknowledge( Message.BaseIndex, Message.MaskOffset, Message.ReceivedMask, CurrentTick );
+            }
+            ToServer.InFlight.pop_front();
+        }
+        if( Server.IsIdle() )
+        {
+            New.Finished = TRUE;
+            break;
+        }
+
+        ToClient.CurrentStep = Step;
+        Server.Send( &ToClient, CurrentTick, nullptr );
+        ToClient.Flush();
+        ToServer.CurrentStep = Step;
+        Client.Send( &ToServer, CurrentTick, nullptr );
+        ToServer.Flush();
+    }
+    New.Steps = Step;
+    New.BytesSent = ToClient.BytesSent;
+    New.BytesRetransmitted = Server.GetStatistics().BytesRetransmitted;
+    New.LostCount = (UINT32)Payloads.size() - Receiver.DeliveredCount;
+
+    ErrorCount += Receiver.ErrorCount + New.LostCount;
+    const ReliableChannelStatistics& Stats = Server.GetStatistics();
+    if( Stats.MessagesDelivered != 0 || Client.GetStatistics().MessagesDelivered != Payloads.size() )
+    {
+        ++ErrorCount;
+    }
+    const bool Passed = New.Finished && ErrorCount == 0;
+
+    Utility::PrintfConsole( "Reliable channel benchmark: %u messages and a %u KB blob, %u%% loss, %u ms latency\n",
+        MessageCount, BenchmarkBlobSizeBytes / 1024, LossPercent, BenchmarkLatencySteps * 1000 / BenchmarkStepsPerSecond );
+
+    const BenchmarkResult* Results[] = { &Old, &New };
+    const CHAR* strLabels[] = { "Resend per snapshot:", "Windowed channel:" };
+    for( UINT32 i = 0; i < ARRAYSIZE(Results); ++i )
+    {
+        const BenchmarkResult& Result = *Results[i];
+        const DOUBLE Msec = (DOUBLE)Result.Steps * 1000.0 / BenchmarkStepsPerSecond;
+        const DOUBLE SentKB = (DOUBLE)Result.BytesSent / 1024.0;
+        if( Result.Finished )
+        {
+            Utility::PrintfConsole( "  %-21s%8.1f ms, %9.1f KB sent, %6.1f KB/s, %5.1f%% overhead, %5.1f%% retransmitted, %u lost\n",
+                strLabels[i], Msec, SentKB, Msec > 0.0 ? (DOUBLE)PayloadBytes / 1024.0 / ( Msec / 1000.0 ) : 0.0,
+                100.0 * ( (DOUBLE)Result.BytesSent - (DOUBLE)PayloadBytes ) / (DOUBLE)PayloadBytes,
+                100.0 * (DOUBLE)Result.BytesRetransmitted / (DOUBLE)Result.BytesSent, Result.LostCount );
+        }
+        else
+        {
+            Utility::PrintfConsole( "  %-21sunfinished after %.0f ms, %9.1f KB sent, %u lost so far\n", strLabels[i], Msec, SentKB, Result.LostCount );
+        }
+    }
+    Utility::PrintfConsole( "  Message pool:        %u messages at peak, %u allocated now\n", PeakPoolMessages, ReliableMessagePool::Get().GetAllocatedCount() );
+    Utility::PrintfConsole( "  Errors:              %u\n", ErrorCount );
+
+    return Passed;
+}
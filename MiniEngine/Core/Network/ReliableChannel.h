@@ -0,0 +1,152 @@
+#pragma once
+
+#include <windows.h>
+#include <deque>
+#include <vector>
+
+#include "ReliableMessage.h"
+
+struct NetFrameStatistics;
+interface ISendState;
+interface IDecodeHandler;
+
+// Fixed size message blocks carved out of chunks that are kept for reuse, so queueing a
+// message does not touch the heap once the pool has grown to the peak load.  Any thread
+// may allocate and free.
+class ReliableMessagePool
+{
+private:
+    static const UINT32 MessagesPerChunk = 64;
+
+    struct FreeMessage
+    {
+        FreeMessage* pNext;
+    };
+
+    CRITICAL_SECTION m_CritSec;
+    FreeMessage* m_pFreeList;
+    std::vector<ReliableMessage*> m_Chunks;
+    UINT32 m_AllocatedCount;
+
+public:
+    ReliableMessagePool();
+    ~ReliableMessagePool();
+
+    ReliableMessage* Allocate();
+    ReliableMessage* Allocate( const ReliableMessage& Source );
+    VOID Free( ReliableMessage* pMessage );
+
+    UINT32 GetAllocatedCount() const { return m_AllocatedCount; }
+    UINT32 GetCapacity() const { return (UINT32)m_Chunks.size() * MessagesPerChunk; }
+
+    static ReliableMessagePool& Get();
+};
+
+struct ReliableChannelStatistics
+{
+    UINT64 MessagesQueued;
+    UINT64 PayloadBytesQueued;
+    UINT64 MessagesSent;
+    UINT64 BytesSent;
+    UINT64 MessagesRetransmitted;
+    UINT64 BytesRetransmitted;
+    UINT64 MessagesAcknowledged;
+    UINT64 MessagesDelivered;
+    UINT64 DuplicatesReceived;
+
+    // Fragmented payloads that reassembled to more than NET_MAX_RELIABLE_PAYLOAD_SIZE_BYTES
+    UINT64 ProtocolErrors;
+
+    // Join transfer: from the first message sent until the send window first drains
+    INT64 FirstSendTick;
+    INT64 FirstDrainTick;
+    UINT64 FirstDrainBytes;
+};
+
+// Windowed reliable messaging for one connection, in both directions.  Messages take
+// consecutive unique indices; up to NET_RELIABLE_WINDOW_SIZE of them are in flight, each
+// sent once and sent again only when it is not acknowledged within the retransmit timeout.
+// The receiver buffers messages that arrive out of order, delivers them in order, and
+// acknowledges selectively, so one lost packet does not resend everything behind it, and
+// a gap that later acknowledgements reveal is resent without waiting for the timeout.
+// Payloads larger than one message are fragmented and reassembled before delivery, and
+// sends are held to a per channel byte rate.
+//
+// Messages may be queued from any thread; everything else belongs to the network thread.
+class ReliableChannel
+{
+private:
+    struct SendEntry
+    {
+        ReliableMessage* pMessage;
+        INT64 LastSendTick;
+        UINT32 SendCount;
+        BOOL Missing;
+    };
+
+    CRITICAL_SECTION m_PendingCritSec;
+    ReliableMessageQueue m_PendingQueue;
+
+    std::deque<SendEntry> m_SendWindow;
+    UINT32 m_NextSendIndex;
+
+    INT64 m_TickFrequency;
+    INT64 m_SmoothedRttTicks;
+    INT64 m_RetransmitTicks;
+
+    DOUBLE m_RateBytesPerTick;
+    DOUBLE m_BurstBytes;
+    DOUBLE m_Tokens;
+    INT64 m_LastRefillTick;
+
+    std::vector<ReliableMessage*> m_RecvWindow;
+    UINT32 m_NextRecvIndex;
+    BOOL m_AckPending;
+
+    std::vector<BYTE> m_Reassembly;
+    UINT32 m_ReassemblyIndex;
+    UINT32 m_ReassemblyOpcode;
+
+    ReliableChannelStatistics m_Stats;
+
+public:
+    ReliableChannel();
+    ~ReliableChannel();
+
+    // Zero bytes per second removes the limit
+    VOID SetRateLimit( UINT32 BytesPerSecond, UINT32 BurstBytes );
+
+    VOID QueueMessage( const ReliableMessage& msg );
+
+    // Splits the payload into as many messages as it needs; fails if it is larger than
+    // NET_MAX_RELIABLE_PAYLOAD_SIZE_BYTES.  As with single messages, the delivered size
+    // is rounded up to a multiple of four bytes.
+    BOOL QueueMessage( UINT Opcode, const VOID* pPayload, UINT PayloadSizeBytes );
+
+    // Sends the pending acknowledgement, then every message that is new or overdue, oldest
+    // first, as far as the rate allows
+    VOID Send( ISendState* pISS, INT64 CurrentTick, NetFrameStatistics* pStats );
+
+    VOID Acknowledge( UINT32 BaseIndex, UINT32 MaskOffset, UINT32 ReceivedMask, INT64 CurrentTick );
+
+    // Delivers the message, and any buffered ones it completes, to the handler.  Returns
+    // FALSE if the message is outside the window or makes a fragmented payload too large;
+    // the oversized payload is dropped, not delivered.
+    BOOL Receive( VOID* pSenderContext, IDecodeHandler* pHandler, UINT32 UniqueIndex, UINT Opcode, UINT FragmentIndex, UINT FragmentCount, const BYTE* pPayload, UINT PayloadSizeBytes, NetFrameStatistics* pStats );
+
+    BOOL IsIdle();
+    UINT32 GetInFlightCount() const { return (UINT32)m_SendWindow.size(); }
+    INT64 GetTickFrequency() const { return m_TickFrequency; }
+    DOUBLE GetRetransmitMsec() const { return (DOUBLE)m_RetransmitTicks * 1000.0 / (DOUBLE)m_TickFrequency; }
+    const ReliableChannelStatistics& GetStatistics() const { return m_Stats; }
+
+    // Sends a join burst of small messages with a fragmented blob over a simulated lossy
+    // link, through this channel and through the old scheme of resending every unacknowledged
+    // message with each snapshot, and reports transfer time, bandwidth and retransmit
+    // overhead.  Validates that every message arrives once, in order and intact.
+    static bool Benchmark( UINT32 MessageCount, UINT32 LossPercent );
+
+private:
+    VOID ReleaseEntry( SendEntry& Entry, INT64 CurrentTick );
+    BOOL Deliver( VOID* pSenderContext, IDecodeHandler* pHandler, UINT32 UniqueIndex, UINT Opcode, UINT FragmentIndex, UINT FragmentCount, const BYTE* pPayload, UINT PayloadSizeBytes );
+};
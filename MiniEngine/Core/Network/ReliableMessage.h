@@ -7,12 +7,21 @@
 
 struct ReliableMessage
 {
-    UINT SequenceIndex;
+    USHORT FragmentIndex;
+    USHORT FragmentCount;
     UINT UniqueIndex;
     UINT Opcode;
     UINT BufferSizeBytes;
     BYTE Buffer[NET_MAX_RELIABLE_MESSAGE_SIZE_BYTES - 4 * sizeof(UINT)];
 
+    ReliableMessage()
+        : FragmentIndex( 0 ),
+          FragmentCount( 1 ),
+          UniqueIndex( 0 ),
+          Opcode( 0 ),
+          BufferSizeBytes( 0 )
+    { }
+
     SIZE_T GetSizeBytes() const { return BufferSizeBytes + sizeof(UINT) * 4; }
 
     template<class T>
@@ -37,7 +46,7 @@ struct ReliableMessage
 
 C_ASSERT( sizeof(ReliableMessage) == NET_MAX_RELIABLE_MESSAGE_SIZE_BYTES );
 
-typedef std::deque<ReliableMessage> ReliableMessageQueue;
+typedef std::deque<ReliableMessage*> ReliableMessageQueue;
 
 enum class ReliableMessageType
 {
@@ -1,6 +1,9 @@
 #include "pch.h"
 #include "SnapshotSendQueue.h"
 #include "NetShared.h"
+#include "LatencyHistogram.h"
+
+static LatencyHistogram g_NetEncodeHistogram("NetEncode");
 
 LARGE_INTEGER g_PerfFreq = { 0, 0 };
 
@@ -8,8 +11,7 @@ SnapshotSendQueue::SnapshotSendQueue()
     : m_LastAckSnapshot( 0 ),
       m_LastSentSnapshot( 0 ),
       m_pNullSnapshot( nullptr ),
-      m_QueuedAck( 0 ),
-      m_NextReliableMessageIndex( 0 )
+      m_QueuedAck( 0 )
 {
     InitializeCriticalSection( &m_PendingQueueCritSec );
     QueryPerformanceCounter( &m_SendThrottle );
@@ -27,25 +29,27 @@ VOID SnapshotSendQueue::Initialize( StateSnapshot* pNullSnapshot )
 
 SnapshotSendQueue::~SnapshotSendQueue(void)
 {
+    for( ReliableMessage* pMsg : m_UnreliableMsgQueue )
+    {
+        ReliableMessagePool::Get().Free( pMsg );
+    }
     DeleteCriticalSection( &m_PendingQueueCritSec );
 }
 
 VOID SnapshotSendQueue::QueueReliableMessage( const ReliableMessage& msg )
 {
-    EnterCriticalSection( &m_PendingQueueCritSec );
-
     assert( msg.BufferSizeBytes <= sizeof(msg.Buffer) );
-    m_PendingMsgQueue.push_back( msg );
-
-    LeaveCriticalSection( &m_PendingQueueCritSec );
+    m_ReliableChannel.QueueMessage( msg );
 }
 
 VOID SnapshotSendQueue::QueueUnreliableMessage( const ReliableMessage& msg )
 {
+    assert( msg.BufferSizeBytes <= sizeof(msg.Buffer) );
+    ReliableMessage* pMsg = ReliableMessagePool::Get().Allocate( msg );
+
     EnterCriticalSection( &m_PendingQueueCritSec );
 
-    assert( msg.BufferSizeBytes <= sizeof(msg.Buffer) );
-    m_UnreliableMsgQueue.push_back( msg );
+    m_UnreliableMsgQueue.push_back( pMsg );
 
     LeaveCriticalSection( &m_PendingQueueCritSec );
 }
@@ -65,6 +69,8 @@ VOID SnapshotSendQueue::QueueSnapshot( StateSnapshot* pSnapshot )
 
 UINT SnapshotSendQueue::SendUpdate( ISendState* pISS, NetFrameStatistics* pStats )
 {
+    ScopedLatencyTimer EncodeTimer( g_NetEncodeHistogram );
+
     StateSnapshot* pLastAck = nullptr;
     StateSnapshot* pCurrent = nullptr;
 
@@ -85,36 +91,26 @@ UINT SnapshotSendQueue::SendUpdate( ISendState* pISS, NetFrameStatistics* pStats
         CurrentIndex = pCurrent->GetIndex();
 
         LARGE_INTEGER CurrentTime;
-        if( m_LastAckSnapshot == 0 )
-        {
-            QueryPerformanceCounter( &CurrentTime );
-            if( CurrentTime.QuadPart < m_SendThrottle.QuadPart )
-            {
-                return CurrentIndex;
-            }
-        }
-
-        EnterCriticalSection( &m_PendingQueueCritSec );
-
-        while( !m_PendingMsgQueue.empty() )
+        QueryPerformanceCounter( &CurrentTime );
+        if( m_LastAckSnapshot == 0 && CurrentTime.QuadPart < m_SendThrottle.QuadPart )
         {
-            ReliableMessage& msg = m_PendingMsgQueue.front();
-            msg.SequenceIndex = CurrentIndex;
-            msg.UniqueIndex = InterlockedIncrement( &m_NextReliableMessageIndex );
-            m_ReliableMsgQueue.push_back( msg );
-            m_PendingMsgQueue.pop_front();
+            return CurrentIndex;
         }
 
         pISS->SetNetFrameStatistics( pStats );
         pISS->BeginSnapshot( CurrentIndex );
 
+        EnterCriticalSection( &m_PendingQueueCritSec );
+
         {
             auto iter = m_UnreliableMsgQueue.begin();
             auto end = m_UnreliableMsgQueue.end();
             while( iter != end )
             {
-                if( pStats != nullptr ) { pStats->UnreliableMessagesSent++; pStats->UnreliableMessageBytesSent += (UINT32)iter->GetSizeBytes(); }
-                pISS->SendUnreliableMessage( *iter );
+                ReliableMessage* pMsg = *iter;
+                if( pStats != nullptr ) { pStats->UnreliableMessagesSent++; pStats->UnreliableMessageBytesSent += (UINT32)pMsg->GetSizeBytes(); }
+                pISS->SendUnreliableMessage( *pMsg );
+                ReliableMessagePool::Get().Free( pMsg );
                 ++iter;
             }
             m_UnreliableMsgQueue.clear();
@@ -122,14 +118,9 @@ UINT SnapshotSendQueue::SendUpdate( ISendState* pISS, NetFrameStatistics* pStats
 
         LeaveCriticalSection( &m_PendingQueueCritSec );
 
-        auto iter = m_ReliableMsgQueue.begin();
-        auto end = m_ReliableMsgQueue.end();
-        while( iter != end )
-        {
-            if( pStats != nullptr ) { pStats->ReliableMessagesSent++; pStats->ReliableMessageBytesSent += (UINT32)iter->GetSizeBytes(); }
-            pISS->SendReliableMessage( *iter );
-            ++iter;
-        }
+        // Reliable messages go out once and again only when overdue, rather than with every
+        // snapshot until one is acknowledged
+        m_ReliableChannel.Send( pISS, CurrentTime.QuadPart, pStats );
 
         pLastAck->Diff( pCurrent, pISS );
 
@@ -171,9 +162,4 @@ VOID SnapshotSendQueue::AckSnapshot( UINT32 Index )
 
         UINT RefCount = pSS->Release();
     }
-
-    while( !m_ReliableMsgQueue.empty() && m_ReliableMsgQueue.front().SequenceIndex <= m_LastAckSnapshot )
-    {
-        m_ReliableMsgQueue.pop_front();
-    }
 }
@@ -5,6 +5,7 @@
 #include <assert.h>
 #include "StateObjects.h"
 #include "ReliableMessage.h"
+#include "ReliableChannel.h"
 #include "DebugPrint.h"
 
 struct NetFrameStatistics;
@@ -19,6 +20,8 @@ interface ISendState : public IStateSnapshotDiff
     
     virtual VOID SendUnreliableMessage( const ReliableMessage& msg ) = 0;
 
+    virtual VOID SendReliableAck( UINT32 BaseIndex, UINT32 MaskOffset, UINT32 ReceivedMask ) = 0;
+
     virtual VOID SendAcknowledge( const UINT SnapshotIndex ) = 0;
 
     virtual VOID EndSnapshot( UINT32 Index ) = 0;
@@ -30,11 +33,9 @@ private:
     typedef std::deque<StateSnapshot*> SnapshotQueue;
     SnapshotQueue m_Queue;
 
-    volatile UINT32 m_NextReliableMessageIndex;
-    ReliableMessageQueue m_PendingMsgQueue;
-    CRITICAL_SECTION m_PendingQueueCritSec;
+    ReliableChannel m_ReliableChannel;
 
-    ReliableMessageQueue m_ReliableMsgQueue;
+    CRITICAL_SECTION m_PendingQueueCritSec;
     ReliableMessageQueue m_UnreliableMsgQueue;
 
     UINT32 m_QueuedAck;
@@ -76,6 +77,12 @@ public:
         QueueReliableMessage( msg );
     }
 
+    // Payloads of any size up to NET_MAX_RELIABLE_PAYLOAD_SIZE_BYTES
+    BOOL QueueReliableMessage( UINT Opcode, const VOID* pPayload, UINT PayloadSizeBytes )
+    {
+        return m_ReliableChannel.QueueMessage( Opcode, pPayload, PayloadSizeBytes );
+    }
+
     VOID QueueUnreliableMessage( const ReliableMessage& msg );
     template< typename T >
     VOID QueueUnreliableMessage( UINT Opcode, const T* pPayload )
@@ -101,6 +108,7 @@ public:
 
     // client & server:
     UINT GetLastAckSnapshot() const { return m_LastAckSnapshot; }
+    ReliableChannel& GetReliableChannel() { return m_ReliableChannel; }
 };
 
 class SnapshotAckTracker
@@ -10,7 +10,8 @@ StateInputOutput::StateInputOutput()
     m_pNullSnapshot = CreateSnapshot();
 }
 
-VOID CreateSnapshotHelper( StateSnapshot* pSS, StateLinkNode* pNode, StateNode* pParentNode )
+// Nodes with IDs up to LastSkippedID were already added by their parent's member table
+VOID CreateSnapshotHelper( StateSnapshot* pSS, StateLinkNode* pNode, StateNode* pParentNode, UINT32 LastSkippedID )
 {
     assert( pSS != nullptr );
     if( pNode == nullptr )
@@ -18,29 +19,39 @@ VOID CreateSnapshotHelper( StateSnapshot* pSS, StateLinkNode* pNode, StateNode*
         return;
     }
 
-    if( pNode->IncludeInSnapshot )
+    if( pNode->IncludeInSnapshot && pNode->ID > LastSkippedID )
     {
         if( pNode->Type == StateNodeType::Complex )
         {
             StateNode* pCN = pSS->AddComplex( pParentNode, pNode->ID );
             pCN->GetCreationData().Clone( pNode->CreationData, pSS );
-            CreateSnapshotHelper( pSS, pNode->pFirstChild, pCN );
+            if( pNode->pSnapshotMembers != nullptr )
+            {
+                pNode->pSnapshotMembers( pSS, pCN, pNode->ID + 1, pNode->pData );
+                CreateSnapshotHelper( pSS, pNode->pFirstChild, pCN, pNode->ID + pNode->MemberCount );
+            }
+            else
+            {
+                CreateSnapshotHelper( pSS, pNode->pFirstChild, pCN, 0 );
+            }
         }
         else
         {
-            StateNode* pN = pSS->AddDataType( pParentNode, pNode->ID, pNode->Type, pNode->pData );
+            StateNode* pN = ( pNode->pCodec != nullptr ) ?
+                pSS->AddDataType( pParentNode, pNode->ID, pNode->pCodec, pNode->pData ) :
+                pSS->AddDataType( pParentNode, pNode->ID, pNode->Type, pNode->pData );
             pN->GetCreationData().Clone( pNode->CreationData, pSS );
         }
     }
 
-    CreateSnapshotHelper( pSS, pNode->pSibling, pParentNode );
+    CreateSnapshotHelper( pSS, pNode->pSibling, pParentNode, LastSkippedID );
 }
 
 StateSnapshot* StateInputOutput::CreateSnapshot()
 {
     StateSnapshot* pSS = new StateSnapshot( m_SnapshotIndex++ );
 
-    CreateSnapshotHelper( pSS, m_pRootNode, nullptr );
+    CreateSnapshotHelper( pSS, m_pRootNode, nullptr, 0 );
 
     return pSS;
 }
@@ -60,7 +71,14 @@ BOOL StateInputOutput::UpdateNodeData( UINT32 ID, const VOID* pData, SIZE_T Data
 
     assert( pNode->Type != StateNodeType::Complex );
 
-    StateNodeTypeCodec::Decode( pNode->Type, pNode->pData, pData );
+    if( pNode->pCodec != nullptr )
+    {
+        pNode->pCodec->pDecode( pNode->pData, pData );
+    }
+    else
+    {
+        StateNodeTypeCodec::Decode( pNode->Type, pNode->pData, pData );
+    }
 
     if (m_pLoggingNode != nullptr && ( pNode == m_pLoggingNode || pNode->pParent == m_pLoggingNode ))
     {
@@ -70,7 +88,7 @@ BOOL StateInputOutput::UpdateNodeData( UINT32 ID, const VOID* pData, SIZE_T Data
     return TRUE;
 }
 
-BOOL StateInputOutput::CreateNode( UINT32 ParentID, UINT32 ID, StateNodeType Type, VOID* pData, SIZE_T DataSizeBytes, UINT CreationCode, const VOID* pCreationData, SIZE_T CreationDataSizeBytes, BOOL IncludeInSnapshot )
+BOOL StateInputOutput::CreateNode( UINT32 ParentID, UINT32 ID, StateNodeType Type, VOID* pData, SIZE_T DataSizeBytes, UINT CreationCode, const VOID* pCreationData, SIZE_T CreationDataSizeBytes, BOOL IncludeInSnapshot, const StateNodeCodec* pCodec )
 {
     StateLinkNode* pParentNode = nullptr;
     if( ParentID != 0 )
@@ -83,11 +101,15 @@ BOOL StateInputOutput::CreateNode( UINT32 ParentID, UINT32 ID, StateNodeType Typ
     }
 
     assert( FindNode(ID) == nullptr );
+    assert( pCodec == nullptr || pCodec->Type == Type );
 
     StateLinkNode* pNode = new StateLinkNode();
     pNode->ID = ID;
     pNode->IncludeInSnapshot = IncludeInSnapshot;
     pNode->Type = Type;
+    pNode->pCodec = ( pCodec != nullptr ) ? pCodec : StateNodeTypeCodec::GetCodec( Type );
+    pNode->pSnapshotMembers = nullptr;
+    pNode->MemberCount = 0;
     pNode->pData = pData;
     pNode->pParent = pParentNode;
     pNode->pFirstChild = nullptr;
@@ -138,9 +160,15 @@ UINT StateInputOutput::CreateNodeGroup( UINT32 ParentID, UINT32 StartingNodeID,
     for( UINT i = 0; i < MemberDataCount; ++i )
     {
         VOID* pData = (VOID*)( (BYTE*)pProxyObject + pMemberDatas[i].OffsetBytes );
-        Success = CreateNode( FirstNodeID, NextNodeID++, pMemberDatas[i].Type, pData, pMemberDatas[i].SizeBytes, i, nullptr, 0, IncludeInSnapshot );
+        Success = CreateNode( FirstNodeID, NextNodeID++, pMemberDatas[i].Type, pData, pMemberDatas[i].SizeBytes, i, nullptr, 0, IncludeInSnapshot, pMemberDatas[i].pCodec );
     }
 
+    // Objects with a generated member table add all of their members to snapshots at once
+    StateLinkNode* pFirstNode = FindNode( FirstNodeID );
+    pFirstNode->pSnapshotMembers = pProxyObject->GetSnapshotMembersFunction();
+    pFirstNode->pData = pProxyObject;
+    pFirstNode->MemberCount = MemberDataCount;
+
     return NextNodeID;
 }
 
@@ -15,9 +15,15 @@ public:
         StateNodeType Type;
         SIZE_T OffsetBytes;
         SIZE_T SizeBytes;
+        const StateNodeCodec* pCodec;   // optional; see NetworkMembers.h
     };
     virtual VOID GetMemberDatas( const MemberDataPosition** ppMemberDatas, UINT* pMemberDataCount ) const = 0;
 
+    // Adds every member of the object at pObject to a snapshot in one pass, with IDs
+    // counting up from FirstID.  Generated by DEFINE_NETWORK_MEMBERS.
+    typedef VOID (*SnapshotMembersFunction)( StateSnapshot* pSnapshot, StateNode* pParent, UINT32 FirstID, const VOID* pObject );
+    virtual SnapshotMembersFunction GetSnapshotMembersFunction() const { return nullptr; }
+
 public:
     virtual VOID SetNodeID( UINT ID ) {}
     virtual UINT GetNodeID() const { return 0; }
@@ -53,6 +59,9 @@ public:
     UINT32 ID;
     BOOL IncludeInSnapshot;
     StateNodeType Type;
+    const StateNodeCodec* pCodec;
+    INetworkObject::SnapshotMembersFunction pSnapshotMembers;
+    UINT32 MemberCount;
     StateLinkNode* pParent;
     StateLinkNode* pFirstChild;
     StateLinkNode* pSibling;
@@ -91,7 +100,7 @@ public:
 
     // local host use only:
     StateLinkNode* FindNode( UINT32 ID );
-    BOOL CreateNode( UINT32 ParentID, UINT32 ID, StateNodeType Type, VOID* pData, SIZE_T DataSizeBytes, UINT CreationCode, const VOID* pCreationData, SIZE_T CreationDataSizeBytes, BOOL IncludeInSnapshot );
+    BOOL CreateNode( UINT32 ParentID, UINT32 ID, StateNodeType Type, VOID* pData, SIZE_T DataSizeBytes, UINT CreationCode, const VOID* pCreationData, SIZE_T CreationDataSizeBytes, BOOL IncludeInSnapshot, const StateNodeCodec* pCodec = nullptr );
     UINT32 CreateNodeGroup( UINT32 ParentID, UINT32 StartingNodeID, INetworkObject* pProxyObject, const VOID* pCreationData, SIZE_T CreationDataSizeBytes, BOOL IncludeInSnapshot );
     BOOL DeleteNodeAndChildren( UINT32 ID );
 
@@ -4,6 +4,7 @@
 #include <DirectXPackedVector.h>
 #include "NetConstants.h"
 #include "ClientPredict.h"
+#include "NetworkMembers.h"
 
 using namespace DirectX;
 using namespace DirectX::PackedVector;
@@ -76,50 +77,32 @@ VOID StateNodeTypeCodec::Encode( StateNodeType Type, VOID* pStorageData, const V
     switch( Type )
     {
     case StateNodeType::Float4AsByteN4:
-        XMStoreByteN4( (XMBYTEN4*)pStorageData, XMLoadFloat4( (const XMFLOAT4*)pExpandedData ) );
+        StateNodeTraits<StateNodeType::Float4AsByteN4>::Encode( pStorageData, pExpandedData );
         return;
     case StateNodeType::Float2AsHalf2:
-        XMStoreHalf2( (XMHALF2*)pStorageData, XMLoadFloat2( (const XMFLOAT2*)pExpandedData ) );
+        StateNodeTraits<StateNodeType::Float2AsHalf2>::Encode( pStorageData, pExpandedData );
         return;
     case StateNodeType::Float4AsHalf4:
-        XMStoreHalf4( (XMHALF4*)pStorageData, XMLoadFloat4( (const XMFLOAT4*)pExpandedData ) );
+        StateNodeTraits<StateNodeType::Float4AsHalf4>::Encode( pStorageData, pExpandedData );
         return;
     case StateNodeType::Float3AsQwordDelta:
-        {
-            auto* pSrc = (const StateFloat3Delta*)pExpandedData;
-            ((Float3Qword*)pStorageData)->SetFloat3( pSrc->GetRawValue() );
-            return;
-        }
+        StateNodeTraits<StateNodeType::Float3AsQwordDelta>::Encode( pStorageData, pExpandedData );
+        return;
     case StateNodeType::Float3Delta:
-        {
-            auto* pSrc = (const StateFloat3Delta*)pExpandedData;
-            XMStoreFloat3( (XMFLOAT3*)pStorageData, pSrc->GetRawValue() );
-            return;
-        }
+        StateNodeTraits<StateNodeType::Float3Delta>::Encode( pStorageData, pExpandedData );
+        return;
     case StateNodeType::Float3AsHalf4Delta:
-        {
-            auto* pSrc = (const StateFloat3Delta*)pExpandedData;
-            XMStoreHalf4( (XMHALF4*)pStorageData, pSrc->GetRawValue() );
-            return;
-        }
+        StateNodeTraits<StateNodeType::Float3AsHalf4Delta>::Encode( pStorageData, pExpandedData );
+        return;
     case StateNodeType::Float4AsHalf4Delta:
-        {
-            auto* pSrc = (const StateFloat4Delta*)pExpandedData;
-            XMStoreHalf4( (XMHALF4*)pStorageData, pSrc->GetRawValue() );
-            return;
-        }
+        StateNodeTraits<StateNodeType::Float4AsHalf4Delta>::Encode( pStorageData, pExpandedData );
+        return;
     case StateNodeType::PredictFloat3:
-    {
-        auto* pSrc = (const PredictionFloat3*)pExpandedData;
-        XMStoreFloat3((XMFLOAT3*)pStorageData, pSrc->GetStaticValue());
+        StateNodeTraits<StateNodeType::PredictFloat3>::Encode( pStorageData, pExpandedData );
         return;
-    }
     case StateNodeType::PredictQuaternion:
-    {
-        auto* pSrc = (const PredictionQuaternion*)pExpandedData;
-        XMStoreHalf4((XMHALF4*)pStorageData, pSrc->GetStaticValue());
+        StateNodeTraits<StateNodeType::PredictQuaternion>::Encode( pStorageData, pExpandedData );
         return;
-    }
     default:
         assert( GetStorageSize( Type ) == GetExpandedSize( Type ) );
         memcpy( pStorageData, pExpandedData, GetStorageSize( Type ) );
@@ -132,51 +115,32 @@ VOID StateNodeTypeCodec::Decode( StateNodeType Type, VOID* pExpandedData, const
     switch( Type )
     {
     case StateNodeType::Float4AsByteN4:
-        XMStoreFloat4( (XMFLOAT4*)pExpandedData, XMLoadByteN4( (const XMBYTEN4*)pStorageData ) );
+        StateNodeTraits<StateNodeType::Float4AsByteN4>::Decode( pExpandedData, pStorageData );
         return;
     case StateNodeType::Float2AsHalf2:
-        XMStoreFloat2( (XMFLOAT2*)pExpandedData, XMLoadHalf2( (const XMHALF2*)pStorageData ) );
+        StateNodeTraits<StateNodeType::Float2AsHalf2>::Decode( pExpandedData, pStorageData );
         return;
     case StateNodeType::Float4AsHalf4:
-        XMStoreFloat4( (XMFLOAT4*)pExpandedData, XMLoadHalf4( (const XMHALF4*)pStorageData ) );
+        StateNodeTraits<StateNodeType::Float4AsHalf4>::Decode( pExpandedData, pStorageData );
         return;
     case StateNodeType::Float3AsQwordDelta:
-        {
-            XMVECTOR v = ((const Float3Qword*)pStorageData)->GetFloat3();
-            auto* pDest = (StateFloat3Delta*)pExpandedData;
-            pDest->ReceiveNewValue( v, g_CurrentRecvTimestamp );
-            return;
-        }
+        StateNodeTraits<StateNodeType::Float3AsQwordDelta>::Decode( pExpandedData, pStorageData );
+        return;
     case StateNodeType::Float3Delta:
-        {
-            auto* pDest = (StateFloat3Delta*)pExpandedData;
-            pDest->ReceiveNewValue( XMLoadFloat3( (const XMFLOAT3*)pStorageData ), g_CurrentRecvTimestamp );
-            return;
-        }
+        StateNodeTraits<StateNodeType::Float3Delta>::Decode( pExpandedData, pStorageData );
+        return;
     case StateNodeType::Float3AsHalf4Delta:
-        {
-            auto* pDest = (StateFloat3Delta*)pExpandedData;
-            pDest->ReceiveNewValue( XMLoadHalf4( (const XMHALF4*)pStorageData ), g_CurrentRecvTimestamp );
-            return;
-        }
+        StateNodeTraits<StateNodeType::Float3AsHalf4Delta>::Decode( pExpandedData, pStorageData );
+        return;
     case StateNodeType::Float4AsHalf4Delta:
-        {
-            auto* pDest = (StateFloat4Delta*)pExpandedData;
-            pDest->ReceiveNewValue( XMLoadHalf4( (const XMHALF4*)pStorageData ), g_CurrentRecvTimestamp );
-            return;
-        }
+        StateNodeTraits<StateNodeType::Float4AsHalf4Delta>::Decode( pExpandedData, pStorageData );
+        return;
     case StateNodeType::PredictFloat3:
-    {
-        auto* pDest = (PredictionFloat3*)pExpandedData;
-        pDest->UpdateFromNetwork(XMLoadFloat3((const XMFLOAT3*)pStorageData), g_CurrentRecvTimestamp.QuadPart);
+        StateNodeTraits<StateNodeType::PredictFloat3>::Decode( pExpandedData, pStorageData );
         return;
-    }
     case StateNodeType::PredictQuaternion:
-    {
-        auto* pDest = (PredictionQuaternion*)pExpandedData;
-        pDest->UpdateFromNetwork(XMLoadHalf4((const XMHALF4*)pStorageData), g_CurrentRecvTimestamp.QuadPart);
+        StateNodeTraits<StateNodeType::PredictQuaternion>::Decode( pExpandedData, pStorageData );
         return;
-    }
     default:
         assert( GetExpandedSize( Type ) == GetStorageSize( Type ) );
         memcpy( pExpandedData, pStorageData, GetExpandedSize( Type ) );
@@ -184,6 +148,49 @@ VOID StateNodeTypeCodec::Decode( StateNodeType Type, VOID* pExpandedData, const
     }
 }
 
+const StateNodeCodec* StateNodeTypeCodec::GetCodec( StateNodeType Type )
+{
+    switch( Type )
+    {
+    case StateNodeType::Integer:
+        return &StateNodeCodecInstance<StateNodeType::Integer>::Codec;
+    case StateNodeType::Integer4:
+        return &StateNodeCodecInstance<StateNodeType::Integer4>::Codec;
+    case StateNodeType::Float:
+        return &StateNodeCodecInstance<StateNodeType::Float>::Codec;
+    case StateNodeType::Float2:
+        return &StateNodeCodecInstance<StateNodeType::Float2>::Codec;
+    case StateNodeType::Float3:
+        return &StateNodeCodecInstance<StateNodeType::Float3>::Codec;
+    case StateNodeType::Float4:
+        return &StateNodeCodecInstance<StateNodeType::Float4>::Codec;
+    case StateNodeType::Float4AsByteN4:
+        return &StateNodeCodecInstance<StateNodeType::Float4AsByteN4>::Codec;
+    case StateNodeType::Float2AsHalf2:
+        return &StateNodeCodecInstance<StateNodeType::Float2AsHalf2>::Codec;
+    case StateNodeType::Float4AsHalf4:
+        return &StateNodeCodecInstance<StateNodeType::Float4AsHalf4>::Codec;
+    case StateNodeType::Matrix43:
+        return &StateNodeCodecInstance<StateNodeType::Matrix43>::Codec;
+    case StateNodeType::Matrix44:
+        return &StateNodeCodecInstance<StateNodeType::Matrix44>::Codec;
+    case StateNodeType::PredictFloat3:
+        return &StateNodeCodecInstance<StateNodeType::PredictFloat3>::Codec;
+    case StateNodeType::PredictQuaternion:
+        return &StateNodeCodecInstance<StateNodeType::PredictQuaternion>::Codec;
+    case StateNodeType::Float3Delta:
+        return &StateNodeCodecInstance<StateNodeType::Float3Delta>::Codec;
+    case StateNodeType::Float3AsHalf4Delta:
+        return &StateNodeCodecInstance<StateNodeType::Float3AsHalf4Delta>::Codec;
+    case StateNodeType::Float4AsHalf4Delta:
+        return &StateNodeCodecInstance<StateNodeType::Float4AsHalf4Delta>::Codec;
+    case StateNodeType::Float3AsQwordDelta:
+        return &StateNodeCodecInstance<StateNodeType::Float3AsQwordDelta>::Codec;
+    default:
+        return nullptr;
+    }
+}
+
 VOID StateNodeCreationData::Clone( const StateNodeCreationData& Other, StateSnapshot* pSnapshot )
 {
     CreationCode = Other.CreationCode;
@@ -234,6 +241,11 @@ BOOL StateNode::HasEqualData( const StateNode* pOther ) const
         return TRUE;
     }
 
+    if( m_pCodec != nullptr )
+    {
+        return m_pCodec->pEqual( pData, pOtherData );
+    }
+
     SIZE_T DataSize = GetStorageDataSize();
     switch( GetType() )
     {
@@ -305,7 +317,14 @@ VOID StateNode::CopyToLocalData( StateSnapshot* pSnapshot, const VOID* pData )
     default:
         assert( pData != nullptr );
         assert( m_pData != nullptr );
-        StateNodeTypeCodec::Encode( m_Type, m_pData, pData );
+        if( m_pCodec != nullptr )
+        {
+            m_pCodec->pEncode( m_pData, pData );
+        }
+        else
+        {
+            StateNodeTypeCodec::Encode( m_Type, m_pData, pData );
+        }
         return;
     }
 }
@@ -374,6 +393,37 @@ StateNode* StateSnapshot::AddDataType( StateNode* pParent, UINT32 ID, StateNodeT
     return pReturn;
 }
 
+StateNode* StateSnapshot::AddDataType( StateNode* pParent, UINT32 ID, const StateNodeCodec* pCodec, const VOID* pData )
+{
+    assert( pCodec != nullptr );
+
+    StateNodeChildSet* pParentCS = this;
+    if( pParent != nullptr )
+    {
+        pParentCS = pParent->GetChildSet();
+        assert( pParentCS != nullptr );
+    }
+
+    VOID* pSN = m_ZoneAllocator.AllocateBytes( sizeof(StateNode) );
+    StateNode* pReturn = new (pSN) StateNode( this, ID, pCodec, pData );
+
+    pParentCS->AddChild( pReturn );
+
+    return pReturn;
+}
+
+StateNode* StateSnapshot::AddEncodedData( StateNode* pParent, UINT32 ID, const StateNodeCodec* pCodec, VOID* pStorageData, UINT32 CreationCode )
+{
+    assert( pParent != nullptr && pParent->GetChildSet() != nullptr );
+
+    VOID* pSN = m_ZoneAllocator.AllocateBytes( sizeof(StateNode) );
+    StateNode* pReturn = new (pSN) StateNode( ID, pCodec, pStorageData, CreationCode );
+
+    pParent->GetChildSet()->AddChild( pReturn );
+
+    return pReturn;
+}
+
 inline VOID DebugPrintData( IStateSnapshotDebug* pDebug, UINT Indent, StateNode* pNode )
 {
     const CHAR* strTypeName = "";
@@ -62,6 +62,19 @@ inline bool IsDeltaType( StateNodeType Type )
     }
 }
 
+// The encoder of a single data node type, instantiated from StateNodeTraits (see
+// NetworkMembers.h).  Nodes hold one of these from the time they are linked, so that
+// snapshots, diffs and updates do not switch on the node type.
+struct StateNodeCodec
+{
+    StateNodeType Type;
+    SIZE_T ExpandedSize;
+    SIZE_T StorageSize;
+    VOID (*pEncode)( VOID* pStorageData, const VOID* pExpandedData );
+    VOID (*pDecode)( VOID* pExpandedData, const VOID* pStorageData );
+    BOOL (*pEqual)( const VOID* pStorageDataA, const VOID* pStorageDataB );
+};
+
 class StateNodeTypeCodec
 {
 public:
@@ -70,6 +83,9 @@ public:
 
     static VOID Encode( StateNodeType Type, VOID* pStorageData, const VOID* pExpandedData );
     static VOID Decode( StateNodeType Type, VOID* pExpandedData, const VOID* pStorageData );
+
+    // Returns nullptr for complex, string and blob nodes
+    static const StateNodeCodec* GetCodec( StateNodeType Type );
 };
 
 struct StateBlob
@@ -152,6 +168,7 @@ private:
     UINT32 m_ID;
     StateNodeType m_Type;
     bool m_PreviouslyChanged;
+    const StateNodeCodec* m_pCodec;
     union
     {
         VOID* m_pData;
@@ -163,18 +180,38 @@ public:
     StateNode( StateSnapshot* pSnapshot, UINT32 ID, StateNodeType Type, const VOID* pData )
         : m_ID( ID ),
         m_Type( Type ),
-        m_PreviouslyChanged( false )
+        m_PreviouslyChanged( false ),
+        m_pCodec( nullptr )
+    {
+        m_pData = CreateLocalData( pSnapshot, pData );
+        CopyToLocalData( pSnapshot, pData );
+    }
+    StateNode( StateSnapshot* pSnapshot, UINT32 ID, const StateNodeCodec* pCodec, const VOID* pData )
+        : m_ID( ID ),
+        m_Type( pCodec->Type ),
+        m_PreviouslyChanged( false ),
+        m_pCodec( pCodec )
     {
         m_pData = CreateLocalData( pSnapshot, pData );
         CopyToLocalData( pSnapshot, pData );
     }
+    // Takes storage that the caller has already allocated and encoded
+    StateNode( UINT32 ID, const StateNodeCodec* pCodec, VOID* pStorageData, UINT32 CreationCode )
+        : m_ID( ID ),
+        m_Type( pCodec->Type ),
+        m_PreviouslyChanged( false ),
+        m_pCodec( pCodec )
+    {
+        m_pData = pStorageData;
+        m_CreationData.CreationCode = CreationCode;
+    }
     ~StateNode();
 
     UINT32 GetID() const { return m_ID; }
     StateNodeType GetType() const { return m_Type; }
     const VOID* GetRawData() const { return m_pData; }
-    SIZE_T GetStorageDataSize() const { return StateNodeTypeCodec::GetStorageSize( m_Type ); }
-    SIZE_T GetExpandedDataSize() const { return StateNodeTypeCodec::GetExpandedSize( m_Type ); }
+    SIZE_T GetStorageDataSize() const { return ( m_pCodec != nullptr ) ? m_pCodec->StorageSize : StateNodeTypeCodec::GetStorageSize( m_Type ); }
+    SIZE_T GetExpandedDataSize() const { return ( m_pCodec != nullptr ) ? m_pCodec->ExpandedSize : StateNodeTypeCodec::GetExpandedSize( m_Type ); }
 
     bool WasPreviouslyChanged() const { return m_PreviouslyChanged; }
     void SetPreviouslyChanged() { m_PreviouslyChanged = true; }
@@ -363,6 +400,8 @@ public:
 
     StateNode* AddComplex( StateNode* pParent, UINT32 ID );
     StateNode* AddDataType( StateNode* pParent, UINT32 ID, StateNodeType Type, const VOID* pData );
+    StateNode* AddDataType( StateNode* pParent, UINT32 ID, const StateNodeCodec* pCodec, const VOID* pData );
+    StateNode* AddEncodedData( StateNode* pParent, UINT32 ID, const StateNodeCodec* pCodec, VOID* pStorageData, UINT32 CreationCode );
 
     StateNode* AddFloat( StateNode* pParent, UINT32 ID, const FLOAT* pExistingFloat ) { return AddDataType( pParent, ID, StateNodeType::Float, pExistingFloat ); }
     StateNode* AddFloat4( StateNode* pParent, UINT32 ID, const FLOAT* pExistingFloat4 ) { return AddDataType( pParent, ID, StateNodeType::Float4, pExistingFloat4 ); }
@@ -15,24 +15,370 @@
 #include "PipelineState.h"
 #include "RootSignature.h"
 #include "Hash.h"
-#include <map>
+#include "PipelineStateCache.h"
+#include "SystemTime.h"
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <unordered_map>
+#include <functional>
+#include <algorithm>
 
 using Math::IsAligned;
 using namespace Graphics;
 using Microsoft::WRL::ComPtr;
 using namespace std;
 
-static map< size_t, ComPtr<ID3D12PipelineState> > s_GraphicsPSOHashMap;
-static map< size_t, ComPtr<ID3D12PipelineState> > s_ComputePSOHashMap;
+// Insert-only open addressing table, split into shards so that concurrent Finalize()
+// calls for different pipelines rarely touch the same cache lines.  A slot goes from
+// null to an entry exactly once, so lookups and inserts need no lock.  Entries that
+// do not fit in their shard go to a locked overflow map.
+class PipelineStateTable
+{
+public:
+	PipelineStateTable()
+	{
+		for (UINT32 i = 0; i < kShardCount; ++i)
+			for (UINT32 j = 0; j < kSlotsPerShard; ++j)
+				m_Shards[i].Slots[j].store(nullptr, memory_order_relaxed);
+	}
+
+	// Returns the entry for HashCode, creating it if needed.  *pInserted is set for the
+	// one caller whose entry was published, which then owns compiling it.
+	PipelineStateEntry* FindOrInsert( size_t HashCode, bool IsCompute, bool* pInserted )
+	{
+		Shard& S = m_Shards[HashCode & (kShardCount - 1)];
+		const size_t FirstSlot = HashCode / kShardCount;
+
+		PipelineStateEntry* pNewEntry = nullptr;
+		for (UINT32 Probe = 0; Probe < kSlotsPerShard; ++Probe)
+		{
+			atomic<PipelineStateEntry*>& Slot = S.Slots[(FirstSlot + Probe) & (kSlotsPerShard - 1)];
+			PipelineStateEntry* pEntry = Slot.load(memory_order_acquire);
+			if (pEntry == nullptr)
+			{
+				if (pNewEntry == nullptr)
+					pNewEntry = CreateEntry(HashCode, IsCompute);
+
+				if (Slot.compare_exchange_strong(pEntry, pNewEntry, memory_order_acq_rel))
+				{
+					*pInserted = true;
+					return pNewEntry;
+				}
+				// Lost the race; pEntry now holds the winner
+			}
+
+			if (pEntry->HashCode == HashCode)
+			{
+				delete pNewEntry;
+				*pInserted = false;
+				return pEntry;
+			}
+		}
+
+		delete pNewEntry;
+
+		lock_guard<mutex> Lock(m_OverflowMutex);
+		PipelineStateEntry*& pEntry = m_Overflow[HashCode];
+		*pInserted = (pEntry == nullptr);
+		if (pEntry == nullptr)
+			pEntry = CreateEntry(HashCode, IsCompute);
+		return pEntry;
+	}
+
+	template <typename Func>
+	void ForEach( Func F ) const
+	{
+		for (UINT32 i = 0; i < kShardCount; ++i)
+			for (UINT32 j = 0; j < kSlotsPerShard; ++j)
+			{
+				PipelineStateEntry* pEntry = m_Shards[i].Slots[j].load(memory_order_acquire);
+				if (pEntry != nullptr)
+					F(pEntry);
+			}
+
+		lock_guard<mutex> Lock(m_OverflowMutex);
+		for (auto& Iter : m_Overflow)
+			F(Iter.second);
+	}
+
+	// Not thread safe; compilation must be idle
+	void DestroyAll( void )
+	{
+		for (UINT32 i = 0; i < kShardCount; ++i)
+			for (UINT32 j = 0; j < kSlotsPerShard; ++j)
+				DestroyEntry(m_Shards[i].Slots[j].exchange(nullptr));
+
+		for (auto& Iter : m_Overflow)
+			DestroyEntry(Iter.second);
+		m_Overflow.clear();
+	}
+
+private:
+	static PipelineStateEntry* CreateEntry( size_t HashCode, bool IsCompute )
+	{
+		PipelineStateEntry* pEntry = new PipelineStateEntry();
+		pEntry->HashCode = HashCode;
+		pEntry->PipelineState.store(nullptr, memory_order_relaxed);
+		pEntry->Finished.store(false, memory_order_relaxed);
+		pEntry->QueueMsec = 0.0;
+		pEntry->CompileMsec = 0.0;
+		pEntry->CacheHit = false;
+		pEntry->IsCompute = IsCompute;
+		return pEntry;
+	}
+
+	static void DestroyEntry( PipelineStateEntry* pEntry )
+	{
+		if (pEntry == nullptr)
+			return;
+		ID3D12PipelineState* PipelineState = pEntry->PipelineState.load();
+		if (PipelineState != nullptr)
+			PipelineState->Release();
+		delete pEntry;
+	}
+
+	static const UINT32 kShardCount = 16;
+	static const UINT32 kSlotsPerShard = 1024;
+
+	struct Shard
+	{
+		__declspec(align(64)) atomic<PipelineStateEntry*> Slots[kSlotsPerShard];
+	};
+
+	Shard m_Shards[kShardCount];
+
+	mutable mutex m_OverflowMutex;
+	unordered_map<size_t, PipelineStateEntry*> m_Overflow;
+};
+
+// Fixed-size pool of threads that compile pipeline states in submission order.  Threads
+// are started with the first compile and stopped by PSO::DestroyAll().
+class PipelineCompilePool
+{
+public:
+	PipelineCompilePool() : m_PendingCount(0), m_StallCount(0), m_StallMsec(0.0), m_Exit(false) {}
+	~PipelineCompilePool() { Shutdown(); }
+
+	void Enqueue( PipelineStateEntry* pEntry, function<ID3D12PipelineState* (bool*)> Compile )
+	{
+		CompileJob Job;
+		Job.pEntry = pEntry;
+		Job.EnqueueTick = SystemTime::GetCurrentTick();
+		Job.Compile = std::move(Compile);
+
+		{
+			lock_guard<mutex> Lock(m_Mutex);
+			if (m_Threads.empty())
+			{
+				const UINT32 ThreadCount = std::max(1u, std::min(thread::hardware_concurrency() / 2, kMaxThreadCount));
+				m_Exit = false;
+				for (UINT32 i = 0; i < ThreadCount; ++i)
+					m_Threads.emplace_back(&PipelineCompilePool::WorkerThread, this);
+			}
+			m_Jobs.push_back(std::move(Job));
+			++m_PendingCount;
+		}
+		m_WorkAvailable.notify_one();
+	}
+
+	// Blocks until the given entry's compile has run.  Returns null if it failed.  Only
+	// waits that actually block count as stalls.
+	ID3D12PipelineState* Wait( PipelineStateEntry* pEntry )
+	{
+		if (pEntry->Finished.load(memory_order_acquire))
+			return pEntry->PipelineState.load(memory_order_acquire);
+
+		const int64_t StartTick = SystemTime::GetCurrentTick();
+
+		unique_lock<mutex> Lock(m_Mutex);
+		if (!pEntry->Finished.load(memory_order_acquire))
+		{
+			m_CompileFinished.wait(Lock, [pEntry]() { return pEntry->Finished.load(memory_order_acquire); });
+			++m_StallCount;
+			m_StallMsec += SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - StartTick);
+		}
+		return pEntry->PipelineState.load(memory_order_acquire);
+	}
+
+	void WaitForAll( void )
+	{
+		unique_lock<mutex> Lock(m_Mutex);
+		m_CompileFinished.wait(Lock, [this]() { return m_PendingCount == 0; });
+	}
+
+	void Shutdown( void )
+	{
+		{
+			lock_guard<mutex> Lock(m_Mutex);
+			m_Exit = true;
+		}
+		m_WorkAvailable.notify_all();
+
+		// Workers drain the queue before exiting
+		for (auto& T : m_Threads)
+			T.join();
+		m_Threads.clear();
+	}
+
+	void GetStallStatistics( UINT32* pStallCount, DOUBLE* pStallMsec )
+	{
+		lock_guard<mutex> Lock(m_Mutex);
+		*pStallCount = m_StallCount;
+		*pStallMsec = m_StallMsec;
+	}
+
+private:
+	static const UINT32 kMaxThreadCount = 4;
+
+	struct CompileJob
+	{
+		PipelineStateEntry* pEntry;
+		int64_t EnqueueTick;
+		function<ID3D12PipelineState* (bool*)> Compile;
+	};
+
+	void WorkerThread( void )
+	{
+		for (;;)
+		{
+			CompileJob Job;
+			{
+				unique_lock<mutex> Lock(m_Mutex);
+				m_WorkAvailable.wait(Lock, [this]() { return m_Exit || !m_Jobs.empty(); });
+				if (m_Jobs.empty())
+					return;
+				Job = std::move(m_Jobs.front());
+				m_Jobs.pop_front();
+			}
+
+			PipelineStateEntry* pEntry = Job.pEntry;
+			const int64_t StartTick = SystemTime::GetCurrentTick();
+			pEntry->QueueMsec = SystemTime::TicksToMillisecs(StartTick - Job.EnqueueTick);
+			ID3D12PipelineState* PipelineState = Job.Compile(&pEntry->CacheHit);
+			pEntry->CompileMsec = SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - StartTick);
+
+			{
+				lock_guard<mutex> Lock(m_Mutex);
+				pEntry->PipelineState.store(PipelineState, memory_order_release);
+				pEntry->Finished.store(true, memory_order_release);
+				--m_PendingCount;
+			}
+			m_CompileFinished.notify_all();
+		}
+	}
+
+	mutex m_Mutex;
+	condition_variable m_WorkAvailable;
+	condition_variable m_CompileFinished;
+	deque<CompileJob> m_Jobs;
+	vector<thread> m_Threads;
+	UINT32 m_PendingCount;
+	UINT32 m_StallCount;
+	DOUBLE m_StallMsec;
+	bool m_Exit;
+};
+
+static PipelineStateTable s_GraphicsPSOTable;
+static PipelineStateTable s_ComputePSOTable;
+static PipelineCompilePool s_CompilePool;
 
 InputLayoutCache g_InputLayoutCache;
 
+static uint64_t HashShaderBytecode( const D3D12_SHADER_BYTECODE& Shader, uint64_t Hash )
+{
+	Hash = Utility::HashBytes64(&Shader.BytecodeLength, sizeof(Shader.BytecodeLength), Hash);
+	return Utility::HashBytes64(Shader.pShaderBytecode, Shader.BytecodeLength, Hash);
+}
+
+// Creates a pipeline state, seeding the driver with a blob from the persistent cache
+// when there is one.  A blob the driver rejects is discarded and the PSO is compiled
+// from scratch; freshly compiled PSOs are written back to the cache.
+template <typename CreateFunc>
+static ID3D12PipelineState* CreatePipelineStateWithCache( uint64_t PersistentKey, PipelineCacheRecordType Type,
+	D3D12_CACHED_PIPELINE_STATE& CachedPSO, CreateFunc Create, bool* pCacheHit )
+{
+	ID3D12PipelineState* pPSO = g_PipelineStateCache.CreateWithCache<ID3D12PipelineState>(PersistentKey, Type,
+		[&CachedPSO, &Create](const void* pCachedBlob, SIZE_T CachedBlobSize, ID3D12PipelineState** ppPSO)
+		{
+			CachedPSO.pCachedBlob = pCachedBlob;
+			CachedPSO.CachedBlobSizeInBytes = CachedBlobSize;
+			const HRESULT hr = Create(ppPSO);
+			CachedPSO.pCachedBlob = nullptr;
+			CachedPSO.CachedBlobSizeInBytes = 0;
+			return hr;
+		},
+		[](ID3D12PipelineState* pPSO, std::vector<BYTE>& Blob)
+		{
+			ComPtr<ID3DBlob> pBlob;
+			if (pPSO == nullptr || FAILED(pPSO->GetCachedBlob(&pBlob)))
+				return false;
+			const BYTE* pData = (const BYTE*)pBlob->GetBufferPointer();
+			Blob.assign(pData, pData + pBlob->GetBufferSize());
+			return true;
+		},
+		pCacheHit);
+
+	// A shader or root signature mismatch; break here rather than on a null PSO later
+	ASSERT(pPSO != nullptr, "Failed to create pipeline state %016llx", PersistentKey);
+	return pPSO;
+}
+
 void PSO::DestroyAll(void)
 {
-	s_GraphicsPSOHashMap.clear();
-	s_ComputePSOHashMap.clear();
+	s_CompilePool.Shutdown();
+	s_GraphicsPSOTable.DestroyAll();
+	s_ComputePSOTable.DestroyAll();
+}
+
+void PSO::WaitForPendingCompiles(void)
+{
+	s_CompilePool.WaitForAll();
+}
+
+ID3D12PipelineState* PSO::WaitForPipelineState(void) const
+{
+	return s_CompilePool.Wait(m_pEntry);
+}
+
+void PSO::PrintCompileStatistics(void)
+{
+	vector<const PipelineStateEntry*> Compiled;
+	auto Collect = [&Compiled](const PipelineStateEntry* pEntry)
+	{
+		if (pEntry->PipelineState.load(memory_order_acquire) != nullptr)
+			Compiled.push_back(pEntry);
+	};
+	s_GraphicsPSOTable.ForEach(Collect);
+	s_ComputePSOTable.ForEach(Collect);
+
+	DOUBLE TotalCompileMsec = 0.0;
+	DOUBLE TotalQueueMsec = 0.0;
+	UINT32 CacheHits = 0;
+	for (const PipelineStateEntry* pEntry : Compiled)
+	{
+		TotalCompileMsec += pEntry->CompileMsec;
+		TotalQueueMsec += pEntry->QueueMsec;
+		CacheHits += pEntry->CacheHit ? 1 : 0;
+	}
+
+	UINT32 StallCount = 0;
+	DOUBLE StallMsec = 0.0;
+	s_CompilePool.GetStallStatistics(&StallCount, &StallMsec);
+
+	Utility::Printf("PSO compile: %u pipelines (%u from cache), %0.1f ms compiling, %0.1f ms queued, %u stalls totaling %0.1f ms\n",
+		(UINT32)Compiled.size(), CacheHits, TotalCompileMsec, TotalQueueMsec, StallCount, StallMsec);
+
+	const size_t SlowestCount = std::min<size_t>(8, Compiled.size());
+	partial_sort(Compiled.begin(), Compiled.begin() + SlowestCount, Compiled.end(),
+		[](const PipelineStateEntry* pA, const PipelineStateEntry* pB) { return pA->CompileMsec > pB->CompileMsec; });
+	for (size_t i = 0; i < SlowestCount; ++i)
+	{
+		const PipelineStateEntry* pEntry = Compiled[i];
+		Utility::Printf("    %s PSO %08llx: %0.2f ms compiling, %0.2f ms queued%s\n", pEntry->IsCompute ? "Compute " : "Graphics",
+			(UINT64)pEntry->HashCode, pEntry->CompileMsec, pEntry->QueueMsec, pEntry->CacheHit ? " (cached)" : "");
+	}
 }
 
 
@@ -119,33 +465,24 @@ void GraphicsPSO::Finalize()
 	HashCode = Utility::HashState(m_InputLayouts.get(), m_PSODesc.InputLayout.NumElements, HashCode);
 	m_PSODesc.InputLayout.pInputElementDescs = m_InputLayouts.get();
 
-	ID3D12PipelineState** PSORef = nullptr;
 	bool firstCompile = false;
-	{
-		static mutex s_HashMapMutex;
-		lock_guard<mutex> CS(s_HashMapMutex);
-		auto iter = s_GraphicsPSOHashMap.find(HashCode);
-
-		// Reserve space so the next inquiry will find that someone got here first.
-		if (iter == s_GraphicsPSOHashMap.end())
-		{
-			firstCompile = true;
-			PSORef = s_GraphicsPSOHashMap[HashCode].GetAddressOf();
-		}
-		else
-			PSORef = iter->second.GetAddressOf();
-	}
+	m_pEntry = s_GraphicsPSOTable.FindOrInsert(HashCode, false, &firstCompile);
 
 	if (firstCompile)
 	{
-		ASSERT_SUCCEEDED( g_Device->CreateGraphicsPipelineState(&m_PSODesc, MY_IID_PPV_ARGS(&m_PSO)) );
-		s_GraphicsPSOHashMap[HashCode].Attach(m_PSO);
-	}
-	else
-	{
-		while (*PSORef == nullptr)
-			this_thread::yield();
-		m_PSO = *PSORef;
+		// The job gets its own copy of the description because this object may be edited
+		// and finalized again before the compile runs.  Shader bytecode and the input
+		// layout's semantic names are expected to outlive the compile.
+		const uint64_t PersistentKey = GetPersistentHash();
+		D3D12_GRAPHICS_PIPELINE_STATE_DESC Desc = m_PSODesc;
+		shared_ptr<const D3D12_INPUT_ELEMENT_DESC> InputLayouts = m_InputLayouts;
+
+		s_CompilePool.Enqueue(m_pEntry, [Desc, InputLayouts, PersistentKey](bool* pCacheHit) mutable
+		{
+			return CreatePipelineStateWithCache(PersistentKey, PCRT_GraphicsPSO, Desc.CachedPSO,
+				[&Desc](ID3D12PipelineState** ppPSO) { return g_Device->CreateGraphicsPipelineState(&Desc, MY_IID_PPV_ARGS(ppPSO)); },
+				pCacheHit);
+		});
 	}
 }
 
@@ -157,33 +494,20 @@ void ComputePSO::Finalize()
 
 	size_t HashCode = Utility::HashState(&m_PSODesc);
 
-	ID3D12PipelineState** PSORef = nullptr;
 	bool firstCompile = false;
-	{
-		static mutex s_HashMapMutex;
-		lock_guard<mutex> CS(s_HashMapMutex);
-		auto iter = s_ComputePSOHashMap.find(HashCode);
-
-		// Reserve space so the next inquiry will find that someone got here first.
-		if (iter == s_ComputePSOHashMap.end())
-		{
-			firstCompile = true;
-			PSORef = s_ComputePSOHashMap[HashCode].GetAddressOf();
-		}
-		else
-			PSORef = iter->second.GetAddressOf();
-	}
+	m_pEntry = s_ComputePSOTable.FindOrInsert(HashCode, true, &firstCompile);
 
 	if (firstCompile)
 	{
-		ASSERT_SUCCEEDED( g_Device->CreateComputePipelineState(&m_PSODesc, MY_IID_PPV_ARGS(&m_PSO)) );
-		s_ComputePSOHashMap[HashCode].Attach(m_PSO);
-	}
-	else
-	{
-		while (*PSORef == nullptr)
-			this_thread::yield();
-		m_PSO = *PSORef;
+		const uint64_t PersistentKey = GetPersistentHash();
+		D3D12_COMPUTE_PIPELINE_STATE_DESC Desc = m_PSODesc;
+
+		s_CompilePool.Enqueue(m_pEntry, [Desc, PersistentKey](bool* pCacheHit) mutable
+		{
+			return CreatePipelineStateWithCache(PersistentKey, PCRT_ComputePSO, Desc.CachedPSO,
+				[&Desc](ID3D12PipelineState** ppPSO) { return g_Device->CreateComputePipelineState(&Desc, MY_IID_PPV_ARGS(ppPSO)); },
+				pCacheHit);
+		});
 	}
 }
 
@@ -193,12 +517,66 @@ ComputePSO::ComputePSO()
 	m_PSODesc.NodeMask = 1;
 }
 
+// The in-process hash covers shader and root signature pointers, which change from
+// run to run.  The persistent hash covers the bytecode and root signature contents.
+uint64_t GraphicsPSO::GetPersistentHash( void ) const
+{
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC Desc = m_PSODesc;
+	Desc.pRootSignature = nullptr;
+	Desc.VS.pShaderBytecode = nullptr;
+	Desc.PS.pShaderBytecode = nullptr;
+	Desc.DS.pShaderBytecode = nullptr;
+	Desc.HS.pShaderBytecode = nullptr;
+	Desc.GS.pShaderBytecode = nullptr;
+	Desc.StreamOutput.pSODeclaration = nullptr;
+	Desc.StreamOutput.pBufferStrides = nullptr;
+	Desc.InputLayout.pInputElementDescs = nullptr;
+	Desc.CachedPSO.pCachedBlob = nullptr;
+	Desc.CachedPSO.CachedBlobSizeInBytes = 0;
+
+	const uint64_t RootSignatureHash = m_RootSignature->GetPersistentHash();
+	uint64_t Hash = Utility::HashBytes64(&Desc, sizeof(Desc));
+	Hash = Utility::HashBytes64(&RootSignatureHash, sizeof(RootSignatureHash), Hash);
+	Hash = HashShaderBytecode(m_PSODesc.VS, Hash);
+	Hash = HashShaderBytecode(m_PSODesc.PS, Hash);
+	Hash = HashShaderBytecode(m_PSODesc.DS, Hash);
+	Hash = HashShaderBytecode(m_PSODesc.HS, Hash);
+	Hash = HashShaderBytecode(m_PSODesc.GS, Hash);
+
+	const D3D12_INPUT_ELEMENT_DESC* pElements = m_InputLayouts.get();
+	for (UINT i = 0; i < m_PSODesc.InputLayout.NumElements; ++i)
+	{
+		D3D12_INPUT_ELEMENT_DESC Element = pElements[i];
+		Element.SemanticName = nullptr;
+		Hash = Utility::HashBytes64(&Element, sizeof(Element), Hash);
+		Hash = Utility::HashBytes64(pElements[i].SemanticName, strlen(pElements[i].SemanticName), Hash);
+	}
+
+	return Hash;
+}
+
+uint64_t ComputePSO::GetPersistentHash( void ) const
+{
+	D3D12_COMPUTE_PIPELINE_STATE_DESC Desc = m_PSODesc;
+	Desc.pRootSignature = nullptr;
+	Desc.CS.pShaderBytecode = nullptr;
+	Desc.CachedPSO.pCachedBlob = nullptr;
+	Desc.CachedPSO.CachedBlobSizeInBytes = 0;
+
+	const uint64_t RootSignatureHash = m_RootSignature->GetPersistentHash();
+	uint64_t Hash = Utility::HashBytes64(&Desc, sizeof(Desc));
+	Hash = Utility::HashBytes64(&RootSignatureHash, sizeof(RootSignatureHash), Hash);
+	return HashShaderBytecode(m_PSODesc.CS, Hash);
+}
+
 UINT32 InputLayoutCache::FindOrAddLayout(const D3D12_INPUT_ELEMENT_DESC* pElements, UINT32 ElementCount)
 {
     UINT32 CreateStringLength = 0;
     size_t InputHash = HashLayout(pElements, ElementCount, &CreateStringLength);
 
-    const UINT32 LayoutCount = GetLayoutCount();
+    lock_guard<mutex> Lock(m_Mutex);
+
+    const UINT32 LayoutCount = (UINT32)m_Layouts.size();
     for (UINT32 i = 0; i < LayoutCount; ++i)
     {
         const InputLayout& IL = m_Layouts[i];
@@ -237,9 +615,17 @@ UINT32 InputLayoutCache::FindOrAddLayout(const D3D12_INPUT_ELEMENT_DESC* pElemen
     return LayoutIndex;
 }
 
+UINT32 InputLayoutCache::GetLayoutCount() const
+{
+    lock_guard<mutex> Lock(m_Mutex);
+    return (UINT32)m_Layouts.size();
+}
+
 bool InputLayoutCache::GetLayout(UINT32 Index, const D3D12_INPUT_ELEMENT_DESC** ppFirstElement, UINT32* pElementCount) const
 {
-    if (Index >= GetLayoutCount())
+    lock_guard<mutex> Lock(m_Mutex);
+
+    if (Index >= m_Layouts.size())
     {
         return false;
     }
@@ -251,6 +637,22 @@ bool InputLayoutCache::GetLayout(UINT32 Index, const D3D12_INPUT_ELEMENT_DESC**
     return true;
 }
 
+bool InputLayoutCache::SetPsoInputLayout(UINT32 Index, GraphicsPSO* pPso) const
+{
+    lock_guard<mutex> Lock(m_Mutex);
+
+    if (Index >= m_Layouts.size())
+    {
+        return false;
+    }
+
+    // SetInputLayout copies the elements, so the lock covers everything that reads them
+    const InputLayout& IL = m_Layouts[Index];
+    pPso->SetInputLayout(IL.ElementCount, &m_InputElements[IL.FirstElementIndex]);
+
+    return true;
+}
+
 bool InputLayoutCache::CompareLayout(const D3D12_INPUT_ELEMENT_DESC* pA, const D3D12_INPUT_ELEMENT_DESC* pB, UINT32 ElementCount) const
 {
     for (UINT32 i = 0; i < ElementCount; ++i)
@@ -317,31 +719,45 @@ size_t InputLayoutCache::HashLayout(const D3D12_INPUT_ELEMENT_DESC* pElements, U
     return Hash;
 }
 
-GraphicsPSO* PsoLayoutCache::SpecializePso(UINT32 InputLayoutIndex)
+GraphicsPSO* PsoLayoutCache::CreateSpecializedPso(UINT32 InputLayoutIndex)
 {
-    if (InputLayoutIndex >= m_SpecializedPsoList.size())
+    lock_guard<mutex> Lock(m_CreateMutex);
+
+    // Another thread may have created it while we waited for the lock
+    GraphicsPSO* pPso = nullptr;
+    if (InputLayoutIndex < MaxInputLayouts)
     {
-        m_SpecializedPsoList.resize(InputLayoutIndex + 1, nullptr);
+        pPso = m_SpecializedPsos[InputLayoutIndex].load(memory_order_acquire);
+    }
+    else
+    {
+        auto Iter = m_OverflowPsos.find(InputLayoutIndex);
+        pPso = Iter != m_OverflowPsos.end() ? Iter->second : nullptr;
     }
-
-    GraphicsPSO* pPso = m_SpecializedPsoList[InputLayoutIndex];
 
     if (pPso == nullptr)
     {
         pPso = new GraphicsPSO();
         *pPso = *m_pRootPso;
 
-        const D3D12_INPUT_ELEMENT_DESC* pDescs = nullptr;
-        UINT32 InputElementCount = 0;
-
-        bool Success = g_InputLayoutCache.GetLayout(InputLayoutIndex, &pDescs, &InputElementCount);
-        assert(Success);
+        if (!g_InputLayoutCache.SetPsoInputLayout(InputLayoutIndex, pPso))
+        {
+            Utility::Printf("PsoLayoutCache: unknown input layout %u, using the unspecialized PSO\n", InputLayoutIndex);
+            delete pPso;
+            return m_pRootPso;
+        }
 
-        pPso->SetInputLayout(InputElementCount, pDescs);
         pPso->Finalize();
 
-        m_SpecializedPsoList[InputLayoutIndex] = pPso;
+        if (InputLayoutIndex < MaxInputLayouts)
+        {
+            m_SpecializedPsos[InputLayoutIndex].store(pPso, memory_order_release);
+        }
+        else
+        {
+            m_OverflowPsos[InputLayoutIndex] = pPso;
+        }
     }
 
     return pPso;
-}
\ No newline at end of file
+}
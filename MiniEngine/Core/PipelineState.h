@@ -14,6 +14,9 @@
 #pragma once
 
 #include "pch.h"
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
 
 class CommandContext;
 class RootSignature;
@@ -24,14 +27,35 @@ class DomainShader;
 class PixelShader;
 class ComputeShader;
 
+// One per unique pipeline state.  Finalize() publishes the entry immediately and a
+// worker thread fills in PipelineState when compilation finishes.
+struct PipelineStateEntry
+{
+	size_t HashCode;
+	std::atomic<ID3D12PipelineState*> PipelineState;
+
+	// Set once the compile has run, even if it failed and PipelineState stays null
+	std::atomic<bool> Finished;
+
+	// Written by the compiling thread before PipelineState is published
+	DOUBLE QueueMsec;
+	DOUBLE CompileMsec;
+	bool CacheHit;
+	bool IsCompute;
+};
+
 class PSO
 {
 public:
 
-	PSO() : m_RootSignature(nullptr) {}
+	PSO() : m_RootSignature(nullptr), m_pEntry(nullptr) {}
 
 	static void DestroyAll( void );
 
+	// Blocks until every queued pipeline state has been compiled
+	static void WaitForPendingCompiles( void );
+	static void PrintCompileStatistics( void );
+
 	void SetRootSignature( const RootSignature& BindMappings )
 	{
 		m_RootSignature = &BindMappings;
@@ -43,13 +67,23 @@ public:
 		return *m_RootSignature;
 	}
 
-	ID3D12PipelineState* GetPipelineStateObject( void ) const { return m_PSO; }
+	// Only blocks if the pipeline state is still being compiled
+	ID3D12PipelineState* GetPipelineStateObject( void ) const
+	{
+		ASSERT(m_pEntry != nullptr, "PSO has not been finalized");
+		ID3D12PipelineState* PipelineState = m_pEntry->PipelineState.load(std::memory_order_acquire);
+		return PipelineState != nullptr ? PipelineState : WaitForPipelineState();
+	}
+
+	bool IsCompiled( void ) const { return m_pEntry != nullptr && m_pEntry->PipelineState.load(std::memory_order_acquire) != nullptr; }
 
 protected:
 
+	ID3D12PipelineState* WaitForPipelineState( void ) const;
+
 	const RootSignature* m_RootSignature;
 
-	ID3D12PipelineState* m_PSO;
+	PipelineStateEntry* m_pEntry;
 };
 
 class GraphicsPSO : public PSO
@@ -84,11 +118,14 @@ public:
 	void SetHullShader( const D3D12_SHADER_BYTECODE& Binary ) { m_PSODesc.HS = Binary; }
 	void SetDomainShader( const D3D12_SHADER_BYTECODE& Binary ) { m_PSODesc.DS = Binary; }
 
-	// Perform validation and compute a hash value for fast state block comparisons
+	// Perform validation and compute a hash value for fast state block comparisons.  New
+	// pipeline states are compiled asynchronously; this returns without waiting.
 	void Finalize();
 
 private:
 
+	uint64_t GetPersistentHash( void ) const;
+
 	D3D12_GRAPHICS_PIPELINE_STATE_DESC m_PSODesc;
 	std::shared_ptr<const D3D12_INPUT_ELEMENT_DESC> m_InputLayouts;
 };
@@ -108,12 +145,16 @@ public:
 
 private:
 
+	uint64_t GetPersistentHash( void ) const;
+
 	D3D12_COMPUTE_PIPELINE_STATE_DESC m_PSODesc;
 };
 
+// All methods are safe to call from multiple threads.
 class InputLayoutCache
 {
 private:
+    mutable std::mutex m_Mutex;
     std::vector<D3D12_INPUT_ELEMENT_DESC> m_InputElements;
 
     struct InputLayout
@@ -128,8 +169,11 @@ private:
 
 public:
     UINT32 FindOrAddLayout(const D3D12_INPUT_ELEMENT_DESC* pElements, UINT32 ElementCount);
-    UINT32 GetLayoutCount() const { return (UINT32)m_Layouts.size(); }
+    UINT32 GetLayoutCount() const;
+
+    // The returned pointer is only stable until the next layout is added; prefer SetPsoInputLayout.
     bool GetLayout(UINT32 Index, const D3D12_INPUT_ELEMENT_DESC** ppFirstElement, UINT32* pElementCount) const;
+    bool SetPsoInputLayout(UINT32 Index, GraphicsPSO* pPso) const;
 
 private:
     bool CompareLayout(const D3D12_INPUT_ELEMENT_DESC* pA, const D3D12_INPUT_ELEMENT_DESC* pB, UINT32 ElementCount) const;
@@ -138,17 +182,44 @@ private:
 
 extern InputLayoutCache g_InputLayoutCache;
 
+// Specializations are looked up without locking, so command lists for one pass can be
+// recorded on several threads.  Layouts past MaxInputLayouts are kept in a map that is
+// searched under the lock.
 class PsoLayoutCache
 {
 private:
+    static const UINT32 MaxInputLayouts = 256;
+
     GraphicsPSO* m_pRootPso;
-    std::vector<GraphicsPSO*> m_SpecializedPsoList;
+    std::atomic<GraphicsPSO*> m_SpecializedPsos[MaxInputLayouts];
+    std::mutex m_CreateMutex;
+    std::unordered_map<UINT32, GraphicsPSO*> m_OverflowPsos;
 
 public:
+    PsoLayoutCache()
+        : m_pRootPso(nullptr)
+    {
+        for (UINT32 i = 0; i < MaxInputLayouts; ++i)
+        {
+            m_SpecializedPsos[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
     void Initialize(GraphicsPSO* pRootPso)
     {
         m_pRootPso = pRootPso;
     }
 
-    GraphicsPSO* SpecializePso(UINT32 InputLayoutIndex);
+    GraphicsPSO* SpecializePso(UINT32 InputLayoutIndex)
+    {
+        if (InputLayoutIndex >= MaxInputLayouts)
+        {
+            return CreateSpecializedPso(InputLayoutIndex);
+        }
+        GraphicsPSO* pPso = m_SpecializedPsos[InputLayoutIndex].load(std::memory_order_acquire);
+        return pPso != nullptr ? pPso : CreateSpecializedPso(InputLayoutIndex);
+    }
+
+private:
+    GraphicsPSO* CreateSpecializedPso(UINT32 InputLayoutIndex);
 };
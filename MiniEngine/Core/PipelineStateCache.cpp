@@ -0,0 +1,566 @@
+#include "pch.h"
+#include "PipelineStateCache.h"
+#include "SystemTime.h"
+#include "Hash.h"
+
+PipelineStateCache g_PipelineStateCache;
+
+PipelineStateCache::PipelineStateCache()
+    : m_hFile(INVALID_HANDLE_VALUE),
+      m_hMapping(nullptr),
+      m_pMappedData(nullptr),
+      m_MappedSizeBytes(0),
+      m_MaxFileBytes(0)
+{
+    ZeroMemory(&m_Identity, sizeof(m_Identity));
+    ZeroMemory(&m_Stats, sizeof(m_Stats));
+}
+
+PipelineStateCache::~PipelineStateCache()
+{
+    Terminate();
+}
+
+namespace
+{
+    // "Name.ext" for instance 0, "Name.1.ext" for instance 1 and so on
+    std::wstring MakeInstanceFileName(const std::wstring& FileName, UINT32 Instance)
+    {
+        if (Instance == 0)
+        {
+            return FileName;
+        }
+        const size_t Dot = FileName.find_last_of(L'.');
+        const size_t Slash = FileName.find_last_of(L"\\/");
+        const size_t Split = (Dot != std::wstring::npos && (Slash == std::wstring::npos || Dot > Slash)) ? Dot : FileName.size();
+        return FileName.substr(0, Split) + L"." + std::to_wstring(Instance) + FileName.substr(Split);
+    }
+}
+
+bool PipelineStateCache::Initialize(const WCHAR* strFileName, const PipelineCacheAdapterIdentity& Identity, UINT64 MaxFileBytes)
+{
+    std::lock_guard<std::mutex> Lock(m_Mutex);
+
+    assert(strFileName != nullptr);
+    m_MaxFileBytes = MaxFileBytes;
+    ZeroMemory(&m_Stats, sizeof(m_Stats));
+
+    const INT64 StartTick = SystemTime::GetCurrentTick();
+    for (UINT32 Instance = 0; Instance < MaxInstanceFiles; ++Instance)
+    {
+        m_FileName = MakeInstanceFileName(strFileName, Instance);
+        if (OpenFile(Identity))
+        {
+            m_Stats.OpenMsec = SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - StartTick);
+            return true;
+        }
+
+        const DWORD Error = GetLastError();
+        CloseFile();
+        if (Error != ERROR_SHARING_VIOLATION)
+        {
+            break;
+        }
+    }
+
+    // Pipelines are still created, just not persisted
+    Utility::Printf(L"PipelineStateCache: could not open \"%s\", cache disabled.\n", m_FileName.c_str());
+    return false;
+}
+
+void PipelineStateCache::Terminate()
+{
+    std::lock_guard<std::mutex> Lock(m_Mutex);
+    CloseFile();
+}
+
+bool PipelineStateCache::Find(UINT64 Key, PipelineCacheRecordType Type, std::vector<BYTE>& Data)
+{
+    std::lock_guard<std::mutex> Lock(m_Mutex);
+
+    if (m_pMappedData != nullptr)
+    {
+        auto iter = m_Records.find(MakeRecordKey(Key, Type));
+        if (iter != m_Records.end())
+        {
+            const RecordHeader* pRH = (const RecordHeader*)(m_pMappedData + iter->second);
+            if (pRH->Key == Key && pRH->Type == (UINT32)Type)
+            {
+                // Copy out; the view may be remapped by a concurrent Store.
+                const BYTE* pData = (const BYTE*)(pRH + 1);
+                Data.assign(pData, pData + pRH->SizeBytes);
+                ++m_Stats.Hits;
+                m_Stats.BytesLoaded += pRH->SizeBytes;
+                return true;
+            }
+        }
+    }
+
+    ++m_Stats.Misses;
+    return false;
+}
+
+void PipelineStateCache::Store(UINT64 Key, PipelineCacheRecordType Type, const VOID* pData, SIZE_T SizeBytes)
+{
+    assert(SizeBytes <= UINT_MAX);
+
+    std::lock_guard<std::mutex> Lock(m_Mutex);
+
+    if (m_pMappedData == nullptr || SizeBytes == 0)
+    {
+        return;
+    }
+
+    const UINT64 RecordKey = MakeRecordKey(Key, Type);
+    const UINT64 RecordSize = Math::AlignUp(sizeof(RecordHeader) + SizeBytes, 8);
+
+    // A blob of the same padded size replaces the old one in place.  A write torn by a crash
+    // leaves a blob the driver rejects, which is recompiled and stored again.
+    auto iter = m_Records.find(RecordKey);
+    auto RejectedIter = m_RejectedRecords.find(RecordKey);
+    const UINT64* pOldOffset = iter != m_Records.end() ? &iter->second : RejectedIter != m_RejectedRecords.end() ? &RejectedIter->second : nullptr;
+    if (pOldOffset != nullptr)
+    {
+        const UINT64 OldOffset = *pOldOffset;
+        RecordHeader* pRH = (RecordHeader*)(m_pMappedData + OldOffset);
+        if (Math::AlignUp(sizeof(RecordHeader) + pRH->SizeBytes, 8) == RecordSize)
+        {
+            memcpy(pRH + 1, pData, SizeBytes);
+            pRH->SizeBytes = (UINT32)SizeBytes;
+            m_Records[RecordKey] = OldOffset;
+            m_RejectedRecords.erase(RecordKey);
+            ++m_Stats.Stores;
+            return;
+        }
+    }
+    const UINT64 Offset = GetFileHeader()->UsedBytes;
+    const UINT64 RequiredSize = Offset + RecordSize;
+    if (RequiredSize > m_MaxFileBytes)
+    {
+        ++m_Stats.DroppedWrites;
+        return;
+    }
+
+    if (RequiredSize > m_MappedSizeBytes)
+    {
+        const UINT64 NewSize = std::min(std::max(m_MappedSizeBytes * 2, RequiredSize), m_MaxFileBytes);
+        UnmapFile();
+        if (!MapFile(NewSize))
+        {
+            CloseFile();
+            ++m_Stats.DroppedWrites;
+            return;
+        }
+    }
+
+    // Later records for the same key shadow earlier ones when the file is indexed.
+    RecordHeader* pRH = (RecordHeader*)(m_pMappedData + Offset);
+    memcpy(pRH + 1, pData, SizeBytes);
+    pRH->Key = Key;
+    pRH->Type = (UINT32)Type;
+    pRH->SizeBytes = (UINT32)SizeBytes;
+    GetFileHeader()->UsedBytes = RequiredSize;
+
+    m_Records[RecordKey] = Offset;
+    m_RejectedRecords.erase(RecordKey);
+    ++m_Stats.Stores;
+}
+
+void PipelineStateCache::RecordCreateTime(bool CacheHit, DOUBLE Msec)
+{
+    std::lock_guard<std::mutex> Lock(m_Mutex);
+    if (CacheHit)
+    {
+        m_Stats.HitCreateMsec += Msec;
+    }
+    else
+    {
+        m_Stats.MissCreateMsec += Msec;
+    }
+}
+
+void PipelineStateCache::RecordRejectedBlob(UINT64 Key, PipelineCacheRecordType Type)
+{
+    std::lock_guard<std::mutex> Lock(m_Mutex);
+    ++m_Stats.RejectedBlobs;
+    auto iter = m_Records.find(MakeRecordKey(Key, Type));
+    if (iter != m_Records.end())
+    {
+        m_RejectedRecords.insert(*iter);
+        m_Records.erase(iter);
+    }
+}
+
+PipelineCacheStats PipelineStateCache::GetStats() const
+{
+    std::lock_guard<std::mutex> Lock(m_Mutex);
+
+    PipelineCacheStats Stats = m_Stats;
+    Stats.RecordCount = (UINT32)m_Records.size();
+    Stats.FileBytes = m_pMappedData != nullptr ? GetFileHeader()->UsedBytes : 0;
+    return Stats;
+}
+
+void PipelineStateCache::PrintStats(const CHAR* strLabel) const
+{
+    const PipelineCacheStats Stats = GetStats();
+    const UINT32 Lookups = Stats.Hits + Stats.Misses;
+    Utility::Printf("PipelineStateCache (%s): %u hits, %u misses (%0.1f%% hit rate), %u stores, %u rejected, %u dropped writes\n",
+        strLabel, Stats.Hits, Stats.Misses, Lookups > 0 ? (FLOAT)Stats.Hits * 100.0f / (FLOAT)Lookups : 0.0f, Stats.Stores, Stats.RejectedBlobs, Stats.DroppedWrites);
+    Utility::Printf("PipelineStateCache (%s): %0.1f ms creating from cache, %0.1f ms creating cold, %0.1f ms opening, %u records / %llu KB (%llu KB compacted)%s\n",
+        strLabel, Stats.HitCreateMsec, Stats.MissCreateMsec, Stats.OpenMsec, Stats.RecordCount, Stats.FileBytes / 1024, Stats.CompactedBytes / 1024, Stats.FileReset ? " (reset)" : "");
+}
+
+bool PipelineStateCache::OpenFile(const PipelineCacheAdapterIdentity& Identity)
+{
+    m_Identity = Identity;
+
+    // Exclusive, since records are written through the mapping without locking the file
+    m_hFile = CreateFile2(m_FileName.c_str(), GENERIC_READ | GENERIC_WRITE, 0, OPEN_ALWAYS, nullptr);
+    if (m_hFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER FileSize = {};
+    if (!GetFileSizeEx(m_hFile, &FileSize))
+    {
+        return false;
+    }
+
+    const UINT64 MinimumSizeBytes = 1024 * 1024;
+    if (!MapFile(std::max((UINT64)FileSize.QuadPart, MinimumSizeBytes)))
+    {
+        return false;
+    }
+
+    const FileHeader* pHeader = GetFileHeader();
+    if (pHeader->Magic != FileMagic || pHeader->Version != FileVersion ||
+        memcmp(&pHeader->Identity, &m_Identity, sizeof(m_Identity)) != 0 ||
+        pHeader->UsedBytes < sizeof(FileHeader) || pHeader->UsedBytes > m_MappedSizeBytes)
+    {
+        ResetFile();
+    }
+
+    IndexFile();
+    return true;
+}
+
+void PipelineStateCache::CloseFile()
+{
+    UnmapFile();
+    if (m_hFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+    m_Records.clear();
+    m_RejectedRecords.clear();
+}
+
+bool PipelineStateCache::MapFile(UINT64 SizeBytes)
+{
+    assert(m_pMappedData == nullptr);
+
+    LARGE_INTEGER MappingSize;
+    MappingSize.QuadPart = SizeBytes;
+    m_hMapping = CreateFileMapping(m_hFile, nullptr, PAGE_READWRITE, MappingSize.HighPart, MappingSize.LowPart, nullptr);
+    if (m_hMapping == nullptr)
+    {
+        return false;
+    }
+
+    m_pMappedData = (BYTE*)MapViewOfFile(m_hMapping, FILE_MAP_ALL_ACCESS, 0, 0, (SIZE_T)SizeBytes);
+    if (m_pMappedData == nullptr)
+    {
+        CloseHandle(m_hMapping);
+        m_hMapping = nullptr;
+        return false;
+    }
+
+    m_MappedSizeBytes = SizeBytes;
+    return true;
+}
+
+void PipelineStateCache::UnmapFile()
+{
+    if (m_pMappedData != nullptr)
+    {
+        FlushViewOfFile(m_pMappedData, 0);
+        UnmapViewOfFile(m_pMappedData);
+        m_pMappedData = nullptr;
+    }
+    if (m_hMapping != nullptr)
+    {
+        CloseHandle(m_hMapping);
+        m_hMapping = nullptr;
+    }
+    m_MappedSizeBytes = 0;
+}
+
+void PipelineStateCache::IndexFile()
+{
+    m_Records.clear();
+    m_RejectedRecords.clear();
+
+    FileHeader* pHeader = GetFileHeader();
+    UINT64 Offset = sizeof(FileHeader);
+    UINT32 RecordCount = 0;
+    while (Offset + sizeof(RecordHeader) <= pHeader->UsedBytes)
+    {
+        const RecordHeader* pRH = (const RecordHeader*)(m_pMappedData + Offset);
+        const UINT64 RecordSize = Math::AlignUp(sizeof(RecordHeader) + pRH->SizeBytes, 8);
+        if (pRH->SizeBytes == 0 || Offset + RecordSize > pHeader->UsedBytes)
+        {
+            // Torn write from a previous run; drop everything past this point
+            break;
+        }
+        m_Records[MakeRecordKey(pRH->Key, (PipelineCacheRecordType)pRH->Type)] = Offset;
+        Offset += RecordSize;
+        ++RecordCount;
+    }
+    pHeader->UsedBytes = Offset;
+
+    if (RecordCount == m_Records.size())
+    {
+        return;
+    }
+
+    // Slide the latest record of each key down over the ones it shadows.  Records only move
+    // toward the front, so a record is read before anything is written over it.
+    const UINT64 UsedBytes = pHeader->UsedBytes;
+    UINT64 WriteOffset = sizeof(FileHeader);
+    Offset = sizeof(FileHeader);
+    while (Offset < UsedBytes)
+    {
+        const RecordHeader* pRH = (const RecordHeader*)(m_pMappedData + Offset);
+        const UINT64 RecordSize = Math::AlignUp(sizeof(RecordHeader) + pRH->SizeBytes, 8);
+        UINT64& LiveOffset = m_Records[MakeRecordKey(pRH->Key, (PipelineCacheRecordType)pRH->Type)];
+        if (LiveOffset == Offset)
+        {
+            memmove(m_pMappedData + WriteOffset, pRH, (SIZE_T)RecordSize);
+            LiveOffset = WriteOffset;
+            WriteOffset += RecordSize;
+        }
+        Offset += RecordSize;
+    }
+    pHeader->UsedBytes = WriteOffset;
+    m_Stats.CompactedBytes = UsedBytes - WriteOffset;
+}
+
+void PipelineStateCache::ResetFile()
+{
+    FileHeader* pHeader = GetFileHeader();
+    pHeader->Magic = FileMagic;
+    pHeader->Version = FileVersion;
+    pHeader->Identity = m_Identity;
+    pHeader->UsedBytes = sizeof(FileHeader);
+    m_Stats.FileReset = true;
+}
+
+namespace
+{
+    // Stands in for a D3D12 driver in PipelineStateCache::Benchmark.  Compiling hashes a
+    // block of "bytecode" many times; creating from a cached blob only validates it, and
+    // rejects blobs from another driver version or with a bad checksum as a driver would.
+    struct StubPipeline
+    {
+        UINT64 Key;
+        UINT64 Checksum;
+        std::vector<BYTE> Blob;
+    };
+
+    struct StubBlobHeader
+    {
+        UINT32 Magic;
+        UINT32 DriverVersion;
+        UINT64 Key;
+        UINT64 Checksum;
+    };
+
+    class StubPipelineDriver
+    {
+    public:
+        static const UINT32 BlobMagic = 0x42505453; // 'STPB'
+        static const UINT32 PayloadBytes = 2048;
+
+        StubPipelineDriver() : DriverVersion(1), CompileCount(0), m_Bytecode(64 * 1024)
+        {
+            for (size_t i = 0; i < m_Bytecode.size(); ++i)
+            {
+                m_Bytecode[i] = (BYTE)(i * 31 + 7);
+            }
+        }
+
+        HRESULT Create(UINT64 Key, const void* pCachedBlob, SIZE_T CachedBlobSize, StubPipeline** ppPipeline)
+        {
+            std::vector<BYTE> Payload(PayloadBytes);
+            if (pCachedBlob != nullptr)
+            {
+                const StubBlobHeader* pHeader = (const StubBlobHeader*)pCachedBlob;
+                if (CachedBlobSize != sizeof(StubBlobHeader) + PayloadBytes || pHeader->Magic != BlobMagic || pHeader->Key != Key)
+                {
+                    return E_INVALIDARG;
+                }
+                if (pHeader->DriverVersion != DriverVersion)
+                {
+                    return D3D12_ERROR_DRIVER_VERSION_MISMATCH;
+                }
+                memcpy(Payload.data(), pHeader + 1, PayloadBytes);
+                if (Utility::HashBytes64(Payload.data(), PayloadBytes) != pHeader->Checksum)
+                {
+                    return E_INVALIDARG;
+                }
+            }
+            else
+            {
+                ++CompileCount;
+                UINT64 Hash = Key;
+                for (UINT32 Pass = 0; Pass < 16; ++Pass)
+                {
+                    Hash = Utility::HashBytes64(m_Bytecode.data(), m_Bytecode.size(), Hash);
+                }
+                for (UINT32 i = 0; i < PayloadBytes; i += sizeof(UINT64))
+                {
+                    Hash = Hash * 6364136223846793005ULL + 1442695040888963407ULL;
+                    memcpy(&Payload[i], &Hash, sizeof(UINT64));
+                }
+            }
+
+            StubPipeline* pPipeline = new StubPipeline;
+            pPipeline->Key = Key;
+            pPipeline->Checksum = Utility::HashBytes64(Payload.data(), PayloadBytes);
+
+            StubBlobHeader Header = { BlobMagic, DriverVersion, Key, pPipeline->Checksum };
+            pPipeline->Blob.resize(sizeof(StubBlobHeader) + PayloadBytes);
+            memcpy(pPipeline->Blob.data(), &Header, sizeof(Header));
+            memcpy(pPipeline->Blob.data() + sizeof(Header), Payload.data(), PayloadBytes);
+
+            *ppPipeline = pPipeline;
+            return S_OK;
+        }
+
+        UINT32 DriverVersion;
+        UINT32 CompileCount;
+
+    private:
+        std::vector<BYTE> m_Bytecode;
+    };
+}
+
+bool PipelineStateCache::Benchmark(UINT32 PipelineCount)
+{
+    PipelineCount = std::max(PipelineCount, 4U);
+    const WCHAR* strFileName = L"PipelineStateCacheBench.dat";
+    DeleteFileW(strFileName);
+
+    PipelineCacheAdapterIdentity Identity = { 0x1234, 0x5678, 0, 1, 1 };
+    StubPipelineDriver Driver;
+    std::vector<UINT64> Checksums(PipelineCount, 0);
+    bool Valid = true;
+
+    // Creates every pipeline once and checks it against the cold results
+    auto RunPhase = [&](PipelineStateCache& Cache, DOUBLE* pMsec, UINT32* pCompiles)
+    {
+        const UINT32 CompilesBefore = Driver.CompileCount;
+        const INT64 StartTick = SystemTime::GetCurrentTick();
+        for (UINT32 i = 0; i < PipelineCount; ++i)
+        {
+            const UINT64 Key = Utility::HashBytes64(&i, sizeof(i));
+            bool CacheHit = false;
+            StubPipeline* pPipeline = Cache.CreateWithCache<StubPipeline>(Key, PCRT_GraphicsPSO,
+                [&Driver, Key](const void* pBlob, SIZE_T BlobSize, StubPipeline** ppPipeline) { return Driver.Create(Key, pBlob, BlobSize, ppPipeline); },
+                [](StubPipeline* pPipeline, std::vector<BYTE>& Blob) { Blob = pPipeline->Blob; return true; },
+                &CacheHit);
+            if (pPipeline == nullptr)
+            {
+                Valid = false;
+                continue;
+            }
+            if (Checksums[i] == 0)
+            {
+                Checksums[i] = pPipeline->Checksum;
+            }
+            Valid = Valid && pPipeline->Checksum == Checksums[i];
+            delete pPipeline;
+        }
+        *pMsec = SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - StartTick);
+        *pCompiles = Driver.CompileCount - CompilesBefore;
+    };
+
+    DOUBLE ColdMsec, WarmMsec, CorruptMsec, DriverMsec, AdapterMsec;
+    UINT32 ColdCompiles, WarmCompiles, CorruptCompiles, DriverCompiles, AdapterCompiles, RecheckCompiles;
+    PipelineCacheStats Cold, Warm, Corrupt, Recheck, DriverUpdate, Adapter;
+    const UINT32 CorruptCount = PipelineCount / 4;
+
+    {
+        PipelineStateCache Cache;
+        Valid = Valid && Cache.Initialize(strFileName, Identity);
+        RunPhase(Cache, &ColdMsec, &ColdCompiles);
+        Cold = Cache.GetStats();
+        Cache.Terminate();
+
+        // Reopening reads the blobs back from disk
+        Valid = Valid && Cache.Initialize(strFileName, Identity);
+        RunPhase(Cache, &WarmMsec, &WarmCompiles);
+        Warm = Cache.GetStats();
+
+        // Shadow a quarter of the records with blobs whose payload was damaged
+        for (UINT32 i = 0; i < CorruptCount; ++i)
+        {
+            const UINT64 Key = Utility::HashBytes64(&i, sizeof(i));
+            std::vector<BYTE> Blob;
+            if (Cache.Find(Key, PCRT_GraphicsPSO, Blob))
+            {
+                Blob.back() ^= 0xFF;
+                Cache.Store(Key, PCRT_GraphicsPSO, Blob.data(), Blob.size());
+            }
+        }
+        Cache.Terminate();
+
+        Valid = Valid && Cache.Initialize(strFileName, Identity);
+        RunPhase(Cache, &CorruptMsec, &CorruptCompiles);
+        Corrupt = Cache.GetStats();
+        Cache.Terminate();
+
+        // The recompiled blobs must have replaced the damaged ones
+        DOUBLE RecheckMsec;
+        Valid = Valid && Cache.Initialize(strFileName, Identity);
+        RunPhase(Cache, &RecheckMsec, &RecheckCompiles);
+        Recheck = Cache.GetStats();
+        Cache.Terminate();
+
+        // A driver update with the same adapter identity rejects every blob
+        ++Driver.DriverVersion;
+        Valid = Valid && Cache.Initialize(strFileName, Identity);
+        RunPhase(Cache, &DriverMsec, &DriverCompiles);
+        DriverUpdate = Cache.GetStats();
+        Cache.Terminate();
+
+        // A file written for another adapter is discarded on open
+        ++Identity.DriverVersion;
+        Valid = Valid && Cache.Initialize(strFileName, Identity);
+        RunPhase(Cache, &AdapterMsec, &AdapterCompiles);
+        Adapter = Cache.GetStats();
+        Cache.Terminate();
+    }
+    DeleteFileW(strFileName);
+
+    Valid = Valid && ColdCompiles == PipelineCount && Cold.Misses == PipelineCount && Cold.Stores == PipelineCount;
+    Valid = Valid && WarmCompiles == 0 && Warm.Hits == PipelineCount && Warm.RejectedBlobs == 0;
+    Valid = Valid && CorruptCompiles == CorruptCount && Corrupt.RejectedBlobs == CorruptCount && Corrupt.Stores == CorruptCount;
+    Valid = Valid && RecheckCompiles == 0 && Recheck.RejectedBlobs == 0 && Recheck.FileBytes == Warm.FileBytes;
+    Valid = Valid && DriverCompiles == PipelineCount && DriverUpdate.RejectedBlobs == PipelineCount;
+    Valid = Valid && AdapterCompiles == PipelineCount && Adapter.FileReset && Adapter.Hits == 0;
+
+    Utility::PrintfConsole("Pipeline cache benchmark: %u pipelines, %u-byte blobs, stub driver\n",
+        PipelineCount, (UINT32)(sizeof(StubBlobHeader) + StubPipelineDriver::PayloadBytes));
+    Utility::PrintfConsole("  Cold:              %10.2f ms (%u compiles)\n", ColdMsec, ColdCompiles);
+    Utility::PrintfConsole("  Warm:              %10.2f ms (%u compiles, %llu KB loaded), %0.1fx faster\n",
+        WarmMsec, WarmCompiles, Warm.BytesLoaded / 1024, ColdMsec / std::max(WarmMsec, 1e-3));
+    Utility::PrintfConsole("  Corrupt blobs:     %10.2f ms (%u rejected, %u recompiled)\n", CorruptMsec, Corrupt.RejectedBlobs, CorruptCompiles);
+    Utility::PrintfConsole("  Driver mismatch:   %10.2f ms (%u rejected, %u recompiled)\n", DriverMsec, DriverUpdate.RejectedBlobs, DriverCompiles);
+    Utility::PrintfConsole("  Adapter mismatch:  %10.2f ms (file %s, %u recompiled)\n", AdapterMsec, Adapter.FileReset ? "reset" : "kept", AdapterCompiles);
+
+    return Valid;
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+#include <mutex>
+#include "SystemTime.h"
+
+enum PipelineCacheRecordType
+{
+    PCRT_RootSignature = 1,
+    PCRT_GraphicsPSO = 2,
+    PCRT_ComputePSO = 3,
+};
+
+// Cached blobs are only valid for the adapter and driver that produced them; a file
+// written under a different identity is discarded on open.
+struct PipelineCacheAdapterIdentity
+{
+    UINT32 VendorId;
+    UINT32 DeviceId;
+    UINT32 SubSysId;
+    UINT32 Revision;
+    UINT64 DriverVersion;
+};
+
+struct PipelineCacheStats
+{
+    UINT32 Hits;
+    UINT32 Misses;
+    UINT32 Stores;
+    UINT32 RejectedBlobs;
+    UINT32 DroppedWrites;
+    UINT32 RecordCount;
+    UINT64 FileBytes;
+    UINT64 BytesLoaded;
+    UINT64 CompactedBytes;
+    DOUBLE HitCreateMsec;
+    DOUBLE MissCreateMsec;
+    DOUBLE OpenMsec;
+    bool FileReset;
+};
+
+// Memory-mapped file of pipeline blobs (cached PSOs and serialized root signatures),
+// indexed by a 64-bit content key and record type.  A blob stored again for a key
+// overwrites its record when the size matches and is appended otherwise; the records it
+// shadows are compacted away when the file is next opened.  The file logic does not touch
+// a D3D device, so it can be driven by anything that produces blobs.
+// All methods are safe to call from multiple threads.
+class PipelineStateCache
+{
+private:
+    static const UINT32 FileMagic = 0x43535050; // 'PPSC'
+    static const UINT32 FileVersion = 1;
+
+    // A process that finds the file held by another opens the next numbered name instead
+    static const UINT32 MaxInstanceFiles = 4;
+
+    struct FileHeader
+    {
+        UINT32 Magic;
+        UINT32 Version;
+        PipelineCacheAdapterIdentity Identity;
+        UINT64 UsedBytes;
+    };
+
+    struct RecordHeader
+    {
+        UINT64 Key;
+        UINT32 Type;
+        UINT32 SizeBytes;
+    };
+
+    typedef std::unordered_map<UINT64, UINT64> RecordMap;
+
+    mutable std::mutex m_Mutex;
+    RecordMap m_Records;
+
+    // Records whose blob the driver rejected, kept so the replacement can overwrite them
+    RecordMap m_RejectedRecords;
+
+    std::wstring m_FileName;
+    PipelineCacheAdapterIdentity m_Identity;
+    HANDLE m_hFile;
+    HANDLE m_hMapping;
+    BYTE* m_pMappedData;
+    UINT64 m_MappedSizeBytes;
+    UINT64 m_MaxFileBytes;
+
+    PipelineCacheStats m_Stats;
+
+public:
+    PipelineStateCache();
+    ~PipelineStateCache();
+
+    // Opens (or creates) the cache file, compacting it if records were shadowed.  If another
+    // process holds it, "Name.1.ext" and so on are tried, so every process keeps a cache.
+    bool Initialize(const WCHAR* strFileName, const PipelineCacheAdapterIdentity& Identity, UINT64 MaxFileBytes = 256 * 1024 * 1024);
+
+    void Terminate();
+    bool IsOpen() const { return m_pMappedData != nullptr; }
+
+    bool Find(UINT64 Key, PipelineCacheRecordType Type, std::vector<BYTE>& Data);
+    void Store(UINT64 Key, PipelineCacheRecordType Type, const VOID* pData, SIZE_T SizeBytes);
+
+    // Creates an object with Create(pCachedBlob, CachedBlobSizeBytes, ppObject), first with
+    // the blob stored under Key if there is one.  A blob that Create rejects is dropped and
+    // the object is created without one; the blob of a cold object, read with
+    // GetBlob(pObject, Blob), is stored for next time.  Returns null if that also fails.
+    template <typename T, typename CreateFunc, typename GetBlobFunc>
+    T* CreateWithCache(UINT64 Key, PipelineCacheRecordType Type, CreateFunc Create, GetBlobFunc GetBlob, bool* pCacheHit);
+
+    // Bookkeeping for the hit/miss report; callers time their own object creation.
+    void RecordCreateTime(bool CacheHit, DOUBLE Msec);
+    void RecordRejectedBlob(UINT64 Key, PipelineCacheRecordType Type);
+
+    PipelineCacheStats GetStats() const;
+    void PrintStats(const CHAR* strLabel) const;
+
+    // Creates pipelines through a stub driver in a scratch file, cold and then warm, and
+    // checks that corrupt blobs, blobs from another driver version and a file written
+    // for another adapter are all rejected and the pipelines recompiled.
+    static bool Benchmark(UINT32 PipelineCount);
+
+private:
+    bool OpenFile(const PipelineCacheAdapterIdentity& Identity);
+    void CloseFile();
+    bool MapFile(UINT64 SizeBytes);
+    void UnmapFile();
+    void IndexFile();
+    void ResetFile();
+    FileHeader* GetFileHeader() const { return (FileHeader*)m_pMappedData; }
+    static UINT64 MakeRecordKey(UINT64 Key, PipelineCacheRecordType Type) { return Key ^ ((UINT64)Type << 56); }
+};
+
+template <typename T, typename CreateFunc, typename GetBlobFunc>
+T* PipelineStateCache::CreateWithCache(UINT64 Key, PipelineCacheRecordType Type, CreateFunc Create, GetBlobFunc GetBlob, bool* pCacheHit)
+{
+    const INT64 StartTick = SystemTime::GetCurrentTick();
+
+    std::vector<BYTE> Blob;
+    bool CacheHit = Find(Key, Type, Blob);
+
+    T* pObject = nullptr;
+    if (CacheHit && FAILED(Create(Blob.data(), Blob.size(), &pObject)))
+    {
+        // Usually D3D12_ERROR_DRIVER_VERSION_MISMATCH or D3D12_ERROR_ADAPTER_NOT_FOUND
+        RecordRejectedBlob(Key, Type);
+        CacheHit = false;
+        pObject = nullptr;
+    }
+
+    if (!CacheHit)
+    {
+        if (FAILED(Create(nullptr, 0, &pObject)))
+        {
+            pObject = nullptr;
+        }
+        else if (pObject != nullptr && GetBlob(pObject, Blob))
+        {
+            Store(Key, Type, Blob.data(), Blob.size());
+        }
+    }
+
+    RecordCreateTime(CacheHit, SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - StartTick));
+    *pCacheHit = CacheHit;
+    return pObject;
+}
+
+extern PipelineStateCache g_PipelineStateCache;
@@ -15,6 +15,8 @@
 #include "RootSignature.h"
 #include "GraphicsCore.h"
 #include "Hash.h"
+#include "PipelineStateCache.h"
+#include "SystemTime.h"
 #include <map>
 #include <thread>
 #include <mutex>
@@ -106,17 +108,25 @@ void RootSignature::Finalize(const std::wstring& name, D3D12_ROOT_SIGNATURE_FLAG
 	size_t HashCode = Utility::HashState(&RootDesc.Flags);
 	HashCode = Utility::HashState( RootDesc.pStaticSamplers, m_NumSamplers, HashCode );
 
+	uint64_t PersistentHash = Utility::HashBytes64(&RootDesc.Flags, sizeof(RootDesc.Flags));
+	PersistentHash = Utility::HashBytes64(RootDesc.pStaticSamplers, m_NumSamplers * sizeof(D3D12_STATIC_SAMPLER_DESC), PersistentHash);
+
 	for (UINT Param = 0; Param < m_NumParameters; ++Param)
 	{
 		const D3D12_ROOT_PARAMETER& RootParam = RootDesc.pParameters[Param];
 		m_DescriptorTableSize[Param] = 0;
 
+		PersistentHash = Utility::HashBytes64(&RootParam.ParameterType, sizeof(RootParam.ParameterType), PersistentHash);
+		PersistentHash = Utility::HashBytes64(&RootParam.ShaderVisibility, sizeof(RootParam.ShaderVisibility), PersistentHash);
+
 		if (RootParam.ParameterType == D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE)
 		{
 			ASSERT(RootParam.DescriptorTable.pDescriptorRanges != nullptr);
 
 			HashCode = Utility::HashState( RootParam.DescriptorTable.pDescriptorRanges,
 				RootParam.DescriptorTable.NumDescriptorRanges, HashCode );
+			PersistentHash = Utility::HashBytes64( RootParam.DescriptorTable.pDescriptorRanges,
+				RootParam.DescriptorTable.NumDescriptorRanges * sizeof(D3D12_DESCRIPTOR_RANGE), PersistentHash );
 
 			// We keep track of sampler descriptor tables separately from CBV_SRV_UAV descriptor tables
 			if (RootParam.DescriptorTable.pDescriptorRanges->RangeType == D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER)
@@ -128,9 +138,19 @@ void RootSignature::Finalize(const std::wstring& name, D3D12_ROOT_SIGNATURE_FLAG
 				m_DescriptorTableSize[Param] += RootParam.DescriptorTable.pDescriptorRanges[TableRange].NumDescriptors;
 		}
 		else
+		{
 			HashCode = Utility::HashState( &RootParam, 1, HashCode );
+
+			// Only hash the live union member; the rest of the parameter is uninitialized
+			if (RootParam.ParameterType == D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS)
+				PersistentHash = Utility::HashBytes64( &RootParam.Constants, sizeof(RootParam.Constants), PersistentHash );
+			else
+				PersistentHash = Utility::HashBytes64( &RootParam.Descriptor, sizeof(RootParam.Descriptor), PersistentHash );
+		}
 	}
 
+	m_PersistentHash = PersistentHash;
+
 	ID3D12RootSignature** RSRef = nullptr;
 	bool firstCompile = false;
 	{
@@ -150,13 +170,31 @@ void RootSignature::Finalize(const std::wstring& name, D3D12_ROOT_SIGNATURE_FLAG
 
 	if (firstCompile)
 	{
-		ComPtr<ID3DBlob> pOutBlob, pErrorBlob;
+		const int64_t StartTick = SystemTime::GetCurrentTick();
 
-		ASSERT_SUCCEEDED( D3D12SerializeRootSignature(&RootDesc, D3D_ROOT_SIGNATURE_VERSION_1,
-			pOutBlob.GetAddressOf(), pErrorBlob.GetAddressOf()));
+		// Serialization is skipped entirely when a previous run left the blob in the cache
+		std::vector<BYTE> CachedBlob;
+		bool CacheHit = g_PipelineStateCache.Find(PersistentHash, PCRT_RootSignature, CachedBlob);
+		if (CacheHit && FAILED(g_Device->CreateRootSignature(1, CachedBlob.data(), CachedBlob.size(), MY_IID_PPV_ARGS(&m_Signature))))
+		{
+			g_PipelineStateCache.RecordRejectedBlob(PersistentHash, PCRT_RootSignature);
+			CacheHit = false;
+		}
+
+		if (!CacheHit)
+		{
+			ComPtr<ID3DBlob> pOutBlob, pErrorBlob;
+
+			ASSERT_SUCCEEDED( D3D12SerializeRootSignature(&RootDesc, D3D_ROOT_SIGNATURE_VERSION_1,
+				pOutBlob.GetAddressOf(), pErrorBlob.GetAddressOf()));
+
+			ASSERT_SUCCEEDED( g_Device->CreateRootSignature(1, pOutBlob->GetBufferPointer(), pOutBlob->GetBufferSize(),
+				MY_IID_PPV_ARGS(&m_Signature)) );
+
+			g_PipelineStateCache.Store(PersistentHash, PCRT_RootSignature, pOutBlob->GetBufferPointer(), pOutBlob->GetBufferSize());
+		}
 
-		ASSERT_SUCCEEDED( g_Device->CreateRootSignature(1, pOutBlob->GetBufferPointer(), pOutBlob->GetBufferSize(),
-			MY_IID_PPV_ARGS(&m_Signature)) );
+		g_PipelineStateCache.RecordCreateTime(CacheHit, SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - StartTick));
 
 		m_Signature->SetName(name.c_str());
 
@@ -56,6 +56,11 @@ void ShadowBuffer::BeginRendering( GraphicsContext& Context )
 {
 	Context.TransitionResource(*this, D3D12_RESOURCE_STATE_DEPTH_WRITE, true);
 	Context.ClearDepth(*this);
+	BindTarget(Context);
+}
+
+void ShadowBuffer::BindTarget( GraphicsContext& Context )
+{
 	Context.SetDepthStencilTarget(GetDSV());
 	Context.SetViewportAndScissor(m_Viewport, m_Scissor);
 }
@@ -31,6 +31,8 @@ public:
 	D3D12_CPU_DESCRIPTOR_HANDLE GetSRV() const { return GetDepthSRV(); }
 
 	void BeginRendering( GraphicsContext& context );
+	// Binds the depth target, viewport and scissor without clearing or transitioning
+	void BindTarget( GraphicsContext& context );
 	void EndRendering( GraphicsContext& context );
 
 private:
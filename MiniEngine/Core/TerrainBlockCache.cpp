@@ -0,0 +1,418 @@
+#include "pch.h"
+#include "TerrainBlockCache.h"
+#include "TessTerrain.h"
+#include "Hash.h"
+#include "../3rdParty/zlib-win64/zlib.h"
+
+using Utility::HashBytes64;
+
+template<typename T>
+static UINT64 HashValue64(const T& Value, UINT64 Hash)
+{
+    return HashBytes64(&Value, sizeof(T), Hash);
+}
+
+static UINT64 HashString64(const CHAR* strString, UINT64 Hash)
+{
+    if (strString == nullptr)
+    {
+        return HashValue64((BYTE)0, Hash);
+    }
+    return HashBytes64(strString, strlen(strString) + 1, Hash);
+}
+
+static UINT64 HashString64(const WCHAR* strString, UINT64 Hash)
+{
+    if (strString == nullptr)
+    {
+        return HashValue64((WCHAR)0, Hash);
+    }
+    return HashBytes64(strString, (wcslen(strString) + 1) * sizeof(WCHAR), Hash);
+}
+
+UINT64 TerrainBlockCacheKey::GetHash() const
+{
+    return HashBytes64(this, sizeof(*this));
+}
+
+UINT64 TerrainBlockCache::HashModelFileName(const CHAR* strModelFileName)
+{
+    assert(strModelFileName != nullptr);
+    return HashBytes64(strModelFileName, strlen(strModelFileName));
+}
+
+TerrainBlockCache::TerrainBlockCache()
+    : m_MemoryBudgetBytes(0),
+      m_MemoryBytes(0),
+      m_hFile(INVALID_HANDLE_VALUE),
+      m_hMapping(nullptr),
+      m_pMappedData(nullptr),
+      m_MappedSizeBytes(0),
+      m_MaxDiskBytes(0)
+{
+    ZeroMemory(&m_Stats, sizeof(m_Stats));
+}
+
+TerrainBlockCache::~TerrainBlockCache()
+{
+    Terminate();
+}
+
+bool TerrainBlockCache::Initialize(const WCHAR* strFileName, SIZE_T MemoryBudgetBytes, UINT64 MaxDiskBytes)
+{
+    std::lock_guard<std::mutex> Lock(m_Mutex);
+
+    assert(MemoryBudgetBytes > 0);
+    m_MemoryBudgetBytes = MemoryBudgetBytes;
+    m_MaxDiskBytes = MaxDiskBytes;
+    ZeroMemory(&m_Stats, sizeof(m_Stats));
+
+    if (strFileName != nullptr && MaxDiskBytes > 0)
+    {
+        m_FileName = strFileName;
+        if (!OpenDiskTier())
+        {
+            // Keep running with the memory tier only; another process may own the file.
+            Utility::Printf(L"TerrainBlockCache: could not open \"%s\", disk tier disabled.\n", strFileName);
+            CloseDiskTier();
+        }
+    }
+
+    return true;
+}
+
+void TerrainBlockCache::Terminate()
+{
+    std::lock_guard<std::mutex> Lock(m_Mutex);
+
+    CloseDiskTier();
+    m_LRUList.clear();
+    m_MemoryMap.clear();
+    m_MemoryBytes = 0;
+    m_MemoryBudgetBytes = 0;
+}
+
+UINT64 TerrainBlockCache::HashConstructionDesc(const TerrainConstructionDesc* pDesc)
+{
+    UINT64 Hash = HashBytes64(&FileVersion, sizeof(FileVersion));
+    if (pDesc == nullptr)
+    {
+        return Hash;
+    }
+
+    Hash = HashValue64(pDesc->WaterLevelY, Hash);
+    Hash = HashValue64(pDesc->PlacementsPerBlock, Hash);
+
+    const UINT32 PlacementCount = (UINT32)pDesc->Placements.size();
+    Hash = HashValue64(PlacementCount, Hash);
+    for (UINT32 i = 0; i < PlacementCount; ++i)
+    {
+        const ObjectPlacementDesc* pOPD = pDesc->Placements[i];
+        Hash = HashString64((const WCHAR*)pOPD->Name, Hash);
+        Hash = HashValue64(pOPD->IsPrimaryPlacement, Hash);
+        Hash = HashString64(pOPD->strModelFileName, Hash);
+        Hash = HashValue64(pOPD->LogicID, Hash);
+        Hash = HashValue64(pOPD->MinRadius, Hash);
+        Hash = HashValue64(pOPD->MaxRadius, Hash);
+        Hash = HashValue64(pOPD->PriorityRatio, Hash);
+        Hash = HashValue64(pOPD->MinAltitude, Hash);
+        Hash = HashValue64(pOPD->MaxAltitude, Hash);
+        Hash = HashValue64(pOPD->PlaceOnHilltop, Hash);
+        Hash = HashValue64(pOPD->HilltopFilter, Hash);
+        Hash = HashValue64(pOPD->PlaceInValley, Hash);
+        Hash = HashValue64(pOPD->ValleyFilter, Hash);
+        Hash = HashValue64(pOPD->PlaceOnSlope, Hash);
+        Hash = HashValue64(pOPD->SlopeFilter, Hash);
+        Hash = HashValue64(pOPD->PlaceOnFlat, Hash);
+        Hash = HashValue64(pOPD->MinPropagations, Hash);
+        Hash = HashValue64(pOPD->MaxPropagations, Hash);
+
+        const UINT32 PropagateCount = (UINT32)pOPD->PropagateDescs.size();
+        Hash = HashValue64(PropagateCount, Hash);
+        for (UINT32 j = 0; j < PropagateCount; ++j)
+        {
+            const ObjectPropagationDesc* pPD = pOPD->PropagateDescs[j];
+            Hash = HashString64((const WCHAR*)pPD->PlacementName, Hash);
+            Hash = HashValue64(pPD->PriorityRatio, Hash);
+        }
+    }
+
+    return Hash;
+}
+
+bool TerrainBlockCache::Find(const TerrainBlockCacheKey& Key, std::vector<BYTE>& Data)
+{
+    std::lock_guard<std::mutex> Lock(m_Mutex);
+
+    if (!IsInitialized())
+    {
+        return false;
+    }
+
+    const UINT64 Hash = Key.GetHash();
+
+    auto MemIter = m_MemoryMap.find(Hash);
+    if (MemIter != m_MemoryMap.end() && MemIter->second->Key == Key)
+    {
+        // Move to the front of the LRU list
+        m_LRUList.splice(m_LRUList.begin(), m_LRUList, MemIter->second);
+        const MemoryRecord& MR = *MemIter->second;
+        if (Decompress(MR.CompressedData.data(), (UINT32)MR.CompressedData.size(), MR.UncompressedSize, Data))
+        {
+            ++m_Stats.MemoryHits;
+            return true;
+        }
+    }
+
+    auto DiskIter = m_DiskMap.find(Hash);
+    if (DiskIter != m_DiskMap.end())
+    {
+        const DiskRecordHeader* pDRH = (const DiskRecordHeader*)(m_pMappedData + DiskIter->second);
+        const BYTE* pCompressedData = (const BYTE*)(pDRH + 1);
+        if (pDRH->Key == Key && Decompress(pCompressedData, pDRH->CompressedSize, pDRH->UncompressedSize, Data))
+        {
+            AddMemoryRecord(Key, pCompressedData, pDRH->CompressedSize, pDRH->UncompressedSize);
+            ++m_Stats.DiskHits;
+            return true;
+        }
+    }
+
+    ++m_Stats.Misses;
+    return false;
+}
+
+void TerrainBlockCache::Insert(const TerrainBlockCacheKey& Key, const VOID* pData, SIZE_T SizeBytes)
+{
+    assert(SizeBytes <= UINT_MAX);
+
+    // Compress outside the lock; this is the expensive part
+    uLongf CompressedSize = compressBound((uLong)SizeBytes);
+    std::vector<BYTE> CompressedData(CompressedSize);
+    if (compress2(CompressedData.data(), &CompressedSize, (const Bytef*)pData, (uLong)SizeBytes, Z_BEST_SPEED) != Z_OK)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> Lock(m_Mutex);
+
+    if (!IsInitialized())
+    {
+        return;
+    }
+
+    ++m_Stats.Inserts;
+    AddMemoryRecord(Key, CompressedData.data(), (UINT32)CompressedSize, (UINT32)SizeBytes);
+
+    if (m_pMappedData != nullptr && m_DiskMap.find(Key.GetHash()) == m_DiskMap.end())
+    {
+        if (!AppendDiskRecord(Key, CompressedData.data(), (UINT32)CompressedSize, (UINT32)SizeBytes))
+        {
+            ++m_Stats.DiskWritesDropped;
+        }
+    }
+}
+
+TerrainBlockCacheStats TerrainBlockCache::GetStats() const
+{
+    std::lock_guard<std::mutex> Lock(m_Mutex);
+
+    TerrainBlockCacheStats Stats = m_Stats;
+    Stats.MemoryBytes = m_MemoryBytes;
+    Stats.MemoryRecordCount = (UINT32)m_MemoryMap.size();
+    Stats.DiskBytes = m_pMappedData != nullptr ? GetFileHeader()->UsedBytes : 0;
+    Stats.DiskRecordCount = (UINT32)m_DiskMap.size();
+    return Stats;
+}
+
+void TerrainBlockCache::PrintStats() const
+{
+    const TerrainBlockCacheStats Stats = GetStats();
+    Utility::Printf("TerrainBlockCache: hit rate %0.1f%% (%llu memory, %llu disk, %llu miss), %llu inserts, %llu evictions, %llu dropped writes\n",
+        Stats.GetHitRate() * 100.0f, Stats.MemoryHits, Stats.DiskHits, Stats.Misses, Stats.Inserts, Stats.MemoryEvictions, Stats.DiskWritesDropped);
+    Utility::Printf("TerrainBlockCache: memory %u records / %llu KB, disk %u records / %llu KB\n",
+        Stats.MemoryRecordCount, Stats.MemoryBytes / 1024, Stats.DiskRecordCount, Stats.DiskBytes / 1024);
+}
+
+bool TerrainBlockCache::OpenDiskTier()
+{
+    m_hFile = CreateFile2(m_FileName.c_str(), GENERIC_READ | GENERIC_WRITE, 0, OPEN_ALWAYS, nullptr);
+    if (m_hFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER FileSize = {};
+    if (!GetFileSizeEx(m_hFile, &FileSize))
+    {
+        return false;
+    }
+
+    const UINT64 MinimumSizeBytes = 1024 * 1024;
+    if (!MapDiskTier(std::max((UINT64)FileSize.QuadPart, MinimumSizeBytes)))
+    {
+        return false;
+    }
+
+    FileHeader* pHeader = GetFileHeader();
+    if (pHeader->Magic != FileMagic || pHeader->Version != FileVersion || pHeader->UsedBytes < sizeof(FileHeader) || pHeader->UsedBytes > m_MappedSizeBytes)
+    {
+        pHeader->Magic = FileMagic;
+        pHeader->Version = FileVersion;
+        pHeader->UsedBytes = sizeof(FileHeader);
+    }
+
+    IndexDiskTier();
+    return true;
+}
+
+void TerrainBlockCache::CloseDiskTier()
+{
+    UnmapDiskTier();
+    if (m_hFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+    m_DiskMap.clear();
+}
+
+bool TerrainBlockCache::MapDiskTier(UINT64 SizeBytes)
+{
+    assert(m_pMappedData == nullptr);
+
+    LARGE_INTEGER MappingSize;
+    MappingSize.QuadPart = SizeBytes;
+    m_hMapping = CreateFileMapping(m_hFile, nullptr, PAGE_READWRITE, MappingSize.HighPart, MappingSize.LowPart, nullptr);
+    if (m_hMapping == nullptr)
+    {
+        return false;
+    }
+
+    m_pMappedData = (BYTE*)MapViewOfFile(m_hMapping, FILE_MAP_ALL_ACCESS, 0, 0, (SIZE_T)SizeBytes);
+    if (m_pMappedData == nullptr)
+    {
+        CloseHandle(m_hMapping);
+        m_hMapping = nullptr;
+        return false;
+    }
+
+    m_MappedSizeBytes = SizeBytes;
+    return true;
+}
+
+void TerrainBlockCache::UnmapDiskTier()
+{
+    if (m_pMappedData != nullptr)
+    {
+        FlushViewOfFile(m_pMappedData, 0);
+        UnmapViewOfFile(m_pMappedData);
+        m_pMappedData = nullptr;
+    }
+    if (m_hMapping != nullptr)
+    {
+        CloseHandle(m_hMapping);
+        m_hMapping = nullptr;
+    }
+    m_MappedSizeBytes = 0;
+}
+
+void TerrainBlockCache::IndexDiskTier()
+{
+    m_DiskMap.clear();
+
+    FileHeader* pHeader = GetFileHeader();
+    UINT64 Offset = sizeof(FileHeader);
+    while (Offset + sizeof(DiskRecordHeader) <= pHeader->UsedBytes)
+    {
+        const DiskRecordHeader* pDRH = (const DiskRecordHeader*)(m_pMappedData + Offset);
+        const UINT64 RecordSize = Math::AlignUp(sizeof(DiskRecordHeader) + pDRH->CompressedSize, 8);
+        if (pDRH->CompressedSize == 0 || Offset + RecordSize > pHeader->UsedBytes)
+        {
+            // Torn write from a previous run; drop everything past this point
+            break;
+        }
+        m_DiskMap[pDRH->Key.GetHash()] = Offset;
+        Offset += RecordSize;
+    }
+    pHeader->UsedBytes = Offset;
+}
+
+bool TerrainBlockCache::AppendDiskRecord(const TerrainBlockCacheKey& Key, const BYTE* pCompressedData, UINT32 CompressedSize, UINT32 UncompressedSize)
+{
+    const UINT64 RecordSize = Math::AlignUp(sizeof(DiskRecordHeader) + CompressedSize, 8);
+    const UINT64 Offset = GetFileHeader()->UsedBytes;
+    const UINT64 RequiredSize = Offset + RecordSize;
+
+    if (RequiredSize > m_MaxDiskBytes)
+    {
+        return false;
+    }
+
+    if (RequiredSize > m_MappedSizeBytes)
+    {
+        const UINT64 NewSize = std::min(std::max(m_MappedSizeBytes * 2, RequiredSize), m_MaxDiskBytes);
+        UnmapDiskTier();
+        if (!MapDiskTier(NewSize))
+        {
+            CloseDiskTier();
+            return false;
+        }
+    }
+
+    DiskRecordHeader* pDRH = (DiskRecordHeader*)(m_pMappedData + Offset);
+    memcpy(pDRH + 1, pCompressedData, CompressedSize);
+    pDRH->Key = Key;
+    pDRH->CompressedSize = CompressedSize;
+    pDRH->UncompressedSize = UncompressedSize;
+    GetFileHeader()->UsedBytes = RequiredSize;
+
+    m_DiskMap[Key.GetHash()] = Offset;
+    return true;
+}
+
+void TerrainBlockCache::AddMemoryRecord(const TerrainBlockCacheKey& Key, const BYTE* pCompressedData, UINT32 CompressedSize, UINT32 UncompressedSize)
+{
+    const UINT64 Hash = Key.GetHash();
+
+    auto iter = m_MemoryMap.find(Hash);
+    if (iter != m_MemoryMap.end())
+    {
+        m_MemoryBytes -= iter->second->CompressedData.size();
+        m_LRUList.erase(iter->second);
+        m_MemoryMap.erase(iter);
+    }
+
+    MemoryRecord MR;
+    MR.Key = Key;
+    MR.UncompressedSize = UncompressedSize;
+    MR.CompressedData.assign(pCompressedData, pCompressedData + CompressedSize);
+    m_LRUList.push_front(std::move(MR));
+    m_MemoryMap[Hash] = m_LRUList.begin();
+    m_MemoryBytes += CompressedSize;
+
+    TrimMemoryTier();
+}
+
+void TerrainBlockCache::TrimMemoryTier()
+{
+    while (m_MemoryBytes > m_MemoryBudgetBytes && m_LRUList.size() > 1)
+    {
+        const MemoryRecord& MR = m_LRUList.back();
+        m_MemoryBytes -= MR.CompressedData.size();
+        m_MemoryMap.erase(MR.Key.GetHash());
+        m_LRUList.pop_back();
+        ++m_Stats.MemoryEvictions;
+    }
+}
+
+bool TerrainBlockCache::Decompress(const BYTE* pCompressedData, UINT32 CompressedSize, UINT32 UncompressedSize, std::vector<BYTE>& Data)
+{
+    Data.resize(UncompressedSize);
+    uLongf DestSize = UncompressedSize;
+    if (uncompress(Data.data(), &DestSize, pCompressedData, CompressedSize) != Z_OK || DestSize != UncompressedSize)
+    {
+        Data.clear();
+        return false;
+    }
+    return true;
+}
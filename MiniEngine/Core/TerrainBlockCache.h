@@ -0,0 +1,135 @@
+#pragma once
+
+#include <unordered_map>
+#include <list>
+#include <vector>
+#include <mutex>
+
+struct TerrainConstructionDesc;
+
+enum TerrainBlockRecordType
+{
+    TBRT_Heightfield = 1,
+    TBRT_ObjectPlacements = 2,
+};
+
+// Identifies one generated block.  The coordinate alone is not enough; the same
+// coordinate means different things at different block scales, and any change to
+// the construction desc or seed invalidates everything generated from it.
+struct TerrainBlockCacheKey
+{
+    UINT64 CoordHash;
+    UINT64 RandomSeed;
+    UINT64 DescHash;
+    FLOAT BlockWorldScale;
+    UINT32 RecordType;
+
+    UINT64 GetHash() const;
+    bool operator==(const TerrainBlockCacheKey& RHS) const { return memcmp(this, &RHS, sizeof(*this)) == 0; }
+};
+
+struct TerrainBlockCacheStats
+{
+    UINT64 MemoryHits;
+    UINT64 DiskHits;
+    UINT64 Misses;
+    UINT64 Inserts;
+    UINT64 MemoryEvictions;
+    UINT64 DiskWritesDropped;
+    UINT64 MemoryBytes;
+    UINT64 DiskBytes;
+    UINT32 MemoryRecordCount;
+    UINT32 DiskRecordCount;
+
+    FLOAT GetHitRate() const
+    {
+        const UINT64 Lookups = MemoryHits + DiskHits + Misses;
+        return Lookups > 0 ? (FLOAT)(MemoryHits + DiskHits) / (FLOAT)Lookups : 0.0f;
+    }
+};
+
+// Compressed cache of generated terrain block data.  Records live in a bounded LRU
+// tier in memory, backed by an append-only memory-mapped file that persists across
+// runs.  The file is opened exclusively, so each process needs its own.  All methods
+// are safe to call from multiple threads.
+class TerrainBlockCache
+{
+private:
+    static const UINT32 FileMagic = 0x43425454; // 'TTBC'
+    static const UINT32 FileVersion = 2;
+
+    struct FileHeader
+    {
+        UINT32 Magic;
+        UINT32 Version;
+        UINT64 UsedBytes;
+    };
+
+    struct DiskRecordHeader
+    {
+        TerrainBlockCacheKey Key;
+        UINT32 CompressedSize;
+        UINT32 UncompressedSize;
+    };
+
+    struct MemoryRecord
+    {
+        TerrainBlockCacheKey Key;
+        UINT32 UncompressedSize;
+        std::vector<BYTE> CompressedData;
+    };
+
+    typedef std::list<MemoryRecord> MemoryRecordList;
+    typedef std::unordered_map<UINT64, MemoryRecordList::iterator> MemoryRecordMap;
+    typedef std::unordered_map<UINT64, UINT64> DiskRecordMap;
+
+    mutable std::mutex m_Mutex;
+
+    MemoryRecordList m_LRUList;
+    MemoryRecordMap m_MemoryMap;
+    SIZE_T m_MemoryBudgetBytes;
+    SIZE_T m_MemoryBytes;
+
+    DiskRecordMap m_DiskMap;
+    std::wstring m_FileName;
+    HANDLE m_hFile;
+    HANDLE m_hMapping;
+    BYTE* m_pMappedData;
+    UINT64 m_MappedSizeBytes;
+    UINT64 m_MaxDiskBytes;
+
+    TerrainBlockCacheStats m_Stats;
+
+public:
+    TerrainBlockCache();
+    ~TerrainBlockCache();
+
+    bool Initialize(const WCHAR* strFileName, SIZE_T MemoryBudgetBytes, UINT64 MaxDiskBytes);
+    void Terminate();
+    bool IsInitialized() const { return m_MemoryBudgetBytes > 0; }
+
+    static UINT64 HashConstructionDesc(const TerrainConstructionDesc* pDesc);
+
+    // Model indices are assigned in load order, so records name models by file instead
+    static UINT64 HashModelFileName(const CHAR* strModelFileName);
+
+    bool Find(const TerrainBlockCacheKey& Key, std::vector<BYTE>& Data);
+    void Insert(const TerrainBlockCacheKey& Key, const VOID* pData, SIZE_T SizeBytes);
+
+    TerrainBlockCacheStats GetStats() const;
+    void PrintStats() const;
+
+private:
+    bool OpenDiskTier();
+    void CloseDiskTier();
+    bool MapDiskTier(UINT64 SizeBytes);
+    void UnmapDiskTier();
+    void IndexDiskTier();
+    bool AppendDiskRecord(const TerrainBlockCacheKey& Key, const BYTE* pCompressedData, UINT32 CompressedSize, UINT32 UncompressedSize);
+    FileHeader* GetFileHeader() const { return (FileHeader*)m_pMappedData; }
+
+    void AddMemoryRecord(const TerrainBlockCacheKey& Key, const BYTE* pCompressedData, UINT32 CompressedSize, UINT32 UncompressedSize);
+    void TrimMemoryTier();
+
+    static bool Decompress(const BYTE* pCompressedData, UINT32 CompressedSize, UINT32 UncompressedSize, std::vector<BYTE>& Data);
+};
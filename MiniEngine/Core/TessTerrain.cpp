@@ -255,6 +255,7 @@ TessellatedTerrain::TessellatedTerrain()
     }
 
     ZeroMemory(m_pTileRings, sizeof(m_pTileRings));
+    m_hColorNoiseSRV.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
 }
 
 void TessellatedTerrain::CreateDefaultConstructionDesc(TerrainConstructionDesc* pDesc)
@@ -325,6 +326,11 @@ void TessellatedTerrain::Terminate()
     m_TileTriStripIB.Destroy();
     m_TileQuadListIB.Destroy();
     m_ColorNoiseTexture.Destroy();
+    if (m_hColorNoiseSRV.ptr != D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN)
+    {
+        Graphics::FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, m_hColorNoiseSRV);
+        m_hColorNoiseSRV.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
+    }
 
     m_PhysicsHeightMap.Destroy();
     m_PhysicsZoneMap.Destroy();
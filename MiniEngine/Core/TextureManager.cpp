@@ -18,11 +18,19 @@
 #include "DDSTextureLoader.h"
 #include "GraphicsCore.h"
 #include "CommandContext.h"
-#include <map>
+#include "SystemTime.h"
+#include "Hash.h"
+#include "EngineTuning.h"
+#include "TiledResources.h"
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <unordered_map>
 
 using namespace std;
 using namespace Graphics;
+using Microsoft::WRL::ComPtr;
 
 static UINT BytesPerPixel( DXGI_FORMAT Format )
 {
@@ -66,6 +74,8 @@ void Texture::Create( size_t Width, size_t Height, DXGI_FORMAT Format, const voi
 
 	if (m_hCpuDescriptorHandle.ptr == D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN)
 		m_hCpuDescriptorHandle = AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+	else
+		DescriptorAllocator::InvalidateCopies();
 	g_Device->CreateShaderResourceView(m_pResource.Get(), nullptr, m_hCpuDescriptorHandle);
 }
 
@@ -125,6 +135,8 @@ bool Texture::CreateDDSFromMemory( const void* filePtr, size_t fileSize, bool sR
 {
 	if (m_hCpuDescriptorHandle.ptr == D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN)
 		m_hCpuDescriptorHandle = AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+	else
+		DescriptorAllocator::InvalidateCopies();
 
 	HRESULT hr = CreateDDSTextureFromMemory( Graphics::g_Device,
 		(const uint8_t*)filePtr, fileSize, 0, sRGB, &m_pResource, m_hCpuDescriptorHandle );
@@ -132,10 +144,875 @@ bool Texture::CreateDDSFromMemory( const void* filePtr, size_t fileSize, bool sR
 	return SUCCEEDED(hr);
 }
 
+// Insert-only open addressing table keyed by a hash of the file name, split into shards
+// like the pipeline state table.  A slot goes from null to a texture exactly once, so
+// lookups and inserts need no lock.  Textures that do not fit in their shard go to a
+// locked overflow map, so a lookup never fails.
+class TextureTable
+{
+public:
+	TextureTable()
+	{
+		for (UINT32 i = 0; i < kShardCount; ++i)
+			for (UINT32 j = 0; j < kSlotsPerShard; ++j)
+				m_Shards[i].Slots[j].store(nullptr, memory_order_relaxed);
+	}
+
+	// Returns the texture for FileName, creating it if needed.  *pInserted is set for the
+	// one caller whose texture was published, which then owns loading it.
+	ManagedTexture* FindOrInsert( const wstring& FileName, bool* pInserted )
+	{
+		const uint64_t HashCode = Utility::HashBytes64(FileName.data(), FileName.size() * sizeof(wchar_t));
+		Shard& S = m_Shards[HashCode & (kShardCount - 1)];
+		const uint64_t FirstSlot = HashCode / kShardCount;
+
+		ManagedTexture* pNewTexture = nullptr;
+		for (UINT32 Probe = 0; Probe < kSlotsPerShard; ++Probe)
+		{
+			atomic<ManagedTexture*>& Slot = S.Slots[(FirstSlot + Probe) & (kSlotsPerShard - 1)];
+			ManagedTexture* pTexture = Slot.load(memory_order_acquire);
+			if (pTexture == nullptr)
+			{
+				if (pNewTexture == nullptr)
+					pNewTexture = new ManagedTexture(FileName);
+
+				if (Slot.compare_exchange_strong(pTexture, pNewTexture, memory_order_acq_rel))
+				{
+					*pInserted = true;
+					return pNewTexture;
+				}
+				// Lost the race; pTexture now holds the winner
+			}
+
+			if (pTexture->GetName() == FileName)
+			{
+				delete pNewTexture;
+				*pInserted = false;
+				return pTexture;
+			}
+		}
+
+		delete pNewTexture;
+
+		lock_guard<mutex> Lock(m_OverflowMutex);
+		ManagedTexture*& pTexture = m_Overflow[FileName];
+		*pInserted = (pTexture == nullptr);
+		if (pTexture == nullptr)
+			pTexture = new ManagedTexture(FileName);
+		return pTexture;
+	}
+
+	// Not thread safe; streaming must be stopped
+	void DestroyAll( void )
+	{
+		for (UINT32 i = 0; i < kShardCount; ++i)
+			for (UINT32 j = 0; j < kSlotsPerShard; ++j)
+				delete m_Shards[i].Slots[j].exchange(nullptr);
+
+		for (auto& Iter : m_Overflow)
+			delete Iter.second;
+		m_Overflow.clear();
+	}
+
+private:
+	static const UINT32 kShardCount = 16;
+	static const UINT32 kSlotsPerShard = 512;
+
+	struct Shard
+	{
+		__declspec(align(64)) atomic<ManagedTexture*> Slots[kSlotsPerShard];
+	};
+
+	Shard m_Shards[kShardCount];
+
+	mutex m_OverflowMutex;
+	unordered_map<wstring, ManagedTexture*> m_Overflow;
+};
+
+struct TextureStreamingStats
+{
+	UINT32 QueuedCount;
+	UINT32 LoadedCount;
+	UINT32 FailedCount;
+	UINT32 VisibleFirstCount;
+	UINT32 WaitCount;
+	UINT64 BytesRead;
+	DOUBLE QueueMsec;
+	DOUBLE ReadMsec;
+	DOUBLE CreateMsec;
+	DOUBLE WaitMsec;
+
+	// Mip streaming
+	UINT32 StreamedCount;
+	UINT32 MipLoadCount;
+	UINT32 MipEvictCount;
+	UINT32 MipFailedCount;
+	UINT64 MipBytesRead;
+	UINT64 ResidentBytes;
+	UINT64 PeakResidentBytes;
+};
+
+namespace TextureManager
+{
+	BoolVar s_StreamMips("Graphics/Texture Streaming/Stream Mips", true);
+	IntVar s_MipTailSize("Graphics/Texture Streaming/Mip Tail Size", 128, 16, 2048, 16);
+	IntVar s_BudgetMB("Graphics/Texture Streaming/Budget (MB)", 512, 16, 16384, 16);
+	NumVar s_TexelsPerPixel("Graphics/Texture Streaming/Texels Per Pixel", 1.0f, 0.125f, 8.0f, 0.125f);
+	IntVar s_IdleFrames("Graphics/Texture Streaming/Idle Frames", 120, 1, 100000, 10);
+}
+
+// Mip residency of a 2D texture whose detailed mips stream.  The texture is a reserved
+// resource with its whole chain; the mip tail is mapped when it loads, and each more
+// detailed mip has tiles from the streamer's pool mapped only while it is resident.  Only
+// the frame thread changes the residency fields, and only while no job is in flight for
+// the texture.
+struct StreamedMips
+{
+	DDSLayout Layout;
+	wstring FilePath;
+	DXGI_FORMAT Format;			// sRGB applied
+	TiledTextureBuffer Buffer;
+	uint32_t TailMip;			// Loaded with the texture and never evicted
+	uint32_t ResidentMip;		// Most detailed mip the view shows
+	uint32_t TargetMip;			// Most detailed mip once the job in flight completes
+	uint32_t DesiredMip;
+	uint64_t DesiredFrame;		// When a resolution was last requested
+	uint64_t PublishFrame;
+	bool HasFeedback;			// Whether anything has requested a resolution
+
+	// Written by the reader thread running the job, read once it completes
+	bool Uploaded;
+
+	bool IsBusy( void ) const { return TargetMip != ResidentMip; }
+
+	// Bytes of the tiles mapped with this mip resident
+	uint64_t GetChainSize( uint32_t FirstMip ) const
+	{
+		return (uint64_t)Buffer.GetMipChainTileCount(FirstMip) * D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES;
+	}
+};
+
+// Bounded pool of reader threads that read DDS files and create their textures.  Textures
+// marked visible since they were queued are served first, most recently seen first; the
+// rest load in request order.  Finished textures are handed back to TextureManager::Update()
+// so their views are written on the frame thread.  The same threads upload the mips that
+// streamed textures gain.
+class TextureStreamer
+{
+public:
+	TextureStreamer() : m_PendingCount(0), m_Sequence(0), m_Exit(false) { ZeroMemory(&m_Stats, sizeof(m_Stats)); }
+	~TextureStreamer() { Shutdown(); }
+
+	// Points the texture's SRV at the placeholder and queues the file.  With StreamMips,
+	// large 2D textures load only their mip tail.  If the file cannot be loaded and a
+	// FallbackTGAPath is given, that file is read instead.
+	void Enqueue( ManagedTexture* pTexture, const wstring& FilePath, bool sRGB, bool StreamMips,
+		D3D12_CPU_DESCRIPTOR_HANDLE PlaceholderSRV, const wstring& FallbackTGAPath = wstring() )
+	{
+		pTexture->m_hCpuDescriptorHandle = AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+		g_Device->CopyDescriptorsSimple(1, pTexture->m_hCpuDescriptorHandle, PlaceholderSRV, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+		LoadRequest Request;
+		Request.Kind = kLoadTexture;
+		Request.FilePath = FilePath;
+		Request.FallbackTGAPath = FallbackTGAPath;
+		Request.sRGB = sRGB;
+		Request.StreamMips = StreamMips;
+		Request.TailSize = (uint32_t)(int32_t)TextureManager::s_MipTailSize;
+		Request.EnqueueTick = SystemTime::GetCurrentTick();
+
+		{
+			lock_guard<mutex> Lock(m_Mutex);
+			StartThreads();
+			m_Requests[pTexture] = std::move(Request);
+			PushJob(pTexture, pTexture->m_LastVisibleFrame.load(memory_order_relaxed));
+			++m_PendingCount;
+			++m_Stats.QueuedCount;
+			pTexture->m_LoadState.store(ManagedTexture::kLoadQueued, memory_order_release);
+		}
+		m_WorkAvailable.notify_one();
+		m_StateChanged.notify_all();
+	}
+
+	// Queues the texture again at a higher priority.  The older job is dropped when popped.
+	void Reprioritize( ManagedTexture* pTexture, uint64_t VisibleFrame )
+	{
+		lock_guard<mutex> Lock(m_Mutex);
+		if (m_Requests.find(pTexture) != m_Requests.end())
+			PushJob(pTexture, VisibleFrame);
+	}
+
+	void SetState( ManagedTexture* pTexture, uint32_t State )
+	{
+		{
+			lock_guard<mutex> Lock(m_Mutex);
+			pTexture->m_LoadState.store(State, memory_order_release);
+		}
+		m_StateChanged.notify_all();
+	}
+
+	void WaitForState( const ManagedTexture* pTexture, uint32_t State )
+	{
+		if (pTexture->m_LoadState.load(memory_order_acquire) >= State)
+			return;
+
+		const int64_t StartTick = SystemTime::GetCurrentTick();
+
+		unique_lock<mutex> Lock(m_Mutex);
+		m_StateChanged.wait(Lock, [pTexture, State]() { return pTexture->m_LoadState.load(memory_order_acquire) >= State; });
+
+		++m_Stats.WaitCount;
+		m_Stats.WaitMsec += SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - StartTick);
+	}
+
+	void WaitForAll( void )
+	{
+		unique_lock<mutex> Lock(m_Mutex);
+		m_StateChanged.wait(Lock, [this]() { return m_PendingCount == 0; });
+	}
+
+	// Writes the views of the textures created and the mip chains changed since the last
+	// call; returns how many.
+	UINT32 PublishCompleted( void )
+	{
+		vector<ManagedTexture*> Completed;
+		vector<ManagedTexture*> MipChanges;
+		unordered_map<const ManagedTexture*, TGAFallback> Fallbacks;
+		{
+			lock_guard<mutex> Lock(m_Mutex);
+			Completed.swap(m_Completed);
+			MipChanges.swap(m_CompletedMipChanges);
+			Fallbacks.swap(m_TGAFallbacks);
+		}
+		if (Completed.empty() && MipChanges.empty())
+			return 0;
+
+		for (ManagedTexture* pTexture : MipChanges)
+		{
+			StreamedMips& Mips = *pTexture->m_pStreamedMips;
+			if (Mips.Uploaded)
+			{
+				Mips.ResidentMip = Mips.TargetMip;
+				CreateMipView(Mips, pTexture->m_hCpuDescriptorHandle);
+			}
+			else
+			{
+				// Keep what is resident; the next Update may try again
+				UnmapMips(Mips, Mips.TargetMip, Mips.ResidentMip);
+				Mips.TargetMip = Mips.ResidentMip;
+			}
+		}
+
+		for (ManagedTexture* pTexture : Completed)
+		{
+			auto Fallback = Fallbacks.find(pTexture);
+			if (Fallback != Fallbacks.end())
+			{
+				// Created here rather than on the reader thread because it writes the texture's
+				// own SRV, which is only changed on the frame thread
+				const TGAFallback& TGA = Fallback->second;
+				pTexture->CreateTGAFromMemory(TGA.Data->data(), TGA.Data->size(), TGA.sRGB);
+				pTexture->GetResource()->SetName(pTexture->m_MapKey.c_str());
+			}
+			else
+			{
+				pTexture->PublishLoadedView();
+			}
+			if (pTexture->m_pStreamedMips != nullptr)
+			{
+				pTexture->m_pStreamedMips->PublishFrame = Graphics::GetFrameCount() + 1;
+				m_Streamed.push_back(pTexture);
+			}
+		}
+
+		{
+			lock_guard<mutex> Lock(m_Mutex);
+			for (ManagedTexture* pTexture : Completed)
+				pTexture->m_LoadState.store(ManagedTexture::kLoadReady, memory_order_release);
+		}
+		m_StateChanged.notify_all();
+		return (UINT32)(Completed.size() + MipChanges.size());
+	}
+
+	// Turns this frame's resolution requests into desired mips, evicts the least recently
+	// requested detail while over budget and queues loads that fit in what remains.
+	void UpdateResidency( void )
+	{
+		if (m_Streamed.empty())
+			return;
+
+		{
+			lock_guard<mutex> Lock(m_TileMutex);
+			m_TilePool.ReleaseEmptySlabs();
+		}
+
+		const uint64_t Frame = Graphics::GetFrameCount() + 1;
+		const uint64_t IdleFrames = (uint64_t)(int32_t)TextureManager::s_IdleFrames;
+		const float TexelsPerPixel = TextureManager::s_TexelsPerPixel;
+		const uint64_t Budget = (uint64_t)(int32_t)TextureManager::s_BudgetMB * 1024 * 1024;
+
+		// Committed bytes count the tiles mapped for a load in flight
+		uint64_t ResidentBytes = 0;
+		uint64_t CommittedBytes = 0;
+		m_LoadCandidates.clear();
+		m_EvictCandidates.clear();
+		for (ManagedTexture* pTexture : m_Streamed)
+		{
+			StreamedMips& Mips = *pTexture->m_pStreamedMips;
+
+			const uint32_t Pixels = pTexture->m_RequestedPixels.exchange(0, memory_order_relaxed);
+			if (Pixels > 0)
+			{
+				Mips.DesiredMip = GetDesiredMip(Mips, Pixels * TexelsPerPixel);
+				Mips.DesiredFrame = Frame;
+				Mips.HasFeedback = true;
+			}
+			else if (!Mips.HasFeedback)
+			{
+				// Nothing reports sizes for this texture (terrain, particles), so once renderers
+				// have had a few frames to do so, all of it is wanted
+				if (Frame - Mips.PublishFrame > kFeedbackFrames)
+				{
+					Mips.DesiredMip = 0;
+					Mips.DesiredFrame = Frame;
+				}
+			}
+			else if (Frame - Mips.DesiredFrame > IdleFrames)
+			{
+				Mips.DesiredMip = Mips.TailMip;
+			}
+
+			ResidentBytes += Mips.GetChainSize(Mips.ResidentMip);
+			CommittedBytes += Mips.GetChainSize(std::min(Mips.ResidentMip, Mips.TargetMip));
+
+			if (Mips.IsBusy())
+				continue;
+			if (Mips.DesiredMip < Mips.ResidentMip)
+				m_LoadCandidates.push_back(pTexture);
+			else if (Mips.ResidentMip < Mips.TailMip)
+				m_EvictCandidates.push_back(pTexture);
+		}
+		m_Stats.ResidentBytes = ResidentBytes;
+		m_Stats.PeakResidentBytes = std::max(m_Stats.PeakResidentBytes, ResidentBytes);
+
+		// Least recently requested first; detail beyond the desired mip goes before detail
+		// that is still wanted
+		if (CommittedBytes > Budget && !m_EvictCandidates.empty())
+		{
+			sort(m_EvictCandidates.begin(), m_EvictCandidates.end(), []( const ManagedTexture* A, const ManagedTexture* B )
+			{
+				return A->m_pStreamedMips->DesiredFrame < B->m_pStreamedMips->DesiredFrame;
+			});
+
+			for (UINT32 Pass = 0; Pass < 2 && CommittedBytes > Budget; ++Pass)
+			{
+				for (ManagedTexture* pTexture : m_EvictCandidates)
+				{
+					if (CommittedBytes <= Budget)
+						break;
+
+					StreamedMips& Mips = *pTexture->m_pStreamedMips;
+					if (Mips.IsBusy())
+						continue;
+
+					const uint32_t NewMip = Pass == 0 ? Mips.DesiredMip : Mips.ResidentMip + 1;
+					if (NewMip <= Mips.ResidentMip)
+						continue;
+
+					CommittedBytes -= Mips.GetChainSize(Mips.ResidentMip) - Mips.GetChainSize(NewMip);
+					EvictMips(pTexture, NewMip);
+				}
+			}
+		}
+
+		// Most recently requested first, then the largest shortfall
+		sort(m_LoadCandidates.begin(), m_LoadCandidates.end(), []( const ManagedTexture* A, const ManagedTexture* B )
+		{
+			const StreamedMips& MA = *A->m_pStreamedMips;
+			const StreamedMips& MB = *B->m_pStreamedMips;
+			if (MA.DesiredFrame != MB.DesiredFrame)
+				return MA.DesiredFrame > MB.DesiredFrame;
+			return MA.ResidentMip - MA.DesiredMip > MB.ResidentMip - MB.DesiredMip;
+		});
+
+		for (ManagedTexture* pTexture : m_LoadCandidates)
+		{
+			StreamedMips& Mips = *pTexture->m_pStreamedMips;
+			const uint64_t Growth = Mips.GetChainSize(Mips.DesiredMip) - Mips.GetChainSize(Mips.ResidentMip);
+			if (CommittedBytes + Growth > Budget)
+				continue;
+
+			if (QueueMipLoad(pTexture, Mips.DesiredMip, Mips.DesiredFrame))
+				CommittedBytes += Growth;
+		}
+	}
+
+	// Abandons queued loads and waits for those in flight.  The GPU must be idle.
+	void Shutdown( void )
+	{
+		{
+			lock_guard<mutex> Lock(m_Mutex);
+			m_Exit = true;
+		}
+		m_WorkAvailable.notify_all();
+
+		for (auto& T : m_Threads)
+			T.join();
+		m_Threads.clear();
+
+		lock_guard<mutex> Lock(m_Mutex);
+		m_Jobs = priority_queue<LoadJob, vector<LoadJob>, LoadJobOrder>();
+		m_Requests.clear();
+		m_TGAFallbacks.clear();
+		m_PendingCount = 0;
+		m_Streamed.clear();
+
+		{
+			lock_guard<mutex> TileLock(m_TileMutex);
+			for (auto& pMips : m_StreamedMips)
+				m_TilePool.FreeTiledTextureTiles(&pMips->Buffer);
+			m_TilePool.Terminate();
+		}
+		m_StreamedMips.clear();
+	}
+
+	TextureStreamingStats GetStats( UINT32* pPendingCount )
+	{
+		lock_guard<mutex> Lock(m_Mutex);
+		*pPendingCount = m_PendingCount;
+		TextureStreamingStats Stats = m_Stats;
+		Stats.StreamedCount = (UINT32)m_StreamedMips.size();
+		return Stats;
+	}
+
+private:
+	static const UINT32 kMaxReaderCount = 4;
+	static const uint64_t kFeedbackFrames = 4;
+	static const UINT32 kMaxTileSlabs = 256;	// 64 MB each
+
+	enum RequestKind
+	{
+		kLoadTexture,
+		kLoadMips
+	};
+
+	struct LoadRequest
+	{
+		RequestKind Kind;
+		wstring FilePath;
+		wstring FallbackTGAPath;
+		bool sRGB;
+		bool StreamMips;
+		uint32_t TailSize;
+		uint32_t TargetMip;
+		int64_t EnqueueTick;
+	};
+
+	// A TGA read after its DDS could not be loaded, created by PublishCompleted()
+	struct TGAFallback
+	{
+		Utility::ByteArray Data;
+		bool sRGB;
+	};
+
+	struct LoadJob
+	{
+		ManagedTexture* pTexture;
+		uint64_t VisibleFrame;
+		uint64_t Sequence;
+	};
+
+	struct LoadJobOrder
+	{
+		bool operator()( const LoadJob& A, const LoadJob& B ) const
+		{
+			if (A.VisibleFrame != B.VisibleFrame)
+				return A.VisibleFrame < B.VisibleFrame;
+			return A.Sequence > B.Sequence;
+		}
+	};
+
+	// Requires m_Mutex
+	void StartThreads( void )
+	{
+		if (!m_Threads.empty())
+			return;
+
+		{
+			lock_guard<mutex> TileLock(m_TileMutex);
+			m_TilePool.Initialize(0, 0, kMaxTileSlabs);
+		}
+
+		const UINT32 ThreadCount = std::max(1u, std::min(thread::hardware_concurrency() / 2, kMaxReaderCount));
+		m_Exit = false;
+		for (UINT32 i = 0; i < ThreadCount; ++i)
+			m_Threads.emplace_back(&TextureStreamer::ReaderThread, this);
+	}
+
+	// Requires m_Mutex
+	void PushJob( ManagedTexture* pTexture, uint64_t VisibleFrame )
+	{
+		LoadJob Job;
+		Job.pTexture = pTexture;
+		Job.VisibleFrame = VisibleFrame;
+		Job.Sequence = m_Sequence++;
+		m_Jobs.push(Job);
+	}
+
+	// Frame thread only.  Maps the mips gained and queues their upload; returns false if the
+	// pool has no room for them.
+	bool QueueMipLoad( ManagedTexture* pTexture, uint32_t NewMip, uint64_t Priority )
+	{
+		StreamedMips& Mips = *pTexture->m_pStreamedMips;
+		if (!MapMips(Mips, NewMip, Mips.ResidentMip))
+		{
+			lock_guard<mutex> Lock(m_Mutex);
+			++m_Stats.MipFailedCount;
+			return false;
+		}
+		Mips.TargetMip = NewMip;
+
+		LoadRequest Request;
+		Request.Kind = kLoadMips;
+		Request.TargetMip = NewMip;
+		Request.EnqueueTick = SystemTime::GetCurrentTick();
+
+		{
+			lock_guard<mutex> Lock(m_Mutex);
+			m_Requests[pTexture] = std::move(Request);
+			PushJob(pTexture, Priority);
+		}
+		m_WorkAvailable.notify_one();
+		return true;
+	}
+
+	// Frame thread only.  The view stops showing the evicted mips before their tiles are
+	// unmapped; the unmapping is queued after the frames already submitted, which may still
+	// sample them.
+	void EvictMips( ManagedTexture* pTexture, uint32_t NewMip )
+	{
+		StreamedMips& Mips = *pTexture->m_pStreamedMips;
+		const uint32_t OldMip = Mips.ResidentMip;
+		Mips.ResidentMip = NewMip;
+		Mips.TargetMip = NewMip;
+		CreateMipView(Mips, pTexture->m_hCpuDescriptorHandle);
+		UnmapMips(Mips, OldMip, NewMip);
+
+		lock_guard<mutex> Lock(m_Mutex);
+		++m_Stats.MipEvictCount;
+	}
+
+	static ID3D12CommandQueue* GetTileMappingQueue( void )
+	{
+		// Uploads go through the same queue, so they see the tiles mapped before them
+		return g_CommandManager.GetQueue(D3D12_COMMAND_LIST_TYPE_DIRECT).GetCommandQueue();
+	}
+
+	// Maps mips FirstMip up to EndMip, all or none
+	bool MapMips( StreamedMips& Mips, uint32_t FirstMip, uint32_t EndMip )
+	{
+		lock_guard<mutex> Lock(m_TileMutex);
+		const UINT32 TileCount = Mips.Buffer.GetMipChainTileCount(FirstMip) - Mips.Buffer.GetMipChainTileCount(EndMip);
+		if (m_TilePool.GetTileGroupCount(TileCount) > m_TilePool.GetFreeTileGroupCount())
+			return false;
+
+		for (uint32_t Mip = FirstMip; Mip < EndMip; ++Mip)
+		{
+			if (!m_TilePool.MapTiledTextureSubresource(GetTileMappingQueue(), &Mips.Buffer, Mip))
+			{
+				for (uint32_t MappedMip = FirstMip; MappedMip < Mip; ++MappedMip)
+					m_TilePool.UnmapTiledTextureSubresource(GetTileMappingQueue(), &Mips.Buffer, MappedMip);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void UnmapMips( StreamedMips& Mips, uint32_t FirstMip, uint32_t EndMip )
+	{
+		lock_guard<mutex> Lock(m_TileMutex);
+		for (uint32_t Mip = FirstMip; Mip < EndMip; ++Mip)
+			m_TilePool.UnmapTiledTextureSubresource(GetTileMappingQueue(), &Mips.Buffer, Mip);
+	}
+
+	// Maps the tail and the packed mips below it, which stay mapped until shutdown
+	bool MapMipTail( StreamedMips& Mips )
+	{
+		lock_guard<mutex> Lock(m_TileMutex);
+		if (m_TilePool.GetTileGroupCount(Mips.Buffer.GetMipChainTileCount(Mips.TailMip)) > m_TilePool.GetFreeTileGroupCount())
+			return false;
+
+		const uint32_t StandardMipCount = Mips.Buffer.GetStandardMipCount();
+		bool Mapped = StandardMipCount == Mips.Layout.MipCount || m_TilePool.MapPackedMips(GetTileMappingQueue(), &Mips.Buffer);
+		for (uint32_t Mip = Mips.TailMip; Mapped && Mip < StandardMipCount; ++Mip)
+			Mapped = m_TilePool.MapTiledTextureSubresource(GetTileMappingQueue(), &Mips.Buffer, Mip);
+
+		if (!Mapped)
+			m_TilePool.FreeTiledTextureTiles(&Mips.Buffer);
+		return Mapped;
+	}
+
+	// A view of the resident mips and everything below them
+	static void CreateMipView( StreamedMips& Mips, D3D12_CPU_DESCRIPTOR_HANDLE Handle )
+	{
+		D3D12_SHADER_RESOURCE_VIEW_DESC SRVDesc = {};
+		SRVDesc.Format = Mips.Format;
+		SRVDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+		SRVDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+		SRVDesc.Texture2D.MostDetailedMip = Mips.ResidentMip;
+		SRVDesc.Texture2D.MipLevels = (UINT)-1;
+		g_Device->CreateShaderResourceView(Mips.Buffer.GetResource(), &SRVDesc, Handle);
+	}
+
+	// The least detailed mip that still has a texel for every TargetTexels on screen
+	static uint32_t GetDesiredMip( const StreamedMips& Mips, float TargetTexels )
+	{
+		const uint32_t Size = std::max(Mips.Layout.Width, Mips.Layout.Height);
+		uint32_t Mip = 0;
+		while (Mip < Mips.TailMip && (float)(Size >> (Mip + 1)) >= TargetTexels)
+			++Mip;
+		return Mip;
+	}
+
+	// The mip to load up front, or zero when the whole chain should load at once
+	static uint32_t GetTailMip( const DDSLayout& Layout, uint32_t TailSize )
+	{
+		if (Layout.Dimension != D3D12_RESOURCE_DIMENSION_TEXTURE2D || Layout.ArraySize != 1 || Layout.MipCount < 2)
+			return 0;
+
+		for (uint32_t Mip = 1; Mip < Layout.MipCount; ++Mip)
+		{
+			const DDSSubresourceLayout& Sub = Layout.Subresources[Mip];
+			if (std::max(Sub.Width, Sub.Height) <= TailSize)
+				return Mip;
+		}
+		return 0;
+	}
+
+	// Uploads mips FirstMip up to EndMip, which must be mapped, from the file's bytes
+	static void UploadMips( StreamedMips& Mips, uint32_t FirstMip, uint32_t EndMip, const uint8_t* pFileData )
+	{
+		D3D12_SUBRESOURCE_DATA SubData[D3D12_REQ_MIP_LEVELS];
+		for (uint32_t Mip = FirstMip; Mip < EndMip; ++Mip)
+		{
+			const DDSSubresourceLayout& Sub = Mips.Layout.Subresources[Mip];
+			SubData[Mip - FirstMip].pData = pFileData + Sub.Offset;
+			SubData[Mip - FirstMip].RowPitch = Sub.RowPitch;
+			SubData[Mip - FirstMip].SlicePitch = Sub.SlicePitch;
+		}
+		CommandContext::InitializeTextureSubresources(Mips.Buffer, FirstMip, EndMip - FirstMip, SubData);
+	}
+
+	void ReaderThread( void )
+	{
+		for (;;)
+		{
+			ManagedTexture* pTexture = nullptr;
+			LoadRequest Request;
+			{
+				unique_lock<mutex> Lock(m_Mutex);
+				m_WorkAvailable.wait(Lock, [this]() { return m_Exit || !m_Jobs.empty(); });
+				if (m_Exit)
+					return;
+
+				const LoadJob Job = m_Jobs.top();
+				m_Jobs.pop();
+
+				// A texture queued again by Reprioritize leaves a stale job behind
+				auto iter = m_Requests.find(Job.pTexture);
+				if (iter == m_Requests.end())
+					continue;
+
+				pTexture = Job.pTexture;
+				Request = std::move(iter->second);
+				m_Requests.erase(iter);
+				if (Request.Kind == kLoadTexture)
+				{
+					if (Job.VisibleFrame != 0)
+						++m_Stats.VisibleFirstCount;
+					pTexture->m_LoadState.store(ManagedTexture::kLoadReading, memory_order_release);
+				}
+			}
+
+			if (Request.Kind == kLoadMips)
+				LoadMips(pTexture, Request);
+			else
+				LoadTexture(pTexture, Request);
+		}
+	}
+
+	// Loads the mip tail of a texture that can stream; returns false to load it whole
+	bool LoadMipTail( ManagedTexture* pTexture, const LoadRequest& Request, D3D12_CPU_DESCRIPTOR_HANDLE Staging, uint64_t* pBytesRead )
+	{
+		// Only the pages holding the headers and the tail are touched
+		Utility::FileViewPtr View = Utility::MapFileUncompressed(Request.FilePath);
+		if (View == nullptr)
+			return false;
+
+		unique_ptr<StreamedMips> pMips(new StreamedMips);
+		if (FAILED(ParseDDSLayout(View->Data(), View->Size(), View->Size(), pMips->Layout)))
+			return false;
+
+		const DDSLayout& Layout = pMips->Layout;
+		uint32_t TailMip = GetTailMip(Layout, Request.TailSize);
+		if (TailMip == 0)
+			return false;
+
+		// Mips packed into shared tiles can only be mapped together, so they are all tail
+		pMips->Format = Request.sRGB ? MakeSRGB(Layout.Format) : Layout.Format;
+		pMips->Buffer.CreateMipChain(Request.FilePath, Layout.Width, Layout.Height, Layout.MipCount, pMips->Format);
+		TailMip = std::min(TailMip, pMips->Buffer.GetStandardMipCount());
+		if (TailMip == 0)
+			return false;
+
+		pMips->FilePath = Request.FilePath;
+		pMips->TailMip = TailMip;
+		pMips->ResidentMip = TailMip;
+		pMips->TargetMip = TailMip;
+		pMips->DesiredMip = TailMip;
+		pMips->DesiredFrame = 0;
+		pMips->PublishFrame = 0;
+		pMips->HasFeedback = false;
+		pMips->Uploaded = false;
+
+		if (!MapMipTail(*pMips))
+			return false;
+
+		const DDSSubresourceLayout& Tail = Layout.Subresources[TailMip];
+		*pBytesRead += Layout.HeaderSize + (Layout.DataSize - Tail.Offset);
+
+		UploadMips(*pMips, TailMip, Layout.MipCount, View->Data());
+		CreateMipView(*pMips, Staging);
+		pTexture->m_pResource = pMips->Buffer.GetResource();
+		pTexture->m_pStreamedMips = pMips.get();
+
+		lock_guard<mutex> Lock(m_Mutex);
+		m_StreamedMips.push_back(std::move(pMips));
+		return true;
+	}
+
+	void LoadTexture( ManagedTexture* pTexture, const LoadRequest& Request )
+	{
+		const int64_t StartTick = SystemTime::GetCurrentTick();
+		uint64_t BytesRead = 0;
+
+		// The view goes to a staging descriptor; the texture's own SRV keeps showing the
+		// placeholder until TextureManager::Update() copies it over.
+		D3D12_CPU_DESCRIPTOR_HANDLE Staging = AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+		bool Loaded = Request.StreamMips && LoadMipTail(pTexture, Request, Staging, &BytesRead);
+		int64_t ReadTick = SystemTime::GetCurrentTick();
+		if (!Loaded)
+		{
+			// Mapped, so the upload buffer is filled straight from the file cache
+			Utility::FileViewPtr View = Utility::MapFile(Request.FilePath);
+			BytesRead += View != nullptr ? View->Size() : 0;
+			ReadTick = SystemTime::GetCurrentTick();
+			Loaded = View != nullptr && SUCCEEDED(CreateDDSTextureFromMemory(g_Device,
+				View->Data(), View->Size(), 0, Request.sRGB, &pTexture->m_pResource, Staging));
+		}
+
+		// A corrupt or unsupported DDS falls back to the TGA next to it, as the synchronous
+		// loader did
+		TGAFallback Fallback;
+		if (!Loaded && !Request.FallbackTGAPath.empty())
+		{
+			Fallback.Data = Utility::ReadFileSync(Request.FallbackTGAPath);
+			Fallback.sRGB = Request.sRGB;
+			BytesRead += Fallback.Data->size();
+		}
+
+		if (Loaded)
+		{
+			pTexture->m_pResource->SetName(pTexture->m_MapKey.c_str());
+		}
+		else
+		{
+			FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, Staging);
+			Staging.ptr = 0;
+		}
+		pTexture->m_hStagingDescriptor = Staging;
+		const int64_t EndTick = SystemTime::GetCurrentTick();
+
+		{
+			lock_guard<mutex> Lock(m_Mutex);
+			if (Loaded)
+				++m_Stats.LoadedCount;
+			else
+				++m_Stats.FailedCount;
+			m_Stats.BytesRead += BytesRead;
+			m_Stats.QueueMsec += SystemTime::TicksToMillisecs(StartTick - Request.EnqueueTick);
+			m_Stats.ReadMsec += SystemTime::TicksToMillisecs(ReadTick - StartTick);
+			m_Stats.CreateMsec += SystemTime::TicksToMillisecs(EndTick - ReadTick);
+
+			if (Fallback.Data != nullptr && Fallback.Data->size() > 0)
+				m_TGAFallbacks[pTexture] = Fallback;
+			m_Completed.push_back(pTexture);
+			--m_PendingCount;
+			pTexture->m_LoadState.store(ManagedTexture::kLoadCreated, memory_order_release);
+		}
+		m_StateChanged.notify_all();
+	}
+
+	// Uploads the mips gained, which QueueMipLoad() mapped.  They sit contiguously in the
+	// file just before the resident ones.
+	void LoadMips( ManagedTexture* pTexture, const LoadRequest& Request )
+	{
+		StreamedMips& Mips = *pTexture->m_pStreamedMips;
+		const DDSLayout& Layout = Mips.Layout;
+		const uint32_t FirstMip = Request.TargetMip;
+		const uint32_t EndMip = Mips.ResidentMip;
+
+		// The file may have changed since its layout was parsed
+		Utility::FileViewPtr View = Utility::MapFileUncompressed(Mips.FilePath);
+		const bool Uploaded = View != nullptr && View->Size() >= Layout.DataSize;
+		if (Uploaded)
+			UploadMips(Mips, FirstMip, EndMip, View->Data());
+
+		lock_guard<mutex> Lock(m_Mutex);
+		Mips.Uploaded = Uploaded;
+		if (Uploaded)
+		{
+			++m_Stats.MipLoadCount;
+			m_Stats.MipBytesRead += Layout.Subresources[EndMip].Offset - Layout.Subresources[FirstMip].Offset;
+		}
+		else
+		{
+			++m_Stats.MipFailedCount;
+		}
+		m_CompletedMipChanges.push_back(pTexture);
+	}
+
+	mutex m_Mutex;
+	condition_variable m_WorkAvailable;
+	condition_variable m_StateChanged;
+	priority_queue<LoadJob, vector<LoadJob>, LoadJobOrder> m_Jobs;
+	unordered_map<const ManagedTexture*, LoadRequest> m_Requests;
+	vector<ManagedTexture*> m_Completed;
+	vector<ManagedTexture*> m_CompletedMipChanges;
+	unordered_map<const ManagedTexture*, TGAFallback> m_TGAFallbacks;
+	vector<unique_ptr<StreamedMips>> m_StreamedMips;
+	vector<thread> m_Threads;
+
+	// Maps the detailed mips of streamed textures; ElasticTilePool is not thread safe
+	mutex m_TileMutex;
+	ElasticTilePool m_TilePool;
+
+	UINT32 m_PendingCount;
+	uint64_t m_Sequence;
+	bool m_Exit;
+	TextureStreamingStats m_Stats;
+
+	// Frame thread only
+	vector<ManagedTexture*> m_Streamed;
+	vector<ManagedTexture*> m_LoadCandidates;
+	vector<ManagedTexture*> m_EvictCandidates;
+};
+
 namespace TextureManager
 {
 	wstring s_RootPath = L"";
-	map< wstring, unique_ptr<ManagedTexture> > s_TextureCache;
+	TextureTable s_TextureCache;
+	TextureStreamer s_Streamer;
 
 	void Initialize( const std::wstring& TextureLibRoot )
 	{
@@ -144,89 +1021,205 @@ namespace TextureManager
 
 	void Shutdown( void )
 	{
-		s_TextureCache.clear();
+		s_Streamer.Shutdown();
+		PrintStatistics();
+		s_TextureCache.DestroyAll();
 	}
 
 	pair<ManagedTexture*, bool> FindOrLoadTexture( const wstring& fileName )
 	{
-		static mutex s_Mutex;
-		lock_guard<mutex> Guard(s_Mutex);
-
-		auto iter = s_TextureCache.find(fileName);
-
-		// If it's found, it has already been loaded or the load process has begun
-		if (iter != s_TextureCache.end())
-			return make_pair(iter->second.get(), false);
+		bool Inserted = false;
+		ManagedTexture* ManTex = s_TextureCache.FindOrInsert(fileName, &Inserted);
 
-		ManagedTexture* NewTexture = new ManagedTexture(fileName);
-		s_TextureCache[fileName].reset( NewTexture );
+		// If it's found, it has already been loaded or the load process has begun.  Wait for
+		// the requester to finish setting it up so the SRV handle and validity are final.
+		if (!Inserted)
+			s_Streamer.WaitForState(ManTex, ManagedTexture::kLoadQueued);
 
 		// This was the first time it was requested, so indicate that the caller must read the file
-		return make_pair(NewTexture, true);
+		return make_pair(ManTex, Inserted);
 	}
 
-	const Texture& GetBlackTex2D(void)
+	static const Texture& GetDefaultTexture( const wchar_t* Name, uint32_t Pixel )
 	{
-		auto ManagedTex = FindOrLoadTexture(L"DefaultBlackTexture");
+		auto ManagedTex = FindOrLoadTexture(Name);
 
 		ManagedTexture* ManTex = ManagedTex.first;
 		const bool RequestsLoad = ManagedTex.second;
 
 		if (!RequestsLoad)
-		{
-			ManTex->WaitForLoad();
 			return *ManTex;
-		}
 
-		uint32_t BlackPixel = 0;
-		ManTex->Create(1, 1, DXGI_FORMAT_R8G8B8A8_UNORM, &BlackPixel);
+		ManTex->Create(1, 1, DXGI_FORMAT_R8G8B8A8_UNORM, &Pixel);
+		s_Streamer.SetState(ManTex, ManagedTexture::kLoadReady);
 		return *ManTex;
 	}
 
+	const Texture& GetBlackTex2D(void)
+	{
+		return GetDefaultTexture(L"DefaultBlackTexture", 0);
+	}
+
 	const Texture& GetWhiteTex2D(void)
 	{
-		auto ManagedTex = FindOrLoadTexture(L"DefaultWhiteTexture");
+		return GetDefaultTexture(L"DefaultWhiteTexture", 0xFFFFFFFFul);
+	}
 
-		ManagedTexture* ManTex = ManagedTex.first;
-		const bool RequestsLoad = ManagedTex.second;
+	const Texture& GetMagentaTex2D(void)
+	{
+		return GetDefaultTexture(L"DefaultMagentaTexture", 0x00FF00FF);
+	}
 
-		if (!RequestsLoad)
+	// Shown while a texture streams in.  Linear textures are mostly normal maps, so they get
+	// a flat normal instead of grey.
+	const Texture& GetPlaceholderTex2D( bool sRGB )
+	{
+		return sRGB ? GetDefaultTexture(L"DefaultPlaceholderTexture", 0xFF808080) :
+			GetDefaultTexture(L"DefaultFlatNormalTexture", 0xFFFF8080);
+	}
+
+	void Update( void )
+	{
+		s_Streamer.PublishCompleted();
+		s_Streamer.UpdateResidency();
+	}
+
+	void WaitForPendingLoads( void )
+	{
+		s_Streamer.WaitForAll();
+	}
+
+	void PrintStatistics( void )
+	{
+		UINT32 PendingCount = 0;
+		const TextureStreamingStats Stats = s_Streamer.GetStats(&PendingCount);
+		if (Stats.QueuedCount == 0)
+			return;
+
+		const UINT32 FinishedCount = std::max(Stats.LoadedCount + Stats.FailedCount, 1u);
+		Utility::Printf("Texture streaming: %u queued, %u loaded, %u failed, %u pending, %u served first for visibility\n",
+			Stats.QueuedCount, Stats.LoadedCount, Stats.FailedCount, PendingCount, Stats.VisibleFirstCount);
+		Utility::Printf("  %0.1f MB read; average %0.2f ms queued, %0.2f ms reading, %0.2f ms creating; %u waits totalling %0.2f ms\n",
+			Stats.BytesRead / (1024.0 * 1024.0), Stats.QueueMsec / FinishedCount, Stats.ReadMsec / FinishedCount,
+			Stats.CreateMsec / FinishedCount, Stats.WaitCount, Stats.WaitMsec);
+		if (Stats.StreamedCount > 0)
 		{
-			ManTex->WaitForLoad();
-			return *ManTex;
+			Utility::Printf("  %u streaming mips: %u mip loads, %u evictions, %u failed, %0.1f MB read; %0.1f MB resident, %0.1f MB peak, %d MB budget\n",
+				Stats.StreamedCount, Stats.MipLoadCount, Stats.MipEvictCount, Stats.MipFailedCount, Stats.MipBytesRead / (1024.0 * 1024.0),
+				Stats.ResidentBytes / (1024.0 * 1024.0), Stats.PeakResidentBytes / (1024.0 * 1024.0), (int32_t)s_BudgetMB);
 		}
-
-		uint32_t WhitePixel = 0xFFFFFFFFul;
-		ManTex->Create(1, 1, DXGI_FORMAT_R8G8B8A8_UNORM, &WhitePixel);
-		return *ManTex;
 	}
 
-	const Texture& GetMagentaTex2D(void)
+	void Benchmark( const std::wstring& Directory )
 	{
-		auto ManagedTex = FindOrLoadTexture(L"DefaultMagentaTexture");
+		vector<wstring> FilePaths;
+		WIN32_FIND_DATAW FindData;
+		HANDLE hFind = FindFirstFileExW((Directory + L"\\*.dds").c_str(), FindExInfoBasic, &FindData, FindExSearchNameMatch, nullptr, 0);
+		if (hFind != INVALID_HANDLE_VALUE)
+		{
+			do
+			{
+				if ((FindData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+					FilePaths.push_back(Directory + L"\\" + FindData.cFileName);
+			}
+			while (FindNextFileW(hFind, &FindData));
+			FindClose(hFind);
+		}
 
-		ManagedTexture* ManTex = ManagedTex.first;
-		const bool RequestsLoad = ManagedTex.second;
+		if (FilePaths.empty())
+		{
+			Utility::Printf(L"Texture load benchmark: no DDS files in %s\n", Directory.c_str());
+			return;
+		}
 
-		if (!RequestsLoad)
+		// Read and create each texture on the calling thread, as LoadDDSFromFile used to
+		UINT64 BytesRead = 0;
+		UINT32 SyncLoadedCount = 0;
+		int64_t StartTick = SystemTime::GetCurrentTick();
+		for (const wstring& FilePath : FilePaths)
 		{
-			ManTex->WaitForLoad();
-			return *ManTex;
+			Utility::ByteArray ba = Utility::ReadFileSync(FilePath);
+			BytesRead += ba->size();
+
+			Texture Tex;
+			if (ba->size() > 0 && Tex.CreateDDSFromMemory(ba->data(), ba->size(), false))
+				++SyncLoadedCount;
+			FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, Tex.GetSRV());
 		}
+		const DOUBLE SyncMsec = SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - StartTick);
 
-		uint32_t MagentaPixel = 0x00FF00FF;
-		ManTex->Create(1, 1, DXGI_FORMAT_R8G8B8A8_UNORM, &MagentaPixel);
-		return *ManTex;
+		// Queue everything through the reader pool, then wait as a loading screen would.  Whole
+		// textures are loaded so both paths read the same bytes.
+		vector<unique_ptr<ManagedTexture>> Streamed;
+		const D3D12_CPU_DESCRIPTOR_HANDLE PlaceholderSRV = GetPlaceholderTex2D(false).GetSRV();
+		StartTick = SystemTime::GetCurrentTick();
+		for (const wstring& FilePath : FilePaths)
+		{
+			Streamed.emplace_back(new ManagedTexture(FilePath));
+			s_Streamer.Enqueue(Streamed.back().get(), FilePath, false, false, PlaceholderSRV);
+		}
+		const DOUBLE RequestMsec = SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - StartTick);
+		for (auto& Tex : Streamed)
+			Tex->WaitForLoad();
+		const DOUBLE StreamMsec = SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - StartTick);
+
+		s_Streamer.PublishCompleted();
+		UINT32 StreamLoadedCount = 0;
+		for (auto& Tex : Streamed)
+		{
+			StreamLoadedCount += Tex->IsValid() ? 1 : 0;
+			FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, Tex->GetSRV());
+		}
+
+		const DOUBLE Megabytes = BytesRead / (1024.0 * 1024.0);
+		Utility::Printf(L"Texture load benchmark: %u DDS files, %0.1f MB from %s\n", (UINT32)FilePaths.size(), Megabytes, Directory.c_str());
+		Utility::Printf("  Calling thread:  %9.1f ms, %7.1f MB/s, %u loaded\n", SyncMsec, Megabytes * 1000.0 / std::max(SyncMsec, 1e-3), SyncLoadedCount);
+		Utility::Printf("  Reader pool:     %9.1f ms, %7.1f MB/s, %u loaded; requests returned in %0.2f ms\n",
+			StreamMsec, Megabytes * 1000.0 / std::max(StreamMsec, 1e-3), StreamLoadedCount, RequestMsec);
 	}
 
 } // namespace TextureManager
 
 void ManagedTexture::WaitForLoad( void ) const
 {
-	volatile D3D12_CPU_DESCRIPTOR_HANDLE& VolHandle = (volatile D3D12_CPU_DESCRIPTOR_HANDLE&)m_hCpuDescriptorHandle;
-	volatile bool& VolValid = (volatile bool&)m_IsValid;
-	while (VolHandle.ptr == D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN && VolValid)
-		this_thread::yield();
+	TextureManager::s_Streamer.WaitForState(this, kLoadCreated);
+}
+
+void ManagedTexture::MarkVisible( void ) const
+{
+	// Offset by one so that frame zero still ranks above textures never seen
+	const uint64_t Frame = Graphics::GetFrameCount() + 1;
+	uint64_t LastFrame = m_LastVisibleFrame.load(memory_order_relaxed);
+	if (LastFrame != Frame && m_LastVisibleFrame.compare_exchange_strong(LastFrame, Frame, memory_order_relaxed) &&
+		m_LoadState.load(memory_order_relaxed) == kLoadQueued)
+	{
+		TextureManager::s_Streamer.Reprioritize(const_cast<ManagedTexture*>(this), Frame);
+	}
+}
+
+void ManagedTexture::RequestResolution( uint32_t ScreenPixels ) const
+{
+	MarkVisible();
+
+	uint32_t Requested = m_RequestedPixels.load(memory_order_relaxed);
+	while (ScreenPixels > Requested && !m_RequestedPixels.compare_exchange_weak(Requested, ScreenPixels, memory_order_relaxed))
+		;
+}
+
+void ManagedTexture::PublishLoadedView( void )
+{
+	if (m_hStagingDescriptor.ptr != 0)
+	{
+		g_Device->CopyDescriptorsSimple(1, m_hCpuDescriptorHandle, m_hStagingDescriptor, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+		FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, m_hStagingDescriptor);
+		m_hStagingDescriptor.ptr = 0;
+	}
+	else
+	{
+		// The file existed but could not be loaded; keep the handle and show the invalid texture
+		g_Device->CopyDescriptorsSimple(1, m_hCpuDescriptorHandle, TextureManager::GetMagentaTex2D().GetSRV(), D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+		m_IsValid = false;
+	}
 }
 
 void ManagedTexture::SetToInvalidTexture( void )
@@ -235,6 +1228,34 @@ void ManagedTexture::SetToInvalidTexture( void )
 	m_IsValid = false;
 }
 
+// Queues a DDS file.  If the file exists but cannot be loaded and FallbackTGAPath is not
+// empty, the reader loads that TGA into the same texture instead.
+static const ManagedTexture* LoadDDSWithFallback( const std::wstring& fileName, bool sRGB, const std::wstring& FallbackTGAPath )
+{
+	using namespace TextureManager;
+
+	auto ManagedTex = FindOrLoadTexture(fileName);
+
+	ManagedTexture* ManTex = ManagedTex.first;
+	const bool RequestsLoad = ManagedTex.second;
+
+	if (!RequestsLoad)
+		return ManTex;
+
+	// Only the existence check happens here, so callers can still fall back to other files
+	const wstring FilePath = s_RootPath + fileName;
+	WIN32_FILE_ATTRIBUTE_DATA FileData;
+	if (!GetFileAttributesExW(FilePath.c_str(), GetFileExInfoStandard, &FileData) || (FileData.nFileSizeLow | FileData.nFileSizeHigh) == 0)
+	{
+		ManTex->SetToInvalidTexture();
+		s_Streamer.SetState(ManTex, ManagedTexture::kLoadReady);
+		return ManTex;
+	}
+
+	s_Streamer.Enqueue(ManTex, FilePath, sRGB, s_StreamMips, GetPlaceholderTex2D(sRGB).GetSRV(), FallbackTGAPath);
+	return ManTex;
+}
+
 const ManagedTexture* TextureManager::LoadFromFile( const std::wstring& fileName, bool sRGB )
 {
 	std::wstring CatPath = fileName;
@@ -245,7 +1266,8 @@ const ManagedTexture* TextureManager::LoadFromFile( const std::wstring& fileName
         CatPath.append(L".dds");
     }
 
-	const ManagedTexture* Tex = LoadDDSFromFile( CatPath, sRGB );
+	// A missing DDS is known now; one that fails to load switches to the TGA once read
+	const ManagedTexture* Tex = LoadDDSWithFallback( CatPath, sRGB, s_RootPath + CatPath + L".tga" );
 	if (!Tex->IsValid())
 		Tex = LoadTGAFromFile( CatPath + L".tga", sRGB );
 
@@ -254,24 +1276,7 @@ const ManagedTexture* TextureManager::LoadFromFile( const std::wstring& fileName
 
 const ManagedTexture* TextureManager::LoadDDSFromFile( const std::wstring& fileName, bool sRGB )
 {
-	auto ManagedTex = FindOrLoadTexture(fileName);
-
-	ManagedTexture* ManTex = ManagedTex.first;
-	const bool RequestsLoad = ManagedTex.second;
-
-	if (!RequestsLoad)
-	{
-		ManTex->WaitForLoad();
-		return ManTex;
-	}
-
-	Utility::ByteArray ba = Utility::ReadFileSync( s_RootPath + fileName );
-	if (ba->size() == 0 || !ManTex->CreateDDSFromMemory( ba->data(), ba->size(), sRGB ))
-		ManTex->SetToInvalidTexture();
-	else
-		ManTex->GetResource()->SetName(fileName.c_str());
-
-	return ManTex;
+	return LoadDDSWithFallback( fileName, sRGB, wstring() );
 }
 
 const ManagedTexture* TextureManager::LoadTGAFromFile( const std::wstring& fileName, bool sRGB )
@@ -282,10 +1287,7 @@ const ManagedTexture* TextureManager::LoadTGAFromFile( const std::wstring& fileN
 	const bool RequestsLoad = ManagedTex.second;
 
 	if (!RequestsLoad)
-	{
-		ManTex->WaitForLoad();
 		return ManTex;
-	}
 
 	Utility::ByteArray ba = Utility::ReadFileSync( s_RootPath + fileName );
 	if (ba->size() > 0)
@@ -296,5 +1298,6 @@ const ManagedTexture* TextureManager::LoadTGAFromFile( const std::wstring& fileN
 	else
 		ManTex->SetToInvalidTexture();
 
+	s_Streamer.SetState(ManTex, ManagedTexture::kLoadReady);
 	return ManTex;
 }
@@ -17,6 +17,9 @@
 #include "pch.h"
 #include "GpuResource.h"
 #include "Utility.h"
+#include <atomic>
+
+struct StreamedMips;
 
 class Texture : public GpuResource
 {
@@ -48,22 +51,62 @@ protected:
 	D3D12_CPU_DESCRIPTOR_HANDLE m_hCpuDescriptorHandle;
 };
 
+// A texture owned by TextureManager.  DDS files are streamed: the SRV handle is allocated
+// up front and shows a placeholder until a reader thread has created the texture and the
+// next Graphics::Present() has written its view, so the handle can be copied right away.
+// Large 2D textures load only their mip tail at first; more detailed mips are then added
+// and dropped according to RequestResolution() and the streaming budget, each change
+// again published through the same handle.
 class ManagedTexture : public Texture
 {
+	friend class TextureStreamer;
+
 public:
-	ManagedTexture( const std::wstring& FileName ) : m_MapKey(FileName), m_IsValid(true) {}
+	enum LoadState
+	{
+		kLoadRequested,		// Inserted into the cache; the requesting thread is setting it up
+		kLoadQueued,		// SRV shows the placeholder; waiting for a reader thread
+		kLoadReading,
+		kLoadCreated,		// Resource created and uploaded; SRV not yet published
+		kLoadReady
+	};
+
+	ManagedTexture( const std::wstring& FileName ) : m_MapKey(FileName), m_IsValid(true), m_LoadState(kLoadRequested), m_LastVisibleFrame(0),
+		m_RequestedPixels(0), m_pStreamedMips(nullptr)
+	{
+		m_hStagingDescriptor.ptr = 0;
+	}
 
 	void operator= ( const Texture& Texture );
 
+	// Blocks until the resource exists.  The SRV may still be the placeholder.
 	void WaitForLoad(void) const;
 	void Unload(void);
 
 	void SetToInvalidTexture(void);
 	bool IsValid(void) const { return m_IsValid; }
+	bool IsResident(void) const { return m_LoadState.load(std::memory_order_acquire) == kLoadReady; }
+
+	// Moves a queued texture ahead of those not seen recently and keeps a streamed one from
+	// being the first evicted.  Cheap after the first call each frame.
+	void MarkVisible(void) const;
+
+	// Asks for enough mips to cover about ScreenPixels across.  The largest request since
+	// the last TextureManager::Update() wins.
+	void RequestResolution(uint32_t ScreenPixels) const;
+
+	const std::wstring& GetName(void) const { return m_MapKey; }
 
 private:
+	void PublishLoadedView(void);
+
 	std::wstring m_MapKey;		// For deleting from the map later
 	bool m_IsValid;
+	std::atomic<uint32_t> m_LoadState;
+	mutable std::atomic<uint64_t> m_LastVisibleFrame;
+	mutable std::atomic<uint32_t> m_RequestedPixels;
+	D3D12_CPU_DESCRIPTOR_HANDLE m_hStagingDescriptor;	// View created by the reader thread, copied on publish
+	StreamedMips* m_pStreamedMips;		// Null unless the mip chain streams; owned by TextureStreamer
 };
 
 namespace TextureManager
@@ -92,4 +135,18 @@ namespace TextureManager
 
 	const Texture& GetBlackTex2D(void);
 	const Texture& GetWhiteTex2D(void);
+
+	// Writes the views of textures finished since the last call, then queues mip loads and
+	// evictions toward this frame's resolution requests within the streaming budget.  Called
+	// once per frame by Graphics::Present(), when no context is copying descriptors.
+	void Update(void);
+
+	// Blocks until every queued texture has been read and created.
+	void WaitForPendingLoads(void);
+
+	void PrintStatistics(void);
+
+	// Loads every DDS file in Directory on the calling thread and then through the reader
+	// pool, and reports the time taken by each.
+	void Benchmark( const std::wstring& Directory );
 }
@@ -0,0 +1,453 @@
+#include "pch.h"
+#include "TileGroupAllocator.h"
+#include "SystemTime.h"
+
+TileGroupAllocator::TileGroupAllocator()
+    : m_SlabGroupShift(0),
+      m_FreeCount(0),
+      m_ActiveSlabCount(0)
+{
+}
+
+void TileGroupAllocator::Initialize(UINT32 SlabGroupShift, UINT32 MaxSlabCount)
+{
+    assert(SlabGroupShift < 24 && ((UINT64)MaxSlabCount << SlabGroupShift) < InvalidIndex);
+    m_SlabGroupShift = SlabGroupShift;
+    m_Slabs.resize(MaxSlabCount);
+    for (auto& S : m_Slabs)
+    {
+        S.FirstFree = InvalidIndex;
+        S.FreeCount = 0;
+        S.Active = false;
+    }
+    m_NextIndex.clear();
+    m_FreeCount = 0;
+    m_ActiveSlabCount = 0;
+}
+
+UINT32 TileGroupAllocator::AddSlab()
+{
+    for (UINT32 SlabIndex = 0; SlabIndex < GetMaxSlabCount(); ++SlabIndex)
+    {
+        Slab& S = m_Slabs[SlabIndex];
+        if (S.Active)
+        {
+            continue;
+        }
+
+        const UINT32 FirstIndex = SlabIndex << m_SlabGroupShift;
+        const UINT32 GroupCount = GetSlabGroupCount();
+        if (m_NextIndex.size() < FirstIndex + GroupCount)
+        {
+            m_NextIndex.resize(FirstIndex + GroupCount);
+        }
+        for (UINT32 i = 0; i < GroupCount - 1; ++i)
+        {
+            m_NextIndex[FirstIndex + i] = FirstIndex + i + 1;
+        }
+        m_NextIndex[FirstIndex + GroupCount - 1] = InvalidIndex;
+
+        S.FirstFree = FirstIndex;
+        S.FreeCount = GroupCount;
+        S.Active = true;
+        m_FreeCount += GroupCount;
+        ++m_ActiveSlabCount;
+        return SlabIndex;
+    }
+    return InvalidIndex;
+}
+
+void TileGroupAllocator::ReleaseSlab(UINT32 SlabIndex)
+{
+    Slab& S = m_Slabs[SlabIndex];
+    assert(S.Active && S.FreeCount == GetSlabGroupCount());
+    S.Active = false;
+    S.FirstFree = InvalidIndex;
+    S.FreeCount = 0;
+    m_FreeCount -= GetSlabGroupCount();
+    --m_ActiveSlabCount;
+}
+
+UINT32 TileGroupAllocator::Allocate(UINT32 Count)
+{
+    if (Count == 0 || Count > m_FreeCount)
+    {
+        return InvalidIndex;
+    }
+
+    UINT32 FirstIndex = InvalidIndex;
+    while (Count > 0)
+    {
+        // The fullest slab with room; slabs are few, so a scan is cheaper than keeping them sorted
+        UINT32 BestSlab = InvalidIndex;
+        UINT32 BestFreeCount = InvalidIndex;
+        for (UINT32 SlabIndex = 0; SlabIndex < GetMaxSlabCount(); ++SlabIndex)
+        {
+            const Slab& S = m_Slabs[SlabIndex];
+            if (S.FreeCount > 0 && S.FreeCount < BestFreeCount)
+            {
+                BestSlab = SlabIndex;
+                BestFreeCount = S.FreeCount;
+            }
+        }
+        assert(BestSlab != InvalidIndex);
+
+        Slab& S = m_Slabs[BestSlab];
+        while (Count > 0 && S.FreeCount > 0)
+        {
+            const UINT32 Index = S.FirstFree;
+            S.FirstFree = m_NextIndex[Index];
+            m_NextIndex[Index] = FirstIndex;
+            FirstIndex = Index;
+            --S.FreeCount;
+            --m_FreeCount;
+            --Count;
+        }
+    }
+    return FirstIndex;
+}
+
+void TileGroupAllocator::Free(UINT32 FirstIndex)
+{
+    while (FirstIndex != InvalidIndex)
+    {
+        const UINT32 NextIndex = m_NextIndex[FirstIndex];
+        Slab& S = m_Slabs[GetSlabIndex(FirstIndex)];
+        assert(S.Active && S.FreeCount < GetSlabGroupCount());
+        m_NextIndex[FirstIndex] = S.FirstFree;
+        S.FirstFree = FirstIndex;
+        ++S.FreeCount;
+        ++m_FreeCount;
+        FirstIndex = NextIndex;
+    }
+}
+
+bool TileGroupAllocator::ChainUsesSlab(UINT32 FirstIndex, UINT32 SlabIndex) const
+{
+    for (UINT32 Index = FirstIndex; Index != InvalidIndex; Index = m_NextIndex[Index])
+    {
+        if (GetSlabIndex(Index) == SlabIndex)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+UINT32 TileGroupAllocator::FindReleasableSlab(UINT32 ReserveGroups) const
+{
+    if (m_FreeCount < GetSlabGroupCount() + ReserveGroups)
+    {
+        return InvalidIndex;
+    }
+
+    // Highest first, since AddSlab refills from the bottom
+    for (UINT32 SlabIndex = GetMaxSlabCount(); SlabIndex-- > 0; )
+    {
+        const Slab& S = m_Slabs[SlabIndex];
+        if (S.Active && S.FreeCount == GetSlabGroupCount())
+        {
+            return SlabIndex;
+        }
+    }
+    return InvalidIndex;
+}
+
+UINT32 TileGroupAllocator::FindCompactionSlab(FLOAT MaxUsedFraction) const
+{
+    UINT32 BestSlab = InvalidIndex;
+    UINT32 BestUsedCount = (UINT32)(MaxUsedFraction * GetSlabGroupCount());
+    for (UINT32 SlabIndex = 0; SlabIndex < GetMaxSlabCount(); ++SlabIndex)
+    {
+        const UINT32 UsedCount = GetSlabUsedCount(SlabIndex);
+        if (m_Slabs[SlabIndex].Active && UsedCount > 0 && UsedCount <= BestUsedCount &&
+            UsedCount <= m_FreeCount - m_Slabs[SlabIndex].FreeCount)
+        {
+            BestSlab = SlabIndex;
+            BestUsedCount = UsedCount;
+        }
+    }
+    return BestSlab;
+}
+
+bool TileGroupAllocator::Validate() const
+{
+    UINT32 TotalFree = 0;
+    UINT32 ActiveCount = 0;
+    for (UINT32 SlabIndex = 0; SlabIndex < GetMaxSlabCount(); ++SlabIndex)
+    {
+        const Slab& S = m_Slabs[SlabIndex];
+        UINT32 Count = 0;
+        for (UINT32 Index = S.FirstFree; Index != InvalidIndex && Count <= S.FreeCount; Index = m_NextIndex[Index])
+        {
+            if (GetSlabIndex(Index) != SlabIndex)
+            {
+                return false;
+            }
+            ++Count;
+        }
+        if (Count != S.FreeCount || (!S.Active && Count != 0))
+        {
+            return false;
+        }
+        TotalFree += Count;
+        ActiveCount += S.Active ? 1 : 0;
+    }
+    return TotalFree == m_FreeCount && ActiveCount == m_ActiveSlabCount;
+}
+
+UINT32 SelectTileEvictions(std::vector<TileEvictionCandidate>& Candidates, UINT32 GroupsNeeded)
+{
+    std::sort(Candidates.begin(), Candidates.end(),
+        [](const TileEvictionCandidate& A, const TileEvictionCandidate& B) { return A.LastUsedFrame < B.LastUsedFrame; });
+
+    UINT32 FreedCount = 0;
+    for (UINT32 i = 0; i < (UINT32)Candidates.size(); ++i)
+    {
+        FreedCount += Candidates[i].GroupCount;
+        if (FreedCount >= GroupsNeeded)
+        {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+namespace
+{
+    struct SimTexture
+    {
+        UINT32 GroupCount;
+        UINT32 FirstIndex;
+        UINT64 LastUsedFrame;
+    };
+
+    struct TilePoolRun
+    {
+        UINT64 Requests;
+        UINT64 Hits;
+        UINT64 Maps;
+        UINT64 FailedMaps;
+        UINT64 Evictions;
+        UINT64 CompactionEvictions;
+        UINT64 SlabsAdded;
+        UINT64 SlabsReleased;
+        UINT64 SlabFrames;
+        UINT32 PeakSlabs;
+        UINT32 FinalSlabs;
+        DOUBLE ElapsedMsec;
+        bool Valid;
+    };
+
+    const UINT32 RequestsPerFrame = 16;
+    const UINT32 EvictionIdleFrames = 2;
+    const UINT32 CompactionIdleFrames = 30;
+    const UINT32 CompactionEvictionsPerFrame = 8;
+    const UINT32 OwnerReleaseFrames = 240;
+
+    bool CheckOwnership(const TileGroupAllocator& Allocator, const std::vector<SimTexture>& Textures)
+    {
+        std::vector<bool> Owned(Allocator.GetMaxCapacity(), false);
+        UINT32 OwnedCount = 0;
+        for (const auto& T : Textures)
+        {
+            UINT32 ChainLength = 0;
+            for (UINT32 Index = T.FirstIndex; Index != TileGroupAllocator::InvalidIndex; Index = Allocator.GetNextIndex(Index))
+            {
+                if (Owned[Index] || !Allocator.IsSlabActive(Allocator.GetSlabIndex(Index)))
+                {
+                    return false;
+                }
+                Owned[Index] = true;
+                ++ChainLength;
+            }
+            if (T.FirstIndex != TileGroupAllocator::InvalidIndex && ChainLength != T.GroupCount)
+            {
+                return false;
+            }
+            OwnedCount += ChainLength;
+        }
+        return Allocator.Validate() && OwnedCount + Allocator.GetFreeCount() == Allocator.GetCapacity();
+    }
+
+    // Policy 0 creates every slab up front and stops mapping when full; policy 1 grows,
+    // evicts, compacts and releases
+    TilePoolRun RunTilePool(UINT32 Policy, UINT32 RequestCount, UINT32 MaxSlabCount, std::vector<SimTexture>& Textures)
+    {
+        TilePoolRun Run = {};
+        TileGroupAllocator Allocator;
+        Allocator.Initialize(6, MaxSlabCount);
+        for (auto& T : Textures)
+        {
+            T.FirstIndex = TileGroupAllocator::InvalidIndex;
+            T.LastUsedFrame = 0;
+        }
+        if (Policy == 0)
+        {
+            while (Allocator.AddSlab() != TileGroupAllocator::InvalidIndex)
+            {
+                ++Run.SlabsAdded;
+            }
+        }
+
+        UINT32 Seed = 11;
+        auto Random = [&Seed]() { Seed = Seed * 1664525 + 1013904223; return Seed >> 8; };
+
+        const UINT32 TextureCount = (UINT32)Textures.size();
+        std::vector<TileEvictionCandidate> Candidates;
+        Run.Valid = true;
+
+        const INT64 StartTick = SystemTime::GetCurrentTick();
+        for (UINT32 Request = 0; Request < RequestCount && Run.Valid; ++Request)
+        {
+            const UINT64 Frame = Request / RequestsPerFrame + 1;
+
+            // The camera drifts across the textures.  For a few thousand frames at a time the
+            // view takes in more than the pool can hold; in between it narrows, as when the
+            // camera stops, and the working set shrinks to a small fraction of the pool.
+            const UINT32 WindowStart = (UINT32)(Frame / 8) % TextureCount;
+            const UINT32 WindowSize = ((Frame / 2000) % 2 == 0) ? TextureCount * 3 / 4 : TextureCount / 16;
+            SimTexture& T = Textures[(WindowStart + Random() % WindowSize) % TextureCount];
+            T.LastUsedFrame = Frame;
+            ++Run.Requests;
+
+            if (T.FirstIndex != TileGroupAllocator::InvalidIndex)
+            {
+                ++Run.Hits;
+            }
+            else
+            {
+                T.FirstIndex = Allocator.Allocate(T.GroupCount);
+                while (Policy == 1 && T.FirstIndex == TileGroupAllocator::InvalidIndex && Allocator.AddSlab() != TileGroupAllocator::InvalidIndex)
+                {
+                    ++Run.SlabsAdded;
+                    T.FirstIndex = Allocator.Allocate(T.GroupCount);
+                }
+                if (Policy == 1 && T.FirstIndex == TileGroupAllocator::InvalidIndex)
+                {
+                    Candidates.clear();
+                    for (auto& Other : Textures)
+                    {
+                        if (Other.FirstIndex != TileGroupAllocator::InvalidIndex && Other.LastUsedFrame + EvictionIdleFrames <= Frame)
+                        {
+                            Candidates.push_back({ Other.LastUsedFrame, Other.GroupCount, &Other });
+                        }
+                    }
+                    const UINT32 EvictCount = SelectTileEvictions(Candidates, T.GroupCount - Allocator.GetFreeCount());
+                    for (UINT32 i = 0; i < EvictCount; ++i)
+                    {
+                        SimTexture* pVictim = (SimTexture*)Candidates[i].pOwner;
+                        Allocator.Free(pVictim->FirstIndex);
+                        pVictim->FirstIndex = TileGroupAllocator::InvalidIndex;
+                        ++Run.Evictions;
+                    }
+                    T.FirstIndex = Allocator.Allocate(T.GroupCount);
+                }
+
+                if (T.FirstIndex != TileGroupAllocator::InvalidIndex)
+                {
+                    ++Run.Maps;
+                }
+                else
+                {
+                    ++Run.FailedMaps;
+                }
+            }
+
+            if ((Request + 1) % RequestsPerFrame != 0)
+            {
+                continue;
+            }
+
+            // Owners let go of textures that have been out of view for a while, as terrain
+            // blocks do when they unload
+            for (auto& Other : Textures)
+            {
+                if (Other.FirstIndex != TileGroupAllocator::InvalidIndex && Other.LastUsedFrame + OwnerReleaseFrames <= Frame)
+                {
+                    Allocator.Free(Other.FirstIndex);
+                    Other.FirstIndex = TileGroupAllocator::InvalidIndex;
+                }
+            }
+
+            // Then move idle textures off the emptiest slab and release empty ones
+            if (Policy == 1)
+            {
+                const UINT32 CompactSlab = Allocator.FindCompactionSlab(0.25f);
+                UINT32 Moved = 0;
+                for (UINT32 i = 0; i < TextureCount && CompactSlab != TileGroupAllocator::InvalidIndex && Moved < CompactionEvictionsPerFrame; ++i)
+                {
+                    SimTexture& Other = Textures[i];
+                    if (Other.FirstIndex != TileGroupAllocator::InvalidIndex && Other.LastUsedFrame + CompactionIdleFrames <= Frame &&
+                        Allocator.ChainUsesSlab(Other.FirstIndex, CompactSlab))
+                    {
+                        Allocator.Free(Other.FirstIndex);
+                        Other.FirstIndex = TileGroupAllocator::InvalidIndex;
+                        ++Run.CompactionEvictions;
+                        ++Moved;
+                    }
+                }
+
+                UINT32 SlabIndex;
+                while ((SlabIndex = Allocator.FindReleasableSlab(Allocator.GetSlabGroupCount() / 2)) != TileGroupAllocator::InvalidIndex)
+                {
+                    Allocator.ReleaseSlab(SlabIndex);
+                    ++Run.SlabsReleased;
+                }
+            }
+
+            Run.SlabFrames += Allocator.GetActiveSlabCount();
+            Run.PeakSlabs = std::max(Run.PeakSlabs, Allocator.GetActiveSlabCount());
+            if (Frame % 64 == 0)
+            {
+                Run.Valid = CheckOwnership(Allocator, Textures);
+            }
+        }
+        Run.ElapsedMsec = SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - StartTick);
+        Run.FinalSlabs = Allocator.GetActiveSlabCount();
+        Run.Valid = Run.Valid && CheckOwnership(Allocator, Textures);
+        return Run;
+    }
+}
+
+bool TileGroupAllocator::Benchmark(UINT32 RequestCount, UINT32 MaxSlabCount)
+{
+    MaxSlabCount = std::max(MaxSlabCount, 2U);
+    RequestCount = std::max(RequestCount, RequestsPerFrame);
+
+    // Mostly single-group terrain heightmaps, some larger surface maps; about twice as many
+    // groups in total as the pool can hold
+    UINT32 Seed = 5;
+    auto Random = [&Seed]() { Seed = Seed * 1664525 + 1013904223; return Seed >> 8; };
+    std::vector<SimTexture> Textures;
+    UINT32 TotalGroups = 0;
+    while (TotalGroups < (MaxSlabCount << 6) * 2)
+    {
+        SimTexture T = {};
+        T.GroupCount = (Random() % 4 == 0) ? 2 + Random() % 15 : 1;
+        Textures.push_back(T);
+        TotalGroups += T.GroupCount;
+    }
+
+    TilePoolRun Runs[2];
+    for (UINT32 Policy = 0; Policy < 2; ++Policy)
+    {
+        Runs[Policy] = RunTilePool(Policy, RequestCount, MaxSlabCount, Textures);
+    }
+    const bool Valid = Runs[0].Valid && Runs[1].Valid && Runs[1].FailedMaps <= Runs[0].FailedMaps;
+
+    const UINT64 FrameCount = std::max<UINT64>(RequestCount / RequestsPerFrame, 1);
+    Utility::PrintfConsole("Tile pool benchmark: %u textures (%u tile groups), %u requests, up to %u slabs of 64 groups\n",
+        (UINT32)Textures.size(), TotalGroups, RequestCount, MaxSlabCount);
+    static const char* s_PolicyNames[2] = { "Fixed, stop when full", "Elastic with eviction" };
+    for (UINT32 Policy = 0; Policy < 2; ++Policy)
+    {
+        const TilePoolRun& Run = Runs[Policy];
+        Utility::PrintfConsole("  %-22s %5.1f%% hits, %7llu failed maps, %7llu evicted (%llu compacting), %5.1f avg %u peak %u final slabs, %llu released, %7.3f ms\n",
+            s_PolicyNames[Policy], 100.0 * (DOUBLE)Run.Hits / (DOUBLE)std::max<UINT64>(Run.Requests, 1), Run.FailedMaps,
+            Run.Evictions + Run.CompactionEvictions, Run.CompactionEvictions, (DOUBLE)Run.SlabFrames / FrameCount,
+            Run.PeakSlabs, Run.FinalSlabs, Run.SlabsReleased, Run.ElapsedMsec);
+    }
+
+    return Valid;
+}
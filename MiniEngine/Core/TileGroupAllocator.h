@@ -0,0 +1,89 @@
+#pragma once
+
+#include <vector>
+
+// A mapped tiled texture that may give up its tiles, as seen by SelectTileEvictions
+struct TileEvictionCandidate
+{
+    UINT64 LastUsedFrame;
+    UINT32 GroupCount;
+    void* pOwner;
+};
+
+// Tile group bookkeeping behind ElasticTilePool, kept free of D3D so it can be exercised
+// on its own.  Groups are numbered slab by slab, SlabGroupCount to a slab, and every slab
+// keeps its own free list so that it can be emptied and released.  Allocations come from
+// the fullest slabs first, which leaves the emptiest ones to drain.  A subresource's groups
+// are chained through GetNextIndex, as with the USHORT IndexList this replaces, but
+// indices are 32 bits so a pool can hold more than 65536 groups.
+//
+// Not thread safe; the tile pool is used from the render thread.
+class TileGroupAllocator
+{
+public:
+    static const UINT32 InvalidIndex = 0xFFFFFFFF;
+
+private:
+    struct Slab
+    {
+        UINT32 FirstFree;
+        UINT32 FreeCount;
+        bool Active;
+    };
+
+    UINT32 m_SlabGroupShift;
+    std::vector<Slab> m_Slabs;
+    std::vector<UINT32> m_NextIndex;
+    UINT32 m_FreeCount;
+    UINT32 m_ActiveSlabCount;
+
+public:
+    TileGroupAllocator();
+
+    void Initialize(UINT32 SlabGroupShift, UINT32 MaxSlabCount);
+
+    // Makes an unused slab available and returns its index, or InvalidIndex when every slab
+    // is in use; the caller then creates its heap.
+    UINT32 AddSlab();
+
+    // Withdraws an entirely free slab; the caller releases its heap.
+    void ReleaseSlab(UINT32 SlabIndex);
+
+    // Returns the first of a chain of Count groups, or InvalidIndex when fewer are free.
+    UINT32 Allocate(UINT32 Count);
+    void Free(UINT32 FirstIndex);
+    UINT32 GetNextIndex(UINT32 Index) const { return m_NextIndex[Index]; }
+
+    UINT32 GetSlabIndex(UINT32 Index) const { return Index >> m_SlabGroupShift; }
+    UINT32 GetIndexWithinSlab(UINT32 Index) const { return Index & ((1U << m_SlabGroupShift) - 1); }
+    UINT32 GetSlabGroupCount() const { return 1U << m_SlabGroupShift; }
+    UINT32 GetMaxSlabCount() const { return (UINT32)m_Slabs.size(); }
+    bool IsSlabActive(UINT32 SlabIndex) const { return m_Slabs[SlabIndex].Active; }
+    UINT32 GetSlabUsedCount(UINT32 SlabIndex) const { return m_Slabs[SlabIndex].Active ? GetSlabGroupCount() - m_Slabs[SlabIndex].FreeCount : 0; }
+
+    UINT32 GetFreeCount() const { return m_FreeCount; }
+    UINT32 GetActiveSlabCount() const { return m_ActiveSlabCount; }
+    UINT32 GetCapacity() const { return m_ActiveSlabCount << m_SlabGroupShift; }
+    UINT32 GetMaxCapacity() const { return GetMaxSlabCount() << m_SlabGroupShift; }
+
+    bool ChainUsesSlab(UINT32 FirstIndex, UINT32 SlabIndex) const;
+
+    // An entirely free slab that can go while at least ReserveGroups stay free, or InvalidIndex.
+    UINT32 FindReleasableSlab(UINT32 ReserveGroups) const;
+
+    // The emptiest slab still in use, if no more than MaxUsedFraction of it is used and its
+    // groups would fit in the other slabs; otherwise InvalidIndex.
+    UINT32 FindCompactionSlab(FLOAT MaxUsedFraction) const;
+
+    // Walks every free list and checks it against the counts.
+    bool Validate() const;
+
+    // Replays a texture streaming workload against a fixed pool that stops mapping when
+    // full, as ElasticTilePool used to, and against this allocator with slab growth, LRU
+    // eviction, compaction and slab release, validating the bookkeeping throughout.
+    static bool Benchmark(UINT32 RequestCount, UINT32 MaxSlabCount);
+};
+
+// Sorts candidates least recently used first and returns how many from the front must be
+// evicted to free GroupsNeeded groups, or 0 if all of them would not be enough.
+UINT32 SelectTileEvictions(std::vector<TileEvictionCandidate>& Candidates, UINT32 GroupsNeeded);
@@ -1,60 +1,113 @@
 #include "pch.h"
 #include "TiledResources.h"
 #include "GraphicsCore.h"
+#include "CommandListManager.h"
 
 ElasticTilePool g_TilePool;
 static const UINT32 g_DefaultSlabTileShift = 10;
 
 ElasticTilePool::ElasticTilePool()
+    : m_TileGroupShift(0)
 {
-    ZeroMemory(m_Slabs, sizeof(m_Slabs));
+    ZeroMemory(&m_HeapDesc, sizeof(m_HeapDesc));
 }
 
 ElasticTilePool::~ElasticTilePool()
 {
 }
 
-void ElasticTilePool::Initialize(UINT32 TileGroupShift, UINT32 SlabTileShift, UINT32 SlabCount)
+void ElasticTilePool::Initialize(UINT32 TileGroupShift, UINT32 SlabTileShift, UINT32 MaxSlabCount)
 {
-    assert(SlabCount <= ARRAYSIZE(m_Slabs));
     assert(TileGroupShift < g_DefaultSlabTileShift);
     if (SlabTileShift == 0)
     {
         SlabTileShift = g_DefaultSlabTileShift - TileGroupShift;
     }
-    m_SlabTileShift = SlabTileShift;
     m_TileGroupShift = TileGroupShift;
-    m_SlabCount = SlabCount;
 
-    D3D12_HEAP_DESC HeapDesc = {};
-    HeapDesc.SizeInBytes = (UINT64)(D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES << TileGroupShift) << SlabTileShift;
-    HeapDesc.Alignment = D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES;
-    HeapDesc.Properties.Type = D3D12_HEAP_TYPE_DEFAULT;
-    HeapDesc.Flags = D3D12_HEAP_FLAG_NONE;
+    m_HeapDesc.SizeInBytes = (UINT64)(D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES << TileGroupShift) << SlabTileShift;
+    m_HeapDesc.Alignment = D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES;
+    m_HeapDesc.Properties.Type = D3D12_HEAP_TYPE_DEFAULT;
+    m_HeapDesc.Flags = D3D12_HEAP_FLAG_NONE;
 
-    for (UINT32 i = 0; i < SlabCount; ++i)
+    // Heaps are created as mapping needs them
+    m_Slabs.resize(MaxSlabCount);
+    ZeroMemory(m_Slabs.data(), MaxSlabCount * sizeof(HeapSlab));
+    m_FreeTiles.Initialize(SlabTileShift, MaxSlabCount);
+}
+
+void ElasticTilePool::Terminate()
+{
+    for (auto& Slab : m_Slabs)
     {
-        HeapSlab& Slab = m_Slabs[i];
-        Graphics::g_Device->CreateHeap(&HeapDesc, MY_IID_PPV_ARGS(&Slab.pHeap));
+        if (Slab.pHeap != nullptr)
+        {
+            Slab.pHeap->Release();
+            Slab.pHeap = nullptr;
+        }
+    }
+    while (!m_PendingReleases.empty())
+    {
+        m_PendingReleases.front().pHeap->Release();
+        m_PendingReleases.pop_front();
     }
+}
 
-    m_FreeTiles.AddIndices((1U << SlabTileShift) * SlabCount);
+bool ElasticTilePool::AddSlab()
+{
+    const UINT32 SlabIndex = m_FreeTiles.AddSlab();
+    if (SlabIndex == TileGroupAllocator::InvalidIndex)
+    {
+        return false;
+    }
+
+    HeapSlab& Slab = m_Slabs[SlabIndex];
+    assert(Slab.pHeap == nullptr);
+    ASSERT_SUCCEEDED(Graphics::g_Device->CreateHeap(&m_HeapDesc, MY_IID_PPV_ARGS(&Slab.pHeap)));
+    return true;
 }
 
-void ElasticTilePool::Terminate()
+void ElasticTilePool::ReleaseEmptySlabs()
+{
+    while (!m_PendingReleases.empty() && Graphics::g_CommandManager.IsFenceComplete(m_PendingReleases.front().FenceValue))
+    {
+        m_PendingReleases.front().pHeap->Release();
+        m_PendingReleases.pop_front();
+    }
+
+    // Keep half a slab free so that a texture coming and going does not churn heaps
+    UINT32 SlabIndex;
+    while ((SlabIndex = m_FreeTiles.FindReleasableSlab(m_FreeTiles.GetSlabGroupCount() / 2)) != TileGroupAllocator::InvalidIndex)
+    {
+        m_FreeTiles.ReleaseSlab(SlabIndex);
+
+        // Earlier frames may still read through tiles that were in this heap
+        PendingRelease Release;
+        Release.FenceValue = Graphics::g_CommandManager.GetGraphicsQueue().IncrementFence();
+        Release.pHeap = m_Slabs[SlabIndex].pHeap;
+        m_PendingReleases.push_back(Release);
+        m_Slabs[SlabIndex].pHeap = nullptr;
+    }
+}
+
+bool ElasticTilePool::IsTextureOnSlab(const TiledTextureBuffer* pTexture, UINT32 SlabIndex) const
 {
-    for (UINT32 i = 0; i < m_SlabCount; ++i)
+    for (UINT32 i = 0; i < pTexture->m_SubresourceCount; ++i)
     {
-        m_Slabs[i].pHeap->Release();
+        if (m_FreeTiles.ChainUsesSlab(pTexture->m_pTileIndices[i], SlabIndex))
+        {
+            return true;
+        }
     }
+    return false;
 }
 
 bool ElasticTilePool::MapTiledTextureSubresource(ID3D12CommandQueue* pQueue, TiledTextureBuffer* pTexture, UINT32 MipIndex, UINT32 SliceIndex)
 {
     const UINT32 SubresourceIndex = ((pTexture->m_NumMipMaps + 1) * SliceIndex) + MipIndex;
-    USHORT TileIndex = pTexture->m_pTileIndices[SubresourceIndex];
+    UINT32 TileIndex = pTexture->m_pTileIndices[SubresourceIndex];
 
-    if (TileIndex != IndexList::InvalidIndex)
+    if (TileIndex != TileGroupAllocator::InvalidIndex)
     {
         return false;
     }
@@ -66,13 +119,38 @@ bool ElasticTilePool::MapTiledTextureSubresource(ID3D12CommandQueue* pQueue, Til
     }
 
     const UINT32 TileSliceSize = SubTiling.WidthInTiles * SubTiling.HeightInTiles;
+    return MapTiles(pQueue, pTexture, SubresourceIndex, SubTiling.WidthInTiles, TileSliceSize, TileSliceSize * SubTiling.DepthInTiles);
+}
+
+bool ElasticTilePool::MapPackedMips(ID3D12CommandQueue* pQueue, TiledTextureBuffer* pTexture)
+{
+    const D3D12_PACKED_MIP_INFO& PackedMips = pTexture->m_PackedMips;
+    assert(pTexture->m_SubresourceCount == pTexture->m_NumMipMaps + 1);
+
+    // The chain is kept with the first packed mip
+    const UINT32 SubresourceIndex = PackedMips.NumStandardMips;
+    if (PackedMips.NumPackedMips == 0 || pTexture->m_pTileIndices[SubresourceIndex] != TileGroupAllocator::InvalidIndex)
+    {
+        return false;
+    }
 
-    UINT32 TileCount = (SubTiling.WidthInTiles * SubTiling.HeightInTiles * SubTiling.DepthInTiles);
+    // Packed tiles are addressed as a row starting at the first packed mip
+    const UINT32 TileCount = PackedMips.NumTilesForPackedMips;
+    return MapTiles(pQueue, pTexture, SubresourceIndex, TileCount, TileCount, TileCount);
+}
+
+bool ElasticTilePool::MapTiles(ID3D12CommandQueue* pQueue, TiledTextureBuffer* pTexture, UINT32 SubresourceIndex,
+    UINT32 WidthInTiles, UINT32 TileSliceSize, UINT32 TileCount)
+{
     const UINT32 TileGroupCount = (TileCount + (1 << m_TileGroupShift) - 1) >> m_TileGroupShift;
     assert(TileGroupCount > 0 && (TileGroupCount << m_TileGroupShift) >= TileCount);
 
-    TileIndex = m_FreeTiles.Allocate(TileGroupCount);
-    if (TileIndex == IndexList::InvalidIndex)
+    UINT32 TileIndex = m_FreeTiles.Allocate(TileGroupCount);
+    while (TileIndex == TileGroupAllocator::InvalidIndex && AddSlab())
+    {
+        TileIndex = m_FreeTiles.Allocate(TileGroupCount);
+    }
+    if (TileIndex == TileGroupAllocator::InvalidIndex)
     {
         return false;
     }
@@ -89,14 +167,13 @@ bool ElasticTilePool::MapTiledTextureSubresource(ID3D12CommandQueue* pQueue, Til
     UINT32 RangeCount = 0;
     UINT32 TileWithinSubresource = 0;
 
-    while (TileIndex != IndexList::InvalidIndex)
+    while (TileIndex != TileGroupAllocator::InvalidIndex)
     {
-        const UINT32 SlabIndex = (UINT32)(TileIndex >> m_SlabTileShift);
-        const UINT32 IndexWithinSlab = (UINT32)TileIndex & ((1U << m_SlabTileShift) - 1);
-        assert(SlabIndex < m_SlabCount);
+        const UINT32 SlabIndex = m_FreeTiles.GetSlabIndex(TileIndex);
+        const UINT32 IndexWithinSlab = m_FreeTiles.GetIndexWithinSlab(TileIndex);
         HeapSlab& Slab = m_Slabs[SlabIndex];
         assert(Slab.pHeap != nullptr);
-        if (Slab.pHeap != pPrevHeap)
+        if (Slab.pHeap != pPrevHeap || RangeCount == ARRAYSIZE(StartCoord))
         {
             if (pPrevHeap != nullptr)
             {
@@ -109,8 +186,8 @@ bool ElasticTilePool::MapTiledTextureSubresource(ID3D12CommandQueue* pQueue, Til
         const UINT32 RangeTileCount = std::min(TileCount, 1U << m_TileGroupShift);
 
         StartCoord[RangeCount].Subresource = SubresourceIndex;
-        StartCoord[RangeCount].X = (TileWithinSubresource % SubTiling.WidthInTiles);
-        StartCoord[RangeCount].Y = (TileWithinSubresource % TileSliceSize) / SubTiling.WidthInTiles;
+        StartCoord[RangeCount].X = (TileWithinSubresource % WidthInTiles);
+        StartCoord[RangeCount].Y = (TileWithinSubresource % TileSliceSize) / WidthInTiles;
         StartCoord[RangeCount].Z = TileWithinSubresource / TileSliceSize;
 
         RegionSizes[RangeCount].NumTiles = RangeTileCount;
@@ -144,13 +221,14 @@ bool ElasticTilePool::UnmapTiledTextureSubresource(ID3D12CommandQueue* pQueue, T
         return false;
     }
 
-    USHORT TileIndex = pTexture->m_pTileIndices[SubresourceIndex];
-    if (TileIndex == IndexList::InvalidIndex)
+    UINT32 TileIndex = pTexture->m_pTileIndices[SubresourceIndex];
+    if (TileIndex == TileGroupAllocator::InvalidIndex)
     {
         return true;
     }
 
     m_FreeTiles.Free(TileIndex);
+    pTexture->m_pTileIndices[SubresourceIndex] = TileGroupAllocator::InvalidIndex;
 
     const UINT32 TileCount = SubTiling.WidthInTiles * SubTiling.HeightInTiles * SubTiling.DepthInTiles;
     D3D12_TILED_RESOURCE_COORDINATE StartCoord = {};
@@ -172,7 +250,7 @@ void ElasticTilePool::FreeTiledTextureTiles(TiledTextureBuffer* pTexture)
     for (UINT32 i = 0; i < pTexture->m_SubresourceCount; ++i)
     {
         m_FreeTiles.Free(pTexture->m_pTileIndices[i]);
-        pTexture->m_pTileIndices[i] = IndexList::InvalidIndex;
+        pTexture->m_pTileIndices[i] = TileGroupAllocator::InvalidIndex;
     }
 }
 
@@ -184,7 +262,25 @@ void TiledTextureBuffer::Create(const std::wstring& Name, uint32_t Width, uint32
     CreateReservedResource(Graphics::g_Device, Name, ResourceDesc);
     CreateDerivedViews(Graphics::g_Device, Format, ArrayCount, 1);
 
-    const UINT32 SubresourceCount = ArrayCount * NumMips;
+    InitializeTiling(ArrayCount * NumMips);
+}
+
+void TiledTextureBuffer::CreateMipChain(const std::wstring& Name, uint32_t Width, uint32_t Height, uint32_t NumMips, DXGI_FORMAT Format)
+{
+    D3D12_RESOURCE_DESC ResourceDesc = DescribeTex2D(Width, Height, 1, NumMips, Format, D3D12_RESOURCE_FLAG_NONE);
+    ResourceDesc.Layout = D3D12_TEXTURE_LAYOUT_64KB_UNDEFINED_SWIZZLE;
+
+    CreateReservedResource(Graphics::g_Device, Name, ResourceDesc);
+    m_NumMipMaps = NumMips - 1;
+
+    InitializeTiling(NumMips);
+}
+
+void TiledTextureBuffer::InitializeTiling(UINT32 SubresourceCount)
+{
+    delete[] m_pSubresourceTilings;
+    delete[] m_pTileIndices;
+
     m_SubresourceCount = SubresourceCount;
     m_pSubresourceTilings = new D3D12_SUBRESOURCE_TILING[SubresourceCount];
     ZeroMemory(m_pSubresourceTilings, SubresourceCount * sizeof(D3D12_SUBRESOURCE_TILING));
@@ -192,13 +288,24 @@ void TiledTextureBuffer::Create(const std::wstring& Name, uint32_t Width, uint32
     UINT32 NumSubresourceTilings = SubresourceCount;
     Graphics::g_Device->GetResourceTiling(m_pResource.Get(), &m_TotalTileCount, &m_PackedMips, &m_TileShape, &NumSubresourceTilings, 0, m_pSubresourceTilings);
 
-    m_pTileIndices = new USHORT[SubresourceCount];
+    m_pTileIndices = new UINT32[SubresourceCount];
     for (UINT32 i = 0; i < SubresourceCount; ++i)
     {
-        m_pTileIndices[i] = IndexList::InvalidIndex;
+        m_pTileIndices[i] = TileGroupAllocator::InvalidIndex;
     }
 }
 
+UINT32 TiledTextureBuffer::GetMipChainTileCount(UINT32 FirstMip) const
+{
+    UINT32 TileCount = m_PackedMips.NumTilesForPackedMips;
+    for (UINT32 Mip = FirstMip; Mip < m_PackedMips.NumStandardMips; ++Mip)
+    {
+        const D3D12_SUBRESOURCE_TILING& SubTiling = m_pSubresourceTilings[Mip];
+        TileCount += SubTiling.WidthInTiles * SubTiling.HeightInTiles * SubTiling.DepthInTiles;
+    }
+    return TileCount;
+}
+
 void TiledTextureBuffer::CreateDerivedViews(ID3D12Device* Device, DXGI_FORMAT Format, uint32_t ArraySize, uint32_t NumMips)
 {
     ASSERT(ArraySize == 1 || NumMips == 1, "We don't support auto-mips on texture arrays");
@@ -239,6 +346,11 @@ void TiledTextureBuffer::CreateDerivedViews(ID3D12Device* Device, DXGI_FORMAT Fo
     {
         m_SRVHandle = Graphics::AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
     }
+    else
+    {
+        // Tables already copied from these views must not be reused
+        DescriptorAllocator::InvalidateCopies();
+    }
 
     ID3D12Resource* Resource = m_pResource.Get();
 
@@ -256,3 +368,20 @@ void TiledTextureBuffer::CreateDerivedViews(ID3D12Device* Device, DXGI_FORMAT Fo
         UAVDesc.Texture2D.MipSlice++;
     }
 }
+
+void TiledTextureBuffer::DestroyViews()
+{
+    if (m_SRVHandle.ptr != D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN)
+    {
+        Graphics::FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, m_SRVHandle);
+        m_SRVHandle.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
+    }
+    for (UINT32 i = 0; i < ARRAYSIZE(m_UAVHandle); ++i)
+    {
+        if (m_UAVHandle[i].ptr != D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN)
+        {
+            Graphics::FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, m_UAVHandle[i]);
+            m_UAVHandle[i].ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
+        }
+    }
+}
@@ -1,115 +1,14 @@
 #pragma once
 
 #include "PixelBuffer.h"
-
-class IndexList
-{
-private:
-    std::vector<USHORT> m_Indices;
-    USHORT m_FirstFreeIndex;
-    USHORT m_FreeCount;
-
-public:
-    static const USHORT InvalidIndex = -1;
-
-    IndexList(USHORT InitialSize = 0)
-    {
-        m_FirstFreeIndex = InvalidIndex;
-        m_FreeCount = 0;
-        AddIndices(InitialSize);
-    }
-
-    USHORT GetIndexCount() const { return (USHORT)m_Indices.size(); }
-    USHORT GetFreeIndexCount() const { return m_FreeCount; }
-
-    void AddIndices(UINT32 Count)
-    {
-        if (Count == 0)
-        {
-            return;
-        }
-
-        m_Indices.reserve(m_Indices.size() + Count);
-        const USHORT FirstIndex = (USHORT)m_Indices.size();
-        for (USHORT i = 0; i < (Count - 1); ++i)
-        {
-            m_Indices.push_back(i + 1);
-        }
-        m_Indices.push_back(m_FirstFreeIndex);
-        m_FirstFreeIndex = FirstIndex;
-        m_FreeCount += (USHORT)Count;
-        ValidateFreeCount();
-    }
-
-    USHORT Allocate(UINT32 Count = 1)
-    {
-        if (m_FreeCount < Count)
-        {
-            return InvalidIndex;
-        }
-
-        const UINT32 CheckCount = Count;
-        const UINT32 CheckFreeCount = m_FreeCount;
-        USHORT ReturnIndex = InvalidIndex;
-        while (Count > 0)
-        {
-            assert(m_FirstFreeIndex != InvalidIndex);
-            const USHORT NextFree = m_Indices[m_FirstFreeIndex];
-            m_Indices[m_FirstFreeIndex] = ReturnIndex;
-            ReturnIndex = m_FirstFreeIndex;
-            m_FirstFreeIndex = NextFree;
-            --m_FreeCount;
-            --Count;
-        }
-        ValidateFreeCount();
-        assert(CountList(ReturnIndex) == CheckCount);
-        assert(CheckCount + m_FreeCount == CheckFreeCount);
-
-        return ReturnIndex;
-    }
-
-    void Free(USHORT FirstIndex)
-    {
-        while (FirstIndex != InvalidIndex)
-        {
-            assert(FirstIndex < (USHORT)m_Indices.size());
-            USHORT NextIndex = m_Indices[FirstIndex];
-            m_Indices[FirstIndex] = m_FirstFreeIndex;
-            m_FirstFreeIndex = FirstIndex;
-            FirstIndex = NextIndex;
-            ++m_FreeCount;
-            assert(m_FreeCount <= m_Indices.size());
-        }
-        ValidateFreeCount();
-    }
-
-    USHORT GetNextIndex(USHORT Index) const
-    {
-        assert(Index < (USHORT)m_Indices.size());
-        return m_Indices[Index];
-    }
-
-private:
-    void ValidateFreeCount() const
-    {
-        assert(CountList(m_FirstFreeIndex) == m_FreeCount);
-    }
-
-    USHORT CountList(USHORT StartIndex) const
-    {
-        UINT32 Count = 0;
-        USHORT i = StartIndex;
-        while (i != InvalidIndex)
-        {
-            ++Count;
-            i = m_Indices[i];
-        }
-        return Count;
-    }
-};
+#include "TileGroupAllocator.h"
+#include <deque>
 
 class TiledTextureBuffer;
 
+// Heaps of tile groups for reserved resources.  Slabs of groups are created as mapping
+// needs them, up to MaxSlabCount, and released again once they empty and enough groups
+// stay free elsewhere.
 class ElasticTilePool
 {
 private:
@@ -118,27 +17,52 @@ private:
         ID3D12Heap* pHeap;
     };
 
-    HeapSlab m_Slabs[32];
-    UINT32 m_SlabCount;
-    UINT32 m_SlabTileShift;
+    struct PendingRelease
+    {
+        UINT64 FenceValue;
+        ID3D12Heap* pHeap;
+    };
+
+    std::vector<HeapSlab> m_Slabs;
+    std::deque<PendingRelease> m_PendingReleases;
     UINT32 m_TileGroupShift;
+    D3D12_HEAP_DESC m_HeapDesc;
 
-    IndexList m_FreeTiles;
+    TileGroupAllocator m_FreeTiles;
 
 public:
     ElasticTilePool();
     ~ElasticTilePool();
 
-    void Initialize(UINT32 TileGroupShift, UINT32 SlabTileShift, UINT32 SlabCount);
+    void Initialize(UINT32 TileGroupShift, UINT32 SlabTileShift, UINT32 MaxSlabCount);
     void Terminate();
 
-    UINT32 GetFreeTileGroupCount() const { return (UINT32)m_FreeTiles.GetFreeIndexCount(); }
+    // Groups that can be mapped without evicting anything, counting slabs not yet created
+    UINT32 GetFreeTileGroupCount() const { return m_FreeTiles.GetFreeCount() + m_FreeTiles.GetMaxCapacity() - m_FreeTiles.GetCapacity(); }
     UINT32 GetTileGroupCount(UINT32 TileCount) const { return (TileCount + (1 << m_TileGroupShift) - 1) >> m_TileGroupShift; }
 
     bool MapTiledTextureSubresource(ID3D12CommandQueue* pQueue, TiledTextureBuffer* pTexture, UINT32 MipIndex, UINT32 SliceIndex = 0);
     bool UnmapTiledTextureSubresource(ID3D12CommandQueue* pQueue, TiledTextureBuffer* pTexture, UINT32 MipIndex, UINT32 SliceIndex = 0);
 
+    // Maps the tiles shared by the packed mips of a single-slice texture.  They are only
+    // unmapped by FreeTiledTextureTiles.
+    bool MapPackedMips(ID3D12CommandQueue* pQueue, TiledTextureBuffer* pTexture);
+
     void FreeTiledTextureTiles(TiledTextureBuffer* pTexture);
+
+    // A sparsely used slab whose textures should be moved off it so that it can be
+    // released, or TileGroupAllocator::InvalidIndex.
+    UINT32 FindCompactionSlab() const { return m_FreeTiles.FindCompactionSlab(0.25f); }
+    bool IsTextureOnSlab(const TiledTextureBuffer* pTexture, UINT32 SlabIndex) const;
+
+    // Call once per frame: withdraws empty slabs and releases their heaps once the GPU is
+    // done with them.
+    void ReleaseEmptySlabs();
+
+private:
+    bool AddSlab();
+    bool MapTiles(ID3D12CommandQueue* pQueue, TiledTextureBuffer* pTexture, UINT32 SubresourceIndex,
+        UINT32 WidthInTiles, UINT32 TileSliceSize, UINT32 TileCount);
 };
 
 extern ElasticTilePool g_TilePool;
@@ -157,20 +81,38 @@ public:
         m_pSubresourceTilings = nullptr;
         m_pTileIndices = nullptr;
     }
+    ~TiledTextureBuffer()
+    {
+        DestroyViews();
+        delete[] m_pSubresourceTilings;
+        delete[] m_pTileIndices;
+    }
 
     void Create(const std::wstring& Name, uint32_t Width, uint32_t Height, uint32_t ArrayCount, uint32_t NumMips, DXGI_FORMAT Format);
 
+    // A read-only 2D texture with a full mip chain and no views, for streaming mips in and
+    // out by mapping them.  The caller creates views over the mips it has mapped.
+    void CreateMipChain(const std::wstring& Name, uint32_t Width, uint32_t Height, uint32_t NumMips, DXGI_FORMAT Format);
+
     // Get pre-created CPU-visible descriptor handles
     const D3D12_CPU_DESCRIPTOR_HANDLE& GetSRV(void) const { return m_SRVHandle; }
     const D3D12_CPU_DESCRIPTOR_HANDLE& GetUAV(void) const { return m_UAVHandle[0]; }
 
-    bool IsSubresourceMapped(UINT32 Index) const { return m_pTileIndices[Index] != IndexList::InvalidIndex; }
+    bool IsSubresourceMapped(UINT32 Index) const { return m_pTileIndices[Index] != TileGroupAllocator::InvalidIndex; }
     UINT32 GetTotalTileCount() const { return m_TotalTileCount; }
 
+    // Mips from here on are packed into shared tiles and cannot be mapped one at a time
+    UINT32 GetStandardMipCount() const { return m_PackedMips.NumStandardMips; }
+
+    // Tiles needed with mips FirstMip and below mapped, packed mips included
+    UINT32 GetMipChainTileCount(UINT32 FirstMip) const;
+
 protected:
     friend class ElasticTilePool;
 
     void CreateDerivedViews(ID3D12Device* Device, DXGI_FORMAT Format, uint32_t ArraySize, uint32_t NumMips = 1);
+    void DestroyViews();
+    void InitializeTiling(UINT32 SubresourceCount);
 
     D3D12_CPU_DESCRIPTOR_HANDLE m_SRVHandle;
     D3D12_CPU_DESCRIPTOR_HANDLE m_UAVHandle[12];
@@ -182,5 +124,5 @@ protected:
     D3D12_TILE_SHAPE m_TileShape;
     D3D12_SUBRESOURCE_TILING* m_pSubresourceTilings;
 
-    USHORT* m_pTileIndices;
+    UINT32* m_pTileIndices;
 };
@@ -38,6 +38,19 @@ namespace Utility
 		Print(buffer);
 	}
 
+	// Prints to the debugger and to stdout, for reports from command-line tools such as
+	// the server benchmarks
+	inline void PrintfConsole( const char* format, ... )
+	{
+		char buffer[512];
+		va_list ap;
+		va_start(ap, format);
+		vsprintf_s(buffer, 512, format, ap);
+		va_end(ap);
+		Print(buffer);
+		fputs(buffer, stdout);
+	}
+
 #ifndef RELEASE
 	inline void PrintSubMessage( const char* format, ... )
 	{
@@ -4,6 +4,7 @@
 #include "TessTerrain.h"
 #include "BulletPhysics.h"
 #include "LineRender.h"
+#include "Hash.h"
 
 WorldGridBuilder::WorldGridBuilder()
 {
@@ -195,9 +196,96 @@ void TerrainServerRenderer::Initialize(TessellatedTerrain* pTerrain, FLOAT Block
 void TerrainServerRenderer::Terminate()
 {
     m_pTessTerrain = nullptr;
+    m_pBlockCache = nullptr;
     WorldGridBuilder::Terminate();
 }
 
+void TerrainServerRenderer::SetBlockCache(TerrainBlockCache* pBlockCache)
+{
+    assert(m_pTessTerrain != nullptr);
+    m_pBlockCache = pBlockCache;
+
+    // Anything that changes the generated heights or placements must feed into the key
+    const UINT32 PhysicsMapDimension = m_pTessTerrain->GetPhysicsMapDimension();
+    const FLOAT WorldScale = m_pTessTerrain->GetWorldScale();
+    UINT64 Hash = TerrainBlockCache::HashConstructionDesc(m_pTessTerrain->GetConstructionDesc());
+    Hash = Utility::HashBytes64(&PhysicsMapDimension, sizeof(PhysicsMapDimension), Hash);
+    Hash = Utility::HashBytes64(&WorldScale, sizeof(WorldScale), Hash);
+    m_ConstructionDescHash = Hash;
+}
+
+TerrainBlockCacheKey TerrainServerRenderer::MakeCacheKey(const TerrainBlock* pBlock, UINT32 RecordType) const
+{
+    TerrainBlockCacheKey Key = {};
+    Key.CoordHash = pBlock->Coord.Hash;
+    Key.RandomSeed = m_pTessTerrain->GetConstructionDesc()->RandomSeed;
+    Key.DescHash = m_ConstructionDescHash;
+    Key.BlockWorldScale = m_BlockWorldScale;
+    Key.RecordType = RecordType;
+    return Key;
+}
+
+bool TerrainServerRenderer::LoadCachedHeightfield(TerrainBlock* pBlock)
+{
+    if (m_pBlockCache == nullptr)
+    {
+        return false;
+    }
+
+    std::vector<BYTE> Record;
+    if (!m_pBlockCache->Find(MakeCacheKey(pBlock, TBRT_Heightfield), Record) || Record.size() < sizeof(CachedHeightfieldHeader))
+    {
+        return false;
+    }
+
+    const CachedHeightfieldHeader* pHeader = (const CachedHeightfieldHeader*)Record.data();
+    const UINT32 SampleCount = pHeader->Width * pHeader->Height;
+    if (Record.size() != sizeof(CachedHeightfieldHeader) + SampleCount * sizeof(FLOAT))
+    {
+        return false;
+    }
+
+    BlockData* pBD = (BlockData*)pBlock->pData;
+    pBD->pCachedSamples = new FLOAT[SampleCount];
+    memcpy(pBD->pCachedSamples, pHeader + 1, SampleCount * sizeof(FLOAT));
+    pBD->Footprint.Format = DXGI_FORMAT_R32_FLOAT;
+    pBD->Footprint.Width = pHeader->Width;
+    pBD->Footprint.Height = pHeader->Height;
+    pBD->Footprint.Depth = 1;
+    pBD->Footprint.RowPitch = pHeader->Width * sizeof(FLOAT);
+    return true;
+}
+
+void TerrainServerRenderer::StoreCachedHeightfield(const TerrainBlock* pBlock)
+{
+    if (m_pBlockCache == nullptr)
+    {
+        return;
+    }
+
+    const BlockData* pBD = (const BlockData*)pBlock->pData;
+    const D3D12_SUBRESOURCE_FOOTPRINT& Footprint = pBD->Footprint;
+    assert(pBD->pGpuSamples != nullptr);
+
+    // Store the raw samples without row padding, so both map types can rescale them
+    const UINT32 RowSizeBytes = Footprint.Width * sizeof(FLOAT);
+    std::vector<BYTE> Record(sizeof(CachedHeightfieldHeader) + RowSizeBytes * Footprint.Height);
+    CachedHeightfieldHeader* pHeader = (CachedHeightfieldHeader*)Record.data();
+    pHeader->Width = Footprint.Width;
+    pHeader->Height = Footprint.Height;
+
+    BYTE* pDestRow = (BYTE*)(pHeader + 1);
+    const BYTE* pSrcRow = (const BYTE*)pBD->pGpuSamples;
+    for (UINT32 y = 0; y < Footprint.Height; ++y)
+    {
+        memcpy(pDestRow, pSrcRow, RowSizeBytes);
+        pDestRow += RowSizeBytes;
+        pSrcRow += Footprint.RowPitch;
+    }
+
+    m_pBlockCache->Insert(MakeCacheKey(pBlock, TBRT_Heightfield), Record.data(), Record.size());
+}
+
 void TerrainServerRenderer::InitializeBlockData(TerrainBlock* pNewBlock)
 {
     BlockData* pBD = (BlockData*)pNewBlock->pData;
@@ -208,9 +296,16 @@ void TerrainServerRenderer::InitializeBlockData(TerrainBlock* pNewBlock)
     }
     pBD->pData = nullptr;
     pBD->pGpuSamples = nullptr;
+    pBD->pCachedSamples = nullptr;
     pBD->HeightmapIndex = -1;
     pBD->MinValue = 0;
     pBD->MaxValue = 0;
+
+    if (LoadCachedHeightfield(pNewBlock))
+    {
+        // Cached blocks skip the GPU render entirely
+        pNewBlock->AvailableFence = -1;
+    }
 }
 
 void TerrainServerRenderer::DeleteBlockData(TerrainBlock* pBlock)
@@ -233,6 +328,12 @@ void TerrainServerRenderer::DeleteBlockData(TerrainBlock* pBlock)
         pBD->pData = nullptr;
     }
 
+    if (pBD->pCachedSamples != nullptr)
+    {
+        delete[] pBD->pCachedSamples;
+        pBD->pCachedSamples = nullptr;
+    }
+
     delete pBD;
     pBlock->pData = nullptr;
 }
@@ -241,6 +342,14 @@ bool TerrainServerRenderer::IsBlockInitialized(TerrainBlock* pNewBlock)
 {
     BlockData* pBD = (BlockData*)pNewBlock->pData;
 
+    if (pBD->pCachedSamples != nullptr)
+    {
+        ProcessTerrainHeightfield(pNewBlock);
+        delete[] pBD->pCachedSamples;
+        pBD->pCachedSamples = nullptr;
+        return true;
+    }
+
     if (pBD->HeightmapIndex == -1 || pNewBlock->AvailableFence == 0)
     {
         return false;
@@ -252,6 +361,7 @@ bool TerrainServerRenderer::IsBlockInitialized(TerrainBlock* pNewBlock)
     {
         assert(pBD->pGpuSamples != nullptr);
         ProcessTerrainHeightfield(pNewBlock);
+        StoreCachedHeightfield(pNewBlock);
         m_pTessTerrain->FreePhysicsHeightmap(pBD->HeightmapIndex);
         pBD->HeightmapIndex = -1;
         pBD->pGpuSamples = nullptr;
@@ -305,8 +415,8 @@ void TerrainServerRenderer::ConvertHeightmap(TerrainBlock* pBlock, FLOAT HeightS
     BlockData* pBD = (BlockData*)pBlock->pData;
     const D3D12_SUBRESOURCE_FOOTPRINT& Footprint = pBD->Footprint;
 
-    assert(pBD->HeightmapIndex != -1);
-    const FLOAT* pSrc = pBD->pGpuSamples;
+    assert(pBD->HeightmapIndex != -1 || pBD->pCachedSamples != nullptr);
+    const FLOAT* pSrc = pBD->pCachedSamples != nullptr ? pBD->pCachedSamples : pBD->pGpuSamples;
     const FLOAT* pSrcRow = pSrc;
     FLOAT* pSamples = new FLOAT[Footprint.Width * Footprint.Height];
     FLOAT* pDestRow = pSamples;
@@ -448,6 +558,11 @@ void TerrainObjectMap::ProcessTerrainHeightfield(TerrainBlock* pBlock)
     const D3D12_SUBRESOURCE_FOOTPRINT& Footprint = pBD->Footprint;
     ConvertHeightmap(pBlock, 1.0f);
 
+    if (LoadCachedPlacements(pBlock))
+    {
+        return;
+    }
+
     // Seed RNG with block coordinates
     Math::RandomNumberGenerator rng;
     rng.SetSeed((UINT32)pBlock->Coord.Hash ^ (UINT32)(pBlock->Coord.Hash >> 32));
@@ -477,6 +592,119 @@ void TerrainObjectMap::ProcessTerrainHeightfield(TerrainBlock* pBlock)
             CreatePlacement(NormXY, pBlock, OPStack, rng, SE.pParentPlacementDesc);
         }
     }
+
+    StoreCachedPlacements(pBlock);
+}
+
+Graphics::InstancedLODModel* TerrainObjectMap::FindInstancedModel(UINT64 ModelKey) const
+{
+    const UINT32 DescCount = (UINT32)m_pConstructionDesc->Placements.size();
+    for (UINT32 i = 0; i < DescCount; ++i)
+    {
+        const ObjectPlacementDesc* pOPD = m_pConstructionDesc->Placements[i];
+        if (pOPD->pInstancedLODModel != nullptr && TerrainBlockCache::HashModelFileName(pOPD->strModelFileName) == ModelKey)
+        {
+            return pOPD->pInstancedLODModel;
+        }
+    }
+    return nullptr;
+}
+
+UINT64 TerrainObjectMap::GetInstancedModelKey(const Graphics::InstancedLODModel* pModel) const
+{
+    const UINT32 DescCount = (UINT32)m_pConstructionDesc->Placements.size();
+    for (UINT32 i = 0; i < DescCount; ++i)
+    {
+        const ObjectPlacementDesc* pOPD = m_pConstructionDesc->Placements[i];
+        if (pOPD->pInstancedLODModel == pModel)
+        {
+            return TerrainBlockCache::HashModelFileName(pOPD->strModelFileName);
+        }
+    }
+    assert(false);
+    return 0;
+}
+
+bool TerrainObjectMap::LoadCachedPlacements(TerrainBlock* pBlock)
+{
+    if (m_pBlockCache == nullptr)
+    {
+        return false;
+    }
+
+    std::vector<BYTE> Record;
+    if (!m_pBlockCache->Find(MakeCacheKey(pBlock, TBRT_ObjectPlacements), Record) || Record.size() < sizeof(UINT32))
+    {
+        return false;
+    }
+
+    // Validate the whole record before touching the block, so a bad record falls back to generation
+    const BYTE* pRead = Record.data();
+    const BYTE* pEnd = pRead + Record.size();
+    const UINT32 GroupCount = *(const UINT32*)pRead;
+    pRead += sizeof(UINT32);
+    for (UINT32 i = 0; i < GroupCount; ++i)
+    {
+        if (pRead + sizeof(CachedPlacementGroupHeader) > pEnd)
+        {
+            return false;
+        }
+        const CachedPlacementGroupHeader* pGroupHeader = (const CachedPlacementGroupHeader*)pRead;
+        pRead += sizeof(CachedPlacementGroupHeader) + pGroupHeader->PlacementCount * sizeof(Graphics::MeshPlacementVertex);
+        if (pRead > pEnd || FindInstancedModel(pGroupHeader->ModelKey) == nullptr)
+        {
+            return false;
+        }
+    }
+
+    ObjectBlockData* pBD = (ObjectBlockData*)pBlock->pData;
+    pRead = Record.data() + sizeof(UINT32);
+    for (UINT32 i = 0; i < GroupCount; ++i)
+    {
+        const CachedPlacementGroupHeader* pGroupHeader = (const CachedPlacementGroupHeader*)pRead;
+        const Graphics::MeshPlacementVertex* pPlacements = (const Graphics::MeshPlacementVertex*)(pGroupHeader + 1);
+        InstanceModelPlacementBuffer* pPB = FindIMPlacementBuffer(pBD, FindInstancedModel(pGroupHeader->ModelKey));
+        pPB->Placements.assign(pPlacements, pPlacements + pGroupHeader->PlacementCount);
+        pRead = (const BYTE*)(pPlacements + pGroupHeader->PlacementCount);
+    }
+
+    return true;
+}
+
+void TerrainObjectMap::StoreCachedPlacements(const TerrainBlock* pBlock) const
+{
+    if (m_pBlockCache == nullptr)
+    {
+        return;
+    }
+
+    // Record layout: group count, then per model { model file hash, placement count, placements }
+    const ObjectBlockData* pBD = (const ObjectBlockData*)pBlock->pData;
+    std::vector<BYTE> Record(sizeof(UINT32));
+    UINT32 GroupCount = 0;
+
+    auto iter = pBD->PlacementBuffers.begin();
+    auto end = pBD->PlacementBuffers.end();
+    while (iter != end)
+    {
+        const InstanceModelPlacementBuffer* pPB = iter->second;
+        ++iter;
+
+        CachedPlacementGroupHeader GroupHeader = {};
+        GroupHeader.ModelKey = GetInstancedModelKey(pPB->pModel);
+        GroupHeader.PlacementCount = (UINT32)pPB->Placements.size();
+        const BYTE* pHeaderBytes = (const BYTE*)&GroupHeader;
+        Record.insert(Record.end(), pHeaderBytes, pHeaderBytes + sizeof(GroupHeader));
+        if (!pPB->Placements.empty())
+        {
+            const BYTE* pPlacementBytes = (const BYTE*)pPB->Placements.data();
+            Record.insert(Record.end(), pPlacementBytes, pPlacementBytes + pPB->Placements.size() * sizeof(Graphics::MeshPlacementVertex));
+        }
+        ++GroupCount;
+    }
+
+    *(UINT32*)Record.data() = GroupCount;
+    m_pBlockCache->Insert(MakeCacheKey(pBlock, TBRT_ObjectPlacements), Record.data(), Record.size());
 }
 
 void TerrainObjectMap::CreatePlacement(XMVECTOR NormalizedXY, const TerrainBlock* pBlock, ObjectPlacementStack& PlacementStack, Math::RandomNumberGenerator& rng, const ObjectPlacementDesc* pParentDesc)
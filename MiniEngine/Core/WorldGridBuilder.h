@@ -6,6 +6,7 @@
 #include <DirectXPackedVector.h>
 
 #include "InstancedLODModels.h"
+#include "TerrainBlockCache.h"
 #include "Math\Random.h"
 
 class WorldGridBuilder
@@ -105,24 +106,36 @@ class TerrainServerRenderer : public WorldGridBuilder
 {
 protected:
     TessellatedTerrain* m_pTessTerrain;
+    TerrainBlockCache* m_pBlockCache;
+    UINT64 m_ConstructionDescHash;
 
     struct BlockData
     {
         FLOAT* pData;
         UINT32 HeightmapIndex;
         const FLOAT* pGpuSamples;
+        FLOAT* pCachedSamples;
         D3D12_SUBRESOURCE_FOOTPRINT Footprint;
         FLOAT MinValue;
         FLOAT MaxValue;
     };
 
+    struct CachedHeightfieldHeader
+    {
+        UINT32 Width;
+        UINT32 Height;
+    };
+
 public:
     TerrainServerRenderer()
-        : m_pTessTerrain(nullptr)
+        : m_pTessTerrain(nullptr),
+          m_pBlockCache(nullptr),
+          m_ConstructionDescHash(0)
     { }
 
     void Initialize(TessellatedTerrain* pTerrain, FLOAT BlockWorldScale);
     void Terminate();
+    void SetBlockCache(TerrainBlockCache* pBlockCache);
 
     void ServerRender(GraphicsContext* pContext);
 
@@ -135,6 +148,10 @@ protected:
 
     void ConvertHeightmap(TerrainBlock* pBlock, FLOAT HeightScaleFactor);
 
+    TerrainBlockCacheKey MakeCacheKey(const TerrainBlock* pBlock, UINT32 RecordType) const;
+    bool LoadCachedHeightfield(TerrainBlock* pBlock);
+    void StoreCachedHeightfield(const TerrainBlock* pBlock);
+
     virtual void ProcessTerrainHeightfield(TerrainBlock* pBlock) {}
     virtual void CompleteTerrainHeightfield(TerrainBlock* pBlock, TerrainBlock* pNeighborBlocks[4]) {}
 };
@@ -194,6 +211,13 @@ protected:
     };
     typedef std::deque<ObjectPlacementStackEntry> ObjectPlacementStack;
 
+    struct CachedPlacementGroupHeader
+    {
+        UINT64 ModelKey;
+        UINT32 PlacementCount;
+        UINT32 Reserved;
+    };
+
     enum TerrainSlopeType
     {
         TST_Unknown = 0,
@@ -225,5 +249,9 @@ protected:
 
 private:
     InstanceModelPlacementBuffer* FindIMPlacementBuffer(ObjectBlockData* pBlockData, Graphics::InstancedLODModel* pModel) const;
+    Graphics::InstancedLODModel* FindInstancedModel(UINT64 ModelKey) const;
+    UINT64 GetInstancedModelKey(const Graphics::InstancedLODModel* pModel) const;
+    bool LoadCachedPlacements(TerrainBlock* pBlock);
+    void StoreCachedPlacements(const TerrainBlock* pBlock) const;
     void CharacterizeTerrain(XMVECTOR NormalizedXY, FLOAT CenterHeight, const TerrainBlock* pBlock, TerrainCharacterization* pTC) const;
 };
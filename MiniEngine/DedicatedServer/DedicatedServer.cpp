@@ -3,6 +3,15 @@
 
 #include "stdafx.h"
 #include "TessTerrain.h"
+#include "DDSLayout.h"
+#include "FileUtility.h"
+#include "BuddyRangeAllocator.h"
+#include "LinearPagePool.h"
+#include "GpuJobScheduler.h"
+#include "TileGroupAllocator.h"
+#include "CpuProfiler.h"
+#include "LatencyHistogram.h"
+#include "PipelineStateCache.h"
 
 class PrintfDebugListener : public INetDebugListener
 {
@@ -21,23 +30,109 @@ void InitializeEngine()
     StringID::Initialize();
     Graphics::Initialize();
     SystemTime::Initialize();
+    EngineTuning::Initialize();
     DataFile::SetDataFileRootPath("Data");
+    World::InitializeTerrainBlockCache(L"TerrainBlockCacheServer.dat");
 }
 
 void TerminateEngine()
 {
+    EngineTuning::StopRemoteControl();
     g_Server.Terminate();
+    World::TerminateTerrainBlockCache();
     Graphics::Terminate();
     Graphics::Shutdown();
 }
 
-int main()
+// Returns argv[Index] as a number, or Default if it was not given
+static UINT32 GetArgument(int argc, char* argv[], int Index, UINT32 Default)
+{
+    return (argc > Index) ? (UINT32)atoi(argv[Index]) : Default;
+}
+
+static std::wstring GetArgument(int argc, char* argv[], int Index, const std::wstring& Default)
+{
+    return (argc > Index) ? MakeWStr(argv[Index]) : Default;
+}
+
+// "-name [arguments]" runs one of these instead of the server; the exit code is 0 if it passed
+struct BenchmarkCommand
+{
+    const char* strName;
+    bool (*pRun)(int argc, char* argv[]);
+};
+
+static const BenchmarkCommand s_BenchmarkCommands[] =
+{
+    { "-physicsbench", [](int argc, char* argv[]) { return PhysicsWorld::BenchmarkThreadScaling(GetArgument(argc, argv, 2, 256), GetArgument(argc, argv, 3, 300)); } },
+    { "-raybench", [](int argc, char* argv[]) { return PhysicsWorld::BenchmarkRayThroughput(GetArgument(argc, argv, 2, 65536), GetArgument(argc, argv, 3, 10)); } },
+    { "-renderqueuebench", [](int argc, char* argv[]) { return ModelRenderQueue::Benchmark(GetArgument(argc, argv, 2, 16384), GetArgument(argc, argv, 3, 64), GetArgument(argc, argv, 4, 100)); } },
+    { "-cullbench", [](int argc, char* argv[]) { return ModelCuller::Benchmark(GetArgument(argc, argv, 2, 65536), GetArgument(argc, argv, 3, 100)); } },
+    { "-descriptorbench", [](int argc, char* argv[]) { return DescriptorRangeAllocator::Benchmark(GetArgument(argc, argv, 2, 1000000), GetArgument(argc, argv, 3, 4096)); } },
+    { "-descriptortablebench", [](int argc, char* argv[]) { return DescriptorTableReuseCache::Benchmark(GetArgument(argc, argv, 2, 300), GetArgument(argc, argv, 3, 4000), GetArgument(argc, argv, 4, 100)); } },
+    { "-psocachebench", [](int argc, char* argv[]) { return PipelineStateCache::Benchmark(GetArgument(argc, argv, 2, 256)); } },
+    { "-ddslayouttest", [](int argc, char* argv[]) { return ValidateDDSLayouts(GetArgument(argc, argv, 2, std::wstring())); } },
+    { "-filereadbench", [](int argc, char* argv[])
+        {
+            if (argc < 3)
+            {
+                Utility::PrintfConsole("Usage: -filereadbench <file> [iterations]\n");
+                return false;
+            }
+            return Utility::BenchmarkFileReads(MakeWStr(argv[2]), GetArgument(argc, argv, 3, 16));
+        } },
+    { "-buddybench", [](int argc, char* argv[]) { return BuddyRangeAllocator::Benchmark(GetArgument(argc, argv, 2, 1000000), GetArgument(argc, argv, 3, 16)); } },
+    { "-pagepoolbench", [](int argc, char* argv[]) { return LinearPagePool::Benchmark(GetArgument(argc, argv, 2, 4), GetArgument(argc, argv, 3, 500000)); } },
+    { "-gpujobbench", [](int argc, char* argv[]) { return GpuJobScheduler::Benchmark(GetArgument(argc, argv, 3, std::wstring()), GetArgument(argc, argv, 2, 4000)); } },
+    { "-tilepoolbench", [](int argc, char* argv[]) { return TileGroupAllocator::Benchmark(GetArgument(argc, argv, 2, 1000000), GetArgument(argc, argv, 3, 16)); } },
+    { "-profilerbench", [](int argc, char* argv[]) { return CpuProfiler::Benchmark(GetArgument(argc, argv, 2, 4), GetArgument(argc, argv, 3, 1000000)); } },
+    { "-latencybench", [](int argc, char* argv[]) { return LatencyHistogram::Benchmark(GetArgument(argc, argv, 2, 4), GetArgument(argc, argv, 3, 1000000)); } },
+    { "-predictbench", [](int argc, char* argv[]) { return ClientPredictStore::Benchmark(GetArgument(argc, argv, 2, 1024), GetArgument(argc, argv, 3, 600)); } },
+    { "-memberbench", [](int argc, char* argv[]) { return NetworkMembers::Benchmark(GetArgument(argc, argv, 2, 2000), GetArgument(argc, argv, 3, 300)); } },
+    { "-reliablebench", [](int argc, char* argv[]) { return ReliableChannel::Benchmark(GetArgument(argc, argv, 2, 2000), GetArgument(argc, argv, 3, 5)); } },
+};
+
+int main(int argc, char* argv[])
 {
     UINT32 ConnectToPort = 31338;
 
+    if (argc > 1)
+    {
+        for (const BenchmarkCommand& Command : s_BenchmarkCommands)
+        {
+            if (_stricmp(argv[1], Command.strName) == 0)
+            {
+                SystemTime::Initialize();
+                const bool Passed = Command.pRun(argc, argv);
+                Utility::PrintfConsole("%s: %s\n", Command.strName + 1, Passed ? "passed" : "FAILED");
+                return Passed ? 0 : 1;
+            }
+        }
+    }
+
+    // -cputrace <file> [seconds] rewrites a Chrome trace of the recent ticks periodically
+    std::wstring CpuTraceFileName;
+    UINT32 CpuTraceIntervalSeconds = 30;
+    if (argc > 2 && _stricmp(argv[1], "-cputrace") == 0)
+    {
+        CpuTraceFileName = MakeWStr(argv[2]);
+        CpuTraceIntervalSeconds = (argc > 3) ? std::max(1, atoi(argv[3])) : CpuTraceIntervalSeconds;
+    }
+
     g_Server.AddDebugListener(&g_DebugListener);
 
     InitializeEngine();
+    CpuProfiler::SetThreadName("Main");
+
+    // Settings can be edited in ServerTuning.txt or sent to the loopback port while running
+    EngineTuning::WatchSettingsFile(L"ServerTuning.txt");
+    if (!EngineTuning::StartRemoteControl((USHORT)(ConnectToPort + 1)))
+    {
+        printf("Could not listen for tuning commands on port %u\n", ConnectToPort + 1);
+    }
+
+    const INT64 CpuTraceIntervalTicks = (INT64)(CpuTraceIntervalSeconds / SystemTime::TicksToSeconds(1));
+    INT64 NextCpuTraceTick = SystemTime::GetCurrentTick() + CpuTraceIntervalTicks;
 
     g_Server.Start(15, ConnectToPort, false);
 
@@ -50,11 +145,27 @@ int main()
     {
         if (g_Server.SingleThreadedTick())
         {
+            EngineTuning::ApplyChanges();
+
             GraphicsContext& gfxContext = GraphicsContext::Begin(L"Server Render");
             g_Server.GetWorld()->GetTerrainPhysicsMap()->ServerRender(&gfxContext);
             gfxContext.Finish();
         }
+
+        LatencyHistogram::UpdateLog();
+
+        if (!CpuTraceFileName.empty() && SystemTime::GetCurrentTick() >= NextCpuTraceTick)
+        {
+            CpuProfiler::ExportChromeTrace(CpuTraceFileName);
+            NextCpuTraceTick = SystemTime::GetCurrentTick() + CpuTraceIntervalTicks;
+        }
+    }
+
+    if (!CpuTraceFileName.empty())
+    {
+        CpuProfiler::ExportChromeTrace(CpuTraceFileName);
     }
+    LatencyHistogram::WriteLog();
 
     TerminateEngine();
 
@@ -89,7 +89,7 @@ private:
 
     void ProcessCommandLine();
     bool ProcessCommand(const CHAR* strCommand, const CHAR* strArgument);
-	void RenderObjects(GraphicsContext& Context, const BaseCamera& Camera, PsoLayoutCache* pPsoCache, RenderPass PassType);
+	void RenderObjects(GraphicsContext& Context, const BaseCamera& Camera, PsoLayoutCache* pPsoCache, RenderPass PassType, const std::function<void(GraphicsContext&)>& SetupParallelChunk);
 
     void RemoteObjectCreated(ModelInstance* pModelInstance, UINT ParentObjectID);
     void RemoteObjectDeleted(ModelInstance* pModelInstance);
@@ -128,6 +128,7 @@ private:
     std::set<ModelInstance*> m_ControllableModelInstances;
 
     bool m_StartServer;
+    CHAR m_strTextureBenchmarkDir[MAX_PATH];
     GameNetServer m_NetServer;
     PrintfDebugListener m_ServerDebugListener;
 
@@ -214,6 +215,7 @@ void GameClient::LogMovementSample(const Vector3& ClientPos, const Vector3& Delt
 void GameClient::Startup( void )
 {
     m_StartServer = true;
+    m_strTextureBenchmarkDir[0] = '\0';
     strcpy_s(m_strConnectToServerName, "localhost");
     m_ConnectToPort = 31338;
 
@@ -229,6 +231,7 @@ void GameClient::Startup( void )
     TestData* pTestData = (TestData*)DataFile::LoadStructFromFile(STRUCT_TEMPLATE_REFERENCE(TestData), "foo");
 
     World::LoadTerrainConstructionDesc("World1");
+    World::InitializeTerrainBlockCache(L"TerrainBlockCacheClient.dat");
 
 	m_RootSig.Reset(6, 2);
 	m_RootSig.InitStaticSampler(0, SamplerAnisoWrapDesc, D3D12_SHADER_VISIBILITY_PIXEL);
@@ -289,6 +292,10 @@ void GameClient::Startup( void )
     m_ExtraTextures[2] = g_OuterShadowBuffer.GetSRV();
 
 	TextureManager::Initialize(L"Textures/");
+    if (m_strTextureBenchmarkDir[0] != '\0')
+    {
+        TextureManager::Benchmark(MakeWStr(m_strTextureBenchmarkDir));
+    }
 
     m_NetClient.InitializeWorld();
     m_pClientWorld = m_NetClient.GetWorld();
@@ -461,6 +468,17 @@ bool GameClient::ProcessCommand(const CHAR* strCommand, const CHAR* strArgument)
         m_StartServer = false;
         m_ConnectToPort = 0;
     }
+    else if (_stricmp(strCommand, "texturebench") == 0)
+    {
+        if (strArgument != nullptr)
+        {
+            strcpy_s(m_strTextureBenchmarkDir, strArgument);
+        }
+        else
+        {
+            InvalidArgument = true;
+        }
+    }
     else
     {
         Utility::Printf("Invalid command: %s\n", strCommand);
@@ -540,6 +558,8 @@ void GameClient::Cleanup( void )
 
     m_NetClient.Terminate();
 
+    World::TerminateTerrainBlockCache();
+
 	delete m_pCameraController;
 	m_pCameraController = nullptr;
 
@@ -799,7 +819,7 @@ bool GameClient::IsDone()
     return false;
 }
 
-void GameClient::RenderObjects(GraphicsContext& gfxContext, const BaseCamera& Camera, PsoLayoutCache* pPsoCache, RenderPass PassType)
+void GameClient::RenderObjects(GraphicsContext& gfxContext, const BaseCamera& Camera, PsoLayoutCache* pPsoCache, RenderPass PassType, const std::function<void(GraphicsContext&)>& SetupParallelChunk)
 {
     ModelRenderContext MRC;
     MRC.pContext = &gfxContext;
@@ -813,6 +833,7 @@ void GameClient::RenderObjects(GraphicsContext& gfxContext, const BaseCamera& Ca
     MRC.pPsoCache = pPsoCache;
     MRC.LastInputLayoutIndex = -1;
     MRC.CurrentPassType = PassType;
+    MRC.SetupParallelChunk = SetupParallelChunk;
 
     m_pClientWorld->Render(MRC);
 
@@ -881,13 +902,17 @@ void GameClient::RenderScene( void )
 		gfxContext.TransitionResource(g_SceneDepthBuffer, D3D12_RESOURCE_STATE_DEPTH_WRITE, true);
 		gfxContext.ClearDepth(g_SceneDepthBuffer);
 
-		gfxContext.SetRootSignature(m_RootSig);
-		gfxContext.SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-		gfxContext.SetDynamicConstantBufferView(1, sizeof(psConstants), &psConstants);
+		auto pfnSetupZPrePass = [&](GraphicsContext& Context)
+		{
+			Context.SetRootSignature(m_RootSig);
+			Context.SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+			Context.SetDynamicConstantBufferView(1, sizeof(psConstants), &psConstants);
+			Context.SetDepthStencilTarget(g_SceneDepthBuffer.GetDSV());
+			Context.SetViewportAndScissor(m_MainViewport, m_MainScissor);
+		};
 
-		gfxContext.SetDepthStencilTarget(g_SceneDepthBuffer.GetDSV());
-		gfxContext.SetViewportAndScissor(m_MainViewport, m_MainScissor);
-		RenderObjects(gfxContext, m_Camera, &m_DepthPSOCache, RenderPass_ZPrePass);
+		pfnSetupZPrePass(gfxContext);
+		RenderObjects(gfxContext, m_Camera, &m_DepthPSOCache, RenderPass_ZPrePass, pfnSetupZPrePass);
 
         RD.ZPrePass = true;
         m_NetClient.GetWorld()->GetTerrain()->Render(&gfxContext, &RD);
@@ -903,21 +928,25 @@ void GameClient::RenderScene( void )
 		gfxContext.ClearColor(g_SceneColorBuffer);
 
 		// Set the default state for command lists
-		auto& pfnSetupGraphicsState = [&](void)
+		auto pfnSetupGraphicsState = [&](GraphicsContext& Context)
 		{
-			gfxContext.SetRootSignature(m_RootSig);
-			gfxContext.SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-			gfxContext.SetDynamicDescriptors(4, 0, 3, m_ExtraTextures);
-			gfxContext.SetDynamicConstantBufferView(1, sizeof(psConstants), &psConstants);
+			Context.SetRootSignature(m_RootSig);
+			Context.SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+			Context.SetDynamicDescriptors(4, 0, 3, m_ExtraTextures);
+			Context.SetDynamicConstantBufferView(1, sizeof(psConstants), &psConstants);
 		};
 
-		pfnSetupGraphicsState();
+		pfnSetupGraphicsState(gfxContext);
 
 		{
 			ScopedTimer _prof(L"Render Inner Shadow Map", gfxContext);
 
 			g_ShadowBuffer.BeginRendering(gfxContext);
-            RenderObjects(gfxContext, m_SunShadow, &m_ShadowPSOCache, RenderPass_Shadow);
+            RenderObjects(gfxContext, m_SunShadow, &m_ShadowPSOCache, RenderPass_Shadow, [&](GraphicsContext& Context)
+            {
+                pfnSetupGraphicsState(Context);
+                g_ShadowBuffer.BindTarget(Context);
+            });
 			g_ShadowBuffer.EndRendering(gfxContext);
 		}
 
@@ -925,14 +954,18 @@ void GameClient::RenderScene( void )
             ScopedTimer _prof(L"Render Outer Shadow Map", gfxContext);
 
             g_OuterShadowBuffer.BeginRendering(gfxContext);
-            RenderObjects(gfxContext, m_SunShadowOuter, &m_ShadowPSOCache, RenderPass_Shadow);
+            RenderObjects(gfxContext, m_SunShadowOuter, &m_ShadowPSOCache, RenderPass_Shadow, [&](GraphicsContext& Context)
+            {
+                pfnSetupGraphicsState(Context);
+                g_OuterShadowBuffer.BindTarget(Context);
+            });
             g_OuterShadowBuffer.EndRendering(gfxContext);
         }
 
         if (SSAO::AsyncCompute)
 		{
 			gfxContext.Flush();
-			pfnSetupGraphicsState();
+			pfnSetupGraphicsState(gfxContext);
 
 			// Make the 3D queue wait for the Compute queue to finish SSAO
 			g_CommandManager.GetGraphicsQueue().StallForProducer(g_CommandManager.GetComputeQueue());
@@ -946,7 +979,12 @@ void GameClient::RenderScene( void )
 			gfxContext.SetRenderTarget(g_SceneColorBuffer.GetRTV(), g_SceneDepthBuffer.GetDSV());
 			gfxContext.SetViewportAndScissor(m_MainViewport, m_MainScissor);
             gfxContext.SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-            RenderObjects(gfxContext, m_Camera, &m_ModelPSOCache, RenderPass_Color);
+            RenderObjects(gfxContext, m_Camera, &m_ModelPSOCache, RenderPass_Color, [&](GraphicsContext& Context)
+            {
+                pfnSetupGraphicsState(Context);
+                Context.SetRenderTarget(g_SceneColorBuffer.GetRTV(), g_SceneDepthBuffer.GetDSV());
+                Context.SetViewportAndScissor(m_MainViewport, m_MainScissor);
+            });
 
             RD.ZPrePass = false;
             m_NetClient.GetWorld()->GetTerrain()->Render(&gfxContext, &RD);
@@ -13,11 +13,7 @@
 //
 
 #include "GameClientRS.hlsli"
-
-cbuffer VSConstants : register(b0)
-{
-	float4x4 modelToProjection;
-};
+#include "ModelInstanceVS.hlsli"
 
 struct VSInput
 {
@@ -35,10 +31,12 @@ struct VSOutput
 };
 
 [RootSignature(ModelViewer_RootSig)]
-VSOutput main(VSInput vsInput)
+VSOutput main(VSInput vsInput, uint InstanceID : SV_InstanceID)
 {
 	VSOutput vsOutput;
 
+	float4x4 modelToProjection = ModelInstances[FirstInstance + InstanceID].modelToProjection;
+
 	vsOutput.position = mul(modelToProjection, float4(vsInput.position, 1.0));
 	vsOutput.texcoord0 = vsInput.texcoord0;
 
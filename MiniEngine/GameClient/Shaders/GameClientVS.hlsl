@@ -13,15 +13,7 @@
 //
 
 #include "GameClientRS.hlsli"
-
-cbuffer VSConstants : register(b0)
-{
-	float4x4 modelToProjection;
-	float4x4 modelToShadow;
-    float4x4 modelToShadowOuter;
-    float4x4 modelToWorld;
-	float3 ViewerPos;
-};
+#include "ModelInstanceVS.hlsli"
 
 struct VSInput
 {
@@ -33,10 +25,17 @@ struct VSInput
 };
 
 [RootSignature(ModelViewer_RootSig)]
-ObjectVSOutput main(VSInput vsInput)
+ObjectVSOutput main(VSInput vsInput, uint InstanceID : SV_InstanceID)
 {
 	ObjectVSOutput vsOutput;
 
+	ModelInstanceConstants Instance = ModelInstances[FirstInstance + InstanceID];
+	float4x4 modelToProjection = Instance.modelToProjection;
+	float4x4 modelToShadow = Instance.modelToShadow;
+	float4x4 modelToShadowOuter = Instance.modelToShadowOuter;
+	float4x4 modelToWorld = Instance.modelToWorld;
+	float3 ViewerPos = Instance.ViewerPos;
+
 	vsOutput.position = mul(modelToProjection, float4(vsInput.position, 1.0));
 	vsOutput.texcoord0 = vsInput.texcoord0;
 	vsOutput.viewDir = mul(modelToWorld, float4(vsInput.position, 1.0)).xyz - ViewerPos;
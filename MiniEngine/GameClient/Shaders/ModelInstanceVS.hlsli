@@ -0,0 +1,18 @@
+// Per-instance constants, laid out to match VSModelConstants.  The render queue draws
+// each batch of instances with its first index in FirstInstance.
+struct ModelInstanceConstants
+{
+	float4x4 modelToProjection;
+	float4x4 modelToShadow;
+	float4x4 modelToShadowOuter;
+	float4x4 modelToWorld;
+	float3 ViewerPos;
+	float Pad;
+};
+
+StructuredBuffer<ModelInstanceConstants> ModelInstances : register(t0);
+
+cbuffer InstanceConstants : register(b1)
+{
+	uint FirstInstance;
+};
@@ -184,7 +184,7 @@ void GameNetClient::Terminate()
 VOID GameNetServer::InitializeServer()
 {
     m_NextObjectID = 1000;
-    m_World.Initialize(false, this);
+    m_World.Initialize(false, this, PWF_Multithreaded);
 
 	//DecomposedTransform DT = DecomposedTransform::CreateFromComponents(XMFLOAT3(0, 300, 0));
 	//m_pTestInstance = (ModelInstance*)SpawnObject(nullptr, "*staticbox1:1:1", nullptr, DT, XMFLOAT3(0, 0, 0));
@@ -210,6 +210,16 @@ VOID GameNetServer::TickServer(FLOAT DeltaTime, DOUBLE AbsoluteTime)
         pSNO->ServerTick(this, DeltaTime, AbsoluteTime);
     }
     m_World.Tick(DeltaTime, 0);
+
+    const WorldTickStatistics& TickStats = m_World.GetLastTickStatistics();
+    NetFrameStatistics* pStats = GetCurrentStatistics();
+    pStats->PrePhysicsMsec = TickStats.PrePhysicsMsec;
+    pStats->PhysicsMsec = TickStats.PhysicsMsec;
+    pStats->PostPhysicsMsec = TickStats.PostPhysicsMsec;
+    pStats->TerrainUpdateMsec = TickStats.TerrainUpdateMsec;
+    pStats->PhysicsSubsteps = TickStats.PhysicsSteps;
+    pStats->PhysicsSubstepsDropped = TickStats.DroppedPhysicsSteps;
+    pStats->ModelInstanceCount = TickStats.ModelInstanceCount;
 }
 
 VOID GameNetServer::TerminateServer()
@@ -552,27 +562,6 @@ void GameNetServer::ClearNode(PlaceNode* pNode)
     DataFile::Unload(pNode);
 }
 
-void InputRemotingObject::GetMemberDatas(const MemberDataPosition** ppMemberDatas, UINT* pMemberDataCount) const
-{
-    static const MemberDataPosition Members[] =
-    {
-        { StateNodeType::Float,             offsetof(InputRemotingObject, m_XAxis0),         sizeof(FLOAT) },
-        { StateNodeType::Float,             offsetof(InputRemotingObject, m_YAxis0),         sizeof(FLOAT) },
-        { StateNodeType::Float,             offsetof(InputRemotingObject, m_XAxis1),         sizeof(FLOAT) },
-        { StateNodeType::Float,             offsetof(InputRemotingObject, m_YAxis1),         sizeof(FLOAT) },
-        { StateNodeType::Float,             offsetof(InputRemotingObject, m_LeftTrigger),    sizeof(FLOAT) },
-        { StateNodeType::Float,             offsetof(InputRemotingObject, m_RightTrigger),   sizeof(FLOAT) },
-        { StateNodeType::Integer,           offsetof(InputRemotingObject, m_Buttons[0]),     sizeof(UINT32) },
-        { StateNodeType::Integer,           offsetof(InputRemotingObject, m_Buttons[1]),     sizeof(UINT32) },
-        { StateNodeType::Integer,           offsetof(InputRemotingObject, m_Buttons[2]),     sizeof(UINT32) },
-        { StateNodeType::Integer,           offsetof(InputRemotingObject, m_Buttons[3]),     sizeof(UINT32) },
-        { StateNodeType::Integer,           offsetof(InputRemotingObject, m_TargetNodeID),   sizeof(UINT32) },
-    };
-
-    *ppMemberDatas = Members;
-    *pMemberDataCount = ARRAYSIZE(Members);
-}
-
 void InputRemotingObject::ClientUpdate(const NetworkInputState& InputState)
 {
     m_XAxis0 = InputState.XAxis0;
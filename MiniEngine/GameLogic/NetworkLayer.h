@@ -180,7 +180,7 @@ public:
 
     static const CHAR* GetTemplateName() { return "$InputRemoting"; }
 
-    VOID GetMemberDatas(const MemberDataPosition** ppMemberDatas, UINT* pMemberDataCount) const;
+    DECLARE_NETWORK_MEMBERS()
 
     void ClientZero()
     {
@@ -194,3 +194,16 @@ public:
     void ServerTick(GameNetServer* pServer, FLOAT DeltaTime, DOUBLE AbsoluteTime);
     void NetworkObjectDeleted(INetworkObject* pNO);
 };
+
+DEFINE_NETWORK_MEMBERS(InputRemotingObject,
+    NETWORK_MEMBER(InputRemotingObject, Float,   m_XAxis0),
+    NETWORK_MEMBER(InputRemotingObject, Float,   m_YAxis0),
+    NETWORK_MEMBER(InputRemotingObject, Float,   m_XAxis1),
+    NETWORK_MEMBER(InputRemotingObject, Float,   m_YAxis1),
+    NETWORK_MEMBER(InputRemotingObject, Float,   m_LeftTrigger),
+    NETWORK_MEMBER(InputRemotingObject, Float,   m_RightTrigger),
+    NETWORK_MEMBER(InputRemotingObject, Integer, m_Buttons[0]),
+    NETWORK_MEMBER(InputRemotingObject, Integer, m_Buttons[1]),
+    NETWORK_MEMBER(InputRemotingObject, Integer, m_Buttons[2]),
+    NETWORK_MEMBER(InputRemotingObject, Integer, m_Buttons[3]),
+    NETWORK_MEMBER(InputRemotingObject, Integer, m_TargetNodeID))